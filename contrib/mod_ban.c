@@ -184,6 +184,22 @@ static pr_memcache_t *mcache = NULL;
 /* For communicating with Redis servers for shared/cached ban data. */
 static pr_redis_t *redis = NULL;
 
+/* Redis cache entries looked up ahead of time, all using a single command;
+ * each is used (once) in place of looking up that entry again.
+ */
+#define BAN_CACHE_PREFETCH_MAXSZ	2
+struct ban_cache_prefetch {
+  unsigned int type;
+  const char *name;
+
+  /* A NULL value indicates that there is no such entry. */
+  void *value;
+  size_t valuesz;
+};
+
+static struct ban_cache_prefetch ban_cache_prefetched[BAN_CACHE_PREFETCH_MAXSZ];
+static unsigned int ban_cache_nprefetched = 0;
+
 struct ban_cache_entry {
   int version;
 
@@ -586,6 +602,104 @@ static int ban_cache_entry_decode_json(pool *p, void *value, size_t valuesz,
   return 0;
 }
 
+static void ban_cache_prefetch_cleanup(void *data) {
+  ban_cache_nprefetched = 0;
+}
+
+/* Looks up the Redis cache entries for the given types/names using a single
+ * MGET.  The prefetched values are allocated from, and are only valid for the
+ * lifetime of, the given pool.
+ */
+static int ban_cache_prefetch(pool *p, unsigned int count,
+    unsigned int *types, const char **names) {
+  register unsigned int i;
+  int res;
+  array_header *keys, *keyszs, *values = NULL, *valueszs = NULL;
+
+  if (redis == NULL ||
+      count > BAN_CACHE_PREFETCH_MAXSZ) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  keys = make_array(p, count, sizeof(char *));
+  keyszs = make_array(p, count, sizeof(size_t));
+
+  for (i = 0; i < count; i++) {
+    void *key = NULL;
+    size_t keysz = 0;
+
+    res = ban_cache_get_key(p, types[i], names[i], &key, &keysz);
+    if (res < 0) {
+      return -1;
+    }
+
+    *((char **) push_array(keys)) = key;
+    *((size_t *) push_array(keyszs)) = keysz;
+  }
+
+  res = pr_redis_kmget(p, redis, &ban_module, keys, keyszs, &values,
+    &valueszs);
+  if (res < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 8,
+      "error prefetching %u Redis entries: %s", count, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  for (i = 0; i < count; i++) {
+    ban_cache_prefetched[i].type = types[i];
+    ban_cache_prefetched[i].name = names[i];
+    ban_cache_prefetched[i].value = ((void **) values->elts)[i];
+    ban_cache_prefetched[i].valuesz = ((size_t *) valueszs->elts)[i];
+  }
+
+  ban_cache_nprefetched = count;
+  register_cleanup(p, NULL, ban_cache_prefetch_cleanup,
+    ban_cache_prefetch_cleanup);
+
+  pr_trace_msg(trace_channel, 9, "prefetched %u Redis entries", count);
+  return 0;
+}
+
+/* Returns 0 if the entry for the given type/name was prefetched, with the
+ * value being NULL if there is no such entry; -1 otherwise.
+ */
+static int ban_cache_prefetch_get(unsigned int type, const char *name,
+    void **value, size_t *valuesz) {
+  register unsigned int i;
+
+  for (i = 0; i < ban_cache_nprefetched; i++) {
+    struct ban_cache_prefetch *bcp;
+
+    bcp = &(ban_cache_prefetched[i]);
+    if (bcp->name == NULL ||
+        bcp->type != type ||
+        strcmp(bcp->name, name) != 0) {
+      continue;
+    }
+
+    *value = bcp->value;
+    *valuesz = bcp->valuesz;
+
+    /* A prefetched entry is only used once; later lookups, e.g. after the
+     * entry has been changed, go to Redis.
+     */
+    bcp->name = NULL;
+
+    if (*value == NULL) {
+      errno = ENOENT;
+    }
+
+    return 0;
+  }
+
+  return -1;
+}
+
 static int ban_cache_entry_get(pool *p, unsigned int type, const char *name,
     struct ban_cache_entry *bce) {
   int res;
@@ -601,8 +715,10 @@ static int ban_cache_entry_get(pool *p, unsigned int type, const char *name,
   if (redis != NULL) {
     driver = "Redis";
 
-    value = pr_redis_kget(p, redis, &ban_module, (const char *) key, keysz,
-      &valuesz);
+    if (ban_cache_prefetch_get(type, name, &value, &valuesz) < 0) {
+      value = pr_redis_kget(p, redis, &ban_module, (const char *) key, keysz,
+        &valuesz);
+    }
 
   } else {
     uint32_t flags = 0;
@@ -3695,8 +3811,25 @@ static int ban_sess_init(void) {
   /* Make sure the list is up-to-date. */
   ban_list_expire();
 
-  /* Check banned host list */
   remote_ip = pr_netaddr_get_ipstr(session.c->remote_addr);
+
+  /* Both the host and class bans may be cached; look them up in Redis
+   * together, rather than one at a time.
+   */
+  if (redis != NULL &&
+      session.conn_class != NULL) {
+    unsigned int types[2];
+    const char *names[2];
+
+    types[0] = BAN_TYPE_HOST;
+    names[0] = remote_ip;
+    types[1] = BAN_TYPE_CLASS;
+    names[1] = session.conn_class->cls_name;
+
+    (void) ban_cache_prefetch(tmp_pool, 2, types, names);
+  }
+
+  /* Check banned host list */
   if (ban_list_exists(tmp_pool, BAN_TYPE_HOST, main_server->sid, remote_ip,
       &rule_mesg) == 0) {
     (void) pr_log_writefile(ban_logfd, MOD_BAN_VERSION,
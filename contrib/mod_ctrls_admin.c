@@ -49,6 +49,9 @@
 /* For the 'shutdown' control action */
 #define CTRLS_DEFAULT_SHUTDOWN_WAIT	5
 
+/* For the 'trace dump' control action; responses are limited to 1024 */
+#define CTRLS_ADMIN_TRACE_DUMP_MAX	1000
+
 /* From src/dirtree.c */
 extern xaset_t *server_list;
 extern int ServerUseReverseDNS;
@@ -108,6 +111,23 @@ static void mem_printf(const char *fmt, ...) {
 }
 #endif /* !PR_USE_DEVEL */
 
+static pr_ctrls_t *metrics_ctrl = NULL;
+
+static void metrics_printf(const char *fmt, ...) {
+  char buf[PR_TUNABLE_BUFFER_SIZE];
+  va_list msg;
+
+  memset(buf, '\0', sizeof(buf));
+
+  va_start(msg, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, msg);
+  va_end(msg);
+
+  buf[sizeof(buf)-1] = '\0';
+
+  pr_ctrls_add_response(metrics_ctrl, "%s", buf);
+}
+
 /* Controls handlers
  */
 
@@ -1017,6 +1037,46 @@ static int ctrls_handle_kick(pr_ctrls_t *ctrl, int reqargc,
   return res;
 }
 
+static int ctrls_handle_metrics(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+
+  /* Check the metrics ACL. */
+  if (!pr_ctrls_check_acl(ctrl, ctrls_admin_acttab, "metrics")) {
+
+    /* Access denied. */
+    pr_ctrls_add_response(ctrl, "access denied");
+    return -1;
+  }
+
+  if (reqargc > 1) {
+    pr_ctrls_add_response(ctrl, "wrong number of parameters");
+    return -1;
+  }
+
+  if (pr_metrics_enabled() == FALSE) {
+    pr_ctrls_add_response(ctrl, "metrics: MetricsEngine not enabled");
+    return -1;
+  }
+
+  if (reqargc == 1) {
+    if (strcmp(reqargv[0], "reset") != 0) {
+      pr_ctrls_add_response(ctrl, "unknown metrics action '%s'", reqargv[0]);
+      return -1;
+    }
+
+    (void) pr_metrics_reset();
+    pr_ctrls_log(MOD_CTRLS_ADMIN_VERSION, "metrics: reset metrics");
+    pr_ctrls_add_response(ctrl, "metrics reset");
+    return 0;
+  }
+
+  metrics_ctrl = ctrl;
+  pr_metrics_dump(metrics_printf);
+  metrics_ctrl = NULL;
+
+  return 0;
+}
+
 static int ctrls_handle_restart(pr_ctrls_t *ctrl, int reqargc,
     char **reqargv) {
 
@@ -1314,7 +1374,46 @@ static int ctrls_handle_trace(pr_ctrls_t *ctrl, int reqargc,
     return -1;
   }
 
-  if (strcmp(reqargv[0], "info") != 0) {
+  if (strcmp(reqargv[0], "dump") == 0) {
+    array_header *lines;
+    pid_t pid = 0;
+    register unsigned int i;
+
+    if (reqargc > 2) {
+      pr_ctrls_add_response(ctrl, "trace: wrong number of parameters");
+      return -1;
+    }
+
+    if (reqargc == 2) {
+      char *ptr = NULL;
+
+      pid = (pid_t) strtol(reqargv[1], &ptr, 10);
+      if (ptr == NULL ||
+          *ptr != '\0' ||
+          pid <= 0) {
+        pr_ctrls_add_response(ctrl, "trace: invalid pid: '%s'", reqargv[1]);
+        return -1;
+      }
+    }
+
+    lines = pr_trace_read_buffer(ctrl->ctrls_tmp_pool, pid,
+      CTRLS_ADMIN_TRACE_DUMP_MAX);
+    if (lines == NULL) {
+      pr_ctrls_add_response(ctrl, "trace: error reading TraceBuffer: %s",
+        strerror(errno));
+      return -1;
+    }
+
+    if (lines->nelts == 0) {
+      pr_ctrls_add_response(ctrl, "trace: TraceBuffer is empty");
+      return 0;
+    }
+
+    for (i = 0; i < lines->nelts; i++) {
+      pr_ctrls_add_response(ctrl, "%s", ((char **) lines->elts)[i]);
+    }
+
+  } else if (strcmp(reqargv[0], "info") != 0) {
     register int i;
 
     for (i = 0; i < reqargc; i++) {
@@ -1708,6 +1807,8 @@ static ctrls_acttab_t ctrls_admin_acttab[] = {
     ctrls_handle_get },
   { "kick",	"disconnect a class, host, or user",	NULL,
     ctrls_handle_kick },
+  { "metrics",	"display or reset command latency metrics",	NULL,
+    ctrls_handle_metrics },
   { "restart",  "restart the daemon (similar to using HUP)",	NULL,
     ctrls_handle_restart },
   { "scoreboard", "clean the ScoreboardFile", NULL,
@@ -1716,7 +1817,7 @@ static ctrls_acttab_t ctrls_admin_acttab[] = {
     ctrls_handle_shutdown },
   { "status",	"display status of servers",		NULL,
     ctrls_handle_status },
-  { "trace",	"set trace levels",		NULL,
+  { "trace",	"set trace levels, dump trace buffer",	NULL,
     ctrls_handle_trace },
   { "up",       "enable a downed virtual server",       NULL,
     ctrls_handle_up },
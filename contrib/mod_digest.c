@@ -75,6 +75,8 @@
 # include <openssl/bio.h>
 # include <openssl/evp.h>
 # include <openssl/err.h>
+# include <openssl/hmac.h>
+# include <openssl/rand.h>
 #endif
 
 module digest_module;
@@ -96,6 +98,7 @@ static int digest_engine = TRUE;
 static pool *digest_pool = NULL;
 
 #define DIGEST_OPT_NO_TRANSFER_CACHE		0x0001
+#define DIGEST_OPT_PERSISTENT_CACHE		0x0002
 
 /* Note that the internal APIs for opportunistic caching only appeared,
  * in working order, in 1.3.6rc2.  So disable it by default for earlier
@@ -134,6 +137,51 @@ static xaset_t *digest_cache_keys = NULL;
 /* How often do we check for expired cache entries (in secs)? */
 #define DIGEST_CACHE_EXPIRY_INTVL		5
 
+/* The persistent cache stores whole-file digests in user extended attributes,
+ * one per algorithm, e.g. "user.proftpd.digest.sha1".  The attribute value
+ * records the identity of the file when the digest was computed:
+ *
+ *  "<version> <dev> <inode> <size> <mtime> <mtime nsecs> <ctime min>
+ *     <ctime max> <hex digest> <hex MAC>"
+ *
+ * A stored digest is only used if the file's current identity matches, and
+ * its ctime (in nsecs) falls within the recorded range.  Setting the
+ * attribute itself changes the ctime, so the range is that of the ctime
+ * expected once the attribute is set (which is checked afterward); any later
+ * change to the file, even one which restores its size and mtime, moves the
+ * ctime past that range, so stale digests are simply ignored, and then
+ * overwritten.
+ *
+ * The owner of a file can write its user attributes, thus the value ends with
+ * an HMAC of the rest of it, using a random key which the daemon generates
+ * at startup, and which the session processes inherit; values which were not
+ * stored by this daemon are not used.
+ */
+#define DIGEST_XATTR_PREFIX			"user.proftpd.digest."
+#define DIGEST_XATTR_VERSION			"3"
+#define DIGEST_XATTR_MAX_SIZE			512
+
+/* How long, in nsecs, setting the attribute may take. */
+#define DIGEST_XATTR_CTIME_WINDOW_NSECS		(100 * 1000000ULL)
+
+/* How far, in nsecs, the ctime set by the filesystem may lag behind the
+ * current time, e.g. for filesystems which only record whole seconds.
+ */
+#define DIGEST_XATTR_CTIME_SLACK_NSECS		(1000 * 1000000ULL)
+
+/* The key for the MACs of the stored values. */
+#define DIGEST_XATTR_KEY_SIZE			32
+static unsigned char digest_xattr_key[DIGEST_XATTR_KEY_SIZE];
+static int digest_xattr_have_key = FALSE;
+
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+# define DIGEST_ST_MTIME_NSECS(st)		((st)->st_mtim.tv_nsec)
+# define DIGEST_ST_CTIME_NSECS(st)		((st)->st_ctim.tv_nsec)
+#else
+# define DIGEST_ST_MTIME_NSECS(st)		0
+# define DIGEST_ST_CTIME_NSECS(st)		0
+#endif /* HAVE_STRUCT_STAT_ST_MTIM */
+
 /* Digest algorithms supported by mod_digest. */
 #define DIGEST_ALGO_CRC32		0x0001
 #ifndef OPENSSL_NO_MD5
@@ -235,81 +283,35 @@ static char *digest_bin2hex(pool *p, const unsigned char *buf, size_len,
 
 #define CRC32_BLOCK		4
 #define CRC32_DIGEST_LENGTH	4
-#define CRC32_TABLE_SIZE	256
 
+/* The CRC itself is computed by the core CRC32 API, which picks the fastest
+ * engine (slice-by-8 tables, or PCLMULQDQ folding) for this CPU.
+ */
 typedef struct crc32_ctx_st {
-  uint32_t *crc32_table;
   uint32_t data;
 } CRC32_CTX;
 
 static int CRC32_Init(CRC32_CTX *ctx) {
-  register unsigned int i;
-
-  /* Initialize the lookup table.   The magic number in the loop is the official
-   * polynomial used by CRC32 in PKZip.
-   */
-
-  ctx->crc32_table = malloc(sizeof(uint32_t) * CRC32_TABLE_SIZE);
-  if (ctx->crc32_table == NULL) {
-    errno = ENOMEM;
-    return 0;
-  }
-
-  for (i = 0; i < CRC32_TABLE_SIZE; i++) {
-    register unsigned int j;
-    uint32_t crc;
-
-    crc = i;
-    for (j = 8; j > 0; j--) {
-      if (crc & 1) {
-        crc = (crc >> 1) ^ 0xEDB88320;
-      } else {
-        crc >>= 1;
-      }
-    }
-
-    ctx->crc32_table[i] = crc;
-  }
-
-  ctx->data = 0xffffffff;
+  ctx->data = 0;
   return 1;
 }
 
-#define CRC32(ctx, c, b) (ctx->crc32_table[((int)(c) ^ (b)) & 0xff] ^ ((c) >> 8))
-#define DOCRC(ctx, c, d)  c = CRC32(ctx, c, *d++)
-
 static int CRC32_Update(CRC32_CTX *ctx, const unsigned char *data,
     size_t datasz) {
-
-  if (datasz == 0) {
-    return 1;
-  }
-
-  while (datasz > 0) {
-    DOCRC(ctx, ctx->data, data);
-    datasz--;
-  }
-
+  ctx->data = pr_crc32(ctx->data, data, datasz);
   return 1;
 }
 
 static int CRC32_Final(unsigned char *md, CRC32_CTX *ctx) {
   uint32_t crc;
 
-  crc = ctx->data;
-  crc ^= 0xffffffff;
-  crc = htonl(crc);
+  crc = htonl(ctx->data);
 
   memcpy(md, &crc, sizeof(crc));
   return 1;
 }
 
 static int CRC32_Free(CRC32_CTX *ctx) {
-  if (ctx->crc32_table != NULL) {
-    free(ctx->crc32_table);
-    ctx->crc32_table = NULL;
-  }
-
   return 1;
 }
 
@@ -896,6 +898,9 @@ MODRET set_digestoptions(cmd_rec *cmd) {
     if (strcmp(cmd->argv[i], "NoTransferCache") == 0) {
       opts |= DIGEST_OPT_NO_TRANSFER_CACHE;
 
+    } else if (strcmp(cmd->argv[i], "PersistentCache") == 0) {
+      opts |= DIGEST_OPT_PERSISTENT_CACHE;
+
     } else {
       CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown DigestOption '",
         cmd->argv[i], "'", NULL));
@@ -1506,6 +1511,288 @@ static int remove_cached_digest(pool *p, unsigned long algo, const char *path,
   return 0;
 }
 
+/* Returns the file identity prefix of the persistent cache value for the
+ * given file.
+ */
+static const char *get_persistent_prefix(pool *p, struct stat *st) {
+  char buf[256];
+
+  memset(buf, '\0', sizeof(buf));
+  snprintf(buf, sizeof(buf)-1, "%s %llu %llu %" PR_LU " %llu %lu ",
+    DIGEST_XATTR_VERSION, (unsigned long long) st->st_dev,
+    (unsigned long long) st->st_ino, (pr_off_t) st->st_size,
+    (unsigned long long) st->st_mtime,
+    (unsigned long) DIGEST_ST_MTIME_NSECS(st));
+
+  return pstrdup(p, buf);
+}
+
+static uint64_t get_ctime_nsecs(struct stat *st) {
+  return ((uint64_t) st->st_ctime * 1000000000ULL) +
+    (uint64_t) DIGEST_ST_CTIME_NSECS(st);
+}
+
+static const char *get_persistent_name(pool *p, unsigned long algo) {
+  register unsigned int i;
+  char *algo_name;
+
+  algo_name = pstrdup(p, get_algo_name(algo, 0));
+  for (i = 0; algo_name[i]; i++) {
+    algo_name[i] = tolower((int) algo_name[i]);
+  }
+
+  return pstrcat(p, DIGEST_XATTR_PREFIX, algo_name, NULL);
+}
+
+/* Returns the hex MAC of the given persistent cache value, or NULL if there
+ * is no key.
+ */
+static const char *get_persistent_mac(pool *p, const char *val, size_t valsz) {
+  unsigned char mac[EVP_MAX_MD_SIZE];
+  unsigned int maclen = 0;
+
+  if (digest_xattr_have_key == FALSE) {
+    errno = EPERM;
+    return NULL;
+  }
+
+  if (HMAC(EVP_sha256(), digest_xattr_key, sizeof(digest_xattr_key),
+      (const unsigned char *) val, valsz, mac, &maclen) == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  return pr_str_bin2hex(p, mac, maclen, PR_STR_FL_HEX_USE_UC);
+}
+
+/* Only whole-file digests are persisted; storing arbitrary ranges would let
+ * clients fill up the limited extended attribute space of a file.
+ */
+static int can_persist_digest(const char *path, time_t mtime, off_t start,
+    size_t len, struct stat *st) {
+
+  if ((digest_opts & DIGEST_OPT_PERSISTENT_CACHE) == 0) {
+    errno = ENOENT;
+    return FALSE;
+  }
+
+  if (start != 0) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  if (pr_fsio_stat(path, st) < 0) {
+    return FALSE;
+  }
+
+  if (!S_ISREG(st->st_mode) ||
+      st->st_mtime != mtime ||
+      (off_t) len != st->st_size) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static int persist_digest(pool *p, unsigned long algo, const char *path,
+    time_t mtime, off_t start, size_t len, const char *hex_digest) {
+  int res;
+  struct stat st;
+  struct timeval tv;
+  const char *name, *prefix, *mac;
+  char ctime_range[64], *val;
+  uint64_t ctime_min, ctime_max, ctime_nsecs = 0;
+
+  if (can_persist_digest(path, mtime, start, len, &st) == FALSE) {
+    return -1;
+  }
+
+  if (gettimeofday(&tv, NULL) < 0) {
+    return -1;
+  }
+
+  /* Setting the attribute sets the ctime to the current time, as recorded
+   * by the filesystem.
+   */
+  ctime_min = ((uint64_t) tv.tv_sec * 1000000000ULL) +
+    ((uint64_t) tv.tv_usec * 1000) - DIGEST_XATTR_CTIME_SLACK_NSECS;
+  ctime_max = ctime_min + DIGEST_XATTR_CTIME_SLACK_NSECS +
+    DIGEST_XATTR_CTIME_WINDOW_NSECS;
+
+  memset(ctime_range, '\0', sizeof(ctime_range));
+  snprintf(ctime_range, sizeof(ctime_range)-1, "%llu %llu ",
+    (unsigned long long) ctime_min, (unsigned long long) ctime_max);
+
+  name = get_persistent_name(p, algo);
+  prefix = get_persistent_prefix(p, &st);
+  val = pstrcat(p, prefix, ctime_range, hex_digest, NULL);
+
+  mac = get_persistent_mac(p, val, strlen(val));
+  if (mac == NULL) {
+    return -1;
+  }
+  val = pstrcat(p, val, " ", mac, NULL);
+
+  res = pr_fsio_setxattr(p, path, name, val, strlen(val), 0);
+  if (res < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 8,
+      "error storing %s digest for '%s' in '%s' attribute: %s",
+      get_algo_name(algo, 0), path, name, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Re-read the ctime, as changed by setting the attribute; if it is not in
+   * the stored range, or if the file has changed meanwhile, the stored digest
+   * is not usable, and is removed.
+   */
+  pr_fs_clear_cache2(path);
+  res = pr_fsio_stat(path, &st);
+  if (res == 0) {
+    ctime_nsecs = get_ctime_nsecs(&st);
+  }
+
+  if (res < 0 ||
+      strcmp(get_persistent_prefix(p, &st), prefix) != 0 ||
+      ctime_nsecs < ctime_min ||
+      ctime_nsecs > ctime_max) {
+    pr_trace_msg(trace_channel, 8,
+      "'%s' changed while storing %s digest, removing '%s' attribute", path,
+      get_algo_name(algo, 0), name);
+    (void) pr_fsio_removexattr(p, path, name);
+
+    errno = EAGAIN;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 12,
+    "stored %s digest '%s' for '%s' in '%s' attribute", get_algo_name(algo, 0),
+    hex_digest, path, name);
+  return 0;
+}
+
+static char *get_persisted_digest(pool *p, unsigned long algo,
+    const char *path, time_t mtime, off_t start, size_t len) {
+  register unsigned int i;
+  struct stat st;
+  const char *name, *prefix, *mac;
+  char buf[DIGEST_XATTR_MAX_SIZE], *hex_digest, *ptr;
+  ssize_t buflen;
+  size_t prefixlen, hex_len;
+  uint64_t ctime_min, ctime_max, ctime_nsecs;
+
+  if (can_persist_digest(path, mtime, start, len, &st) == FALSE) {
+    return NULL;
+  }
+
+  name = get_persistent_name(p, algo);
+
+  memset(buf, '\0', sizeof(buf));
+  buflen = pr_fsio_getxattr(p, path, name, buf, sizeof(buf)-1);
+  if (buflen < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 19,
+      "no %s digest stored for '%s' in '%s' attribute: %s",
+      get_algo_name(algo, 0), path, name, strerror(xerrno));
+
+    errno = xerrno;
+    return NULL;
+  }
+
+  buf[buflen] = '\0';
+
+  prefix = get_persistent_prefix(p, &st);
+  prefixlen = strlen(prefix);
+
+  if ((size_t) buflen <= prefixlen ||
+      strncmp(buf, prefix, prefixlen) != 0) {
+    pr_trace_msg(trace_channel, 12,
+      "stored %s digest for '%s' is stale, ignoring", get_algo_name(algo, 0),
+      path);
+    errno = ENOENT;
+    return NULL;
+  }
+
+  /* Only use values which we stored ourselves. */
+  ptr = strrchr(buf, ' ');
+  if (ptr == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  *ptr = '\0';
+  mac = get_persistent_mac(p, buf, ptr - buf);
+  if (mac == NULL ||
+      strlen(mac) != strlen(ptr + 1) ||
+      CRYPTO_memcmp(mac, ptr + 1, strlen(mac)) != 0) {
+    pr_trace_msg(trace_channel, 3,
+      "stored %s digest for '%s' was not stored by us, ignoring",
+      get_algo_name(algo, 0), path);
+    errno = EPERM;
+    return NULL;
+  }
+  buflen = ptr - buf;
+
+  ctime_min = strtoull(buf + prefixlen, &ptr, 10);
+  if (*ptr != ' ') {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  ctime_max = strtoull(ptr + 1, &ptr, 10);
+  if (*ptr != ' ') {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  /* We never store a wider range than this. */
+  if (ctime_max < ctime_min ||
+      ctime_max - ctime_min > DIGEST_XATTR_CTIME_SLACK_NSECS +
+        DIGEST_XATTR_CTIME_WINDOW_NSECS) {
+    pr_trace_msg(trace_channel, 3,
+      "stored %s digest for '%s' has invalid ctime range, ignoring",
+      get_algo_name(algo, 0), path);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  ctime_nsecs = get_ctime_nsecs(&st);
+  if (ctime_nsecs < ctime_min ||
+      ctime_nsecs > ctime_max) {
+    pr_trace_msg(trace_channel, 12,
+      "stored %s digest for '%s' is stale (file changed), ignoring",
+      get_algo_name(algo, 0), path);
+    errno = ENOENT;
+    return NULL;
+  }
+
+  hex_digest = ptr + 1;
+  hex_len = buflen - (hex_digest - buf);
+
+  /* Make sure that what is stored looks like a digest of this algorithm. */
+  if (hex_len != (size_t) (EVP_MD_size(get_algo_md(algo)) * 2)) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  for (i = 0; i < hex_len; i++) {
+    if (!isxdigit((int) hex_digest[i])) {
+      errno = EINVAL;
+      return NULL;
+    }
+  }
+
+  pr_trace_msg(trace_channel, 12,
+    "using stored %s digest '%s' for '%s'", get_algo_name(algo, 0),
+    hex_digest, path);
+  return pstrdup(p, hex_digest);
+}
+
 static int add_cached_digest(pool *p, cmd_rec *cmd, unsigned long algo,
     const char *path, time_t mtime, off_t start, size_t len,
     const char *hex_digest) {
@@ -1546,6 +1833,9 @@ static int add_cached_digest(pool *p, cmd_rec *cmd, unsigned long algo,
       get_algo_name(algo, 0), cache_key->key);
   }
 
+  (void) persist_digest(cmd->tmp_pool, algo, path, mtime, start, len,
+    hex_digest);
+
   return res;
 }
 
@@ -1596,15 +1886,22 @@ static char *get_cached_digest(pool *p, unsigned long algo, const char *path,
           strerror(errno));
       }
 
-      errno = ENOENT;
-      return NULL;
+    } else {
+      hex_digest = pstrdup(p, val);
+      pr_trace_msg(trace_channel, 12,
+        "using cached digest '%s' for %s digest, key '%s'", hex_digest,
+        algo_name, key);
+      return hex_digest;
     }
+  }
 
-    hex_digest = pstrdup(p, val);
-    pr_trace_msg(trace_channel, 12,
-      "using cached digest '%s' for %s digest, key '%s'", hex_digest,
-      algo_name, key);
-    return hex_digest;
+  if (digest_opts & DIGEST_OPT_PERSISTENT_CACHE) {
+    char *hex_digest;
+
+    hex_digest = get_persisted_digest(p, algo, path, mtime, start, len);
+    if (hex_digest != NULL) {
+      return hex_digest;
+    }
   }
 
   errno = ENOENT;
@@ -2817,6 +3114,18 @@ static int digest_init(void) {
   digest_pool = make_sub_pool(permanent_pool);
   pr_pool_tag(digest_pool, MOD_DIGEST_VERSION);
 
+  /* Generated once, in the daemon, so that all sessions use the same key for
+   * the persistent cache.
+   */
+  if (RAND_bytes(digest_xattr_key, sizeof(digest_xattr_key)) == 1) {
+    digest_xattr_have_key = TRUE;
+
+  } else {
+    pr_log_pri(PR_LOG_NOTICE, MOD_DIGEST_VERSION
+      ": unable to generate DigestOptions PersistentCache key: %s",
+      ERR_error_string(ERR_get_error(), NULL));
+  }
+
 #if defined(PR_SHARED_MODULE)
   pr_event_register(&digest_module, "core.module-unload", digest_mod_unload_ev,
     NULL);
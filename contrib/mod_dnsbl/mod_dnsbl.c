@@ -37,8 +37,21 @@
 #include <arpa/nameser.h>
 #include <resolv.h>
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+#ifndef MAP_FAILED
+# define MAP_FAILED	((void *) -1)
+#endif /* MAP_FAILED */
+
 #define DNSBL_REASON_MAX_LEN		256
 
+/* Default overall deadline, in seconds, for the DNSBL queries of a single
+ * connection.
+ */
+#define DNSBL_DEFAULT_TIMEOUT		5
+
 module dnsbl_module;
 
 static int dnsbl_engine = FALSE;
@@ -46,6 +59,55 @@ static int dnsbl_logfd = -1;
 
 static const char *trace_channel = "dnsbl";
 
+/* The result cache lives in an anonymous shared memory segment, allocated by
+ * the daemon process and thus inherited by all session processes.  Each
+ * entry records whether a DNSBL query name (i.e. the reversed client address
+ * plus the DNSBL domain) is listed, until the TTL of the DNS record which
+ * provided that answer expires.
+ *
+ * As for the Netaddr API's shared DNS cache, entries are protected by a
+ * sequence number: writers make it odd while updating the entry, and
+ * readers ignore an entry whose sequence number was odd or changed while
+ * they were copying it.
+ */
+#if defined(__GNUC__) && \
+    ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+# define DNSBL_HAVE_CACHE	1
+#endif
+
+#define DNSBL_CACHE_PROBES	4
+#define DNSBL_CACHE_NAMESZ	256
+
+struct dnsbl_cache_entry {
+  unsigned int seqno;
+  time_t expires;
+  int listed;
+  char name[DNSBL_CACHE_NAMESZ];
+};
+
+struct dnsbl_cache {
+  unsigned int nentries;
+  unsigned long nhits, nmisses;
+  struct dnsbl_cache_entry entries[1];
+};
+
+static struct dnsbl_cache *dnsbl_cache = NULL;
+static size_t dnsbl_cachesz = 0;
+
+/* A DNSBL query in flight. */
+struct dnsbl_query {
+  const char *domain;
+  const char *name;
+
+  unsigned char req[NS_PACKETSZ];
+  int reqlen;
+  unsigned int id;
+
+  int done;
+  int listed;
+  int cached;
+};
+
 /* Necessary prototypes. */
 static int dnsbl_sess_init(void);
 
@@ -55,6 +117,166 @@ typedef enum {
 
 } dnsbl_policy_e;
 
+static unsigned int dnsbl_cache_hash(const char *name) {
+  unsigned int h = 2166136261U;
+
+  /* FNV-1a */
+  while (*name) {
+    h ^= (unsigned char) *name++;
+    h *= 16777619U;
+  }
+
+  return h;
+}
+
+/* Returns TRUE or FALSE for a cached listing result for the given query name,
+ * or -1 if there is no such result.
+ */
+static int dnsbl_cache_get(const char *name) {
+#if defined(DNSBL_HAVE_CACHE)
+  register unsigned int i;
+  unsigned int h;
+  time_t now;
+
+  if (dnsbl_cache == NULL) {
+    return -1;
+  }
+
+  h = dnsbl_cache_hash(name);
+  time(&now);
+
+  for (i = 0; i < DNSBL_CACHE_PROBES; i++) {
+    struct dnsbl_cache_entry *entry, copy;
+    unsigned int seqno;
+
+    entry = &(dnsbl_cache->entries[(h + i) % dnsbl_cache->nentries]);
+
+    seqno = *((volatile unsigned int *) &(entry->seqno));
+    if (seqno & 1) {
+      continue;
+    }
+
+    __sync_synchronize();
+    memcpy(&copy, entry, sizeof(copy));
+    __sync_synchronize();
+
+    if (*((volatile unsigned int *) &(entry->seqno)) != seqno) {
+      continue;
+    }
+
+    if (copy.expires > now &&
+        strncmp(copy.name, name, sizeof(copy.name)) == 0) {
+      __sync_fetch_and_add(&(dnsbl_cache->nhits), 1);
+      return copy.listed;
+    }
+  }
+
+  __sync_fetch_and_add(&(dnsbl_cache->nmisses), 1);
+#endif /* DNSBL_HAVE_CACHE */
+
+  return -1;
+}
+
+static void dnsbl_cache_set(const char *name, int listed, unsigned int ttl) {
+#if defined(DNSBL_HAVE_CACHE)
+  register unsigned int i;
+  unsigned int h, seqno;
+  struct dnsbl_cache_entry *slot = NULL;
+  time_t now;
+
+  if (dnsbl_cache == NULL ||
+      ttl == 0 ||
+      strlen(name) >= DNSBL_CACHE_NAMESZ) {
+    return;
+  }
+
+  h = dnsbl_cache_hash(name);
+  time(&now);
+
+  /* Prefer the slot already holding this name, then the slot expiring
+   * soonest (which includes unused slots).
+   */
+  for (i = 0; i < DNSBL_CACHE_PROBES; i++) {
+    struct dnsbl_cache_entry *entry;
+
+    entry = &(dnsbl_cache->entries[(h + i) % dnsbl_cache->nentries]);
+    if (strncmp(entry->name, name, sizeof(entry->name)) == 0) {
+      slot = entry;
+      break;
+    }
+
+    if (slot == NULL ||
+        entry->expires < slot->expires) {
+      slot = entry;
+    }
+  }
+
+  seqno = *((volatile unsigned int *) &(slot->seqno));
+  if ((seqno & 1) ||
+      !__sync_bool_compare_and_swap(&(slot->seqno), seqno, seqno + 1)) {
+    /* Another process is updating this slot; skip caching. */
+    return;
+  }
+
+  __sync_synchronize();
+  sstrncpy(slot->name, name, sizeof(slot->name));
+  slot->listed = listed;
+  slot->expires = now + ttl;
+  __sync_synchronize();
+  slot->seqno = seqno + 2;
+
+  pr_trace_msg(trace_channel, 15,
+    "cached %s result for '%s' for %u secs", listed ? "listed" : "unlisted",
+    name, ttl);
+#endif /* DNSBL_HAVE_CACHE */
+}
+
+static int dnsbl_cache_init(unsigned int nentries) {
+#if defined(DNSBL_HAVE_CACHE)
+  void *shm;
+  size_t shmsz;
+  int mmap_flags = MAP_SHARED;
+
+# if defined(MAP_ANONYMOUS)
+  mmap_flags |= MAP_ANONYMOUS;
+# elif defined(MAP_ANON)
+  mmap_flags |= MAP_ANON;
+# else
+  errno = ENOSYS;
+  return -1;
+# endif
+
+  shmsz = sizeof(struct dnsbl_cache) +
+    ((nentries - 1) * sizeof(struct dnsbl_cache_entry));
+
+  shm = mmap(NULL, shmsz, PROT_READ|PROT_WRITE, mmap_flags, -1, 0);
+  if (shm == MAP_FAILED) {
+    return -1;
+  }
+
+  memset(shm, 0, shmsz);
+  dnsbl_cache = shm;
+  dnsbl_cachesz = shmsz;
+  dnsbl_cache->nentries = nentries;
+
+  pr_trace_msg(trace_channel, 9,
+    "allocated %lu bytes for DNSBL cache (%u entries)", (unsigned long) shmsz,
+    nentries);
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* DNSBL_HAVE_CACHE */
+}
+
+static void dnsbl_cache_free(void) {
+  if (dnsbl_cache != NULL) {
+    (void) munmap((void *) dnsbl_cache, dnsbl_cachesz);
+    dnsbl_cache = NULL;
+    dnsbl_cachesz = 0;
+  }
+}
+
 static const char *reverse_ip_addr(pool *p, const char *ip_addr) {
   char *addr2, *res, *tmp;
   size_t addrlen = strlen(ip_addr) +1;
@@ -186,10 +408,413 @@ static int lookup_addr(pool *p, const char *addr, const char *domain) {
   return 0;
 }
 
+/* Parse a response to one of our queries for the given name.  Returns TRUE
+ * if the name is listed, FALSE if not, and -1 if the response does not
+ * carry a usable answer.  The TTL for which the answer may be cached is
+ * provided as well.
+ */
+static int parse_response(const unsigned char *resp, int resplen,
+    const char *name, unsigned int *ttl) {
+  ns_msg handle;
+  ns_rr rr;
+  int rcode, rrno, listed = FALSE;
+
+  *ttl = 0;
+
+  if (ns_initparse(resp, resplen, &handle) < 0) {
+    return -1;
+  }
+
+  /* Make sure that this is the answer to the question we asked. */
+  if (ns_msg_count(handle, ns_s_qd) != 1 ||
+      ns_parserr(&handle, ns_s_qd, 0, &rr) < 0 ||
+      strcasecmp(ns_rr_name(rr), name) != 0) {
+    return -1;
+  }
+
+  rcode = ns_msg_getflag(handle, ns_f_rcode);
+  if (rcode != ns_r_noerror &&
+      rcode != ns_r_nxdomain) {
+    pr_trace_msg(trace_channel, 3, "received rcode %d for '%s'", rcode, name);
+    return -1;
+  }
+
+  for (rrno = 0; rrno < ns_msg_count(handle, ns_s_an); rrno++) {
+    if (ns_parserr(&handle, ns_s_an, rrno, &rr) < 0) {
+      continue;
+    }
+
+    if (ns_rr_type(rr) == ns_t_a) {
+      if (listed == FALSE ||
+          ns_rr_ttl(rr) < *ttl) {
+        *ttl = ns_rr_ttl(rr);
+      }
+
+      listed = TRUE;
+    }
+  }
+
+  if (listed == FALSE) {
+    /* A negative answer may be cached for the lesser of the TTL and the
+     * MINIMUM field of the SOA record in the authority section (RFC 2308).
+     */
+    for (rrno = 0; rrno < ns_msg_count(handle, ns_s_ns); rrno++) {
+      if (ns_parserr(&handle, ns_s_ns, rrno, &rr) < 0) {
+        continue;
+      }
+
+      if (ns_rr_type(rr) == ns_t_soa) {
+        *ttl = ns_rr_ttl(rr);
+
+        if (ns_rr_rdlen(rr) >= NS_INT32SZ) {
+          const unsigned char *ptr;
+          unsigned long minimum;
+
+          ptr = ns_rr_rdata(rr) + ns_rr_rdlen(rr) - NS_INT32SZ;
+          NS_GET32(minimum, ptr);
+
+          if (minimum < *ttl) {
+            *ttl = minimum;
+          }
+        }
+
+        break;
+      }
+    }
+  }
+
+  return listed;
+}
+
+static long elapsed_msecs(struct timeval *start) {
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+  return ((now.tv_sec - start->tv_sec) * 1000L) +
+    ((now.tv_usec - start->tv_usec) / 1000L);
+}
+
+/* Send the pending queries to the IPv4 nameservers configured for the system
+ * resolver, all at once, and collect their answers until one of them lists
+ * the client, or all have been answered, or the timeout (in seconds) is
+ * reached.  Queries which are not answered in time are treated as not
+ * listing the client.  Unanswered queries are resent, to the next
+ * nameserver, once half of the timeout has elapsed.
+ *
+ * On return, listed_idx holds the index of the query which lists the client,
+ * or -1.  Returns -1, with errno set, if the queries could not be sent.
+ */
+static int lookup_addrs(struct dnsbl_query *queries, unsigned int nqueries,
+    int timeout, int *listed_idx) {
+  register unsigned int i;
+  struct sockaddr_in ns_addrs[MAXNS];
+  struct timeval start;
+  unsigned int nns = 0, ns_idx = 0, npending = 0;
+  int fd, retransmitted = FALSE, xerrno;
+  long timeout_ms;
+
+  *listed_idx = -1;
+
+  for (i = 0; i < nqueries; i++) {
+    if (queries[i].done == FALSE) {
+      npending++;
+    }
+  }
+
+  if (npending == 0) {
+    return 0;
+  }
+
+  if (!(_res.options & RES_INIT) &&
+      res_init() < 0) {
+    errno = EPERM;
+    return -1;
+  }
+
+  for (i = 0; i < (unsigned int) _res.nscount && i < MAXNS; i++) {
+    if (_res.nsaddr_list[i].sin_family == AF_INET) {
+      memcpy(&(ns_addrs[nns++]), &(_res.nsaddr_list[i]),
+        sizeof(struct sockaddr_in));
+    }
+  }
+
+  if (nns == 0) {
+    pr_trace_msg(trace_channel, 3, "no IPv4 nameservers configured");
+    errno = ENOENT;
+    return -1;
+  }
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  for (i = 0; i < nqueries; i++) {
+    struct dnsbl_query *q = &(queries[i]);
+    register unsigned int j;
+
+    if (q->done) {
+      continue;
+    }
+
+    q->reqlen = res_mkquery(ns_o_query, q->name, ns_c_in, ns_t_a, NULL, 0,
+      NULL, q->req, sizeof(q->req));
+    if (q->reqlen < 0) {
+      (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+        "error constructing query for DNS name '%s'", q->name);
+      q->done = TRUE;
+      npending--;
+      continue;
+    }
+
+    /* Use an unpredictable ID for each query, unique among our queries, so
+     * that the responses can be matched to them.
+     */
+    do {
+      q->id = (unsigned int) pr_random_next(0, 65535);
+
+      for (j = 0; j < i; j++) {
+        if (queries[j].id == q->id) {
+          break;
+        }
+      }
+    } while (j < i);
+
+    q->req[0] = (unsigned char) (q->id >> 8);
+    q->req[1] = (unsigned char) (q->id & 0xff);
+
+    (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+      "for DNSBLDomain '%s', resolving DNS name '%s'", q->domain, q->name);
+
+    if (sendto(fd, q->req, q->reqlen, 0, (struct sockaddr *) &(ns_addrs[0]),
+        sizeof(struct sockaddr_in)) < 0) {
+      pr_trace_msg(trace_channel, 3, "error sending query for '%s': %s",
+        q->name, strerror(errno));
+    }
+  }
+
+  gettimeofday(&start, NULL);
+  timeout_ms = timeout * 1000L;
+
+  while (npending > 0) {
+    unsigned char resp[NS_PACKETSZ];
+    struct sockaddr_in from;
+    socklen_t fromlen;
+    struct timeval tv;
+    fd_set rfds;
+    long wait_ms;
+    int res, resplen, listed;
+    unsigned int id, ttl;
+    struct dnsbl_query *q = NULL;
+
+    pr_signals_handle();
+
+    wait_ms = timeout_ms - elapsed_msecs(&start);
+    if (wait_ms <= 0) {
+      break;
+    }
+
+    if (retransmitted == FALSE &&
+        wait_ms <= timeout_ms / 2) {
+      ns_idx = (ns_idx + 1) % nns;
+
+      for (i = 0; i < nqueries; i++) {
+        if (queries[i].done == FALSE) {
+          pr_trace_msg(trace_channel, 9, "resending query for '%s'",
+            queries[i].name);
+          (void) sendto(fd, queries[i].req, queries[i].reqlen, 0,
+            (struct sockaddr *) &(ns_addrs[ns_idx]),
+            sizeof(struct sockaddr_in));
+        }
+      }
+
+      retransmitted = TRUE;
+    }
+
+    if (retransmitted == FALSE) {
+      wait_ms -= timeout_ms / 2;
+    }
+
+    tv.tv_sec = wait_ms / 1000L;
+    tv.tv_usec = (wait_ms % 1000L) * 1000L;
+
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+
+    res = select(fd + 1, &rfds, NULL, NULL, &tv);
+    if (res < 0) {
+      xerrno = errno;
+
+      if (xerrno == EINTR) {
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 3, "error waiting for responses: %s",
+        strerror(xerrno));
+      break;
+    }
+
+    if (res == 0) {
+      continue;
+    }
+
+    fromlen = sizeof(from);
+    resplen = recvfrom(fd, resp, sizeof(resp), 0, (struct sockaddr *) &from,
+      &fromlen);
+    if (resplen < NS_HFIXEDSZ) {
+      continue;
+    }
+
+    /* Ignore responses from anyone but our nameservers. */
+    for (i = 0; i < nns; i++) {
+      if (from.sin_addr.s_addr == ns_addrs[i].sin_addr.s_addr &&
+          from.sin_port == ns_addrs[i].sin_port) {
+        break;
+      }
+    }
+
+    if (i == nns) {
+      continue;
+    }
+
+    id = (resp[0] << 8) | resp[1];
+    for (i = 0; i < nqueries; i++) {
+      if (queries[i].done == FALSE &&
+          queries[i].id == id) {
+        q = &(queries[i]);
+        break;
+      }
+    }
+
+    if (q == NULL) {
+      continue;
+    }
+
+    listed = parse_response(resp, resplen, q->name, &ttl);
+    if (listed < 0) {
+      /* Not the answer to our question, or a server failure; keep waiting,
+       * in case the resent query fares better.
+       */
+      continue;
+    }
+
+    q->done = TRUE;
+    q->listed = listed;
+    npending--;
+
+    dnsbl_cache_set(q->name, listed, ttl);
+
+    if (listed) {
+      (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+        "found record for DNS name '%s', client address has been blacklisted",
+        q->name);
+      *listed_idx = i;
+      break;
+    }
+
+    (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+      "no record returned for DNS name '%s', client address is not "
+      "blacklisted", q->name);
+  }
+
+  if (*listed_idx < 0) {
+    for (i = 0; i < nqueries; i++) {
+      if (queries[i].done == FALSE) {
+        (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+          "no answer for DNS name '%s' within %d %s, client address is not "
+          "blacklisted", queries[i].name, timeout,
+          timeout != 1 ? "seconds" : "second");
+      }
+    }
+  }
+
+  (void) close(fd);
+  return 0;
+}
+
+/* Returns the DNSBLDomain which lists the client address, or NULL if none
+ * of them do.  The lists are consulted concurrently, thus if more than one
+ * of them lists the client, the first to answer is returned.
+ */
+static const char *find_listing(pool *p, const char *rev_ip_addr) {
+  config_rec *c;
+  array_header *queries;
+  struct dnsbl_query *q;
+  int timeout = DNSBL_DEFAULT_TIMEOUT, listed_idx = -1;
+  register unsigned int i;
+
+  c = find_config(main_server->conf, CONF_PARAM, "DNSBLTimeout", FALSE);
+  if (c != NULL) {
+    timeout = *((int *) c->argv[0]);
+  }
+
+  queries = make_array(p, 0, sizeof(struct dnsbl_query));
+
+  c = find_config(main_server->conf, CONF_PARAM, "DNSBLDomain", FALSE);
+  while (c != NULL) {
+    int listed;
+
+    pr_signals_handle();
+
+    q = push_array(queries);
+    memset(q, 0, sizeof(struct dnsbl_query));
+    q->domain = c->argv[0];
+    q->name = pstrcat(p, rev_ip_addr, ".", q->domain, NULL);
+
+    listed = dnsbl_cache_get(q->name);
+    if (listed >= 0) {
+      (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+        "for DNSBLDomain '%s', using cached result for DNS name '%s': client "
+        "address is %s", q->domain, q->name,
+        listed ? "blacklisted" : "not blacklisted");
+
+      q->done = q->cached = TRUE;
+      q->listed = listed;
+
+      if (listed) {
+        return q->domain;
+      }
+    }
+
+    c = find_config_next(c, c->next, CONF_PARAM, "DNSBLDomain", FALSE);
+  }
+
+  if (lookup_addrs(queries->elts, queries->nelts, timeout, &listed_idx) < 0) {
+    (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+      "unable to query DNSBLDomains concurrently (%s), querying them in turn",
+      strerror(errno));
+
+    for (i = 0; i < queries->nelts; i++) {
+      q = &(((struct dnsbl_query *) queries->elts)[i]);
+
+      pr_signals_handle();
+
+      if (q->done == FALSE &&
+          lookup_addr(p, rev_ip_addr, q->domain) < 0) {
+        return q->domain;
+      }
+    }
+
+    return NULL;
+  }
+
+  if (listed_idx < 0) {
+    return NULL;
+  }
+
+  q = &(((struct dnsbl_query *) queries->elts)[listed_idx]);
+
+  /* Check for TXT record for this DNS name, to see if the reason for
+   * blacklisting has been configured.
+   */
+  lookup_reason(p, q->name);
+  return q->domain;
+}
+
 static int dnsbl_reject_conn(void) {
   config_rec *c;
   pool *tmp_pool = NULL;
-  const char *rev_ip_addr = NULL;
+  const char *rev_ip_addr = NULL, *domain = NULL;
   int reject_conn = FALSE;
   dnsbl_policy_e policy = DNSBL_POLICY_DENY_ALLOW;
 
@@ -222,57 +847,31 @@ static int dnsbl_reject_conn(void) {
     return -1;
   }
 
-  switch (policy) {
-    /* For this policy, the connection will be allowed unless the connecting
-     * client is listed by any of the DNSBLDomain sites.
-     */
-    case DNSBL_POLICY_ALLOW_DENY: {
-      c = find_config(main_server->conf, CONF_PARAM, "DNSBLDomain", FALSE);
-      while (c) {
-        const char *domain;
-    
-        pr_signals_handle();
-
-        domain = c->argv[0];
-
-        if (lookup_addr(tmp_pool, rev_ip_addr, domain) < 0) {
-          (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
-            "client address '%s' is listed by DNSBLDomain '%s', rejecting "
-            "connection", pr_netaddr_get_ipstr(session.c->remote_addr), domain);
-          reject_conn = TRUE;
-          break;
-        }
-
-        c = find_config_next(c, c->next, CONF_PARAM, "DNSBLDomain", FALSE);
-      }
-
-      break;
-    }
-
-    /* For this policy, the connection will be NOT allowed unless the
-     * connecting client is listed by any of the DNSBLDomain sites.
-     */
-    case DNSBL_POLICY_DENY_ALLOW: {
-      c = find_config(main_server->conf, CONF_PARAM, "DNSBLDomain", FALSE);
-      while (c) {
-        const char *domain;
-
-        pr_signals_handle();
-
-        domain = c->argv[0];
-
-        if (lookup_addr(tmp_pool, rev_ip_addr, domain) < 0) {
-          (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
-            "client address '%s' is listed by DNSBLDomain '%s', allowing "
-            "connection", pr_netaddr_get_ipstr(session.c->remote_addr), domain);
-          reject_conn = FALSE;
-          break;
-        }
-    
-        c = find_config_next(c, c->next, CONF_PARAM, "DNSBLDomain", FALSE);
-      } 
+  /* With either policy, the first DNSBLDomain found to list the client
+   * decides the matter.
+   */
+  domain = find_listing(tmp_pool, rev_ip_addr);
+  if (domain != NULL) {
+    switch (policy) {
+      /* For this policy, the connection will be allowed unless the
+       * connecting client is listed by any of the DNSBLDomain sites.
+       */
+      case DNSBL_POLICY_ALLOW_DENY:
+        (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+          "client address '%s' is listed by DNSBLDomain '%s', rejecting "
+          "connection", pr_netaddr_get_ipstr(session.c->remote_addr), domain);
+        reject_conn = TRUE;
+        break;
 
-      break; 
+      /* For this policy, the connection will be NOT allowed unless the
+       * connecting client is listed by any of the DNSBLDomain sites.
+       */
+      case DNSBL_POLICY_DENY_ALLOW:
+        (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+          "client address '%s' is listed by DNSBLDomain '%s', allowing "
+          "connection", pr_netaddr_get_ipstr(session.c->remote_addr), domain);
+        reject_conn = FALSE;
+        break;
     }
   }
 
@@ -288,6 +887,32 @@ static int dnsbl_reject_conn(void) {
 /* Configuration handlers
  */
 
+/* usage: DNSBLCache off|count */
+MODRET set_dnsblcache(cmd_rec *cmd) {
+  int count = 0;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (strcasecmp(cmd->argv[1], "off") != 0) {
+    char *ptr = NULL;
+
+    count = (int) strtol(cmd->argv[1], &ptr, 10);
+    if ((ptr && *ptr) ||
+        count <= 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted count '",
+        cmd->argv[1], "'", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = count;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: DNSBLDomain domain */
 MODRET set_dnsbldomain(cmd_rec *cmd) {
   char *domain;
@@ -304,6 +929,13 @@ MODRET set_dnsbldomain(cmd_rec *cmd) {
   c = add_config_param_str(cmd->argv[0], 1, domain);
   c->flags |= CF_MERGEDOWN_MULTI;
 
+  /* Ignore trailing '.' in domain, if present. */
+  domain = c->argv[0];
+  if (*domain != '\0' &&
+      domain[strlen(domain)-1] == '.') {
+    domain[strlen(domain)-1] = '\0';
+  }
+
   return PR_HANDLED(cmd);
 }
 
@@ -365,12 +997,73 @@ MODRET set_dnsblpolicy(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: DNSBLTimeout secs */
+MODRET set_dnsbltimeout(cmd_rec *cmd) {
+  int timeout = -1;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  if (pr_str_get_duration(cmd->argv[1], &timeout) < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error parsing timeout value '",
+      cmd->argv[1], "': ", strerror(errno), NULL));
+  }
+
+  if (timeout <= 0) {
+    CONF_ERROR(cmd, "timeout must be greater than zero");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = timeout;
+
+  return PR_HANDLED(cmd);
+}
+
 /* Event listeners
  */
 
+#if defined(PR_SHARED_MODULE)
+static void dnsbl_mod_unload_ev(const void *event_data, void *user_data) {
+  if (strcmp("mod_dnsbl.c", (const char *) event_data) == 0) {
+    pr_event_unregister(&dnsbl_module, NULL, NULL);
+    dnsbl_cache_free();
+  }
+}
+#endif /* PR_SHARED_MODULE */
+
+static void dnsbl_postparse_ev(const void *event_data, void *user_data) {
+  config_rec *c;
+
+  /* The result cache is (re)allocated by the daemon process after every
+   * (re)parse, so that the sessions forked afterward share it.
+   */
+  dnsbl_cache_free();
+
+  c = find_config(main_server->conf, CONF_PARAM, "DNSBLCache", FALSE);
+  if (c != NULL &&
+      *((int *) c->argv[0]) > 0) {
+    if (dnsbl_cache_init(*((unsigned int *) c->argv[0])) < 0) {
+      pr_log_pri(PR_LOG_NOTICE, MOD_DNSBL_VERSION
+        ": notice: unable to allocate DNSBLCache: %s", strerror(errno));
+    }
+  }
+}
+
 /* Initialization functions
  */
 
+static int dnsbl_init(void) {
+#if defined(PR_SHARED_MODULE)
+  pr_event_register(&dnsbl_module, "core.module-unload", dnsbl_mod_unload_ev,
+    NULL);
+#endif /* PR_SHARED_MODULE */
+  pr_event_register(&dnsbl_module, "core.postparse", dnsbl_postparse_ev, NULL);
+
+  return 0;
+}
+
 static void dnsbl_sess_reinit_ev(const void *event_data, void *user_data) {
   int res;
 
@@ -449,10 +1142,12 @@ static int dnsbl_sess_init(void) {
  */
 
 static conftable dnsbl_conftab[] = {
+  { "DNSBLCache",	set_dnsblcache,		NULL },
   { "DNSBLDomain",	set_dnsbldomain,	NULL },
   { "DNSBLEngine",	set_dnsblengine,	NULL },
   { "DNSBLLog",		set_dnsbllog,		NULL },
   { "DNSBLPolicy",	set_dnsblpolicy,	NULL },
+  { "DNSBLTimeout",	set_dnsbltimeout,	NULL },
   { NULL }
 };
 
@@ -475,7 +1170,7 @@ module dnsbl_module = {
   NULL,
 
   /* Module initialization function */
-  NULL,
+  dnsbl_init,
 
   /* Session initialization function */
   dnsbl_sess_init,
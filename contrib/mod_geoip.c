@@ -599,9 +599,30 @@ static const char *get_geoip_filter_value(int filter_id) {
   return NULL;
 }
 
-static void get_geoip_tables(array_header *geoips, int filter_flags,
-    int skip_standard) {
+/* Tables opened with one of these flags, and without CheckCache, do not need
+ * any per-process state once opened.  We open those tables once, in the
+ * daemon process, so that all session processes share the same (read-only)
+ * cached pages, rather than each session loading its own copy.
+ */
+#define GEOIP_SHARED_CACHE_FLAGS \
+  (GEOIP_MEMORY_CACHE|GEOIP_MMAP_CACHE|GEOIP_INDEX_CACHE)
+
+static int is_shared_geoip_table(int flags) {
+  if (flags & GEOIP_CHECK_CACHE) {
+    return FALSE;
+  }
+
+  if (flags & GEOIP_SHARED_CACHE_FLAGS) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Returns the number of configured GeoIPTables which could not be opened. */
+static int get_geoip_tables(array_header *geoips, int shared_tables) {
   config_rec *c;
+  int failed = 0;
 
   c = find_config(main_server->conf, CONF_PARAM, "GeoIPTable", FALSE);
   while (c) {
@@ -615,15 +636,16 @@ static void get_geoip_tables(array_header *geoips, int filter_flags,
     flags = *((int *) c->argv[1]);
     use_utf8 = *((int *) c->argv[2]);
 
-    /* Make sure we open tables that are marked with the default
-     * GEOIP_STANDARD flag, which has a value of zero.
+    /* Shared tables are opened by the daemon process; session processes only
+     * open the remaining (Standard, CheckCache) tables.
      */
-    if (flags == GEOIP_STANDARD && skip_standard == TRUE) { 
+    if (is_shared_geoip_table(flags) != shared_tables) {
       pr_trace_msg(trace_channel, 15,
-        "skipping loading GeoIP table '%s'", path);
+        "skipping loading %s GeoIP table '%s'",
+        shared_tables ? "session" : "shared", path);
       c = find_config_next(c, c->next, CONF_PARAM, "GeoIPTable", FALSE);
       continue;
-    } 
+    }
 
     PRIVS_ROOT
     gi = GeoIP_open(path, flags);
@@ -658,15 +680,15 @@ static void get_geoip_tables(array_header *geoips, int filter_flags,
 
       pr_log_pri(PR_LOG_WARNING, MOD_GEOIP_VERSION
         ": warning: unable to open/use GeoIPTable '%s'", path);
+      failed++;
     }
 
     c = find_config_next(c, c->next, CONF_PARAM, "GeoIPTable", FALSE);
   }
 
-  if (geoips->nelts == 0 &&
-      static_geoips->nelts == 0 &&
-      ((filter_flags == GEOIP_STANDARD) ||
-       (filter_flags & GEOIP_CHECK_CACHE))) {
+  if (shared_tables == FALSE &&
+      geoips->nelts == 0 &&
+      static_geoips->nelts == 0) {
     GeoIP *gi;
 
     /* Let the library use its own default database file(s), if no others
@@ -689,6 +711,8 @@ static void get_geoip_tables(array_header *geoips, int filter_flags,
         ": warning: unable to open/use default GeoIP library database file(s)");
     }
   }
+
+  return failed;
 }
 
 static void remove_geoip_tables(array_header *geoips) {
@@ -1425,23 +1449,37 @@ static void geoip_mod_unload_ev(const void *event_data, void *user_data) {
 #endif /* PR_SHARED_MODULE */
 
 static void geoip_postparse_ev(const void *event_data, void *user_data) {
-  int filter_flags;
+  pool *tmp_pool;
+  array_header *geoips;
+  int failed;
 
-  filter_flags = GEOIP_MEMORY_CACHE|GEOIP_MMAP_CACHE|GEOIP_INDEX_CACHE;
+  pr_log_debug(DEBUG8, MOD_GEOIP_VERSION ": loading shared GeoIP tables");
 
-  pr_log_debug(DEBUG8, MOD_GEOIP_VERSION ": loading static GeoIP tables");
-  get_geoip_tables(static_geoips, filter_flags, TRUE);
-}
+  /* Open the new set of tables before discarding any previously loaded set,
+   * so that a restart which fails to open a table does not leave sessions
+   * without any shared tables.
+   */
+  tmp_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(tmp_pool, MOD_GEOIP_VERSION);
+
+  geoips = make_array(tmp_pool, 0, sizeof(GeoIP *));
+  failed = get_geoip_tables(geoips, TRUE);
+
+  if (failed > 0 &&
+      static_geoips->nelts > 0) {
+    pr_log_pri(PR_LOG_WARNING, MOD_GEOIP_VERSION
+      ": unable to open %d shared %s, keeping previously loaded tables",
+      failed, failed != 1 ? "GeoIPTables" : "GeoIPTable");
+    remove_geoip_tables(geoips);
+    destroy_pool(tmp_pool);
+    return;
+  }
 
-static void geoip_restart_ev(const void *event_data, void *user_data) {
   remove_geoip_tables(static_geoips);
-
   destroy_pool(geoip_pool);
 
-  geoip_pool = make_sub_pool(permanent_pool);
-  pr_pool_tag(geoip_pool, MOD_GEOIP_VERSION);
-
-  static_geoips = make_array(geoip_pool, 0, sizeof(GeoIP *));
+  geoip_pool = tmp_pool;
+  static_geoips = geoips;
 }
 
 /* Initialization functions
@@ -1458,7 +1496,6 @@ static int geoip_init(void) {
     NULL);
 #endif /* PR_SHARED_MODULE */
   pr_event_register(&geoip_module, "core.postparse", geoip_postparse_ev, NULL);
-  pr_event_register(&geoip_module, "core.restart", geoip_restart_ev, NULL);
 
   return 0;
 }
@@ -1519,7 +1556,7 @@ static int geoip_sess_init(void) {
   sess_geoips = make_array(tmp_pool, 0, sizeof(GeoIP *));
 
   pr_log_debug(DEBUG8, MOD_GEOIP_VERSION ": loading session GeoIP tables");
-  get_geoip_tables(sess_geoips, GEOIP_CHECK_CACHE, FALSE);
+  (void) get_geoip_tables(sess_geoips, FALSE);
 
   if (static_geoips->nelts == 0 &&
       sess_geoips->nelts == 0) {
@@ -108,6 +108,11 @@ int sftp_auth_hostbased(struct ssh2_packet *pkt, cmd_rec *pass_cmd,
     pubkey_type = SFTP_KEY_ECDSA_521;
 #endif /* PR_USE_OPENSSL_ECC */
 
+#ifdef PR_USE_OPENSSL_ED25519
+  } else if (strncmp(hostkey_algo, "ssh-ed25519", 12) == 0) {
+    pubkey_type = SFTP_KEY_ED25519;
+#endif /* PR_USE_OPENSSL_ED25519 */
+
   /* XXX Need to support X509v3 certs here */
 
   } else {
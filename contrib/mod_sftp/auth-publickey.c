@@ -143,6 +143,11 @@ int sftp_auth_publickey(struct ssh2_packet *pkt, cmd_rec *pass_cmd,
     pubkey_type = SFTP_KEY_ECDSA_521;
 #endif /* PR_USE_OPENSSL_ECC */
 
+#ifdef PR_USE_OPENSSL_ED25519
+  } else if (strncmp(pubkey_algo, "ssh-ed25519", 12) == 0) {
+    pubkey_type = SFTP_KEY_ED25519;
+#endif /* PR_USE_OPENSSL_ED25519 */
+
   /* XXX This is where we would add support for X509 public keys, e.g.:
    *
    *  x509v3-ssh-dss
@@ -297,6 +297,11 @@ struct fxp_extpair {
 static pool *fxp_pool = NULL;
 static int fxp_use_gmt = TRUE;
 
+/* IDs of the events generated for every READ/WRITE request, looked up on
+ * first use.
+ */
+static int fxp_data_read_event_id = -1, fxp_data_write_event_id = -1;
+
 /* FSOptions */
 static unsigned long fxp_fsio_opts = 0UL;
 static unsigned int fxp_min_client_version = 1;
@@ -10122,12 +10127,18 @@ static int fxp_handle_read(struct fxp_packet *fxp) {
   pr_trace_msg(trace_channel, 8, "sending response: DATA (%lu bytes)",
     (unsigned long) res);
 
-  pbuf = pcalloc(fxp->pool, sizeof(pr_buffer_t));
-  pbuf->buf = (char *) data;
-  pbuf->buflen = res;
-  pbuf->current = pbuf->buf;
-  pbuf->remaining = 0;
-  pr_event_generate("mod_sftp.sftp.data-write", pbuf);
+  if (fxp_data_write_event_id < 0) {
+    fxp_data_write_event_id = pr_event_get_id("mod_sftp.sftp.data-write");
+  }
+
+  if (pr_event_listening_id(fxp_data_write_event_id) > 0) {
+    pbuf = pcalloc(fxp->pool, sizeof(pr_buffer_t));
+    pbuf->buf = (char *) data;
+    pbuf->buflen = res;
+    pbuf->current = pbuf->buf;
+    pbuf->remaining = 0;
+    pr_event_generate_id(fxp_data_write_event_id, pbuf);
+  }
 
   sftp_msg_write_byte(&buf, &buflen, SFTP_SSH2_FXP_DATA);
   sftp_msg_write_int(&buf, &buflen, fxp->request_id);
@@ -13015,12 +13026,18 @@ static int fxp_handle_write(struct fxp_packet *fxp) {
     cmd2 = fxp_cmd_alloc(fxp->pool, C_APPE, NULL);
   }
 
-  pbuf = pcalloc(fxp->pool, sizeof(pr_buffer_t));
-  pbuf->buf = (char *) data;
-  pbuf->buflen = datalen;
-  pbuf->current = pbuf->buf;
-  pbuf->remaining = 0;
-  pr_event_generate("mod_sftp.sftp.data-read", pbuf);
+  if (fxp_data_read_event_id < 0) {
+    fxp_data_read_event_id = pr_event_get_id("mod_sftp.sftp.data-read");
+  }
+
+  if (pr_event_listening_id(fxp_data_read_event_id) > 0) {
+    pbuf = pcalloc(fxp->pool, sizeof(pr_buffer_t));
+    pbuf->buf = (char *) data;
+    pbuf->buflen = datalen;
+    pbuf->current = pbuf->buf;
+    pbuf->remaining = 0;
+    pr_event_generate_id(fxp_data_read_event_id, pbuf);
+  }
 
   pr_throttle_init(cmd2);
   
@@ -1592,11 +1592,18 @@ static const char *get_kexinit_hostkey_algo_list(pool *p) {
 
   /* Our list of supported hostkey algorithms depends on the hostkeys
    * that have been configured.  Show a preference for RSA over DSA,
-   * and ECDSA over both RSA and DSA.
+   * ECDSA over both RSA and DSA, and Ed25519 (whose signatures are the
+   * cheapest to make) over all of them.
    *
    * XXX Should this be configurable later?
    */
 
+#ifdef PR_USE_OPENSSL_ED25519
+  if (sftp_keys_have_ed25519_hostkey() == 0) {
+    list = pstrcat(p, list, *list ? "," : "", "ssh-ed25519", NULL);
+  }
+#endif /* PR_USE_OPENSSL_ED25519 */
+
 #ifdef PR_USE_OPENSSL_ECC
   res = sftp_keys_have_ecdsa_hostkey(p, &nids);
   if (res > 0) {
@@ -1975,6 +1982,13 @@ static int setup_hostkey_algo(struct sftp_kex *kex, const char *algo) {
   }
 #endif /* PR_USE_OPENSSL_ECC */
 
+#ifdef PR_USE_OPENSSL_ED25519
+  if (strncmp(algo, "ssh-ed25519", 12) == 0) {
+    kex->use_hostkey_type = SFTP_KEY_ED25519;
+    return 0;
+  }
+#endif /* PR_USE_OPENSSL_ED25519 */
+
   /* XXX Need to handle "x509v3-ssh-dss", "x509v3-ssh-rsa", "x509v3-sign"
    * algorithms here.
    */
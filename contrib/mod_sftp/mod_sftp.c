@@ -35,6 +35,7 @@
 #include "mac.h"
 #include "keys.h"
 #include "keystore.h"
+#include "rfc4716.h"
 #include "disconnect.h"
 #include "kex.h"
 #include "blacklist.h"
@@ -70,6 +71,7 @@ static const char *sftp_server_version = SFTP_ID_DEFAULT_STRING;
 #define SFTP_HOSTKEY_FL_CLEAR_RSA_KEY		0x001
 #define SFTP_HOSTKEY_FL_CLEAR_DSA_KEY		0x002
 #define SFTP_HOSTKEY_FL_CLEAR_ECDSA_KEY		0x004
+#define SFTP_HOSTKEY_FL_CLEAR_ED25519_KEY	0x008
 
 static const char *trace_channel = "ssh2";
 
@@ -1156,7 +1158,9 @@ MODRET set_sftpextensions(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
-/* usage: SFTPHostKey path|"agent:/..."|"NoRSA"|"NoDSA"|"NoECDSA"" */
+/* usage: SFTPHostKey path|"agent:/..."|"NoRSA"|"NoDSA"|"NoECDSA"|
+ *          "NoEd25519"
+ */
 MODRET set_sftphostkey(cmd_rec *cmd) {
   struct stat st;
   int flags = 0;
@@ -1174,6 +1178,9 @@ MODRET set_sftphostkey(cmd_rec *cmd) {
 
   } else if (strncasecmp(cmd->argv[1], "NoECDSA", 8) == 0) {
     flags |= SFTP_HOSTKEY_FL_CLEAR_ECDSA_KEY;
+
+  } else if (strncasecmp(cmd->argv[1], "NoEd25519", 10) == 0) {
+    flags |= SFTP_HOSTKEY_FL_CLEAR_ED25519_KEY;
   }
 
   if (strncmp(cmd->argv[1], "agent:", 6) != 0 &&
@@ -1745,6 +1752,14 @@ static void sftp_postparse_ev(const void *event_data, void *user_data) {
       ": error preparing interoperability checks: %s", strerror(errno));
   }
 
+  /* Index the authorized key files here, so that all session processes
+   * share the indexes in memory, rather than each parsing the files.
+   */
+  if (sftp_rfc4716_index_files(permanent_pool) < 0) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_SFTP_VERSION
+      ": error indexing authorized key files: %s", strerror(errno));
+  }
+
   /* Check for incompatible SFTPAuthMethods configurations.  For example,
    * configuring:
    *
@@ -1815,6 +1830,18 @@ static void sftp_restart_ev(const void *event_data, void *user_data) {
 
   /* Clear the client banner regexes. */
   sftp_interop_free();
+
+  /* Clear the authorized key file indexes; they are rebuilt, for the new
+   * configuration, once it has been parsed.
+   */
+  sftp_rfc4716_free_indexes();
+}
+
+static void sftp_prefork_ev(const void *event_data, void *user_data) {
+  /* Make sure that the session process inherits current indexes of the
+   * authorized key files.
+   */
+  (void) sftp_rfc4716_revalidate_indexes(permanent_pool);
 }
 
 static void sftp_shutdown_ev(const void *event_data, void *user_data) {
@@ -2002,6 +2029,7 @@ static int sftp_init(void) {
     NULL);
 #endif
   pr_event_register(&sftp_module, "core.postparse", sftp_postparse_ev, NULL);
+  pr_event_register(&sftp_module, "core.pre-fork", sftp_prefork_ev, NULL);
   pr_event_register(&sftp_module, "core.restart", sftp_restart_ev, NULL);
   pr_event_register(&sftp_module, "core.shutdown", sftp_shutdown_ev, NULL);
   pr_event_register(&sftp_module, "core.timeout-login", sftp_timeoutlogin_ev,
@@ -2196,6 +2224,15 @@ static int sftp_sess_init(void) {
         } else {
           pr_trace_msg(trace_channel, 9, "cleared ECDSA hostkey(s)");
         }
+
+      } else if (flags & SFTP_HOSTKEY_FL_CLEAR_ED25519_KEY) {
+        if (sftp_keys_clear_ed25519_hostkey() < 0) {
+          pr_trace_msg(trace_channel, 13,
+            "error clearing Ed25519 hostkey: %s", strerror(errno));
+
+        } else {
+          pr_trace_msg(trace_channel, 9, "cleared Ed25519 hostkey");
+        }
       }
     }
 
@@ -2203,11 +2240,13 @@ static int sftp_sess_init(void) {
   }
 
   /* Support having either an RSA hostkey, a DSA hostkey, an ECDSA hostkey,
-   * or any combination thereof.  But we have to have at least one hostkey.
+   * an Ed25519 hostkey, or any combination thereof.  But we have to have at
+   * least one hostkey.
    */
   if (sftp_keys_have_dsa_hostkey() < 0 &&
       sftp_keys_have_rsa_hostkey() < 0 &&
-      sftp_keys_have_ecdsa_hostkey(sftp_pool, NULL) < 0) {
+      sftp_keys_have_ecdsa_hostkey(sftp_pool, NULL) < 0 &&
+      sftp_keys_have_ed25519_hostkey() < 0) {
     (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
       "no available host keys, unable to handle session");
     errno = EACCES;
@@ -76,6 +76,9 @@ static const char *server_version = SFTP_ID_DEFAULT_STRING;
 static const char *version_id = SFTP_ID_DEFAULT_STRING "\r\n";
 static int sent_version_id = FALSE;
 
+/* IDs of the events generated for every read/write, looked up on first use. */
+static int netio_read_event_id = -1, netio_write_event_id = -1;
+
 static void is_client_alive(void);
 
 /* Count of the number of "client alive" messages sent without a response. */
@@ -297,7 +300,10 @@ int sftp_ssh2_packet_sock_read(int sockfd, void *buf, size_t reqlen,
      * have the facilities for handling such data, we only pass the
      * amount of data read in.
      */
-    pr_event_generate("ssh2.netio-read", &res);
+    if (netio_read_event_id < 0) {
+      netio_read_event_id = pr_event_get_id("ssh2.netio-read");
+    }
+    pr_event_generate_id(netio_read_event_id, &res);
 
     session.total_raw_in += reqlen;
     time(&last_recvd);
@@ -1249,7 +1255,10 @@ int sftp_ssh2_packet_send(int sockfd, struct ssh2_packet *pkt) {
    * have the facilities for handling such data, we only pass the
    * amount of data to be written out.
    */
-  pr_event_generate("ssh2.netio-write", &write_len);
+  if (netio_write_event_id < 0) {
+    netio_write_event_id = pr_event_get_id("ssh2.netio-write");
+  }
+  pr_event_generate_id(netio_write_event_id, &write_len);
 
   /* The socket we accept is blocking, thus there's no need to handle
    * EAGAIN/EWOULDBLOCK errors.
@@ -28,6 +28,8 @@
 #include "crypto.h"
 #include "rfc4716.h"
 
+extern xaset_t *server_list;
+
 /* File-based keystore implementation */
 
 struct filestore_key {
@@ -39,14 +41,63 @@ struct filestore_key {
   /* Key data */
   unsigned char *key_data;
   uint32_t key_datalen;
+
+  /* Indexed keys with the same key data, e.g. with different Subject
+   * headers, in the order in which they appear in the file.
+   */
+  struct filestore_key *next;
 };
 
 struct filestore_data {
   pr_fh_t *fh;
   const char *path;
   unsigned int lineno;
+
+  /* The stat(2) info of the opened file, for validating its index. */
+  struct stat st;
 };
 
+/* An index of the keys in a file, keyed by the key data.  Rather than
+ * parsing every key in the file, and comparing each of them, for every
+ * public key which a client offers, the file is parsed once; each check is
+ * then a single lookup, for as long as the file is not changed.
+ *
+ * Files whose paths do not depend on the user are indexed by the daemon,
+ * before any session processes are forked; each session process then uses
+ * its inherited copy of those indexes.  The daemon's copy is never changed
+ * by a session process (any changes, e.g. rebuilding a stale index, are made
+ * to that session's own copy), thus one session cannot affect the keys which
+ * are authorized for other sessions.  Before forking each session process,
+ * the daemon revalidates its indexes, and rebuilds those of changed files,
+ * so that the session processes do not each rebuild them.  Files whose
+ * paths contain variables (e.g. "%u" or "~") are indexed by each session
+ * process, for that session only.
+ */
+struct filestore_index {
+  struct filestore_index *next;
+  pool *pool;
+  const char *path;
+  int key_type;
+
+  /* The identity of the file when it was indexed. */
+  dev_t file_dev;
+  ino_t file_ino;
+  off_t file_size;
+  time_t file_mtime;
+  long file_mtime_nsecs;
+  time_t file_ctime;
+  long file_ctime_nsecs;
+
+  /* When the file was indexed. */
+  time_t indexed;
+
+  pr_table_t *keys;
+  unsigned int nkeys;
+};
+
+static pool *filestore_index_pool = NULL;
+static struct filestore_index *filestore_indexes = NULL;
+
 static const char *trace_channel = "ssh2";
 
 /* This getline() function is quite similar to pr_fsio_getline(), except
@@ -333,9 +384,227 @@ static struct filestore_key *filestore_get_key(sftp_keystore_t *store,
   return key;
 }
 
+static int filestore_index_key_cmp(const void *key1, size_t keysz1,
+    const void *key2, size_t keysz2) {
+
+  if (keysz1 != keysz2) {
+    return keysz1 < keysz2 ? -1 : 1;
+  }
+
+  return memcmp(key1, key2, keysz1);
+}
+
+/* The key data end with the key material itself (e.g. the RSA modulus, the
+ * ECDSA point, the Ed25519 public key), which is effectively random; hashing
+ * just the trailing bytes is cheaper than hashing the entire key.
+ */
+static unsigned int filestore_index_key_hash(const void *key, size_t keysz) {
+  const unsigned char *k;
+  unsigned int h = 5381;
+  size_t i = 0;
+
+  k = key;
+  if (keysz > 32) {
+    i = keysz - 32;
+  }
+
+  for (; i < keysz; i++) {
+    h = (h * 33) + k[i];
+  }
+
+  return h;
+}
+
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+# define FILESTORE_ST_MTIME_NSECS(st)	((st)->st_mtim.tv_nsec)
+# define FILESTORE_ST_CTIME_NSECS(st)	((st)->st_ctim.tv_nsec)
+#else
+# define FILESTORE_ST_MTIME_NSECS(st)	0L
+# define FILESTORE_ST_CTIME_NSECS(st)	0L
+#endif /* HAVE_STRUCT_STAT_ST_MTIM */
+
+/* Returns TRUE if the index is still valid for the file with the given
+ * stat(2) info.
+ */
+static int filestore_index_is_valid(struct filestore_index *fsi,
+    struct stat *st) {
+  if (fsi->file_dev != st->st_dev ||
+      fsi->file_ino != st->st_ino ||
+      fsi->file_size != st->st_size ||
+      fsi->file_mtime != st->st_mtime ||
+      fsi->file_mtime_nsecs != (long) FILESTORE_ST_MTIME_NSECS(st) ||
+      fsi->file_ctime != st->st_ctime ||
+      fsi->file_ctime_nsecs != (long) FILESTORE_ST_CTIME_NSECS(st)) {
+    return FALSE;
+  }
+
+  /* A file changed in the same second as it was indexed may have changed
+   * again since, without any visible change to its timestamps (e.g. for
+   * filesystems with coarse timestamps, or without nanosecond timestamps);
+   * such indexes are not trusted.
+   */
+  if (fsi->file_mtime >= fsi->indexed ||
+      fsi->file_ctime >= fsi->indexed) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void filestore_index_remove(struct filestore_index *fsi) {
+  struct filestore_index *fi, *prev = NULL;
+
+  for (fi = filestore_indexes; fi != NULL; fi = fi->next) {
+    if (fi == fsi) {
+      if (prev != NULL) {
+        prev->next = fi->next;
+
+      } else {
+        filestore_indexes = fi->next;
+      }
+
+      break;
+    }
+
+    prev = fi;
+  }
+
+  destroy_pool(fsi->pool);
+}
+
+static struct filestore_index *filestore_index_build(sftp_keystore_t *store,
+    pool *p) {
+  register unsigned int i;
+  pool *index_pool, *tmp_pool;
+  array_header *keys;
+  struct filestore_index *fsi;
+  struct filestore_key *key;
+  struct filestore_data *store_data = store->keystore_data;
+  unsigned int nchains;
+
+  if (filestore_index_pool == NULL) {
+    filestore_index_pool = make_sub_pool(sftp_pool);
+    pr_pool_tag(filestore_index_pool, "SFTP File-based Keystore Indexes Pool");
+  }
+
+  index_pool = make_sub_pool(filestore_index_pool);
+  pr_pool_tag(index_pool, "SFTP File-based Keystore Index Pool");
+
+  /* The lines read while parsing are only needed until each key is parsed;
+   * the indexed keys themselves are copied into the index pool.
+   */
+  tmp_pool = make_sub_pool(p);
+  keys = make_array(tmp_pool, 32, sizeof(struct filestore_key *));
+
+  key = filestore_get_key(store, tmp_pool);
+  while (key != NULL) {
+    pr_signals_handle();
+
+    if (key->key_data != NULL) {
+      struct filestore_key *indexed_key;
+
+      indexed_key = pcalloc(index_pool, sizeof(struct filestore_key));
+      indexed_key->key_data = palloc(index_pool, key->key_datalen);
+      memcpy(indexed_key->key_data, key->key_data, key->key_datalen);
+      indexed_key->key_datalen = key->key_datalen;
+
+      if (key->subject != NULL) {
+        indexed_key->subject = pstrdup(index_pool, key->subject);
+      }
+
+      *((struct filestore_key **) push_array(keys)) = indexed_key;
+    }
+
+    key = filestore_get_key(store, tmp_pool);
+  }
+
+  fsi = pcalloc(index_pool, sizeof(struct filestore_index));
+  fsi->pool = index_pool;
+  fsi->path = pstrdup(index_pool, store_data->path);
+  fsi->key_type = store->store_ktypes;
+  fsi->file_dev = store_data->st.st_dev;
+  fsi->file_ino = store_data->st.st_ino;
+  fsi->file_size = store_data->st.st_size;
+  fsi->file_mtime = store_data->st.st_mtime;
+  fsi->file_mtime_nsecs = FILESTORE_ST_MTIME_NSECS(&(store_data->st));
+  fsi->file_ctime = store_data->st.st_ctime;
+  fsi->file_ctime_nsecs = FILESTORE_ST_CTIME_NSECS(&(store_data->st));
+  fsi->indexed = time(NULL);
+
+  nchains = keys->nelts > 32 ? keys->nelts : 32;
+  fsi->keys = pr_table_nalloc(index_pool, 0, nchains);
+  (void) pr_table_ctl(fsi->keys, PR_TABLE_CTL_SET_KEY_CMP,
+    filestore_index_key_cmp);
+  (void) pr_table_ctl(fsi->keys, PR_TABLE_CTL_SET_KEY_HASH,
+    filestore_index_key_hash);
+
+  for (i = 0; i < keys->nelts; i++) {
+    struct filestore_key *indexed_key, *k;
+
+    indexed_key = ((struct filestore_key **) keys->elts)[i];
+
+    k = (struct filestore_key *) pr_table_kget(fsi->keys,
+      indexed_key->key_data, indexed_key->key_datalen, NULL);
+    if (k != NULL) {
+      /* Keep duplicate keys in file order. */
+      while (k->next != NULL) {
+        k = k->next;
+      }
+
+      k->next = indexed_key;
+
+    } else {
+      (void) pr_table_kadd(fsi->keys, indexed_key->key_data,
+        indexed_key->key_datalen, indexed_key, sizeof(struct filestore_key));
+    }
+
+    fsi->nkeys++;
+  }
+
+  destroy_pool(tmp_pool);
+
+  fsi->next = filestore_indexes;
+  filestore_indexes = fsi;
+
+  pr_trace_msg(trace_channel, 8, "indexed %u %s from '%s'", fsi->nkeys,
+    fsi->nkeys != 1 ? "keys" : "key", fsi->path);
+  return fsi;
+}
+
+/* Returns the index for the opened file, building (or rebuilding) the index
+ * if necessary.
+ */
+static struct filestore_index *filestore_get_index(sftp_keystore_t *store,
+    pool *p) {
+  struct filestore_index *fsi;
+  struct filestore_data *store_data = store->keystore_data;
+
+  for (fsi = filestore_indexes; fsi != NULL; fsi = fsi->next) {
+    pr_signals_handle();
+
+    if (strcmp(fsi->path, store_data->path) != 0) {
+      continue;
+    }
+
+    if (filestore_index_is_valid(fsi, &(store_data->st)) == TRUE) {
+      pr_trace_msg(trace_channel, 17, "using index of %u %s from '%s'",
+        fsi->nkeys, fsi->nkeys != 1 ? "keys" : "key", fsi->path);
+      return fsi;
+    }
+
+    pr_trace_msg(trace_channel, 9, "'%s' has changed, rebuilding its index",
+      fsi->path);
+    filestore_index_remove(fsi);
+    break;
+  }
+
+  return filestore_index_build(store, p);
+}
+
 static int filestore_verify_host_key(sftp_keystore_t *store, pool *p,
     const char *user, const char *host_fqdn, const char *host_user,
     unsigned char *key_data, uint32_t key_len) {
+  struct filestore_index *fsi;
   struct filestore_key *key = NULL;
   struct filestore_data *store_data = store->keystore_data;
 
@@ -346,16 +615,18 @@ static int filestore_verify_host_key(sftp_keystore_t *store, pool *p,
     return -1;
   }
 
-  /* XXX Note that this will scan the file from the beginning, each time.
-   * There's room for improvement; perhaps mmap() the file into memory?
-   */
+  fsi = filestore_get_index(store, p);
 
-  key = filestore_get_key(store, p);
+  key = (struct filestore_key *) pr_table_kget(fsi->keys, key_data,
+    key_len, NULL);
   while (key) {
     int ok;
 
     pr_signals_handle();
 
+    /* The index matched the key data; make sure that the key itself is
+     * usable.
+     */
     ok = sftp_keys_compare_keys(p, key_data, key_len, key->key_data,
       key->key_datalen);
     if (ok != TRUE) {
@@ -373,29 +644,28 @@ static int filestore_verify_host_key(sftp_keystore_t *store, pool *p,
       break;
     }
 
-    key = filestore_get_key(store, p);
+    key = key->next;
   }
 
   if (res == 0) {
     pr_trace_msg(trace_channel, 10, "found matching public key for host '%s' "
       "in '%s'", host_fqdn, store_data->path);
-  }
 
-  if (pr_fsio_lseek(store_data->fh, 0, SEEK_SET) < 0) {
-    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
-      "error seeking to start of '%s': %s", store_data->path, strerror(errno));
-    return -1;
+  } else {
+    pr_trace_msg(trace_channel, 10, "no matching key found among %u %s in "
+      "'%s'", fsi->nkeys, fsi->nkeys != 1 ? "keys" : "key",
+      store_data->path);
+    errno = ENOENT;
   }
 
-  store_data->lineno = 0;
   return res;
 }
 
 static int filestore_verify_user_key(sftp_keystore_t *store, pool *p,
     const char *user, unsigned char *key_data, uint32_t key_len) {
+  struct filestore_index *fsi;
   struct filestore_key *key = NULL;
   struct filestore_data *store_data = store->keystore_data;
-  unsigned int count = 0;
 
   int res = -1;
 
@@ -404,17 +674,18 @@ static int filestore_verify_user_key(sftp_keystore_t *store, pool *p,
     return -1;
   }
 
-  /* XXX Note that this will scan the file from the beginning, each time.
-   * There's room for improvement; perhaps mmap() the file into memory?
-   */
+  fsi = filestore_get_index(store, p);
 
-  key = filestore_get_key(store, p);
+  key = (struct filestore_key *) pr_table_kget(fsi->keys, key_data,
+    key_len, NULL);
   while (key) {
     int ok;
 
     pr_signals_handle();
-    count++;
 
+    /* The index matched the key data; make sure that the key itself is
+     * usable.
+     */
     ok = sftp_keys_compare_keys(p, key_data, key_len, key->key_data,
       key->key_datalen);
     if (ok != TRUE) {
@@ -422,10 +693,6 @@ static int filestore_verify_user_key(sftp_keystore_t *store, pool *p,
         (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
           "error comparing keys from '%s': %s", store_data->path,
           strerror(errno));
-
-      } else {
-        pr_trace_msg(trace_channel, 10,
-          "failed to match key #%u from file '%s'", count, store_data->path);
       }
 
     } else {
@@ -452,21 +719,20 @@ static int filestore_verify_user_key(sftp_keystore_t *store, pool *p,
       }
     }
 
-    key = filestore_get_key(store, p);
+    key = key->next;
   }
 
   if (res == 0) {
     pr_trace_msg(trace_channel, 10, "found matching public key for user '%s' "
       "in '%s'", user, store_data->path);
-  }
 
-  if (pr_fsio_lseek(store_data->fh, 0, SEEK_SET) < 0) {
-    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
-      "error seeking to start of '%s': %s", store_data->path, strerror(errno));
-    return -1;
+  } else {
+    pr_trace_msg(trace_channel, 10, "no matching key found among %u %s in "
+      "'%s'", fsi->nkeys, fsi->nkeys != 1 ? "keys" : "key",
+      store_data->path);
+    errno = ENOENT;
   }
 
-  store_data->lineno = 0;
   return res;
 }
 
@@ -534,7 +800,9 @@ static sftp_keystore_t *filestore_open(pool *parent_pool,
     return NULL;
   }
 
-  /* Stat the opened file to determine the optimal buffer size for IO. */
+  /* Stat the opened file to determine the optimal buffer size for IO, and
+   * to check whether any index of the file is still valid.
+   */
   memset(&st, 0, sizeof(st));
   if (pr_fsio_fstat(fh, &st) < 0) {
     xerrno = errno;
@@ -562,6 +830,7 @@ static sftp_keystore_t *filestore_open(pool *parent_pool,
   store_data->path = path;
   store_data->fh = fh;
   store_data->lineno = 0;
+  memcpy(&(store_data->st), &st, sizeof(struct stat));
 
   store->store_ktypes = requested_key_type;
 
@@ -579,6 +848,168 @@ static sftp_keystore_t *filestore_open(pool *parent_pool,
   return store;
 }
 
+static int filestore_index_path(pool *p, int key_type, const char *path) {
+  sftp_keystore_t *store;
+  pool *tmp_pool;
+
+  tmp_pool = make_sub_pool(p);
+  pr_pool_tag(tmp_pool, "SFTP File-based Keystore Index temporary pool");
+
+  store = filestore_open(tmp_pool, key_type, path, NULL);
+  if (store == NULL) {
+    int xerrno = errno;
+
+    destroy_pool(tmp_pool);
+    errno = xerrno;
+    return -1;
+  }
+
+  (void) filestore_get_index(store, tmp_pool);
+  (store->store_close)(store);
+
+  destroy_pool(tmp_pool);
+  return 0;
+}
+
+int sftp_rfc4716_index_files(pool *p) {
+  server_rec *s;
+
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* The daemon process has no sftp_pool, so the indexes are allocated out
+   * of the given pool.
+   */
+  if (filestore_index_pool == NULL) {
+    filestore_index_pool = make_sub_pool(p);
+    pr_pool_tag(filestore_index_pool, "SFTP File-based Keystore Indexes Pool");
+  }
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    register unsigned int i;
+    const char *directives[2] = {
+      "SFTPAuthorizedHostKeys",
+      "SFTPAuthorizedUserKeys"
+    };
+    int key_types[2] = {
+      SFTP_SSH2_HOST_KEY_STORE,
+      SFTP_SSH2_USER_KEY_STORE
+    };
+
+    for (i = 0; i < 2; i++) {
+      register unsigned int j;
+      config_rec *c;
+
+      c = find_config(s->conf, CONF_PARAM, directives[i], FALSE);
+      if (c == NULL) {
+        continue;
+      }
+
+      for (j = 0; j < c->argc; j++) {
+        const char *path;
+
+        pr_signals_handle();
+
+        if (strncmp(c->argv[j], "file:", 5) != 0) {
+          continue;
+        }
+
+        /* Paths which are interpolated for the user can only be indexed
+         * by the session process.
+         */
+        path = ((char *) c->argv[j]) + 5;
+        if (*path == '~' ||
+            strchr(path, '%') != NULL) {
+          continue;
+        }
+
+        if (filestore_index_path(p, key_types[i], path) < 0) {
+          pr_trace_msg(trace_channel, 3,
+            "unable to index %s '%s': %s", directives[i], path,
+            strerror(errno));
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
+int sftp_rfc4716_revalidate_indexes(pool *p) {
+  register unsigned int i;
+  struct filestore_index *fsi;
+  pool *tmp_pool;
+  array_header *stale;
+
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(p);
+  pr_pool_tag(tmp_pool, "SFTP File-based Keystore Revalidate pool");
+
+  stale = make_array(tmp_pool, 0, sizeof(struct filestore_index *));
+
+  for (fsi = filestore_indexes; fsi != NULL; fsi = fsi->next) {
+    struct stat st;
+    int res, xerrno;
+
+    pr_signals_handle();
+
+    pr_fs_clear_cache2(fsi->path);
+
+    PRIVS_ROOT
+    res = pr_fsio_stat(fsi->path, &st);
+    xerrno = errno;
+    PRIVS_RELINQUISH
+
+    if (res < 0) {
+      pr_trace_msg(trace_channel, 9, "unable to stat '%s': %s", fsi->path,
+        strerror(xerrno));
+      *((struct filestore_index **) push_array(stale)) = fsi;
+      continue;
+    }
+
+    if (filestore_index_is_valid(fsi, &st) == FALSE) {
+      *((struct filestore_index **) push_array(stale)) = fsi;
+    }
+  }
+
+  for (i = 0; i < stale->nelts; i++) {
+    const char *path;
+    int key_type;
+
+    fsi = ((struct filestore_index **) stale->elts)[i];
+    path = pstrdup(tmp_pool, fsi->path);
+    key_type = fsi->key_type;
+
+    pr_trace_msg(trace_channel, 9, "'%s' has changed, rebuilding its index",
+      path);
+    filestore_index_remove(fsi);
+
+    if (filestore_index_path(tmp_pool, key_type, path) < 0) {
+      pr_trace_msg(trace_channel, 3, "unable to index '%s': %s", path,
+        strerror(errno));
+    }
+  }
+
+  destroy_pool(tmp_pool);
+  return 0;
+}
+
+int sftp_rfc4716_free_indexes(void) {
+  if (filestore_index_pool != NULL) {
+    destroy_pool(filestore_index_pool);
+    filestore_index_pool = NULL;
+  }
+
+  filestore_indexes = NULL;
+  return 0;
+}
+
 int sftp_rfc4716_init(void) {
   sftp_keystore_register_store("file", filestore_open,
     SFTP_SSH2_HOST_KEY_STORE|SFTP_SSH2_USER_KEY_STORE);
@@ -589,6 +1020,7 @@ int sftp_rfc4716_init(void) {
 int sftp_rfc4716_free(void) {
   sftp_keystore_unregister_store("file",
     SFTP_SSH2_HOST_KEY_STORE|SFTP_SSH2_USER_KEY_STORE);
+  sftp_rfc4716_free_indexes();
 
   return 0;
 }
@@ -30,4 +30,16 @@
 int sftp_rfc4716_init(void);
 int sftp_rfc4716_free(void);
 
+/* Indexes the authorized key files (those whose paths do not depend on the
+ * user) configured for all servers, so that session processes inherit the
+ * indexes rather than each parsing the files.  Called by the daemon.
+ */
+int sftp_rfc4716_index_files(pool *);
+
+/* Rebuilds any of the daemon's indexes whose files have changed.  Called by
+ * the daemon, before forking each session process.
+ */
+int sftp_rfc4716_revalidate_indexes(pool *);
+int sftp_rfc4716_free_indexes(void);
+
 #endif /* MOD_SFTP_RFC4716_H */
@@ -36,6 +36,16 @@
 
 #define SNMP_MAX_LOCK_ATTEMPTS		10
 
+/* If the compiler provides atomic builtins, the counters in the mmap'd tables
+ * are read and updated using atomic operations, rather than serializing each
+ * update through fcntl(2) byte-range locks.  The table layout is unchanged;
+ * every field is an aligned 32-bit word.
+ */
+#if defined(__GNUC__) && \
+    ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+# define SNMP_DB_USE_ATOMICS	1
+#endif
+
 /* Note: Not all database IDs are in this list; only those databases which
  * have on-disk tables are here.  Thus the NOTIFY and CONN database IDs are
  * explicitly NOT here, as they are ephemeral/synthetic databases anyway.
@@ -1175,29 +1185,75 @@ int snmp_db_get_value(pool *p, unsigned int field, int32_t *int_value,
     return -1;
   }
 
+  db_data = snmp_dbs[db_id].db_data;
+  if (db_data == NULL) {
+    /* The table has not been opened, e.g. SNMPEngine is off. */
+    errno = EPERM;
+    return -1;
+  }
+
+  field_data = &(((uint32_t *) db_data)[field_start]);
+
+#if defined(SNMP_DB_USE_ATOMICS)
+  *int_value = (int32_t) __sync_add_and_fetch((uint32_t *) field_data, 0);
+#else
   res = snmp_db_rlock(field);
   if (res < 0) {
     return -1;
   }
 
-  db_data = snmp_dbs[db_id].db_data;
-  field_data = &(((uint32_t *) db_data)[field_start]);
   memmove(int_value, field_data, field_len);
 
   res = snmp_db_unlock(field);
   if (res < 0) {
     return -1;
   }
+#endif /* SNMP_DB_USE_ATOMICS */
+
+  if (pr_trace_get_level(trace_channel) >= 19) {
+    pr_trace_msg(trace_channel, 19,
+      "read value %lu for field %s", (unsigned long) *int_value,
+       snmp_db_get_fieldstr(p, field));
+  }
+
+  return 0;
+}
+
+#if defined(SNMP_DB_USE_ATOMICS)
+static int incr_field_value(uint32_t *field_data, int32_t incr,
+    uint32_t *orig_val, uint32_t *new_val) {
+
+  if (incr >= 0) {
+    *orig_val = __sync_fetch_and_add(field_data, (uint32_t) incr);
+    *new_val = *orig_val + incr;
+    return 0;
+  }
+
+  /* When decrementing, we must not wrap below zero; use a compare-and-swap
+   * loop, so that a concurrent update is never lost.
+   */
+  while (TRUE) {
+    *orig_val = *((volatile uint32_t *) field_data);
+    if (*orig_val == 0) {
+      return -1;
+    }
+
+    *new_val = *orig_val + incr;
+    if (__sync_bool_compare_and_swap(field_data, *orig_val, *new_val)) {
+      break;
+    }
+  }
 
-  pr_trace_msg(trace_channel, 19,
-    "read value %lu for field %s", (unsigned long) *int_value,
-     snmp_db_get_fieldstr(p, field));
   return 0;
 }
+#endif /* SNMP_DB_USE_ATOMICS */
 
 int snmp_db_incr_value(pool *p, unsigned int field, int32_t incr) {
   uint32_t orig_val, new_val;
-  int db_id, res;
+  int db_id;
+#if !defined(SNMP_DB_USE_ATOMICS)
+  int res;
+#endif /* !SNMP_DB_USE_ATOMICS */
   void *db_data, *field_data;
   off_t field_start;
   size_t field_len;
@@ -1211,13 +1267,34 @@ int snmp_db_incr_value(pool *p, unsigned int field, int32_t incr) {
     return -1;
   }
 
+  db_data = snmp_dbs[db_id].db_data;
+  if (db_data == NULL) {
+    /* The table has not been opened, e.g. SNMPEngine is off. */
+    errno = EPERM;
+    return -1;
+  }
+
+  field_data = &(((uint32_t *) db_data)[field_start]);
+
+#if defined(SNMP_DB_USE_ATOMICS)
+  if (incr_field_value(field_data, incr, &orig_val, &new_val) < 0) {
+    /* If we are in fact decrementing a value, and that value is
+     * already zero, then do nothing.
+     */
+    if (pr_trace_get_level(trace_channel) >= 19) {
+      pr_trace_msg(trace_channel, 19,
+        "value already zero for field %s (%d), not decrementing by %ld",
+        snmp_db_get_fieldstr(p, field), field, (long) incr);
+    }
+
+    return 0;
+  }
+#else
   res = snmp_db_wlock(field);
   if (res < 0) {
     return -1;
   }
 
-  db_data = snmp_dbs[db_id].db_data;
-  field_data = &(((uint32_t *) db_data)[field_start]);
   memmove(&new_val, field_data, field_len);
   orig_val = new_val;
 
@@ -1241,28 +1318,26 @@ int snmp_db_incr_value(pool *p, unsigned int field, int32_t incr) {
   new_val += incr;
   memmove(field_data, &new_val, field_len);
 
-#if 0
-  res = msync(field_data, field_len, MS_SYNC);
-  if (res < 0) {
-    pr_trace_msg(trace_channel, 1, "msync(2) error for field %s (%d): %s",
-      snmp_db_get_fieldstr(p, field), field, strerror(errno));  
-  }
-#endif
-
   res = snmp_db_unlock(field);
   if (res < 0) {
     return -1;
   }
+#endif /* SNMP_DB_USE_ATOMICS */
+
+  if (pr_trace_get_level(trace_channel) >= 19) {
+    pr_trace_msg(trace_channel, 19,
+      "wrote value %lu (was %lu) for field %s (%d)", (unsigned long) new_val,
+      (unsigned long) orig_val, snmp_db_get_fieldstr(p, field), field);
+  }
 
-  pr_trace_msg(trace_channel, 19,
-    "wrote value %lu (was %lu) for field %s (%d)", (unsigned long) new_val,
-    (unsigned long) orig_val, snmp_db_get_fieldstr(p, field), field);
   return 0;
 }
 
 int snmp_db_reset_value(pool *p, unsigned int field) {
-  uint32_t val;
-  int db_id, res;
+  int db_id;
+#if !defined(SNMP_DB_USE_ATOMICS)
+  int res;
+#endif /* !SNMP_DB_USE_ATOMICS */
   void *db_data, *field_data;
   off_t field_start;
   size_t field_len;
@@ -1276,21 +1351,30 @@ int snmp_db_reset_value(pool *p, unsigned int field) {
     return -1;
   }
 
-  res = snmp_db_wlock(field);
-  if (res < 0) {
+  db_data = snmp_dbs[db_id].db_data;
+  if (db_data == NULL) {
+    /* The table has not been opened, e.g. SNMPEngine is off. */
+    errno = EPERM;
     return -1;
   }
 
-  db_data = snmp_dbs[db_id].db_data;
   field_data = &(((uint32_t *) db_data)[field_start]);
 
-  val = 0;
-  memmove(field_data, &val, field_len);
+#if defined(SNMP_DB_USE_ATOMICS)
+  (void) __sync_fetch_and_and((uint32_t *) field_data, 0);
+#else
+  res = snmp_db_wlock(field);
+  if (res < 0) {
+    return -1;
+  }
+
+  memset(field_data, 0, field_len);
 
   res = snmp_db_unlock(field);
   if (res < 0) {
     return -1;
   }
+#endif /* SNMP_DB_USE_ATOMICS */
 
   pr_trace_msg(trace_channel, 19,
     "reset value to 0 for field %s", snmp_db_get_fieldstr(p, field));
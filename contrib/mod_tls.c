@@ -7226,6 +7226,7 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
   static unsigned char logged_data = FALSE;
   int blocking, res = 0, xerrno = 0;
   long cache_mode = 0;
+  uint64_t handshake_start_usecs;
   char *subj = NULL;
   SSL *ssl = NULL;
   BIO *rbio = NULL, *wbio = NULL;
@@ -7303,6 +7304,8 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
     }
   }
 
+  handshake_start_usecs = pr_metrics_now();
+
   retry:
 
   blocking = tls_get_block(conn);
@@ -7497,6 +7500,7 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
   pr_trace_msg(trace_channel, 17,
     "TLS handshake on %s conn fd %d COMPLETED", on_data ? "data" : "ctrl",
     conn->rfd);
+  pr_metrics_observe(PR_METRICS_ID_TLS_HANDSHAKE, handshake_start_usecs);
 
   if (on_data) {
     /* Disable TCP_NODELAY, now that the handshake is done. */
@@ -517,6 +517,9 @@ static int sess_cache_redis_entry_set(pool *p, const unsigned char *sess_id,
   int res, xerrno = 0;
   void *key = NULL, *value = NULL;
   size_t keysz = 0, valuesz = 0;
+  pool *tmp_pool;
+  pr_redis_pipeline_t *pipeline;
+  array_header *replies = NULL;
 
   /* Encode the SSL session data. */
   res = sess_cache_entry_encode_json(p, &value, &valuesz, se);
@@ -541,10 +544,31 @@ static int sess_cache_redis_entry_set(pool *p, const unsigned char *sess_id,
     return -1;
   }
 
-  res = pr_redis_kset(sess_redis, &tls_redis_module, (const char *) key,
-    keysz, value, valuesz, se->expires);
+  /* Update the stats along with storing the session, in a single round
+   * trip.  Note that this means a store which fails is still counted.
+   */
+  tmp_pool = make_sub_pool(p);
+  pipeline = pr_redis_pipeline_alloc(tmp_pool, sess_redis, &tls_redis_module);
+  (void) pr_redis_pipeline_kset(pipeline, (const char *) key, keysz, value,
+    valuesz, se->expires);
+  (void) pr_redis_pipeline_incr(pipeline,
+    sesscache_keys[SESSCACHE_KEY_STORES].key, 1);
+
+  res = pr_redis_pipeline_exec(tmp_pool, pipeline, &replies);
   xerrno = errno;
 
+  if (res == 0) {
+    pr_redis_reply_t *reply;
+
+    reply = ((pr_redis_reply_t **) replies->elts)[0];
+    if (reply->type != PR_REDIS_REPLY_TYPE_STATUS) {
+      res = -1;
+      xerrno = EINVAL;
+    }
+  }
+
+  destroy_pool(tmp_pool);
+
   if (res < 0) {
     pr_trace_msg(trace_channel, 2,
       "unable to add Redis entry for session ID (%lu bytes): %s",
@@ -642,41 +666,49 @@ static int sess_cache_add_large_sess(tls_sess_cache_t *cache,
   struct sesscache_large_entry *entry = NULL;
 
   if (sess_len > TLS_MAX_SSL_SESSION_SIZE) {
-    int res;
     const char *exceeds_key = sesscache_keys[SESSCACHE_KEY_EXCEEDS].key,
       *max_len_key = sesscache_keys[SESSCACHE_KEY_MAX_LEN].key;
-    void *value = NULL;
-    size_t valuesz = 0;
     pool *tmp_pool;
+    pr_redis_pipeline_t *pipeline;
+    array_header *replies = NULL;
 
-    res = pr_redis_incr(sess_redis, &tls_redis_module, exceeds_key, 1, NULL);
-    if (res < 0) {
+    /* Update the count, and get the current maximum length, in a single
+     * round trip.
+     */
+    tmp_pool = make_sub_pool(cache->cache_pool);
+    pipeline = pr_redis_pipeline_alloc(tmp_pool, sess_redis, &tls_redis_module);
+    (void) pr_redis_pipeline_incr(pipeline, exceeds_key, 1);
+    (void) pr_redis_pipeline_get(pipeline, max_len_key);
+
+    if (pr_redis_pipeline_exec(tmp_pool, pipeline, &replies) < 0) {
       pr_trace_msg(trace_channel, 2,
         "error incrementing '%s' value: %s", exceeds_key, strerror(errno));
-    }
 
-    /* XXX Yes, this is subject to race conditions; other proftpd servers
-     * might also be modifying this value in Redis.  Oh well.
-     */
+    } else {
+      pr_redis_reply_t *reply;
 
-    tmp_pool = make_sub_pool(cache->cache_pool);
-    value = pr_redis_get(tmp_pool, sess_redis, &tls_redis_module, max_len_key,
-      &valuesz);
-    if (value != NULL) {
-      uint64_t max_len;
-
-      memcpy(&max_len, value, valuesz);
-      if ((uint64_t) sess_len > max_len) {
-        if (pr_redis_set(sess_redis, &tls_redis_module, max_len_key, &max_len,
-            sizeof(max_len), 0) < 0) {
-          pr_trace_msg(trace_channel, 2,
-            "error setting '%s' value: %s", max_len_key, strerror(errno));
+      /* XXX Yes, this is subject to race conditions; other proftpd servers
+       * might also be modifying this value in Redis.  Oh well.
+       */
+
+      reply = ((pr_redis_reply_t **) replies->elts)[1];
+      if (reply->type == PR_REDIS_REPLY_TYPE_STRING &&
+          reply->valuesz == sizeof(uint64_t)) {
+        uint64_t max_len;
+
+        memcpy(&max_len, reply->value, reply->valuesz);
+        if ((uint64_t) sess_len > max_len) {
+          if (pr_redis_set(sess_redis, &tls_redis_module, max_len_key, &max_len,
+              sizeof(max_len), 0) < 0) {
+            pr_trace_msg(trace_channel, 2,
+              "error setting '%s' value: %s", max_len_key, strerror(errno));
+          }
         }
-      }
 
-    } else {
-      pr_trace_msg(trace_channel, 2,
-        "error getting '%s' value: %s", max_len_key, strerror(errno));
+      } else {
+        pr_trace_msg(trace_channel, 2,
+          "error getting '%s' value: %s", max_len_key, strerror(ENOENT));
+      }
     }
 
     destroy_pool(tmp_pool);
@@ -771,14 +803,6 @@ static int sess_cache_add(tls_sess_cache_t *cache, const unsigned char *sess_id,
     /* Add this session to the "large session" list instead as a fallback. */
     return sess_cache_add_large_sess(cache, sess_id, sess_id_len, expires,
         sess, sess_len);
-
-  } else {
-    const char *key = sesscache_keys[SESSCACHE_KEY_STORES].key;
-
-    if (pr_redis_incr(sess_redis, &tls_redis_module, key, 1, NULL) < 0) {
-      pr_trace_msg(trace_channel, 2,
-        "error incrementing '%s' value: %s", key, strerror(errno));
-    }
   }
 
   return 0;
@@ -963,6 +987,7 @@ static int sess_cache_status(tls_sess_cache_t *cache,
     void (*statusf)(void *, const char *, ...), void *arg, int flags) {
   register unsigned int i;
   pool *tmp_pool;
+  array_header *keys, *values = NULL, *valueszs = NULL;
 
   pr_trace_msg(trace_channel, 9, "checking Redis session cache %p", cache);
 
@@ -973,21 +998,48 @@ static int sess_cache_status(tls_sess_cache_t *cache,
   statusf(arg, "%s", "");
   statusf(arg, "Redis server: ");
 
+  keys = make_array(tmp_pool, 0, sizeof(char *));
   for (i = 0; sesscache_keys[i].key != NULL; i++) {
-    const char *key, *desc;
-    void *value = NULL;
-    size_t valuesz = 0;
-
-    key = sesscache_keys[i].key;
-    desc = sesscache_keys[i].desc;
+    *((const char **) push_array(keys)) = sesscache_keys[i].key;
+  }
 
-    value = pr_redis_get(tmp_pool, sess_redis, &tls_redis_module, key,
-      &valuesz);
-    if (value != NULL) {
+  /* Get all of the stats in a single round trip. */
+  if (pr_redis_mget(tmp_pool, sess_redis, &tls_redis_module, keys, &values,
+      &valueszs) == 0) {
+    for (i = 0; i < values->nelts; i++) {
+      const char *desc;
+      void *value;
+      size_t valuesz;
       uint64_t num = 0;
-      memcpy(&num, value, valuesz);
+
+      value = ((void **) values->elts)[i];
+      valuesz = ((size_t *) valueszs->elts)[i];
+      if (value == NULL) {
+        continue;
+      }
+
+      desc = sesscache_keys[i].desc;
+
+      /* The counters are maintained using INCRBY, and so are text; the
+       * maximum length is stored as a binary number.
+       */
+      if (i == SESSCACHE_KEY_MAX_LEN) {
+        if (valuesz != sizeof(num)) {
+          continue;
+        }
+
+        memcpy(&num, value, valuesz);
+
+      } else {
+        num = strtoull(pstrndup(tmp_pool, value, valuesz), NULL, 10);
+      }
+
       statusf(arg, "%s: %lu", desc, (unsigned long) num);
     }
+
+  } else {
+    pr_trace_msg(trace_channel, 2,
+      "error getting cache stats: %s", strerror(errno));
   }
 
   /* XXX run stats on Redis servers? */
@@ -1322,6 +1374,9 @@ static int ocsp_cache_redis_entry_set(pool *p, const char *fingerprint,
   int res, xerrno = 0;
   void *key = NULL, *value = NULL;
   size_t keysz = 0, valuesz = 0;
+  pool *tmp_pool;
+  pr_redis_pipeline_t *pipeline;
+  array_header *replies = NULL;
 
   /* Encode the OCSP response data. */
   res = ocsp_cache_entry_encode_json(p, &value, &valuesz, oe);
@@ -1346,10 +1401,31 @@ static int ocsp_cache_redis_entry_set(pool *p, const char *fingerprint,
     return -1;
   }
 
-  res = pr_redis_kset(ocsp_redis, &tls_redis_module, (const char *) key, keysz,
-    value, valuesz, 0);
+  /* Update the stats along with storing the response, in a single round
+   * trip.  Note that this means a store which fails is still counted.
+   */
+  tmp_pool = make_sub_pool(p);
+  pipeline = pr_redis_pipeline_alloc(tmp_pool, ocsp_redis, &tls_redis_module);
+  (void) pr_redis_pipeline_kset(pipeline, (const char *) key, keysz, value,
+    valuesz, 0);
+  (void) pr_redis_pipeline_incr(pipeline,
+    ocspcache_keys[OCSPCACHE_KEY_STORES].key, 1);
+
+  res = pr_redis_pipeline_exec(tmp_pool, pipeline, &replies);
   xerrno = errno;
 
+  if (res == 0) {
+    pr_redis_reply_t *reply;
+
+    reply = ((pr_redis_reply_t **) replies->elts)[0];
+    if (reply->type != PR_REDIS_REPLY_TYPE_STATUS) {
+      res = -1;
+      xerrno = EINVAL;
+    }
+  }
+
+  destroy_pool(tmp_pool);
+
   if (res < 0) {
     pr_trace_msg(trace_channel, 2,
       "unable to add Redis entry for fingerprint '%s': %s", fingerprint,
@@ -1452,38 +1528,47 @@ static int ocsp_cache_add_large_resp(tls_ocsp_cache_t *cache,
   if (resp_derlen > TLS_MAX_OCSP_RESPONSE_SIZE) {
     const char *exceeds_key = ocspcache_keys[OCSPCACHE_KEY_EXCEEDS].key,
       *max_len_key = ocspcache_keys[OCSPCACHE_KEY_MAX_LEN].key;
-    void *value = NULL;
-    size_t valuesz = 0;
     pool *tmp_pool;
+    pr_redis_pipeline_t *pipeline;
+    array_header *replies = NULL;
 
-    if (pr_redis_incr(ocsp_redis, &tls_redis_module, exceeds_key, 1,
-        NULL) < 0) {
+    /* Update the count, and get the current maximum length, in a single
+     * round trip.
+     */
+    tmp_pool = make_sub_pool(cache->cache_pool);
+    pipeline = pr_redis_pipeline_alloc(tmp_pool, ocsp_redis, &tls_redis_module);
+    (void) pr_redis_pipeline_incr(pipeline, exceeds_key, 1);
+    (void) pr_redis_pipeline_get(pipeline, max_len_key);
+
+    if (pr_redis_pipeline_exec(tmp_pool, pipeline, &replies) < 0) {
       pr_trace_msg(trace_channel, 2,
         "error incrementing '%s' value: %s", exceeds_key, strerror(errno));
-    }
 
-    /* XXX Yes, this is subject to race conditions; other proftpd servers
-     * might also be modifying this value in Redis.  Oh well.
-     */
+    } else {
+      pr_redis_reply_t *reply;
 
-    tmp_pool = make_sub_pool(cache->cache_pool);
-    value = pr_redis_get(tmp_pool, ocsp_redis, &tls_redis_module, max_len_key,
-      &valuesz);
-    if (value != NULL) {
-      uint64_t max_len;
-
-      memcpy(&max_len, value, valuesz);
-      if ((uint64_t) resp_derlen > max_len) {
-        if (pr_redis_set(ocsp_redis, &tls_redis_module, max_len_key, &max_len,
-            sizeof(max_len), 0) < 0) {
-          pr_trace_msg(trace_channel, 2,
-            "error setting '%s' value: %s", max_len_key, strerror(errno));
+      /* XXX Yes, this is subject to race conditions; other proftpd servers
+       * might also be modifying this value in Redis.  Oh well.
+       */
+
+      reply = ((pr_redis_reply_t **) replies->elts)[1];
+      if (reply->type == PR_REDIS_REPLY_TYPE_STRING &&
+          reply->valuesz == sizeof(uint64_t)) {
+        uint64_t max_len;
+
+        memcpy(&max_len, reply->value, reply->valuesz);
+        if ((uint64_t) resp_derlen > max_len) {
+          if (pr_redis_set(ocsp_redis, &tls_redis_module, max_len_key, &max_len,
+              sizeof(max_len), 0) < 0) {
+            pr_trace_msg(trace_channel, 2,
+              "error setting '%s' value: %s", max_len_key, strerror(errno));
+          }
         }
-      }
 
-    } else {
-      pr_trace_msg(trace_channel, 2,
-        "error getting '%s' value: %s", max_len_key, strerror(errno));
+      } else {
+        pr_trace_msg(trace_channel, 2,
+          "error getting '%s' value: %s", max_len_key, strerror(ENOENT));
+      }
     }
 
     destroy_pool(tmp_pool);
@@ -1574,14 +1659,6 @@ static int ocsp_cache_add(tls_ocsp_cache_t *cache, const char *fingerprint,
 
     /* Add this response to the "large response" list instead as a fallback. */
     return ocsp_cache_add_large_resp(cache, fingerprint, resp, resp_age);
-
-  } else {
-    const char *key = ocspcache_keys[OCSPCACHE_KEY_STORES].key;
-
-    if (pr_redis_incr(ocsp_redis, &tls_redis_module, key, 1, NULL) < 0) {
-      pr_trace_msg(trace_channel, 2,
-        "error incrementing '%s' value: %s", key, strerror(errno));
-    }
   }
 
   return 0;
@@ -1771,6 +1848,7 @@ static int ocsp_cache_status(tls_ocsp_cache_t *cache,
     void (*statusf)(void *, const char *, ...), void *arg, int flags) {
   register unsigned int i;
   pool *tmp_pool;
+  array_header *keys, *values = NULL, *valueszs = NULL;
 
   pr_trace_msg(trace_channel, 9, "checking Redis ocsp cache %p", cache);
 
@@ -1781,21 +1859,48 @@ static int ocsp_cache_status(tls_ocsp_cache_t *cache,
   statusf(arg, "%s", "");
   statusf(arg, "Redis server: ");
 
+  keys = make_array(tmp_pool, 0, sizeof(char *));
   for (i = 0; ocspcache_keys[i].key != NULL; i++) {
-    const char *key, *desc;
-    void *value = NULL;
-    size_t valuesz = 0;
-
-    key = ocspcache_keys[i].key;
-    desc = ocspcache_keys[i].desc;
+    *((const char **) push_array(keys)) = ocspcache_keys[i].key;
+  }
 
-    value = pr_redis_get(tmp_pool, ocsp_redis, &tls_redis_module, key,
-      &valuesz);
-    if (value != NULL) {
+  /* Get all of the stats in a single round trip. */
+  if (pr_redis_mget(tmp_pool, ocsp_redis, &tls_redis_module, keys, &values,
+      &valueszs) == 0) {
+    for (i = 0; i < values->nelts; i++) {
+      const char *desc;
+      void *value;
+      size_t valuesz;
       uint64_t num = 0;
-      memcpy(&num, value, valuesz);
+
+      value = ((void **) values->elts)[i];
+      valuesz = ((size_t *) valueszs->elts)[i];
+      if (value == NULL) {
+        continue;
+      }
+
+      desc = ocspcache_keys[i].desc;
+
+      /* The counters are maintained using INCRBY, and so are text; the
+       * maximum length is stored as a binary number.
+       */
+      if (i == OCSPCACHE_KEY_MAX_LEN) {
+        if (valuesz != sizeof(num)) {
+          continue;
+        }
+
+        memcpy(&num, value, valuesz);
+
+      } else {
+        num = strtoull(pstrndup(tmp_pool, value, valuesz), NULL, 10);
+      }
+
       statusf(arg, "%s: %lu", desc, (unsigned long) num);
     }
+
+  } else {
+    pr_trace_msg(trace_channel, 2,
+      "error getting cache stats: %s", strerror(errno));
   }
 
   /* XXX run stats on Redis servers? */
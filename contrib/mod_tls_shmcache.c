@@ -43,7 +43,7 @@
 # define HAVE_LIBRESSL	1
 #endif
 
-#define MOD_TLS_SHMCACHE_VERSION		"mod_tls_shmcache/0.2"
+#define MOD_TLS_SHMCACHE_VERSION		"mod_tls_shmcache/0.3"
 
 /* Make sure the version of proftpd is as necessary. */
 #if PROFTPD_VERSION_NUMBER < 0x0001030602
@@ -54,6 +54,52 @@ module tls_shmcache_module;
 
 #define TLS_SHMCACHE_SESS_PROJECT_ID		247
 
+/* The entries in the shm segments are grouped into sets of (at least)
+ * TLS_SHMCACHE_SET_SIZE consecutive slots.  A key hashes to exactly one set;
+ * adds, lookups, and deletes only ever probe the slots of that set, and only
+ * lock that set (using an fcntl(2) lock on the byte at the set's offset in
+ * the cache file).  Operations on different sets thus do not contend with
+ * each other.  When a set is full, adding a new entry evicts the entry in
+ * that set which would expire soonest.
+ */
+#ifndef TLS_SHMCACHE_SET_SIZE
+# define TLS_SHMCACHE_SET_SIZE		8
+#endif
+
+/* If the compiler provides atomic builtins, the counters in the shm header
+ * are updated using atomic operations, since processes holding locks on
+ * different sets may update them concurrently.  This also allows lookups to
+ * use read locks.
+ */
+#if defined(__GNUC__) && \
+    ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+# define TLS_SHMCACHE_USE_ATOMICS	1
+# define SHMCACHE_INCR(v)		__sync_fetch_and_add(&(v), 1)
+# define SHMCACHE_DECR(v)		__sync_fetch_and_sub(&(v), 1)
+# define SHMCACHE_ADD(v, n)		__sync_fetch_and_add(&(v), (n))
+# define SHMCACHE_GET_LOCK		F_RDLCK
+#else
+# define SHMCACHE_INCR(v)		((v)++)
+# define SHMCACHE_DECR(v)		((v)--)
+# define SHMCACHE_ADD(v, n)		((v) += (n))
+# define SHMCACHE_GET_LOCK		F_WRLCK
+#endif /* TLS_SHMCACHE_USE_ATOMICS */
+
+/* Lock statistics, kept in the shm header, for tuning the cache size. */
+struct shmcache_lockstats {
+  /* The total number of locks acquired. */
+  unsigned long nlocks;
+
+  /* The number of locks which were held by another process, and thus
+   * for which we had to wait.
+   */
+  unsigned long ncontended;
+
+  /* Total and maximum time spent waiting for contended locks. */
+  unsigned long wait_usecs;
+  unsigned long max_wait_usecs;
+};
+
 /* Assume a maximum SSL session (serialized) length of 10K.  Note that this
  * is different from the SSL_MAX_SSL_SESSION_ID_LENGTH provided by OpenSSL.
  * There is no limit imposed on the length of the ASN1 description of the
@@ -108,6 +154,7 @@ struct sesscache_data {
   unsigned int nstored;
   unsigned int ndeleted;
   unsigned int nexpired;
+  unsigned int nevicted;
   unsigned int nerrors;
 
   /* This tracks the number of sessions that could not be added because
@@ -116,16 +163,13 @@ struct sesscache_data {
   unsigned int nexceeded;
   unsigned int exceeded_maxsz;
 
-  /* Track the timestamp of the next session to expire in the cache; used
-   * as an optimization when flushing the cache of expired sessions.
-   */
-  time_t next_expiring;
+  struct shmcache_lockstats sd_lockstats;
 
   /* These listlen/listsz track the number of entries in the cache and total
    * entries possible, and thus can be used for determining the fullness of
-   * the cache.
+   * the cache.  The entries are grouped into sd_nsets sets.
    */
-  unsigned int sd_listlen, sd_listsz;
+  unsigned int sd_listlen, sd_listsz, sd_nsets;
 
   /* It is important that this field be the last in the struct! */
   struct sesscache_entry *sd_entries;
@@ -136,7 +180,9 @@ static struct sesscache_data *sesscache_data = NULL;
 static size_t sesscache_datasz = 0;
 static int sesscache_shmid = -1;
 static pr_fh_t *sesscache_fh = NULL;
-static array_header *sesscache_sess_list = NULL;
+
+/* The "large session" entries, indexed by session ID. */
+static pr_table_t *sesscache_sess_tab = NULL;
 
 #if defined(PR_USE_OPENSSL_OCSP)
 # define TLS_SHMCACHE_OCSP_PROJECT_ID		249
@@ -181,6 +227,7 @@ struct ocspcache_data {
   unsigned int nstored;
   unsigned int ndeleted;
   unsigned int nexpired;
+  unsigned int nevicted;
   unsigned int nerrors;
 
   /* This tracks the number of sessions that could not be added because
@@ -189,11 +236,13 @@ struct ocspcache_data {
   unsigned int nexceeded;
   unsigned int exceeded_maxsz;
 
+  struct shmcache_lockstats od_lockstats;
+
   /* These listlen/listsz track the number of entries in the cache and total
    * entries possible, and thus can be used for determining the fullness of
-   * the cache.
+   * the cache.  The entries are grouped into od_nsets sets.
    */
-  unsigned int od_listlen, od_listsz;
+  unsigned int od_listlen, od_listsz, od_nsets;
 
   /* It is important that this field be the last in the struct! */
   struct ocspcache_entry *od_entries;
@@ -204,7 +253,9 @@ static struct ocspcache_data *ocspcache_data = NULL;
 static size_t ocspcache_datasz = 0;
 static int ocspcache_shmid = -1;
 static pr_fh_t *ocspcache_fh = NULL;
-static array_header *ocspcache_resp_list = NULL;
+
+/* The "large response" entries, indexed by fingerprint. */
+static pr_table_t *ocspcache_resp_tab = NULL;
 #endif /* PR_USE_OPENSSL_OCSP */
 
 static const char *trace_channel = "tls.shmcache";
@@ -285,29 +336,63 @@ static const char *shmcache_get_lock_desc(int lock_type) {
   return lock_desc;
 }
 
+/* Record the time spent waiting for a contended lock. */
+static void shmcache_lock_waited(struct shmcache_lockstats *stats,
+    unsigned long wait_usecs) {
+
+  SHMCACHE_INCR(stats->ncontended);
+  SHMCACHE_ADD(stats->wait_usecs, wait_usecs);
+
+#if defined(TLS_SHMCACHE_USE_ATOMICS)
+  while (TRUE) {
+    unsigned long max_usecs;
+
+    max_usecs = *((volatile unsigned long *) &(stats->max_wait_usecs));
+    if (wait_usecs <= max_usecs ||
+        __sync_bool_compare_and_swap(&(stats->max_wait_usecs), max_usecs,
+          wait_usecs)) {
+      break;
+    }
+  }
+#else
+  if (wait_usecs > stats->max_wait_usecs) {
+    stats->max_wait_usecs = wait_usecs;
+  }
+#endif /* TLS_SHMCACHE_USE_ATOMICS */
+}
+
 /* XXX There is anecdotal (and real) evidence that using SysV semaphores
  * is faster than fcntl(2)/flock(3).  However, semaphores are not cleaned up
  * if the process dies tragically.  Could possibly deal with this in an
  * exit event handler, though.  Something to keep in mind.
+ *
+ * A len of zero locks the entire file, i.e. all of the sets.  If stats are
+ * provided, the number of locks acquired, and the time spent waiting for
+ * contended locks, are recorded there.
  */
-static int shmcache_lock_shm(pr_fh_t *fh, int lock_type) {
+static int shmcache_lock_shm_range(pr_fh_t *fh, int lock_type, off_t start,
+    off_t len, struct shmcache_lockstats *stats) {
   const char *lock_desc;
-  int fd;
+  int fd, lock_cmd = F_SETLK;
   struct flock lock;
-  unsigned int nattempts = 1;
+  struct timeval wait_start;
 
   lock.l_type = lock_type;
   lock.l_whence = SEEK_SET;
-  lock.l_start = 0;
-  lock.l_len = 0;
+  lock.l_start = start;
+  lock.l_len = len;
 
   fd = PR_FH_FD(fh);
   lock_desc = shmcache_get_lock_desc(lock_type);
 
-  pr_trace_msg(trace_channel, 19, "attempting to %s shmcache fd %d", lock_desc,
-    fd);
+  pr_trace_msg(trace_channel, 19, "attempting to %s shmcache fd %d "
+    "(offset %" PR_LU ", len %" PR_LU ")", lock_desc, fd, (pr_off_t) start,
+    (pr_off_t) len);
 
-  while (fcntl(fd, F_SETLK, &lock) < 0) {
+  /* First try to get the lock without blocking; if another process holds a
+   * conflicting lock, then wait for it, keeping track of how long we waited.
+   */
+  while (fcntl(fd, lock_cmd, &lock) < 0) {
     int xerrno = errno;
 
     if (xerrno == EINTR) {
@@ -315,11 +400,12 @@ static int shmcache_lock_shm(pr_fh_t *fh, int lock_type) {
       continue;
     }
 
-    pr_trace_msg(trace_channel, 3, "%s of shmcache fd %d failed: %s",
-      lock_desc, fd, strerror(xerrno));
-    if (xerrno == EACCES) {
+    if (lock_cmd == F_SETLK &&
+        (xerrno == EAGAIN || xerrno == EACCES)) {
       struct flock locker;
 
+      memcpy(&locker, &lock, sizeof(locker));
+
       /* Get the PID of the process blocking this lock. */
       if (fcntl(fd, F_GETLK, &locker) == 0) {
         pr_trace_msg(trace_channel, 3, "process ID %lu has blocking %s on "
@@ -327,55 +413,126 @@ static int shmcache_lock_shm(pr_fh_t *fh, int lock_type) {
           shmcache_get_lock_desc(locker.l_type), fd);
       }
 
-      /* Treat this as an interrupted call, call pr_signals_handle() (which
-       * will delay for a few msecs because of EINTR), and try again.
-       * After 10 attempts, give up altogether.
-       */
-
-      nattempts++;
-      if (nattempts <= 10) {
-        errno = EINTR;
-
-        pr_signals_handle();
-        continue;
-      }
-
-      errno = xerrno;
-      return -1;
+      gettimeofday(&wait_start, NULL);
+      lock_cmd = F_SETLKW;
+      continue;
     }
 
+    pr_trace_msg(trace_channel, 3, "%s of shmcache fd %d failed: %s",
+      lock_desc, fd, strerror(xerrno));
+
     errno = xerrno;
     return -1;
   }
 
+  if (stats != NULL &&
+      lock_type != F_UNLCK) {
+    SHMCACHE_INCR(stats->nlocks);
+
+    if (lock_cmd == F_SETLKW) {
+      struct timeval wait_end;
+      unsigned long wait_usecs;
+
+      gettimeofday(&wait_end, NULL);
+      wait_usecs = ((wait_end.tv_sec - wait_start.tv_sec) * 1000000) +
+        (wait_end.tv_usec - wait_start.tv_usec);
+
+      pr_trace_msg(trace_channel, 12, "waited %lu usecs to %s shmcache fd %d",
+        wait_usecs, lock_desc, fd);
+      shmcache_lock_waited(stats, wait_usecs);
+    }
+  }
+
   pr_trace_msg(trace_channel, 19, "%s of shmcache fd %d succeeded", lock_desc,
     fd);
   return 0;
 }
 
-/* Use a hash function to hash the given lookup key to a slot in the entries
- * list.  This hash, module the number of entries, is the initial iteration
- * start point.  This will hopefully avoid having to do many linear scans for
- * the add/get/delete operations.
+static int shmcache_lock_shm(pr_fh_t *fh, int lock_type) {
+  return shmcache_lock_shm_range(fh, lock_type, 0, 0, NULL);
+}
+
+/* Use a hash function to hash the given lookup key to a set of slots in the
+ * entries list.
  *
  * Use Perl's hashing algorithm.
  */
 static unsigned int shmcache_hash(const unsigned char *id, unsigned int len) {
-  unsigned int i = 0;
-  size_t sz = len;
+  register unsigned int i;
+  unsigned int h = 0;
 
-  while (sz--) {
-    const unsigned char *k = id;
-    unsigned int c = *k;
-    k++;
+  for (i = 0; i < len; i++) {
+    h = (h * 33) + id[i];
+  }
 
-    /* Always handle signals in potentially long-running while loops. */
-    pr_signals_handle();
+  return h;
+}
+
+/* Determine the range of slots, [*start, *end), of the set to which the
+ * given hash maps.  Any leftover slots (when the list size is not a multiple
+ * of the set size) belong to the last set.
+ */
+static unsigned int shmcache_get_set(unsigned int h, unsigned int listsz,
+    unsigned int nsets, unsigned int *start, unsigned int *end) {
+  unsigned int set;
+
+  set = h % nsets;
+  *start = set * TLS_SHMCACHE_SET_SIZE;
+  *end = (set == nsets - 1) ? listsz : *start + TLS_SHMCACHE_SET_SIZE;
+
+  return set;
+}
+
+static unsigned int shmcache_get_nsets(unsigned int listsz) {
+  unsigned int nsets;
+
+  nsets = listsz / TLS_SHMCACHE_SET_SIZE;
+  return nsets > 0 ? nsets : 1;
+}
+
+/* Large entries are kept in tables keyed by binary IDs, so we provide our own
+ * key comparison and hash callbacks.
+ */
+static int shmcache_key_cmp(const void *key1, size_t keysz1, const void *key2,
+    size_t keysz2) {
 
-    i = (i * 33) + c;
+  if (keysz1 != keysz2) {
+    return keysz1 < keysz2 ? -1 : 1;
   }
 
-  return i;
+  return memcmp(key1, key2, keysz1);
+}
+
+static unsigned int shmcache_key_hash(const void *key, size_t keysz) {
+  return shmcache_hash(key, keysz);
+}
+
+static pr_table_t *shmcache_alloc_large_tab(pool *p) {
+  pr_table_t *tab;
+
+  tab = pr_table_alloc(p, 0);
+  (void) pr_table_ctl(tab, PR_TABLE_CTL_SET_KEY_CMP, shmcache_key_cmp);
+  (void) pr_table_ctl(tab, PR_TABLE_CTL_SET_KEY_HASH, shmcache_key_hash);
+
+  return tab;
+}
+
+static void shmcache_update_max(unsigned int *max, unsigned int val) {
+#if defined(TLS_SHMCACHE_USE_ATOMICS)
+  while (TRUE) {
+    unsigned int curr;
+
+    curr = *((volatile unsigned int *) max);
+    if (val <= curr ||
+        __sync_bool_compare_and_swap(max, curr, val)) {
+      break;
+    }
+  }
+#else
+  if (val > *max) {
+    *max = val;
+  }
+#endif /* TLS_SHMCACHE_USE_ATOMICS */
 }
 
 static void *shmcache_get_shm(pr_fh_t *fh, size_t *shm_size, int project_id,
@@ -564,8 +721,10 @@ static struct sesscache_data *sess_cache_get_shm(pr_fh_t *fh,
     "using shm ID %d for sesscache path '%s' (%u sessions)", sesscache_shmid,
     fh->fh_path, shm_sess_max);
 
-  data->sd_entries = (struct sesscache_entry *) (data + sizeof(struct sesscache_data));
+  data->sd_entries = (struct sesscache_entry *) (((char *) data) +
+    sizeof(struct sesscache_data));
   data->sd_listsz = shm_sess_max;
+  data->sd_nsets = shmcache_get_nsets(shm_sess_max);
 
   return data;
 }
@@ -606,8 +765,10 @@ static struct ocspcache_data *ocsp_cache_get_shm(pr_fh_t *fh,
     "using shm ID %d for ocspcache path '%s' (%u responses)", ocspcache_shmid,
     fh->fh_path, shm_resp_max);
 
-  data->od_entries = (struct ocspcache_entry *) (data + sizeof(struct ocspcache_data));
+  data->od_entries = (struct ocspcache_entry *) (((char *) data) +
+    sizeof(struct ocspcache_data));
   data->od_listsz = shm_resp_max;
+  data->od_nsets = shmcache_get_nsets(shm_resp_max);
 
   return data;
 }
@@ -616,83 +777,45 @@ static struct ocspcache_data *ocsp_cache_get_shm(pr_fh_t *fh,
 /* SSL session cache implementation callbacks.
  */
 
-/* Scan the entire list, clearing out expired sessions.  Logs the number
- * of sessions that expired and updates the header stat.
- *
- * NOTE: Callers are assumed to handle the locking of the shm before/after
- * calling this function!
- */
-static unsigned int sess_cache_flush(void) {
-  register unsigned int i;
-  unsigned int flushed = 0;
-  time_t now, next_expiring = 0;
-
-  now = time(NULL);
-
-  /* We always scan the in-memory large session entry list. */
-  if (sesscache_sess_list != NULL) {
-    struct sesscache_large_entry *entries;
+static int sess_cache_lock(int lock_type) {
+  return shmcache_lock_shm_range(sesscache_fh, lock_type, 0, 0,
+    &(sesscache_data->sd_lockstats));
+}
 
-    entries = sesscache_sess_list->elts;
-    for (i = 0; i < sesscache_sess_list->nelts; i++) {
-      struct sesscache_large_entry *entry;
+static int sess_cache_lock_set(int lock_type, unsigned int set) {
+  return shmcache_lock_shm_range(sesscache_fh, lock_type, set, 1,
+    &(sesscache_data->sd_lockstats));
+}
 
-      entry = &(entries[i]);
+static void sess_cache_scrub_large_sess(struct sesscache_large_entry *entry) {
+  pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
+  entry->expires = 0;
+}
 
-      if (entry->expires > now) {
-        /* This entry has expired; clear its slot. */
-        entry->expires = 0;
-        pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
-      }
-    }
-  }
+/* Scrubs the large session entries; if a timestamp is provided as the
+ * user_data, only the entries which have expired as of that time are
+ * scrubbed, and removed from the table.
+ */
+static int sess_cache_scrub_large_sess_cb(const void *key_data,
+    size_t key_datasz, const void *value_data, size_t value_datasz,
+    void *user_data) {
+  struct sesscache_large_entry *entry;
+  time_t *now;
 
-  /* If now is earlier than the earliest expiring session in the cache,
-   * then a scan will be pointless.
-   */
-  if (now < sesscache_data->next_expiring) {
-    unsigned int secs;
+  entry = (struct sesscache_large_entry *) value_data;
+  now = user_data;
 
-    secs = sesscache_data->next_expiring - now;
-    tls_log("shmcache: no expired sessions to flush; %u secs to next "
-      "expiration", secs);
+  if (now == NULL) {
+    sess_cache_scrub_large_sess(entry);
     return 0;
   }
 
-  tls_log("shmcache: flushing session cache of expired sessions");
-
-  for (i = 0; i < sesscache_data->sd_listsz; i++) {
-    struct sesscache_entry *entry;
-
-    entry = &(sesscache_data->sd_entries[i]);
-    if (entry->expires > 0) {
-      if (entry->expires > now) {
-        if (entry->expires < next_expiring) {
-          next_expiring = entry->expires;
-        }
-
-      } else {
-        /* This entry has expired; clear its slot. */
-        entry->expires = 0;
-        pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
-
-        /* Don't forget to update the stats. */
-        sesscache_data->nexpired++;
-
-        if (sesscache_data->sd_listlen > 0) {
-          sesscache_data->sd_listlen--;
-        }
-
-        flushed++;
-      }
-    }
-
-    sesscache_data->next_expiring = next_expiring;
+  if (entry->expires <= *now) {
+    sess_cache_scrub_large_sess(entry);
+    (void) pr_table_kremove(sesscache_sess_tab, key_data, key_datasz, NULL);
   }
 
-  tls_log("shmcache: flushed %u expired %s from session cache", flushed,
-    flushed != 1 ? "sessions" : "session");
-  return flushed;
+  return 0;
 }
 
 static int sess_cache_open(tls_sess_cache_t *cache, char *info, long timeout) {
@@ -901,24 +1024,13 @@ static int sess_cache_close(tls_sess_cache_t *cache) {
 
   if (cache != NULL &&
       cache->cache_pool != NULL) {
-    destroy_pool(cache->cache_pool);
-
-    if (sesscache_sess_list != NULL) {
-      register unsigned int i;
-      struct sesscache_large_entry *entries;
-
-      entries = sesscache_sess_list->elts;
-      for (i = 0; i < sesscache_sess_list->nelts; i++) {
-        struct sesscache_large_entry *entry;
-
-        entry = &(entries[i]);
-        if (entry->expires > 0) {
-          pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
-        }
-      }
-
-      sesscache_sess_list = NULL;
+    if (sesscache_sess_tab != NULL) {
+      (void) pr_table_do(sesscache_sess_tab, sess_cache_scrub_large_sess_cb,
+        NULL, PR_TABLE_DO_FL_ALL);
+      sesscache_sess_tab = NULL;
     }
+
+    destroy_pool(cache->cache_pool);
   }
 
   if (sesscache_shmid >= 0) {
@@ -951,67 +1063,53 @@ static int sess_cache_add_large_sess(tls_sess_cache_t *cache,
     const unsigned char *sess_id, unsigned int sess_id_len, time_t expires,
     SSL_SESSION *sess, int sess_len) {
   struct sesscache_large_entry *entry = NULL;
+  unsigned char *ptr;
+  time_t now;
 
   if (sess_len > TLS_MAX_SSL_SESSION_SIZE) {
     /* We may get sessions to add to the list which do not exceed the max
      * size, but instead are here because we couldn't get the lock on the
      * shmcache.  Don't track these in the 'exceeded' stats'.
      */
-
-    if (shmcache_lock_shm(sesscache_fh, F_WRLCK) == 0) {
-      sesscache_data->nexceeded++;
-      if ((size_t) sess_len > sesscache_data->exceeded_maxsz) {
-        sesscache_data->exceeded_maxsz = sess_len;
-      }
-
-      if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
-        tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-      }
-
-    } else {
-      tls_log("shmcache: error write-locking shmcache: %s", strerror(errno));
-    }
+    SHMCACHE_INCR(sesscache_data->nexceeded);
+    shmcache_update_max(&(sesscache_data->exceeded_maxsz), sess_len);
   }
 
-  if (sesscache_sess_list != NULL) {
-    register unsigned int i;
-    struct sesscache_large_entry *entries;
-    time_t now;
-
-    /* Look for any expired sessions in the list to overwrite/reuse. */
-    entries = sesscache_sess_list->elts;
-    now = time(NULL);
-    for (i = 0; i < sesscache_sess_list->nelts; i++) {
-      entry = &(entries[i]);
-
-      if (entry->expires > now) {
-        /* This entry has expired; clear and reuse its slot. */
-        entry->expires = 0;
-        pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
-
-        break;
-      }
-    }
-
-  } else {
-    sesscache_sess_list = make_array(cache->cache_pool, 1,
-      sizeof(struct sesscache_large_entry));
-    entry = push_array(sesscache_sess_list);
+  if (sesscache_sess_tab == NULL) {
+    sesscache_sess_tab = shmcache_alloc_large_tab(cache->cache_pool);
   }
 
-  /* Be defensive, and catch the case where entry might still be null here. */
-  if (entry == NULL) {
-    errno = EPERM;
-    return -1;
+  /* Clear out any expired sessions, and any existing entry for this
+   * session ID.
+   */
+  now = time(NULL);
+  (void) pr_table_do(sesscache_sess_tab, sess_cache_scrub_large_sess_cb, &now,
+    PR_TABLE_DO_FL_ALL);
+
+  entry = (struct sesscache_large_entry *) pr_table_kremove(sesscache_sess_tab,
+    sess_id, sess_id_len, NULL);
+  if (entry != NULL) {
+    sess_cache_scrub_large_sess(entry);
   }
 
+  entry = pcalloc(cache->cache_pool, sizeof(struct sesscache_large_entry));
   entry->expires = expires;
   entry->sess_id_len = sess_id_len;
   entry->sess_id = palloc(cache->cache_pool, sess_id_len);
   memcpy((char *) entry->sess_id, sess_id, sess_id_len);
   entry->sess_datalen = sess_len;
-  entry->sess_data = palloc(cache->cache_pool, sess_len);
-  i2d_SSL_SESSION(sess, (unsigned char **) &(entry->sess_data));
+  entry->sess_data = ptr = palloc(cache->cache_pool, sess_len);
+  i2d_SSL_SESSION(sess, &ptr);
+
+  if (pr_table_kadd(sesscache_sess_tab, entry->sess_id, sess_id_len, entry,
+      sizeof(struct sesscache_large_entry)) < 0) {
+    int xerrno = errno;
+
+    sess_cache_scrub_large_sess(entry);
+
+    errno = xerrno;
+    return -1;
+  }
 
   return 0;
 }
@@ -1019,8 +1117,11 @@ static int sess_cache_add_large_sess(tls_sess_cache_t *cache,
 static int sess_cache_add(tls_sess_cache_t *cache, const unsigned char *sess_id,
     unsigned int sess_id_len, time_t expires, SSL_SESSION *sess) {
   register unsigned int i;
-  unsigned int h, idx, last;
-  int found_slot = FALSE, need_lock = TRUE, res = 0, sess_len;
+  unsigned int h, set, start, end;
+  int replacing = FALSE, sess_len;
+  struct sesscache_entry *slot = NULL;
+  unsigned char *ptr;
+  time_t now;
 
   pr_trace_msg(trace_channel, 9, "adding session to shmcache session cache %p",
     cache);
@@ -1048,227 +1149,163 @@ static int sess_cache_add(tls_sess_cache_t *cache, const unsigned char *sess_id,
       sess, sess_len);
   }
 
-  if (sesscache_data->sd_listlen == sesscache_data->sd_listsz) {
-    /* It appears that the cache is full.  Try flushing any expired
-     * sessions.
-     */
-
-    if (shmcache_lock_shm(sesscache_fh, F_WRLCK) == 0) {
-      if (sess_cache_flush() > 0) {
-        /* If we made room, then do NOT release the lock; we keep the lock
-         * so that we can add the session.
-         */
-        need_lock = FALSE;
-
-      } else {
-        /* Release the lock, and use the "large session" list fallback. */
-        if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
-          tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-        }
-
-        return sess_cache_add_large_sess(cache, sess_id, sess_id_len, expires,
-          sess, sess_len);
-      }
-
-    } else {
-      tls_log("shmcache: unable to flush shm cache: error write-locking "
-        "shmcache: %s", strerror(errno));
-
-      /* Add this session to the "large session" list instead as a fallback. */
-      return sess_cache_add_large_sess(cache, sess_id, sess_id_len, expires,
-        sess, sess_len);
-    }
-  }
-
-  /* Hash the key, start looking for an open slot. */
+  /* Hash the key to its set, and lock just that set. */
   h = shmcache_hash(sess_id, sess_id_len);
-  idx = h % sesscache_data->sd_listsz;
+  set = shmcache_get_set(h, sesscache_data->sd_listsz,
+    sesscache_data->sd_nsets, &start, &end);
 
-  if (need_lock) {
-    if (shmcache_lock_shm(sesscache_fh, F_WRLCK) < 0) {
-      tls_log("shmcache: unable to add session to shm cache: error "
-        "write-locking shmcache: %s", strerror(errno));
+  if (sess_cache_lock_set(F_WRLCK, set) < 0) {
+    tls_log("shmcache: unable to add session to shm cache: error "
+      "write-locking shmcache: %s", strerror(errno));
 
-      /* Add this session to the "large session" list instead as a fallback. */
-      return sess_cache_add_large_sess(cache, sess_id, sess_id_len, expires,
-        sess, sess_len);
-    }
+    /* Add this session to the "large session" list instead as a fallback. */
+    return sess_cache_add_large_sess(cache, sess_id, sess_id_len, expires,
+      sess, sess_len);
   }
 
-  i = idx;
-  last = idx > 0 ? (idx - 1) : 0;
-
-  do {
+  /* Use the slot already holding this session ID, if any.  Otherwise, use
+   * the slot which expires soonest: an open slot (i.e. expires == 0) first,
+   * then an expired slot, and only then evict a live session.
+   */
+  for (i = start; i < end; i++) {
     struct sesscache_entry *entry;
 
-    pr_signals_handle();
-
-    /* Look for the first open slot (i.e. expires == 0). */
     entry = &(sesscache_data->sd_entries[i]);
-    if (entry->expires == 0) {
-      unsigned char *ptr;
+    if (entry->expires > 0 &&
+        entry->sess_id_len == sess_id_len &&
+        memcmp(entry->sess_id, sess_id, sess_id_len) == 0) {
+      slot = entry;
+      replacing = TRUE;
+      break;
+    }
 
-      entry->expires = expires;
-      entry->sess_id_len = sess_id_len;
-      memcpy(entry->sess_id, sess_id, sess_id_len);
-      entry->sess_datalen = sess_len;
+    if (slot == NULL ||
+        entry->expires < slot->expires) {
+      slot = entry;
+    }
+  }
 
-      ptr = entry->sess_data;
-      i2d_SSL_SESSION(sess, &ptr);
+  now = time(NULL);
 
-      sesscache_data->sd_listlen++;
-      sesscache_data->nstored++;
+  if (slot->expires == 0) {
+    SHMCACHE_INCR(sesscache_data->sd_listlen);
 
-      if (sesscache_data->next_expiring > 0) {
-        if (expires < sesscache_data->next_expiring) {
-          sesscache_data->next_expiring = expires;
-        }
+  } else {
+    if (replacing == FALSE) {
+      /* Don't forget to update the stats. */
+      if (slot->expires <= now) {
+        SHMCACHE_INCR(sesscache_data->nexpired);
 
       } else {
-        sesscache_data->next_expiring = expires;
+        pr_trace_msg(trace_channel, 12,
+          "session cache set %u full, evicting session expiring in %lu secs",
+          set, (unsigned long) (slot->expires - now));
+        SHMCACHE_INCR(sesscache_data->nevicted);
       }
-
-      found_slot = TRUE;
-      break;
     }
 
-    if (i < sesscache_data->sd_listsz) {
-      i++;
+    pr_memscrub(slot->sess_data, slot->sess_datalen);
+  }
 
-    } else {
-      i = 0;
-    }
+  slot->expires = expires;
+  slot->sess_id_len = sess_id_len;
+  memcpy(slot->sess_id, sess_id, sess_id_len);
+  slot->sess_datalen = sess_len;
 
-  } while (i != last);
+  ptr = slot->sess_data;
+  i2d_SSL_SESSION(sess, &ptr);
 
-  /* There is a race condition possible between the open slots check
-   * above and the scan through the slots.  So if we didn't actually find
-   * an open slot at this point, add it to the "large session" list.
-   */
-  if (!found_slot) {
-    res = sess_cache_add_large_sess(cache, sess_id, sess_id_len, expires, sess,
-      sess_len);
-  }
+  SHMCACHE_INCR(sesscache_data->nstored);
 
-  if (need_lock) {
-    if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
-      tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-    }
+  if (sess_cache_lock_set(F_UNLCK, set) < 0) {
+    tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
   }
 
-  return res;
+  return 0;
 }
 
 static SSL_SESSION *sess_cache_get(tls_sess_cache_t *cache,
     const unsigned char *sess_id, unsigned int sess_id_len) {
-  unsigned int h, idx;
+  register unsigned int i;
+  unsigned int h, set, start, end;
   SSL_SESSION *sess = NULL;
+  time_t now;
 
   pr_trace_msg(trace_channel, 9,
     "getting session from shmcache session cache %p", cache);
 
-  /* Look for the requested session in the "large session" list first. */
-  if (sesscache_sess_list != NULL) {
-    register unsigned int i;
-    struct sesscache_large_entry *entries;
-
-    entries = sesscache_sess_list->elts;
-    for (i = 0; i < sesscache_sess_list->nelts; i++) {
-      struct sesscache_large_entry *entry;
-
-      entry = &(entries[i]);
-      if (entry->expires > 0 &&
-          entry->sess_id_len == sess_id_len &&
-          memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
-        time_t now;
+  now = time(NULL);
 
-        now = time(NULL);
-        if (entry->expires <= now) {
-          TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
+  /* Look for the requested session in the "large session" list first. */
+  if (sesscache_sess_tab != NULL) {
+    const struct sesscache_large_entry *entry;
 
-          ptr = entry->sess_data;
-          sess = d2i_SSL_SESSION(NULL, &ptr, entry->sess_datalen);
-          if (sess == NULL) {
-            tls_log("shmcache: error retrieving session from session cache: %s",
-              shmcache_get_errors());
+    entry = pr_table_kget(sesscache_sess_tab, sess_id, sess_id_len, NULL);
+    if (entry != NULL &&
+        entry->expires > now) {
+      TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
 
-          } else {
-            break;
-          }
-        }
+      ptr = entry->sess_data;
+      sess = d2i_SSL_SESSION(NULL, &ptr, entry->sess_datalen);
+      if (sess != NULL) {
+        return sess;
       }
-    }
-  }
 
-  if (sess) {
-    return sess;
+      tls_log("shmcache: error retrieving session from session cache: %s",
+        shmcache_get_errors());
+    }
   }
 
   h = shmcache_hash(sess_id, sess_id_len);
-  idx = h % sesscache_data->sd_listsz;
+  set = shmcache_get_set(h, sesscache_data->sd_listsz,
+    sesscache_data->sd_nsets, &start, &end);
 
-  if (shmcache_lock_shm(sesscache_fh, F_WRLCK) == 0) {
-    register unsigned int i;
-    unsigned int last;
+  if (sess_cache_lock_set(SHMCACHE_GET_LOCK, set) < 0) {
+    tls_log("shmcache: unable to retrieve session from session cache: error "
+      "locking shmcache: %s", strerror(errno));
 
-    i = idx;
-    last = idx > 0 ? (idx -1) : 0;
+    errno = EPERM;
+    return NULL;
+  }
 
-    do {
-      struct sesscache_entry *entry;
+  for (i = start; i < end; i++) {
+    struct sesscache_entry *entry;
 
-      pr_signals_handle();
+    entry = &(sesscache_data->sd_entries[i]);
+    if (entry->expires > 0 &&
+        entry->sess_id_len == sess_id_len &&
+        memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
 
-      entry = &(sesscache_data->sd_entries[i]);
-      if (entry->expires > 0 &&
-          entry->sess_id_len == sess_id_len &&
-          memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
-        time_t now;
+      if (entry->expires > now) {
+        TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
 
         /* Don't forget to update the stats. */
-        now = time(NULL);
-
-        if (entry->expires > now) {
-          TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
-
-          ptr = entry->sess_data;
-          sess = d2i_SSL_SESSION(NULL, &ptr, entry->sess_datalen);
-          if (sess != NULL) {
-            sesscache_data->nhits++;
+        ptr = entry->sess_data;
+        sess = d2i_SSL_SESSION(NULL, &ptr, entry->sess_datalen);
+        if (sess != NULL) {
+          SHMCACHE_INCR(sesscache_data->nhits);
 
-          } else {
-            tls_log("shmcache: error retrieving session from session cache: %s",
-              shmcache_get_errors());
-            sesscache_data->nerrors++;
-          }
+        } else {
+          tls_log("shmcache: error retrieving session from session cache: %s",
+            shmcache_get_errors());
+          SHMCACHE_INCR(sesscache_data->nerrors);
         }
-
-        break;
       }
 
-      if (i < sesscache_data->sd_listsz) {
-        i++;
-
-      } else {
-        i = 0;
-      }
-
-    } while (i != last);
-
-    if (sess == NULL) {
-      sesscache_data->nmisses++;
-      errno = ENOENT;
+      break;
     }
+  }
 
-    if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
-      tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-    }
+  if (sess == NULL) {
+    SHMCACHE_INCR(sesscache_data->nmisses);
+  }
 
-  } else {
-    tls_log("shmcache: unable to retrieve session from session cache: error "
-      "write-locking shmcache: %s", strerror(errno));
+  if (sess_cache_lock_set(F_UNLCK, set) < 0) {
+    tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
+  }
 
-    errno = EPERM;
+  if (sess == NULL) {
+    errno = ENOENT;
   }
 
   return sess;
@@ -1276,95 +1313,68 @@ static SSL_SESSION *sess_cache_get(tls_sess_cache_t *cache,
 
 static int sess_cache_delete(tls_sess_cache_t *cache,
     const unsigned char *sess_id, unsigned int sess_id_len) {
-  unsigned int h, idx;
-  int res;
+  register unsigned int i;
+  unsigned int h, set, start, end;
+  time_t now;
 
   pr_trace_msg(trace_channel, 9,
     "removing session from shmcache session cache %p", cache);
 
   /* Look for the requested session in the "large session" list first. */
-  if (sesscache_sess_list != NULL) {
-    register unsigned int i;
-    struct sesscache_large_entry *entries;
-
-    entries = sesscache_sess_list->elts;
-    for (i = 0; i < sesscache_sess_list->nelts; i++) {
-      struct sesscache_large_entry *entry;
-
-      entry = &(entries[i]);
-      if (entry->sess_id_len == sess_id_len &&
-          memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
-
-        pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
-        entry->expires = 0;
-        return 0;
-      }
+  if (sesscache_sess_tab != NULL) {
+    struct sesscache_large_entry *entry;
+
+    entry = (struct sesscache_large_entry *) pr_table_kremove(
+      sesscache_sess_tab, sess_id, sess_id_len, NULL);
+    if (entry != NULL) {
+      sess_cache_scrub_large_sess(entry);
+      return 0;
     }
   }
 
   h = shmcache_hash(sess_id, sess_id_len);
-  idx = h % sesscache_data->sd_listsz;
-
-  if (shmcache_lock_shm(sesscache_fh, F_WRLCK) == 0) {
-    register unsigned int i;
-    unsigned int last;
-
-    i = idx;
-    last = idx > 0 ? (idx - 1) : 0;
-
-    do {
-      struct sesscache_entry *entry;
+  set = shmcache_get_set(h, sesscache_data->sd_listsz,
+    sesscache_data->sd_nsets, &start, &end);
 
-      pr_signals_handle();
+  if (sess_cache_lock_set(F_WRLCK, set) < 0) {
+    tls_log("shmcache: unable to delete session from session cache: error "
+      "write-locking shmcache: %s", strerror(errno));
 
-      entry = &(sesscache_data->sd_entries[i]);
-      if (entry->sess_id_len == sess_id_len &&
-          memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
-        time_t now;
+    errno = EPERM;
+    return -1;
+  }
 
-        pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
+  now = time(NULL);
 
-        if (sesscache_data->sd_listlen > 0) {
-          sesscache_data->sd_listlen--;
-        }
+  for (i = start; i < end; i++) {
+    struct sesscache_entry *entry;
 
-        /* Don't forget to update the stats. */
-        now = time(NULL);
-        if (entry->expires > now) {
-          sesscache_data->ndeleted++;
+    entry = &(sesscache_data->sd_entries[i]);
+    if (entry->expires > 0 &&
+        entry->sess_id_len == sess_id_len &&
+        memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
 
-        } else {
-          sesscache_data->nexpired++;
-        }
+      pr_memscrub(entry->sess_data, entry->sess_datalen);
+      SHMCACHE_DECR(sesscache_data->sd_listlen);
 
-        entry->expires = 0;
-        break;
-      }
-
-      if (i < sesscache_data->sd_listsz) {
-        i++;
+      /* Don't forget to update the stats. */
+      if (entry->expires > now) {
+        SHMCACHE_INCR(sesscache_data->ndeleted);
 
       } else {
-        i = 0;
+        SHMCACHE_INCR(sesscache_data->nexpired);
       }
 
-    } while (i != last);
-
-    if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
-      tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
+      entry->expires = 0;
+      break;
     }
+  }
 
-    res = 0;
-
-  } else {
-    tls_log("shmcache: unable to delete session from session cache: error "
-      "write-locking shmcache: %s", strerror(errno));
-
-    errno = EPERM;
-    res = -1;
+  if (sess_cache_lock_set(F_UNLCK, set) < 0) {
+    tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
   }
 
-  return res;
+  return 0;
 }
 
 static int sess_cache_clear(tls_sess_cache_t *cache) {
@@ -1378,20 +1388,13 @@ static int sess_cache_clear(tls_sess_cache_t *cache) {
     return -1;
   }
 
-  if (sesscache_sess_list != NULL) {
-    struct sesscache_large_entry *entries;
-    
-    entries = sesscache_sess_list->elts;
-    for (i = 0; i < sesscache_sess_list->nelts; i++) {
-      struct sesscache_large_entry *entry;
-
-      entry = &(entries[i]);
-      entry->expires = 0;
-      pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
-    }
+  if (sesscache_sess_tab != NULL) {
+    (void) pr_table_do(sesscache_sess_tab, sess_cache_scrub_large_sess_cb,
+      NULL, PR_TABLE_DO_FL_ALL);
+    (void) pr_table_empty(sesscache_sess_tab);
   }
 
-  if (shmcache_lock_shm(sesscache_fh, F_WRLCK) < 0) {
+  if (sess_cache_lock(F_WRLCK) < 0) {
     tls_log("shmcache: unable to clear cache: error write-locking shmcache: %s",
       strerror(errno));
     return -1;
@@ -1409,7 +1412,7 @@ static int sess_cache_clear(tls_sess_cache_t *cache) {
   res = sesscache_data->sd_listlen; 
   sesscache_data->sd_listlen = 0;
 
-  if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
+  if (sess_cache_lock(F_UNLCK) < 0) {
     tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
   }
 
@@ -1462,6 +1465,28 @@ static int sess_cache_remove(tls_sess_cache_t *cache) {
   return res;
 }
 
+static void shmcache_status_lockstats(struct shmcache_lockstats *stats,
+    unsigned int listsz, unsigned int nsets,
+    void (*statusf)(void *, const char *, ...), void *arg) {
+  unsigned long nlocks, ncontended, wait_usecs, max_wait_usecs;
+
+  nlocks = stats->nlocks;
+  ncontended = stats->ncontended;
+  wait_usecs = stats->wait_usecs;
+  max_wait_usecs = stats->max_wait_usecs;
+
+  statusf(arg, "Cache sets: %u (%u entries per set)", nsets,
+    nsets > 1 ? TLS_SHMCACHE_SET_SIZE : listsz);
+  statusf(arg, "Cache lifetime locks: %lu", nlocks);
+  statusf(arg, "Cache lifetime contended locks: %lu", ncontended);
+  if (ncontended > 0) {
+    statusf(arg, "  Total lock wait time: %lu usecs", wait_usecs);
+    statusf(arg, "  Average lock wait time: %lu usecs",
+      wait_usecs / ncontended);
+    statusf(arg, "  Maximum lock wait time: %lu usecs", max_wait_usecs);
+  }
+}
+
 static int sess_cache_status(tls_sess_cache_t *cache,
     void (*statusf)(void *, const char *, ...), void *arg, int flags) {
   int res, xerrno = 0;
@@ -1470,7 +1495,7 @@ static int sess_cache_status(tls_sess_cache_t *cache,
 
   pr_trace_msg(trace_channel, 9, "checking shmcache session cache %p", cache);
 
-  if (shmcache_lock_shm(sesscache_fh, F_RDLCK) < 0) {
+  if (sess_cache_lock(F_RDLCK) < 0) {
     pr_log_debug(DEBUG1, MOD_TLS_SHMCACHE_VERSION
       ": error read-locking shmcache: %s", strerror(errno));
     return -1;
@@ -1511,6 +1536,10 @@ static int sess_cache_status(tls_sess_cache_t *cache,
   statusf(arg, "Cache lifetime sessions stored: %u", sesscache_data->nstored);
   statusf(arg, "Cache lifetime sessions deleted: %u", sesscache_data->ndeleted);
   statusf(arg, "Cache lifetime sessions expired: %u", sesscache_data->nexpired);
+  statusf(arg, "Cache lifetime sessions evicted: %u", sesscache_data->nevicted);
+  statusf(arg, "%s", "");
+  shmcache_status_lockstats(&(sesscache_data->sd_lockstats),
+    sesscache_data->sd_listsz, sesscache_data->sd_nsets, statusf, arg);
   statusf(arg, "%s", "");
   statusf(arg, "Cache lifetime errors handling sessions in cache: %u",
     sesscache_data->nerrors);
@@ -1630,7 +1659,7 @@ static int sess_cache_status(tls_sess_cache_t *cache,
     }
   }
 
-  if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
+  if (sess_cache_lock(F_UNLCK) < 0) {
     pr_log_debug(DEBUG1, MOD_TLS_SHMCACHE_VERSION
       ": error unlocking shmcache: %s", strerror(errno));
   }
@@ -1644,67 +1673,36 @@ static int sess_cache_status(tls_sess_cache_t *cache,
 /* OCSP response cache implementation callbacks.
  */
 
-/* Scan the entire list, and clear out the oldest response.  Logs the number
- * of responses cleared and updates the header stat.
- *
- * NOTE: Callers are assumed to handle the locking of the shm before/after
- * calling this function!
- */
-static unsigned int ocsp_cache_flush(void) {
-  register unsigned int i;
-  unsigned int flushed = 0;
-  time_t now;
-
-  now = time(NULL);
-
-  /* We always scan the in-memory large response entry list. */
-  if (ocspcache_resp_list != NULL) {
-    struct ocspcache_large_entry *entries;
-
-    entries = ocspcache_resp_list->elts;
-    for (i = 0; i < ocspcache_resp_list->nelts; i++) {
-      struct ocspcache_large_entry *entry;
-
-      entry = &(entries[i]);
-
-      if (entry->age > (now - 3600)) {
-        /* This entry has expired; clear its slot. */
-        pr_memscrub(entry->resp_der, entry->resp_derlen);
-        entry->resp_derlen = 0;
-        pr_memscrub(entry->fingerprint, entry->fingerprint_len);
-        entry->fingerprint_len = 0;
-      }
-    }
-  }
-
-  tls_log("shmcache: flushing ocsp cache of oldest responses");
+static int ocsp_cache_lock(int lock_type) {
+  return shmcache_lock_shm_range(ocspcache_fh, lock_type, 0, 0,
+    &(ocspcache_data->od_lockstats));
+}
 
-  for (i = 0; i < ocspcache_data->od_listsz; i++) {
-    struct ocspcache_entry *entry;
+static int ocsp_cache_lock_set(int lock_type, unsigned int set) {
+  return shmcache_lock_shm_range(ocspcache_fh, lock_type, set, 1,
+    &(ocspcache_data->od_lockstats));
+}
 
-    entry = &(ocspcache_data->od_entries[i]);
-    if (entry->age > (now - 3600)) {
-      /* This entry has expired; clear its slot. */
-      pr_memscrub(entry->resp_der, entry->resp_derlen);
-      entry->resp_derlen = 0;
-      pr_memscrub(entry->fingerprint, entry->fingerprint_len);
-      entry->fingerprint_len = 0;
-      entry->age = 0;
+static void ocsp_cache_scrub_entry(struct ocspcache_entry *entry) {
+  pr_memscrub(entry->resp_der, entry->resp_derlen);
+  entry->resp_derlen = 0;
+  pr_memscrub(entry->fingerprint, entry->fingerprint_len);
+  entry->fingerprint_len = 0;
+  entry->age = 0;
+}
 
-      /* Don't forget to update the stats. */
-      ocspcache_data->nexpired++;
+static int ocsp_cache_scrub_large_resp_cb(const void *key_data,
+    size_t key_datasz, const void *value_data, size_t value_datasz,
+    void *user_data) {
+  struct ocspcache_large_entry *entry;
 
-      if (ocspcache_data->od_listlen > 0) {
-        ocspcache_data->od_listlen--;
-      }
+  entry = (struct ocspcache_large_entry *) value_data;
 
-      flushed++;
-    }
-  }
+  pr_memscrub(entry->resp_der, entry->resp_derlen);
+  entry->resp_derlen = 0;
+  entry->age = 0;
 
-  tls_log("shmcache: flushed %u old %s from ocsp cache", flushed,
-    flushed != 1 ? "responses" : "response");
-  return flushed;
+  return 0;
 }
 
 static int ocsp_cache_open(tls_ocsp_cache_t *cache, char *info) {
@@ -1907,19 +1905,10 @@ static int ocsp_cache_close(tls_ocsp_cache_t *cache) {
 
   if (cache != NULL &&
       cache->cache_pool != NULL) {
-    if (ocspcache_resp_list != NULL) {
-      register unsigned int i;
-      struct ocspcache_large_entry *entries;
-
-      entries = ocspcache_resp_list->elts;
-      for (i = 0; i < ocspcache_resp_list->nelts; i++) {
-        struct ocspcache_large_entry *entry;
-
-        entry = &(entries[i]);
-        pr_memscrub(entry->resp_der, entry->resp_derlen);
-      }
-
-      ocspcache_resp_list = NULL;
+    if (ocspcache_resp_tab != NULL) {
+      (void) pr_table_do(ocspcache_resp_tab, ocsp_cache_scrub_large_resp_cb,
+        NULL, PR_TABLE_DO_FL_ALL);
+      ocspcache_resp_tab = NULL;
     }
 
     destroy_pool(cache->cache_pool);
@@ -1964,57 +1953,22 @@ static int ocsp_cache_add_large_resp(tls_ocsp_cache_t *cache,
      * size, but instead are here because we couldn't get the lock on the
      * shmcache.  Don't track these in the 'exceeded' stats'.
      */
-
-    if (shmcache_lock_shm(ocspcache_fh, F_WRLCK) == 0) {
-      ocspcache_data->nexceeded++;
-      if ((size_t) resp_derlen > ocspcache_data->exceeded_maxsz) {
-        ocspcache_data->exceeded_maxsz = resp_derlen;
-      }
-
-      if (shmcache_lock_shm(ocspcache_fh, F_UNLCK) < 0) {
-        tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-      }
-
-    } else {
-      tls_log("shmcache: error write-locking shmcache: %s", strerror(errno));
-    }
+    SHMCACHE_INCR(ocspcache_data->nexceeded);
+    shmcache_update_max(&(ocspcache_data->exceeded_maxsz), resp_derlen);
   }
 
-  if (ocspcache_resp_list != NULL) {
-    register unsigned int i;
-    struct ocspcache_large_entry *entries;
-    time_t now;
-
-    /* Look for any expired responses in the list to overwrite/reuse. */
-    entries = ocspcache_resp_list->elts;
-    now = time(NULL);
-    for (i = 0; i < ocspcache_resp_list->nelts; i++) {
-      entry = &(entries[i]);
-
-      if (entry->age > (now - 3600)) {
-        /* This entry has expired; clear and reuse its slot. */
-        entry->age = 0;
-        pr_memscrub(entry->resp_der, entry->resp_derlen);
-        entry->resp_derlen = 0;
-        pr_memscrub(entry->fingerprint, entry->fingerprint_len);
-        entry->fingerprint_len = 0;
-
-        break;
-      }
-    }
-
-  } else {
-    ocspcache_resp_list = make_array(cache->cache_pool, 1,
-      sizeof(struct ocspcache_large_entry));
-    entry = push_array(ocspcache_resp_list);
+  if (ocspcache_resp_tab == NULL) {
+    ocspcache_resp_tab = shmcache_alloc_large_tab(cache->cache_pool);
   }
 
-  /* Be defensive, and catch the case where entry might still be null here. */
-  if (entry == NULL) {
-    errno = EPERM;
-    return -1;
+  /* Replace any existing entry for this fingerprint. */
+  entry = (struct ocspcache_large_entry *) pr_table_kremove(ocspcache_resp_tab,
+    fingerprint, strlen(fingerprint), NULL);
+  if (entry != NULL) {
+    (void) ocsp_cache_scrub_large_resp_cb(NULL, 0, entry, 0, NULL);
   }
 
+  entry = pcalloc(cache->cache_pool, sizeof(struct ocspcache_large_entry));
   entry->age = resp_age;
   entry->fingerprint_len = strlen(fingerprint);
   entry->fingerprint = palloc(cache->cache_pool, entry->fingerprint_len);
@@ -2025,15 +1979,27 @@ static int ocsp_cache_add_large_resp(tls_ocsp_cache_t *cache,
   ptr = entry->resp_der;
   i2d_OCSP_RESPONSE(resp, &ptr);
 
+  if (pr_table_kadd(ocspcache_resp_tab, entry->fingerprint,
+      entry->fingerprint_len, entry, sizeof(struct ocspcache_large_entry)) < 0) {
+    int xerrno = errno;
+
+    (void) ocsp_cache_scrub_large_resp_cb(NULL, 0, entry, 0, NULL);
+
+    errno = xerrno;
+    return -1;
+  }
+
   return 0;
 }
 
 static int ocsp_cache_add(tls_ocsp_cache_t *cache, const char *fingerprint,
     OCSP_RESPONSE *resp, time_t resp_age) {
   register unsigned int i;
-  unsigned int h, idx, last;
-  int found_slot = FALSE, need_lock = TRUE, res = 0, resp_derlen;
+  unsigned int h, set, start, end;
+  int replacing = FALSE, resp_derlen;
   size_t fingerprint_len;
+  struct ocspcache_entry *slot = NULL;
+  unsigned char *ptr;
 
   pr_trace_msg(trace_channel, 9, "adding response to shmcache ocsp cache %p",
     cache);
@@ -2068,108 +2034,89 @@ static int ocsp_cache_add(tls_ocsp_cache_t *cache, const char *fingerprint,
     return ocsp_cache_add_large_resp(cache, fingerprint, resp, resp_age);
   }
 
-  if (ocspcache_data->od_listlen == ocspcache_data->od_listsz) {
-    /* It appears that the cache is full.  Flush the oldest response. */
-    if (shmcache_lock_shm(ocspcache_fh, F_WRLCK) == 0) {
-      if (ocsp_cache_flush() > 0) {
-        /* If we made room, then do NOT release the lock; we keep the lock
-         * so that we can add the response.
-         */
-        need_lock = FALSE;
-
-      } else {
-        /* Release the lock, and use the "large response" list fallback. */
-        if (shmcache_lock_shm(ocspcache_fh, F_UNLCK) < 0) {
-          tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-        }
-
-        return ocsp_cache_add_large_resp(cache, fingerprint, resp, resp_age);
-      }
-
-    } else {
-      tls_log("shmcache: unable to flush ocsp shmcache: error write-locking "
-        "shmcache: %s", strerror(errno));
-
-      /* Add this response to the "large response" list instead as a
-       * fallback.
-       */
-      return ocsp_cache_add_large_resp(cache, fingerprint, resp, resp_age);
-    }
-  }
-
-  /* Hash the key, start looking for an open slot. */
+  /* Hash the key to its set, and lock just that set. */
   fingerprint_len = strlen(fingerprint);
   h = shmcache_hash((unsigned char *) fingerprint, fingerprint_len);
-  idx = h % ocspcache_data->od_listsz;
+  set = shmcache_get_set(h, ocspcache_data->od_listsz,
+    ocspcache_data->od_nsets, &start, &end);
 
-  if (need_lock) {
-    if (shmcache_lock_shm(ocspcache_fh, F_WRLCK) < 0) {
-      tls_log("shmcache: unable to add response to ocsp shmcache: error "
-        "write-locking shmcache: %s", strerror(errno));
+  if (ocsp_cache_lock_set(F_WRLCK, set) < 0) {
+    tls_log("shmcache: unable to add response to ocsp shmcache: error "
+      "write-locking shmcache: %s", strerror(errno));
 
-      /* Add this response to the "large response" list instead as a
-       * fallback.
-       */
-      return ocsp_cache_add_large_resp(cache, fingerprint, resp, resp_age);
-    }
+    /* Add this response to the "large response" list instead as a
+     * fallback.
+     */
+    return ocsp_cache_add_large_resp(cache, fingerprint, resp, resp_age);
   }
 
-  i = idx;
-  last = idx > 0 ? (idx - 1) : 0;
-
-  do {
+  /* Use the slot already holding a response for this fingerprint, if any.
+   * Otherwise, use an open slot (i.e. fingerprint_len == 0), or evict the
+   * oldest response in the set.
+   */
+  for (i = start; i < end; i++) {
     struct ocspcache_entry *entry;
 
-    pr_signals_handle();
-
-    /* Look for the first open slot (i.e. fingerprint_len == 0). */
     entry = &(ocspcache_data->od_entries[i]);
+    if (entry->fingerprint_len > 0 &&
+        entry->fingerprint_len == fingerprint_len &&
+        memcmp(entry->fingerprint, fingerprint, fingerprint_len) == 0) {
+      slot = entry;
+      replacing = TRUE;
+      break;
+    }
+
     if (entry->fingerprint_len == 0) {
-      unsigned char *ptr;
+      slot = entry;
+      break;
+    }
 
-      entry->age = resp_age;
-      entry->fingerprint_len = fingerprint_len;
-      memcpy(entry->fingerprint, fingerprint, fingerprint_len);
-      entry->resp_derlen = resp_derlen;
+    if (slot == NULL ||
+        entry->age < slot->age) {
+      slot = entry;
+    }
+  }
 
-      ptr = entry->resp_der;
-      i2d_OCSP_RESPONSE(resp, &ptr);
+  if (slot->fingerprint_len == 0) {
+    SHMCACHE_INCR(ocspcache_data->od_listlen);
 
-      ocspcache_data->od_listlen++;
-      ocspcache_data->nstored++;
+  } else {
+    if (replacing == FALSE) {
+      /* Don't forget to update the stats. */
+      if (slot->age <= (time(NULL) - 3600)) {
+        SHMCACHE_INCR(ocspcache_data->nexpired);
 
-      found_slot = TRUE;
-      break;
+      } else {
+        pr_trace_msg(trace_channel, 12,
+          "ocsp cache set %u full, evicting oldest response", set);
+        SHMCACHE_INCR(ocspcache_data->nevicted);
+      }
     }
 
-    if (i < ocspcache_data->od_listsz) {
-      i++;
+    ocsp_cache_scrub_entry(slot);
+  }
 
-    } else {
-      i = 0;
-    }
-  } while (i != last);
+  slot->age = resp_age;
+  slot->fingerprint_len = fingerprint_len;
+  memcpy(slot->fingerprint, fingerprint, fingerprint_len);
+  slot->resp_derlen = resp_derlen;
 
-  /* There is a race condition possible between the open slots check
-   * above and the scan through the slots.  So if we didn't actually find
-   * an open slot at this point, add it to the "large response" list.
-   */
-  if (!found_slot) {
-    res = ocsp_cache_add_large_resp(cache, fingerprint, resp, resp_age);
-  }
+  ptr = slot->resp_der;
+  i2d_OCSP_RESPONSE(resp, &ptr);
 
-  if (need_lock) {
-    if (shmcache_lock_shm(ocspcache_fh, F_UNLCK) < 0) {
-      tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-    }
+  SHMCACHE_INCR(ocspcache_data->nstored);
+
+  if (ocsp_cache_lock_set(F_UNLCK, set) < 0) {
+    tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
   }
 
-  return res;
+  return 0;
 }
 
 static OCSP_RESPONSE *ocsp_cache_get(tls_ocsp_cache_t *cache,
     const char *fingerprint, time_t *resp_age) {
-  unsigned int h, idx;
+  register unsigned int i;
+  unsigned int h, set, start, end;
   OCSP_RESPONSE *resp = NULL;
   size_t fingerprint_len = 0;
 
@@ -2179,106 +2126,84 @@ static OCSP_RESPONSE *ocsp_cache_get(tls_ocsp_cache_t *cache,
   fingerprint_len = strlen(fingerprint);
 
   /* Look for the requested response in the "large response" list first. */
-  if (ocspcache_resp_list != NULL) {
-    register unsigned int i;
-    struct ocspcache_large_entry *entries;
-
-    entries = ocspcache_resp_list->elts;
-    for (i = 0; i < ocspcache_resp_list->nelts; i++) {
-      struct ocspcache_large_entry *entry;
-
-      entry = &(entries[i]);
-      if (entry->fingerprint_len > 0 &&
-          entry->fingerprint_len == fingerprint_len &&
-          memcmp(entry->fingerprint, fingerprint, fingerprint_len) == 0) {
-        const unsigned char *ptr;
-
-        ptr = entry->resp_der;
-        resp = d2i_OCSP_RESPONSE(NULL, &ptr, entry->resp_derlen);
-        if (resp == NULL) {
-          tls_log("shmcache: error retrieving response from ocsp cache: %s",
-            shmcache_get_errors());
+  if (ocspcache_resp_tab != NULL) {
+    const struct ocspcache_large_entry *entry;
 
-        } else {
-          *resp_age = entry->age;
-          break;
-        }
+    entry = pr_table_kget(ocspcache_resp_tab, fingerprint, fingerprint_len,
+      NULL);
+    if (entry != NULL &&
+        entry->resp_derlen > 0) {
+      const unsigned char *ptr;
+
+      ptr = entry->resp_der;
+      resp = d2i_OCSP_RESPONSE(NULL, &ptr, entry->resp_derlen);
+      if (resp != NULL) {
+        *resp_age = entry->age;
+        return resp;
       }
-    }
-  }
 
-  if (resp) {
-    return resp;
+      tls_log("shmcache: error retrieving response from ocsp cache: %s",
+        shmcache_get_errors());
+    }
   }
 
   h = shmcache_hash((unsigned char *) fingerprint, fingerprint_len);
-  idx = h % ocspcache_data->od_listsz;
+  set = shmcache_get_set(h, ocspcache_data->od_listsz,
+    ocspcache_data->od_nsets, &start, &end);
 
-  if (shmcache_lock_shm(ocspcache_fh, F_WRLCK) == 0) {
-    register unsigned int i;
-    unsigned int last;
-
-    i = idx;
-    last = idx > 0 ? (idx -1) : 0;
-
-    do {
-      struct ocspcache_entry *entry;
-
-      pr_signals_handle();
-
-      entry = &(ocspcache_data->od_entries[i]);
-      if (entry->fingerprint_len > 0 &&
-          entry->fingerprint_len == fingerprint_len &&
-          memcmp(entry->fingerprint, fingerprint, fingerprint_len) == 0) {
-        const unsigned char *ptr;
+  if (ocsp_cache_lock_set(SHMCACHE_GET_LOCK, set) < 0) {
+    tls_log("shmcache: unable to retrieve response from ocsp cache: error "
+      "locking shmcache: %s", strerror(errno));
 
-        /* Don't forget to update the stats. */
+    errno = EPERM;
+    return NULL;
+  }
 
-        ptr = entry->resp_der;
-        resp = d2i_OCSP_RESPONSE(NULL, &ptr, entry->resp_derlen);
-        if (resp != NULL) {
-          *resp_age = entry->age;
-          ocspcache_data->nhits++;
+  for (i = start; i < end; i++) {
+    struct ocspcache_entry *entry;
 
-        } else {
-          tls_log("shmcache: error retrieving response from ocsp cache: %s",
-            shmcache_get_errors());
-          ocspcache_data->nerrors++;
-        }
+    entry = &(ocspcache_data->od_entries[i]);
+    if (entry->fingerprint_len > 0 &&
+        entry->fingerprint_len == fingerprint_len &&
+        memcmp(entry->fingerprint, fingerprint, fingerprint_len) == 0) {
+      const unsigned char *ptr;
 
-        break;
-      }
+      /* Don't forget to update the stats. */
 
-      if (i < ocspcache_data->od_listsz) {
-        i++;
+      ptr = entry->resp_der;
+      resp = d2i_OCSP_RESPONSE(NULL, &ptr, entry->resp_derlen);
+      if (resp != NULL) {
+        *resp_age = entry->age;
+        SHMCACHE_INCR(ocspcache_data->nhits);
 
       } else {
-        i = 0;
+        tls_log("shmcache: error retrieving response from ocsp cache: %s",
+          shmcache_get_errors());
+        SHMCACHE_INCR(ocspcache_data->nerrors);
       }
-    } while (i != last);
 
-    if (resp == NULL) {
-      ocspcache_data->nmisses++;
-      errno = ENOENT;
+      break;
     }
+  }
 
-    if (shmcache_lock_shm(ocspcache_fh, F_UNLCK) < 0) {
-      tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-    }
+  if (resp == NULL) {
+    SHMCACHE_INCR(ocspcache_data->nmisses);
+  }
 
-  } else {
-    tls_log("shmcache: unable to retrieve response from ocsp cache: error "
-      "write-locking shmcache: %s", strerror(errno));
+  if (ocsp_cache_lock_set(F_UNLCK, set) < 0) {
+    tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
+  }
 
-    errno = EPERM;
+  if (resp == NULL) {
+    errno = ENOENT;
   }
 
   return resp;
 }
 
 static int ocsp_cache_delete(tls_ocsp_cache_t *cache, const char *fingerprint) {
-  unsigned int h, idx;
-  int res;
+  register unsigned int i;
+  unsigned int h, set, start, end;
   size_t fingerprint_len = 0;
 
   pr_trace_msg(trace_channel, 9,
@@ -2287,94 +2212,59 @@ static int ocsp_cache_delete(tls_ocsp_cache_t *cache, const char *fingerprint) {
   fingerprint_len = strlen(fingerprint);
 
   /* Look for the requested response in the "large response" list first. */
-  if (ocspcache_resp_list != NULL) {
-    register unsigned int i;
-    struct ocspcache_large_entry *entries;
-
-    entries = ocspcache_resp_list->elts;
-    for (i = 0; i < ocspcache_resp_list->nelts; i++) {
-      struct ocspcache_large_entry *entry;
-
-      entry = &(entries[i]);
-      if (entry->fingerprint_len == fingerprint_len &&
-          memcmp(entry->fingerprint, fingerprint, fingerprint_len) == 0) {
-
-        pr_memscrub(entry->resp_der, entry->resp_derlen);
-        entry->resp_derlen = 0;
-        pr_memscrub(entry->fingerprint, entry->fingerprint_len);
-        entry->fingerprint_len = 0;
-        entry->age = 0;
-        return 0;
-      }
+  if (ocspcache_resp_tab != NULL) {
+    struct ocspcache_large_entry *entry;
+
+    entry = (struct ocspcache_large_entry *) pr_table_kremove(
+      ocspcache_resp_tab, fingerprint, fingerprint_len, NULL);
+    if (entry != NULL) {
+      (void) ocsp_cache_scrub_large_resp_cb(NULL, 0, entry, 0, NULL);
+      return 0;
     }
   }
 
   h = shmcache_hash((unsigned char *) fingerprint, fingerprint_len);
-  idx = h % ocspcache_data->od_listsz;
-
-  if (shmcache_lock_shm(ocspcache_fh, F_WRLCK) == 0) {
-    register unsigned int i;
-    unsigned int last;
-
-    i = idx;
-    last = idx > 0 ? (idx - 1) : 0;
+  set = shmcache_get_set(h, ocspcache_data->od_listsz,
+    ocspcache_data->od_nsets, &start, &end);
 
-    do {
-      struct ocspcache_entry *entry;
-
-      pr_signals_handle();
-
-      entry = &(ocspcache_data->od_entries[i]);
-      if (entry->fingerprint_len == fingerprint_len &&
-          memcmp(entry->fingerprint, fingerprint, fingerprint_len) == 0) {
-        time_t now;
-
-        pr_memscrub(entry->resp_der, entry->resp_derlen);
-        entry->resp_derlen = 0;
-        pr_memscrub(entry->fingerprint, entry->fingerprint_len);
-        entry->fingerprint_len = 0;
+  if (ocsp_cache_lock_set(F_WRLCK, set) < 0) {
+    tls_log("shmcache: unable to delete response from ocsp cache: error "
+      "write-locking shmcache: %s", strerror(errno));
 
-        if (ocspcache_data->od_listlen > 0) {
-          ocspcache_data->od_listlen--;
-        }
+    errno = EPERM;
+    return -1;
+  }
 
-        /* Don't forget to update the stats. */
-        now = time(NULL);
-        if (entry->age > (now - 3600)) {
-          ocspcache_data->nexpired++;
+  for (i = start; i < end; i++) {
+    struct ocspcache_entry *entry;
 
-        } else {
-          ocspcache_data->ndeleted++;
-        }
+    entry = &(ocspcache_data->od_entries[i]);
+    if (entry->fingerprint_len > 0 &&
+        entry->fingerprint_len == fingerprint_len &&
+        memcmp(entry->fingerprint, fingerprint, fingerprint_len) == 0) {
+      time_t now;
 
-        entry->age = 0;
-        break;
-      }
+      SHMCACHE_DECR(ocspcache_data->od_listlen);
 
-      if (i < ocspcache_data->od_listsz) {
-        i++;
+      /* Don't forget to update the stats. */
+      now = time(NULL);
+      if (entry->age > (now - 3600)) {
+        SHMCACHE_INCR(ocspcache_data->nexpired);
 
       } else {
-        i = 0;
+        SHMCACHE_INCR(ocspcache_data->ndeleted);
       }
 
-    } while (i != last);
-
-    if (shmcache_lock_shm(ocspcache_fh, F_UNLCK) < 0) {
-      tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
+      ocsp_cache_scrub_entry(entry);
+      break;
     }
+  }
 
-    res = 0;
-
-  } else {
-    tls_log("shmcache: unable to delete response from ocsp cache: error "
-      "write-locking shmcache: %s", strerror(errno));
-
-    errno = EPERM;
-    res = -1;
+  if (ocsp_cache_lock_set(F_UNLCK, set) < 0) {
+    tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
   }
 
-  return res;
+  return 0;
 }
 
 static int ocsp_cache_clear(tls_ocsp_cache_t *cache) {
@@ -2388,44 +2278,26 @@ static int ocsp_cache_clear(tls_ocsp_cache_t *cache) {
     return -1;
   }
 
-  if (ocspcache_resp_list != NULL) {
-    struct ocspcache_large_entry *entries;
-
-    entries = ocspcache_resp_list->elts;
-    for (i = 0; i < ocspcache_resp_list->nelts; i++) {
-      struct ocspcache_large_entry *entry;
-
-      entry = &(entries[i]);
-      entry->age = 0;
-      pr_memscrub(entry->resp_der, entry->resp_derlen);
-      entry->resp_derlen = 0;
-      pr_memscrub(entry->fingerprint, entry->fingerprint_len);
-      entry->fingerprint_len = 0;
-    }
+  if (ocspcache_resp_tab != NULL) {
+    (void) pr_table_do(ocspcache_resp_tab, ocsp_cache_scrub_large_resp_cb,
+      NULL, PR_TABLE_DO_FL_ALL);
+    (void) pr_table_empty(ocspcache_resp_tab);
   }
 
-  if (shmcache_lock_shm(ocspcache_fh, F_WRLCK) < 0) {
+  if (ocsp_cache_lock(F_WRLCK) < 0) {
     tls_log("shmcache: unable to clear cache: error write-locking shmcache: %s",
       strerror(errno));
     return -1;
   }
 
   for (i = 0; i < ocspcache_data->od_listsz; i++) {
-    struct ocspcache_entry *entry;
-
-    entry = &(ocspcache_data->od_entries[i]);
-
-    entry->age = 0;
-    pr_memscrub(entry->resp_der, entry->resp_derlen);
-    entry->resp_derlen = 0;
-    pr_memscrub(entry->fingerprint, entry->fingerprint_len);
-    entry->fingerprint_len = 0;
+    ocsp_cache_scrub_entry(&(ocspcache_data->od_entries[i]));
   }
 
   res = ocspcache_data->od_listlen;
   ocspcache_data->od_listlen = 0;
 
-  if (shmcache_lock_shm(ocspcache_fh, F_UNLCK) < 0) {
+  if (ocsp_cache_lock(F_UNLCK) < 0) {
     tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
   }
 
@@ -2485,7 +2357,7 @@ static int ocsp_cache_status(tls_ocsp_cache_t *cache,
 
   pr_trace_msg(trace_channel, 9, "checking shmcache ocsp cache %p", cache);
 
-  if (shmcache_lock_shm(ocspcache_fh, F_RDLCK) < 0) {
+  if (ocsp_cache_lock(F_RDLCK) < 0) {
     pr_log_debug(DEBUG1, MOD_TLS_SHMCACHE_VERSION
       ": error read-locking shmcache: %s", strerror(errno));
     return -1;
@@ -2528,6 +2400,11 @@ static int ocsp_cache_status(tls_ocsp_cache_t *cache,
     ocspcache_data->ndeleted);
   statusf(arg, "Cache lifetime responses expired: %u",
     ocspcache_data->nexpired);
+  statusf(arg, "Cache lifetime responses evicted: %u",
+    ocspcache_data->nevicted);
+  statusf(arg, "%s", "");
+  shmcache_status_lockstats(&(ocspcache_data->od_lockstats),
+    ocspcache_data->od_listsz, ocspcache_data->od_nsets, statusf, arg);
   statusf(arg, "%s", "");
   statusf(arg, "Cache lifetime errors handling responses in cache: %u",
     ocspcache_data->nerrors);
@@ -2538,7 +2415,7 @@ static int ocsp_cache_status(tls_ocsp_cache_t *cache,
       ocspcache_data->exceeded_maxsz);
   }
 
-  if (shmcache_lock_shm(ocspcache_fh, F_UNLCK) < 0) {
+  if (ocsp_cache_lock(F_UNLCK) < 0) {
     pr_log_debug(DEBUG1, MOD_TLS_SHMCACHE_VERSION
       ": error unlocking shmcache: %s", strerror(errno));
   }
@@ -33,6 +33,14 @@
 
 module wrap2_redis_module;
 
+/* mod_wrap2 always asks for a client's options right after asking for its
+ * clients, so the options are fetched in the same round trip as the clients,
+ * and kept here until then.
+ */
+static wrap2_table_t *prefetch_tab = NULL;
+static const char *prefetch_name = NULL;
+static array_header *prefetch_items = NULL, *prefetch_itemszs = NULL;
+
 static char *get_named_key(pool *p, char *key, const char *name) {
   if (name == NULL) {
     return key;
@@ -45,9 +53,57 @@ static char *get_named_key(pool *p, char *key, const char *name) {
   return key;
 }
 
+static void clear_prefetch(void) {
+  prefetch_tab = NULL;
+  prefetch_name = NULL;
+  prefetch_items = prefetch_itemszs = NULL;
+}
+
+/* Provides the values of an ARRAY reply in the same form as
+ * pr_redis_list_getall() et al.
+ */
+static int get_reply_items(pool *p, pr_redis_reply_t *reply,
+    array_header **items, array_header **itemszs) {
+  register unsigned int i;
+  pr_redis_reply_t **elts;
+
+  if (reply->type != PR_REDIS_REPLY_TYPE_ARRAY) {
+    if (reply->type == PR_REDIS_REPLY_TYPE_ERROR) {
+      wrap2_log("Redis error: %s", (char *) reply->value);
+    }
+
+    errno = EINVAL;
+    return -1;
+  }
+
+  *items = make_array(p, reply->elements->nelts, sizeof(void *));
+  *itemszs = make_array(p, reply->elements->nelts, sizeof(size_t));
+
+  elts = reply->elements->elts;
+  for (i = 0; i < reply->elements->nelts; i++) {
+    void *item;
+
+    if (elts[i]->type != PR_REDIS_REPLY_TYPE_STRING) {
+      continue;
+    }
+
+    item = palloc(p, elts[i]->valuesz);
+    memcpy(item, elts[i]->value, elts[i]->valuesz);
+
+    *((void **) push_array(*items)) = item;
+    *((size_t *) push_array(*itemszs)) = elts[i]->valuesz;
+  }
+
+  return 0;
+}
+
 static int redistab_close_cb(wrap2_table_t *redistab) {
   pr_redis_t *redis;
 
+  if (prefetch_tab == redistab) {
+    clear_prefetch();
+  }
+
   redis = redistab->tab_handle;
 
   (void) pr_redis_conn_close(redis);
@@ -60,8 +116,10 @@ static array_header *redistab_fetch_clients_cb(wrap2_table_t *redistab,
   register unsigned int i;
   pool *tmp_pool = NULL;
   pr_redis_t *redis;
-  char *key = NULL, **vals = NULL;
-  array_header *items = NULL, *itemszs = NULL, *clients = NULL;
+  pr_redis_pipeline_t *pipeline;
+  char *key = NULL, *option_key = NULL, **vals = NULL;
+  array_header *items = NULL, *itemszs = NULL, *clients = NULL,
+    *replies = NULL;
   int res, xerrno = 0, use_list = TRUE;
 
   /* Allocate a temporary pool for the duration of this read. */
@@ -80,15 +138,54 @@ static array_header *redistab_fetch_clients_cb(wrap2_table_t *redistab,
   key = get_named_key(tmp_pool, key, name);
   redis = redistab->tab_handle;
 
+  pipeline = pr_redis_pipeline_alloc(tmp_pool, redis, &wrap2_redis_module);
   if (use_list == TRUE) {
-    res = pr_redis_list_getall(tmp_pool, redis, &wrap2_redis_module, key,
-      &items, &itemszs);
-    xerrno = errno;
+    (void) pr_redis_pipeline_list_getall(pipeline, key);
 
   } else {
-    res = pr_redis_set_getall(tmp_pool, redis, &wrap2_redis_module, key,
-      &items, &itemszs);
+    (void) pr_redis_pipeline_set_getall(pipeline, key);
+  }
+
+  clear_prefetch();
+
+  option_key = ((char **) redistab->tab_data)[WRAP2_REDIS_OPTION_KEY_IDX];
+  if (option_key != NULL) {
+    int option_use_list = TRUE;
+
+    if (strncasecmp(option_key, "list:", 5) == 0) {
+      option_key += 5;
+
+    } else if (strncasecmp(option_key, "set:", 4) == 0) {
+      option_use_list = FALSE;
+      option_key += 4;
+    }
+
+    option_key = get_named_key(tmp_pool, option_key, name);
+
+    if (option_use_list == TRUE) {
+      (void) pr_redis_pipeline_list_getall(pipeline, option_key);
+
+    } else {
+      (void) pr_redis_pipeline_set_getall(pipeline, option_key);
+    }
+  }
+
+  res = pr_redis_pipeline_exec(tmp_pool, pipeline, &replies);
+  xerrno = errno;
+
+  if (res == 0) {
+    pr_redis_reply_t **elts;
+
+    elts = replies->elts;
+    res = get_reply_items(tmp_pool, elts[0], &items, &itemszs);
     xerrno = errno;
+
+    if (option_key != NULL &&
+        get_reply_items(redistab->tab_pool, elts[1], &prefetch_items,
+          &prefetch_itemszs) == 0) {
+      prefetch_tab = redistab;
+      prefetch_name = name ? pstrdup(redistab->tab_pool, name) : NULL;
+    }
   }
 
   /* Check the results. */
@@ -224,7 +321,17 @@ static array_header *redistab_fetch_options_cb(wrap2_table_t *redistab,
   key = get_named_key(tmp_pool, key, name);
   redis = redistab->tab_handle;
 
-  if (use_list == TRUE) {
+  if (prefetch_tab == redistab &&
+      ((prefetch_name == NULL && name == NULL) ||
+       (prefetch_name != NULL && name != NULL &&
+        strcmp(prefetch_name, name) == 0))) {
+    items = prefetch_items;
+    itemszs = prefetch_itemszs;
+    res = 0;
+
+    clear_prefetch();
+
+  } else if (use_list == TRUE) {
     res = pr_redis_list_getall(tmp_pool, redis, &wrap2_redis_module, key,
       &items, &itemszs);
     xerrno = errno;
@@ -53,8 +53,12 @@ void pr_ascii_ftp_reset(void);
 int pr_ascii_ftp_from_crlf(pool *p, char *in, size_t inlen, char **out,
   size_t *outlen);
 
-/*
- * Returns the number N on success, and -1 on error, setting errno
+/* Converts the given `in' buffer, adding a CR before any LF which does not
+ * already have one.  If no conversion is needed, `out' is set to `in';
+ * otherwise `out' points to an internal buffer, which is reused (and thus
+ * overwritten) by the next call.
+ *
+ * Returns the number of CRs added on success, and -1 on error, setting errno
  * appropriately.
  */
 int pr_ascii_ftp_to_crlf(pool *p, char *in, size_t inlen, char **out,
@@ -186,6 +186,11 @@ void init_bindings(void);
 /* Free the Bindings layer. */
 void free_bindings(void);
 
+/* Free the Bindings layer, and close all listening connections, including
+ * those which would otherwise be reused by the next init_bindings().
+ */
+void free_listening_conns(void);
+
 /* Macro error-handling wrappers */
 #define PR_ADD_IPBINDS(s) \
   if ((res = pr_ipbind_add_binds((s))) < 0) \
@@ -42,6 +42,11 @@ int pr_cmd_strcmp(cmd_rec *cmd, const char *cmd_name);
  */
 int pr_cmd_get_id(const char *name_name);
 
+/* Returns the name of the command for the given ID, i.e. the inverse of
+ * pr_cmd_get_id().  Returns NULL, with errno set to ENOENT, for an unknown ID.
+ */
+const char *pr_cmd_get_name(int cmd_id);
+
 /* These IDs are indices into a static list in the Command API. */
 #define	PR_CMD_USER_ID		1
 #define PR_CMD_PASS_ID		2
@@ -104,6 +109,9 @@ int pr_cmd_get_id(const char *name_name);
 #define PR_CMD_CLNT_ID		59
 #define PR_CMD_RANG_ID		60
 
+/* The largest command ID. */
+#define PR_CMD_MAX_ID		PR_CMD_RANG_ID
+
 /* The minimum and maximum command name lengths. */
 #define PR_CMD_MIN_NAMELEN	3
 #define PR_CMD_MAX_NAMELEN	4
@@ -112,6 +112,9 @@
 #include "json.h"
 #include "memcache.h"
 #include "redis.h"
+#include "metrics.h"
+#include "crc32.h"
+#include "listcache.h"
 
 # ifdef HAVE_SETPASSENT
 #  define setpwent()	setpassent(1)
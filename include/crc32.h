@@ -0,0 +1,54 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* CRC32 API */
+
+#ifndef PR_CRC32_H
+#define PR_CRC32_H
+
+#include "conf.h"
+
+/* Updates the given CRC32 (the IEEE 802.3/PKZip polynomial, as used by
+ * XCRC and HASH) with the given data, and returns the new CRC.  The initial
+ * CRC is zero; the returned value is the final CRC of all of the data seen
+ * so far, i.e. no further finalization is needed.
+ */
+uint32_t pr_crc32(uint32_t crc, const void *data, size_t datasz);
+
+/* CRC32 engines.  By default, the fastest engine supported by the CPU is
+ * used; the engine can be changed, e.g. for testing or benchmarking.
+ */
+#define PR_CRC32_ENGINE_SLICE8		1
+#define PR_CRC32_ENGINE_PCLMUL		2
+
+/* Returns the engine in use. */
+int pr_crc32_get_engine(void);
+
+/* Sets the engine to use.  Returns -1, with errno set to ENOSYS, if the
+ * requested engine is not supported by this build or CPU, or EINVAL for
+ * an unknown engine.
+ */
+int pr_crc32_set_engine(int engine);
+
+#endif /* PR_CRC32_H */
@@ -80,6 +80,20 @@ void pr_event_generate(const char *event, const void *event_data);
  */
 int pr_event_listening(const char *event);
 
+/* Returns the ID for the given event name, for use with the functions below,
+ * or -1 (with errno set appropriately) if there was an error.  Event IDs
+ * remain valid for the life of the process, whether or not any handlers are
+ * (still) registered for the event.  Thus code generating an event on a hot
+ * path, e.g. for every read/write, can look up its ID once, and cache it.
+ */
+int pr_event_get_id(const char *event);
+
+/* Same as pr_event_generate(), for the event with the given ID. */
+void pr_event_generate_id(int event_id, const void *event_data);
+
+/* Same as pr_event_listening(), for the event with the given ID. */
+int pr_event_listening_id(int event_id);
+
 /* Dump Events information. */
 void pr_event_dump(void (*)(const char *, ...));
 
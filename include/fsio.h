@@ -228,6 +228,9 @@ struct fh_rec {
 
   /* Hint of the optimal buffer size for IO on this file. */
   size_t fh_iosz;
+
+  /* The flags with which this file was opened. */
+  int fh_flags;
 };
 
 /* Maximum symlink count, for loop detection. */
@@ -360,8 +363,9 @@ int pr_unregister_fs(const char *);
 void pr_fs_clear_cache(void);
 int pr_fs_clear_cache2(const char *path);
 
-/* Dump the current contents of the statcache via trace logging, to the
- * "fs.statcache" trace channel.
+/* Dump the current contents of the statcache, along with its hit, miss,
+ * expiry and eviction counters, via trace logging, to the "fs.statcache"
+ * trace channel.
  */
 void pr_fs_statcache_dump(void);
 
@@ -389,10 +393,16 @@ int pr_fs_copy_file(const char *src, const char *dst);
  *
  * The callback, when present, will be invoked with the number of bytes
  * just written to the destination file in that iteration.
+ *
+ * Where the platform and filesystem allow, and no module has hooked the
+ * FSIO read/write handlers for the files, the kernel does the copying
+ * (by cloning the file, or using copy_file_range(2) or sendfile(2)); use
+ * the NO_OFFLOAD flag to always copy using read/write.
  */
 int pr_fs_copy_file2(const char *src, const char *dst, int flags,
   void (*progress_cb)(int));
 #define PR_FSIO_COPY_FILE_FL_NO_DELETE_ON_FAILURE	0x0001
+#define PR_FSIO_COPY_FILE_FL_NO_OFFLOAD			0x0002
 
 int pr_fs_setcwd(const char *);
 const char *pr_fs_getcwd(void);
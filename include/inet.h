@@ -145,6 +145,13 @@ void pr_inet_close(pool *, conn_t *);
 void pr_inet_lingering_abort(pool *, conn_t *, long);
 void pr_inet_lingering_close(pool *, conn_t *, long);
 int pr_inet_set_default_family(pool *, int);
+
+/* Sets whether the daemon's listening sockets use SO_REUSEPORT, so that
+ * several daemon processes can accept connections on the same address/port.
+ * Returns the previous setting, or -1 (ENOSYS) if SO_REUSEPORT is not
+ * supported.
+ */
+int pr_inet_set_reuse_port(int);
 int pr_inet_set_async(pool *, conn_t *);
 int pr_inet_set_block(pool *, conn_t *);
 int pr_inet_set_nonblock(pool *, conn_t *);
@@ -87,6 +87,11 @@
 /* This opaque structure is used for tracking filters for events. */
 typedef struct jot_filters_rec pr_jot_filters_t;
 
+/* This opaque structure is used for LogFormats compiled via
+ * pr_jot_compile_logfmt().
+ */
+typedef struct jot_logfmt_rec pr_jot_logfmt_t;
+
 /* Use this for passing data to your jotting callbacks. */
 typedef struct {
   /* A pointer to the object into which resolved variables are written. */
@@ -182,6 +187,23 @@ int pr_jot_resolve_logfmt(pool *p, cmd_rec *cmd, pr_jot_filters_t *filters,
   int (*on_default)(pool *, pr_jot_ctx_t *, unsigned char),
   int (*on_other)(pool *, pr_jot_ctx_t *, unsigned char *, size_t));
 
+/* Compile the given LogFormat buffer (as produced by pr_jot_parse_logfmt())
+ * into a list of operations, so that the buffer does not need to be scanned
+ * every time it is resolved.  The compiled LogFormat refers to the given
+ * buffer, and thus must not outlive it.
+ */
+pr_jot_logfmt_t *pr_jot_compile_logfmt(pool *p, unsigned char *logfmt);
+
+/* Identical to pr_jot_resolve_logfmt(), except that the LogFormat is one
+ * compiled by pr_jot_compile_logfmt().
+ */
+int pr_jot_resolve_compiled_logfmt(pool *p, cmd_rec *cmd,
+  pr_jot_filters_t *filters, pr_jot_logfmt_t *compiled, pr_jot_ctx_t *ctx,
+  int (*on_meta)(pool *, pr_jot_ctx_t *, unsigned char, const char *,
+    const void *),
+  int (*on_default)(pool *, pr_jot_ctx_t *, unsigned char),
+  int (*on_other)(pool *, pr_jot_ctx_t *, unsigned char *, size_t));
+
 /* Canned `on_meta` callback to use when resolving LogFormat strings into
  * JSON objects.
  */
@@ -0,0 +1,84 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Directory listing cache API
+ *
+ * Formatted directory listings (e.g. for LIST or MLSD) are stored as files
+ * in a cache directory, and thus shared by all of the session processes.
+ * A cached listing is keyed by the server, chroot and path of the listed
+ * directory, the user, and a caller-provided key describing how the
+ * listing was formatted; it is only used while the directory's identity and
+ * mtime/ctime match those seen when the listing was made, and while it is
+ * younger than the configured maximum age.
+ */
+
+#ifndef PR_LISTCACHE_H
+#define PR_LISTCACHE_H
+
+#include "conf.h"
+
+/* Opens the given cache directory.  This should be done before any
+ * chroot(2), as the cache is used via this open directory.
+ */
+int pr_listcache_open(const char *path);
+int pr_listcache_close(void);
+
+/* Returns TRUE if a cache directory is open, FALSE otherwise. */
+int pr_listcache_is_open(void);
+
+/* Sets the maximum age, in seconds, of cached listings, and the maximum
+ * size, in bytes, of the listings which will be cached.
+ */
+int pr_listcache_set_limits(unsigned int max_age, size_t max_size);
+#define PR_LISTCACHE_DEFAULT_MAX_AGE		60
+#define PR_LISTCACHE_DEFAULT_MAX_SIZE		(1024 * 1024)
+
+/* Looks up the cached listing for the given directory, with the given key.
+ * The given stat(2) info for the directory is used to validate any cached
+ * listing.  Returns 0 and the listing, allocated from the given pool, if
+ * found.  Otherwise, returns -1, with errno set to ENOENT if there is no
+ * usable cached listing, or EPERM if the cache is not open.
+ */
+int pr_listcache_get(pool *p, const char *dir, const char *key,
+  const struct stat *dir_st, char **data, size_t *datalen);
+
+/* Captures a listing, as it is sent, for caching.  Capturing only starts
+ * if the cache is open, and the directory has not been modified within the
+ * current second (as modifications within the same second might not change
+ * its timestamps).  Captures larger than the maximum size are discarded.
+ * Finishing the capture stores the listing, unless the directory changed
+ * while it was being listed.
+ */
+int pr_listcache_capture_start(const char *dir, const char *key,
+  const struct stat *dir_st);
+void pr_listcache_capture_add(const char *data, size_t datalen);
+int pr_listcache_capture_finish(void);
+void pr_listcache_capture_abort(void);
+
+/* Removes any cached listings of the given path, and of its parent
+ * directory; used by the FSIO API when modifying the given path.
+ */
+int pr_listcache_invalidate(const char *path);
+
+#endif /* PR_LISTCACHE_H */
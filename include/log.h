@@ -157,6 +157,7 @@ void pr_log_debug(int, const char *, ...)
        ;
 #endif
 
+int pr_log_getdebuglevel(void);
 int pr_log_setdebuglevel(int);
 int pr_log_setdefaultlevel(int);
 
@@ -0,0 +1,110 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Metrics API */
+
+#ifndef PR_METRICS_H
+#define PR_METRICS_H
+
+#include "conf.h"
+
+/* Latency histograms use HDR-style log-linear buckets, in microseconds:
+ * each power-of-two range [2^N, 2^(N+1)) is split into 2^SUB_BUCKET_BITS
+ * equal sub-buckets (and values below 2^SUB_BUCKET_BITS get a bucket each),
+ * so a reported percentile is at most 1/2^SUB_BUCKET_BITS (6.25%) above the
+ * true value.  Values of 2^32 usecs (about 71 minutes) or more share the
+ * last bucket.
+ */
+#define PR_METRICS_HISTOGRAM_SUB_BUCKET_BITS	4
+#define PR_METRICS_HISTOGRAM_SUB_BUCKET_COUNT \
+  (1 << PR_METRICS_HISTOGRAM_SUB_BUCKET_BITS)
+#define PR_METRICS_HISTOGRAM_BUCKET_COUNT \
+  ((32 - PR_METRICS_HISTOGRAM_SUB_BUCKET_BITS + 1) * \
+   PR_METRICS_HISTOGRAM_SUB_BUCKET_COUNT)
+
+/* Named (non-command) latency metrics. */
+#define PR_METRICS_ID_AUTH			0
+#define PR_METRICS_ID_DATA_XFER			1
+#define PR_METRICS_ID_TLS_HANDSHAKE		2
+#define PR_METRICS_ID_MAX			3
+
+/* Counters; the byte counters are for completed data transfers. */
+#define PR_METRICS_COUNTER_BYTES_IN		0
+#define PR_METRICS_COUNTER_BYTES_OUT		1
+#define PR_METRICS_COUNTER_MAX			2
+
+/* Allocates the shared memory segment in which the metrics are aggregated.
+ * This must be called by the daemon process, before any session processes
+ * are forked, so that all sessions update the same segment.  Until this is
+ * called, all of the other Metrics API functions are no-ops.
+ */
+int pr_metrics_init(void);
+
+/* Releases the shared memory segment; metrics collection is disabled
+ * afterward.
+ */
+int pr_metrics_free(void);
+
+/* Returns TRUE if metrics are being collected, FALSE otherwise. */
+int pr_metrics_enabled(void);
+
+/* Returns the current time in microseconds, for use as the start time of
+ * an observation.  Returns zero if metrics are not being collected, which
+ * makes the corresponding observation a no-op.
+ */
+uint64_t pr_metrics_now(void);
+
+/* Record the time elapsed since the given start time (as obtained from
+ * pr_metrics_now()) for the given command and dispatch phase (PRE_CMD, CMD,
+ * POST_CMD, POST_CMD_ERR, LOG_CMD, LOG_CMD_ERR).
+ */
+int pr_metrics_cmd_observe(cmd_rec *cmd, int phase, uint64_t start_usecs);
+
+/* Record the time elapsed since the given start time for the given named
+ * metric.
+ */
+int pr_metrics_observe(int metric_id, uint64_t start_usecs);
+
+/* Increment the given counter. */
+int pr_metrics_incr(int counter_id, uint64_t incr);
+
+/* Returns the approximate latency, in microseconds, below which the given
+ * percentage of observations for the given named metric fall.  Returns -1
+ * with errno set to ENOENT if there are no observations.
+ */
+int pr_metrics_get_percentile(int metric_id, unsigned int pct,
+  uint64_t *usecs);
+
+/* Returns the current value of the given counter. */
+int pr_metrics_get_counter(int counter_id, uint64_t *val);
+
+/* Clear all of the collected metrics. */
+int pr_metrics_reset(void);
+
+/* Dump the collected metrics, one line per command/phase and named metric,
+ * in a simple text format.
+ */
+void pr_metrics_dump(void (*)(const char *, ...));
+
+#endif /* PR_METRICS_H */
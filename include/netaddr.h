@@ -473,6 +473,22 @@ void pr_netaddr_clear_dnscache(const char *ip_addr);
 /* Clears the cached IP addresses, given a DNS name. */
 void pr_netaddr_clear_ipcache(const char *name);
 
+/* Enables a reverse DNS cache which is shared by all processes.  This must
+ * be called by the daemon process, before any session processes are forked.
+ * Successful lookups are cached for ttl seconds, and failed lookups for
+ * negative_ttl seconds.  Returns -1 with errno set to ENOSYS if shared
+ * caching is not supported on this platform.
+ */
+int pr_netaddr_sharedcache_init(unsigned int nentries, int ttl,
+  int negative_ttl);
+
+/* Releases the shared reverse DNS cache. */
+int pr_netaddr_sharedcache_free(void);
+
+/* Provides the number of shared reverse DNS cache hits and misses. */
+int pr_netaddr_sharedcache_get_stats(unsigned long *hits,
+  unsigned long *misses);
+
 /* Validates the DNS name returned. */
 char *pr_netaddr_validate_dns_str(char *);
 
@@ -151,6 +151,16 @@ void pr_netio_abort(pr_netio_stream_t *);
 int pr_netio_lingering_abort(pr_netio_stream_t *, long);
 
 int pr_netio_close(pr_netio_stream_t *);
+
+/* Corking a stream causes the data written to it to be buffered, rather than
+ * written immediately; uncorking the stream writes out the buffered data,
+ * using a single write.  This is used for coalescing the responses to
+ * pipelined commands on the control connection.  Closing a corked stream, or
+ * writing to it via pr_netio_write_async(), writes out the buffered data
+ * first.  Only one stream can be corked at a time.
+ */
+int pr_netio_cork(pr_netio_stream_t *);
+int pr_netio_uncork(pr_netio_stream_t *);
 int pr_netio_lingering_close(pr_netio_stream_t *, long);
 #define NETIO_LINGERING_CLOSE_FL_NO_SHUTDOWN	0x00001
 
@@ -206,6 +216,12 @@ char *pr_netio_telnet_gets(char *, size_t, pr_netio_stream_t *,
 int pr_netio_telnet_gets2(char *, size_t, pr_netio_stream_t *,
   pr_netio_stream_t *);
 
+/* Returns TRUE if a complete line has already been read into the given
+ * stream's buffer, i.e. if the next pr_netio_telnet_gets2() call will not
+ * need to wait for more data from the network, and FALSE otherwise.
+ */
+int pr_netio_telnet_pending(pr_netio_stream_t *);
+
 int pr_netio_write(pr_netio_stream_t *, char *, size_t);
 
 /* This is a bit odd, because io_ functions are opaque, we can't be sure
@@ -52,6 +52,13 @@
 # define PR_TUNABLE_DEFAULT_BACKLOG	128
 #endif /* PR_TUNABLE_DEFAULT_BACKLOG */
 
+/* The maximum number of daemon processes accepting connections, as
+ * configured by the "AcceptorProcesses" configuration directive.
+ */
+#ifndef PR_TUNABLE_MAX_ACCEPTORS
+# define PR_TUNABLE_MAX_ACCEPTORS	64
+#endif /* PR_TUNABLE_MAX_ACCEPTORS */
+
 /* The default TCP send/receive buffer sizes, should explicit sizes not
  * be defined at compile time, or should the runtime determination process
  * fail.
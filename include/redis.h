@@ -73,6 +73,77 @@ int pr_redis_command(pr_redis_t *redis, const array_header *args,
 #define PR_REDIS_REPLY_TYPE_STATUS		5
 #define PR_REDIS_REPLY_TYPE_ERROR		6
 
+/* Pipelined commands.  Commands queued on a pipeline are held locally until
+ * pr_redis_pipeline_exec(), which sends them all to the Redis server, then
+ * reads all of their replies; this costs one network round trip, rather than
+ * one per command.  Any namespace prefix configured for the given module is
+ * used for the keys of queued commands.
+ *
+ * The replies, in the order in which their commands were queued, are
+ * returned as a list of pr_redis_reply_t pointers, allocated from the given
+ * pool.  A command which fails, e.g. due to the wrong type of key, has an
+ * ERROR reply, and does not stop the execution of the remaining commands.
+ * Once executed, the pipeline is empty, and can be reused.
+ *
+ * Note that, unlike pr_redis_incr(), a pipelined increment of a nonexistent
+ * key creates that key, as a pipeline cannot react to one reply before
+ * sending the next command.
+ */
+typedef struct redis_pipeline_rec pr_redis_pipeline_t;
+
+typedef struct redis_reply_rec {
+  /* One of the PR_REDIS_REPLY_TYPE values. */
+  int type;
+
+  /* For STRING, STATUS, and ERROR replies.  The value is always
+   * NUL-terminated; the terminating NUL is not included in the size.
+   */
+  void *value;
+  size_t valuesz;
+
+  /* For INTEGER replies. */
+  int64_t number;
+
+  /* For ARRAY replies; the elements are pr_redis_reply_t pointers. */
+  array_header *elements;
+} pr_redis_reply_t;
+
+pr_redis_pipeline_t *pr_redis_pipeline_alloc(pool *p, pr_redis_t *redis,
+  module *m);
+
+/* Queue a custom command; unlike the other queueing functions, the
+ * arguments are NOT namespaced.
+ */
+int pr_redis_pipeline_command(pr_redis_pipeline_t *pipeline,
+  const array_header *args);
+
+int pr_redis_pipeline_get(pr_redis_pipeline_t *pipeline, const char *key);
+int pr_redis_pipeline_incr(pr_redis_pipeline_t *pipeline, const char *key,
+  uint32_t incr);
+int pr_redis_pipeline_remove(pr_redis_pipeline_t *pipeline, const char *key);
+int pr_redis_pipeline_set(pr_redis_pipeline_t *pipeline, const char *key,
+  void *value, size_t valuesz, time_t expires);
+int pr_redis_pipeline_list_getall(pr_redis_pipeline_t *pipeline,
+  const char *key);
+int pr_redis_pipeline_set_getall(pr_redis_pipeline_t *pipeline,
+  const char *key);
+
+int pr_redis_pipeline_kget(pr_redis_pipeline_t *pipeline, const char *key,
+  size_t keysz);
+int pr_redis_pipeline_kincr(pr_redis_pipeline_t *pipeline, const char *key,
+  size_t keysz, uint32_t incr);
+int pr_redis_pipeline_kremove(pr_redis_pipeline_t *pipeline, const char *key,
+  size_t keysz);
+int pr_redis_pipeline_kset(pr_redis_pipeline_t *pipeline, const char *key,
+  size_t keysz, void *value, size_t valuesz, time_t expires);
+int pr_redis_pipeline_list_kgetall(pr_redis_pipeline_t *pipeline,
+  const char *key, size_t keysz);
+int pr_redis_pipeline_set_kgetall(pr_redis_pipeline_t *pipeline,
+  const char *key, size_t keysz);
+
+int pr_redis_pipeline_exec(pool *p, pr_redis_pipeline_t *pipeline,
+  array_header **replies);
+
 int pr_redis_add(pr_redis_t *redis, module *m, const char *key, void *value,
   size_t valuesz, time_t expires);
 int pr_redis_decr(pr_redis_t *redis, module *m, const char *key, uint32_t decr,
@@ -88,6 +159,17 @@ int pr_redis_rename(pr_redis_t *redis, module *m, const char *from,
 int pr_redis_set(pr_redis_t *redis, module *m, const char *key, void *value,
   size_t valuesz, time_t expires);
 
+/* Multiple key operations, each done using a single command.  The values
+ * array returned by pr_redis_mget() has an element for each requested key,
+ * in order; the value for a nonexistent key is NULL, with a size of zero.
+ * Keys set using pr_redis_mset() with an expiration all expire after the
+ * same number of seconds.
+ */
+int pr_redis_mget(pool *p, pr_redis_t *redis, module *m, array_header *keys,
+  array_header **values, array_header **valueszs);
+int pr_redis_mset(pr_redis_t *redis, module *m, array_header *keys,
+  array_header *values, array_header *valueszs, time_t expires);
+
 /* Hash operations */
 int pr_redis_hash_count(pr_redis_t *redis, module *m, const char *key,
   uint64_t *count);
@@ -206,6 +288,12 @@ int pr_redis_krename(pr_redis_t *redis, module *m, const char *from,
 int pr_redis_kset(pr_redis_t *redis, module *m, const char *key, size_t keysz,
   void *value, size_t valuesz, time_t expires);
 
+int pr_redis_kmget(pool *p, pr_redis_t *redis, module *m, array_header *keys,
+  array_header *keyszs, array_header **values, array_header **valueszs);
+int pr_redis_kmset(pr_redis_t *redis, module *m, array_header *keys,
+  array_header *keyszs, array_header *values, array_header *valueszs,
+  time_t expires);
+
 int pr_redis_hash_kcount(pr_redis_t *redis, module *m, const char *key,
   size_t keysz, uint64_t *count);
 int pr_redis_hash_kdelete(pr_redis_t *redis, module *m, const char *key,
@@ -307,6 +395,20 @@ int redis_set_server(const char *server, int port, unsigned long flags,
 int redis_set_sentinels(array_header *sentinels, const char *name);
 int redis_set_timeouts(unsigned long connect_millis, unsigned long io_millis);
 
+/* Use the broker listening on the given Unix domain socket path, if
+ * possible, for new connections; a NULL path clears this.
+ */
+int redis_set_broker(const char *path);
+
+/* Runs the broker loop, accepting session connections on the given listening
+ * socket, and using the given number of connections to the Redis server.
+ * Connections from processes other than session processes (i.e. not running
+ * as the broker's User, or not in the broker's session) are rejected.
+ * Returns -1 only on error; ENOSYS is used when the peers of the socket
+ * cannot be checked on this platform.
+ */
+int redis_broker_run(pool *p, int listen_fd, unsigned int nupstreams);
+
 int redis_clear(void);
 int redis_init(void);
 
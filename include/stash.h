@@ -42,6 +42,12 @@ void *pr_stash_get_symbol2(pr_stash_type_t stash_type, const char *name,
 int pr_stash_remove_symbol(pr_stash_type_t stash_type, const char *name,
   module *m);
 
+/* Returns a serial number for the given symbol type, which changes whenever
+ * a symbol of that type is added or removed.  Returns zero, and sets errno
+ * to EINVAL, for an unknown type.
+ */
+unsigned long pr_stash_get_serial(pr_stash_type_t stash_type);
+
 /* These functions are similar to pr_stash_remove_symbol(), except that they
  * allow for providing type-specific criteria.
  */
@@ -48,6 +48,69 @@ int pr_trace_set_file(const char *);
 int pr_trace_set_levels(const char *, int, int);
 int pr_trace_use_stderr(int);
 
+/* Configures the binary trace buffer ("TraceBuffer").  Each process records
+ * its trace messages, timestamped but otherwise unformatted, into a ring of
+ * fixed-size records in its own memory-mapped file, named by appending
+ * ".<pid>" to the given path.  This avoids the formatting and the write(2)
+ * of the TraceLog for every message, so that detailed tracing can be left
+ * enabled, for post-mortem use.  A NULL path disables the trace buffer.
+ */
+int pr_trace_set_buffer(const char *path, off_t size);
+
+/* Reads the most recent records, up to max_records, from the trace buffer
+ * of the given process (or of the calling process, if pid is zero), rendered
+ * as TraceLog lines, oldest first.
+ */
+array_header *pr_trace_read_buffer(pool *p, pid_t pid,
+  unsigned int max_records);
+
+/* Removes the trace buffer file of the given (exited) process, if that
+ * process ended its session cleanly.  Buffers of sessions which ended due
+ * to e.g. a signal or segfault are kept, for post-mortem examination.
+ */
+int pr_trace_remove_buffer(pid_t pid);
+
+/* The trace buffer file layout: a header, followed by a ring of fixed-size
+ * records.  The header occupies the space of the first record.  The utils/
+ * ftptrace program duplicates these definitions; keep them in sync.
+ */
+#define PR_TRACE_BUFFER_MAGIC			0x50525442
+#define PR_TRACE_BUFFER_VERSION			1
+#define PR_TRACE_BUFFER_RECORD_SIZE		512
+#define PR_TRACE_BUFFER_DEFAULT_SIZE		(1024 * 1024)
+#define PR_TRACE_BUFFER_MIN_SIZE		(64 * 1024)
+
+typedef struct {
+  uint32_t tbh_magic;
+  uint32_t tbh_version;
+  uint32_t tbh_pid;
+  uint32_t tbh_flags;
+  uint32_t tbh_record_size;
+  uint32_t tbh_nrecords;
+
+  /* Sequence number of the next record to be written. */
+  uint64_t tbh_next;
+
+} pr_trace_buffer_header_t;
+
+/* Set when the owning process ended its session cleanly. */
+#define PR_TRACE_BUFFER_FL_CLEAN		0x0001
+
+typedef struct {
+  /* Sequence number of this record plus one; zero while being written. */
+  uint64_t tbr_seqno;
+
+  int64_t tbr_sec;
+  uint32_t tbr_usec;
+  uint32_t tbr_level;
+  uint32_t tbr_msglen;
+  uint32_t tbr_reserved;
+  char tbr_channel[32];
+
+  /* The NUL-terminated message text follows, filling the record. */
+
+} pr_trace_buffer_record_t;
+
 int pr_trace_set_options(unsigned long trace_opts);
 #define PR_TRACE_OPT_LOG_CONN_IPS		0x0001
 #define PR_TRACE_OPT_USE_TIMESTAMP_MILLIS	0x0002
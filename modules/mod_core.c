@@ -54,10 +54,12 @@ module core_module;
 char AddressCollisionCheck = TRUE;
 
 static int core_scrub_timer_id = -1;
+static int core_metrics_restarted = FALSE;
 static pr_fh_t *displayquit_fh = NULL;
 
 #ifdef PR_USE_TRACE
 static const char *trace_log = NULL;
+static const char *trace_buffer = NULL;
 #endif /* PR_USE_TRACE */
 
 /* Necessary prototypes. */
@@ -705,6 +707,54 @@ MODRET set_usereversedns(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: ReverseDNSCache off|count [ttl [negative-ttl]] */
+MODRET set_reversednscache(cmd_rec *cmd) {
+  int count = 0, ttl = 300, negative_ttl = 60;
+  config_rec *c;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 4) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (strcasecmp(cmd->argv[1], "off") != 0) {
+    char *ptr = NULL;
+
+    count = (int) strtol(cmd->argv[1], &ptr, 10);
+    if ((ptr && *ptr) ||
+        count <= 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted count '",
+        cmd->argv[1], "'", NULL));
+    }
+
+    if (cmd->argc >= 3) {
+      if (pr_str_get_duration(cmd->argv[2], &ttl) < 0) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error parsing TTL '",
+          cmd->argv[2], "': ", strerror(errno), NULL));
+      }
+    }
+
+    if (cmd->argc == 4) {
+      if (pr_str_get_duration(cmd->argv[3], &negative_ttl) < 0) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error parsing negative TTL '",
+          cmd->argv[3], "': ", strerror(errno), NULL));
+      }
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 3, NULL, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = count;
+  c->argv[1] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = ttl;
+  c->argv[2] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[2]) = negative_ttl;
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_satisfy(cmd_rec *cmd) {
   int satisfy = -1;
 
@@ -959,6 +1009,41 @@ MODRET set_masqueradeaddress(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: AcceptorProcesses count */
+MODRET set_acceptorprocesses(cmd_rec *cmd) {
+  int count;
+  char *endp = NULL;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  count = (int) strtol(cmd->argv[1], &endp, 10);
+  if ((endp && *endp) ||
+      count < 1 ||
+      count > PR_TUNABLE_MAX_ACCEPTORS) {
+    char max_str[32];
+
+    memset(max_str, '\0', sizeof(max_str));
+    snprintf(max_str, sizeof(max_str)-1, "%d", PR_TUNABLE_MAX_ACCEPTORS);
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool,
+      "count must be between 1 and ", max_str, NULL));
+  }
+
+#ifndef SO_REUSEPORT
+  if (count > 1) {
+    CONF_ERROR(cmd, "multiple acceptor processes require SO_REUSEPORT, "
+      "which is not supported on this system");
+  }
+#endif /* SO_REUSEPORT */
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = count;
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_maxinstances(cmd_rec *cmd) {
   long max_instances;
   char *endp;
@@ -1262,6 +1347,26 @@ MODRET set_socketoptions(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: MetricsEngine on|off */
+MODRET set_metricsengine(cmd_rec *cmd) {
+  int bool;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  bool = get_boolean(cmd, 1);
+  if (bool == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = bool;
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_multilinerfc2228(cmd_rec *cmd) {
   int bool;
   config_rec *c;
@@ -1634,6 +1739,57 @@ MODRET set_trace(cmd_rec *cmd) {
 #endif /* PR_USE_TRACE */
 }
 
+/* usage: TraceBuffer path [size [units]] */
+MODRET set_tracebuffer(cmd_rec *cmd) {
+#ifdef PR_USE_TRACE
+  off_t size = PR_TRACE_BUFFER_DEFAULT_SIZE;
+
+  if (cmd->argc-1 < 1 ||
+      cmd->argc-1 > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (pr_fs_valid_path(cmd->argv[1]) < 0) {
+    CONF_ERROR(cmd, "must be an absolute path");
+  }
+
+  if (cmd->argc-1 >= 2) {
+    const char *units = NULL;
+
+    if (cmd->argc-1 == 3) {
+      units = cmd->argv[3];
+    }
+
+    if (pr_str_get_nbytes(cmd->argv[2], units, &size) < 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unable to parse: ",
+        cmd->argv[2], " ", units ? units : "", ": ", strerror(errno), NULL));
+    }
+
+    if (size < PR_TRACE_BUFFER_MIN_SIZE) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "size ", cmd->argv[2],
+        units ? units : "", " is too small", NULL));
+    }
+  }
+
+  trace_buffer = pstrdup(cmd->server->pool, cmd->argv[1]);
+  if (pr_trace_set_buffer(trace_buffer, size) < 0) {
+    if (errno == EPERM) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error using TraceBuffer '",
+        trace_buffer, "': directory is world-writable", NULL));
+    }
+
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error using TraceBuffer '",
+      trace_buffer, "': ", strerror(errno), NULL));
+  }
+
+  return PR_HANDLED(cmd);
+#else
+  CONF_ERROR(cmd,
+    "Use of the TraceBuffer directive requires trace support (--enable-trace)");
+#endif /* PR_USE_TRACE */
+}
+
 /* usage: TraceLog path */
 MODRET set_tracelog(cmd_rec *cmd) {
 #ifdef PR_USE_TRACE
@@ -6570,7 +6726,33 @@ static void core_exit_ev(const void *event_data, void *user_data) {
   pr_fs_statcache_free();
 }
 
+/* The metrics segment must be allocated by the daemon process, before any
+ * sessions are forked, so that all sessions share it.  The segment, and
+ * thus the metrics collected so far, are kept across restarts as long as
+ * MetricsEngine stays on.
+ */
+static void core_metrics_init(void) {
+  config_rec *c;
+
+  c = find_config(main_server->conf, CONF_PARAM, "MetricsEngine", FALSE);
+  if (c != NULL &&
+      *((int *) c->argv[0]) == TRUE) {
+    if (pr_metrics_init() < 0) {
+      pr_log_pri(PR_LOG_NOTICE, "unable to enable MetricsEngine: %s",
+        strerror(errno));
+    }
+
+  } else {
+    (void) pr_metrics_free();
+  }
+}
+
 static void core_restart_ev(const void *event_data, void *user_data) {
+  /* The configuration has not been re-read yet; any MetricsEngine changes
+   * are applied once it has been, in core_postparse_ev().
+   */
+  core_metrics_restarted = TRUE;
+
   pr_fs_statcache_reset();
   pr_scoreboard_scrub();
 
@@ -6580,10 +6762,50 @@ static void core_restart_ev(const void *event_data, void *user_data) {
     pr_trace_set_file(NULL);
     trace_log = NULL;
   }
+
+  if (trace_buffer) {
+    (void) pr_trace_set_buffer(NULL, 0);
+    trace_buffer = NULL;
+  }
 #endif /* PR_USE_TRACE */
 }
 
+static void core_postparse_ev(const void *event_data, void *user_data) {
+  config_rec *c;
+
+  if (core_metrics_restarted) {
+    core_metrics_restarted = FALSE;
+    core_metrics_init();
+  }
+
+  /* The shared reverse DNS cache is (re)allocated by the daemon process
+   * after every (re)parse, so that the sessions forked afterward share it,
+   * and so that any changed ReverseDNSCache settings take effect.
+   */
+  (void) pr_netaddr_sharedcache_free();
+
+  c = find_config(main_server->conf, CONF_PARAM, "ReverseDNSCache", FALSE);
+  if (c != NULL) {
+    int count, ttl, negative_ttl;
+
+    count = *((int *) c->argv[0]);
+    ttl = *((int *) c->argv[1]);
+    negative_ttl = *((int *) c->argv[2]);
+
+    if (count > 0) {
+      if (pr_netaddr_sharedcache_init((unsigned int) count, ttl,
+          negative_ttl) < 0) {
+        pr_log_pri(PR_LOG_NOTICE, "unable to enable ReverseDNSCache: %s",
+          strerror(errno));
+      }
+    }
+  }
+}
+
 static void core_startup_ev(const void *event_data, void *user_data) {
+  config_rec *c;
+
+  core_metrics_init();
 
   /* Add a scoreboard-scrubbing timer.
    *
@@ -6598,7 +6820,6 @@ static void core_startup_ev(const void *event_data, void *user_data) {
   if (ServerType == SERVER_STANDALONE) {
     int scrub_scoreboard = TRUE;
     int scrub_interval = PR_TUNABLE_SCOREBOARD_SCRUB_TIMER;
-    config_rec *c;
 
     c = find_config(main_server->conf, CONF_PARAM, "ScoreboardScrub", FALSE);
     if (c) {
@@ -6672,6 +6893,7 @@ static int core_init(void) {
   pr_feat_add(C_SIZE);
   pr_feat_add(C_HOST);
 
+  pr_event_register(&core_module, "core.postparse", core_postparse_ev, NULL);
   pr_event_register(&core_module, "core.restart", core_restart_ev, NULL);
   pr_event_register(&core_module, "core.startup", core_startup_ev, NULL);
 
@@ -7096,6 +7318,7 @@ static conftable core_conftab[] = {
   { "</Limit>", 		end_limit, 			NULL },
   { "<VirtualHost>",		add_virtualhost,		NULL },
   { "</VirtualHost>",		end_virtualhost,		NULL },
+  { "AcceptorProcesses",	set_acceptorprocesses,		NULL },
   { "Allow",			set_allowdeny,			NULL },
   { "AllowAll",			set_allowall,			NULL },
   { "AllowClass",		set_allowdenyusergroupclass,	NULL },
@@ -7137,6 +7360,7 @@ static conftable core_conftab[] = {
   { "MaxCommandRate",		set_maxcommandrate,		NULL },
   { "MaxConnectionRate",	set_maxconnrate,		NULL },
   { "MaxInstances",		set_maxinstances,		NULL },
+  { "MetricsEngine",		set_metricsengine,		NULL },
   { "MultilineRFC2228",		set_multilinerfc2228,		NULL },
   { "Order",			set_order,			NULL },
   { "PassivePorts",		set_passiveports,		NULL },
@@ -7147,6 +7371,7 @@ static conftable core_conftab[] = {
   { "ProcessTitles",		set_processtitles,		NULL },
   { "Protocols",		set_protocols,			NULL },
   { "RegexOptions",		set_regexoptions,		NULL },
+  { "ReverseDNSCache",		set_reversednscache,		NULL },
   { "Satisfy",			set_satisfy,			NULL },
   { "ScoreboardFile",		set_scoreboardfile,		NULL },
   { "ScoreboardMutex",		set_scoreboardmutex,		NULL },
@@ -7165,6 +7390,7 @@ static conftable core_conftab[] = {
   { "TimeoutLinger",		set_timeoutlinger,		NULL },
   { "TimesGMT",			set_timesgmt,			NULL },
   { "Trace",			set_trace,			NULL },
+  { "TraceBuffer",		set_tracebuffer,		NULL },
   { "TraceLog",			set_tracelog,			NULL },
   { "TraceOptions",		set_traceoptions,		NULL },
   { "TransferLog",		add_transferlog,		NULL },
@@ -387,6 +387,7 @@ static void facts_mlinfobuf_add(struct mlinfo *info, int flags) {
   size_t buflen;
  
   buflen = facts_mlinfo_fmt(info, buf, sizeof(buf), flags);
+  pr_listcache_capture_add(buf, buflen);
 
   /* If this buffer will exceed the capacity of mlinfo_buf, then flush
    * mlinfo_buf.
@@ -423,6 +424,22 @@ static void facts_mlinfobuf_flush(void) {
   facts_mlinfobuf_init();
 }
 
+/* Sends a cached MLSD listing. */
+static void facts_mlinfobuf_send(const char *data, size_t datalen) {
+  int res;
+
+  session.sf_flags &= ~SF_ASCII_OVERRIDE;
+
+  res = pr_data_xfer((char *) data, datalen);
+  if (res < 0 &&
+      errno != 0) {
+    pr_log_debug(DEBUG3, MOD_FACTS_VERSION
+      ": error transferring data: [%d] %s", errno, strerror(errno));
+  }
+
+  session.sf_flags |= SF_ASCII_OVERRIDE;
+}
+
 static int facts_mlinfo_get(struct mlinfo *info, const char *path,
     const char *dent_name, int flags, const char *user, uid_t uid,
     const char *group, gid_t gid, mode_t *mode) {
@@ -1346,8 +1363,9 @@ MODRET facts_mlsd(cmd_rec *cmd) {
   gid_t fake_gid = -1;
   mode_t *fake_mode = NULL;
   struct mlinfo info;
+  struct stat dir_st;
   unsigned char *ptr;
-  int flags = 0;
+  int flags = 0, capturing = FALSE;
   DIR *dirh;
   struct dirent *dent;
 
@@ -1406,6 +1424,8 @@ MODRET facts_mlsd(cmd_rec *cmd) {
     return PR_ERROR(cmd);
   }
 
+  memcpy(&dir_st, &(info.st), sizeof(struct stat));
+
   if (!S_ISDIR(info.st.st_mode)) {
     pr_response_add_err(R_550, _("'%s' is not a directory"), path);
 
@@ -1515,6 +1535,38 @@ MODRET facts_mlsd(cmd_rec *cmd) {
 
   facts_mlinfobuf_init();
 
+  c = find_config(get_dir_ctxt(cmd->tmp_pool, (char *) best_path), CONF_PARAM,
+    "ListCache", FALSE);
+  if (c != NULL &&
+      c->argv[0] != NULL &&
+      pr_listcache_is_open() == TRUE) {
+    char key[PR_TUNABLE_BUFFER_SIZE], *data = NULL;
+    size_t datalen = 0;
+
+    /* The cache key describes everything, other than the directory and the
+     * user, which affects how the listing is formatted.
+     */
+    memset(key, '\0', sizeof(key));
+    snprintf(key, sizeof(key)-1,
+      "%s facts=%lu opts=%lu flags=%d fake=%s:%s:%lo", (char *) cmd->argv[0], facts_opts, facts_mlinfo_opts, flags,
+      fake_user ? fake_user : "", fake_group ? fake_group : "",
+      fake_mode ? (unsigned long) *fake_mode : 0UL);
+
+    if (pr_listcache_get(cmd->tmp_pool, decoded_path, key, &dir_st, &data,
+        &datalen) == 0) {
+      pr_fsio_closedir(dirh);
+
+      facts_mlinfobuf_send(data, datalen);
+      pr_data_close(FALSE);
+
+      return PR_HANDLED(cmd);
+    }
+
+    if (pr_listcache_capture_start(decoded_path, key, &dir_st) == 0) {
+      capturing = TRUE;
+    }
+  }
+
   while ((dent = pr_fsio_readdir(dirh)) != NULL) {
     int hidden = FALSE, res;
     char *rel_path, *abs_path;
@@ -1575,9 +1627,17 @@ MODRET facts_mlsd(cmd_rec *cmd) {
   pr_fsio_closedir(dirh);
 
   if (XFER_ABORTED) {
+    if (capturing) {
+      pr_listcache_capture_abort();
+    }
+
     pr_data_close(TRUE);
 
   } else {
+    if (capturing) {
+      (void) pr_listcache_capture_finish();
+    }
+
     facts_mlinfobuf_flush();
     pr_data_close(FALSE);
   }
@@ -49,6 +49,7 @@ struct logformat_struc {
 
   char *lf_fmt_name;
   unsigned char	*lf_format;
+  pr_jot_logfmt_t *lf_compiled;
 };
 
 struct logfile_struc {
@@ -63,6 +64,10 @@ struct logfile_struc {
 
   /* Pointer to the "owning" configuration */
   config_rec		*lf_conf;
+
+  /* Optional buffer of pending (complete) log lines, see ExtendedLogBuffer. */
+  char			*lf_buf;
+  size_t		lf_bufsz, lf_buflen;
 };
 
 /* Value for lf_fd signalling that data should be logged via syslog, rather
@@ -70,12 +75,21 @@ struct logfile_struc {
  */
 #define EXTENDED_LOG_SYSLOG	-4
 
+/* Default interval, in seconds, at which buffered ExtendedLog lines are
+ * flushed.
+ */
+#define EXTENDED_LOG_FLUSH_INTERVAL_DEFAULT	1
+
 static pool *log_pool = NULL;
 static logformat_t *formats = NULL;
 static xaset_t *format_set = NULL;
 static logfile_t *logs = NULL;
 static xaset_t *log_set = NULL;
 
+static size_t extlog_bufsz = 0;
+static int extlog_flush_interval = EXTENDED_LOG_FLUSH_INTERVAL_DEFAULT;
+static int extlog_flush_timer_id = -1;
+
 static const char *trace_channel = "extlog";
 
 /* format string args:
@@ -177,6 +191,9 @@ static void parse_logformat(const char *directive, char *fmt_name,
   memcpy(lf->lf_format, format_buf, fmt_len);
   lf->lf_format[fmt_len] = '\0';
 
+  /* Compile the format now, rather than scanning it for every entry. */
+  lf->lf_compiled = pr_jot_compile_logfmt(log_pool, lf->lf_format);
+
   if (format_set == NULL) {
     format_set = xaset_create(log_pool, NULL);
   }
@@ -275,6 +292,51 @@ MODRET set_extendedlog(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* Syntax: ExtendedLogBuffer off|size [flush-interval] */
+MODRET set_extendedlogbuffer(cmd_rec *cmd) {
+  config_rec *c = NULL;
+  off_t bufsz = 0;
+  int flush_interval = EXTENDED_LOG_FLUSH_INTERVAL_DEFAULT;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  if (strcasecmp(cmd->argv[1], "off") != 0) {
+    if (pr_str_get_nbytes(cmd->argv[1], NULL, &bufsz) < 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid buffer size '",
+        cmd->argv[1], "': ", strerror(errno), NULL));
+    }
+
+    if (bufsz < EXTENDED_LOG_BUFFER_SIZE) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "buffer size '", cmd->argv[1],
+        "' is too small", NULL));
+    }
+
+    if (cmd->argc == 3) {
+      if (pr_str_get_duration(cmd->argv[2], &flush_interval) < 0) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid flush interval '",
+          cmd->argv[2], "': ", strerror(errno), NULL));
+      }
+
+      if (flush_interval < 1) {
+        CONF_ERROR(cmd, "flush interval must be at least 1 second");
+      }
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(size_t));
+  *((size_t *) c->argv[0]) = (size_t) bufsz;
+  c->argv[1] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = flush_interval;
+
+  return PR_HANDLED(cmd);
+}
+
 /* Syntax: AllowLogSymlinks <on|off> */
 MODRET set_allowlogsymlinks(cmd_rec *cmd) {
   int bool = -1;
@@ -628,9 +690,63 @@ static int resolve_on_other(pool *p, pr_jot_ctx_t *jot_ctx,
 /* from src/log.c */
 extern int syslog_sockfd;
 
+static void extlog_write(logfile_t *lf, const char *text, size_t text_len) {
+  while (text_len > 0) {
+    ssize_t res;
+
+    res = write(lf->lf_fd, text, text_len);
+    if (res < 0) {
+      int xerrno = errno;
+
+      if (xerrno == EINTR) {
+        continue;
+      }
+
+      pr_log_pri(PR_LOG_ALERT, "error: cannot write ExtendedLog '%s': %s",
+        lf->lf_filename, strerror(xerrno));
+      return;
+    }
+
+    text += res;
+    text_len -= res;
+  }
+}
+
+/* Write out any buffered lines for the given ExtendedLog.  The entire buffer
+ * is handed to a single write(2), so that lines from different sessions are
+ * not interleaved.
+ */
+static void extlog_flush(logfile_t *lf) {
+  if (lf->lf_buf == NULL ||
+      lf->lf_buflen == 0) {
+    return;
+  }
+
+  if (lf->lf_fd >= 0) {
+    pr_trace_msg(trace_channel, 17, "flushing %lu bytes to ExtendedLog '%s'",
+      (unsigned long) lf->lf_buflen, lf->lf_filename);
+    extlog_write(lf, lf->lf_buf, lf->lf_buflen);
+  }
+
+  lf->lf_buflen = 0;
+}
+
+static void extlog_flush_all(void) {
+  logfile_t *lf;
+
+  for (lf = logs; lf; lf = lf->next) {
+    extlog_flush(lf);
+  }
+}
+
+static void extlog_close(logfile_t *lf) {
+  extlog_flush(lf);
+  (void) close(lf->lf_fd);
+  lf->lf_fd = -1;
+}
+
 static void log_event(cmd_rec *cmd, logfile_t *lf) {
   int res;
-  unsigned char *f = NULL;
   char logbuf[EXTENDED_LOG_BUFFER_SIZE] = {'\0'};
   logformat_t *fmt = NULL;
   size_t logbuflen;
@@ -639,7 +755,6 @@ static void log_event(cmd_rec *cmd, logfile_t *lf) {
   struct extlog_buffer *log;
 
   fmt = lf->lf_format;
-  f = fmt->lf_format;
 
   tmp_pool = make_sub_pool(cmd->tmp_pool);
   jot_ctx = pcalloc(tmp_pool, sizeof(pr_jot_ctx_t));
@@ -649,8 +764,9 @@ static void log_event(cmd_rec *cmd, logfile_t *lf) {
 
   jot_ctx->log = log;
 
-  res = pr_jot_resolve_logfmt(tmp_pool, cmd, lf->lf_jot_filters, f, jot_ctx,
-    resolve_on_meta, resolve_on_default, resolve_on_other);
+  res = pr_jot_resolve_compiled_logfmt(tmp_pool, cmd, lf->lf_jot_filters,
+    fmt->lf_compiled, jot_ctx, resolve_on_meta, resolve_on_default,
+    resolve_on_other);
   if (res < 0) {
     /* EPERM indicates that the event was filtered, thus is not necessarily
      * an unexpected condition.
@@ -670,10 +786,25 @@ static void log_event(cmd_rec *cmd, logfile_t *lf) {
   if (lf->lf_fd != EXTENDED_LOG_SYSLOG) {
     pr_log_event_generate(PR_LOG_TYPE_EXTLOG, lf->lf_fd, -1, logbuf, logbuflen);
 
-    /* What about short writes? */
-    if (write(lf->lf_fd, logbuf, logbuflen) < 0) {
-      pr_log_pri(PR_LOG_ALERT, "error: cannot write ExtendedLog '%s': %s",
-        lf->lf_filename, strerror(errno));
+    if (lf->lf_buf != NULL) {
+      /* Only complete lines are buffered; make room for this one first. */
+      if (lf->lf_buflen + logbuflen > lf->lf_bufsz) {
+        extlog_flush(lf);
+      }
+
+      if (logbuflen > lf->lf_bufsz) {
+        /* The buffer for a FIFO may be smaller than the longest line (see
+         * PIPE_BUF); such lines are written out directly.
+         */
+        extlog_write(lf, logbuf, logbuflen);
+
+      } else {
+        memcpy(lf->lf_buf + lf->lf_buflen, logbuf, logbuflen);
+        lf->lf_buflen += logbuflen;
+      }
+
+    } else {
+      extlog_write(lf, logbuf, logbuflen);
     }
 
   } else {
@@ -725,6 +856,8 @@ static void log_exit_ev(const void *event_data, void *user_data) {
   cmd->cmd_class |= CL_DISCONNECT;
   (void) pr_cmd_dispatch_phase(cmd, LOG_CMD,
     PR_CMD_DISPATCH_FL_CLEAR_RESPONSE);
+
+  extlog_flush_all();
 }
 
 static void log_postparse_ev(const void *event_data, void *user_data) {
@@ -805,6 +938,11 @@ static void log_sess_reinit_ev(const void *event_data, void *user_data) {
   pr_event_unregister(&log_module, "core.session-reinit", log_sess_reinit_ev);
   pr_event_unregister(&log_module, "core.timeout-stalled", log_xfer_stalled_ev);
 
+  if (extlog_flush_timer_id > 0) {
+    (void) pr_timer_remove(extlog_flush_timer_id, &log_module);
+    extlog_flush_timer_id = -1;
+  }
+
   /* XXX If ServerLog configured, close/reopen syslog? */
 
   /* Close all ExtendedLog files, to prevent duplicate fds. */
@@ -812,11 +950,13 @@ static void log_sess_reinit_ev(const void *event_data, void *user_data) {
     if (lf->lf_fd > -1) {
       /* No need to close the special EXTENDED_LOG_SYSLOG (i.e. fake) fd. */
       if (lf->lf_fd != EXTENDED_LOG_SYSLOG) {
-        (void) close(lf->lf_fd);
+        extlog_close(lf);
       }
 
       lf->lf_fd = -1;
     }
+
+    lf->lf_buf = NULL;
   }
 
   res = log_sess_init();
@@ -836,6 +976,13 @@ static void log_xfer_stalled_ev(const void *event_data, void *user_data) {
   }
 }
 
+static int log_flush_timer_cb(CALLBACK_FRAME) {
+  extlog_flush_all();
+
+  /* Always restart the timer. */
+  return 1;
+}
+
 /* Initialization handlers
  */
 
@@ -991,8 +1138,7 @@ MODRET log_post_pass(cmd_rec *cmd) {
           lf->lf_conf->config_type == CONF_ANON) {
         pr_log_debug(DEBUG7, "mod_log: closing ExtendedLog '%s' (fd %d)",
           lf->lf_filename, lf->lf_fd);
-        (void) close(lf->lf_fd);
-        lf->lf_fd = -1;
+        extlog_close(lf);
       }
     }
 
@@ -1007,8 +1153,7 @@ MODRET log_post_pass(cmd_rec *cmd) {
           lf->lf_conf != session.anon_config) {
         pr_log_debug(DEBUG7, "mod_log: closing ExtendedLog '%s' (fd %d)",
           lf->lf_filename, lf->lf_fd);
-        (void) close(lf->lf_fd);
-        lf->lf_fd = -1;
+        extlog_close(lf);
       }
     }
 
@@ -1030,8 +1175,7 @@ MODRET log_post_pass(cmd_rec *cmd) {
               strcmp(lfi->lf_filename, lf->lf_filename) == 0) {
             pr_log_debug(DEBUG7, "mod_log: closing ExtendedLog '%s' (fd %d)",
               lf->lf_filename, lfi->lf_fd);
-            (void) close(lfi->lf_fd);
-            lfi->lf_fd = -1;
+            extlog_close(lfi);
           }
         }
 
@@ -1039,8 +1183,7 @@ MODRET log_post_pass(cmd_rec *cmd) {
         if (lf->lf_fd != -1 &&
             lf->lf_fd != EXTENDED_LOG_SYSLOG &&
             pr_jot_filters_include_classes(lf->lf_jot_filters, CL_NONE) == TRUE) {
-          (void) close(lf->lf_fd);
-          lf->lf_fd = -1;
+          extlog_close(lf);
         }
       }
     }
@@ -1055,6 +1198,8 @@ static int dispatched_connect = FALSE;
 static int log_sess_init(void) {
   char *serverlog_name = NULL;
   logfile_t *lf = NULL;
+  config_rec *c;
+  int buffered = FALSE;
 
   pr_event_register(&log_module, "core.session-reinit", log_sess_reinit_ev,
     NULL);
@@ -1086,8 +1231,6 @@ static int log_sess_init(void) {
     }
 
   } else {
-    config_rec *c;
-
     c = find_config(main_server->conf, CONF_PARAM, "SystemLog", FALSE);
     if (c != NULL) {
       char *path;
@@ -1137,6 +1280,15 @@ static int log_sess_init(void) {
     }
   }
 
+  c = find_config(main_server->conf, CONF_PARAM, "ExtendedLogBuffer", FALSE);
+  if (c != NULL) {
+    extlog_bufsz = *((size_t *) c->argv[0]);
+    extlog_flush_interval = *((int *) c->argv[1]);
+
+  } else {
+    extlog_bufsz = 0;
+  }
+
   /* Open all the ExtendedLog files. */
   find_extendedlogs();
 
@@ -1176,6 +1328,22 @@ static int log_sess_init(void) {
             pr_log_pri(PR_LOG_WARNING, "unable to open ExtendedLog '%s': "
               "%s is a symbolic link", lf->lf_filename, lf->lf_filename);
           }
+
+        } else if (extlog_bufsz > 0) {
+          struct stat st;
+
+          lf->lf_bufsz = extlog_bufsz;
+
+          /* Writes to a FIFO are only atomic up to PIPE_BUF bytes. */
+          if (fstat(lf->lf_fd, &st) == 0 &&
+              S_ISFIFO(st.st_mode) &&
+              lf->lf_bufsz > PIPE_BUF) {
+            lf->lf_bufsz = PIPE_BUF;
+          }
+
+          lf->lf_buf = palloc(session.pool, lf->lf_bufsz);
+          lf->lf_buflen = 0;
+          buffered = TRUE;
         }
 
       } else {
@@ -1187,6 +1355,15 @@ static int log_sess_init(void) {
     }
   }
 
+  if (buffered == TRUE) {
+    pr_trace_msg(trace_channel, 9,
+      "buffering ExtendedLog writes (%lu bytes, flushed every %d %s)",
+      (unsigned long) extlog_bufsz, extlog_flush_interval,
+      extlog_flush_interval != 1 ? "secs" : "sec");
+    extlog_flush_timer_id = pr_timer_add(extlog_flush_interval, -1,
+      &log_module, log_flush_timer_cb, "ExtendedLog flush");
+  }
+
   /* Register event handlers for the session. */
   pr_event_register(&log_module, "core.exit", log_exit_ev, NULL);
   pr_event_register(&log_module, "core.timeout-stalled", log_xfer_stalled_ev,
@@ -1216,6 +1393,7 @@ static int log_sess_init(void) {
 static conftable log_conftab[] = {
   { "AllowLogSymlinks",	set_allowlogsymlinks,			NULL },
   { "ExtendedLog",	set_extendedlog,			NULL },
+  { "ExtendedLogBuffer",set_extendedlogbuffer,			NULL },
   { "LogFormat",	set_logformat,				NULL },
   { "ServerLog",	set_serverlog,				NULL },
   { "SystemLog",	set_systemlog,				NULL },
@@ -27,6 +27,7 @@
 /* Directory listing module for ProFTPD. */
 
 #include "conf.h"
+#include "privs.h"
 
 #ifndef GLOB_ABORTED
 #define GLOB_ABORTED GLOB_ABEND
@@ -383,6 +384,8 @@ static int sendline(int flags, char *fmt, ...) {
   listbuflen = (listbuf_ptr - listbuf) + strlen(listbuf_ptr);
 
   buflen = strlen(buf);
+  pr_listcache_capture_add(buf, buflen);
+
   if (buflen >= (listbufsz - listbuflen)) {
     /* Make sure the ASCII flags are cleared from the session flags,
      * so that the pr_data_xfer() function does not try to perform
@@ -429,6 +432,92 @@ static void ls_done(cmd_rec *cmd) {
   pr_data_close(quiet);
 }
 
+/* Sends a cached listing, after any buffered lines. */
+static int sendcached(const char *data, size_t datalen) {
+  int res, using_ascii = FALSE;
+
+  res = sendline(LS_SENDLINE_FL_FLUSH, " ");
+  if (res < 0 ||
+      datalen == 0) {
+    return res;
+  }
+
+  if (session.sf_flags & SF_ASCII) {
+    using_ascii = TRUE;
+  }
+
+  session.sf_flags &= ~SF_ASCII;
+  session.sf_flags &= ~SF_ASCII_OVERRIDE;
+
+  res = pr_data_xfer((char *) data, datalen);
+  if (res < 0 &&
+      errno != 0) {
+    int xerrno = errno;
+
+    if (session.d != NULL) {
+      xerrno = PR_NETIO_ERRNO(session.d->outstrm);
+    }
+
+    pr_log_debug(DEBUG3, "pr_data_xfer returned %d, error = %s", res,
+      strerror(xerrno));
+  }
+
+  if (using_ascii) {
+    session.sf_flags |= SF_ASCII;
+  }
+  session.sf_flags |= SF_ASCII_OVERRIDE;
+
+  pr_trace_msg("data", 8, "sent %lu bytes of cached listing",
+    (unsigned long) datalen);
+  return res;
+}
+
+/* Cached listings are only used for the plain, non-recursive listing of a
+ * single directory, without any ListOptions limits, where ListCache is
+ * configured.
+ */
+static int ls_use_cache(cmd_rec *cmd) {
+  config_rec *c;
+
+  if (opt_R ||
+      opt_STAT ||
+      list_nfiles.max > 0 ||
+      list_ndirs.max > 0 ||
+      pr_listcache_is_open() == FALSE) {
+    return FALSE;
+  }
+
+  c = find_config(CURRENT_CONF, CONF_PARAM, "ListCache", FALSE);
+  if (c == NULL ||
+      c->argv[0] == NULL) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* The cache key describes everything, other than the directory and the
+ * user, which affects how the listing is formatted.
+ */
+static const char *ls_cache_key(cmd_rec *cmd) {
+  char buf[PR_TUNABLE_BUFFER_SIZE];
+
+  memset(buf, '\0', sizeof(buf));
+  snprintf(buf, sizeof(buf)-1,
+    "%s -%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s sort=%d flags=%lu fake=%s:%s:%lo "
+    "gmt=%d symlinks=%d", (char *) cmd->argv[0],
+    opt_1 ? "1" : "", opt_a ? "a" : "", opt_A ? "A" : "", opt_B ? "B" : "",
+    opt_C ? "C" : "", opt_c ? "c" : "", opt_d ? "d" : "", opt_F ? "F" : "",
+    opt_h ? "h" : "", opt_l ? "l" : "", opt_L ? "L" : "", opt_n ? "n" : "",
+    opt_r ? "r" : "", opt_S ? "S" : "", opt_t ? "t" : "", opt_U ? "U" : "",
+    ls_sort_by, list_flags, fakeuser ? fakeuser : "",
+    fakegroup ? fakegroup : "",
+    have_fake_mode ? (unsigned long) fakemode : 0UL, list_times_gmt,
+    list_show_symlinks);
+
+  return pstrdup(cmd->tmp_pool, buf);
+}
+
 static char units[6][2] = 
   { "", "k", "M", "G", "T", "P" };
 
@@ -776,7 +865,7 @@ static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
         if (opt_1) {
           /* One file per line, with no info other than the file name.  Easy. */
           snprintf(nameline, sizeof(nameline)-1, "%s",
-            pr_fs_encode_path(cmd->tmp_pool, display_name));
+            pr_fs_encode_path(p, display_name));
 
         } else {
           if (!opt_n) {
@@ -785,7 +874,7 @@ static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
               "%s %3d %-8s %-8s %s %s %2d %s %s", m, (int) st.st_nlink,
               MAP_UID(st.st_uid), MAP_GID(st.st_gid), s,
               months[t->tm_mon], t->tm_mday, timeline,
-              pr_fs_encode_path(cmd->tmp_pool, display_name));
+              pr_fs_encode_path(p, display_name));
 
           } else {
             /* Format nameline using user/group IDs. */
@@ -793,7 +882,7 @@ static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
               "%s %3d %-8u %-8u %s %s %2d %s %s", m, (int) st.st_nlink,
               (unsigned) st.st_uid, (unsigned) st.st_gid, s,
               months[t->tm_mon], t->tm_mday, timeline,
-              pr_fs_encode_path(cmd->tmp_pool, name));
+              pr_fs_encode_path(p, name));
           }
         }
 
@@ -842,7 +931,7 @@ static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
       if (S_ISREG(st.st_mode) ||
           S_ISDIR(st.st_mode) ||
           S_ISLNK(st.st_mode)) {
-        addfile(cmd, pr_fs_encode_path(cmd->tmp_pool, name), suffix, sort_time,
+        addfile(cmd, pr_fs_encode_path(p, name), suffix, sort_time,
           st.st_size);
       }
     }
@@ -851,452 +940,1530 @@ static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
   return rval;
 }
 
-static size_t colwidth = 0;
-static unsigned int filenames = 0;
+/* Streaming listings (ListStreaming).
+ *
+ * Rather than reading all of a directory's names into memory, sorting them,
+ * and then buffering all of the formatted lines until the directory has been
+ * read, streaming listings send each line as soon as its position in the
+ * listing is known.  Unsorted (-U) listings are sent as the directory is
+ * read.  Sorted listings use an external merge sort: records are sorted in
+ * memory until the session's limit is reached, at which point they are
+ * written, sorted, to an unlinked temporary file (a "run"); the runs are
+ * then merged.  The limit applies to all of the session's sorters, e.g.
+ * those holding the subdirectories still to be listed for -R.
+ */
 
-struct filename {
-  struct filename *down;
-  struct filename *right;
-  char *line;
-  int top;
-};
+#define LS_STREAM_DEFAULT_MAX_MEM	(8 * 1024 * 1024)
+#define LS_STREAM_DEFAULT_TMPDIR	"/tmp"
 
-struct sort_filename {
+/* Maximum number of runs merged at once, and the memory we assume that
+ * each run being merged uses (for its stdio buffer and current record).
+ */
+#define LS_STREAM_MAX_FANIN		64
+#define LS_STREAM_RUN_MEMSZ		(32 * 1024)
+
+/* How often (in entries) the per-entry pool is recycled. */
+#define LS_STREAM_POOL_ENTRIES		256
+
+static int ls_streaming = FALSE;
+static size_t ls_stream_max_mem = LS_STREAM_DEFAULT_MAX_MEM;
+static size_t ls_stream_mem = 0;
+static int ls_stream_tmpfd = -1;
+static int ls_stream_errno = 0;
+static const char *ls_stream_name = NULL;
+static struct ls_sorter *ls_stream_sorter = NULL;
+
+struct ls_sort_rec {
   time_t sort_time;
   off_t size;
   char *name;
-  char *suffix;
+  char *line;
 };
 
-static struct filename *head = NULL;
-static struct filename *tail = NULL;
-static array_header *sort_arr = NULL;
-static pool *fpool = NULL;
+/* A record, as written to a run file; the name and line follow. */
+struct ls_sort_hdr {
+  int64_t sort_time;
+  int64_t size;
+  uint32_t namelen;
+  uint32_t linelen;
+};
 
-static void addfile(cmd_rec *cmd, const char *name, const char *suffix,
-    time_t sort_time, off_t size) {
-  struct filename *p;
-  size_t l;
+typedef int (*ls_sort_cmp_t)(const struct ls_sort_rec *,
+  const struct ls_sort_rec *);
 
-  if (name == NULL ||
-      suffix == NULL) {
-    return;
-  }
+/* The current record of a run being merged. */
+struct ls_sort_cursor {
+  FILE *fp;
+  struct ls_sort_rec rec;
+  char *buf;
+  size_t bufsz;
+};
 
-  /* If we are not sorting (-U is in effect), then we have no need to buffer
-   * up the line, and can send it immediately.  This can provide quite a bit
-   * of memory/CPU savings, especially for LIST commands on wide/deep
-   * directories (Bug#4060).
+struct ls_sorter {
+  pool *pool, *rec_pool;
+
+  /* NULL for unsorted (i.e. first-in, first-out) sorters. */
+  ls_sort_cmp_t cmp;
+
+  /* In-memory records; malloc'd, as pool memory would not be reclaimed
+   * when the array grows.
    */
-  if (opt_U == 1) {
-    (void) sendline(0, "%s%s\r\n", name, suffix);
-    return;
+  struct ls_sort_rec *recs;
+  unsigned int nrecs, nalloc, next_rec;
+  size_t memused;
+
+  /* Spilled runs. */
+  array_header *runs;
+
+  /* Merging/reading state. */
+  struct ls_sort_cursor *cursors;
+  unsigned int ncursors, *heap, nheap, next_run;
+  int merging;
+};
+
+static int ls_sort_name_cmp(const struct ls_sort_rec *r1,
+    const struct ls_sort_rec *r2) {
+#if defined(PR_USE_NLS) && defined(HAVE_STRCOLL)
+  return strcoll(r1->name, r2->name);
+#else
+  return strcmp(r1->name, r2->name);
+#endif /* !PR_USE_NLS or !HAVE_STRCOLL */
+}
+
+/* Newest first (or oldest first, for -r), then by name. */
+static int ls_sort_time_cmp(const struct ls_sort_rec *r1,
+    const struct ls_sort_rec *r2) {
+  if (r1->sort_time != r2->sort_time) {
+    int res;
+
+    res = (r1->sort_time > r2->sort_time ? -1 : 1);
+    return (opt_r ? -res : res);
   }
 
-  if (fpool == NULL) {
-    fpool = make_sub_pool(cmd->tmp_pool);
-    pr_pool_tag(fpool, "mod_ls addfile pool");
+  return ls_sort_name_cmp(r1, r2);
+}
+
+/* Largest first (or smallest first, for -r), then by name. */
+static int ls_sort_size_cmp(const struct ls_sort_rec *r1,
+    const struct ls_sort_rec *r2) {
+  if (r1->size != r2->size) {
+    int res;
+
+    res = (r1->size > r2->size ? -1 : 1);
+    return (opt_r ? -res : res);
   }
 
-  if (opt_S || opt_t) {
-    struct sort_filename *s;
+  return ls_sort_name_cmp(r1, r2);
+}
 
-    if (sort_arr == NULL) {
-      sort_arr = make_array(fpool, 50, sizeof(struct sort_filename));
-    }
+static ls_sort_cmp_t ls_qsort_cmp = NULL;
 
-    s = (struct sort_filename *) push_array(sort_arr);
-    s->sort_time = sort_time;
-    s->size = size;
-    s->name = pstrdup(fpool, name);
-    s->suffix = pstrdup(fpool, suffix);
+static int ls_sort_qsort_cmp(const void *a, const void *b) {
+  return ls_qsort_cmp(a, b);
+}
 
-    return;
+/* Opens an unlinked temporary file, in the directory opened at session
+ * start (thus usable after chroot(2)).
+ */
+static FILE *ls_stream_tmpfile(void) {
+#if defined(AT_FDCWD)
+  static unsigned int tmp_count = 0;
+  int fd = -1, xerrno = 0;
+  FILE *fp;
+
+  if (ls_stream_tmpfd < 0) {
+    errno = EPERM;
+    return NULL;
   }
 
-  l = strlen(name) + strlen(suffix);
-  if (l > colwidth) {
-    colwidth = l;
+  PRIVS_ROOT
+# if defined(O_TMPFILE)
+  fd = openat(ls_stream_tmpfd, ".", O_RDWR|O_TMPFILE, 0600);
+# endif /* O_TMPFILE */
+  if (fd < 0) {
+    char name[64];
+
+    memset(name, '\0', sizeof(name));
+    snprintf(name, sizeof(name)-1, ".proftpd-ls.%lu.%u",
+      (unsigned long) session.pid, tmp_count++);
+
+    fd = openat(ls_stream_tmpfd, name, O_RDWR|O_CREAT|O_EXCL, 0600);
+    if (fd >= 0) {
+      (void) unlinkat(ls_stream_tmpfd, name, 0);
+    }
   }
+  xerrno = errno;
+  PRIVS_RELINQUISH
 
-  p = (struct filename *) pcalloc(fpool, sizeof(struct filename));
-  p->line = pcalloc(fpool, l + 2);
-  snprintf(p->line, l + 1, "%s%s", name, suffix);
+  if (fd < 0) {
+    pr_trace_msg("data", 1, "error opening listing sort file: %s",
+      strerror(xerrno));
+    errno = xerrno;
+    return NULL;
+  }
 
-  if (tail) {
-    tail->down = p;
+  (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
 
-  } else {
-    head = p;
+  fp = fdopen(fd, "w+");
+  if (fp == NULL) {
+    xerrno = errno;
+    (void) close(fd);
+    errno = xerrno;
   }
 
-  tail = p;
-  filenames++;
+  return fp;
+#else
+  errno = ENOSYS;
+  return NULL;
+#endif /* AT_FDCWD */
 }
 
-static int file_time_cmp(const struct sort_filename *f1,
-    const struct sort_filename *f2) {
-
-  if (f1->sort_time > f2->sort_time)
-    return -1;
+static struct ls_sorter *ls_sorter_create(pool *p, ls_sort_cmp_t cmp) {
+  struct ls_sorter *s;
 
-  else if (f1->sort_time < f2->sort_time)
-    return 1;
+  s = pcalloc(p, sizeof(struct ls_sorter));
+  s->pool = p;
+  s->cmp = cmp;
+  s->runs = make_array(p, 0, sizeof(FILE *));
 
-  return 0;
+  return s;
 }
 
-static int file_time_reverse_cmp(const struct sort_filename *f1,
-    const struct sort_filename *f2) {
-  return -file_time_cmp(f1, f2);
+static void ls_sorter_clear_recs(struct ls_sorter *s) {
+  if (s->recs != NULL) {
+    free(s->recs);
+    s->recs = NULL;
+  }
+
+  if (s->rec_pool != NULL) {
+    destroy_pool(s->rec_pool);
+    s->rec_pool = NULL;
+  }
+
+  s->nrecs = s->nalloc = s->next_rec = 0;
+  ls_stream_mem -= s->memused;
+  s->memused = 0;
 }
 
-static int file_size_cmp(const struct sort_filename *f1,
-    const struct sort_filename *f2) {
+static int ls_sort_write(FILE *fp, const struct ls_sort_rec *rec) {
+  struct ls_sort_hdr hdr;
 
-  if (f1->size > f2->size)
-    return -1;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.sort_time = (int64_t) rec->sort_time;
+  hdr.size = (int64_t) rec->size;
+  hdr.namelen = strlen(rec->name);
+  hdr.linelen = strlen(rec->line);
 
-  else if (f1->size < f2->size)
-    return 1;
+  if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+      fwrite(rec->name, 1, hdr.namelen, fp) != hdr.namelen ||
+      fwrite(rec->line, 1, hdr.linelen, fp) != hdr.linelen) {
+    return -1;
+  }
 
   return 0;
 }
 
-static int file_size_reverse_cmp(const struct sort_filename *f1,
-    const struct sort_filename *f2) {
-  return -file_size_cmp(f1, f2);
-}
+static unsigned int ls_sorter_fanin(void) {
+  unsigned int fanin;
 
-static void sortfiles(cmd_rec *cmd) {
+  fanin = ls_stream_max_mem / LS_STREAM_RUN_MEMSZ;
+  if (fanin < 2) {
+    fanin = 2;
+  }
 
-  if (sort_arr) {
+  if (fanin > LS_STREAM_MAX_FANIN) {
+    fanin = LS_STREAM_MAX_FANIN;
+  }
 
-    /* Sort by time? */
-    if (opt_t) {
-      register unsigned int i = 0;
-      int setting = opt_S;
-      struct sort_filename *elts = sort_arr->elts;
+  return fanin;
+}
 
-      qsort(sort_arr->elts, sort_arr->nelts, sizeof(struct sort_filename),
-        (int (*)(const void *, const void *))
-          (opt_r ? file_time_reverse_cmp : file_time_cmp));
+static int ls_sorter_collapse(struct ls_sorter *);
 
-      opt_S = opt_t = 0;
+/* Writes the in-memory records, sorted, to a new run.  Unsorted sorters
+ * only ever have one run, which is appended to.
+ */
+static int ls_sorter_spill(struct ls_sorter *s) {
+  register unsigned int i;
+  FILE *fp;
+  int new_run = TRUE;
 
-      for (i = 0; i < sort_arr->nelts; i++) {
-        addfile(cmd, elts[i].name, elts[i].suffix, elts[i].sort_time,
-          elts[i].size);
-      }
+  if (s->nrecs == 0) {
+    return 0;
+  }
 
-      opt_S = setting;
-      opt_t = 1;
+  if (s->cmp == NULL &&
+      s->runs->nelts > 0) {
+    fp = ((FILE **) s->runs->elts)[0];
+    new_run = FALSE;
 
-    /* Sort by file size? */
-    } else if (opt_S) {
-      register unsigned int i = 0;
-      int setting = opt_t;
-      struct sort_filename *elts = sort_arr->elts;
+  } else {
+    fp = ls_stream_tmpfile();
+    if (fp == NULL) {
+      return -1;
+    }
+  }
 
-      qsort(sort_arr->elts, sort_arr->nelts, sizeof(struct sort_filename),
-        (int (*)(const void *, const void *))
-          (opt_r ? file_size_reverse_cmp : file_size_cmp));
+  if (s->cmp != NULL) {
+    ls_qsort_cmp = s->cmp;
+    qsort(s->recs, s->nrecs, sizeof(struct ls_sort_rec), ls_sort_qsort_cmp);
+  }
 
-      opt_S = opt_t = 0;
+  for (i = 0; i < s->nrecs; i++) {
+    if (ls_sort_write(fp, &(s->recs[i])) < 0) {
+      break;
+    }
+  }
 
-      for (i = 0; i < sort_arr->nelts; i++) {
-        addfile(cmd, elts[i].name, elts[i].suffix, elts[i].sort_time,
-          elts[i].size);
-      }
+  if (i < s->nrecs ||
+      fflush(fp) != 0) {
+    int xerrno = errno;
 
-      opt_S = 1;
-      opt_t = setting;
+    if (new_run) {
+      fclose(fp);
     }
+
+    errno = xerrno;
+    return -1;
   }
 
-  sort_arr = NULL;
+  pr_trace_msg("data", 15, "spilled %u listing records (%lu bytes) to "
+    "sort file", s->nrecs, (unsigned long) s->memused);
+
+  if (new_run) {
+    *((FILE **) push_array(s->runs)) = fp;
+  }
+
+  ls_sorter_clear_recs(s);
+
+  /* Keep the number of runs, and thus of open files, bounded. */
+  if (s->cmp != NULL &&
+      s->runs->nelts >= ls_sorter_fanin()) {
+    return ls_sorter_collapse(s);
+  }
+
+  return 0;
 }
 
-static int outputfiles(cmd_rec *cmd) {
-  int n, res = 0;
-  struct filename *p = NULL, *q = NULL;
+static int ls_sorter_add(struct ls_sorter *s, time_t sort_time, off_t size,
+    const char *name, const char *line, const char *suffix) {
+  struct ls_sort_rec *rec;
+  size_t namelen, linelen, suffixlen, need;
+  char *ptr;
 
-  if (opt_S || opt_t) {
-    sortfiles(cmd);
+  namelen = strlen(name);
+  linelen = strlen(line);
+  suffixlen = strlen(suffix);
+
+  need = namelen + linelen + suffixlen + 2;
+  if (s->nrecs == s->nalloc) {
+    need += (s->nalloc > 0 ? s->nalloc : 64) * sizeof(struct ls_sort_rec);
   }
 
-  if (head == NULL) {
-    /* Nothing to display. */
-    if (sendline(LS_SENDLINE_FL_FLUSH, " ") < 0) {
-      res = -1;
+  /* Without a directory for the sort files, sort in memory, as for
+   * non-streaming listings.
+   */
+  if (s->nrecs > 0 &&
+      ls_stream_tmpfd >= 0 &&
+      ls_stream_mem + need > ls_stream_max_mem) {
+    if (ls_sorter_spill(s) < 0) {
+      return -1;
     }
 
-    destroy_pool(fpool);
-    fpool = NULL;
-    sort_arr = NULL;
-    head = tail = NULL;
-    colwidth = 0;
-    filenames = 0;
-
-    return res;
+    need = namelen + linelen + suffixlen + 2 +
+      (64 * sizeof(struct ls_sort_rec));
   }
 
-  tail->down = NULL;
-  tail = NULL;
-  colwidth = (colwidth | 7) + 1;
-  if (opt_l || !opt_C) {
-    colwidth = 75;
+  if (s->nrecs == s->nalloc) {
+    unsigned int nalloc;
+    struct ls_sort_rec *recs;
+
+    nalloc = (s->nalloc > 0 ? s->nalloc * 2 : 64);
+    recs = realloc(s->recs, nalloc * sizeof(struct ls_sort_rec));
+    if (recs == NULL) {
+      pr_log_pri(PR_LOG_ALERT, "Out of memory!");
+      exit(1);
+    }
+
+    s->recs = recs;
+    s->nalloc = nalloc;
   }
 
-  /* avoid division by 0 if colwidth > 75 */
-  if (colwidth > 75) {
-    colwidth = 75;
+  if (s->rec_pool == NULL) {
+    s->rec_pool = make_sub_pool(s->pool);
+    pr_pool_tag(s->rec_pool, "mod_ls sorter record pool");
   }
 
-  if (opt_C) {
-    p = head;
-    p->top = 1;
-    n = (filenames + (75 / colwidth)-1) / (75 / colwidth);
+  rec = &(s->recs[s->nrecs++]);
+  rec->sort_time = sort_time;
+  rec->size = size;
 
-    while (n && p) {
-      pr_signals_handle();
+  ptr = palloc(s->rec_pool, namelen + linelen + suffixlen + 2);
+  rec->name = ptr;
+  memcpy(ptr, name, namelen + 1);
 
-      p = p->down;
-      if (p) {
-        p->top = 0;
-      }
-      n--;
+  ptr += namelen + 1;
+  rec->line = ptr;
+  memcpy(ptr, line, linelen);
+  memcpy(ptr + linelen, suffix, suffixlen + 1);
+
+  s->memused += need;
+  ls_stream_mem += need;
+  return 0;
+}
+
+/* Reads the next record of a run; returns 1 if read, 0 at the end of the
+ * run, -1 on error.
+ */
+static int ls_sort_read(struct ls_sort_cursor *c) {
+  struct ls_sort_hdr hdr;
+  size_t len;
+
+  if (fread(&hdr, sizeof(hdr), 1, c->fp) != 1) {
+    if (ferror(c->fp)) {
+      errno = EIO;
+      return -1;
     }
 
-    q = head;
-    while (p) {
-      pr_signals_handle();
+    return 0;
+  }
 
-      p->top = q->top;
-      q->right = p;
-      q = q->down;
-      p = p->down;
+  len = (size_t) hdr.namelen + hdr.linelen + 2;
+  if (len > c->bufsz) {
+    char *buf;
+
+    buf = realloc(c->buf, len);
+    if (buf == NULL) {
+      pr_log_pri(PR_LOG_ALERT, "Out of memory!");
+      exit(1);
     }
 
-    while (q) {
-      pr_signals_handle();
+    c->buf = buf;
+    c->bufsz = len;
+  }
 
-      q->right = NULL;
-      q = q->down;
+  c->rec.sort_time = (time_t) hdr.sort_time;
+  c->rec.size = (off_t) hdr.size;
+  c->rec.name = c->buf;
+  c->rec.line = c->buf + hdr.namelen + 1;
+
+  if (fread(c->rec.name, 1, hdr.namelen, c->fp) != hdr.namelen ||
+      fread(c->rec.line, 1, hdr.linelen, c->fp) != hdr.linelen) {
+    errno = EIO;
+    return -1;
+  }
+
+  c->rec.name[hdr.namelen] = '\0';
+  c->rec.line[hdr.linelen] = '\0';
+  return 1;
+}
+
+static int ls_sort_heap_less(struct ls_sorter *s, unsigned int i,
+    unsigned int j) {
+  int res;
+
+  res = s->cmp(&(s->cursors[s->heap[i]].rec), &(s->cursors[s->heap[j]].rec));
+  if (res == 0) {
+    /* Keep equal records in run order. */
+    return (s->heap[i] < s->heap[j]);
+  }
+
+  return (res < 0);
+}
+
+static void ls_sort_heap_down(struct ls_sorter *s, unsigned int i) {
+  while (TRUE) {
+    unsigned int child, tmp;
+
+    child = (2 * i) + 1;
+    if (child >= s->nheap) {
+      break;
     }
 
-    p = head;
-    while (p && p->down && !p->down->top) {
-      pr_signals_handle();
-      p = p->down;
+    if (child + 1 < s->nheap &&
+        ls_sort_heap_less(s, child + 1, child)) {
+      child++;
     }
 
-    if (p && p->down) {
-      p->down = NULL;
+    if (!ls_sort_heap_less(s, child, i)) {
+      break;
     }
+
+    tmp = s->heap[i];
+    s->heap[i] = s->heap[child];
+    s->heap[child] = tmp;
+    i = child;
   }
+}
 
-  p = head;
-  while (p) {
-    pr_signals_handle();
+static void ls_sorter_end_merge(struct ls_sorter *s) {
+  register unsigned int i;
 
-    q = p;
-    p = p->down;
-    while (q) {
-      char pad[6] = {'\0'};
+  for (i = 0; i < s->ncursors; i++) {
+    if (s->cursors[i].fp != NULL) {
+      fclose(s->cursors[i].fp);
+    }
 
-      pr_signals_handle();
+    if (s->cursors[i].buf != NULL) {
+      free(s->cursors[i].buf);
+    }
+  }
 
-      if (!q->right) {
-        sstrncpy(pad, "\r\n", sizeof(pad));
+  if (s->cursors != NULL) {
+    free(s->cursors);
+    s->cursors = NULL;
+  }
 
-      } else {
-        unsigned int idx = 0;
+  if (s->heap != NULL) {
+    free(s->heap);
+    s->heap = NULL;
+  }
 
-        sstrncpy(pad, "\t\t\t\t\t", sizeof(pad));
+  s->ncursors = s->nheap = s->next_run = 0;
+  s->merging = FALSE;
+}
 
-        idx = (colwidth + 7 - strlen(q->line)) / 8;
-        if (idx >= sizeof(pad)) {
-          idx = sizeof(pad)-1;
-        }
+/* Starts merging all of the runs, which then belong to the merge. */
+static int ls_sorter_begin_merge(struct ls_sorter *s) {
+  register unsigned int i;
+  FILE **runs;
+  unsigned int nruns;
 
-        pad[idx] = '\0';
+  runs = s->runs->elts;
+  nruns = s->runs->nelts;
+
+  s->cursors = calloc(nruns, sizeof(struct ls_sort_cursor));
+  s->heap = calloc(nruns, sizeof(unsigned int));
+  if (s->cursors == NULL ||
+      s->heap == NULL) {
+    pr_log_pri(PR_LOG_ALERT, "Out of memory!");
+    exit(1);
+  }
+
+  s->ncursors = nruns;
+  s->nheap = s->next_run = 0;
+  s->merging = TRUE;
+
+  for (i = 0; i < nruns; i++) {
+    s->cursors[i].fp = runs[i];
+    rewind(runs[i]);
+  }
+  s->runs->nelts = 0;
+
+  if (s->cmp == NULL) {
+    /* Unsorted: the runs are simply read in order. */
+    return 0;
+  }
+
+  for (i = 0; i < nruns; i++) {
+    int res;
+
+    res = ls_sort_read(&(s->cursors[i]));
+    if (res < 0) {
+      return -1;
+    }
+
+    if (res > 0) {
+      s->heap[s->nheap++] = i;
+    }
+  }
+
+  for (i = s->nheap / 2; i > 0; i--) {
+    ls_sort_heap_down(s, i - 1);
+  }
+
+  return 0;
+}
+
+/* Returns the next merged record, or NULL when done; errno will be non-zero
+ * if there was an error.
+ */
+static struct ls_sort_rec *ls_sorter_next_merged(struct ls_sorter *s) {
+  struct ls_sort_cursor *c;
+  int res;
+
+  errno = 0;
+
+  if (s->cmp == NULL) {
+    while (s->next_run < s->ncursors) {
+      c = &(s->cursors[s->next_run]);
+
+      res = ls_sort_read(c);
+      if (res > 0) {
+        return &(c->rec);
       }
 
-      if (sendline(0, "%s%s", q->line, pad) < 0) {
-        return -1;
+      if (res < 0) {
+        return NULL;
       }
 
-      q = q->right;
+      s->next_run++;
     }
+
+    return NULL;
   }
 
-  if (sendline(LS_SENDLINE_FL_FLUSH, " ") < 0) {
-    res = -1;
+  if (s->nheap == 0) {
+    return NULL;
   }
 
-  destroy_pool(fpool);
-  fpool = NULL;
-  sort_arr = NULL;
-  head = tail = NULL;
-  colwidth = 0;
-  filenames = 0;
+  /* The record at the top of the heap was returned last time; advance
+   * that run, and restore the heap.
+   */
+  if (s->next_run > 0) {
+    c = &(s->cursors[s->heap[0]]);
 
-  return res;
+    res = ls_sort_read(c);
+    if (res < 0) {
+      return NULL;
+    }
+
+    if (res == 0) {
+      s->heap[0] = s->heap[--s->nheap];
+      if (s->nheap == 0) {
+        return NULL;
+      }
+    }
+
+    ls_sort_heap_down(s, 0);
+  }
+
+  s->next_run = 1;
+  return &(s->cursors[s->heap[0]].rec);
 }
 
-static void discard_output(void) {
-  if (fpool) {
-    destroy_pool(fpool);
+/* Merges all of the runs into a single run. */
+static int ls_sorter_collapse(struct ls_sorter *s) {
+  struct ls_sort_rec *rec;
+  FILE *fp;
+  int xerrno;
+
+  fp = ls_stream_tmpfile();
+  if (fp == NULL) {
+    return -1;
   }
-  fpool = NULL;
 
-  head = tail = NULL;
-  colwidth = 0;
-  filenames = 0;
+  if (ls_sorter_begin_merge(s) < 0) {
+    xerrno = errno;
+    ls_sorter_end_merge(s);
+    fclose(fp);
+    errno = xerrno;
+    return -1;
+  }
+
+  while ((rec = ls_sorter_next_merged(s)) != NULL) {
+    pr_signals_handle();
+
+    if (ls_sort_write(fp, rec) < 0) {
+      break;
+    }
+  }
+
+  xerrno = errno;
+  if (xerrno == 0 &&
+      fflush(fp) != 0) {
+    xerrno = errno;
+  }
+
+  ls_sorter_end_merge(s);
+
+  if (xerrno != 0) {
+    fclose(fp);
+    errno = xerrno;
+    return -1;
+  }
+
+  *((FILE **) push_array(s->runs)) = fp;
+  return 0;
 }
 
-static int dircmp(const void *a, const void *b) {
-#if defined(PR_USE_NLS) && defined(HAVE_STRCOLL)
-  return strcoll(*(const char **)a, *(const char **)b);
-#else
-  return strcmp(*(const char **)a, *(const char **)b);
-#endif /* !PR_USE_NLS or !HAVE_STRCOLL */
+/* Prepares the sorter for reading back its records, in order. */
+static int ls_sorter_finish(struct ls_sorter *s) {
+  s->next_rec = 0;
+
+  if (s->runs->nelts == 0) {
+    if (s->cmp != NULL &&
+        s->nrecs > 1) {
+      ls_qsort_cmp = s->cmp;
+      qsort(s->recs, s->nrecs, sizeof(struct ls_sort_rec), ls_sort_qsort_cmp);
+    }
+
+    return 0;
+  }
+
+  if (ls_sorter_spill(s) < 0) {
+    return -1;
+  }
+
+  return ls_sorter_begin_merge(s);
 }
 
-static char **sreaddir(const char *dirname, const int sort) {
-  DIR *d;
-  struct dirent *de;
-  struct stat st;
-  int i, dir_fd;
-  char **p;
-  long ssize;
-  size_t dsize;
+/* Returns the next record, or NULL when done; errno will be non-zero if
+ * there was an error.
+ */
+static struct ls_sort_rec *ls_sorter_next(struct ls_sorter *s) {
+  if (s->merging) {
+    return ls_sorter_next_merged(s);
+  }
 
-  pr_fs_clear_cache2(dirname);
-  if (pr_fsio_stat(dirname, &st) < 0) {
-    return NULL;
+  errno = 0;
+  if (s->next_rec < s->nrecs) {
+    return &(s->recs[s->next_rec++]);
   }
 
-  if (!S_ISDIR(st.st_mode)) {
-    errno = ENOTDIR;
-    return NULL;
+  return NULL;
+}
+
+static void ls_sorter_free(struct ls_sorter *s) {
+  register unsigned int i;
+  FILE **runs;
+
+  if (s == NULL) {
+    return;
   }
 
-  d = pr_fsio_opendir(dirname);
-  if (d == NULL) {
-    return NULL;
+  if (s->merging) {
+    ls_sorter_end_merge(s);
+  }
+
+  runs = s->runs->elts;
+  for (i = 0; i < s->runs->nelts; i++) {
+    fclose(runs[i]);
+  }
+  s->runs->nelts = 0;
+
+  ls_sorter_clear_recs(s);
+}
+
+static size_t colwidth = 0;
+static unsigned int filenames = 0;
+
+struct filename {
+  struct filename *down;
+  struct filename *right;
+  char *line;
+  int top;
+};
+
+struct sort_filename {
+  time_t sort_time;
+  off_t size;
+  char *name;
+  char *suffix;
+};
+
+static struct filename *head = NULL;
+static struct filename *tail = NULL;
+static array_header *sort_arr = NULL;
+static pool *fpool = NULL;
+
+static void addfile(cmd_rec *cmd, const char *name, const char *suffix,
+    time_t sort_time, off_t size) {
+  struct filename *p;
+  size_t l;
+
+  if (name == NULL ||
+      suffix == NULL) {
+    return;
+  }
+
+  /* Streaming listings send each line immediately, unless it needs to be
+   * sorted (by time or size).
+   */
+  if (ls_streaming) {
+    if (ls_stream_sorter != NULL) {
+      if (ls_sorter_add(ls_stream_sorter, sort_time, size,
+          ls_stream_name ? ls_stream_name : name, name, suffix) < 0) {
+        ls_stream_errno = errno;
+      }
+
+      return;
+    }
+
+    (void) sendline(0, "%s%s\r\n", name, suffix);
+    return;
+  }
+
+  /* If we are not sorting (-U is in effect), then we have no need to buffer
+   * up the line, and can send it immediately.  This can provide quite a bit
+   * of memory/CPU savings, especially for LIST commands on wide/deep
+   * directories (Bug#4060).
+   */
+  if (opt_U == 1) {
+    (void) sendline(0, "%s%s\r\n", name, suffix);
+    return;
+  }
+
+  if (fpool == NULL) {
+    fpool = make_sub_pool(cmd->tmp_pool);
+    pr_pool_tag(fpool, "mod_ls addfile pool");
+  }
+
+  if (opt_S || opt_t) {
+    struct sort_filename *s;
+
+    if (sort_arr == NULL) {
+      sort_arr = make_array(fpool, 50, sizeof(struct sort_filename));
+    }
+
+    s = (struct sort_filename *) push_array(sort_arr);
+    s->sort_time = sort_time;
+    s->size = size;
+    s->name = pstrdup(fpool, name);
+    s->suffix = pstrdup(fpool, suffix);
+
+    return;
+  }
+
+  l = strlen(name) + strlen(suffix);
+  if (l > colwidth) {
+    colwidth = l;
+  }
+
+  p = (struct filename *) pcalloc(fpool, sizeof(struct filename));
+  p->line = pcalloc(fpool, l + 2);
+  snprintf(p->line, l + 1, "%s%s", name, suffix);
+
+  if (tail) {
+    tail->down = p;
+
+  } else {
+    head = p;
+  }
+
+  tail = p;
+  filenames++;
+}
+
+static int file_time_cmp(const struct sort_filename *f1,
+    const struct sort_filename *f2) {
+
+  if (f1->sort_time > f2->sort_time)
+    return -1;
+
+  else if (f1->sort_time < f2->sort_time)
+    return 1;
+
+  return 0;
+}
+
+static int file_time_reverse_cmp(const struct sort_filename *f1,
+    const struct sort_filename *f2) {
+  return -file_time_cmp(f1, f2);
+}
+
+static int file_size_cmp(const struct sort_filename *f1,
+    const struct sort_filename *f2) {
+
+  if (f1->size > f2->size)
+    return -1;
+
+  else if (f1->size < f2->size)
+    return 1;
+
+  return 0;
+}
+
+static int file_size_reverse_cmp(const struct sort_filename *f1,
+    const struct sort_filename *f2) {
+  return -file_size_cmp(f1, f2);
+}
+
+static void sortfiles(cmd_rec *cmd) {
+
+  if (sort_arr) {
+
+    /* Sort by time? */
+    if (opt_t) {
+      register unsigned int i = 0;
+      int setting = opt_S;
+      struct sort_filename *elts = sort_arr->elts;
+
+      qsort(sort_arr->elts, sort_arr->nelts, sizeof(struct sort_filename),
+        (int (*)(const void *, const void *))
+          (opt_r ? file_time_reverse_cmp : file_time_cmp));
+
+      opt_S = opt_t = 0;
+
+      for (i = 0; i < sort_arr->nelts; i++) {
+        addfile(cmd, elts[i].name, elts[i].suffix, elts[i].sort_time,
+          elts[i].size);
+      }
+
+      opt_S = setting;
+      opt_t = 1;
+
+    /* Sort by file size? */
+    } else if (opt_S) {
+      register unsigned int i = 0;
+      int setting = opt_t;
+      struct sort_filename *elts = sort_arr->elts;
+
+      qsort(sort_arr->elts, sort_arr->nelts, sizeof(struct sort_filename),
+        (int (*)(const void *, const void *))
+          (opt_r ? file_size_reverse_cmp : file_size_cmp));
+
+      opt_S = opt_t = 0;
+
+      for (i = 0; i < sort_arr->nelts; i++) {
+        addfile(cmd, elts[i].name, elts[i].suffix, elts[i].sort_time,
+          elts[i].size);
+      }
+
+      opt_S = 1;
+      opt_t = setting;
+    }
+  }
+
+  sort_arr = NULL;
+}
+
+static int outputfiles(cmd_rec *cmd) {
+  int n, res = 0;
+  struct filename *p = NULL, *q = NULL;
+
+  if (opt_S || opt_t) {
+    sortfiles(cmd);
+  }
+
+  if (head == NULL) {
+    /* Nothing to display. */
+    if (sendline(LS_SENDLINE_FL_FLUSH, " ") < 0) {
+      res = -1;
+    }
+
+    destroy_pool(fpool);
+    fpool = NULL;
+    sort_arr = NULL;
+    head = tail = NULL;
+    colwidth = 0;
+    filenames = 0;
+
+    return res;
+  }
+
+  tail->down = NULL;
+  tail = NULL;
+  colwidth = (colwidth | 7) + 1;
+  if (opt_l || !opt_C) {
+    colwidth = 75;
+  }
+
+  /* avoid division by 0 if colwidth > 75 */
+  if (colwidth > 75) {
+    colwidth = 75;
+  }
+
+  if (opt_C) {
+    p = head;
+    p->top = 1;
+    n = (filenames + (75 / colwidth)-1) / (75 / colwidth);
+
+    while (n && p) {
+      pr_signals_handle();
+
+      p = p->down;
+      if (p) {
+        p->top = 0;
+      }
+      n--;
+    }
+
+    q = head;
+    while (p) {
+      pr_signals_handle();
+
+      p->top = q->top;
+      q->right = p;
+      q = q->down;
+      p = p->down;
+    }
+
+    while (q) {
+      pr_signals_handle();
+
+      q->right = NULL;
+      q = q->down;
+    }
+
+    p = head;
+    while (p && p->down && !p->down->top) {
+      pr_signals_handle();
+      p = p->down;
+    }
+
+    if (p && p->down) {
+      p->down = NULL;
+    }
+  }
+
+  p = head;
+  while (p) {
+    pr_signals_handle();
+
+    q = p;
+    p = p->down;
+    while (q) {
+      char pad[6] = {'\0'};
+
+      pr_signals_handle();
+
+      if (!q->right) {
+        sstrncpy(pad, "\r\n", sizeof(pad));
+
+      } else {
+        unsigned int idx = 0;
+
+        sstrncpy(pad, "\t\t\t\t\t", sizeof(pad));
+
+        idx = (colwidth + 7 - strlen(q->line)) / 8;
+        if (idx >= sizeof(pad)) {
+          idx = sizeof(pad)-1;
+        }
+
+        pad[idx] = '\0';
+      }
+
+      if (sendline(0, "%s%s", q->line, pad) < 0) {
+        return -1;
+      }
+
+      q = q->right;
+    }
+  }
+
+  if (sendline(LS_SENDLINE_FL_FLUSH, " ") < 0) {
+    res = -1;
+  }
+
+  destroy_pool(fpool);
+  fpool = NULL;
+  sort_arr = NULL;
+  head = tail = NULL;
+  colwidth = 0;
+  filenames = 0;
+
+  return res;
+}
+
+static void discard_output(void) {
+  if (fpool) {
+    destroy_pool(fpool);
+  }
+  fpool = NULL;
+
+  head = tail = NULL;
+  colwidth = 0;
+  filenames = 0;
+}
+
+static int dircmp(const void *a, const void *b) {
+#if defined(PR_USE_NLS) && defined(HAVE_STRCOLL)
+  return strcoll(*(const char **)a, *(const char **)b);
+#else
+  return strcmp(*(const char **)a, *(const char **)b);
+#endif /* !PR_USE_NLS or !HAVE_STRCOLL */
+}
+
+static char **sreaddir(const char *dirname, const int sort) {
+  DIR *d;
+  struct dirent *de;
+  struct stat st;
+  int i, dir_fd;
+  char **p;
+  long ssize;
+  size_t dsize;
+
+  pr_fs_clear_cache2(dirname);
+  if (pr_fsio_stat(dirname, &st) < 0) {
+    return NULL;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    errno = ENOTDIR;
+    return NULL;
+  }
+
+  d = pr_fsio_opendir(dirname);
+  if (d == NULL) {
+    return NULL;
+  }
+
+  /* It doesn't matter if the following guesses are wrong, but it slows
+   * the system a bit and wastes some memory if they are wrong, so
+   * don't guess *too* naively!
+   *
+   * 'dsize' must be greater than zero or we loop forever.
+   * 'ssize' must be at least big enough to hold a maximum-length name.
+   */
+
+  /* Guess the number of entries in the directory. */
+  dsize = (((size_t) st.st_size) / 4) + 10;
+  if (dsize > LS_MAX_DSIZE) {
+    dsize = LS_MAX_DSIZE;
+  }
+
+  /* The directory has been opened already, but portably accessing the file
+   * descriptor inside the DIR struct isn't easy.  Some systems use "dd_fd" or
+   * "__dd_fd" rather than "d_fd".  Still others work really hard at opacity.
+   */
+#if defined(HAVE_DIRFD) 
+  dir_fd = dirfd(d);
+#elif defined(HAVE_STRUCT_DIR_D_FD)
+  dir_fd = d->d_fd;
+#elif defined(HAVE_STRUCT_DIR_DD_FD)
+  dir_fd = d->dd_fd;
+#elif defined(HAVE_STRUCT_DIR___DD_FD)
+  dir_fd = d->__dd_fd;
+#else
+  dir_fd = 0;
+#endif
+
+  ssize = get_name_max((char *) dirname, dir_fd);
+  if (ssize < 1) {
+    pr_log_debug(DEBUG1, "get_name_max(%s, %d) = %lu, using %d", dirname,
+      dir_fd, (unsigned long) ssize, NAME_MAX_GUESS);
+    ssize = NAME_MAX_GUESS;
+  }
+
+  ssize *= ((dsize / 4) + 1);
+
+  /* Allocate first block for holding filenames.  Yes, we are explicitly using
+   * malloc (and realloc, and calloc, later) rather than the memory pools.
+   * Recursive directory listings would eat up a lot of pool memory that is
+   * only freed when the _entire_ directory structure has been parsed.  Also,
+   * this helps to keep the memory footprint a little smaller.
+   */
+  pr_trace_msg("data", 8, "allocating readdir buffer of %lu bytes",
+    (unsigned long) (dsize * sizeof(char *)));
+
+  p = malloc(dsize * sizeof(char *));
+  if (p == NULL) {
+    pr_log_pri(PR_LOG_ALERT, "Out of memory!");
+    exit(1);
+  }
+
+  i = 0;
+
+  while ((de = pr_fsio_readdir(d)) != NULL) {
+    pr_signals_handle();
+
+    if ((size_t) i >= dsize - 1) {
+      char **newp;
+
+      /* The test above goes off one item early in case this is the last item
+       * in the directory and thus next time we will want to NULL-terminate
+       * the array.
+       */
+      pr_log_debug(DEBUG0, "Reallocating sreaddir buffer from %lu entries to "
+        "%lu entries", (unsigned long) dsize, (unsigned long) dsize * 2);
+
+      /* Allocate bigger array for pointers to filenames */
+      pr_trace_msg("data", 8, "allocating readdir buffer of %lu bytes",
+        (unsigned long) (2 * dsize * sizeof(char *)));
+
+      newp = (char **) realloc(p, 2 * dsize * sizeof(char *));
+      if (newp == NULL) {
+        pr_log_pri(PR_LOG_ALERT, "Out of memory!");
+        exit(1);
+      }
+      p = newp;
+      dsize *= 2;
+    }
+
+    /* Append the filename to the block. */
+    p[i] = (char *) calloc(strlen(de->d_name) + 1, sizeof(char));
+    if (p[i] == NULL) {
+      pr_log_pri(PR_LOG_ALERT, "Out of memory!");
+      exit(1);
+    }
+    sstrncpy(p[i++], de->d_name, strlen(de->d_name) + 1);
+  }
+
+  pr_fsio_closedir(d);
+
+  /* This is correct, since the above is off by one element.
+   */
+  p[i] = NULL;
+
+  if (sort) {
+    PR_DEVEL_CLOCK(qsort(p, i, sizeof(char *), dircmp));
+  }
+
+  return p;
+}
+
+/* Lists the given subdirectory, for -R.  Returns 1 if no more
+ * subdirectories should be listed, -1 on error, and 0 otherwise.
+ */
+static int listsubdir(cmd_rec *cmd, pool *workp, const char *resp_code,
+    const char *name, char *subname) {
+  char cwd_buf[PR_TUNABLE_PATH_MAX + 1] = {'\0'};
+  unsigned char symhold;
+
+  if (list_ndirs.curr && list_ndirs.max &&
+      list_ndirs.curr >= list_ndirs.max) {
+
+    if (!list_ndirs.logged) {
+      pr_log_debug(DEBUG8, "ListOptions maxdirs (%u) reached",
+        list_ndirs.max);
+      list_ndirs.logged = TRUE;
+    }
+
+    return 1;
+  }
+
+  if (list_nfiles.curr && list_nfiles.max &&
+      list_nfiles.curr >= list_nfiles.max) {
+
+    if (!list_nfiles.logged) {
+      pr_log_debug(DEBUG8, "ListOptions maxfiles (%u) reached",
+        list_nfiles.max);
+      list_nfiles.logged = TRUE;
+    }
+
+    return 1;
+  }
+
+  push_cwd(cwd_buf, &symhold);
+
+  if (subname && ls_perms_full(workp, cmd, subname, NULL) &&
+      !pr_fsio_chdir_canon(subname, !opt_L && list_show_symlinks)) {
+    char *subdir;
+    int res = 0;
+
+    if (strcmp(name, ".") == 0) {
+      subdir = subname;
+
+    } else {
+      subdir = pdircat(workp, name, subname, NULL);
+    }
+
+    if (opt_STAT) {
+      pr_response_add(resp_code, "%s", "");
+      pr_response_add(resp_code, "%s:",
+        pr_fs_encode_path(cmd->tmp_pool, subdir));
+
+    } else if (sendline(0, "\r\n%s:\r\n",
+               pr_fs_encode_path(cmd->tmp_pool, subdir)) < 0 ||
+        sendline(LS_SENDLINE_FL_FLUSH, " ") < 0) {
+      pop_cwd(cwd_buf, &symhold);
+      return -1;
+    }
+
+    list_ndepth.curr++;
+    res = listdir(cmd, workp, resp_code, subdir);
+    list_ndepth.curr--;
+    pop_cwd(cwd_buf, &symhold);
+
+    if (res > 0) {
+      return 1;
+    }
+
+    if (res < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* Streaming listings are used for LIST (not STAT), where ListStreaming is
+ * enabled, except for multi-column (-C without -l) listings, whose layout
+ * depends on all of the names.
+ */
+static int ls_use_streaming(cmd_rec *cmd) {
+  config_rec *c;
+
+  if (opt_STAT ||
+      (opt_C && !opt_l)) {
+    return FALSE;
+  }
+
+  c = find_config(CURRENT_CONF, CONF_PARAM, "ListStreaming", FALSE);
+  if (c == NULL ||
+      *((int *) c->argv[0]) != TRUE) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Lists one directory entry, for a streaming listing, noting any
+ * subdirectory to be listed for -R.  Returns the listfile() result, or -1
+ * on error.
+ */
+static int liststream_entry(cmd_rec *cmd, pool *p, const char *resp_code,
+    const char *filename, struct ls_sorter *dirs) {
+  int d;
+
+  if (*filename == '.' &&
+      !opt_a &&
+      (!opt_A || is_dotdir(filename))) {
+    return 0;
+  }
+
+  ls_stream_name = filename;
+  d = listfile(cmd, p, resp_code, filename);
+  ls_stream_name = NULL;
+
+  if (ls_stream_errno != 0) {
+    errno = ls_stream_errno;
+    return -1;
+  }
+
+  if (d == 1 &&
+      dirs != NULL &&
+      !is_dotdir(filename)) {
+    if (ls_sorter_add(dirs, 0, 0, filename, "", "") < 0) {
+      return -1;
+    }
+  }
+
+  return d;
+}
+
+/* The streaming counterpart of listdir(), which also requires a chdir()
+ * first.
+ */
+static int listdir_stream(cmd_rec *cmd, pool *workp, const char *resp_code,
+    const char *name, int capturing) {
+  void *dirh;
+  struct dirent *de;
+  struct ls_sorter *names = NULL, *lines = NULL, *dirs = NULL;
+  struct ls_sort_rec *rec;
+  pool *entry_pool;
+  unsigned int nentries = 0;
+  int d = 0, res = 0, xerrno = 0, prev_streaming;
+
+  dirh = pr_fsio_opendir(".");
+  if (dirh == NULL) {
+    pr_trace_msg("fsio", 9,
+      "opendir() error on '.': %s", strerror(errno));
+
+    if (capturing) {
+      pr_listcache_capture_abort();
+    }
+
+    return 0;
+  }
+
+  /* Names are sorted (unless -U) before being listed, so that each line can
+   * be sent as soon as it is formatted.  Sorting by time or size needs the
+   * formatted lines to be sorted instead.
+   */
+  if (opt_S || opt_t) {
+    lines = ls_sorter_create(workp,
+      opt_t ? ls_sort_time_cmp : ls_sort_size_cmp);
+
+  } else if (!opt_U) {
+    names = ls_sorter_create(workp, ls_sort_name_cmp);
+  }
+
+  if (opt_R) {
+    /* Subdirectories are listed in name order, unless -U; the names are
+     * already in order, if sorted.
+     */
+    dirs = ls_sorter_create(workp,
+      (opt_U || names != NULL) ? NULL : ls_sort_name_cmp);
+  }
+
+  prev_streaming = ls_streaming;
+  ls_streaming = TRUE;
+  ls_stream_sorter = lines;
+  ls_stream_errno = 0;
+
+  entry_pool = make_sub_pool(workp);
+  pr_pool_tag(entry_pool, "mod_ls: listdir_stream(): entry pool");
+
+  while ((de = pr_fsio_readdir(dirh)) != NULL) {
+    pr_signals_handle();
+
+    if (XFER_ABORTED) {
+      res = -1;
+      break;
+    }
+
+    if (names != NULL) {
+      if (ls_sorter_add(names, 0, 0, de->d_name, "", "") < 0) {
+        res = -1;
+        break;
+      }
+
+      continue;
+    }
+
+    if (++nentries % LS_STREAM_POOL_ENTRIES == 0) {
+      destroy_pool(entry_pool);
+      entry_pool = make_sub_pool(workp);
+      pr_pool_tag(entry_pool, "mod_ls: listdir_stream(): entry pool");
+    }
+
+    d = liststream_entry(cmd, entry_pool, resp_code, de->d_name, dirs);
+    if (d < 0) {
+      res = -1;
+      break;
+    }
+
+    if (d == 2) {
+      break;
+    }
+  }
+  xerrno = errno;
+
+  pr_fsio_closedir(dirh);
+
+  if (res == 0 &&
+      names != NULL) {
+    if (ls_sorter_finish(names) < 0) {
+      xerrno = errno;
+      res = -1;
+
+    } else {
+      while ((rec = ls_sorter_next(names)) != NULL) {
+        pr_signals_handle();
+
+        if (XFER_ABORTED) {
+          res = -1;
+          break;
+        }
+
+        if (++nentries % LS_STREAM_POOL_ENTRIES == 0) {
+          destroy_pool(entry_pool);
+          entry_pool = make_sub_pool(workp);
+          pr_pool_tag(entry_pool, "mod_ls: listdir_stream(): entry pool");
+        }
+
+        d = liststream_entry(cmd, entry_pool, resp_code, rec->name, dirs);
+        if (d < 0) {
+          res = -1;
+          break;
+        }
+
+        if (d == 2) {
+          break;
+        }
+      }
+
+      if (res == 0 &&
+          rec == NULL &&
+          errno != 0) {
+        res = -1;
+      }
+      xerrno = errno;
+    }
+
+    ls_sorter_free(names);
+  }
+
+  ls_stream_sorter = NULL;
+  ls_streaming = prev_streaming;
+  destroy_pool(entry_pool);
+
+  if (res == 0 &&
+      lines != NULL) {
+    if (ls_sorter_finish(lines) < 0) {
+      xerrno = errno;
+      res = -1;
+
+    } else {
+      while ((rec = ls_sorter_next(lines)) != NULL) {
+        pr_signals_handle();
+
+        if (XFER_ABORTED) {
+          res = -1;
+          break;
+        }
+
+        if (sendline(0, "%s\r\n", rec->line) < 0) {
+          res = -1;
+          break;
+        }
+      }
+
+      if (res == 0 &&
+          rec == NULL &&
+          errno != 0) {
+        res = -1;
+      }
+      xerrno = errno;
+    }
   }
 
-  /* It doesn't matter if the following guesses are wrong, but it slows
-   * the system a bit and wastes some memory if they are wrong, so
-   * don't guess *too* naively!
-   *
-   * 'dsize' must be greater than zero or we loop forever.
-   * 'ssize' must be at least big enough to hold a maximum-length name.
-   */
+  ls_sorter_free(lines);
 
-  /* Guess the number of entries in the directory. */
-  dsize = (((size_t) st.st_size) / 4) + 10;
-  if (dsize > LS_MAX_DSIZE) {
-    dsize = LS_MAX_DSIZE;
+  if (res == 0 &&
+      sendline(LS_SENDLINE_FL_FLUSH, " ") < 0) {
+    xerrno = errno;
+    res = -1;
   }
 
-  /* The directory has been opened already, but portably accessing the file
-   * descriptor inside the DIR struct isn't easy.  Some systems use "dd_fd" or
-   * "__dd_fd" rather than "d_fd".  Still others work really hard at opacity.
-   */
-#if defined(HAVE_DIRFD) 
-  dir_fd = dirfd(d);
-#elif defined(HAVE_STRUCT_DIR_D_FD)
-  dir_fd = d->d_fd;
-#elif defined(HAVE_STRUCT_DIR_DD_FD)
-  dir_fd = d->dd_fd;
-#elif defined(HAVE_STRUCT_DIR___DD_FD)
-  dir_fd = d->__dd_fd;
-#else
-  dir_fd = 0;
-#endif
+  if (capturing) {
+    if (res < 0 ||
+        XFER_ABORTED ||
+        d == 2) {
+      pr_listcache_capture_abort();
 
-  ssize = get_name_max((char *) dirname, dir_fd);
-  if (ssize < 1) {
-    pr_log_debug(DEBUG1, "get_name_max(%s, %d) = %lu, using %d", dirname,
-      dir_fd, (unsigned long) ssize, NAME_MAX_GUESS);
-    ssize = NAME_MAX_GUESS;
+    } else {
+      (void) pr_listcache_capture_finish();
+    }
   }
 
-  ssize *= ((dsize / 4) + 1);
-
-  /* Allocate first block for holding filenames.  Yes, we are explicitly using
-   * malloc (and realloc, and calloc, later) rather than the memory pools.
-   * Recursive directory listings would eat up a lot of pool memory that is
-   * only freed when the _entire_ directory structure has been parsed.  Also,
-   * this helps to keep the memory footprint a little smaller.
-   */
-  pr_trace_msg("data", 8, "allocating readdir buffer of %lu bytes",
-    (unsigned long) (dsize * sizeof(char *)));
+  if (res < 0) {
+    if (xerrno != 0 &&
+        !XFER_ABORTED) {
+      pr_log_pri(PR_LOG_NOTICE, "error listing '%s': %s", name,
+        strerror(xerrno));
+    }
 
-  p = malloc(dsize * sizeof(char *));
-  if (p == NULL) {
-    pr_log_pri(PR_LOG_ALERT, "Out of memory!");
-    exit(1);
+    ls_sorter_free(dirs);
+    return -1;
   }
 
-  i = 0;
+  if (dirs != NULL &&
+      d != 2) {
+    if (ls_sorter_finish(dirs) < 0) {
+      pr_log_pri(PR_LOG_NOTICE, "error listing subdirectories of '%s': %s",
+        name, strerror(errno));
+      ls_sorter_free(dirs);
+      return -1;
+    }
 
-  while ((de = pr_fsio_readdir(d)) != NULL) {
-    pr_signals_handle();
+    while ((rec = ls_sorter_next(dirs)) != NULL) {
+      pool *subdir_pool;
 
-    if ((size_t) i >= dsize - 1) {
-      char **newp;
+      pr_signals_handle();
 
-      /* The test above goes off one item early in case this is the last item
-       * in the directory and thus next time we will want to NULL-terminate
-       * the array.
-       */
-      pr_log_debug(DEBUG0, "Reallocating sreaddir buffer from %lu entries to "
-        "%lu entries", (unsigned long) dsize, (unsigned long) dsize * 2);
+      subdir_pool = make_sub_pool(workp);
+      pr_pool_tag(subdir_pool, "mod_ls: listdir_stream(): subdir pool");
 
-      /* Allocate bigger array for pointers to filenames */
-      pr_trace_msg("data", 8, "allocating readdir buffer of %lu bytes",
-        (unsigned long) (2 * dsize * sizeof(char *)));
+      res = listsubdir(cmd, subdir_pool, resp_code, name,
+        pstrdup(subdir_pool, rec->name));
+      destroy_pool(subdir_pool);
 
-      newp = (char **) realloc(p, 2 * dsize * sizeof(char *));
-      if (newp == NULL) {
-        pr_log_pri(PR_LOG_ALERT, "Out of memory!");
-        exit(1);
+      if (res != 0) {
+        break;
       }
-      p = newp;
-      dsize *= 2;
     }
 
-    /* Append the filename to the block. */
-    p[i] = (char *) calloc(strlen(de->d_name) + 1, sizeof(char));
-    if (p[i] == NULL) {
-      pr_log_pri(PR_LOG_ALERT, "Out of memory!");
-      exit(1);
+    if (res == 0 &&
+        rec == NULL &&
+        errno != 0) {
+      pr_log_pri(PR_LOG_NOTICE, "error listing subdirectories of '%s': %s",
+        name, strerror(errno));
+      res = -1;
     }
-    sstrncpy(p[i++], de->d_name, strlen(de->d_name) + 1);
-  }
-
-  pr_fsio_closedir(d);
-
-  /* This is correct, since the above is off by one element.
-   */
-  p[i] = NULL;
-
-  if (sort) {
-    PR_DEVEL_CLOCK(qsort(p, i, sizeof(char *), dircmp));
   }
 
-  return p;
+  ls_sorter_free(dirs);
+  return (res < 0 ? -1 : 0);
 }
 
 /* This listdir() requires a chdir() first. */
 static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
     const char *name) {
   char **dir;
-  int dest_workp = 0;
+  int dest_workp = 0, capturing = FALSE;
   register unsigned int i = 0;
 
   if (list_ndepth.curr && list_ndepth.max &&
@@ -1339,6 +2506,47 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
     dest_workp++;
   }
 
+  if (ls_use_cache(cmd)) {
+    struct stat st;
+
+    /* A single stat of the directory suffices for validating any cached
+     * listing.
+     */
+    pr_fs_clear_cache2(".");
+    if (pr_fsio_stat(".", &st) == 0) {
+      const char *key;
+      char *data = NULL;
+      size_t datalen = 0;
+
+      key = ls_cache_key(cmd);
+      if (pr_listcache_get(workp, ".", key, &st, &data, &datalen) == 0) {
+        int res;
+
+        res = sendcached(data, datalen);
+        if (dest_workp) {
+          destroy_pool(workp);
+        }
+
+        return (res < 0 ? -1 : 0);
+      }
+
+      if (pr_listcache_capture_start(".", key, &st) == 0) {
+        capturing = TRUE;
+      }
+    }
+  }
+
+  if (ls_use_streaming(cmd)) {
+    int res;
+
+    res = listdir_stream(cmd, workp, resp_code, name, capturing);
+    if (dest_workp) {
+      destroy_pool(workp);
+    }
+
+    return res;
+  }
+
   PR_DEVEL_CLOCK(dir = sreaddir(".", opt_U ? FALSE : TRUE));
   if (dir) {
     char **s;
@@ -1378,6 +2586,10 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
     }
 
     if (outputfiles(cmd) < 0) {
+      if (capturing) {
+        pr_listcache_capture_abort();
+      }
+
       if (dest_workp) {
         destroy_pool(workp);
       }
@@ -1394,10 +2606,19 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
       return -1;
     }
 
+    if (capturing) {
+      if (XFER_ABORTED ||
+          d == 2) {
+        pr_listcache_capture_abort();
+
+      } else {
+        (void) pr_listcache_capture_finish();
+      }
+    }
+
     r = dir;
     while (opt_R && r != s) {
-      char cwd_buf[PR_TUNABLE_PATH_MAX + 1] = {'\0'};
-      unsigned char symhold;
+      int res;
 
       if (*r && (strcmp(*r, ".") == 0 || strcmp(*r, "..") == 0)) {
         r++;
@@ -1409,101 +2630,37 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
        */
       pr_signals_handle();
 
-      if (list_ndirs.curr && list_ndirs.max &&
-          list_ndirs.curr >= list_ndirs.max) {
-
-        if (!list_ndirs.logged) {
-          pr_log_debug(DEBUG8, "ListOptions maxdirs (%u) reached",
-            list_ndirs.max);
-          list_ndirs.logged = TRUE;
-        }
-
-        break;
-      }
-
-      if (list_nfiles.curr && list_nfiles.max &&
-          list_nfiles.curr >= list_nfiles.max) {
-
-        if (!list_nfiles.logged) {
-          pr_log_debug(DEBUG8, "ListOptions maxfiles (%u) reached",
-            list_nfiles.max);
-          list_nfiles.logged = TRUE;
-        }
-
+      res = listsubdir(cmd, workp, resp_code, name, *r);
+      if (res > 0) {
         break;
-      }
-
-      push_cwd(cwd_buf, &symhold);
-
-      if (*r && ls_perms_full(workp, cmd, (char *) *r, NULL) &&
-          !pr_fsio_chdir_canon(*r, !opt_L && list_show_symlinks)) {
-        char *subdir;
-        int res = 0;
 
-        if (strcmp(name, ".") == 0) {
-          subdir = *r;
-
-        } else {
-          subdir = pdircat(workp, name, *r, NULL);
+      } else if (res < 0) {
+        if (dest_workp) {
+          destroy_pool(workp);
         }
 
-        if (opt_STAT) {
-          pr_response_add(resp_code, "%s", "");
-          pr_response_add(resp_code, "%s:",
-            pr_fs_encode_path(cmd->tmp_pool, subdir));
-
-        } else if (sendline(0, "\r\n%s:\r\n",
-                   pr_fs_encode_path(cmd->tmp_pool, subdir)) < 0 ||
-            sendline(LS_SENDLINE_FL_FLUSH, " ") < 0) {
-          pop_cwd(cwd_buf, &symhold);
-
-          if (dest_workp) {
-            destroy_pool(workp);
-          }
-
-          /* Explicitly free the memory allocated for containing the list of
-           * filenames.
-           */
-          i = 0;
-          while (dir[i] != NULL) {
-            free(dir[i++]);
-          }
-          free(dir);
-
-          return -1;
+        /* Explicitly free the memory allocated for containing the list of
+         * filenames.
+         */
+        i = 0;
+        while (dir[i] != NULL) {
+          free(dir[i++]);
         }
+        free(dir);
 
-        list_ndepth.curr++;
-        res = listdir(cmd, workp, resp_code, subdir);
-        list_ndepth.curr--;
-        pop_cwd(cwd_buf, &symhold);
-
-        if (res > 0) {
-          break;
-
-        } else if (res < 0) {
-          if (dest_workp) {
-            destroy_pool(workp);
-          }
-
-          /* Explicitly free the memory allocated for containing the list of
-           * filenames.
-           */
-          i = 0;
-          while (dir[i] != NULL) {
-            free(dir[i++]);
-          }
-          free(dir);
-
-          return -1;
-        }
+        return -1;
       }
+
       r++;
     }
 
   } else {
     pr_trace_msg("fsio", 9,
       "sreaddir() error on '.': %s", strerror(errno));
+
+    if (capturing) {
+      pr_listcache_capture_abort();
+    }
   }
 
   if (dest_workp) {
@@ -3478,6 +4635,75 @@ MODRET set_dirfakemode(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: ListCache path|off [maxage secs] [maxsize bytes] */
+MODRET set_listcache(cmd_rec *cmd) {
+  register unsigned int i;
+  config_rec *c;
+  unsigned int max_age = PR_LISTCACHE_DEFAULT_MAX_AGE;
+  size_t max_size = PR_LISTCACHE_DEFAULT_MAX_SIZE;
+
+  if (cmd->argc < 2 ||
+      (cmd->argc % 2) != 0) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL|CONF_ANON|CONF_DIR);
+
+  c = add_config_param(cmd->argv[0], 3, NULL, NULL, NULL);
+  c->flags |= CF_MERGEDOWN;
+
+  if (strcasecmp(cmd->argv[1], "off") == 0) {
+    if (cmd->argc != 2) {
+      CONF_ERROR(cmd, "wrong number of parameters");
+    }
+
+    return PR_HANDLED(cmd);
+  }
+
+  if (*((char *) cmd->argv[1]) != '/') {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "path '", (char *) cmd->argv[1],
+      "' is not an absolute path", NULL));
+  }
+
+  for (i = 2; i < cmd->argc; i += 2) {
+    if (strcasecmp(cmd->argv[i], "maxage") == 0) {
+      int age;
+
+      age = atoi(cmd->argv[i+1]);
+      if (age < 1) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool,
+          "maxage must be greater than 0: '", (char *) cmd->argv[i+1], "'",
+          NULL));
+      }
+
+      max_age = age;
+
+    } else if (strcasecmp(cmd->argv[i], "maxsize") == 0) {
+      off_t size;
+
+      if (pr_str_get_nbytes(cmd->argv[i+1], NULL, &size) < 0 ||
+          size < 1) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid maxsize '",
+          (char *) cmd->argv[i+1], "'", NULL));
+      }
+
+      max_size = (size_t) size;
+
+    } else {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown parameter: '",
+        (char *) cmd->argv[i], "'", NULL));
+    }
+  }
+
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+  c->argv[1] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = max_age;
+  c->argv[2] = palloc(c->pool, sizeof(size_t));
+  *((size_t *) c->argv[2]) = max_size;
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_listoptions(cmd_rec *cmd) {
   config_rec *c = NULL;
   unsigned long flags = 0;
@@ -3581,6 +4807,62 @@ MODRET set_listoptions(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+MODRET set_liststreaming(cmd_rec *cmd) {
+  register unsigned int i;
+  int engine = -1;
+  config_rec *c;
+  size_t max_mem = LS_STREAM_DEFAULT_MAX_MEM;
+  const char *tmpdir = LS_STREAM_DEFAULT_TMPDIR;
+
+  if (cmd->argc < 2 ||
+      (cmd->argc % 2) != 0) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL|CONF_ANON|CONF_DIR);
+
+  engine = get_boolean(cmd, 1);
+  if (engine == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  for (i = 2; i < cmd->argc; i += 2) {
+    if (strcasecmp(cmd->argv[i], "maxmem") == 0) {
+      off_t size;
+
+      if (pr_str_get_nbytes(cmd->argv[i+1], NULL, &size) < 0 ||
+          size < LS_STREAM_RUN_MEMSZ) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid maxmem '",
+          (char *) cmd->argv[i+1], "'", NULL));
+      }
+
+      max_mem = (size_t) size;
+
+    } else if (strcasecmp(cmd->argv[i], "tmpdir") == 0) {
+      tmpdir = cmd->argv[i+1];
+      if (*tmpdir != '/') {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "tmpdir '", tmpdir,
+          "' is not an absolute path", NULL));
+      }
+
+    } else {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown parameter: '",
+        (char *) cmd->argv[i], "'", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 3, NULL, NULL, NULL);
+  c->flags |= CF_MERGEDOWN;
+
+  c->argv[0] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = engine;
+  c->argv[1] = palloc(c->pool, sizeof(size_t));
+  *((size_t *) c->argv[1]) = max_mem;
+  c->argv[2] = pstrdup(c->pool, tmpdir);
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_showsymlinks(cmd_rec *cmd) {
   int bool = -1;
   config_rec *c = NULL;
@@ -3632,6 +4914,76 @@ static int ls_init(void) {
   return 0;
 }
 
+static int ls_sess_init(void) {
+  config_rec *c;
+  int xerrno = 0;
+
+  /* The cache directory is opened now, before any chroot(2); the first
+   * configured ListCache directory is used for all of the session's
+   * listings.
+   */
+  c = find_config(main_server->conf, CONF_PARAM, "ListCache", TRUE);
+  while (c != NULL) {
+    pr_signals_handle();
+
+    if (c->argv[0] != NULL) {
+      const char *path;
+
+      path = c->argv[0];
+      (void) pr_listcache_set_limits(*((unsigned int *) c->argv[1]),
+        *((size_t *) c->argv[2]));
+
+      if (pr_listcache_open(path) < 0) {
+        pr_log_pri(PR_LOG_NOTICE,
+          "notice: unable to use ListCache directory '%s': %s", path,
+          strerror(errno));
+      }
+
+      break;
+    }
+
+    c = find_config_next(c, c->next, CONF_PARAM, "ListCache", TRUE);
+  }
+
+  /* Similarly, the directory for the temporary files used when sorting
+   * streaming listings is opened now; the first ListStreaming which enables
+   * streaming sets the session's limits.
+   */
+  c = find_config(main_server->conf, CONF_PARAM, "ListStreaming", TRUE);
+  while (c != NULL) {
+    pr_signals_handle();
+
+    if (*((int *) c->argv[0]) == TRUE) {
+      const char *tmpdir;
+
+      ls_stream_max_mem = *((size_t *) c->argv[1]);
+      tmpdir = c->argv[2];
+
+#if defined(AT_FDCWD)
+      PRIVS_ROOT
+      ls_stream_tmpfd = open(tmpdir, O_RDONLY|O_DIRECTORY);
+      xerrno = errno;
+      PRIVS_RELINQUISH
+
+      if (ls_stream_tmpfd < 0) {
+        pr_log_pri(PR_LOG_NOTICE,
+          "notice: unable to use ListStreaming tmpdir '%s', sorting listings "
+          "in memory: %s", tmpdir, strerror(xerrno));
+
+      } else {
+        (void) fcntl(ls_stream_tmpfd, F_SETFD, FD_CLOEXEC);
+      }
+#endif /* AT_FDCWD */
+
+      break;
+    }
+
+    c = find_config_next(c, c->next, CONF_PARAM, "ListStreaming", TRUE);
+  }
+
+  return 0;
+}
+
 /* Module API tables
  */
 
@@ -3639,7 +4991,9 @@ static conftable ls_conftab[] = {
   { "DirFakeUser",	set_dirfakeusergroup,			NULL },
   { "DirFakeGroup",	set_dirfakeusergroup,			NULL },
   { "DirFakeMode",	set_dirfakemode,			NULL },
+  { "ListCache",	set_listcache,				NULL },
   { "ListOptions",	set_listoptions,			NULL },
+  { "ListStreaming",	set_liststreaming,			NULL },
   { "ShowSymlinks",	set_showsymlinks,			NULL },
   { "UseGlobbing",	set_useglobbing,			NULL },
   { NULL,		NULL,					NULL }
@@ -3679,5 +5033,5 @@ module ls_module = {
   ls_init,
 
   /* Session initialization */
-  NULL
+  ls_sess_init
 };
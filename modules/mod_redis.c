@@ -40,17 +40,47 @@
 #include <hiredis/hiredis.h>
 
 extern xaset_t *server_list;
+extern unsigned char is_master;
 
 module redis_module;
 
 #define REDIS_SERVER_DEFAULT_PORT		6379
 #define REDIS_SENTINEL_DEFAULT_PORT		26379
 
+#define REDIS_BROKER_DEFAULT_CONNECTIONS	1
+
+/* How long to wait, in seconds, for the broker process to stop. */
+#define REDIS_BROKER_STOP_TIMEOUT		5
+
+/* How long to wait, in seconds, between starts of the broker process, should
+ * it die.
+ */
+#define REDIS_BROKER_RESPAWN_INTERVAL		10
+
 static int redis_engine = FALSE;
 static int redis_logfd = -1;
 static unsigned long redis_opts = 0UL;
 static pool *redis_pool = NULL;
 
+/* The broker process, its socket path, and the server whose Redis
+ * configuration it uses.
+ */
+static pid_t redis_broker_pid = 0;
+static const char *redis_broker_path = NULL;
+static server_rec *redis_broker_server = NULL;
+
+/* The process which started the broker, i.e. which reaps and respawns it,
+ * and when.
+ */
+static unsigned int redis_broker_connections = REDIS_BROKER_DEFAULT_CONNECTIONS;
+static pid_t redis_broker_owner = 0;
+static time_t redis_broker_started = 0;
+
+/* Has the daemon started, i.e. should the broker be (re)started after the
+ * configuration is parsed?
+ */
+static int redis_daemon_started = FALSE;
+
 static int redis_sess_init(void);
 
 static pr_table_t *jot_logfmt2json = NULL;
@@ -365,9 +395,381 @@ static void log_events(cmd_rec *cmd) {
   }
 }
 
+/* Configures the Redis API, for new connections, using the Redis directives
+ * of the given server.
+ */
+static void redis_set_conn_config(server_rec *s) {
+  config_rec *c;
+
+  c = find_config(s->conf, CONF_PARAM, "RedisOptions", FALSE);
+  while (c != NULL) {
+    unsigned long opts = 0;
+
+    pr_signals_handle();
+
+    opts = *((unsigned long *) c->argv[0]);
+    redis_opts |= opts;
+
+    c = find_config_next(c, c->next, CONF_PARAM, "RedisOptions", FALSE);
+  }
+
+  c = find_config(s->conf, CONF_PARAM, "RedisSentinel", FALSE);
+  if (c != NULL) {
+    array_header *sentinels;
+    const char *master;
+
+    sentinels = c->argv[0];
+    master = c->argv[1];
+
+    (void) redis_set_sentinels(sentinels, master);
+  }
+
+  c = find_config(s->conf, CONF_PARAM, "RedisServer", FALSE);
+  if (c != NULL) {
+    const char *server, *password, *db_idx;
+    int port;
+
+    server = c->argv[0];
+    port = *((int *) c->argv[1]);
+    password = c->argv[2];
+    db_idx = c->argv[3];
+
+    (void) redis_set_server(server, port, redis_opts, password, db_idx);
+  }
+
+  c = find_config(s->conf, CONF_PARAM, "RedisTimeouts", FALSE);
+  if (c != NULL) {
+    unsigned long connect_millis, io_millis;
+
+    connect_millis = *((unsigned long *) c->argv[0]);
+    io_millis = *((unsigned long *) c->argv[1]);
+
+    if (redis_set_timeouts(connect_millis, io_millis) < 0) {
+      (void) pr_log_writefile(redis_logfd, MOD_REDIS_VERSION,
+        "error setting Redis timeouts: %s", strerror(errno));
+    }
+  }
+}
+
+/* Broker
+ */
+
+static int redis_strcmp(const char *a, const char *b) {
+  if (a == NULL ||
+      b == NULL) {
+    return (a == b ? 0 : -1);
+  }
+
+  return strcmp(a, b);
+}
+
+/* Sessions use the broker only if their Redis server configuration is that
+ * of the broker, i.e. of the "server config" context.
+ */
+static int redis_broker_usable(server_rec *s) {
+  config_rec *c, *broker_c;
+
+  if (s == redis_broker_server) {
+    return TRUE;
+  }
+
+  c = find_config(s->conf, CONF_PARAM, "RedisServer", FALSE);
+  broker_c = find_config(redis_broker_server->conf, CONF_PARAM, "RedisServer",
+    FALSE);
+  if (c == NULL ||
+      broker_c == NULL) {
+    if (c != broker_c) {
+      return FALSE;
+    }
+
+  } else if (redis_strcmp(c->argv[0], broker_c->argv[0]) != 0 ||
+             *((int *) c->argv[1]) != *((int *) broker_c->argv[1]) ||
+             redis_strcmp(c->argv[2], broker_c->argv[2]) != 0 ||
+             redis_strcmp(c->argv[3], broker_c->argv[3]) != 0) {
+    return FALSE;
+  }
+
+  c = find_config(s->conf, CONF_PARAM, "RedisSentinel", FALSE);
+  broker_c = find_config(redis_broker_server->conf, CONF_PARAM,
+    "RedisSentinel", FALSE);
+  if (c == NULL ||
+      broker_c == NULL) {
+    if (c != broker_c) {
+      return FALSE;
+    }
+
+  } else {
+    register unsigned int i;
+    array_header *sentinels, *broker_sentinels;
+    pr_netaddr_t **addrs, **broker_addrs;
+
+    sentinels = c->argv[0];
+    broker_sentinels = broker_c->argv[0];
+
+    if (sentinels->nelts != broker_sentinels->nelts ||
+        redis_strcmp(c->argv[1], broker_c->argv[1]) != 0) {
+      return FALSE;
+    }
+
+    addrs = sentinels->elts;
+    broker_addrs = broker_sentinels->elts;
+
+    for (i = 0; i < sentinels->nelts; i++) {
+      if (pr_netaddr_cmp(addrs[i], broker_addrs[i]) != 0 ||
+          pr_netaddr_get_port(addrs[i]) != pr_netaddr_get_port(broker_addrs[i])) {
+        return FALSE;
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+static int redis_broker_listen(const char *path) {
+  int fd, flags, xerrno;
+  struct sockaddr_un sock;
+
+  if (strlen(path) >= sizeof(sock.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (fd <= STDERR_FILENO) {
+    int res;
+
+    res = pr_fs_get_usable_fd(fd);
+    xerrno = errno;
+
+    (void) close(fd);
+    if (res < 0) {
+      errno = xerrno;
+      return -1;
+    }
+
+    fd = res;
+  }
+
+  (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  flags = fcntl(fd, F_GETFL);
+  (void) fcntl(fd, F_SETFL, flags|O_NONBLOCK);
+
+  /* Make sure the path to which we want to bind this socket doesn't already
+   * exist.
+   */
+  (void) unlink(path);
+
+  memset(&sock, 0, sizeof(sock));
+  sock.sun_family = AF_UNIX;
+  sstrncpy(sock.sun_path, path, sizeof(sock.sun_path));
+
+  if (bind(fd, (struct sockaddr *) &sock, sizeof(sock)) < 0) {
+    xerrno = errno;
+
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Only the sessions, running as the daemon User/Group before login, may
+   * use the broker; it is already authenticated to the Redis server.
+   */
+  if (chown(path, daemon_uid, daemon_gid) < 0 ||
+      chmod(path, 0600) < 0) {
+    xerrno = errno;
+
+    (void) close(fd);
+    (void) unlink(path);
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Allow for the burst of sessions connecting after a restart. */
+  if (listen(fd, SOMAXCONN) < 0) {
+    xerrno = errno;
+
+    (void) close(fd);
+    (void) unlink(path);
+    errno = xerrno;
+    return -1;
+  }
+
+  return fd;
+}
+
+static pid_t redis_broker_start(const char *path, unsigned int connections) {
+  pid_t broker_pid;
+  int fd, res, xerrno;
+
+  broker_pid = fork();
+  switch (broker_pid) {
+    case -1:
+      pr_log_pri(PR_LOG_ALERT,
+        MOD_REDIS_VERSION ": unable to fork: %s", strerror(errno));
+      return 0;
+
+    case 0:
+      /* We're the child. */
+      break;
+
+    default:
+      /* We're the parent. */
+      return broker_pid;
+  }
+
+  /* Reset the cached PID, so that it is correctly reflected in the logs. */
+  session.pid = getpid();
+
+  /* Make sure that we do not act as the daemon when terminated. */
+  is_master = FALSE;
+  (void) signal(SIGTERM, SIG_DFL);
+  (void) signal(SIGINT, SIG_DFL);
+  (void) signal(SIGALRM, SIG_IGN);
+  (void) signal(SIGHUP, SIG_IGN);
+  (void) signal(SIGUSR1, SIG_IGN);
+  (void) signal(SIGUSR2, SIG_IGN);
+
+  /* Remove our event listeners. */
+  pr_event_unregister(&redis_module, NULL, NULL);
+
+  pr_trace_msg(trace_channel, 3, "forked Redis broker PID %lu",
+    (unsigned long) session.pid);
+
+  PRIVS_ROOT
+  fd = redis_broker_listen(path);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (fd < 0) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_REDIS_VERSION
+      ": unable to listen on RedisBroker socket '%s': %s", path,
+      strerror(xerrno));
+    exit(1);
+  }
+
+  /* The broker runs with the identity of the configured daemon User/Group. */
+  session.uid = daemon_uid;
+  session.gid = daemon_gid;
+  PRIVS_REVOKE
+
+  pr_proctitle_set("(Redis broker)");
+  pr_log_debug(DEBUG2, MOD_REDIS_VERSION
+    ": Redis broker listening on '%s', using %u %s", path, connections,
+    connections != 1 ? "connections" : "connection");
+
+  redis_set_conn_config(main_server);
+
+  res = redis_broker_run(redis_pool, fd, connections);
+  xerrno = errno;
+
+  pr_log_pri(PR_LOG_NOTICE, MOD_REDIS_VERSION
+    ": Redis broker exiting: %s", res < 0 ? strerror(xerrno) : "done");
+  exit(res < 0 ? 1 : 0);
+}
+
+static void redis_broker_stop(void) {
+  int res = -1, status = 0;
+  pid_t broker_pid;
+  time_t start_time;
+
+  if (redis_broker_path == NULL) {
+    return;
+  }
+
+  /* The broker PID is cleared once the broker has been reaped, e.g. it died;
+   * there is then nothing to signal, but its socket may remain.
+   */
+  broker_pid = redis_broker_pid;
+  if (broker_pid != 0) {
+    pr_trace_msg(trace_channel, 3, "stopping Redis broker PID %lu",
+      (unsigned long) broker_pid);
+
+    PRIVS_ROOT
+    res = kill(broker_pid, SIGTERM);
+    PRIVS_RELINQUISH
+  }
+
+  if (res == 0) {
+    start_time = time(NULL);
+
+    res = waitpid(broker_pid, &status, WNOHANG);
+    while (res == 0 ||
+           (res < 0 && errno == EINTR)) {
+      pr_signals_handle();
+
+      if ((time(NULL) - start_time) > REDIS_BROKER_STOP_TIMEOUT) {
+        pr_log_pri(PR_LOG_NOTICE, MOD_REDIS_VERSION
+          ": Redis broker PID %lu took longer than %d secs to stop, "
+          "sending SIGKILL", (unsigned long) broker_pid,
+          REDIS_BROKER_STOP_TIMEOUT);
+
+        PRIVS_ROOT
+        (void) kill(broker_pid, SIGKILL);
+        PRIVS_RELINQUISH
+        break;
+      }
+
+      /* Poll every 100 millisecs. */
+      pr_timer_usleep(100 * 1000);
+      res = waitpid(broker_pid, &status, WNOHANG);
+    }
+  }
+
+  if (redis_broker_path != NULL) {
+    PRIVS_ROOT
+    (void) unlink(redis_broker_path);
+    PRIVS_RELINQUISH
+  }
+
+  redis_broker_pid = 0;
+  redis_broker_path = NULL;
+  redis_broker_server = NULL;
+  redis_broker_owner = 0;
+}
+
 /* Configuration handlers
  */
 
+/* usage: RedisBroker path [connections] */
+MODRET set_redisbroker(cmd_rec *cmd) {
+  config_rec *c;
+  unsigned int connections = REDIS_BROKER_DEFAULT_CONNECTIONS;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (pr_fs_valid_path(cmd->argv[1]) < 0) {
+    CONF_ERROR(cmd, "must be an absolute path");
+  }
+
+  if (cmd->argc == 3) {
+    char *ptr = NULL;
+
+    connections = (unsigned int) strtoul(cmd->argv[2], &ptr, 10);
+    if ((ptr && *ptr) ||
+        connections == 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool,
+        "badly formatted connections value: ", cmd->argv[2], NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+  c->argv[1] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = connections;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: RedisEngine on|off */
 MODRET set_redisengine(cmd_rec *cmd) {
   int engine = -1;
@@ -944,7 +1346,105 @@ MODRET redis_post_pass(cmd_rec *cmd) {
 /* Event handlers
  */
 
+static void redis_broker_init(void) {
+  config_rec *c;
+  const char *path;
+  unsigned int connections;
+
+  c = find_config(main_server->conf, CONF_PARAM, "RedisBroker", FALSE);
+  if (c == NULL) {
+    return;
+  }
+
+  if (ServerType == SERVER_INETD) {
+    pr_log_debug(DEBUG0, MOD_REDIS_VERSION
+      ": cannot support RedisBroker for ServerType inetd, ignoring");
+    return;
+  }
+
+  path = pstrdup(redis_pool, c->argv[0]);
+  connections = *((unsigned int *) c->argv[1]);
+
+  c = find_config(main_server->conf, CONF_PARAM, "RedisEngine", FALSE);
+  if (c == NULL ||
+      *((int *) c->argv[0]) == FALSE) {
+    pr_log_debug(DEBUG0, MOD_REDIS_VERSION
+      ": RedisEngine not enabled, ignoring RedisBroker");
+    return;
+  }
+
+  redis_broker_started = time(NULL);
+  redis_broker_pid = redis_broker_start(path, connections);
+  if (redis_broker_pid == 0) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_REDIS_VERSION
+      ": failed to start Redis broker, sessions will connect to Redis directly");
+    return;
+  }
+
+  redis_broker_path = path;
+  redis_broker_server = main_server;
+  redis_broker_connections = connections;
+  redis_broker_owner = getpid();
+}
+
+static void redis_chld_ev(const void *event_data, void *user_data) {
+  pid_t pid;
+
+  /* Note that we are called with SIGCHLD blocked; only note that the broker
+   * is gone here, and respawn it before the next session is forked.
+   */
+  pid = *((pid_t *) event_data);
+  if (redis_broker_pid != 0 &&
+      pid == redis_broker_pid) {
+    redis_broker_pid = 0;
+  }
+}
+
+static void redis_postparse_ev(const void *event_data, void *user_data) {
+  /* On startup, the broker is started once the daemon has started, rather
+   * than here; this is only for restarts.
+   */
+  if (redis_daemon_started == TRUE) {
+    redis_broker_init();
+  }
+}
+
+static void redis_prefork_ev(const void *event_data, void *user_data) {
+  time_t now;
+
+  /* Only the process which started the broker, and reaped it, respawns it;
+   * not e.g. any AcceptorProcesses.
+   */
+  if (redis_broker_path == NULL ||
+      redis_broker_pid != 0 ||
+      redis_broker_owner != getpid()) {
+    return;
+  }
+
+  /* Do not respawn a broker which keeps dying in a tight loop; until it is
+   * respawned, sessions connect to Redis directly.
+   */
+  now = time(NULL);
+  if ((now - redis_broker_started) < REDIS_BROKER_RESPAWN_INTERVAL) {
+    return;
+  }
+
+  pr_log_pri(PR_LOG_NOTICE, MOD_REDIS_VERSION
+    ": Redis broker exited, restarting it");
+
+  redis_broker_started = now;
+  redis_broker_pid = redis_broker_start(redis_broker_path,
+    redis_broker_connections);
+  if (redis_broker_pid == 0) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_REDIS_VERSION
+      ": failed to restart Redis broker, sessions will connect to Redis "
+      "directly");
+  }
+}
+
 static void redis_restart_ev(const void *event_data, void *user_data) {
+  redis_broker_stop();
+
   destroy_pool(redis_pool);
   redis_pool = make_sub_pool(permanent_pool);
   pr_pool_tag(redis_pool, MOD_REDIS_VERSION);
@@ -974,10 +1474,17 @@ static void redis_sess_reinit_ev(const void *event_data, void *user_data) {
 }
 
 static void redis_shutdown_ev(const void *event_data, void *user_data) {
+  redis_broker_stop();
+
   destroy_pool(redis_pool);
   jot_logfmt2json = NULL;
 }
 
+static void redis_startup_ev(const void *event_data, void *user_data) {
+  redis_daemon_started = TRUE;
+  redis_broker_init();
+}
+
 /* Initialization functions
  */
 
@@ -986,8 +1493,13 @@ static int redis_module_init(void) {
   pr_pool_tag(redis_pool, MOD_REDIS_VERSION);
 
   redis_init();
+  pr_event_register(&redis_module, "core.postparse", redis_postparse_ev,
+    NULL);
+  pr_event_register(&redis_module, "core.pre-fork", redis_prefork_ev, NULL);
   pr_event_register(&redis_module, "core.restart", redis_restart_ev, NULL);
   pr_event_register(&redis_module, "core.shutdown", redis_shutdown_ev, NULL);
+  pr_event_register(&redis_module, "core.signal.CHLD", redis_chld_ev, NULL);
+  pr_event_register(&redis_module, "core.startup", redis_startup_ev, NULL);
 
   pr_log_debug(DEBUG2, MOD_REDIS_VERSION ": using hiredis-%d.%d.%d",
     HIREDIS_MAJOR, HIREDIS_MINOR, HIREDIS_PATCH);
@@ -1058,53 +1570,17 @@ static int redis_sess_init(void) {
     }
   }
 
-  c = find_config(main_server->conf, CONF_PARAM, "RedisOptions", FALSE);
-  while (c != NULL) {
-    unsigned long opts = 0;
-
-    pr_signals_handle();
-
-    opts = *((unsigned long *) c->argv[0]);
-    redis_opts |= opts;
+  redis_set_conn_config(main_server);
 
-    c = find_config_next(c, c->next, CONF_PARAM, "RedisOptions", FALSE);
-  }
-
-  c = find_config(main_server->conf, CONF_PARAM, "RedisSentinel", FALSE);
-  if (c != NULL) {
-    array_header *sentinels;
-    const char *master;
-
-    sentinels = c->argv[0];
-    master = c->argv[1];
-
-    (void) redis_set_sentinels(sentinels, master);
-  }
-
-  c = find_config(main_server->conf, CONF_PARAM, "RedisServer", FALSE);
-  if (c != NULL) {
-    const char *server, *password, *db_idx;
-    int port;
-
-    server = c->argv[0];
-    port = *((int *) c->argv[1]);
-    password = c->argv[2];
-    db_idx = c->argv[3];
-
-    (void) redis_set_server(server, port, redis_opts, password, db_idx);
-  }
-
-  c = find_config(main_server->conf, CONF_PARAM, "RedisTimeouts", FALSE);
-  if (c != NULL) {
-    unsigned long connect_millis, io_millis;
-
-    connect_millis = *((unsigned long *) c->argv[0]);
-    io_millis = *((unsigned long *) c->argv[1]);
-
-    if (redis_set_timeouts(connect_millis, io_millis) < 0) {
-      (void) pr_log_writefile(redis_logfd, MOD_REDIS_VERSION,
-        "error setting Redis timeouts: %s", strerror(errno));
-    }
+  /* Use the broker, if it is running, and this session's Redis server is the
+   * broker's.
+   */
+  (void) redis_set_broker(NULL);
+  if (redis_broker_pid != 0 &&
+      redis_broker_usable(main_server) == TRUE) {
+    pr_trace_msg(trace_channel, 9, "using Redis broker at '%s'",
+      redis_broker_path);
+    (void) redis_set_broker(redis_broker_path);
   }
 
   return 0;
@@ -1114,6 +1590,7 @@ static int redis_sess_init(void) {
  */
 
 static conftable redis_conftab[] = {
+  { "RedisBroker",		set_redisbroker,	NULL },
   { "RedisEngine",		set_redisengine,	NULL },
   { "RedisLog",			set_redislog,		NULL },
   { "RedisLogOnCommand",	set_redislogoncommand,	NULL },
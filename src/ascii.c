@@ -26,11 +26,20 @@
 
 #include "conf.h"
 
+/* Buffer into which pr_ascii_ftp_to_crlf() writes its output; it is reused
+ * across calls, rather than allocating a new buffer for each chunk of data
+ * transferred.
+ */
+static char *ascii_buf = NULL;
+static size_t ascii_bufsz = 0;
+
+static int have_dangling_cr = FALSE;
+
 int pr_ascii_ftp_from_crlf(pool *p, char *in, size_t inlen, char **out,
     size_t *outlen) {
-  char *src, *dst;
-  size_t rem;
-  int adj;
+  char *src, *dst, *end;
+  size_t len = 0;
+  int adj = 0;
 
   (void) p;
 
@@ -47,47 +56,66 @@ int pr_ascii_ftp_from_crlf(pool *p, char *in, size_t inlen, char **out,
   }
 
   src = in;
-  rem = inlen;
+  end = in + inlen;
   dst = *out;
-  adj = 0;
 
-  while (rem--) {
-    if (*src != '\r') {
+  /* Note that the output buffer may be the input buffer, hence the use of
+   * memmove(3).  The runs of text between CRs are found using memchr(3),
+   * which is typically much faster than checking each byte here.
+   */
+  while (src < end) {
+    char *cr;
+    size_t run_len;
+
+    cr = memchr(src, '\r', end - src);
+    if (cr == NULL) {
+      cr = end;
+    }
+
+    run_len = cr - src;
+    if (run_len > 0) {
+      if (dst != src) {
+        memmove(dst, src, run_len);
+      }
+
+      dst += run_len;
+      src += run_len;
+      len += run_len;
+    }
+
+    if (src == end) {
+      break;
+    }
+
+    if (src + 1 == end) {
+      /* Copy the trailing CR, but save it for later. */
       *dst++ = *src++;
-      (*outlen)++;
+      adj++;
+      break;
+    }
+
+    if (*(src + 1) == '\n') {
+      /* Skip the CR. */
+      src++;
 
     } else {
-      if (rem == 0) {
-        /* copy, but save it for later */
-        adj++;
-        *dst++ = *src++;
-
-      } else {
-        if (*(src+1) == '\n') {
-          /* Skip the CR. */
-          src++;
-
-        } else {
-          *dst++ = *src++;
-          (*outlen)++;
-        }
-      }
+      *dst++ = *src++;
+      len++;
     }
   }
 
+  *outlen += len;
   return adj;
 }
 
-static int have_dangling_cr = FALSE;
-
 /* This function rewrites the contents of the given buffer, making sure that
  * each LF has a preceding CR, as required by RFC959.
  */
 int pr_ascii_ftp_to_crlf(pool *p, char *in, size_t inlen, char **out,
     size_t *outlen) {
-  register unsigned int i = 0, j = 0;
-  char *dst = NULL, *src;
-  size_t src_len, lf_pos;
+  char *src, *dst, *end, *lf;
+  size_t bufsz;
+  int prev_cr;
 
   if (p == NULL ||
       in == NULL ||
@@ -103,32 +131,29 @@ int pr_ascii_ftp_to_crlf(pool *p, char *in, size_t inlen, char **out,
   }
 
   src = in;
-  src_len = lf_pos = inlen;
+  end = in + inlen;
 
-  /* First, determine the position of the first bare LF. */
-  if (have_dangling_cr == FALSE &&
-      src[0] == '\n') {
-    lf_pos = 0;
-    goto found_lf;
-  }
-
-  for (i = 1; i < src_len; i++) {
-    if (src[i] == '\n' &&
-        src[i-1] != '\r') {
-      lf_pos = i;
+  /* First, find the first bare LF, if any.  An LF at the start of the
+   * buffer is not bare if the previous buffer ended with a CR.
+   */
+  prev_cr = have_dangling_cr;
+  lf = memchr(src, '\n', inlen);
+  while (lf != NULL) {
+    if (lf == src ? prev_cr == FALSE : *(lf - 1) != '\r') {
       break;
     }
+
+    lf = memchr(lf + 1, '\n', end - (lf + 1));
   }
 
-found_lf:
   /* If the last character in the buffer is CR, then we have a dangling CR.
    * The first character in the next buffer could be an LF, and without
    * this flag, that LF would be treated as a bare LF, thus resulting in
    * an added extraneous CR in the stream.
    */
-  have_dangling_cr = (src[src_len-1] == '\r') ? TRUE : FALSE;
+  have_dangling_cr = (*(end - 1) == '\r') ? TRUE : FALSE;
 
-  if (lf_pos == src_len) {
+  if (lf == NULL) {
     /* No translation needed. */
     *out = in;
     *outlen = inlen;
@@ -138,41 +163,54 @@ found_lf:
   /* Assume the worst: a block containing only LF characters, needing twice
    * the size for holding the corresponding CRs.
    */
-  dst = malloc(src_len * 2);
-  if (dst == NULL) {
-    pr_log_pri(PR_LOG_ALERT, "Out of memory!");
-    exit(1);
+  bufsz = inlen * 2;
+  if (bufsz > ascii_bufsz) {
+    char *ptr;
+
+    ptr = realloc(ascii_buf, bufsz);
+    if (ptr == NULL) {
+      pr_log_pri(PR_LOG_ALERT, "Out of memory!");
+      exit(1);
+    }
+
+    ascii_buf = ptr;
+    ascii_bufsz = bufsz;
   }
 
-  if (lf_pos > 0) {
-    memcpy(dst, src, lf_pos);
-    i = j = lf_pos;
+  dst = ascii_buf;
 
-  } else {
-    dst[0] = '\r';
-    dst[1] = '\n';
-    i = 2;
-    j = 1;
-  }
+  /* Copy everything up to each bare LF, then insert the CR. */
+  while (lf != NULL) {
+    size_t run_len;
+
+    run_len = lf - src;
+    if (run_len > 0) {
+      memcpy(dst, src, run_len);
+      dst += run_len;
+      src += run_len;
+    }
 
-  while (j < src_len) {
-    if (src[j] == '\n' &&
-        src[j-1] != '\r') {
-      dst[i++] = '\r';
+    *dst++ = '\r';
+    *dst++ = *src++;
+
+    lf = memchr(src, '\n', end - src);
+    while (lf != NULL &&
+           *(lf - 1) == '\r') {
+      lf = memchr(lf + 1, '\n', end - (lf + 1));
     }
+  }
 
-    dst[i++] = src[j++];
+  if (src < end) {
+    memcpy(dst, src, end - src);
+    dst += (end - src);
   }
-  pr_signals_handle();
 
-  *outlen = i;
-  *out = pcalloc(p, *outlen);
-  memcpy(*out, dst, i);
+  pr_signals_handle();
 
-  free(dst);
-  dst = NULL;
+  *out = ascii_buf;
+  *outlen = dst - ascii_buf;
 
-  return i - j;
+  return (int) (*outlen - inlen);
 }
 
 void pr_ascii_ftp_reset(void) {
@@ -437,6 +437,7 @@ static cmd_rec *make_cmd(pool *cp, unsigned int argc, ...) {
 static modret_t *dispatch_auth(cmd_rec *cmd, char *match, module **m) {
   authtable *start_tab = NULL, *iter_tab = NULL;
   modret_t *mr = NULL;
+  uint64_t start_usecs = 0;
 
   start_tab = pr_stash_get_symbol2(PR_SYM_AUTH, match, NULL,
     &cmd->stash_index, &cmd->stash_hash);
@@ -450,6 +451,13 @@ static modret_t *dispatch_auth(cmd_rec *cmd, char *match, module **m) {
 
   iter_tab = start_tab;
 
+  /* Only password authentication, which may involve remote backends (e.g.
+   * LDAP, RADIUS, SQL servers), is timed.
+   */
+  if (strcmp(match, "auth") == 0) {
+    start_usecs = pr_metrics_now();
+  }
+
   while (iter_tab) {
     pr_signals_handle();
 
@@ -504,6 +512,7 @@ static modret_t *dispatch_auth(cmd_rec *cmd, char *match, module **m) {
     }
   }
 
+  pr_metrics_observe(PR_METRICS_ID_AUTH, start_usecs);
   return mr;
 }
 
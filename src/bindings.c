@@ -1162,6 +1162,21 @@ void free_bindings(void) {
   }
 }
 
+/* Close all of the listening conns, including those normally kept open
+ * across restarts.  Used by acceptor processes (see AcceptorProcesses),
+ * which need their own listening sockets, rather than sharing those (and
+ * their accept queues) of the daemon which forked them.
+ */
+void free_listening_conns(void) {
+  free_bindings();
+
+  if (listening_conn_pool != NULL) {
+    destroy_pool(listening_conn_pool);
+    listening_conn_pool = NULL;
+    listening_conn_list = NULL;
+  }
+}
+
 static int init_inetd_bindings(void) {
   int res = 0;
   server_rec *serv = NULL;
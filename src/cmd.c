@@ -425,6 +425,16 @@ int pr_cmd_get_id(const char *cmd_name) {
   return -1;
 }
 
+const char *pr_cmd_get_name(int cmd_id) {
+  if (cmd_id <= 0 ||
+      cmd_id > PR_CMD_MAX_ID) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  return cmd_ids[cmd_id].cmd_name;
+}
+
 static int is_known_cmd(struct cmd_entry *known_cmds, const char *cmd_name,
     size_t cmd_namelen) {
   register unsigned int i;
@@ -0,0 +1,343 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* CRC32: slice-by-8 tables, and carry-less multiplication (PCLMULQDQ)
+ * folding on x86-64 CPUs which support it.
+ */
+
+#include "conf.h"
+#include "crc32.h"
+
+/* The PCLMULQDQ engine needs compiler support for per-function target
+ * options, so that the rest of the code does not require those instructions.
+ */
+#if defined(__x86_64__) && \
+    defined(__GNUC__) && \
+    (defined(__clang__) || __GNUC__ >= 5)
+# define PR_CRC32_HAVE_PCLMUL
+# include <cpuid.h>
+# include <emmintrin.h>
+# include <smmintrin.h>
+# include <wmmintrin.h>
+#endif
+
+/* The reflected form of the polynomial used by CRC32 in PKZip. */
+#define CRC32_POLY		0xedb88320
+
+/* The PCLMULQDQ engine folds 64 bytes at a time. */
+#define CRC32_PCLMUL_MIN_LEN	64
+
+static uint32_t crc32_tables[8][256];
+static int crc32_initialized = FALSE;
+static int crc32_engine = 0;
+
+static void crc32_init_tables(void) {
+  register unsigned int i, j;
+
+  for (i = 0; i < 256; i++) {
+    uint32_t crc;
+
+    crc = i;
+    for (j = 8; j > 0; j--) {
+      if (crc & 1) {
+        crc = (crc >> 1) ^ CRC32_POLY;
+
+      } else {
+        crc >>= 1;
+      }
+    }
+
+    crc32_tables[0][i] = crc;
+  }
+
+  /* Table N holds the CRC of each byte value followed by N zero bytes. */
+  for (i = 0; i < 256; i++) {
+    for (j = 1; j < 8; j++) {
+      uint32_t crc;
+
+      crc = crc32_tables[j-1][i];
+      crc32_tables[j][i] = (crc >> 8) ^ crc32_tables[0][crc & 0xff];
+    }
+  }
+}
+
+/* Note that the given and returned CRCs are the unfinalized (inverted)
+ * values.
+ */
+static uint32_t crc32_slice8(uint32_t crc, const unsigned char *data,
+    size_t datasz) {
+
+  /* Handle any leading bytes one at a time, until the data is aligned. */
+  while (datasz > 0 &&
+         ((unsigned long) data & 7) != 0) {
+    crc = crc32_tables[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    datasz--;
+  }
+
+  while (datasz >= 8) {
+    uint32_t one, two;
+
+    /* Assembling the words from bytes keeps this independent of the
+     * host byte order; compilers turn this into single loads.
+     */
+    one = crc ^ ((uint32_t) data[0] |
+      ((uint32_t) data[1] << 8) |
+      ((uint32_t) data[2] << 16) |
+      ((uint32_t) data[3] << 24));
+    two = (uint32_t) data[4] |
+      ((uint32_t) data[5] << 8) |
+      ((uint32_t) data[6] << 16) |
+      ((uint32_t) data[7] << 24);
+
+    crc = crc32_tables[7][one & 0xff] ^
+      crc32_tables[6][(one >> 8) & 0xff] ^
+      crc32_tables[5][(one >> 16) & 0xff] ^
+      crc32_tables[4][one >> 24] ^
+      crc32_tables[3][two & 0xff] ^
+      crc32_tables[2][(two >> 8) & 0xff] ^
+      crc32_tables[1][(two >> 16) & 0xff] ^
+      crc32_tables[0][two >> 24];
+
+    data += 8;
+    datasz -= 8;
+  }
+
+  while (datasz > 0) {
+    crc = crc32_tables[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    datasz--;
+  }
+
+  return crc;
+}
+
+#ifdef PR_CRC32_HAVE_PCLMUL
+static int crc32_have_pclmul(void) {
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+    return FALSE;
+  }
+
+  /* PCLMULQDQ is ECX bit 1, SSE4.1 is ECX bit 19. */
+  if ((ecx & (1 << 1)) &&
+      (ecx & (1 << 19))) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Folds the data, 64 bytes at a time, using carry-less multiplication, then
+ * reduces the result to 32 bits.  This follows Intel's "Fast CRC Computation
+ * for Generic Polynomials Using PCLMULQDQ Instruction" paper.  The data
+ * length MUST be at least 64 bytes, and a multiple of 16 bytes.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *data,
+    size_t datasz) {
+  static const uint64_t k1k2[2] __attribute__((aligned(16))) = {
+    0x0154442bd4ULL, 0x01c6e41596ULL
+  };
+  static const uint64_t k3k4[2] __attribute__((aligned(16))) = {
+    0x01751997d0ULL, 0x00ccaa009eULL
+  };
+  static const uint64_t k5k0[2] __attribute__((aligned(16))) = {
+    0x0163cd6124ULL, 0x0000000000ULL
+  };
+  static const uint64_t poly[2] __attribute__((aligned(16))) = {
+    0x01db710641ULL, 0x01f7011641ULL
+  };
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  x1 = _mm_loadu_si128((const __m128i *) (data + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *) (data + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *) (data + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *) (data + 0x30));
+
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  x0 = _mm_load_si128((const __m128i *) k1k2);
+
+  data += 64;
+  datasz -= 64;
+
+  /* Fold four 128-bit lanes in parallel, 64 bytes at a time. */
+  while (datasz >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+    y5 = _mm_loadu_si128((const __m128i *) (data + 0x00));
+    y6 = _mm_loadu_si128((const __m128i *) (data + 0x10));
+    y7 = _mm_loadu_si128((const __m128i *) (data + 0x20));
+    y8 = _mm_loadu_si128((const __m128i *) (data + 0x30));
+
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+    data += 64;
+    datasz -= 64;
+  }
+
+  /* Fold the four lanes into one. */
+  x0 = _mm_load_si128((const __m128i *) k3k4);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* Fold any remaining 16 byte blocks. */
+  while (datasz >= 16) {
+    x2 = _mm_loadu_si128((const __m128i *) data);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    data += 16;
+    datasz -= 16;
+  }
+
+  /* Fold 128 bits down to 64 bits. */
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x0 = _mm_loadl_epi64((const __m128i *) k5k0);
+
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits. */
+  x0 = _mm_load_si128((const __m128i *) poly);
+
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return (uint32_t) _mm_extract_epi32(x1, 1);
+}
+#endif /* PR_CRC32_HAVE_PCLMUL */
+
+static void crc32_init(void) {
+  crc32_init_tables();
+
+  crc32_engine = PR_CRC32_ENGINE_SLICE8;
+#ifdef PR_CRC32_HAVE_PCLMUL
+  if (crc32_have_pclmul() == TRUE) {
+    crc32_engine = PR_CRC32_ENGINE_PCLMUL;
+  }
+#endif /* PR_CRC32_HAVE_PCLMUL */
+
+  crc32_initialized = TRUE;
+}
+
+uint32_t pr_crc32(uint32_t crc, const void *data, size_t datasz) {
+  const unsigned char *ptr;
+
+  if (data == NULL ||
+      datasz == 0) {
+    return crc;
+  }
+
+  if (crc32_initialized == FALSE) {
+    crc32_init();
+  }
+
+  ptr = data;
+  crc = ~crc;
+
+#ifdef PR_CRC32_HAVE_PCLMUL
+  if (crc32_engine == PR_CRC32_ENGINE_PCLMUL &&
+      datasz >= CRC32_PCLMUL_MIN_LEN) {
+    size_t len;
+
+    len = datasz & ~((size_t) 15);
+    crc = crc32_pclmul(crc, ptr, len);
+
+    ptr += len;
+    datasz -= len;
+  }
+#endif /* PR_CRC32_HAVE_PCLMUL */
+
+  crc = crc32_slice8(crc, ptr, datasz);
+  return ~crc;
+}
+
+int pr_crc32_get_engine(void) {
+  if (crc32_initialized == FALSE) {
+    crc32_init();
+  }
+
+  return crc32_engine;
+}
+
+int pr_crc32_set_engine(int engine) {
+  if (crc32_initialized == FALSE) {
+    crc32_init();
+  }
+
+  switch (engine) {
+    case PR_CRC32_ENGINE_SLICE8:
+      crc32_engine = engine;
+      return 0;
+
+    case PR_CRC32_ENGINE_PCLMUL:
+#ifdef PR_CRC32_HAVE_PCLMUL
+      if (crc32_have_pclmul() == TRUE) {
+        crc32_engine = engine;
+        return 0;
+      }
+#endif /* PR_CRC32_HAVE_PCLMUL */
+
+      errno = ENOSYS;
+      return -1;
+
+    default:
+      break;
+  }
+
+  errno = EINVAL;
+  return -1;
+}
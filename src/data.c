@@ -547,6 +547,11 @@ int pr_data_open(char *filename, char *reason, int direction, off_t size) {
     }
   }
 
+  /* Any coalesced responses must reach the client before we wait for the
+   * data connection.
+   */
+  (void) pr_netio_uncork(session.c->outstrm);
+
   /* Make sure that any abort flags have been cleared. */
   session.sf_flags &= ~(SF_ABORT|SF_POST_ABORT);
 
@@ -656,6 +661,19 @@ int pr_data_open(char *filename, char *reason, int direction, off_t size) {
 void pr_data_close(int quiet) {
   nstrm = NULL;
 
+  if (pr_metrics_enabled() == TRUE &&
+      session.xfer.start_time.tv_sec != 0) {
+    uint64_t start_usecs;
+
+    start_usecs = ((uint64_t) session.xfer.start_time.tv_sec * 1000000) +
+      session.xfer.start_time.tv_usec;
+    pr_metrics_observe(PR_METRICS_ID_DATA_XFER, start_usecs);
+
+    pr_metrics_incr(session.xfer.direction == PR_NETIO_IO_RD ?
+      PR_METRICS_COUNTER_BYTES_IN : PR_METRICS_COUNTER_BYTES_OUT,
+      (uint64_t) session.xfer.total_bytes);
+  }
+
   if (session.d) {
     pr_inet_lingering_close(session.pool, session.d, timeout_linger);
     session.d = NULL;
@@ -1081,7 +1099,6 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
   int len = 0;
   int total = 0;
   int res = 0;
-  pool *tmp_pool = NULL;
 
   if (cl_buf == NULL ||
       cl_size == 0) {
@@ -1156,7 +1173,6 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
             continue;
           }
 
-          destroy_pool(tmp_pool);
           errno = xerrno;
           return -1;
         }
@@ -1208,14 +1224,11 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
               buflen > 1) {
             size_t outlen = 0;
 
-            /* Use a temporary pool for the CRLF conversion, lest the
-             * session.xfer.p pool grow quite large while downloading a large
-             * file for ASCII conversion (Bug#4277).
+            /* Note that the conversion is done in place, and thus does not
+             * allocate any memory.
              */
-            tmp_pool = make_sub_pool(session.xfer.p);
-            pr_pool_tag(tmp_pool, "ASCII download");
-
-            res = pr_ascii_ftp_from_crlf(tmp_pool, buf, buflen, &buf, &outlen);
+            res = pr_ascii_ftp_from_crlf(session.xfer.p, buf, buflen, &buf,
+              &outlen);
             if (res < 0) {
               pr_trace_msg(trace_channel, 3, "error reading ASCII data: %s",
                 strerror(errno));
@@ -1317,6 +1330,7 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
       int bwrote = 0;
       int buflen = cl_size;
       unsigned int xferbuflen;
+      char *xferbuf;
 
       pr_signals_handle();
 
@@ -1328,6 +1342,7 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
 
       /* Fill up our internal buffer. */
       memcpy(session.xfer.buf, cl_buf, buflen);
+      xferbuf = session.xfer.buf;
 
       /* We use ASCII translation if:
        *
@@ -1340,31 +1355,26 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
         char *out = NULL;
         size_t outlen = 0;
 
-        /* Use a temporary pool for the CRLF conversion, lest the
-         * session.xfer.p pool grow quite large while downloading a large
-         * file for ASCII conversion (Bug#4277).
-         */
-        tmp_pool = make_sub_pool(session.xfer.p);
-        pr_pool_tag(tmp_pool, "ASCII upload");
-
         /* Scan the internal buffer, looking for LFs with no preceding CRs.
-         * Add CRs (and expand the internal buffer) as necessary. xferbuflen
-         * will be adjusted so that it contains the length of data in
-         * the internal buffer, including any added CRs.
+         * Any needed CRs are added in a separate buffer, reused by the
+         * ASCII API across calls; xferbuflen will be adjusted so that it
+         * contains the length of the converted data, including any added CRs.
+         * Since no memory is allocated per call, the session.xfer.p pool does
+         * not grow while downloading a large file in ASCII mode (Bug#4277).
          */
-        res = pr_ascii_ftp_to_crlf(tmp_pool, session.xfer.buf, xferbuflen,
-          &out, &outlen);
+        res = pr_ascii_ftp_to_crlf(session.xfer.p, session.xfer.buf,
+          xferbuflen, &out, &outlen);
         if (res < 0) {
           pr_trace_msg(trace_channel, 1, "error writing ASCII data: %s",
             strerror(errno));
 
         } else {
-          session.xfer.buf = out;
+          xferbuf = out;
           session.xfer.buflen = xferbuflen = outlen;
         }
       }
 
-      bwrote = pr_netio_write(session.d->outstrm, session.xfer.buf, xferbuflen);
+      bwrote = pr_netio_write(session.d->outstrm, xferbuf, xferbuflen);
       while (bwrote < 0) {
         int xerrno = errno;
 
@@ -1376,12 +1386,10 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
           errno = EINTR;
           pr_signals_handle();
              
-          bwrote = pr_netio_write(session.d->outstrm, session.xfer.buf,
-            xferbuflen);
+          bwrote = pr_netio_write(session.d->outstrm, xferbuf, xferbuflen);
           continue;
         }
 
-        destroy_pool(tmp_pool);
         errno = xerrno;
         return -1;
       }
@@ -1432,7 +1440,6 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
     session.total_bytes_out += total;
   }
 
-  destroy_pool(tmp_pool);
   return (len < 0 ? -1 : len);
 }
 
@@ -26,11 +26,6 @@
 
 #include "conf.h"
 
-/* Note: as more events are added, and as this API grows more and more used
- * by the core code, look into using a different ADT for storage/retrieval
- * of these objects, such as hash tables.
- */
-
 struct event_handler {
   struct event_handler *next, *prev;
   module *module;
@@ -41,16 +36,30 @@ struct event_handler {
 
 struct event_list {
   struct event_list *next;
+
+  /* Next list in the same event_table bucket. */
+  struct event_list *bucket_next;
+
   pool *pool;
   const char *event;
   size_t event_len;
+  unsigned int hash;
+  int id;
+  unsigned int nhandlers;
   struct event_handler *handlers;
 };
 
 static pool *event_pool = NULL;
 static struct event_list *events = NULL;
 
-static const char *curr_event = NULL;
+/* Event lists, hashed by event name, and indexed by event ID.  Event lists
+ * are never freed (unregistering only removes handlers), thus event IDs
+ * remain valid for the life of the process.
+ */
+#define EVENT_TABLE_SIZE	128
+static struct event_list *event_table[EVENT_TABLE_SIZE];
+static array_header *event_ids = NULL;
+
 static struct event_list *curr_evl = NULL;
 static struct event_handler *curr_evh = NULL;
 
@@ -73,12 +82,103 @@ static const char *trace_channel = "event";
 
 #define EVENT_POOL_SZ	256
 
+static unsigned int event_hash(const char *event, size_t event_len) {
+  register unsigned int i;
+  unsigned int h = 0;
+
+  for (i = 0; i < event_len; i++) {
+    h = (h * 33) + (unsigned char) event[i];
+  }
+
+  return h;
+}
+
+static struct event_list *event_lookup(const char *event, size_t event_len,
+    unsigned int hash) {
+  struct event_list *evl;
+
+  for (evl = event_table[hash % EVENT_TABLE_SIZE]; evl;
+      evl = evl->bucket_next) {
+    if (evl->hash == hash &&
+        evl->event_len == event_len &&
+        memcmp(evl->event, event, event_len) == 0) {
+      return evl;
+    }
+  }
+
+  return NULL;
+}
+
+static struct event_list *event_get(const char *event) {
+  size_t event_len;
+
+  if (events == NULL) {
+    return NULL;
+  }
+
+  event_len = strlen(event);
+  return event_lookup(event, event_len, event_hash(event, event_len));
+}
+
+/* Returns the list for the given event, creating it if necessary. */
+static struct event_list *event_create(const char *event) {
+  struct event_list *evl;
+  pool *evl_pool;
+  size_t event_len;
+  unsigned int hash;
+
+  event_len = strlen(event);
+  hash = event_hash(event, event_len);
+
+  evl = event_lookup(event, event_len, hash);
+  if (evl != NULL) {
+    return evl;
+  }
+
+  if (event_pool == NULL) {
+    event_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(event_pool, "Event Pool");
+  }
+
+  if (event_ids == NULL) {
+    event_ids = make_array(event_pool, 32, sizeof(struct event_list *));
+  }
+
+  evl_pool = pr_pool_create_sz(event_pool, EVENT_POOL_SZ);
+  pr_pool_tag(evl_pool, "Event listener list pool");
+
+  evl = pcalloc(evl_pool, sizeof(struct event_list));
+  evl->pool = evl_pool;
+  evl->event = pstrdup(evl->pool, event);
+  evl->event_len = event_len;
+  evl->hash = hash;
+  evl->id = event_ids->nelts;
+  *((struct event_list **) push_array(event_ids)) = evl;
+
+  evl->bucket_next = event_table[hash % EVENT_TABLE_SIZE];
+  event_table[hash % EVENT_TABLE_SIZE] = evl;
+
+  evl->next = events;
+  events = evl;
+
+  return evl;
+}
+
+static struct event_list *event_get_by_id(int event_id) {
+  if (event_ids == NULL ||
+      event_id < 0 ||
+      event_id >= (int) event_ids->nelts) {
+    return NULL;
+  }
+
+  return ((struct event_list **) event_ids->elts)[event_id];
+}
+
 int pr_event_register(module *m, const char *event,
     void (*cb)(const void *, void *), void *user_data) {
   register unsigned int i;
-  struct event_handler *evh;
+  struct event_handler *evh, *evhi;
   struct event_list *evl;
-  pool *evl_pool;
   unsigned long flags = 0;
 
   if (event == NULL ||
@@ -112,82 +212,57 @@ int pr_event_register(module *m, const char *event,
 
   evh->flags = flags;
 
-  /* Scan the currently registered lists, looking for where to add this
-   * registration.
-   */
-
-  for (evl = events; evl; evl = evl->next) {
-    if (strncmp(evl->event, event, evl->event_len + 1) == 0) {
-      struct event_handler *evhi, *evhl = NULL;
-
-      evhi = evl->handlers;
-      if (evhi) {
-        /* Make sure this event handler is added to the START of the list,
-         * in order to preserve module load order handling of events (i.e.
-         * last module loaded, first module handled).  The exception to this
-         * rule are core callbacks (i.e. where m == NULL); these will always
-         * be invoked last.
-         *
-         * Before that, though, check for duplicate registration/subscription.
-         */ 
-        while (evhi) {
-          pr_signals_handle();
-
-          if (evhi->cb == evh->cb) {
-            /* Duplicate callback */
-            errno = EEXIST;
-            return -1;
-          }
-
-          evhl = evhi;
-
-          if (evhi->next == NULL) {
-            break;
-          }
-
-          evhi = evhi->next;
-        }
-
-        if (evh->module != NULL) {
-          if (evl->handlers->next != NULL) {
-            evl->handlers->next->prev = evh;
-          }
+  evl = event_create(event);
+
+  evhi = evl->handlers;
+  if (evhi) {
+    struct event_handler *evhl = NULL;
+
+    /* Make sure this event handler is added to the START of the list,
+     * in order to preserve module load order handling of events (i.e.
+     * last module loaded, first module handled).  The exception to this
+     * rule are core callbacks (i.e. where m == NULL); these will always
+     * be invoked last.
+     *
+     * Before that, though, check for duplicate registration/subscription.
+     */ 
+    while (evhi) {
+      pr_signals_handle();
+
+      if (evhi->cb == evh->cb) {
+        /* Duplicate callback */
+        errno = EEXIST;
+        return -1;
+      }
 
-          evh->next = evl->handlers;
-          evl->handlers = evh;
+      evhl = evhi;
 
-        } else {
-          /* Core event listeners go at the end. */
-          evhl->next = evh;
-          evh->prev = evhl;
-        }
-
-      } else {
-        evl->handlers = evh;
+      if (evhi->next == NULL) {
+        break;
       }
 
-      /* All done */
-      return 0;
+      evhi = evhi->next;
     }
-  }
 
-  evl_pool = pr_pool_create_sz(event_pool, EVENT_POOL_SZ);
-  pr_pool_tag(evl_pool, "Event listener list pool");
+    if (evh->module != NULL) {
+      if (evl->handlers->next != NULL) {
+        evl->handlers->next->prev = evh;
+      }
 
-  evl = pcalloc(evl_pool, sizeof(struct event_list));
-  evl->pool = evl_pool;
-  evl->event = pstrdup(evl->pool, event);
-  evl->event_len = strlen(evl->event);
-  evl->handlers = evh; 
-  evl->next = events;
+      evh->next = evl->handlers;
+      evl->handlers = evh;
 
-  events = evl;
+    } else {
+      /* Core event listeners go at the end. */
+      evhl->next = evh;
+      evh->prev = evhl;
+    }
 
-  /* Clear any cached data. */
-  curr_event = NULL;
-  curr_evl = NULL;
-  curr_evh = NULL;
+  } else {
+    evl->handlers = evh;
+  }
 
+  evl->nhandlers++;
   return 0;
 }
 
@@ -209,51 +284,49 @@ int pr_event_unregister(module *m, const char *event,
    * grow unnecessarily.
    */
 
-  for (evl = events; evl; evl = evl->next) {
-    pr_signals_handle();
+  for (evl = event != NULL ? event_get(event) : events; evl;
+      evl = event != NULL ? NULL : evl->next) {
+    struct event_handler *evh;
 
-    if (event == NULL ||
-        strncmp(evl->event, event, evl->event_len + 1) == 0) {
-      struct event_handler *evh;
-
-      /* If there are no handlers for this event, there is nothing to
-       * unregister.  Skip on to the next list.
-       */
-      if (!evl->handlers) {
-        continue;
-      }
+    pr_signals_handle();
 
-      for (evh = evl->handlers; evh;) {
+    /* If there are no handlers for this event, there is nothing to
+     * unregister.  Skip on to the next list.
+     */
+    if (!evl->handlers) {
+      continue;
+    }
 
-        if ((m == NULL || evh->module == m) &&
-            (cb == NULL || evh->cb == cb)) { 
-          struct event_handler *tmp = evh->next;
+    for (evh = evl->handlers; evh;) {
 
-          if (evh->next) {
-            evh->next->prev = evh->prev;
-          }
+      if ((m == NULL || evh->module == m) &&
+          (cb == NULL || evh->cb == cb)) { 
+        struct event_handler *tmp = evh->next;
 
-          if (evh->prev) {
-            evh->prev->next = evh->next;
+        if (evh->next) {
+          evh->next->prev = evh->prev;
+        }
 
-          } else {
-            /* This is the head of the list. */
-            evl->handlers = evh->next;
-          }
+        if (evh->prev) {
+          evh->prev->next = evh->next;
 
-          evh->module = NULL;
-          evh = tmp;
-          unregistered = TRUE;
-  
         } else {
-          evh = evh->next;
+          /* This is the head of the list. */
+          evl->handlers = evh->next;
         }
+
+        evh->module = NULL;
+        evh = tmp;
+        evl->nhandlers--;
+        unregistered = TRUE;
+  
+      } else {
+        evh = evh->next;
       }
     }
   }
 
   /* Clear any cached data. */
-  curr_event = NULL;
   curr_evl = NULL;
   curr_evh = NULL;
 
@@ -265,110 +338,119 @@ int pr_event_unregister(module *m, const char *event,
   return 0;
 }
 
+int pr_event_get_id(const char *event) {
+  struct event_list *evl;
+
+  if (event == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  evl = event_create(event);
+  return evl->id;
+}
+
 int pr_event_listening(const char *event) {
   struct event_list *evl;
-  int count = 0;
 
   if (event == NULL) {
     errno = EINVAL;
     return -1;
   }
 
-  if (events == NULL) {
-    /* No registered listeners at all. */
+  evl = event_get(event);
+  if (evl == NULL) {
+    /* No registered listeners for this event. */
     return 0;
   }
 
-  /* Lookup callbacks for this event. */
-  for (evl = events; evl; evl = evl->next) {
-
-    if (strncmp(evl->event, event, evl->event_len + 1) == 0) {
-      struct event_handler *evh;
+  return (int) evl->nhandlers;
+}
 
-      /* If there are no registered callbacks for this event, be done. */
-      if (evl->handlers == NULL) {
-        return 0;
-      }
- 
-      for (evh = evl->handlers; evh; evh = evh->next) {
-        count++;
-      }
+int pr_event_listening_id(int event_id) {
+  struct event_list *evl;
 
-      break;
-    }
+  evl = event_get_by_id(event_id);
+  if (evl == NULL) {
+    errno = EINVAL;
+    return -1;
   }
 
-  return count; 
+  return (int) evl->nhandlers;
 }
 
-void pr_event_generate(const char *event, const void *event_data) {
+static void event_dispatch(struct event_list *evl, const void *event_data) {
   int use_cache = FALSE;
-  struct event_list *evl;
+  struct event_handler *evh;
 
-  if (!event)
-    return;
-
-  /* If there are no registered callbacks, be done. */
-  if (!events)
+  /* If there are no registered callbacks for this event, be done. */
+  if (evl->handlers == NULL) {
+    pr_trace_msg(trace_channel, 8, "no event handlers registered for '%s'",
+      evl->event);
     return;
+  }
 
-  /* If there is a cached event, see if the given event matches. */
-  if (curr_event &&
-      strcmp(curr_event, event) == 0) {
+  /* Is this event being generated by one of its own listeners? */
+  if (curr_evl == evl) {
     use_cache = TRUE;
   }
 
-  /* Lookup callbacks for this event. */
-  for (evl = use_cache ? curr_evl : events; evl; evl = evl->next) {
+  curr_evl = evl;
 
-    if (strncmp(evl->event, event, evl->event_len + 1) == 0) {  
-      struct event_handler *evh;
+  for (evh = use_cache ? curr_evh : evl->handlers; evh; evh = evh->next) {
+    /* Make sure that if the same event is generated by the current
+     * listener, the next time through we go to the next listener, rather
+     * sending the same event against to the same listener (Bug#3619).
+     */
+    curr_evh = evh->next;
 
-      /* If there are no registered callbacks for this event, be done. */
-      if (!evl->handlers) {
-        pr_trace_msg(trace_channel, 8, "no event handlers registered for '%s'",
-          event);
-        return;
-      }
+    if (!(evh->flags & PR_EVENT_FL_UNTRACED)) {
+      if (evh->module) {
+        pr_trace_msg(trace_channel, 8,
+          "dispatching event '%s' to mod_%s (at %p, use cache = %s)",
+          evl->event, evh->module->name, evh->cb,
+          use_cache ? "true" : "false");
 
-      curr_event = event;
-      curr_evl = evl;
-
-      for (evh = use_cache ? curr_evh : evl->handlers; evh; evh = evh->next) {
-        /* Make sure that if the same event is generated by the current
-         * listener, the next time through we go to the next listener, rather
-         * sending the same event against to the same listener (Bug#3619).
-         */
-        curr_evh = evh->next;
-
-        if (!(evh->flags & PR_EVENT_FL_UNTRACED)) {
-          if (evh->module) {
-            pr_trace_msg(trace_channel, 8,
-              "dispatching event '%s' to mod_%s (at %p, use cache = %s)", event,
-              evh->module->name, evh->cb, use_cache ? "true" : "false");
-
-          } else {
-            pr_trace_msg(trace_channel, 8,
-              "dispatching event '%s' to core (at %p, use cache = %s)", event,
-              evh->cb, use_cache ? "true" : "false");
-          }
-        }
-
-        evh->cb(event_data, evh->user_data);
+      } else {
+        pr_trace_msg(trace_channel, 8,
+          "dispatching event '%s' to core (at %p, use cache = %s)",
+          evl->event, evh->cb, use_cache ? "true" : "false");
       }
-
-      break;
     }
+
+    evh->cb(event_data, evh->user_data);
   }
 
   /* Clear any cached data after publishing the event to all interested
    * listeners.
    */
-  curr_event = NULL;
   curr_evl = NULL;
   curr_evh = NULL;
+}
 
-  return;
+void pr_event_generate(const char *event, const void *event_data) {
+  struct event_list *evl;
+
+  if (!event)
+    return;
+
+  evl = event_get(event);
+  if (evl == NULL) {
+    return;
+  }
+
+  event_dispatch(evl, event_data);
+}
+
+void pr_event_generate_id(int event_id, const void *event_data) {
+  struct event_list *evl;
+
+  evl = event_get_by_id(event_id);
+  if (evl == NULL) {
+    return;
+  }
+
+  event_dispatch(evl, event_data);
 }
 
 void pr_event_dump(void (*dumpf)(const char *, ...)) {
@@ -54,6 +54,19 @@
 # include <acl/libacl.h>
 #endif
 
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
+
+#if defined(__linux__)
+# include <sys/syscall.h>
+
+/* Defined in <linux/fs.h>, which conflicts with <sys/mount.h>. */
+# if !defined(FICLONE) && defined(_IOW)
+#  define FICLONE		_IOW(0x94, 9, int)
+# endif
+#endif /* Linux */
+
 /* We will reset timers in the progress callback every Nth iteration of the
  * callback when copying a file.
  */
@@ -63,6 +76,13 @@ static size_t copy_iter_count = 0;
 # define COPY_PROGRESS_NTH_ITER       50000
 #endif
 
+/* When the kernel does the copying for us, it copies this many bytes at a
+ * time, between progress callbacks.
+ */
+#ifndef COPY_OFFLOAD_CHUNKSZ
+# define COPY_OFFLOAD_CHUNKSZ		(16 * 1024 * 1024)
+#endif
+
 /* For determining whether a file is on an NFS filesystem.  Note that
  * this value is Linux specific.  See Bug#3874 for details.
  */
@@ -1124,151 +1144,255 @@ static int fs_cmp(const void *a, const void *b) {
 
 /* Statcache stuff */
 struct fs_statcache {
-  pool *sc_pool;
   struct stat sc_stat;
   int sc_errno;
   int sc_retval;
   time_t sc_cached_ts;
 };
 
-struct fs_statcache_evict_data {
-  time_t now;
-  time_t max_age;
-  pr_table_t *cache_tab;
+/* We need to cache two different sets of data: one for stat(2), and one
+ * for lstat(2).  For some files (e.g. symlinks), the struct stat data for
+ * the same path will be different for the two system calls.  Both are kept
+ * in a single entry per path, so that the path is stored (and hashed) once.
+ *
+ * Entries are chained in a hash table for lookups, and are also kept on a
+ * list in least-recently-used order, so that looking up, adding, and
+ * evicting entries (when the cache is full) are all constant-time.
+ */
+struct fs_statcache_entry {
+  struct fs_statcache_entry *sce_next;
+  struct fs_statcache_entry *sce_lru_prev, *sce_lru_next;
+  unsigned int sce_hash;
+  unsigned int sce_flags;
+  struct fs_statcache sce_stat;
+  struct fs_statcache sce_lstat;
+  size_t sce_path_len;
+  char sce_path[1];
 };
 
+#define FS_STATCACHE_FL_STAT		0x0001
+#define FS_STATCACHE_FL_LSTAT		0x0002
+
+#define FS_STATCACHE_MIN_CHAINS		32
+
 static const char *statcache_channel = "fs.statcache";
 static pool *statcache_pool = NULL;
 static unsigned int statcache_size = 0;
 static unsigned int statcache_max_age = 0;
 static unsigned int statcache_flags = 0;
 
-/* We need to maintain two different caches: one for stat(2) data, and one
- * for lstat(2) data.  For some files (e.g. symlinks), the struct stat data
- * for the same path will be different for the two system calls.
- */
-static pr_table_t *stat_statcache_tab = NULL;
-static pr_table_t *lstat_statcache_tab = NULL;
+static struct fs_statcache_entry **statcache_chains = NULL;
+static unsigned int statcache_nchains = 0;
+static unsigned int statcache_count = 0;
+static unsigned int statcache_seed = 0;
+
+/* Most recently used entry at the head, least recently used at the tail. */
+static struct fs_statcache_entry *statcache_lru_head = NULL;
+static struct fs_statcache_entry *statcache_lru_tail = NULL;
+
+/* Counters, for the life of the process. */
+static unsigned long statcache_hits = 0;
+static unsigned long statcache_misses = 0;
+static unsigned long statcache_expired = 0;
+static unsigned long statcache_evicted = 0;
 
 #define fs_cache_lstat(f, p, s) cache_stat((f), (p), (s), FSIO_FILE_LSTAT)
 #define fs_cache_stat(f, p, s) cache_stat((f), (p), (s), FSIO_FILE_STAT)
 
-static const struct fs_statcache *fs_statcache_get(pr_table_t *cache_tab,
-    const char *path, size_t path_len, time_t now) {
-  const struct fs_statcache *sc = NULL;
+/* Same hashing algorithm as the Table API, seeded per process. */
+static unsigned int fs_statcache_hash(const char *path, size_t path_len) {
+  unsigned int h = 0;
 
-  if (pr_table_count(cache_tab) == 0) {
-    errno = EPERM;
-    return NULL;
+  while (path_len--) {
+    h = (h * 33) + (unsigned char) path[path_len];
   }
 
-  sc = pr_table_get(cache_tab, path, NULL);
-  if (sc != NULL) {
-    time_t age;
+  return h + statcache_seed;
+}
 
-    /* If this item hasn't expired yet, return it, otherwise, remove it. */
-    age = now - sc->sc_cached_ts;
-    if (age <= statcache_max_age) {
-      pr_trace_msg(statcache_channel, 19,
-        "using cached entry for '%s' (age %lu %s)", path,
-        (unsigned long) age, age != 1 ? "secs" : "sec");
-      return sc;
-    }
+static struct fs_statcache_entry *fs_statcache_lookup(const char *path,
+    size_t path_len, unsigned int h) {
+  struct fs_statcache_entry *sce;
 
-    pr_trace_msg(statcache_channel, 14,
-      "entry for '%s' expired (age %lu %s > max age %lu), removing", path,
-      (unsigned long) age, age != 1 ? "secs" : "sec",
-      (unsigned long) statcache_max_age);
-    (void) pr_table_remove(cache_tab, path, NULL);
-    destroy_pool(sc->sc_pool);
+  if (statcache_chains == NULL) {
+    return NULL;
+  }
+
+  for (sce = statcache_chains[h & (statcache_nchains - 1)]; sce != NULL;
+      sce = sce->sce_next) {
+    if (sce->sce_hash == h &&
+        sce->sce_path_len == path_len &&
+        memcmp(sce->sce_path, path, path_len) == 0) {
+      return sce;
+    }
   }
 
-  errno = ENOENT;
   return NULL;
 }
 
-static int fs_statcache_evict_expired(const void *key_data, size_t key_datasz,
-    const void *value_data, size_t value_datasz, void *user_data) {
-  const struct fs_statcache *sc;
-  struct fs_statcache_evict_data *evict_data;
-  time_t age;
-  pr_table_t *cache_tab = NULL;
+static void fs_statcache_lru_unlink(struct fs_statcache_entry *sce) {
+  if (sce->sce_lru_prev != NULL) {
+    sce->sce_lru_prev->sce_lru_next = sce->sce_lru_next;
+
+  } else {
+    statcache_lru_head = sce->sce_lru_next;
+  }
 
-  sc = value_data;
-  evict_data = user_data;
+  if (sce->sce_lru_next != NULL) {
+    sce->sce_lru_next->sce_lru_prev = sce->sce_lru_prev;
 
-  cache_tab = evict_data->cache_tab;
-  age = evict_data->now - sc->sc_cached_ts;
-  if (age > evict_data->max_age) {
-    pr_trace_msg(statcache_channel, 14,
-      "entry for '%s' expired (age %lu %s > max age %lu), evicting",
-      (char *) key_data, (unsigned long) age, age != 1 ? "secs" : "sec",
-      (unsigned long) evict_data->max_age);
-    (void) pr_table_kremove(cache_tab, key_data, key_datasz, NULL);
-    destroy_pool(sc->sc_pool);
+  } else {
+    statcache_lru_tail = sce->sce_lru_prev;
   }
 
-  return 0;
+  sce->sce_lru_prev = sce->sce_lru_next = NULL;
 }
 
-static int fs_statcache_evict(pr_table_t *cache_tab, time_t now) {
-  int res, table_count;
-  struct fs_statcache_evict_data evict_data;
+static void fs_statcache_lru_push(struct fs_statcache_entry *sce) {
+  sce->sce_lru_prev = NULL;
+  sce->sce_lru_next = statcache_lru_head;
 
-  /* We try to make room in two passes.  First, evict any item that has
-   * exceeded the maximum age.  After that, if we are still not low enough,
-   * lower the maximum age, and try again.  If not enough room by then, then
-   * we'll try again on the next stat.
-   */
+  if (statcache_lru_head != NULL) {
+    statcache_lru_head->sce_lru_prev = sce;
 
-  evict_data.now = now;
-  evict_data.max_age = statcache_max_age;
-  evict_data.cache_tab = cache_tab;
+  } else {
+    statcache_lru_tail = sce;
+  }
 
-  res = pr_table_do(cache_tab, fs_statcache_evict_expired, &evict_data,
-    PR_TABLE_DO_FL_ALL);
-  if (res < 0) {
-    pr_trace_msg(statcache_channel, 4,
-      "error evicting expired items: %s", strerror(errno));
+  statcache_lru_head = sce;
+}
+
+static void fs_statcache_remove(struct fs_statcache_entry *sce) {
+  struct fs_statcache_entry **chain;
+
+  chain = &(statcache_chains[sce->sce_hash & (statcache_nchains - 1)]);
+  while (*chain != NULL) {
+    if (*chain == sce) {
+      *chain = sce->sce_next;
+      break;
+    }
+
+    chain = &((*chain)->sce_next);
   }
 
-  table_count = pr_table_count(cache_tab);
-  if (table_count < 0 ||
-      (unsigned int) table_count < statcache_size) {
+  fs_statcache_lru_unlink(sce);
+  statcache_count--;
+  free(sce);
+}
+
+/* Grows the hash table, as needed, to keep the chains short. */
+static int fs_statcache_grow(void) {
+  struct fs_statcache_entry **chains, *sce;
+  unsigned int nchains;
+
+  if (statcache_chains != NULL &&
+      statcache_count < statcache_nchains) {
     return 0;
   }
 
-  /* Try for a shorter max age. */
-  if (statcache_max_age > 10) {
-    evict_data.max_age = (statcache_max_age - 10);
-    res = pr_table_do(cache_tab, fs_statcache_evict_expired, &evict_data,
-      PR_TABLE_DO_FL_ALL);
-    if (res < 0) {
-      pr_trace_msg(statcache_channel, 4,
-        "error evicting expired items: %s", strerror(errno));
-    }
+  nchains = statcache_nchains > 0 ? statcache_nchains * 2 :
+    FS_STATCACHE_MIN_CHAINS;
+  if (nchains < statcache_nchains) {
+    errno = ENOSPC;
+    return -1;
   }
 
-  table_count = pr_table_count(cache_tab);
-  if (table_count < 0 ||
-      (unsigned int) table_count < statcache_size) {
-    return 0;
+  if (statcache_pool == NULL) {
+    statcache_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(statcache_pool, "FS Statcache Pool");
+  }
+
+  chains = pcalloc(statcache_pool,
+    nchains * sizeof(struct fs_statcache_entry *));
+
+  /* Every entry is on the LRU list, so we use that to rehash them. */
+  for (sce = statcache_lru_head; sce != NULL; sce = sce->sce_lru_next) {
+    unsigned int idx;
+
+    idx = sce->sce_hash & (nchains - 1);
+    sce->sce_next = chains[idx];
+    chains[idx] = sce;
+  }
+
+  pr_trace_msg(statcache_channel, 17,
+    "resized statcache table from %u to %u chains", statcache_nchains,
+    nchains);
+  statcache_chains = chains;
+  statcache_nchains = nchains;
+  return 0;
+}
+
+static const struct fs_statcache *fs_statcache_get(unsigned int op,
+    const char *path, size_t path_len, time_t now) {
+  struct fs_statcache_entry *sce;
+  struct fs_statcache *sc;
+  unsigned int flag;
+  time_t age;
+
+  if (statcache_count == 0) {
+    statcache_misses++;
+    errno = EPERM;
+    return NULL;
+  }
+
+  sce = fs_statcache_lookup(path, path_len, fs_statcache_hash(path, path_len));
+  if (sce == NULL) {
+    statcache_misses++;
+    errno = ENOENT;
+    return NULL;
+  }
+
+  if (op == FSIO_FILE_STAT) {
+    flag = FS_STATCACHE_FL_STAT;
+    sc = &(sce->sce_stat);
+
+  } else {
+    flag = FS_STATCACHE_FL_LSTAT;
+    sc = &(sce->sce_lstat);
+  }
+
+  if (!(sce->sce_flags & flag)) {
+    statcache_misses++;
+    errno = ENOENT;
+    return NULL;
+  }
+
+  /* If this item hasn't expired yet, return it, otherwise, remove it. */
+  age = now - sc->sc_cached_ts;
+  if (age <= statcache_max_age) {
+    pr_trace_msg(statcache_channel, 19,
+      "using cached entry for '%s' (age %lu %s)", path,
+      (unsigned long) age, age != 1 ? "secs" : "sec");
+
+    fs_statcache_lru_unlink(sce);
+    fs_statcache_lru_push(sce);
+    statcache_hits++;
+    return sc;
   }
 
   pr_trace_msg(statcache_channel, 14,
-    "still not enough room in cache (size %d >= max %d)",
-    pr_table_count(cache_tab), statcache_size);
-  errno = EPERM;
-  return -1;
+    "entry for '%s' expired (age %lu %s > max age %lu), removing", path,
+    (unsigned long) age, age != 1 ? "secs" : "sec",
+    (unsigned long) statcache_max_age);
+  statcache_expired++;
+  statcache_misses++;
+
+  sce->sce_flags &= ~flag;
+  if (sce->sce_flags == 0) {
+    fs_statcache_remove(sce);
+  }
+
+  errno = ENOENT;
+  return NULL;
 }
 
 /* Returns 1 if we successfully added a cache entry, 0 if not, and -1 if
  * there was an error.
  */
-static int fs_statcache_add(pr_table_t *cache_tab, const char *path,
+static int fs_statcache_add(unsigned int op, const char *path,
     size_t path_len, struct stat *st, int xerrno, int retval, time_t now) {
-  int res, table_count;
-  pool *sc_pool;
+  unsigned int h;
+  struct fs_statcache_entry *sce;
   struct fs_statcache *sc;
 
   if (statcache_size == 0 ||
@@ -1277,39 +1401,64 @@ static int fs_statcache_add(pr_table_t *cache_tab, const char *path,
     return 0;
   }
 
-  table_count = pr_table_count(cache_tab);
-  if (table_count > 0 &&
-      (unsigned int) table_count >= statcache_size) {
-    /* We've reached capacity, and need to evict some items to make room. */
-    if (fs_statcache_evict(cache_tab, now) < 0) {
-      pr_trace_msg(statcache_channel, 8,
-        "unable to evict enough items from the cache: %s", strerror(errno));
+  h = fs_statcache_hash(path, path_len);
+
+  sce = fs_statcache_lookup(path, path_len, h);
+  if (sce != NULL) {
+    fs_statcache_lru_unlink(sce);
+
+  } else {
+    /* If we've reached capacity, make room by evicting the least recently
+     * used entries.
+     */
+    while (statcache_count >= statcache_size &&
+           statcache_lru_tail != NULL) {
+      sce = statcache_lru_tail;
+
+      pr_trace_msg(statcache_channel, 14,
+        "cache full (size %u >= max %u), evicting entry for '%s'",
+        statcache_count, statcache_size, sce->sce_path);
+      fs_statcache_remove(sce);
+      statcache_evicted++;
+    }
+
+    if (fs_statcache_grow() < 0) {
+      return -1;
     }
+
+    sce = malloc(sizeof(struct fs_statcache_entry) + path_len);
+    if (sce == NULL) {
+      errno = ENOMEM;
+      return -1;
+    }
+
+    memset(sce, 0, sizeof(struct fs_statcache_entry));
+    sce->sce_hash = h;
+    sce->sce_path_len = path_len;
+    memcpy(sce->sce_path, path, path_len);
+    sce->sce_path[path_len] = '\0';
+
+    sce->sce_next = statcache_chains[h & (statcache_nchains - 1)];
+    statcache_chains[h & (statcache_nchains - 1)] = sce;
+    statcache_count++;
+  }
+
+  if (op == FSIO_FILE_STAT) {
+    sce->sce_flags |= FS_STATCACHE_FL_STAT;
+    sc = &(sce->sce_stat);
+
+  } else {
+    sce->sce_flags |= FS_STATCACHE_FL_LSTAT;
+    sc = &(sce->sce_lstat);
   }
 
-  sc_pool = make_sub_pool(statcache_pool);
-  pr_pool_tag(sc_pool, "FS statcache entry pool");
-  sc = pcalloc(sc_pool, sizeof(struct fs_statcache));
-  sc->sc_pool = sc_pool;
   memcpy(&(sc->sc_stat), st, sizeof(struct stat));
   sc->sc_errno = xerrno;
   sc->sc_retval = retval;
   sc->sc_cached_ts = now;
 
-  res = pr_table_add(cache_tab, pstrndup(sc_pool, path, path_len), sc,
-    sizeof(struct fs_statcache *));
-  if (res < 0) {
-    int tmp_errno = errno;
-
-    if (tmp_errno == EEXIST) {
-      res = 0;
-    }
-
-    destroy_pool(sc->sc_pool);
-    errno = tmp_errno;
-  }
-
-  return (res == 0 ? 1 : res);
+  fs_statcache_lru_push(sce);
+  return 1;
 }
 
 static int cache_stat(pr_fs_t *fs, const char *path, struct stat *st,
@@ -1318,7 +1467,6 @@ static int cache_stat(pr_fs_t *fs, const char *path, struct stat *st,
   char cleaned_path[PR_TUNABLE_PATH_MAX+1], pathbuf[PR_TUNABLE_PATH_MAX+1];
   int (*mystat)(pr_fs_t *, const char *, struct stat *) = NULL;
   size_t path_len;
-  pr_table_t *cache_tab = NULL;
   const struct fs_statcache *sc = NULL;
   time_t now;
 
@@ -1364,16 +1512,14 @@ static int cache_stat(pr_fs_t *fs, const char *path, struct stat *st,
   /* Determine which filesystem function to use, stat() or lstat() */
   if (op == FSIO_FILE_STAT) {
     mystat = fs->stat ? fs->stat : sys_stat;
-    cache_tab = stat_statcache_tab;
 
   } else {
     mystat = fs->lstat ? fs->lstat : sys_lstat;
-    cache_tab = lstat_statcache_tab;
   }
 
   path_len = strlen(cleaned_path);
 
-  sc = fs_statcache_get(cache_tab, cleaned_path, path_len, now);
+  sc = fs_statcache_get(op, cleaned_path, path_len, now);
   if (sc != NULL) {
 
     /* Update the given struct stat pointer with the cached info */
@@ -1400,7 +1546,7 @@ static int cache_stat(pr_fs_t *fs, const char *path, struct stat *st,
   }
 
   /* Update the cache */
-  res = fs_statcache_add(cache_tab, cleaned_path, path_len, st, xerrno, retval,     now);
+  res = fs_statcache_add(op, cleaned_path, path_len, st, xerrno, retval, now);
   if (res < 0) {
     pr_trace_msg(trace_channel, 8,
       "error adding cached stat for '%s': %s", cleaned_path, strerror(errno));
@@ -1595,39 +1741,69 @@ static void statcache_dumpf(const char *fmt, ...) {
 }
 
 void pr_fs_statcache_dump(void) {
-  pr_table_dump(statcache_dumpf, stat_statcache_tab);
-  pr_table_dump(statcache_dumpf, lstat_statcache_tab);
+  struct fs_statcache_entry *sce;
+  time_t now;
+
+  statcache_dumpf("statcache: %u %s (max %u), %u %s", statcache_count,
+    statcache_count != 1 ? "entries" : "entry", statcache_size,
+    statcache_nchains, statcache_nchains != 1 ? "chains" : "chain");
+  statcache_dumpf("statcache: %lu %s, %lu %s, %lu expired, %lu evicted",
+    statcache_hits, statcache_hits != 1 ? "hits" : "hit", statcache_misses,
+    statcache_misses != 1 ? "misses" : "miss", statcache_expired,
+    statcache_evicted);
+
+  /* Entries are dumped from most to least recently used. */
+  now = time(NULL);
+  for (sce = statcache_lru_head; sce != NULL; sce = sce->sce_lru_next) {
+    char stat_age[32], lstat_age[32];
+
+    sstrncpy(stat_age, "-", sizeof(stat_age));
+    if (sce->sce_flags & FS_STATCACHE_FL_STAT) {
+      snprintf(stat_age, sizeof(stat_age)-1, "%lu",
+        (unsigned long) (now - sce->sce_stat.sc_cached_ts));
+    }
+
+    sstrncpy(lstat_age, "-", sizeof(lstat_age));
+    if (sce->sce_flags & FS_STATCACHE_FL_LSTAT) {
+      snprintf(lstat_age, sizeof(lstat_age)-1, "%lu",
+        (unsigned long) (now - sce->sce_lstat.sc_cached_ts));
+    }
+
+    statcache_dumpf("  '%s' (stat age %s, lstat age %s)", sce->sce_path,
+      stat_age, lstat_age);
+  }
 }
 
-void pr_fs_statcache_free(void) {
-  if (stat_statcache_tab != NULL) {
-    int size;
+/* Note: the hash table itself is allocated out of the statcache_pool; the
+ * entries are individually allocated, as they are individually evicted.
+ */
+static void fs_statcache_clear(void) {
+  struct fs_statcache_entry *sce;
 
-    size = pr_table_count(stat_statcache_tab);
+  if (statcache_count > 0) {
     pr_trace_msg(statcache_channel, 11,
-      "resetting stat(2) statcache (clearing %d %s)", size,
-      size != 1 ? "entries" : "entry");
-    pr_table_empty(stat_statcache_tab);
-    pr_table_free(stat_statcache_tab);
-    stat_statcache_tab = NULL;
+      "resetting statcache (clearing %u %s)", statcache_count,
+      statcache_count != 1 ? "entries" : "entry");
   }
 
-  if (lstat_statcache_tab != NULL) {
-    int size;
+  sce = statcache_lru_head;
+  while (sce != NULL) {
+    struct fs_statcache_entry *next;
 
-    size = pr_table_count(lstat_statcache_tab);
-    pr_trace_msg(statcache_channel, 11,
-      "resetting lstat(2) statcache (clearing %d %s)", size,
-      size != 1 ? "entries" : "entry");
-    pr_table_empty(lstat_statcache_tab);
-    pr_table_free(lstat_statcache_tab);
-    lstat_statcache_tab = NULL;
+    next = sce->sce_lru_next;
+    free(sce);
+    sce = next;
   }
 
-  /* Note: we do not need to explicitly destroy each entry in the statcache
-   * tables, since ALL entries are allocated out of this statcache_pool.
-   * And we destroy this pool here.  Much easier cleanup that way.
-   */
+  statcache_lru_head = statcache_lru_tail = NULL;
+  statcache_count = 0;
+  statcache_chains = NULL;
+  statcache_nchains = 0;
+}
+
+void pr_fs_statcache_free(void) {
+  fs_statcache_clear();
+
   if (statcache_pool != NULL) {
     destroy_pool(statcache_pool);
     statcache_pool = NULL;
@@ -1641,9 +1817,6 @@ void pr_fs_statcache_reset(void) {
     statcache_pool = make_sub_pool(permanent_pool);
     pr_pool_tag(statcache_pool, "FS Statcache Pool");
   }
-
-  stat_statcache_tab = pr_table_alloc(statcache_pool, 0);
-  lstat_statcache_tab = pr_table_alloc(statcache_pool, 0);
 }
 
 int pr_fs_statcache_set_policy(unsigned int size, unsigned int max_age,
@@ -1661,14 +1834,14 @@ int pr_fs_clear_cache2(const char *path) {
 
   (void) pr_event_generate("fs.statcache.clear", path);
 
-  if (pr_table_count(stat_statcache_tab) == 0 &&
-      pr_table_count(lstat_statcache_tab) == 0) {
+  if (statcache_count == 0) {
     return 0;
   }
 
   if (path != NULL) {
     char cleaned_path[PR_TUNABLE_PATH_MAX+1], pathbuf[PR_TUNABLE_PATH_MAX+1];
-    int lstat_count, stat_count;
+    size_t path_len;
+    struct fs_statcache_entry *sce;
 
     if (*path != '/') {
       size_t pathbuf_len;
@@ -1696,32 +1869,23 @@ int pr_fs_clear_cache2(const char *path) {
 
     res = 0;
 
-    stat_count = pr_table_exists(stat_statcache_tab, cleaned_path);
-    if (stat_count > 0) {
-      const struct fs_statcache *sc;
-
-      sc = pr_table_remove(stat_statcache_tab, cleaned_path, NULL);
-      if (sc != NULL) {
-        destroy_pool(sc->sc_pool);
+    path_len = strlen(cleaned_path);
+    sce = fs_statcache_lookup(cleaned_path, path_len,
+      fs_statcache_hash(cleaned_path, path_len));
+    if (sce != NULL) {
+      if (sce->sce_flags & FS_STATCACHE_FL_STAT) {
+        pr_trace_msg(statcache_channel, 17, "cleared stat(2) entry for '%s'",
+          path);
+        res++;
       }
 
-      pr_trace_msg(statcache_channel, 17, "cleared stat(2) entry for '%s'",
-        path);
-      res += stat_count;
-    }
-
-    lstat_count = pr_table_exists(lstat_statcache_tab, cleaned_path);
-    if (lstat_count > 0) {
-      const struct fs_statcache *sc;
-
-      sc = pr_table_remove(lstat_statcache_tab, cleaned_path, NULL);
-      if (sc != NULL) {
-        destroy_pool(sc->sc_pool);
+      if (sce->sce_flags & FS_STATCACHE_FL_LSTAT) {
+        pr_trace_msg(statcache_channel, 17, "cleared lstat(2) entry for '%s'",
+          path);
+        res++;
       }
 
-      pr_trace_msg(statcache_channel, 17, "cleared lstat(2) entry for '%s'",
-        path);
-      res += lstat_count;
+      fs_statcache_remove(sce);
     }
 
   } else {
@@ -1739,13 +1903,172 @@ void pr_fs_clear_cache(void) {
 
 /* FS functions proper */
 
+/* Kernel-side copies bypass the FSIO read/write handlers, so they are only
+ * used when those handlers are the system ones; this keeps any module which
+ * hooks writes (e.g. mod_quotatab, for enforcing quotas) in the loop.
+ */
+static int copy_can_offload(pr_fh_t *src_fh, pr_fh_t *dst_fh) {
+  pr_fs_t *fs;
+
+  fs = src_fh->fh_fs;
+  while (fs && fs->fs_next && !fs->read) {
+    fs = fs->fs_next;
+  }
+
+  if (fs == NULL ||
+      fs->read != sys_read) {
+    return FALSE;
+  }
+
+  fs = dst_fh->fh_fs;
+  while (fs && fs->fs_next && !fs->write) {
+    fs = fs->fs_next;
+  }
+
+  if (fs == NULL ||
+      fs->write != sys_write) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void copy_offload_progress(void (*progress_cb)(int), off_t nbytes) {
+  while (nbytes > 0) {
+    int len;
+
+    len = nbytes > COPY_OFFLOAD_CHUNKSZ ? COPY_OFFLOAD_CHUNKSZ : (int) nbytes;
+
+    if (progress_cb != NULL) {
+      (progress_cb)(len);
+
+    } else {
+      /* Each chunk is worth many read/write iterations; make sure that the
+       * builtin callback resets the timers for every chunk.
+       */
+      copy_iter_count = COPY_PROGRESS_NTH_ITER - 1;
+      copy_progress_cb(len);
+    }
+
+    nbytes -= len;
+  }
+}
+
+/* Try to have the kernel copy the first `len` bytes of the source file,
+ * by cloning the file (reflink), then by copy_file_range(2), then by
+ * sendfile(2).  Returns the number of bytes copied; the file offsets of both
+ * handles are left at that point, so that the caller can copy whatever
+ * remains using read/write.  Errors are not fatal here; if they persist,
+ * the read/write copy will report them.
+ */
+static off_t copy_offload(pr_fh_t *src_fh, pr_fh_t *dst_fh, off_t len,
+    void (*progress_cb)(int)) {
+  off_t copied = 0;
+  int src_fd, dst_fd;
+
+  src_fd = PR_FH_FD(src_fh);
+  dst_fd = PR_FH_FD(dst_fh);
+
+#if defined(FICLONE)
+  if (ioctl(dst_fd, FICLONE, src_fd) == 0) {
+    if (lseek(src_fd, len, SEEK_SET) == len &&
+        lseek(dst_fd, len, SEEK_SET) == len) {
+      pr_trace_msg(trace_channel, 9, "cloned '%s' to '%s' (%" PR_LU " bytes)",
+        src_fh->fh_path, dst_fh->fh_path, (pr_off_t) len);
+      copy_offload_progress(progress_cb, len);
+      return len;
+    }
+
+    /* Start over from the beginning, then. */
+    (void) lseek(src_fd, 0, SEEK_SET);
+    (void) lseek(dst_fd, 0, SEEK_SET);
+
+  } else {
+    pr_trace_msg(trace_channel, 14, "unable to clone '%s' to '%s': %s",
+      src_fh->fh_path, dst_fh->fh_path, strerror(errno));
+  }
+#endif /* FICLONE */
+
+#if defined(__NR_copy_file_range)
+  while (copied < len) {
+    ssize_t res;
+    size_t chunksz;
+
+    chunksz = (len - copied) > COPY_OFFLOAD_CHUNKSZ ? COPY_OFFLOAD_CHUNKSZ :
+      (size_t) (len - copied);
+
+    res = syscall(__NR_copy_file_range, src_fd, NULL, dst_fd, NULL, chunksz,
+      0);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 14,
+        "error using copy_file_range(2) to copy '%s' to '%s': %s",
+        src_fh->fh_path, dst_fh->fh_path, strerror(errno));
+      break;
+    }
+
+    /* Some filesystems (e.g. procfs) report no data this way; let the
+     * read/write copy handle them.
+     */
+    if (res == 0) {
+      break;
+    }
+
+    copied += res;
+    copy_offload_progress(progress_cb, res);
+  }
+
+  if (copied > 0) {
+    pr_trace_msg(trace_channel, 9,
+      "copied %" PR_LU " bytes from '%s' to '%s' using copy_file_range(2)",
+      (pr_off_t) copied, src_fh->fh_path, dst_fh->fh_path);
+  }
+#endif /* __NR_copy_file_range */
+
+#if defined(HAVE_LINUX_SENDFILE)
+  while (copied < len) {
+    ssize_t res;
+    size_t chunksz;
+
+    chunksz = (len - copied) > COPY_OFFLOAD_CHUNKSZ ? COPY_OFFLOAD_CHUNKSZ :
+      (size_t) (len - copied);
+
+    res = sendfile(dst_fd, src_fd, NULL, chunksz);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 14,
+        "error using sendfile(2) to copy '%s' to '%s': %s",
+        src_fh->fh_path, dst_fh->fh_path, strerror(errno));
+      break;
+    }
+
+    if (res == 0) {
+      break;
+    }
+
+    copied += res;
+    copy_offload_progress(progress_cb, res);
+  }
+#endif /* HAVE_LINUX_SENDFILE */
+
+  return copied;
+}
+
 int pr_fs_copy_file2(const char *src, const char *dst, int flags,
     void (*progress_cb)(int)) {
   pr_fh_t *src_fh, *dst_fh;
   struct stat src_st, dst_st;
   char *buf;
   size_t bufsz;
-  int dst_existed = FALSE, res;
+  int dst_existed = FALSE, have_dst_st = FALSE, res;
 #ifdef PR_USE_XATTR
   array_header *xattrs = NULL;
 #endif /* PR_USE_XATTR */
@@ -1868,6 +2191,7 @@ int pr_fs_copy_file2(const char *src, const char *dst, int flags,
   }
 
   if (pr_fsio_fstat(dst_fh, &dst_st) == 0) {
+    have_dst_st = TRUE;
 
     /* Check to see if the source and destination paths are identical.
      * We wait until now, rather than simply comparing the path strings
@@ -1903,6 +2227,18 @@ int pr_fs_copy_file2(const char *src, const char *dst, int flags,
   }
 #endif
 
+  /* Let the kernel copy the data, where we can; anything it does not copy
+   * is copied by the read/write loop below.
+   */
+  if (!(flags & PR_FSIO_COPY_FILE_FL_NO_OFFLOAD) &&
+      have_dst_st == TRUE &&
+      S_ISREG(src_st.st_mode) &&
+      S_ISREG(dst_st.st_mode) &&
+      src_st.st_size > 0 &&
+      copy_can_offload(src_fh, dst_fh) == TRUE) {
+    (void) copy_offload(src_fh, dst_fh, src_st.st_size, progress_cb);
+  }
+
   while ((res = pr_fsio_read(src_fh, buf, bufsz)) > 0) {
     size_t datalen;
     off_t offset;
@@ -3997,6 +4333,7 @@ int pr_fsio_mkdir(const char *path, mode_t mode) {
 
   if (res == 0) {
     pr_fs_clear_cache2(path);
+    (void) pr_listcache_invalidate(path);
   }
 
   if (dir_umask != (mode_t) -1) {
@@ -4552,6 +4889,7 @@ int pr_fsio_rmdir(const char *path) {
   res = (fs->rmdir)(fs, path);
   if (res == 0) {
     pr_fs_clear_cache2(path);
+    (void) pr_listcache_invalidate(path);
   }
 
   return res;
@@ -4802,7 +5140,9 @@ int pr_fsio_rename(const char *rnfr, const char *rnto) {
   res = (fs->rename)(fs, rnfr, rnto);
   if (res == 0) {
     pr_fs_clear_cache2(rnfr);
+    (void) pr_listcache_invalidate(rnfr);
     pr_fs_clear_cache2(rnto);
+    (void) pr_listcache_invalidate(rnto);
   }
 
   return res;
@@ -4857,6 +5197,7 @@ int pr_fsio_unlink(const char *name) {
   res = (fs->unlink)(fs, name);
   if (res == 0) {
     pr_fs_clear_cache2(name);
+    (void) pr_listcache_invalidate(name);
   }
 
   return res;
@@ -4910,6 +5251,7 @@ pr_fh_t *pr_fsio_open_canon(const char *name, int flags) {
   fh->fh_fd = -1;
   fh->fh_buf = NULL;
   fh->fh_fs = fs;
+  fh->fh_flags = flags;
 
   /* Find the first non-NULL custom open handler.  If there are none,
    * use the system open.
@@ -4971,6 +5313,7 @@ pr_fh_t *pr_fsio_open(const char *name, int flags) {
   fh->fh_fd = -1;
   fh->fh_buf = NULL;
   fh->fh_fs = fs;
+  fh->fh_flags = flags;
 
   /* Find the first non-NULL custom open handler.  If there are none,
    * use the system open.
@@ -5054,6 +5397,10 @@ int pr_fsio_close(pr_fh_t *fh) {
 
   if (res == 0) {
     pr_fs_clear_cache2(fh->fh_path);
+
+    if (fh->fh_flags & (O_WRONLY|O_RDWR|O_APPEND|O_CREAT|O_TRUNC)) {
+      (void) pr_listcache_invalidate(fh->fh_path);
+    }
   }
 
   /* Make sure to scrub any buffered memory, too. */
@@ -5277,6 +5624,7 @@ int pr_fsio_link(const char *target_path, const char *link_path) {
   res = (fs->link)(fs, target_path, link_path);
   if (res == 0) {
     pr_fs_clear_cache2(link_path);
+    (void) pr_listcache_invalidate(link_path);
   }
 
   return res;
@@ -5309,6 +5657,7 @@ int pr_fsio_symlink(const char *target_path, const char *link_path) {
   res = (fs->symlink)(fs, target_path, link_path);
   if (res == 0) {
     pr_fs_clear_cache2(link_path);
+    (void) pr_listcache_invalidate(link_path);
   }
 
   return res;
@@ -5336,6 +5685,7 @@ int pr_fsio_ftruncate(pr_fh_t *fh, off_t len) {
   res = (fs->ftruncate)(fh, fh->fh_fd, len);
   if (res == 0) {
     pr_fs_clear_cache2(fh->fh_path);
+    (void) pr_listcache_invalidate(fh->fh_path);
 
     /* Clear any read buffer. */
     if (fh->fh_buf != NULL) {
@@ -5373,6 +5723,7 @@ int pr_fsio_truncate(const char *path, off_t len) {
   res = (fs->truncate)(fs, path, len);
   if (res == 0) {
     pr_fs_clear_cache2(path);
+    (void) pr_listcache_invalidate(path);
   }
   
   return res;
@@ -5404,6 +5755,7 @@ int pr_fsio_chmod(const char *name, mode_t mode) {
   res = (fs->chmod)(fs, name, mode);
   if (res == 0) {
     pr_fs_clear_cache2(name);
+    (void) pr_listcache_invalidate(name);
   }
 
   return res;
@@ -5454,6 +5806,7 @@ int pr_fsio_fchmod(pr_fh_t *fh, mode_t mode) {
   res = (fs->fchmod)(fh, fh->fh_fd, mode);
   if (res == 0) {
     pr_fs_clear_cache2(fh->fh_path);
+    (void) pr_listcache_invalidate(fh->fh_path);
   }
 
   return res;
@@ -5514,6 +5867,7 @@ int pr_fsio_chown(const char *name, uid_t uid, gid_t gid) {
   res = (fs->chown)(fs, name, uid, gid);
   if (res == 0) {
     pr_fs_clear_cache2(name);
+    (void) pr_listcache_invalidate(name);
   }
 
   return res;
@@ -5564,6 +5918,7 @@ int pr_fsio_fchown(pr_fh_t *fh, uid_t uid, gid_t gid) {
   res = (fs->fchown)(fh, fh->fh_fd, uid, gid);
   if (res == 0) {
     pr_fs_clear_cache2(fh->fh_path);
+    (void) pr_listcache_invalidate(fh->fh_path);
   }
 
   return res;
@@ -5624,6 +5979,7 @@ int pr_fsio_lchown(const char *name, uid_t uid, gid_t gid) {
   res = (fs->lchown)(fs, name, uid, gid);
   if (res == 0) {
     pr_fs_clear_cache2(name);
+    (void) pr_listcache_invalidate(name);
   }
 
   return res;
@@ -5727,6 +6083,7 @@ int pr_fsio_utimes(const char *path, struct timeval *tvs) {
   res = (fs->utimes)(fs, path, tvs);
   if (res == 0) {
     pr_fs_clear_cache2(path);
+    (void) pr_listcache_invalidate(path);
   }
 
   return res;
@@ -5822,6 +6179,7 @@ int pr_fsio_futimes(pr_fh_t *fh, struct timeval *tvs) {
   res = (fs->futimes)(fh, fh->fh_fd, tvs);
   if (res == 0) {
     pr_fs_clear_cache2(fh->fh_path);
+    (void) pr_listcache_invalidate(fh->fh_path);
   }
 
   return res;
@@ -7307,10 +7665,10 @@ int init_fs(void) {
   }
 
   /* Prepare the stat cache as well. */
+  fs_statcache_clear();
   statcache_pool = make_sub_pool(permanent_pool);
   pr_pool_tag(statcache_pool, "FS Statcache Pool");
-  stat_statcache_tab = pr_table_alloc(statcache_pool, 0);
-  lstat_statcache_tab = pr_table_alloc(statcache_pool, 0);
+  statcache_seed = (unsigned int) (rand() ^ getpid() ^ time(NULL));
 
   return 0;
 }
@@ -48,6 +48,11 @@ static int inet_errno = 0;		/* Holds errno */
  */
 static int inet_family = 0;
 
+/* Whether the daemon process(es) use SO_REUSEPORT on their listening
+ * sockets; see AcceptorProcesses.
+ */
+static int inet_reuse_port = FALSE;
+
 static const char *trace_channel = "inet";
 
 /* Called by others after running a number of pr_inet_* functions in order
@@ -70,6 +75,20 @@ int pr_inet_set_default_family(pool *p, int family) {
   return old_family;
 }
 
+int pr_inet_set_reuse_port(int reuse_port) {
+  int old_reuse_port = inet_reuse_port;
+
+#ifndef SO_REUSEPORT
+  if (reuse_port) {
+    errno = ENOSYS;
+    return -1;
+  }
+#endif /* SO_REUSEPORT */
+
+  inet_reuse_port = reuse_port;
+  return old_reuse_port;
+}
+
 /* Find a service and return its port number. */
 int pr_inet_getservport(pool *p, const char *serv, const char *proto) {
   struct servent *servent;
@@ -324,9 +343,11 @@ static conn_t *init_conn(pool *p, int fd, const pr_netaddr_t *bind_addr,
     /* Note that we only want to use this socket option if we are NOT the
      * master/parent daemon.  Otherwise, we would allow multiple daemon
      * processes to bind to the same socket, causing unexpected terror
-     * and madness (see Issue #622).
+     * and madness (see Issue #622) -- unless the admin explicitly asked
+     * for that, for the daemon's own acceptor processes (AcceptorProcesses).
      */
-    if (!is_master) {
+    if (!is_master ||
+        inet_reuse_port) {
       if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *) &one,
           sizeof(one)) < 0) {
         pr_log_pri(PR_LOG_NOTICE, "error setting SO_REUSEPORT: %s",
@@ -35,6 +35,27 @@ struct jot_filters_rec {
   array_header *cmd_ids;
 };
 
+/* A compiled LogFormat is a flat list of operations: either a run of literal
+ * text, or a LogFormat ID (with its optional argument) to be resolved.
+ */
+struct jot_logfmt_op {
+  unsigned char logfmt_id;
+
+  /* For LogFormat IDs, e.g. the name of the environment variable. */
+  const char *logfmt_data;
+
+  /* For literal text, i.e. when the ID is zero. */
+  unsigned char *text;
+  size_t text_len;
+};
+
+struct jot_logfmt_rec {
+  pool *pool;
+
+  struct jot_logfmt_op *ops;
+  unsigned int nops;
+};
+
 /* For tracking the size of deleted files. */
 static off_t jot_deleted_filesz = 0;
 
@@ -1063,6 +1084,41 @@ static const char *get_meta_transfer_type(cmd_rec *cmd) {
   return transfer_type;
 }
 
+/* Several modules (e.g. mod_log, mod_sql, mod_exec) may resolve LogFormat
+ * variables for the same command, at the LOG_CMD/LOG_CMD_ERR phases.  By
+ * then, the command has been handled, and the values of the path-related
+ * variables will not change; these values are thus stashed in the command
+ * notes, so that the (relatively expensive) path resolution is only done
+ * once per command.
+ */
+static const char *get_meta_memoized(cmd_rec *cmd, const char *key,
+    const char *(*get_meta)(cmd_rec *)) {
+  const char *val;
+  int memoize = FALSE;
+
+  if (cmd->notes != NULL &&
+      (session.curr_phase == LOG_CMD ||
+       session.curr_phase == LOG_CMD_ERR)) {
+    memoize = TRUE;
+
+    val = pr_table_get(cmd->notes, key, NULL);
+    if (val != NULL) {
+      return val;
+    }
+  }
+
+  val = (get_meta)(cmd);
+  if (val != NULL &&
+      memoize == TRUE) {
+    if (pr_table_add(cmd->notes, key, (void *) val, 0) < 0) {
+      pr_trace_msg(trace_channel, 9, "error stashing '%s' note: %s", key,
+        strerror(errno));
+    }
+  }
+
+  return val;
+}
+
 static int resolve_logfmt_id(pool *p, unsigned char logfmt_id,
     const char *logfmt_data, pr_jot_ctx_t *ctx, cmd_rec *cmd,
     int (*on_meta)(pool *, pr_jot_ctx_t *, unsigned char,
@@ -1093,7 +1149,7 @@ static int resolve_logfmt_id(pool *p, unsigned char logfmt_id,
     case LOGFMT_META_BASENAME: {
       const char *basename;
 
-      basename = get_meta_basename(cmd);
+      basename = get_meta_memoized(cmd, "jot.basename", get_meta_basename);
       if (basename != NULL) {
         res = (on_meta)(p, ctx, logfmt_id, NULL, basename);
 
@@ -1148,7 +1204,7 @@ static int resolve_logfmt_id(pool *p, unsigned char logfmt_id,
     case LOGFMT_META_FILENAME: {
       const char *filename;
 
-      filename = get_meta_filename(cmd);
+      filename = get_meta_memoized(cmd, "jot.filename", get_meta_filename);
       if (filename != NULL) {
         res = (on_meta)(p, ctx, logfmt_id, NULL, filename);
 
@@ -1489,7 +1545,8 @@ static int resolve_logfmt_id(pool *p, unsigned char logfmt_id,
     case LOGFMT_META_XFER_PATH: {
       const char *transfer_path;
 
-      transfer_path = get_meta_transfer_path(cmd);
+      transfer_path = get_meta_memoized(cmd, "jot.transfer-path",
+        get_meta_transfer_path);
       if (transfer_path != NULL) {
         res = (on_meta)(p, ctx, logfmt_id, NULL, transfer_path);
 
@@ -1503,7 +1560,7 @@ static int resolve_logfmt_id(pool *p, unsigned char logfmt_id,
     case LOGFMT_META_DIR_NAME: {
       const char *dir_name;
 
-      dir_name = get_meta_dir_name(cmd);
+      dir_name = get_meta_memoized(cmd, "jot.dir-name", get_meta_dir_name);
       if (dir_name != NULL) {
         res = (on_meta)(p, ctx, logfmt_id, NULL, dir_name);
 
@@ -1517,7 +1574,7 @@ static int resolve_logfmt_id(pool *p, unsigned char logfmt_id,
     case LOGFMT_META_DIR_PATH: {
       const char *dir_path;
 
-      dir_path = get_meta_dir_path(cmd);
+      dir_path = get_meta_memoized(cmd, "jot.dir-path", get_meta_dir_path);
       if (dir_path != NULL) {
         res = (on_meta)(p, ctx, logfmt_id, NULL, dir_path);
 
@@ -2212,6 +2269,168 @@ int pr_jot_resolve_logfmt(pool *p, cmd_rec *cmd, pr_jot_filters_t *filters,
   return 0;
 }
 
+pr_jot_logfmt_t *pr_jot_compile_logfmt(pool *p, unsigned char *logfmt) {
+  pool *sub_pool;
+  pr_jot_logfmt_t *compiled;
+  array_header *ops;
+  struct jot_logfmt_op *op;
+  size_t text_len = 0;
+
+  if (p == NULL ||
+      logfmt == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  sub_pool = make_sub_pool(p);
+  pr_pool_tag(sub_pool, "Jot LogFormat pool");
+
+  compiled = pcalloc(sub_pool, sizeof(pr_jot_logfmt_t));
+  compiled->pool = sub_pool;
+
+  ops = make_array(sub_pool, 8, sizeof(struct jot_logfmt_op));
+
+  while (*logfmt) {
+    unsigned char logfmt_id;
+
+    if (*logfmt != LOGFMT_META_START) {
+      logfmt++;
+      text_len++;
+      continue;
+    }
+
+    if (text_len > 0) {
+      op = push_array(ops);
+      op->logfmt_id = 0;
+      op->logfmt_data = NULL;
+      op->text = logfmt - text_len;
+      op->text_len = text_len;
+
+      text_len = 0;
+    }
+
+    logfmt_id = *(logfmt + 1);
+
+    op = push_array(ops);
+    op->logfmt_id = logfmt_id;
+    op->logfmt_data = NULL;
+    op->text = NULL;
+    op->text_len = 0;
+
+    /* Skip past the META_START and the ID. */
+    logfmt += 2;
+
+    switch (logfmt_id) {
+      case LOGFMT_META_CUSTOM:
+      case LOGFMT_META_ENV_VAR:
+      case LOGFMT_META_NOTE_VAR:
+      case LOGFMT_META_TIME:
+        if (*logfmt == LOGFMT_META_START &&
+            *(logfmt + 1) == LOGFMT_META_ARG) {
+          size_t logfmt_datalen = 0;
+
+          op->logfmt_data = get_meta_arg(sub_pool, logfmt + 2,
+            &logfmt_datalen);
+
+          /* Skip past the META_START, META_ARG, the data, and
+           * META_ARG_END.
+           */
+          logfmt += (3 + logfmt_datalen);
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  if (text_len > 0) {
+    op = push_array(ops);
+    op->logfmt_id = 0;
+    op->logfmt_data = NULL;
+    op->text = logfmt - text_len;
+    op->text_len = text_len;
+  }
+
+  compiled->ops = ops->elts;
+  compiled->nops = ops->nelts;
+
+  pr_trace_msg(trace_channel, 17, "compiled LogFormat into %u %s",
+    compiled->nops, compiled->nops != 1 ? "operations" : "operation");
+  return compiled;
+}
+
+int pr_jot_resolve_compiled_logfmt(pool *p, cmd_rec *cmd,
+    pr_jot_filters_t *filters, pr_jot_logfmt_t *compiled, pr_jot_ctx_t *ctx,
+    int (*on_meta)(pool *, pr_jot_ctx_t *, unsigned char, const char *,
+      const void *),
+    int (*on_default)(pool *, pr_jot_ctx_t *, unsigned char),
+    int (*on_other)(pool *, pr_jot_ctx_t *, unsigned char *, size_t)) {
+  register unsigned int i;
+  int jottable = FALSE;
+
+  if (p == NULL ||
+      cmd == NULL ||
+      compiled == NULL ||
+      on_meta == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  jottable = is_jottable(p, cmd, filters);
+  if (jottable == FALSE) {
+    pr_trace_msg(trace_channel, 17, "ignoring filtered event '%s'",
+      (const char *) cmd->argv[0]);
+    errno = EPERM;
+    return -1;
+  }
+
+  if (on_default == NULL) {
+    on_default = jot_resolve_on_default;
+  }
+
+  if (on_other == NULL) {
+    on_other = jot_resolve_on_other;
+  }
+
+  for (i = 0; i < compiled->nops; i++) {
+    int res = 0, val = TRUE;
+    struct jot_logfmt_op *op;
+
+    op = &(compiled->ops[i]);
+
+    switch (op->logfmt_id) {
+      case 0:
+        res = (on_other)(p, ctx, op->text, op->text_len);
+        break;
+
+      /* Special handling for the CONNECT/DISCONNECT meta. */
+      case LOGFMT_META_CONNECT:
+        if (cmd->cmd_class == CL_CONNECT) {
+          res = (on_meta)(p, ctx, LOGFMT_META_CONNECT, NULL, &val);
+        }
+        break;
+
+      case LOGFMT_META_DISCONNECT:
+        if (cmd->cmd_class == CL_DISCONNECT) {
+          res = (on_meta)(p, ctx, LOGFMT_META_DISCONNECT, NULL, &val);
+        }
+        break;
+
+      default:
+        res = resolve_logfmt_id(p, op->logfmt_id, op->logfmt_data, ctx, cmd,
+          on_meta, on_default);
+        break;
+    }
+
+    if (res < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
 static int jot_parse_on_unknown(pool *p, pr_jot_ctx_t *ctx, const char *text,
     size_t text_len) {
   return 0;
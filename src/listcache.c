@@ -0,0 +1,668 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Directory listing cache
+ *
+ * The listings of a directory are stored in a subdirectory of the cache
+ * directory, named for a hash of the directory's real (i.e. including any
+ * chroot) path; each listing is a file named for a hash of its key.  This
+ * way, all of the listings of a directory can be removed at once, by any
+ * session, regardless of how it sees that directory.
+ *
+ * Each file starts with a header line, describing the listed directory as
+ * it was when listed, followed by the directory ID, the key, and the listing
+ * itself.  The IDs and keys are compared in full on lookup, so hash
+ * collisions are harmless.
+ */
+
+#include "conf.h"
+#include "privs.h"
+
+#define LISTCACHE_MAGIC			"proftpd-listcache-1"
+
+/* The initial size of the buffer used for capturing a listing. */
+#define LISTCACHE_CAPTURE_BUFSZ		8192
+
+static int listcache_fd = -1;
+static unsigned int listcache_max_age = PR_LISTCACHE_DEFAULT_MAX_AGE;
+static size_t listcache_max_size = PR_LISTCACHE_DEFAULT_MAX_SIZE;
+
+static pool *capture_pool = NULL;
+static char *capture_buf = NULL;
+static size_t capture_buflen = 0, capture_bufsz = 0;
+static int capture_ok = FALSE;
+static const char *capture_path = NULL, *capture_id = NULL,
+  *capture_key = NULL;
+static struct stat capture_st;
+static time_t capture_started = 0;
+
+static const char *trace_channel = "listcache";
+
+#if defined(AT_FDCWD)
+
+/* 64-bit FNV-1a */
+static uint64_t listcache_hash(const char *text) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  while (*text) {
+    h ^= (unsigned char) *text++;
+    h *= 0x100000001b3ULL;
+  }
+
+  return h;
+}
+
+static char *listcache_hash_name(pool *p, const char *text) {
+  char buf[32];
+  uint64_t h;
+
+  h = listcache_hash(text);
+  snprintf(buf, sizeof(buf)-1, "%08lx%08lx", (unsigned long) (h >> 32),
+    (unsigned long) (h & 0xffffffffUL));
+  return pstrdup(p, buf);
+}
+
+/* Returns the real, i.e. including any chroot, absolute path of the given
+ * directory.
+ */
+static char *listcache_dir_id(pool *p, const char *dir) {
+  char buf[PR_TUNABLE_PATH_MAX+1], *path;
+
+  if (*dir != '/') {
+    path = pdircat(p, pr_fs_getcwd(), dir, NULL);
+
+  } else {
+    path = pstrdup(p, dir);
+  }
+
+  if (session.chroot_path != NULL &&
+      strcmp(session.chroot_path, "/") != 0) {
+    path = pstrcat(p, session.chroot_path, "/", path, NULL);
+  }
+
+  memset(buf, '\0', sizeof(buf));
+  pr_fs_clean_path(path, buf, sizeof(buf)-1);
+
+  return pstrdup(p, buf);
+}
+
+/* Cached listings depend on who is listing as well. */
+static char *listcache_user_key(pool *p, const char *key) {
+  char buf[256];
+
+  memset(buf, '\0', sizeof(buf));
+  snprintf(buf, sizeof(buf)-1, "%u %s %lu %lu ",
+    main_server != NULL ? main_server->sid : 0,
+    session.user != NULL ? session.user : "",
+    (unsigned long) session.uid, (unsigned long) session.gid);
+
+  return pstrcat(p, buf, key, NULL);
+}
+
+static int listcache_write(int fd, const char *data, size_t datalen) {
+  while (datalen > 0) {
+    ssize_t res;
+
+    res = write(fd, data, datalen);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      return -1;
+    }
+
+    data += res;
+    datalen -= res;
+  }
+
+  return 0;
+}
+
+static int listcache_store(pool *p, const char *id, const char *key,
+    const struct stat *st, time_t created, const char *data, size_t datalen) {
+  char hdr[512], suffix[64], *dir_name, *entry_path, *tmp_path;
+  int fd, res, xerrno = 0;
+  size_t hdrlen;
+
+  dir_name = listcache_hash_name(p, id);
+  entry_path = pdircat(p, dir_name, listcache_hash_name(p, key), NULL);
+  memset(suffix, '\0', sizeof(suffix));
+  snprintf(suffix, sizeof(suffix)-1, ".tmp.%lu", (unsigned long) getpid());
+  tmp_path = pstrcat(p, entry_path, suffix, NULL);
+
+  memset(hdr, '\0', sizeof(hdr));
+  snprintf(hdr, sizeof(hdr)-1, "%s %lu %lu %lu %lu %lu %lu %lu %lu %lu\n",
+    LISTCACHE_MAGIC, (unsigned long) st->st_dev, (unsigned long) st->st_ino,
+    (unsigned long) st->st_mtime, (unsigned long) st->st_ctime,
+    (unsigned long) st->st_size, (unsigned long) created,
+    (unsigned long) strlen(id), (unsigned long) strlen(key),
+    (unsigned long) datalen);
+  hdrlen = strlen(hdr);
+
+  PRIVS_ROOT
+  res = mkdirat(listcache_fd, dir_name, 0700);
+  if (res < 0 &&
+      errno == EEXIST) {
+    res = 0;
+  }
+
+  if (res == 0) {
+    fd = openat(listcache_fd, tmp_path, O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW,
+      0600);
+    if (fd >= 0) {
+      if (listcache_write(fd, hdr, hdrlen) < 0 ||
+          listcache_write(fd, id, strlen(id)) < 0 ||
+          listcache_write(fd, key, strlen(key)) < 0 ||
+          listcache_write(fd, data, datalen) < 0) {
+        res = -1;
+        xerrno = errno;
+      }
+
+      if (close(fd) < 0 &&
+          res == 0) {
+        res = -1;
+        xerrno = errno;
+      }
+
+      if (res == 0) {
+        res = renameat(listcache_fd, tmp_path, listcache_fd, entry_path);
+        xerrno = errno;
+      }
+
+      if (res < 0) {
+        (void) unlinkat(listcache_fd, tmp_path, 0);
+      }
+
+    } else {
+      res = -1;
+      xerrno = errno;
+    }
+
+  } else {
+    xerrno = errno;
+  }
+  PRIVS_RELINQUISH
+
+  if (res < 0) {
+    pr_trace_msg(trace_channel, 3, "error storing listing of '%s': %s", id,
+      strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9, "stored %lu byte listing of '%s' as '%s'",
+    (unsigned long) datalen, id, entry_path);
+  return 0;
+}
+
+static int listcache_remove_dir(pool *p, const char *id) {
+  char *dir_name;
+  int dir_fd, xerrno;
+  unsigned int count = 0;
+  DIR *dirh;
+  struct dirent *dent;
+
+  dir_name = listcache_hash_name(p, id);
+
+  PRIVS_ROOT
+  dir_fd = openat(listcache_fd, dir_name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW);
+  xerrno = errno;
+
+  if (dir_fd < 0) {
+    PRIVS_RELINQUISH
+
+    if (xerrno != ENOENT) {
+      pr_trace_msg(trace_channel, 3,
+        "error opening cached listings of '%s': %s", id, strerror(xerrno));
+    }
+
+    errno = xerrno;
+    return -1;
+  }
+
+  dirh = fdopendir(dir_fd);
+  if (dirh == NULL) {
+    xerrno = errno;
+    (void) close(dir_fd);
+    PRIVS_RELINQUISH
+
+    errno = xerrno;
+    return -1;
+  }
+
+  while ((dent = readdir(dirh)) != NULL) {
+    if (strcmp(dent->d_name, ".") == 0 ||
+        strcmp(dent->d_name, "..") == 0) {
+      continue;
+    }
+
+    if (unlinkat(dir_fd, dent->d_name, 0) == 0) {
+      count++;
+    }
+  }
+
+  (void) closedir(dirh);
+  PRIVS_RELINQUISH
+
+  if (count > 0) {
+    pr_trace_msg(trace_channel, 9, "removed %u cached %s of '%s'", count,
+      count != 1 ? "listings" : "listing", id);
+  }
+
+  return 0;
+}
+#endif /* AT_FDCWD */
+
+int pr_listcache_open(const char *path) {
+#if defined(AT_FDCWD)
+  int fd, xerrno;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  (void) pr_listcache_close();
+
+  PRIVS_ROOT
+  fd = open(path, O_RDONLY|O_DIRECTORY);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (fd < 0) {
+    pr_trace_msg(trace_channel, 1, "error opening cache directory '%s': %s",
+      path, strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+  listcache_fd = fd;
+
+  pr_trace_msg(trace_channel, 9, "using cache directory '%s'", path);
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* AT_FDCWD */
+}
+
+int pr_listcache_close(void) {
+  pr_listcache_capture_abort();
+
+  if (listcache_fd < 0) {
+    errno = EPERM;
+    return -1;
+  }
+
+  (void) close(listcache_fd);
+  listcache_fd = -1;
+  return 0;
+}
+
+int pr_listcache_is_open(void) {
+  return (listcache_fd >= 0 ? TRUE : FALSE);
+}
+
+int pr_listcache_set_limits(unsigned int max_age, size_t max_size) {
+  if (max_age == 0 ||
+      max_size == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  listcache_max_age = max_age;
+  listcache_max_size = max_size;
+  return 0;
+}
+
+int pr_listcache_get(pool *p, const char *dir, const char *key,
+    const struct stat *dir_st, char **data, size_t *datalen) {
+#if defined(AT_FDCWD)
+  pool *tmp_pool;
+  char *id, *user_key, *entry_path, *buf, *ptr;
+  int fd, xerrno;
+  unsigned long dir_dev, dir_ino, dir_mtime, dir_ctime, dir_size, created,
+    idlen, keylen, len;
+  struct stat st;
+  size_t bufsz, buflen = 0;
+  time_t now;
+
+  if (p == NULL ||
+      dir == NULL ||
+      key == NULL ||
+      dir_st == NULL ||
+      data == NULL ||
+      datalen == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (listcache_fd < 0) {
+    errno = EPERM;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(p);
+  pr_pool_tag(tmp_pool, "Listcache lookup pool");
+
+  id = listcache_dir_id(tmp_pool, dir);
+  user_key = listcache_user_key(tmp_pool, key);
+  entry_path = pdircat(tmp_pool, listcache_hash_name(tmp_pool, id),
+    listcache_hash_name(tmp_pool, user_key), NULL);
+
+  PRIVS_ROOT
+  fd = openat(listcache_fd, entry_path, O_RDONLY|O_NOFOLLOW);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (fd < 0) {
+    pr_trace_msg(trace_channel, 17, "no cached listing of '%s': %s", id,
+      strerror(xerrno));
+    destroy_pool(tmp_pool);
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (fstat(fd, &st) < 0 ||
+      (size_t) st.st_size > (listcache_max_size + strlen(id) +
+        strlen(user_key) + 512)) {
+    (void) close(fd);
+    destroy_pool(tmp_pool);
+    errno = ENOENT;
+    return -1;
+  }
+
+  bufsz = st.st_size;
+  buf = palloc(p, bufsz + 1);
+
+  while (buflen < bufsz) {
+    ssize_t res;
+
+    res = read(fd, buf + buflen, bufsz - buflen);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      break;
+    }
+
+    if (res == 0) {
+      break;
+    }
+
+    buflen += res;
+  }
+
+  (void) close(fd);
+  buf[buflen] = '\0';
+
+  ptr = memchr(buf, '\n', buflen);
+  if (ptr == NULL ||
+      strncmp(buf, LISTCACHE_MAGIC " ", strlen(LISTCACHE_MAGIC) + 1) != 0 ||
+      sscanf(buf + strlen(LISTCACHE_MAGIC) + 1,
+        "%lu %lu %lu %lu %lu %lu %lu %lu %lu", &dir_dev, &dir_ino, &dir_mtime,
+        &dir_ctime, &dir_size, &created, &idlen, &keylen, &len) != 9) {
+    pr_trace_msg(trace_channel, 3, "ignoring malformed cached listing '%s'",
+      entry_path);
+    destroy_pool(tmp_pool);
+    errno = ENOENT;
+    return -1;
+  }
+
+  ptr++;
+
+  if ((size_t) (ptr - buf) + idlen + keylen + len != buflen ||
+      idlen != strlen(id) ||
+      keylen != strlen(user_key) ||
+      strncmp(ptr, id, idlen) != 0 ||
+      strncmp(ptr + idlen, user_key, keylen) != 0) {
+    /* Most likely a hash collision, or a partial file. */
+    pr_trace_msg(trace_channel, 9, "cached listing '%s' is not for '%s'",
+      entry_path, id);
+    destroy_pool(tmp_pool);
+    errno = ENOENT;
+    return -1;
+  }
+
+  now = time(NULL);
+
+  if (dir_dev != (unsigned long) dir_st->st_dev ||
+      dir_ino != (unsigned long) dir_st->st_ino ||
+      dir_mtime != (unsigned long) dir_st->st_mtime ||
+      dir_ctime != (unsigned long) dir_st->st_ctime ||
+      dir_size != (unsigned long) dir_st->st_size ||
+      (unsigned long) now >= created + listcache_max_age) {
+    pr_trace_msg(trace_channel, 9, "cached listing of '%s' is stale, removing",
+      id);
+
+    PRIVS_ROOT
+    (void) unlinkat(listcache_fd, entry_path, 0);
+    PRIVS_RELINQUISH
+
+    destroy_pool(tmp_pool);
+    errno = ENOENT;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9, "using cached %lu byte listing of '%s'",
+    len, id);
+
+  *data = ptr + idlen + keylen;
+  *datalen = len;
+
+  destroy_pool(tmp_pool);
+  return 0;
+#else
+  errno = EPERM;
+  return -1;
+#endif /* AT_FDCWD */
+}
+
+int pr_listcache_capture_start(const char *dir, const char *key,
+    const struct stat *dir_st) {
+  time_t now;
+
+  if (dir == NULL ||
+      key == NULL ||
+      dir_st == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (listcache_fd < 0) {
+    errno = EPERM;
+    return -1;
+  }
+
+  pr_listcache_capture_abort();
+
+  now = time(NULL);
+  if (dir_st->st_mtime >= now ||
+      dir_st->st_ctime >= now) {
+    pr_trace_msg(trace_channel, 17,
+      "not caching listing of '%s': modified too recently", dir);
+    errno = EAGAIN;
+    return -1;
+  }
+
+#if defined(AT_FDCWD)
+  capture_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(capture_pool, "Listcache capture pool");
+
+  capture_path = listcache_dir_id(capture_pool, dir);
+  capture_id = capture_path;
+
+  /* For re-checking the directory when done, we need its path as seen by
+   * this session.
+   */
+  if (session.chroot_path != NULL &&
+      strcmp(session.chroot_path, "/") != 0) {
+    capture_path = pstrdup(capture_pool, *dir == '/' ? dir :
+      pdircat(capture_pool, pr_fs_getcwd(), dir, NULL));
+  }
+
+  capture_key = listcache_user_key(capture_pool, key);
+  memcpy(&capture_st, dir_st, sizeof(struct stat));
+  capture_started = now;
+
+  capture_bufsz = LISTCACHE_CAPTURE_BUFSZ;
+  capture_buf = palloc(capture_pool, capture_bufsz);
+  capture_buflen = 0;
+  capture_ok = TRUE;
+
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* AT_FDCWD */
+}
+
+void pr_listcache_capture_add(const char *data, size_t datalen) {
+  if (capture_pool == NULL ||
+      capture_ok == FALSE ||
+      data == NULL) {
+    return;
+  }
+
+  if (capture_buflen + datalen > listcache_max_size) {
+    pr_trace_msg(trace_channel, 9,
+      "listing of '%s' exceeds max cacheable size (%lu bytes), not caching",
+      capture_id, (unsigned long) listcache_max_size);
+    capture_ok = FALSE;
+    return;
+  }
+
+  if (capture_buflen + datalen > capture_bufsz) {
+    char *buf;
+    size_t bufsz;
+
+    bufsz = capture_bufsz;
+    while (capture_buflen + datalen > bufsz) {
+      bufsz *= 2;
+    }
+
+    buf = palloc(capture_pool, bufsz);
+    memcpy(buf, capture_buf, capture_buflen);
+    capture_buf = buf;
+    capture_bufsz = bufsz;
+  }
+
+  memcpy(capture_buf + capture_buflen, data, datalen);
+  capture_buflen += datalen;
+}
+
+int pr_listcache_capture_finish(void) {
+#if defined(AT_FDCWD)
+  struct stat st;
+  int res;
+
+  if (capture_pool == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  if (capture_ok == FALSE) {
+    pr_listcache_capture_abort();
+    errno = EFBIG;
+    return -1;
+  }
+
+  /* Make sure that the directory did not change while it was listed. */
+  pr_fs_clear_cache2(capture_path);
+  if (pr_fsio_stat(capture_path, &st) < 0 ||
+      st.st_dev != capture_st.st_dev ||
+      st.st_ino != capture_st.st_ino ||
+      st.st_mtime != capture_st.st_mtime ||
+      st.st_ctime != capture_st.st_ctime ||
+      st.st_size != capture_st.st_size) {
+    pr_trace_msg(trace_channel, 9,
+      "'%s' changed while being listed, not caching", capture_id);
+    pr_listcache_capture_abort();
+    errno = ESTALE;
+    return -1;
+  }
+
+  res = listcache_store(capture_pool, capture_id, capture_key, &capture_st,
+    capture_started, capture_buf, capture_buflen);
+  pr_listcache_capture_abort();
+
+  return res;
+#else
+  errno = EPERM;
+  return -1;
+#endif /* AT_FDCWD */
+}
+
+void pr_listcache_capture_abort(void) {
+  if (capture_pool != NULL) {
+    destroy_pool(capture_pool);
+    capture_pool = NULL;
+  }
+
+  capture_buf = NULL;
+  capture_buflen = capture_bufsz = 0;
+  capture_ok = FALSE;
+  capture_path = capture_id = capture_key = NULL;
+}
+
+int pr_listcache_invalidate(const char *path) {
+#if defined(AT_FDCWD)
+  pool *tmp_pool;
+  char *id, *ptr;
+
+  if (listcache_fd < 0) {
+    return 0;
+  }
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(tmp_pool, "Listcache invalidate pool");
+
+  id = listcache_dir_id(tmp_pool, path);
+  (void) listcache_remove_dir(tmp_pool, id);
+
+  ptr = strrchr(id, '/');
+  if (ptr != NULL) {
+    if (ptr == id) {
+      ptr++;
+    }
+
+    *ptr = '\0';
+    (void) listcache_remove_dir(tmp_pool, id);
+  }
+
+  destroy_pool(tmp_pool);
+#endif /* AT_FDCWD */
+
+  return 0;
+}
@@ -727,6 +727,11 @@ void log_stderr(int bool) {
   logstderr = bool;
 }
 
+/* Get the current debug logging level. */
+int pr_log_getdebuglevel(void) {
+  return debug_level;
+}
+
 /* Set the debug logging level; see log.h for constants.  Higher
  * numbers mean print more, DEBUG0 (0) == print no debugging log
  * (default)
@@ -842,9 +847,34 @@ static const char *get_log_event_name(unsigned int log_type) {
   return event_name;
 }
 
+/* The event IDs of the log events, indexed by log type, looked up on first
+ * use; these events are checked for every logged message.
+ */
+static int log_event_ids[PR_LOG_TYPE_TRACELOG+1] = { -1, -1, -1, -1, -1, -1 };
+
+static int get_log_event_id(unsigned int log_type) {
+  const char *event_name;
+
+  if (log_type > PR_LOG_TYPE_TRACELOG) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (log_event_ids[log_type] >= 0) {
+    return log_event_ids[log_type];
+  }
+
+  event_name = get_log_event_name(log_type);
+  if (event_name == NULL) {
+    return -1;
+  }
+
+  log_event_ids[log_type] = pr_event_get_id(event_name);
+  return log_event_ids[log_type];
+}
+
 int pr_log_event_generate(unsigned int log_type, int log_fd, int log_level,
     const char *log_msg, size_t log_msglen) {
-  const char *event_name;
   pr_log_event_t le;
 
   if (log_msg == NULL ||
@@ -858,8 +888,6 @@ int pr_log_event_generate(unsigned int log_type, int log_fd, int log_level,
     return -1;
   }
 
-  event_name = get_log_event_name(log_type);
-
   memset(&le, 0, sizeof(le));
   le.log_type = log_type;
   le.log_fd = log_fd;
@@ -867,20 +895,19 @@ int pr_log_event_generate(unsigned int log_type, int log_fd, int log_level,
   le.log_msg = log_msg;
   le.log_msglen = log_msglen;
 
-  pr_event_generate(event_name, &le);
+  pr_event_generate_id(get_log_event_id(log_type), &le);
   return 0;
 }
 
 int pr_log_event_listening(unsigned int log_type) {
-  const char *event_name;
-  int res;
+  int event_id, res;
 
-  event_name = get_log_event_name(log_type);
-  if (event_name == NULL) {
+  event_id = get_log_event_id(log_type);
+  if (event_id < 0) {
     return FALSE;
   }
 
-  res = pr_event_listening(event_name);
+  res = pr_event_listening_id(event_id);
   if (res <= 0) {
     return FALSE;
   }
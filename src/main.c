@@ -42,6 +42,10 @@
 
 #include "privs.h"
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
 int (*cmd_auth_chk)(cmd_rec *);
 void (*cmd_handler)(server_rec *, conn_t *);
 
@@ -222,201 +226,372 @@ static int get_command_class(const char *name) {
   return (c ? c->cmd_class : CL_ALL);
 }
 
+/* Command dispatch plans.  Rather than walking the stash for every phase
+ * of every command, the handlers for a command are looked up once, and
+ * bucketed by phase (cmd_type), in stash order.  Plans for the known
+ * commands are indexed by command ID; plans for other commands (e.g. the
+ * SITE commands) are kept in a table, keyed by name.  Plans are discarded
+ * whenever the set of command handlers changes, e.g. due to a module being
+ * loaded or unloaded.
+ */
+struct dispatch_plan {
+  const char *name;
+  cmdtable **handlers[LOG_CMD_ERR+1];
+  unsigned int nhandlers[LOG_CMD_ERR+1];
+};
+
+static pool *dispatch_pool = NULL;
+static pr_table_t *dispatch_tab = NULL;
+static struct dispatch_plan *dispatch_id_plans[PR_CMD_MAX_ID+1];
+static struct dispatch_plan *dispatch_any_plan = NULL;
+static unsigned long dispatch_serial = 0;
+
+static void dispatch_plans_clear(void) {
+  if (dispatch_pool != NULL) {
+    destroy_pool(dispatch_pool);
+  }
+
+  dispatch_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(dispatch_pool, "Command dispatch plan pool");
+
+  dispatch_tab = pr_table_alloc(dispatch_pool, 0);
+  memset(dispatch_id_plans, 0, sizeof(dispatch_id_plans));
+  dispatch_any_plan = NULL;
+  dispatch_serial = pr_stash_get_serial(PR_SYM_CMD);
+}
+
+/* Returns NULL if there are no handlers for the command, unless always_create
+ * is TRUE.
+ */
+static struct dispatch_plan *dispatch_plan_create(const char *name,
+    int always_create) {
+  register unsigned int i;
+  struct dispatch_plan *plan;
+  cmdtable *c;
+  unsigned int nhandlers[LOG_CMD_ERR+1], total = 0;
+  int idx = -1;
+  unsigned int hash = 0;
+
+  memset(nhandlers, 0, sizeof(nhandlers));
+
+  c = pr_stash_get_symbol2(PR_SYM_CMD, name, NULL, &idx, &hash);
+  while (c != NULL) {
+    if (c->cmd_type >= PRE_CMD &&
+        c->cmd_type <= LOG_CMD_ERR) {
+      nhandlers[c->cmd_type]++;
+      total++;
+    }
+
+    c = pr_stash_get_symbol2(PR_SYM_CMD, name, c, &idx, &hash);
+  }
+
+  if (total == 0 &&
+      always_create == FALSE) {
+    return NULL;
+  }
+
+  plan = pcalloc(dispatch_pool, sizeof(struct dispatch_plan));
+  plan->name = pstrdup(dispatch_pool, name);
+
+  for (i = PRE_CMD; i <= LOG_CMD_ERR; i++) {
+    if (nhandlers[i] > 0) {
+      plan->handlers[i] = pcalloc(dispatch_pool,
+        nhandlers[i] * sizeof(cmdtable *));
+    }
+  }
+
+  c = pr_stash_get_symbol2(PR_SYM_CMD, name, NULL, &idx, &hash);
+  while (c != NULL) {
+    if (c->cmd_type >= PRE_CMD &&
+        c->cmd_type <= LOG_CMD_ERR) {
+      plan->handlers[c->cmd_type][plan->nhandlers[c->cmd_type]++] = c;
+    }
+
+    c = pr_stash_get_symbol2(PR_SYM_CMD, name, c, &idx, &hash);
+  }
+
+  return plan;
+}
+
+static struct dispatch_plan *dispatch_get_plan(const char *name, int cmd_id) {
+  struct dispatch_plan *plan;
+
+  if (dispatch_pool == NULL ||
+      dispatch_serial != pr_stash_get_serial(PR_SYM_CMD)) {
+    dispatch_plans_clear();
+  }
+
+  if (cmd_id > 0 &&
+      cmd_id <= PR_CMD_MAX_ID) {
+    plan = dispatch_id_plans[cmd_id];
+
+    /* Guard against a cmd_rec whose name was changed after its ID was
+     * assigned.
+     */
+    if (plan != NULL &&
+        strcmp(plan->name, name) == 0) {
+      return plan;
+    }
+
+    if (plan == NULL &&
+        pr_cmd_get_id(name) == cmd_id) {
+      plan = dispatch_plan_create(name, TRUE);
+      dispatch_id_plans[cmd_id] = plan;
+      return plan;
+    }
+
+  } else if (name[0] == '*' &&
+             name[1] == '\0') {
+    if (dispatch_any_plan == NULL) {
+      dispatch_any_plan = dispatch_plan_create(C_ANY, TRUE);
+    }
+
+    return dispatch_any_plan;
+  }
+
+  plan = (struct dispatch_plan *) pr_table_get(dispatch_tab, name, NULL);
+  if (plan != NULL) {
+    return plan;
+  }
+
+  /* Only cache plans for commands which have handlers, lest clients fill
+   * the table with garbage command names.
+   */
+  plan = dispatch_plan_create(name, FALSE);
+  if (plan != NULL) {
+    (void) pr_table_add(dispatch_tab, plan->name, plan,
+      sizeof(struct dispatch_plan));
+  }
+
+  return plan;
+}
+
+/* Compile the plans for the known commands up front, after the modules have
+ * been initialized, so that session processes inherit them.
+ */
+static void dispatch_plans_init(void) {
+  register int i;
+
+  dispatch_plans_clear();
+
+  for (i = 1; i <= PR_CMD_MAX_ID; i++) {
+    dispatch_id_plans[i] = dispatch_plan_create(pr_cmd_get_name(i), TRUE);
+  }
+
+  dispatch_any_plan = dispatch_plan_create(C_ANY, TRUE);
+}
+
+static const char *dispatch_phase_str(int cmd_type) {
+  switch (cmd_type) {
+    case PRE_CMD:
+      return "PRE_CMD";
+
+    case CMD:
+      return "CMD";
+
+    case POST_CMD:
+      return "POST_CMD";
+
+    case POST_CMD_ERR:
+      return "POST_CMD_ERR";
+
+    case LOG_CMD:
+      return "LOG_CMD";
+
+    case LOG_CMD_ERR:
+      return "LOG_CMD_ERR";
+  }
+
+  return "(unknown)";
+}
+
 static int _dispatch(cmd_rec *cmd, int cmd_type, int validate, char *match) {
+  register unsigned int i;
   const char *cmdargstr = NULL;
+  size_t cmdargstrlen = 0;
+  struct dispatch_plan *plan;
+  unsigned int nhandlers = 0;
   cmdtable *c;
   modret_t *mr;
   int success = 0, xerrno = 0;
   int send_error = 0;
-  static int match_index_cache = -1;
-  static unsigned int match_hash_cache = 0;
-  static char *last_match = NULL;
-  int *index_cache = NULL;
-  unsigned int *hash_cache = NULL;
 
   send_error = (cmd_type == PRE_CMD || cmd_type == CMD ||
     cmd_type == POST_CMD_ERR);
 
-  if (!match) {
-    match = cmd->argv[0];
-    index_cache = &cmd->stash_index;
-    hash_cache = &cmd->stash_hash;
+  if (match == NULL) {
+    plan = dispatch_get_plan(cmd->argv[0], cmd->cmd_id);
 
   } else {
-    if (last_match != match) {
-      match_index_cache = -1;
-      last_match = match;
-    }
-
-    index_cache = &match_index_cache;
-    hash_cache = &match_hash_cache;
+    plan = dispatch_get_plan(match, -1);
   }
 
-  c = pr_stash_get_symbol2(PR_SYM_CMD, match, NULL, index_cache, hash_cache);
-
-  while (c && !success) {
-    size_t cmdargstrlen = 0;
+  if (plan != NULL &&
+      cmd_type >= PRE_CMD &&
+      cmd_type <= LOG_CMD_ERR) {
+    nhandlers = plan->nhandlers[cmd_type];
+  }
 
+  for (i = 0; i < nhandlers && !success; i++) {
     pr_signals_handle();
 
+    c = plan->handlers[cmd_type][i];
+
     session.curr_cmd = cmd->argv[0];
     session.curr_cmd_id = cmd->cmd_id;
     session.curr_cmd_rec = cmd;
     session.curr_phase = cmd_type;
 
-    if (c->cmd_type == cmd_type) {
-      if (c->group) {
-        cmd->group = pstrdup(cmd->pool, c->group);
-      }
+    /* Command groups are static strings in the module's command table;
+     * no need to copy them.
+     */
+    if (c->group) {
+      cmd->group = (char *) c->group;
+    }
 
-      if (c->requires_auth &&
-          cmd_auth_chk &&
-          !cmd_auth_chk(cmd)) {
-        pr_trace_msg("command", 8,
-          "command '%s' failed 'requires_auth' check for mod_%s.c",
-          (char *) cmd->argv[0], c->m->name);
-        errno = EACCES;
-        return -1;
-      }
+    if (c->requires_auth &&
+        cmd_auth_chk &&
+        !cmd_auth_chk(cmd)) {
+      pr_trace_msg("command", 8,
+        "command '%s' failed 'requires_auth' check for mod_%s.c",
+        (char *) cmd->argv[0], c->m->name);
+      errno = EACCES;
+      return -1;
+    }
 
-      if (cmd->tmp_pool == NULL) {
-        cmd->tmp_pool = make_sub_pool(cmd->pool);
-        pr_pool_tag(cmd->tmp_pool, "cmd_rec tmp pool");
-      }
+    if (cmd->tmp_pool == NULL) {
+      cmd->tmp_pool = make_sub_pool(cmd->pool);
+      pr_pool_tag(cmd->tmp_pool, "cmd_rec tmp pool");
+    }
 
+    if (cmd_type == CMD) {
       cmdargstr = pr_cmd_get_displayable_str(cmd, &cmdargstrlen);
 
-      if (cmd_type == CMD) {
-
-        /* The client has successfully authenticated... */
-        if (session.user) {
-          char *args = NULL;
+      /* The client has successfully authenticated... */
+      if (session.user) {
+        char *args = NULL;
 
-          /* Be defensive, and check whether cmdargstrlen has a value.
-           * If it's zero, assume we need to use strchr(3), rather than
-           * memchr(2); see Bug#3714.
-           */
-          if (cmdargstrlen > 0) {
-            args = memchr(cmdargstr, ' ', cmdargstrlen);
+        /* Be defensive, and check whether cmdargstrlen has a value.
+         * If it's zero, assume we need to use strchr(3), rather than
+         * memchr(2); see Bug#3714.
+         */
+        if (cmdargstrlen > 0) {
+          args = memchr(cmdargstr, ' ', cmdargstrlen);
 
-          } else {
-            args = strchr(cmdargstr, ' ');
-          }
+        } else {
+          args = strchr(cmdargstr, ' ');
+        }
 
-          pr_scoreboard_entry_update(session.pid,
-            PR_SCORE_CMD, "%s", cmd->argv[0], NULL, NULL);
-          pr_scoreboard_entry_update(session.pid,
-            PR_SCORE_CMD_ARG, "%s", args ? (args + 1) : "", NULL, NULL);
+        pr_scoreboard_entry_update(session.pid,
+          PR_SCORE_CMD, "%s", cmd->argv[0], NULL, NULL);
+        pr_scoreboard_entry_update(session.pid,
+          PR_SCORE_CMD_ARG, "%s", args ? (args + 1) : "", NULL, NULL);
 
-          pr_proctitle_set("%s - %s: %s", session.user, session.proc_prefix,
-            cmdargstr);
+        pr_proctitle_set("%s - %s: %s", session.user, session.proc_prefix,
+          cmdargstr);
 
-        /* ...else the client has not yet authenticated */
-        } else {
-          pr_proctitle_set("%s:%d: %s", session.c->remote_addr ?
-            pr_netaddr_get_ipstr(session.c->remote_addr) : "?",
-            session.c->remote_port ? session.c->remote_port : 0, cmdargstr);
-        }
+      /* ...else the client has not yet authenticated */
+      } else {
+        pr_proctitle_set("%s:%d: %s", session.c->remote_addr ?
+          pr_netaddr_get_ipstr(session.c->remote_addr) : "?",
+          session.c->remote_port ? session.c->remote_port : 0, cmdargstr);
       }
+    }
 
-      /* Skip logging the internal CONNECT/DISCONNECT commands. */
-      if (!(cmd->cmd_class & CL_CONNECT) &&
-          !(cmd->cmd_class & CL_DISCONNECT)) {
+    /* Skip logging the internal CONNECT/DISCONNECT commands.  Only build
+     * the displayable string for logging if it will actually be logged.
+     */
+    if (!(cmd->cmd_class & CL_CONNECT) &&
+        !(cmd->cmd_class & CL_DISCONNECT)) {
 
-        pr_log_debug(DEBUG4, "dispatching %s command '%s' to mod_%s",
-          (cmd_type == PRE_CMD ? "PRE_CMD" :
-           cmd_type == CMD ? "CMD" :
-           cmd_type == POST_CMD ? "POST_CMD" :
-           cmd_type == POST_CMD_ERR ? "POST_CMD_ERR" :
-           cmd_type == LOG_CMD ? "LOG_CMD" :
-           cmd_type == LOG_CMD_ERR ? "LOG_CMD_ERR" :
-           "(unknown)"),
-          cmdargstr, c->m->name);
+      if (pr_log_getdebuglevel() >= DEBUG4 ||
+          pr_log_event_listening(PR_LOG_TYPE_SYSLOG) > 0 ||
+          pr_log_event_listening(PR_LOG_TYPE_SYSTEMLOG) > 0) {
+        if (cmdargstr == NULL) {
+          cmdargstr = pr_cmd_get_displayable_str(cmd, &cmdargstrlen);
+        }
 
-        pr_trace_msg("command", 7, "dispatching %s command '%s' to mod_%s.c",
-          (cmd_type == PRE_CMD ? "PRE_CMD" :
-           cmd_type == CMD ? "CMD" :
-           cmd_type == POST_CMD ? "POST_CMD" :
-           cmd_type == POST_CMD_ERR ? "POST_CMD_ERR" :
-           cmd_type == LOG_CMD ? "LOG_CMD" :
-           cmd_type == LOG_CMD_ERR ? "LOG_CMD_ERR" :
-           "(unknown)"),
-          cmdargstr, c->m->name);
+        pr_log_debug(DEBUG4, "dispatching %s command '%s' to mod_%s",
+          dispatch_phase_str(cmd_type), cmdargstr, c->m->name);
       }
 
-      cmd->cmd_class |= c->cmd_class;
+      if (pr_trace_get_level("command") >= 7) {
+        if (cmdargstr == NULL) {
+          cmdargstr = pr_cmd_get_displayable_str(cmd, &cmdargstrlen);
+        }
 
-      /* KLUDGE: disable umask() for not G_WRITE operations.  Config/
-       * Directory walking code will be completely redesigned in 1.3,
-       * this is only necessary for perfomance reasons in 1.1/1.2
-       */
+        pr_trace_msg("command", 7, "dispatching %s command '%s' to mod_%s.c",
+          dispatch_phase_str(cmd_type), cmdargstr, c->m->name);
+      }
+    }
 
-      if (!c->group || strcmp(c->group, G_WRITE) != 0)
-        kludge_disable_umask();
-      mr = pr_module_call(c->m, c->handler, cmd);
-      kludge_enable_umask();
+    cmd->cmd_class |= c->cmd_class;
 
-      if (MODRET_ISHANDLED(mr)) {
-        success = 1;
+    /* KLUDGE: disable umask() for not G_WRITE operations.  Config/
+     * Directory walking code will be completely redesigned in 1.3,
+     * this is only necessary for perfomance reasons in 1.1/1.2
+     */
 
-      } else if (MODRET_ISERROR(mr)) {
-        xerrno = errno;
-        success = -1;
+    if (!c->group || strcmp(c->group, G_WRITE) != 0)
+      kludge_disable_umask();
+    mr = pr_module_call(c->m, c->handler, cmd);
+    kludge_enable_umask();
 
-        if (cmd_type == POST_CMD ||
-            cmd_type == LOG_CMD ||
-            cmd_type == LOG_CMD_ERR) {
-          if (MODRET_ERRMSG(mr)) {
-            pr_log_pri(PR_LOG_NOTICE, "%s", MODRET_ERRMSG(mr));
-          }
+    if (MODRET_ISHANDLED(mr)) {
+      success = 1;
 
-          /* Even though we normally want to return a negative value
-           * for success (indicating lack of success), for
-           * LOG_CMD/LOG_CMD_ERR handlers, we always want to handle
-           * errors as a success value of zero (meaning "keep looking").
-           *
-           * This will allow the cmd_rec to continue to be dispatched to
-           * the other interested handlers (Bug#3633).
-           */
-          if (cmd_type == LOG_CMD || 
-              cmd_type == LOG_CMD_ERR) {
-            success = 0;
-          }
+    } else if (MODRET_ISERROR(mr)) {
+      xerrno = errno;
+      success = -1;
 
-        } else if (send_error) {
-          if (MODRET_ERRNUM(mr) &&
-              MODRET_ERRMSG(mr)) {
-            pr_response_add_err(MODRET_ERRNUM(mr), "%s", MODRET_ERRMSG(mr));
+      if (cmd_type == POST_CMD ||
+          cmd_type == LOG_CMD ||
+          cmd_type == LOG_CMD_ERR) {
+        if (MODRET_ERRMSG(mr)) {
+          pr_log_pri(PR_LOG_NOTICE, "%s", MODRET_ERRMSG(mr));
+        }
 
-          } else if (MODRET_ERRMSG(mr)) {
-            pr_response_send_raw("%s", MODRET_ERRMSG(mr));
-          }
+        /* Even though we normally want to return a negative value
+         * for success (indicating lack of success), for
+         * LOG_CMD/LOG_CMD_ERR handlers, we always want to handle
+         * errors as a success value of zero (meaning "keep looking").
+         *
+         * This will allow the cmd_rec to continue to be dispatched to
+         * the other interested handlers (Bug#3633).
+         */
+        if (cmd_type == LOG_CMD || 
+            cmd_type == LOG_CMD_ERR) {
+          success = 0;
         }
 
-        errno = xerrno;
-      }
+      } else if (send_error) {
+        if (MODRET_ERRNUM(mr) &&
+            MODRET_ERRMSG(mr)) {
+          pr_response_add_err(MODRET_ERRNUM(mr), "%s", MODRET_ERRMSG(mr));
 
-      if (session.user &&
-          !(session.sf_flags & SF_XFER) &&
-          cmd_type == CMD) {
-        pr_session_set_idle();
+        } else if (MODRET_ERRMSG(mr)) {
+          pr_response_send_raw("%s", MODRET_ERRMSG(mr));
+        }
       }
 
-      destroy_pool(cmd->tmp_pool);
-      cmd->tmp_pool = NULL;
+      errno = xerrno;
     }
 
-    if (!success) {
-      c = pr_stash_get_symbol2(PR_SYM_CMD, match, c, index_cache, hash_cache);
+    if (session.user &&
+        !(session.sf_flags & SF_XFER) &&
+        cmd_type == CMD) {
+      pr_session_set_idle();
     }
+
+    destroy_pool(cmd->tmp_pool);
+    cmd->tmp_pool = NULL;
   }
 
   /* Note: validate is only TRUE for the CMD phase, for specific handlers
    * (as opposed to any C_ANY handlers).
    */
 
-  if (!c &&
-      !success &&
+  if (success == 0 &&
       validate) {
     char *method;
 
@@ -425,8 +600,6 @@ static int _dispatch(cmd_rec *cmd, int cmd_type, int validate, char *match) {
       method = cmd->argv[0];
 
     } else {
-      register unsigned int i;
-
       method = pstrdup(cmd->pool, cmd->argv[0]);
       for (i = 0; method[i]; i++) {
         if (method[i] == '_')
@@ -603,6 +776,7 @@ int pr_cmd_dispatch_phase(cmd_rec *cmd, int phase, int flags) {
   char *cp = NULL;
   int success = 0, xerrno = 0;
   pool *resp_pool = NULL;
+  uint64_t phase_start_usecs;
 
   if (cmd == NULL) {
     errno = EINVAL;
@@ -651,6 +825,9 @@ int pr_cmd_dispatch_phase(cmd_rec *cmd, int phase, int flags) {
 
   set_cmd_start_ms(cmd);
 
+  /* Note that this is zero if metrics are not being collected. */
+  phase_start_usecs = pr_metrics_now();
+
   if (phase == 0) {
     /* First, dispatch to wildcard PRE_CMD handlers. */
     success = _dispatch(cmd, PRE_CMD, FALSE, C_ANY);
@@ -658,14 +835,20 @@ int pr_cmd_dispatch_phase(cmd_rec *cmd, int phase, int flags) {
     if (!success)	/* run other pre_cmd */
       success = _dispatch(cmd, PRE_CMD, FALSE, NULL);
 
+    pr_metrics_cmd_observe(cmd, PRE_CMD, phase_start_usecs);
+
     if (success < 0) {
       /* Dispatch to POST_CMD_ERR handlers as well. */
 
+      phase_start_usecs = pr_metrics_now();
       _dispatch(cmd, POST_CMD_ERR, FALSE, C_ANY);
       _dispatch(cmd, POST_CMD_ERR, FALSE, NULL);
+      pr_metrics_cmd_observe(cmd, POST_CMD_ERR, phase_start_usecs);
 
+      phase_start_usecs = pr_metrics_now();
       _dispatch(cmd, LOG_CMD_ERR, FALSE, C_ANY);
       _dispatch(cmd, LOG_CMD_ERR, FALSE, NULL);
+      pr_metrics_cmd_observe(cmd, LOG_CMD_ERR, phase_start_usecs);
 
       xerrno = errno;
       pr_trace_msg("response", 9, "flushing error response list for '%s'",
@@ -679,17 +862,23 @@ int pr_cmd_dispatch_phase(cmd_rec *cmd, int phase, int flags) {
       return success;
     }
 
+    phase_start_usecs = pr_metrics_now();
     success = _dispatch(cmd, CMD, FALSE, C_ANY);
     if (!success)
       success = _dispatch(cmd, CMD, TRUE, NULL);
+    pr_metrics_cmd_observe(cmd, CMD, phase_start_usecs);
 
     if (success == 1) {
+      phase_start_usecs = pr_metrics_now();
       success = _dispatch(cmd, POST_CMD, FALSE, C_ANY);
       if (!success)
         success = _dispatch(cmd, POST_CMD, FALSE, NULL);
+      pr_metrics_cmd_observe(cmd, POST_CMD, phase_start_usecs);
 
+      phase_start_usecs = pr_metrics_now();
       _dispatch(cmd, LOG_CMD, FALSE, C_ANY);
       _dispatch(cmd, LOG_CMD, FALSE, NULL);
+      pr_metrics_cmd_observe(cmd, LOG_CMD, phase_start_usecs);
 
       xerrno = errno;
       pr_trace_msg("response", 9, "flushing response list for '%s'",
@@ -701,12 +890,16 @@ int pr_cmd_dispatch_phase(cmd_rec *cmd, int phase, int flags) {
     } else if (success < 0) {
       /* Allow for non-logging command handlers to be run if CMD fails. */
 
+      phase_start_usecs = pr_metrics_now();
       success = _dispatch(cmd, POST_CMD_ERR, FALSE, C_ANY);
       if (!success)
         success = _dispatch(cmd, POST_CMD_ERR, FALSE, NULL);
+      pr_metrics_cmd_observe(cmd, POST_CMD_ERR, phase_start_usecs);
 
+      phase_start_usecs = pr_metrics_now();
       _dispatch(cmd, LOG_CMD_ERR, FALSE, C_ANY);
       _dispatch(cmd, LOG_CMD_ERR, FALSE, NULL);
+      pr_metrics_cmd_observe(cmd, LOG_CMD_ERR, phase_start_usecs);
 
       xerrno = errno;
       pr_trace_msg("response", 9, "flushing error response list for '%s'",
@@ -748,6 +941,8 @@ int pr_cmd_dispatch_phase(cmd_rec *cmd, int phase, int flags) {
         return -1;
     }
 
+    pr_metrics_cmd_observe(cmd, phase, phase_start_usecs);
+
     if (flags & PR_CMD_DISPATCH_FL_SEND_RESPONSE) {
       xerrno = errno;
 
@@ -874,6 +1069,30 @@ static cmd_rec *make_ftp_cmd(pool *p, char *buf, size_t buflen, int flags) {
   return cmd;
 }
 
+/* The responses to pipelined commands, i.e. commands which the client sent
+ * without waiting for the responses to the previous commands, are coalesced
+ * into a single write.  This is not done for commands which transfer data,
+ * or which change or close the control connection; the client must see the
+ * preceding responses before those commands proceed.
+ */
+static int cmd_can_coalesce(cmd_rec *cmd) {
+  if (pr_cmd_cmp(cmd, PR_CMD_RETR_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_STOR_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_STOU_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_APPE_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_LIST_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_NLST_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_MLSD_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_AUTH_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_CCC_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_REIN_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_QUIT_ID) == 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 static void cmd_loop(server_rec *server, conn_t *c) {
 
   while (TRUE) {
@@ -917,6 +1136,13 @@ static void cmd_loop(server_rec *server, conn_t *c) {
           cmd->protocol);
       }
  
+      if (cmd_can_coalesce(cmd) == FALSE) {
+        (void) pr_netio_uncork(session.c->outstrm);
+
+      } else if (pr_netio_telnet_pending(session.c->instrm) == TRUE) {
+        (void) pr_netio_cork(session.c->outstrm);
+      }
+
       pr_cmd_dispatch(cmd);
       destroy_pool(cmd->pool);
 
@@ -925,12 +1151,493 @@ static void cmd_loop(server_rec *server, conn_t *c) {
       pr_response_send(R_500, _("Invalid command: try being more creative"));
     }
 
+    /* Write out the coalesced responses before waiting for the next
+     * command.
+     */
+    if (session.c != NULL &&
+        pr_netio_telnet_pending(session.c->instrm) != TRUE) {
+      (void) pr_netio_uncork(session.c->outstrm);
+    }
+
     /* Release any working memory allocated in inet */
     pr_inet_clear();
   }
 }
 
+/* AcceptorProcesses: in addition to the daemon process, acceptor processes
+ * forked by the daemon accept connections, each on its own SO_REUSEPORT
+ * listening sockets, so that the kernel spreads the incoming connections
+ * (and thus the accept/fork work) across them.  Each process forks and
+ * tracks its own sessions; the per-process session counts are kept in
+ * shared memory, for enforcing MaxInstances across all of them.
+ *
+ * Each acceptor holds the read end of a pipe from the daemon.  When that
+ * pipe is closed, by the daemon on restart, or on its exit, the acceptor
+ * "retires": it closes its listening sockets, and exits once its sessions
+ * have ended.
+ */
+
+/* Retiring acceptors keep their slots, thus twice the maximum. */
+#define ACCEPTOR_MAX_SLOTS		(PR_TUNABLE_MAX_ACCEPTORS * 2)
+
+/* An acceptor which exits this soon after being started is not restarted,
+ * lest the daemon fork repeatedly e.g. due to a bind(2) error.
+ */
+#define ACCEPTOR_MIN_LIFETIME		5
+
+struct acceptor_slot {
+  volatile pid_t pid;
+  volatile unsigned long nsessions;
+};
+
+static struct acceptor_slot *acceptor_slots = NULL;
+static int acceptor_count = 1;
+
+/* The slot of this process; zero for the daemon process. */
+static int acceptor_idx = 0;
+
+/* In an acceptor: the read end of its pipe from the daemon. */
+static int acceptor_pipefd = -1;
+
+/* In the daemon: the write ends of the pipes to the current (i.e. not
+ * retiring) acceptors, and their start times, indexed by slot.
+ */
+static int acceptor_fds[ACCEPTOR_MAX_SLOTS];
+static time_t acceptor_started[ACCEPTOR_MAX_SLOTS];
+
+/* In the daemon: which acceptors have been reaped, by handle_chld(), but
+ * not yet had their slots freed.
+ */
+static int acceptor_reaped[ACCEPTOR_MAX_SLOTS];
+
+static void daemon_loop(void);
+
+static void acceptors_shutdown_ev(const void *event_data, void *user_data) {
+  register int i;
+
+  for (i = 1; i < ACCEPTOR_MAX_SLOTS; i++) {
+    pid_t pid;
+
+    pid = acceptor_slots[i].pid;
+    if (pid != 0 &&
+        acceptor_reaped[i] == FALSE &&
+        kill(pid, SIGTERM) < 0) {
+      pr_trace_msg("signal", 1, "error sending signal %d to PID %lu: %s",
+        SIGTERM, (unsigned long) pid, strerror(errno));
+    }
+  }
+}
+
+static void acceptors_chld_ev(const void *event_data, void *user_data) {
+  pid_t pid;
+  register int i;
+
+  if (acceptor_idx != 0) {
+    return;
+  }
+
+  pid = *((pid_t *) event_data);
+  for (i = 1; i < ACCEPTOR_MAX_SLOTS; i++) {
+    if (acceptor_slots[i].pid == pid) {
+      acceptor_reaped[i] = TRUE;
+      break;
+    }
+  }
+}
+
+static int acceptors_init(void) {
+  int *count, mmap_flags = MAP_SHARED;
+  void *shm;
+  register int i;
+
+  count = get_param_ptr(main_server->conf, "AcceptorProcesses", FALSE);
+  if (count == NULL ||
+      *count <= 1 ||
+      no_forking) {
+    return 0;
+  }
+
+#if defined(MAP_ANONYMOUS)
+  mmap_flags |= MAP_ANONYMOUS;
+#elif defined(MAP_ANON)
+  mmap_flags |= MAP_ANON;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+
+  if (pr_inet_set_reuse_port(TRUE) < 0) {
+    return -1;
+  }
+
+  shm = mmap(NULL, sizeof(struct acceptor_slot) * ACCEPTOR_MAX_SLOTS,
+    PROT_READ|PROT_WRITE, mmap_flags, -1, 0);
+  if (shm == MAP_FAILED) {
+    int xerrno = errno;
+
+    (void) pr_inet_set_reuse_port(FALSE);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  acceptor_slots = shm;
+  memset(acceptor_slots, 0, sizeof(struct acceptor_slot) * ACCEPTOR_MAX_SLOTS);
+  acceptor_slots[0].pid = getpid();
+
+  for (i = 0; i < ACCEPTOR_MAX_SLOTS; i++) {
+    acceptor_fds[i] = -1;
+    acceptor_reaped[i] = FALSE;
+  }
+
+  acceptor_count = *count;
+  pr_event_register(NULL, "core.shutdown", acceptors_shutdown_ev, NULL);
+  pr_event_register(NULL, "core.signal.CHLD", acceptors_chld_ev, NULL);
+
+  return 0;
+}
+
+/* Called by fork_server(), for the session process: the pipes to/from
+ * acceptors are only for the daemon/acceptor processes.
+ */
+static void acceptors_close_fds(void) {
+  register int i;
+
+  if (acceptor_slots == NULL) {
+    return;
+  }
+
+  for (i = 0; i < ACCEPTOR_MAX_SLOTS; i++) {
+    if (acceptor_fds[i] != -1) {
+      (void) close(acceptor_fds[i]);
+      acceptor_fds[i] = -1;
+    }
+  }
+
+  if (acceptor_pipefd != -1) {
+    (void) close(acceptor_pipefd);
+    acceptor_pipefd = -1;
+  }
+}
+
+/* Publishes our number of sessions, for the other daemon/acceptor processes;
+ * called whenever it changes.
+ */
+static void acceptors_update_sessions(void) {
+  if (acceptor_slots != NULL) {
+    acceptor_slots[acceptor_idx].nsessions = child_count();
+  }
+}
+
+/* Returns the number of sessions, of this process and of all of the other
+ * daemon/acceptor processes, for MaxInstances.
+ */
+static unsigned long acceptors_count_sessions(void) {
+  unsigned long nsessions = 0;
+  register int i;
+
+  if (acceptor_slots == NULL) {
+    return child_count();
+  }
+
+  acceptors_update_sessions();
+
+  for (i = 0; i < ACCEPTOR_MAX_SLOTS; i++) {
+    if (acceptor_slots[i].pid != 0) {
+      nsessions += acceptor_slots[i].nsessions;
+    }
+  }
+
+  return nsessions;
+}
+
+static void acceptor_child_init(int idx, int pipefd) {
+  pr_child_t *ch;
+
+  acceptors_close_fds();
+  acceptor_idx = idx;
+  acceptor_pipefd = pipefd;
+  acceptor_slots[idx].pid = getpid();
+  acceptor_slots[idx].nsessions = 0;
+
+  /* The sessions of the daemon are not ours. */
+  if (child_count() > 0) {
+    for (ch = child_get(NULL); ch; ch = child_get(ch)) {
+      child_remove(ch->ch_pid);
+    }
+
+    child_update();
+  }
+
+  /* Timers, e.g. for polling the Controls socket and scrubbing the
+   * scoreboard, are for the daemon process only.
+   */
+  pr_timer_remove(-1, ANY_MODULE);
+
+  /* Open our own listening sockets, rather than sharing those of the
+   * daemon, and thus its accept queues.
+   */
+  free_listening_conns();
+  init_bindings();
+
+  pr_log_debug(DEBUG2, "acceptor process (slot %d) accepting connections",
+    idx);
+}
+
+static int acceptor_fork(int idx) {
+  int fds[2];
+  pid_t pid;
+  sigset_t sig_set;
+
+  if (pipe(fds) < 0) {
+    pr_log_pri(PR_LOG_ALERT, "pipe(2) failed: %s", strerror(errno));
+    return -1;
+  }
+
+  /* As for fork_server(), block signals which would examine the lists
+   * being updated here.
+   */
+  sigemptyset(&sig_set);
+  sigaddset(&sig_set, SIGTERM);
+  sigaddset(&sig_set, SIGCHLD);
+
+  if (sigprocmask(SIG_BLOCK, &sig_set, NULL) < 0) {
+    pr_log_pri(PR_LOG_NOTICE,
+      "unable to block signal set: %s", strerror(errno));
+  }
+
+  pid = fork();
+  switch (pid) {
+    case 0:
+      if (sigprocmask(SIG_UNBLOCK, &sig_set, NULL) < 0) {
+        pr_log_pri(PR_LOG_NOTICE,
+          "unable to unblock signal set: %s", strerror(errno));
+      }
+
+      (void) close(fds[1]);
+      acceptor_child_init(idx, fds[0]);
+      daemon_loop();
+
+      pr_session_end(0);
+      break;
+
+    case -1: {
+      int xerrno = errno;
+
+      if (sigprocmask(SIG_UNBLOCK, &sig_set, NULL) < 0) {
+        pr_log_pri(PR_LOG_NOTICE,
+          "unable to unblock signal set: %s", strerror(errno));
+      }
+
+      pr_log_pri(PR_LOG_ALERT, "unable to fork(): %s", strerror(xerrno));
+      (void) close(fds[0]);
+      (void) close(fds[1]);
+      return -1;
+    }
+
+    default:
+      (void) close(fds[0]);
+      (void) fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+      acceptor_fds[idx] = fds[1];
+      time(&acceptor_started[idx]);
+      acceptor_reaped[idx] = FALSE;
+      acceptor_slots[idx].pid = pid;
+      acceptor_slots[idx].nsessions = 0;
+
+      if (sigprocmask(SIG_UNBLOCK, &sig_set, NULL) < 0) {
+        pr_log_pri(PR_LOG_NOTICE,
+          "unable to unblock signal set: %s", strerror(errno));
+      }
+
+      break;
+  }
+
+  return 0;
+}
+
+/* Forks acceptors, until there are the configured number of them. */
+static void acceptors_spawn(void) {
+  int ncurrent = 1;
+  register int i;
+
+  if (acceptor_slots == NULL) {
+    return;
+  }
+
+  for (i = 1; i < ACCEPTOR_MAX_SLOTS; i++) {
+    if (acceptor_fds[i] != -1) {
+      ncurrent++;
+    }
+  }
+
+  for (i = 1; i < ACCEPTOR_MAX_SLOTS && ncurrent < acceptor_count; i++) {
+    if (acceptor_slots[i].pid != 0) {
+      continue;
+    }
+
+    if (acceptor_fork(i) < 0) {
+      break;
+    }
+
+    ncurrent++;
+  }
+
+  if (ncurrent < acceptor_count) {
+    pr_log_pri(PR_LOG_WARNING,
+      "only %d of %d AcceptorProcesses running", ncurrent, acceptor_count);
+  }
+}
+
+/* Called by the daemon, after reaping child processes, to free the slots
+ * of acceptors which have exited, and replace any which did so unexpectedly.
+ * The reaped acceptors are noted by acceptors_chld_ev(); their PIDs cannot
+ * be probed using kill(2), as they may already have been reused.
+ */
+static void acceptors_reap(void) {
+  int respawn = FALSE;
+  time_t now;
+  register int i;
+
+  if (acceptor_slots == NULL ||
+      acceptor_idx != 0) {
+    return;
+  }
+
+  time(&now);
+
+  for (i = 1; i < ACCEPTOR_MAX_SLOTS; i++) {
+    pid_t pid;
+
+    pid = acceptor_slots[i].pid;
+    if (pid == 0 ||
+        acceptor_reaped[i] == FALSE) {
+      continue;
+    }
+
+    if (acceptor_fds[i] != -1) {
+      (void) close(acceptor_fds[i]);
+      acceptor_fds[i] = -1;
+
+      if (now - acceptor_started[i] >= ACCEPTOR_MIN_LIFETIME) {
+        pr_log_pri(PR_LOG_WARNING,
+          "acceptor process %lu exited unexpectedly, restarting",
+          (unsigned long) pid);
+        respawn = TRUE;
+
+      } else {
+        pr_log_pri(PR_LOG_WARNING,
+          "acceptor process %lu exited unexpectedly, not restarting",
+          (unsigned long) pid);
+      }
+
+    } else {
+      pr_log_debug(DEBUG2, "retired acceptor process %lu exited",
+        (unsigned long) pid);
+    }
+
+    acceptor_reaped[i] = FALSE;
+    acceptor_slots[i].nsessions = 0;
+    acceptor_slots[i].pid = 0;
+
+    (void) pr_trace_remove_buffer(pid);
+  }
+
+  if (respawn) {
+    acceptors_spawn();
+  }
+}
+
+/* Called by the daemon after reparsing its configuration: retire the
+ * current acceptors, and fork new ones, with the new configuration.
+ */
+static void acceptors_restart(void) {
+  int *count;
+  register int i;
+
+  count = get_param_ptr(main_server->conf, "AcceptorProcesses", FALSE);
+
+  if (acceptor_slots == NULL) {
+    if (count != NULL &&
+        *count > 1) {
+      pr_log_pri(PR_LOG_NOTICE, "AcceptorProcesses requires a full restart "
+        "of proftpd, rather than a SIGHUP, to take effect");
+    }
+
+    return;
+  }
+
+  for (i = 1; i < ACCEPTOR_MAX_SLOTS; i++) {
+    if (acceptor_fds[i] != -1) {
+      (void) close(acceptor_fds[i]);
+      acceptor_fds[i] = -1;
+    }
+  }
+
+  acceptor_count = count != NULL ? *count : 1;
+  acceptors_spawn();
+}
+
+/* Called by an acceptor whose pipe from the daemon has been closed: stop
+ * accepting connections, and exit once our sessions have ended.
+ */
+static void acceptor_retire(void) {
+  (void) close(acceptor_pipefd);
+  acceptor_pipefd = -1;
+
+  free_listening_conns();
+
+  pr_log_debug(DEBUG2, "acceptor process (slot %d) retiring, waiting for "
+    "%lu %s to end", acceptor_idx, child_count(),
+    child_count() != 1 ? "sessions" : "session");
+  pr_proctitle_set("(retired acceptor)");
+
+  while (child_count() > 0) {
+    struct timeval tv;
+
+    acceptors_update_sessions();
+
+    tv.tv_sec = 1L;
+    tv.tv_usec = 0L;
+    (void) select(0, NULL, NULL, NULL, &tv);
+
+    pr_signals_handle();
+
+    if (have_dead_child) {
+      sigset_t sig_set;
+
+      sigemptyset(&sig_set);
+      sigaddset(&sig_set, SIGCHLD);
+      sigaddset(&sig_set, SIGTERM);
+      pr_alarms_block();
+      if (sigprocmask(SIG_BLOCK, &sig_set, NULL) < 0) {
+        pr_log_pri(PR_LOG_NOTICE,
+          "unable to block signal set: %s", strerror(errno));
+      }
+
+      have_dead_child = FALSE;
+      child_update();
+
+      if (sigprocmask(SIG_UNBLOCK, &sig_set, NULL) < 0) {
+        pr_log_pri(PR_LOG_NOTICE,
+          "unable to unblock signal set: %s", strerror(errno));
+      }
+
+      pr_alarms_unblock();
+    }
+  }
+
+  acceptor_slots[acceptor_idx].nsessions = 0;
+  pr_session_end(0);
+}
+
 void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
+  if (acceptor_idx != 0) {
+    /* Acceptors are replaced, rather than restarted, by the daemon. */
+    pr_log_debug(DEBUG2, "received SIGHUP in acceptor process, ignoring");
+    return;
+  }
+
   if (is_master && mpid) {
     int maxfd;
     fd_set childfds;
@@ -1038,11 +1745,13 @@ void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
     }
 
     pr_event_generate("core.postparse", NULL);
+    dispatch_plans_init();
 
     /* Recreate the listen connection.  Can an inetd-spawned server accept
      * and process HUP?
      */
     init_bindings();
+    acceptors_restart();
 
     gettimeofday(&restart_finish, NULL);
 
@@ -1195,6 +1904,7 @@ static void fork_server(int fd, conn_t *l, unsigned char no_fork) {
 
   /* No longer need any listening fds. */
   pr_ipbind_close_listeners();
+  acceptors_close_fds();
 
   /* There would appear to be no useful purpose behind setting the process
    * group of the newly forked child.  In daemon/inetd mode, we should have no
@@ -1541,6 +2251,14 @@ static void daemon_loop(void) {
     /* Monitor children pipes */
     maxfd = semaphore_fds(&listenfds, maxfd);
 
+    /* Monitor the pipe from the daemon, if we are an acceptor. */
+    if (acceptor_pipefd != -1) {
+      FD_SET(acceptor_pipefd, &listenfds);
+      if (acceptor_pipefd > maxfd) {
+        maxfd = acceptor_pipefd;
+      }
+    }
+
     /* Check for ftp shutdown message file */
     switch (check_shutmsg(PR_SHUTMSG_PATH, &shut, &deny, &disc, shutmsg,
         sizeof(shutmsg))) {
@@ -1601,12 +2319,21 @@ static void daemon_loop(void) {
 
     if (i == -1 &&
         xerrno == EINTR) {
-      errno = xerrno;
+      /* Unlike an interrupted read/write, there is nothing to retry here;
+       * avoid the EINTR retry delay of pr_signals_handle(), which would
+       * otherwise hold up accepting connections whenever a session ends
+       * (SIGCHLD).
+       */
+      errno = 0;
       pr_signals_handle();
+      acceptors_update_sessions();
 
-      /* We handled our signal; clear errno. */
+      /* We handled our signal; clear errno.  Any reaped children are
+       * handled below, rather than once select(2) next returns, so that
+       * exited acceptors are promptly replaced.
+       */
       xerrno = errno = 0;
-      continue;
+      i = 0;
     }
 
     if (have_dead_child) {
@@ -1630,6 +2357,8 @@ static void daemon_loop(void) {
       }
 
       pr_alarms_unblock();
+
+      acceptors_reap();
     }
 
     if (i == -1) {
@@ -1686,6 +2415,11 @@ static void daemon_loop(void) {
       continue;
     }
 
+    if (acceptor_pipefd != -1 &&
+        FD_ISSET(acceptor_pipefd, &listenfds)) {
+      acceptor_retire();
+    }
+
     /* Accept the connection. */
     listen_conn = pr_ipbind_accept_conn(&listenfds, &fd);
 
@@ -1698,7 +2432,7 @@ static void daemon_loop(void) {
 
       /* Check for exceeded MaxInstances. */
       if (ServerMaxInstances > 0 &&
-          child_count() >= ServerMaxInstances) {
+          acceptors_count_sessions() >= ServerMaxInstances) {
         pr_event_generate("core.max-instances", NULL);
         
         pr_log_pri(PR_LOG_WARNING,
@@ -1717,7 +2451,13 @@ static void daemon_loop(void) {
 
       /* Fork off a child to handle the connection. */
       } else {
+        /* Let modules update any state which the session process will
+         * inherit.
+         */
+        pr_event_generate("core.pre-fork", NULL);
+
         PR_DEVEL_CLOCK(fork_server(fd, listen_conn, no_forking));
+        acceptors_update_sessions();
       }
     }
 #ifdef PR_DEVEL_NO_DAEMON
@@ -1891,6 +2631,11 @@ static void standalone_main(void) {
 
   pr_event_generate("core.startup", NULL);
 
+  if (acceptors_init() < 0) {
+    pr_log_pri(PR_LOG_WARNING, "unable to use AcceptorProcesses: %s",
+      strerror(errno));
+  }
+
   init_bindings();
 
   pr_log_pri(PR_LOG_NOTICE, "ProFTPD %s (built %s) standalone mode STARTUP",
@@ -1902,6 +2647,7 @@ static void standalone_main(void) {
     exit(1);
   }
 
+  acceptors_spawn();
   daemon_loop();
 }
 
@@ -2528,6 +3274,7 @@ int main(int argc, char *argv[], char **envp) {
   }
 
   pr_event_generate("core.postparse", NULL);
+  dispatch_plans_init();
 
   if (show_version &&
       show_version == 2) {
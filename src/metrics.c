@@ -0,0 +1,555 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Metrics: counters and latency histograms, aggregated across all session
+ * processes in an anonymous shared memory segment.
+ */
+
+#include "conf.h"
+#include "metrics.h"
+
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+#ifndef MAP_FAILED
+# define MAP_FAILED	((void *) -1)
+#endif
+
+#if defined(__GNUC__) && \
+    ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+# define METRICS_ATOMIC_ADD(ptr, val)	__sync_fetch_and_add((ptr), (val))
+# define METRICS_ATOMIC_CAS(ptr, old, new) \
+    __sync_bool_compare_and_swap((ptr), (old), (new))
+#else
+/* Without atomic operations, concurrent updates from different sessions may
+ * occasionally be lost; the metrics are then approximate.
+ */
+# define METRICS_ATOMIC_ADD(ptr, val)	(*(ptr) += (val))
+# define METRICS_ATOMIC_CAS(ptr, old, new) \
+    (*(ptr) == (old) ? (*(ptr) = (new), TRUE) : FALSE)
+#endif
+
+/* Commands with known IDs (see cmd.h) use the slot for their ID; all other
+ * commands (e.g. SFTP requests, module-specific commands) are assigned a
+ * slot, by name, from the remaining slots.
+ */
+#define METRICS_CMD_ID_SLOT_COUNT	64
+#define METRICS_CMD_SLOT_COUNT		128
+
+/* Slot keys are the first 8 bytes of the command name, packed into a single
+ * word, which can then be claimed atomically.
+ */
+#define METRICS_CMD_NAMELEN		8
+
+/* Dispatch phases are PRE_CMD (1) through LOG_CMD_ERR (6). */
+#define METRICS_PHASE_COUNT		6
+
+struct metrics_histogram {
+  uint64_t count;
+  uint64_t total_usecs;
+  uint64_t max_usecs;
+  uint64_t buckets[PR_METRICS_HISTOGRAM_BUCKET_COUNT];
+};
+
+struct metrics_cmd_slot {
+  uint64_t key;
+  struct metrics_histogram phases[METRICS_PHASE_COUNT];
+};
+
+struct metrics_segment {
+  time_t start_time;
+  struct metrics_cmd_slot cmds[METRICS_CMD_SLOT_COUNT];
+  struct metrics_histogram named[PR_METRICS_ID_MAX];
+  uint64_t counters[PR_METRICS_COUNTER_MAX];
+};
+
+static struct metrics_segment *metrics_shm = NULL;
+
+static const char *metrics_names[PR_METRICS_ID_MAX] = {
+  "auth",
+  "data-transfer",
+  "tls-handshake"
+};
+
+static const char *metrics_counter_names[PR_METRICS_COUNTER_MAX] = {
+  "bytes-in",
+  "bytes-out"
+};
+
+static const char *metrics_phase_names[METRICS_PHASE_COUNT] = {
+  "PRE_CMD",
+  "CMD",
+  "POST_CMD",
+  "POST_CMD_ERR",
+  "LOG_CMD",
+  "LOG_CMD_ERR"
+};
+
+static const char *trace_channel = "metrics";
+
+static uint64_t get_usecs(void) {
+  struct timeval tv;
+  uint64_t usecs;
+
+  if (gettimeofday(&tv, NULL) < 0) {
+    return 0;
+  }
+
+  usecs = ((uint64_t) tv.tv_sec * 1000000) + tv.tv_usec;
+  return usecs;
+}
+
+static unsigned int get_bucket_idx(uint64_t usecs) {
+  unsigned int idx, magnitude = 0, shift;
+  uint64_t val;
+
+  if (usecs < PR_METRICS_HISTOGRAM_SUB_BUCKET_COUNT) {
+    return (unsigned int) usecs;
+  }
+
+  /* Find the power of two below the value; the sub-bucket within that
+   * range is given by the bits just below its leading bit.
+   */
+  for (val = usecs; val > 1; val >>= 1) {
+    magnitude++;
+  }
+
+  shift = magnitude - PR_METRICS_HISTOGRAM_SUB_BUCKET_BITS;
+  idx = ((shift + 1) * PR_METRICS_HISTOGRAM_SUB_BUCKET_COUNT) +
+    (unsigned int) ((usecs >> shift) &
+      (PR_METRICS_HISTOGRAM_SUB_BUCKET_COUNT - 1));
+
+  if (idx >= PR_METRICS_HISTOGRAM_BUCKET_COUNT) {
+    idx = PR_METRICS_HISTOGRAM_BUCKET_COUNT - 1;
+  }
+
+  return idx;
+}
+
+/* Returns the largest value counted by the given bucket. */
+static uint64_t get_bucket_max(unsigned int idx) {
+  unsigned int shift;
+  uint64_t sub_idx;
+
+  if (idx < PR_METRICS_HISTOGRAM_SUB_BUCKET_COUNT) {
+    return idx;
+  }
+
+  shift = (idx / PR_METRICS_HISTOGRAM_SUB_BUCKET_COUNT) - 1;
+  sub_idx = PR_METRICS_HISTOGRAM_SUB_BUCKET_COUNT +
+    (idx % PR_METRICS_HISTOGRAM_SUB_BUCKET_COUNT);
+
+  return ((sub_idx + 1) << shift) - 1;
+}
+
+static void histogram_observe(struct metrics_histogram *hist,
+    uint64_t usecs) {
+  uint64_t max_usecs;
+
+  METRICS_ATOMIC_ADD(&(hist->count), 1);
+  METRICS_ATOMIC_ADD(&(hist->total_usecs), usecs);
+  METRICS_ATOMIC_ADD(&(hist->buckets[get_bucket_idx(usecs)]), 1);
+
+  max_usecs = hist->max_usecs;
+  while (usecs > max_usecs) {
+    if (METRICS_ATOMIC_CAS(&(hist->max_usecs), max_usecs, usecs)) {
+      break;
+    }
+
+    max_usecs = hist->max_usecs;
+  }
+}
+
+static int histogram_get_percentile(struct metrics_histogram *hist,
+    unsigned int pct, uint64_t *usecs) {
+  register unsigned int i;
+  uint64_t count, target, seen = 0;
+
+  count = hist->count;
+  if (count == 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  target = ((count * pct) + 99) / 100;
+  if (target == 0) {
+    target = 1;
+  }
+
+  for (i = 0; i < PR_METRICS_HISTOGRAM_BUCKET_COUNT; i++) {
+    seen += hist->buckets[i];
+    if (seen >= target) {
+      break;
+    }
+  }
+
+  if (i >= PR_METRICS_HISTOGRAM_BUCKET_COUNT - 1) {
+    *usecs = hist->max_usecs;
+
+  } else {
+    /* Report the upper bound of the bucket, but never more than the largest
+     * value actually observed.
+     */
+    *usecs = get_bucket_max(i);
+    if (*usecs > hist->max_usecs) {
+      *usecs = hist->max_usecs;
+    }
+  }
+
+  return 0;
+}
+
+static uint64_t get_cmd_key(const char *name) {
+  register unsigned int i;
+  uint64_t key = 0;
+
+  for (i = 0; i < METRICS_CMD_NAMELEN && name[i]; i++) {
+    key = (key << 8) | (unsigned char) name[i];
+  }
+
+  return key;
+}
+
+static const char *get_cmd_key_name(uint64_t key, char *buf, size_t bufsz) {
+  register unsigned int i;
+  unsigned int len = 0;
+  char name[METRICS_CMD_NAMELEN + 1];
+
+  memset(name, '\0', sizeof(name));
+  for (i = 0; i < METRICS_CMD_NAMELEN; i++) {
+    unsigned char c;
+
+    c = (unsigned char) ((key >> ((METRICS_CMD_NAMELEN - 1 - i) * 8)) & 0xff);
+    if (c != 0) {
+      name[len++] = c;
+    }
+  }
+
+  sstrncpy(buf, name, bufsz);
+  return buf;
+}
+
+static struct metrics_cmd_slot *get_cmd_slot(cmd_rec *cmd) {
+  register unsigned int i;
+  uint64_t key;
+  unsigned int idx;
+
+  key = get_cmd_key(cmd->argv[0]);
+  if (key == 0) {
+    return NULL;
+  }
+
+  if (cmd->cmd_id > 0 &&
+      cmd->cmd_id < METRICS_CMD_ID_SLOT_COUNT) {
+    idx = cmd->cmd_id;
+
+    if (metrics_shm->cmds[idx].key == 0) {
+      (void) METRICS_ATOMIC_CAS(&(metrics_shm->cmds[idx].key), 0, key);
+    }
+
+    return &(metrics_shm->cmds[idx]);
+  }
+
+  /* Open addressing, claiming a free slot for this name if necessary. */
+  idx = (unsigned int) (key % (METRICS_CMD_SLOT_COUNT -
+    METRICS_CMD_ID_SLOT_COUNT));
+
+  for (i = 0; i < METRICS_CMD_SLOT_COUNT - METRICS_CMD_ID_SLOT_COUNT; i++) {
+    struct metrics_cmd_slot *slot;
+
+    slot = &(metrics_shm->cmds[METRICS_CMD_ID_SLOT_COUNT + idx]);
+    if (slot->key == key) {
+      return slot;
+    }
+
+    if (slot->key == 0) {
+      if (METRICS_ATOMIC_CAS(&(slot->key), 0, key) ||
+          slot->key == key) {
+        return slot;
+      }
+    }
+
+    idx = (idx + 1) % (METRICS_CMD_SLOT_COUNT - METRICS_CMD_ID_SLOT_COUNT);
+  }
+
+  pr_trace_msg(trace_channel, 9,
+    "no metrics slot available for command '%s', ignoring",
+    (char *) cmd->argv[0]);
+  return NULL;
+}
+
+int pr_metrics_init(void) {
+  void *shm;
+  int mmap_flags = MAP_SHARED;
+
+  if (metrics_shm != NULL) {
+    return 0;
+  }
+
+#if defined(MAP_ANONYMOUS)
+  mmap_flags |= MAP_ANONYMOUS;
+#elif defined(MAP_ANON)
+  mmap_flags |= MAP_ANON;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+
+  shm = mmap(NULL, sizeof(struct metrics_segment), PROT_READ|PROT_WRITE,
+    mmap_flags, -1, 0);
+  if (shm == MAP_FAILED) {
+    int xerrno = errno;
+
+    pr_log_pri(PR_LOG_NOTICE, "unable to allocate %lu bytes for metrics: %s",
+      (unsigned long) sizeof(struct metrics_segment), strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Anonymous mappings are zero-filled; the pages for unused histograms
+   * are thus never touched.
+   */
+  metrics_shm = shm;
+  time(&(metrics_shm->start_time));
+
+  pr_trace_msg(trace_channel, 9, "allocated %lu bytes for metrics",
+    (unsigned long) sizeof(struct metrics_segment));
+  return 0;
+}
+
+int pr_metrics_free(void) {
+  if (metrics_shm == NULL) {
+    return 0;
+  }
+
+  if (munmap((void *) metrics_shm, sizeof(struct metrics_segment)) < 0) {
+    return -1;
+  }
+
+  metrics_shm = NULL;
+  return 0;
+}
+
+int pr_metrics_enabled(void) {
+  return metrics_shm != NULL ? TRUE : FALSE;
+}
+
+uint64_t pr_metrics_now(void) {
+  uint64_t now;
+
+  if (metrics_shm == NULL) {
+    return 0;
+  }
+
+  now = get_usecs();
+
+  /* Zero means "not timing", so make sure we never return that. */
+  return now > 0 ? now : 1;
+}
+
+int pr_metrics_cmd_observe(cmd_rec *cmd, int phase, uint64_t start_usecs) {
+  struct metrics_cmd_slot *slot;
+  uint64_t now, elapsed = 0;
+
+  if (metrics_shm == NULL ||
+      start_usecs == 0) {
+    return 0;
+  }
+
+  if (cmd == NULL ||
+      cmd->argv == NULL ||
+      cmd->argv[0] == NULL ||
+      phase < PRE_CMD ||
+      phase > LOG_CMD_ERR) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Note that if there are no free slots for the command, the observation
+   * is silently dropped; we do not want to clobber the errno value from the
+   * command handlers.
+   */
+  slot = get_cmd_slot(cmd);
+  if (slot == NULL) {
+    return 0;
+  }
+
+  now = get_usecs();
+  if (now > start_usecs) {
+    elapsed = now - start_usecs;
+  }
+
+  histogram_observe(&(slot->phases[phase - 1]), elapsed);
+  return 0;
+}
+
+int pr_metrics_observe(int metric_id, uint64_t start_usecs) {
+  uint64_t now, elapsed = 0;
+
+  if (metrics_shm == NULL ||
+      start_usecs == 0) {
+    return 0;
+  }
+
+  if (metric_id < 0 ||
+      metric_id >= PR_METRICS_ID_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  now = get_usecs();
+  if (now > start_usecs) {
+    elapsed = now - start_usecs;
+  }
+
+  histogram_observe(&(metrics_shm->named[metric_id]), elapsed);
+  return 0;
+}
+
+int pr_metrics_incr(int counter_id, uint64_t incr) {
+  if (metrics_shm == NULL) {
+    return 0;
+  }
+
+  if (counter_id < 0 ||
+      counter_id >= PR_METRICS_COUNTER_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  METRICS_ATOMIC_ADD(&(metrics_shm->counters[counter_id]), incr);
+  return 0;
+}
+
+int pr_metrics_get_percentile(int metric_id, unsigned int pct,
+    uint64_t *usecs) {
+
+  if (metric_id < 0 ||
+      metric_id >= PR_METRICS_ID_MAX ||
+      pct > 100 ||
+      usecs == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (metrics_shm == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  return histogram_get_percentile(&(metrics_shm->named[metric_id]), pct,
+    usecs);
+}
+
+int pr_metrics_get_counter(int counter_id, uint64_t *val) {
+  if (counter_id < 0 ||
+      counter_id >= PR_METRICS_COUNTER_MAX ||
+      val == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (metrics_shm == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  *val = metrics_shm->counters[counter_id];
+  return 0;
+}
+
+int pr_metrics_reset(void) {
+  if (metrics_shm == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  memset(metrics_shm, 0, sizeof(struct metrics_segment));
+  time(&(metrics_shm->start_time));
+  return 0;
+}
+
+static void dump_histogram(void (*dumpf)(const char *, ...), const char *name,
+    struct metrics_histogram *hist) {
+  uint64_t p50 = 0, p90 = 0, p99 = 0;
+
+  if (hist->count == 0) {
+    return;
+  }
+
+  (void) histogram_get_percentile(hist, 50, &p50);
+  (void) histogram_get_percentile(hist, 90, &p90);
+  (void) histogram_get_percentile(hist, 99, &p99);
+
+  dumpf("  %s: count %" PR_LU ", avg %" PR_LU " usecs, p50 %" PR_LU
+    " usecs, p90 %" PR_LU " usecs, p99 %" PR_LU " usecs, max %" PR_LU " usecs",
+    name, (pr_off_t) hist->count, (pr_off_t) (hist->total_usecs / hist->count),
+    (pr_off_t) p50, (pr_off_t) p90, (pr_off_t) p99,
+    (pr_off_t) hist->max_usecs);
+}
+
+void pr_metrics_dump(void (*dumpf)(const char *, ...)) {
+  register unsigned int i, j;
+  char buf[METRICS_CMD_NAMELEN + 32];
+
+  if (dumpf == NULL) {
+    return;
+  }
+
+  if (metrics_shm == NULL) {
+    dumpf("%s", "Metrics: disabled");
+    return;
+  }
+
+  dumpf("Metrics (since %lu):", (unsigned long) metrics_shm->start_time);
+
+  for (i = 0; i < PR_METRICS_COUNTER_MAX; i++) {
+    dumpf("  %s: %" PR_LU, metrics_counter_names[i],
+      (pr_off_t) metrics_shm->counters[i]);
+  }
+
+  for (i = 0; i < PR_METRICS_ID_MAX; i++) {
+    dump_histogram(dumpf, metrics_names[i], &(metrics_shm->named[i]));
+  }
+
+  for (i = 0; i < METRICS_CMD_SLOT_COUNT; i++) {
+    struct metrics_cmd_slot *slot;
+    char name[METRICS_CMD_NAMELEN + 1];
+
+    slot = &(metrics_shm->cmds[i]);
+    if (slot->key == 0) {
+      continue;
+    }
+
+    get_cmd_key_name(slot->key, name, sizeof(name));
+
+    for (j = 0; j < METRICS_PHASE_COUNT; j++) {
+      memset(buf, '\0', sizeof(buf));
+      snprintf(buf, sizeof(buf)-1, "%s %s", metrics_phase_names[j], name);
+      dump_histogram(dumpf, buf, &(slot->phases[j]));
+    }
+  }
+}
@@ -32,6 +32,13 @@
 #if HAVE_IFADDRS_H
 # include <ifaddrs.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+#ifndef MAP_FAILED
+# define MAP_FAILED	((void *) -1)
+#endif
 
 /* Define an IPv4 equivalent of the IN6_IS_ADDR_LOOPBACK macro. */
 #undef IN_IS_ADDR_LOOPBACK
@@ -64,6 +71,201 @@ static pr_table_t *netaddr_dnstab = NULL;
 
 static const char *trace_channel = "dns";
 
+/* The shared reverse DNS cache lives in an anonymous shared memory segment,
+ * allocated by the daemon process and thus inherited by all session
+ * processes.  Each entry maps an IP address string to the verified DNS names
+ * for that address (NUL-separated, the preferred name first); an entry with
+ * no names records a failed lookup (a "negative" entry).
+ *
+ * Entries are protected by a sequence number (seqlock): a writer makes the
+ * sequence number odd while updating the entry, and readers retry/ignore an
+ * entry whose sequence number was odd or changed while they were copying
+ * it.  Lookups thus never block.  Writers which lose the race to update an
+ * entry simply do not cache their result.
+ */
+#if defined(__GNUC__) && \
+    ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+# define NETADDR_HAVE_SHAREDCACHE	1
+#endif
+
+#define NETADDR_SHAREDCACHE_PROBES	4
+#define NETADDR_SHAREDCACHE_IPSZ	64
+#define NETADDR_SHAREDCACHE_NAMESZ	512
+
+struct netaddr_sharedcache_entry {
+  unsigned int seqno;
+  time_t expires;
+  char ip_str[NETADDR_SHAREDCACHE_IPSZ];
+  size_t nameslen;
+  char names[NETADDR_SHAREDCACHE_NAMESZ];
+};
+
+struct netaddr_sharedcache {
+  unsigned int nentries;
+  int ttl, negative_ttl;
+  unsigned long nhits, nmisses, nstored;
+  struct netaddr_sharedcache_entry entries[1];
+};
+
+static struct netaddr_sharedcache *netaddr_sharedcache = NULL;
+static size_t netaddr_sharedcachesz = 0;
+
+static unsigned int netaddr_sharedcache_hash(const char *ip_str) {
+  unsigned int h = 2166136261U;
+
+  /* FNV-1a */
+  while (*ip_str) {
+    h ^= (unsigned char) *ip_str++;
+    h *= 16777619U;
+  }
+
+  return h;
+}
+
+#if defined(NETADDR_HAVE_SHAREDCACHE)
+/* Copy the entry, returning -1 if it was being written concurrently. */
+static int netaddr_sharedcache_read(struct netaddr_sharedcache_entry *entry,
+    struct netaddr_sharedcache_entry *copy) {
+  unsigned int seqno;
+
+  seqno = *((volatile unsigned int *) &(entry->seqno));
+  if (seqno & 1) {
+    return -1;
+  }
+
+  __sync_synchronize();
+  memcpy(copy, entry, sizeof(struct netaddr_sharedcache_entry));
+  __sync_synchronize();
+
+  if (*((volatile unsigned int *) &(entry->seqno)) != seqno) {
+    return -1;
+  }
+
+  return 0;
+}
+#endif /* NETADDR_HAVE_SHAREDCACHE */
+
+/* Look up the given IP address in the shared cache.  On a hit, the cached
+ * names (if any) are copied into the given buffer, and their total length
+ * is returned; a return value of zero indicates a cached failed lookup.
+ * Returns -1, with errno set to ENOENT, on a miss.
+ */
+static int netaddr_sharedcache_get(const char *ip_str, char *names,
+    size_t namesz) {
+#if defined(NETADDR_HAVE_SHAREDCACHE)
+  register unsigned int i;
+  unsigned int h;
+  time_t now;
+
+  if (netaddr_sharedcache == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  h = netaddr_sharedcache_hash(ip_str);
+  time(&now);
+
+  for (i = 0; i < NETADDR_SHAREDCACHE_PROBES; i++) {
+    struct netaddr_sharedcache_entry *entry, copy;
+
+    entry = &(netaddr_sharedcache->entries[(h + i) %
+      netaddr_sharedcache->nentries]);
+    if (netaddr_sharedcache_read(entry, &copy) < 0) {
+      continue;
+    }
+
+    if (copy.expires == 0 ||
+        strncmp(copy.ip_str, ip_str, sizeof(copy.ip_str)) != 0) {
+      continue;
+    }
+
+    if (copy.expires <= now ||
+        copy.nameslen >= namesz) {
+      break;
+    }
+
+    memcpy(names, copy.names, copy.nameslen);
+    names[copy.nameslen] = '\0';
+
+    __sync_fetch_and_add(&(netaddr_sharedcache->nhits), 1);
+    pr_trace_msg(trace_channel, 8,
+      "using %s result for IP address '%s' from shared DNS cache",
+      copy.nameslen > 0 ? "cached" : "cached failed", ip_str);
+    return (int) copy.nameslen;
+  }
+
+  __sync_fetch_and_add(&(netaddr_sharedcache->nmisses), 1);
+#endif /* NETADDR_HAVE_SHAREDCACHE */
+
+  errno = ENOENT;
+  return -1;
+}
+
+/* Store the given names (NUL-separated, possibly empty) for the given IP
+ * address in the shared cache.
+ */
+static void netaddr_sharedcache_set(const char *ip_str, const char *names,
+    size_t nameslen) {
+#if defined(NETADDR_HAVE_SHAREDCACHE)
+  register unsigned int i;
+  unsigned int h, seqno;
+  struct netaddr_sharedcache_entry *slot = NULL;
+  time_t now;
+
+  if (netaddr_sharedcache == NULL ||
+      strlen(ip_str) >= NETADDR_SHAREDCACHE_IPSZ ||
+      nameslen >= NETADDR_SHAREDCACHE_NAMESZ) {
+    return;
+  }
+
+  h = netaddr_sharedcache_hash(ip_str);
+  time(&now);
+
+  /* Prefer the slot already holding this address, then an unused or expired
+   * slot, then the slot expiring soonest.  These unlocked reads only guide
+   * the choice of slot.
+   */
+  for (i = 0; i < NETADDR_SHAREDCACHE_PROBES; i++) {
+    struct netaddr_sharedcache_entry *entry;
+
+    entry = &(netaddr_sharedcache->entries[(h + i) %
+      netaddr_sharedcache->nentries]);
+    if (strncmp(entry->ip_str, ip_str, sizeof(entry->ip_str)) == 0) {
+      slot = entry;
+      break;
+    }
+
+    if (slot == NULL ||
+        entry->expires < slot->expires) {
+      slot = entry;
+    }
+  }
+
+  seqno = *((volatile unsigned int *) &(slot->seqno));
+  if ((seqno & 1) ||
+      !__sync_bool_compare_and_swap(&(slot->seqno), seqno, seqno + 1)) {
+    /* Another process is updating this slot; skip caching. */
+    return;
+  }
+
+  __sync_synchronize();
+  sstrncpy(slot->ip_str, ip_str, sizeof(slot->ip_str));
+  if (nameslen > 0) {
+    memcpy(slot->names, names, nameslen);
+  }
+  slot->nameslen = nameslen;
+  slot->expires = now + (nameslen > 0 ? netaddr_sharedcache->ttl :
+    netaddr_sharedcache->negative_ttl);
+  __sync_synchronize();
+  slot->seqno = seqno + 2;
+
+  __sync_fetch_and_add(&(netaddr_sharedcache->nstored), 1);
+  pr_trace_msg(trace_channel, 8,
+    "stashed %s result for IP address '%s' in shared DNS cache",
+    nameslen > 0 ? "lookup" : "failed lookup", ip_str);
+#endif /* NETADDR_HAVE_SHAREDCACHE */
+}
+
 /* Netaddr cache management */
 static array_header *netaddr_dnscache_get(pool *p, const char *ip_str) {
   array_header *res = NULL;
@@ -227,6 +429,58 @@ static int netaddr_ipcache_set(const char *name, const pr_netaddr_t *na) {
   return 0;
 }
 
+/* Store the given verified DNS name (NULL for a failed lookup), along with
+ * any other names verified for the IP address, in the shared cache.
+ */
+static void netaddr_sharedcache_add(const char *ip_str, const char *name) {
+  char names[NETADDR_SHAREDCACHE_NAMESZ];
+  size_t nameslen;
+  array_header *dns_names;
+
+  if (netaddr_sharedcache == NULL) {
+    return;
+  }
+
+  if (name == NULL) {
+    netaddr_sharedcache_set(ip_str, NULL, 0);
+    return;
+  }
+
+  /* The name to use goes first, followed by any aliases. */
+  nameslen = strlen(name) + 1;
+  if (nameslen >= sizeof(names)) {
+    return;
+  }
+
+  memcpy(names, name, nameslen);
+
+  dns_names = netaddr_dnscache_get(NULL, ip_str);
+  if (dns_names != NULL) {
+    register unsigned int i;
+    char **elts;
+
+    elts = dns_names->elts;
+    for (i = 0; i < dns_names->nelts; i++) {
+      size_t len;
+
+      if (elts[i] == NULL ||
+          strcmp(elts[i], name) == 0) {
+        continue;
+      }
+
+      len = strlen(elts[i]) + 1;
+      if (nameslen + len >= sizeof(names)) {
+        break;
+      }
+
+      memcpy(names + nameslen, elts[i], len);
+      nameslen += len;
+    }
+  }
+
+  netaddr_sharedcache_set(ip_str, names, nameslen);
+}
+
 /* Provide replacements for needed functions. */
 
 #if !defined(HAVE_GETNAMEINFO) || defined(PR_USE_GETNAMEINFO)
@@ -1889,39 +2143,62 @@ const char *pr_netaddr_get_dnsstr(const pr_netaddr_t *na) {
 
   if (reverse_dns) {
     int res = 0;
+    const char *ip_str;
 
-    pr_trace_msg(trace_channel, 3,
-      "verifying DNS name for IP address %s via reverse DNS lookup",
-      pr_netaddr_get_ipstr(na));
+    ip_str = pr_netaddr_get_ipstr(na);
 
-    memset(dns_buf, '\0', sizeof(dns_buf));
-    res = pr_getnameinfo(pr_netaddr_get_sockaddr(na),
-      pr_netaddr_get_sockaddr_len(na), dns_buf, sizeof(dns_buf), NULL, 0,
-      NI_NAMEREQD);
-    dns_buf[sizeof(dns_buf)-1] = '\0';
+    /* Another process may already have resolved this address for us. */
+    res = netaddr_sharedcache_get(ip_str, dns_buf, sizeof(dns_buf));
+    if (res > 0) {
+      const char *ptr;
 
-    if (res == 0) {
-      /* Some older glibc's getaddrinfo(3) does not appear to handle IPv6
-       * addresses properly; we thus prefer gethostbyname2(3) on systems
-       * which have it, for such older systems.
+      /* Populate our per-process caches with all of the cached names; the
+       * first of them is the name to use.
        */
+      for (ptr = dns_buf; ptr < dns_buf + res; ptr += strlen(ptr) + 1) {
+        netaddr_dnscache_set(ip_str, ptr);
+
+        if (ptr != dns_buf) {
+          netaddr_ipcache_set(ptr, na);
+        }
+      }
+
+      name = dns_buf;
+
+    } else if (res < 0) {
+      pr_trace_msg(trace_channel, 3,
+        "verifying DNS name for IP address %s via reverse DNS lookup", ip_str);
+
+      memset(dns_buf, '\0', sizeof(dns_buf));
+      res = pr_getnameinfo(pr_netaddr_get_sockaddr(na),
+        pr_netaddr_get_sockaddr_len(na), dns_buf, sizeof(dns_buf), NULL, 0,
+        NI_NAMEREQD);
+      dns_buf[sizeof(dns_buf)-1] = '\0';
+
+      if (res == 0) {
+        /* Some older glibc's getaddrinfo(3) does not appear to handle IPv6
+         * addresses properly; we thus prefer gethostbyname2(3) on systems
+         * which have it, for such older systems.
+         */
 #ifdef HAVE_GETHOSTBYNAME2
-      res = netaddr_get_dnsstr_gethostbyname(na, dns_buf);
+        res = netaddr_get_dnsstr_gethostbyname(na, dns_buf);
 #else
-      res = netaddr_get_dnsstr_getaddrinfo(na, dns_buf);
+        res = netaddr_get_dnsstr_getaddrinfo(na, dns_buf);
 #endif /* HAVE_GETHOSTBYNAME2 */
-      if (res == 0) {
-        name = dns_buf;
-        pr_trace_msg(trace_channel, 8,
-          "using DNS name '%s' for IP address '%s'", name,
-          pr_netaddr_get_ipstr(na));
+        if (res == 0) {
+          name = pr_netaddr_validate_dns_str(dns_buf);
+          pr_trace_msg(trace_channel, 8,
+            "using DNS name '%s' for IP address '%s'", name, ip_str);
 
-      } else {
-        name = NULL;
-        pr_trace_msg(trace_channel, 8,
-          "unable to verify any DNS names for IP address '%s'",
-          pr_netaddr_get_ipstr(na));
+        } else {
+          name = NULL;
+          pr_trace_msg(trace_channel, 8,
+            "unable to verify any DNS names for IP address '%s'", ip_str);
+        }
       }
+
+      /* Share the result, successful or not, with the other processes. */
+      netaddr_sharedcache_add(ip_str, name);
     }
 
   } else {
@@ -1929,10 +2206,7 @@ const char *pr_netaddr_get_dnsstr(const pr_netaddr_t *na) {
       "UseReverseDNS off, returning IP address instead of DNS name");
   }
 
-  if (name) {
-    name = pr_netaddr_validate_dns_str(name);
-
-  } else {
+  if (name == NULL) {
     name = (char *) pr_netaddr_get_ipstr(na);
   }
 
@@ -2447,6 +2721,100 @@ void pr_netaddr_clear_ipcache(const char *name) {
   }
 }
 
+int pr_netaddr_sharedcache_init(unsigned int nentries, int ttl,
+    int negative_ttl) {
+#if defined(NETADDR_HAVE_SHAREDCACHE)
+  void *shm;
+  size_t shmsz;
+  int mmap_flags = MAP_SHARED;
+
+  if (nentries == 0 ||
+      ttl < 0 ||
+      negative_ttl < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (netaddr_sharedcache != NULL) {
+    errno = EEXIST;
+    return -1;
+  }
+
+# if defined(MAP_ANONYMOUS)
+  mmap_flags |= MAP_ANONYMOUS;
+# elif defined(MAP_ANON)
+  mmap_flags |= MAP_ANON;
+# else
+  errno = ENOSYS;
+  return -1;
+# endif
+
+  shmsz = sizeof(struct netaddr_sharedcache) +
+    ((nentries - 1) * sizeof(struct netaddr_sharedcache_entry));
+
+  shm = mmap(NULL, shmsz, PROT_READ|PROT_WRITE, mmap_flags, -1, 0);
+  if (shm == MAP_FAILED) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 1,
+      "unable to allocate %lu bytes for shared DNS cache: %s",
+      (unsigned long) shmsz, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  memset(shm, 0, shmsz);
+  netaddr_sharedcache = shm;
+  netaddr_sharedcachesz = shmsz;
+
+  netaddr_sharedcache->nentries = nentries;
+  netaddr_sharedcache->ttl = ttl;
+  netaddr_sharedcache->negative_ttl = negative_ttl;
+
+  pr_trace_msg(trace_channel, 9,
+    "allocated %lu bytes for shared DNS cache (%u entries, TTL %d secs, "
+    "negative TTL %d secs)", (unsigned long) shmsz, nentries, ttl,
+    negative_ttl);
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* NETADDR_HAVE_SHAREDCACHE */
+}
+
+int pr_netaddr_sharedcache_free(void) {
+  if (netaddr_sharedcache == NULL) {
+    return 0;
+  }
+
+  if (munmap((void *) netaddr_sharedcache, netaddr_sharedcachesz) < 0) {
+    return -1;
+  }
+
+  netaddr_sharedcache = NULL;
+  netaddr_sharedcachesz = 0;
+  return 0;
+}
+
+int pr_netaddr_sharedcache_get_stats(unsigned long *hits,
+    unsigned long *misses) {
+  if (hits == NULL ||
+      misses == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (netaddr_sharedcache == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  *hits = netaddr_sharedcache->nhits;
+  *misses = netaddr_sharedcache->nmisses;
+  return 0;
+}
+
 void init_netaddr(void) {
   if (netaddr_pool) {
     pr_netaddr_clear_cache();
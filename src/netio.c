@@ -76,6 +76,40 @@ static pr_netio_t *default_othr_netio = NULL, *othr_netio = NULL;
  */
 static int properly_terminated_prev_command = TRUE;
 
+/* Data written to a corked stream is collected in this buffer, rather than
+ * being written out immediately, until the stream is uncorked (or the buffer
+ * fills up).  Only one stream, i.e. the control connection, is corked at a
+ * time.
+ */
+#define NETIO_CORK_BUFFER_SIZE		(PR_TUNABLE_BUFFER_SIZE * 4)
+static pr_netio_stream_t *corked_nstrm = NULL;
+static char *cork_buf = NULL;
+static size_t cork_buflen = 0;
+
+static int netio_cork_flush(pr_netio_stream_t *nstrm) {
+  int res;
+  size_t buflen;
+
+  if (cork_buflen == 0) {
+    return 0;
+  }
+
+  pr_trace_msg(trace_channel, 19, "writing %lu bytes of corked data",
+    (unsigned long) cork_buflen);
+
+  /* Clear the buffer first, lest pr_netio_write() try to buffer this data
+   * again.
+   */
+  buflen = cork_buflen;
+  cork_buflen = 0;
+
+  corked_nstrm = NULL;
+  res = pr_netio_write(nstrm, cork_buf, buflen);
+  corked_nstrm = nstrm;
+
+  return res < 0 ? -1 : 0;
+}
+
 static pr_netio_stream_t *netio_stream_alloc(pool *parent_pool) {
   pool *netio_pool = NULL;
   pr_netio_stream_t *nstrm = NULL;
@@ -336,6 +370,10 @@ int pr_netio_close(pr_netio_stream_t *nstrm) {
     return -1;
   }
 
+  if (nstrm == corked_nstrm) {
+    (void) pr_netio_uncork(nstrm);
+  }
+
   nstrm_mode = netio_stream_mode(nstrm->strm_mode);
 
   switch (nstrm->strm_type) {
@@ -427,6 +465,10 @@ static int netio_lingering_close(pr_netio_stream_t *nstrm, long linger,
     return 0;
   }
 
+  if (nstrm == corked_nstrm) {
+    (void) pr_netio_uncork(nstrm);
+  }
+
   nstrm_mode = netio_stream_mode(nstrm->strm_mode);
 
   if (!(flags & NETIO_LINGERING_CLOSE_FL_NO_SHUTDOWN)) {
@@ -1030,8 +1072,96 @@ int pr_netio_printf_async(pr_netio_stream_t *nstrm, char *fmt, ...) {
   return pr_netio_write_async(nstrm, buf, strlen(buf));
 }
 
+int pr_netio_cork(pr_netio_stream_t *nstrm) {
+  if (nstrm == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (nstrm == corked_nstrm) {
+    return 0;
+  }
+
+  if (corked_nstrm != NULL) {
+    (void) pr_netio_uncork(corked_nstrm);
+  }
+
+  if (cork_buf == NULL) {
+    cork_buf = malloc(NETIO_CORK_BUFFER_SIZE);
+    if (cork_buf == NULL) {
+      pr_log_pri(PR_LOG_ALERT, "Out of memory!");
+      exit(1);
+    }
+  }
+
+  pr_trace_msg(trace_channel, 19, "corking %s stream",
+    netio_stream_mode(nstrm->strm_mode));
+  corked_nstrm = nstrm;
+  cork_buflen = 0;
+
+  return 0;
+}
+
+int pr_netio_uncork(pr_netio_stream_t *nstrm) {
+  int res;
+
+  if (nstrm == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (nstrm != corked_nstrm) {
+    return 0;
+  }
+
+  pr_trace_msg(trace_channel, 19, "uncorking %s stream",
+    netio_stream_mode(nstrm->strm_mode));
+
+  res = netio_cork_flush(nstrm);
+  corked_nstrm = NULL;
+
+  return res;
+}
+
+/* Returns the ID of the read/write event for the given stream type, looked
+ * up on first use; these events are generated for every read/write.
+ */
+static int netio_event_id(int strm_type, int reading) {
+  static int event_ids[2][3] = { { -1, -1, -1 }, { -1, -1, -1 } };
+  static const char *event_names[2][3] = {
+    { "core.ctrl-write", "core.data-write", "core.othr-write" },
+    { "core.ctrl-read", "core.data-read", "core.othr-read" }
+  };
+  int idx;
+
+  switch (strm_type) {
+    case PR_NETIO_STRM_CTRL:
+      idx = 0;
+      break;
+
+    case PR_NETIO_STRM_DATA:
+      idx = 1;
+      break;
+
+    case PR_NETIO_STRM_OTHR:
+      idx = 2;
+      break;
+
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+
+  reading = reading ? 1 : 0;
+  if (event_ids[reading][idx] < 0) {
+    event_ids[reading][idx] = pr_event_get_id(event_names[reading][idx]);
+  }
+
+  return event_ids[reading][idx];
+}
+
 int pr_netio_write(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
-  int bwritten = 0, total = 0;
+  int bwritten = 0, total = 0, event_id;
   const char *nstrm_mode;
   pr_buffer_t *pbuf;
   pool *tmp_pool;
@@ -1049,6 +1179,22 @@ int pr_netio_write(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
     return -1;
   }
 
+  if (nstrm == corked_nstrm) {
+    if (cork_buflen + buflen > NETIO_CORK_BUFFER_SIZE) {
+      if (netio_cork_flush(nstrm) < 0) {
+        return -1;
+      }
+    }
+
+    if (buflen <= NETIO_CORK_BUFFER_SIZE) {
+      memcpy(cork_buf + cork_buflen, buf, buflen);
+      cork_buflen += buflen;
+      return (int) buflen;
+    }
+
+    /* Too large to buffer; write it out directly. */
+  }
+
   nstrm_mode = netio_stream_mode(nstrm->strm_mode);
 
   /* Before we send out the data to the client, generate an event
@@ -1062,32 +1208,23 @@ int pr_netio_write(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
    * pr_buffer_t out of that.  Then simply destroy the subpool when done.
    */
 
-  tmp_pool = make_sub_pool(nstrm->strm_pool);
-  pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
-  pbuf->buf = buf;
-  pbuf->buflen = buflen;
-  pbuf->current = pbuf->buf;
-  pbuf->remaining = 0;
-
-  switch (nstrm->strm_type) {
-    case PR_NETIO_STRM_CTRL:
-      pr_event_generate("core.ctrl-write", pbuf);
-      break;
+  event_id = netio_event_id(nstrm->strm_type, FALSE);
+  if (pr_event_listening_id(event_id) > 0) {
+    tmp_pool = make_sub_pool(nstrm->strm_pool);
+    pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
+    pbuf->buf = buf;
+    pbuf->buflen = buflen;
+    pbuf->current = pbuf->buf;
+    pbuf->remaining = 0;
 
-    case PR_NETIO_STRM_DATA:
-      pr_event_generate("core.data-write", pbuf);
-      break;
+    pr_event_generate_id(event_id, pbuf);
 
-    case PR_NETIO_STRM_OTHR:
-      pr_event_generate("core.othr-write", pbuf);
-      break;
+    /* The event listeners may have changed the data to write out. */
+    buf = pbuf->buf;
+    buflen = pbuf->buflen - pbuf->remaining;
+    destroy_pool(tmp_pool);
   }
 
-  /* The event listeners may have changed the data to write out. */
-  buf = pbuf->buf;
-  buflen = pbuf->buflen - pbuf->remaining;
-  destroy_pool(tmp_pool);
-
   while (buflen) {
 
     switch (pr_netio_poll(nstrm)) {
@@ -1175,7 +1312,7 @@ int pr_netio_write(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
 }
 
 int pr_netio_write_async(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
-  int bwritten = 0, flags = 0, total = 0;
+  int bwritten = 0, flags = 0, total = 0, event_id;
   const char *nstrm_mode;
   pr_buffer_t *pbuf;
   pool *tmp_pool;
@@ -1191,6 +1328,46 @@ int pr_netio_write_async(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
     return -1;
   }
 
+  if (nstrm == corked_nstrm &&
+      cork_buflen > 0) {
+    int res;
+    size_t corked_len;
+
+    /* Any corked data must be written out first, to preserve the order of
+     * the data; here it too is written without blocking.  Whatever cannot
+     * be written now stays corked, followed by the given data, until the
+     * stream is uncorked.
+     */
+    corked_len = cork_buflen;
+    cork_buflen = 0;
+
+    res = pr_netio_write_async(nstrm, cork_buf, corked_len);
+    if (res < 0) {
+      cork_buflen = corked_len;
+      return -1;
+    }
+
+    if ((size_t) res < corked_len) {
+      cork_buflen = corked_len - res;
+      memmove(cork_buf, cork_buf + res, cork_buflen);
+
+      pr_trace_msg(trace_channel, 19, "unable to write %lu bytes of corked "
+        "data without blocking, keeping them corked",
+        (unsigned long) cork_buflen);
+
+      if (cork_buflen + buflen > NETIO_CORK_BUFFER_SIZE) {
+        /* As for any other data which cannot be written without blocking,
+         * give up on this data.
+         */
+        return 0;
+      }
+
+      memcpy(cork_buf + cork_buflen, buf, buflen);
+      cork_buflen += buflen;
+      return (int) buflen;
+    }
+  }
+
   /* Prepare the descriptor for nonblocking IO. */
   flags = fcntl(nstrm->strm_fd, F_GETFL);
   if (flags < 0) {
@@ -1207,32 +1384,23 @@ int pr_netio_write_async(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
    * for any listeners which may want to examine this data.
    */
 
-  tmp_pool = make_sub_pool(nstrm->strm_pool);
-  pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
-  pbuf->buf = buf;
-  pbuf->buflen = buflen;
-  pbuf->current = pbuf->buf;
-  pbuf->remaining = 0;
-
-  switch (nstrm->strm_type) {
-    case PR_NETIO_STRM_CTRL:
-      pr_event_generate("core.ctrl-write", pbuf);
-      break;
+  event_id = netio_event_id(nstrm->strm_type, FALSE);
+  if (pr_event_listening_id(event_id) > 0) {
+    tmp_pool = make_sub_pool(nstrm->strm_pool);
+    pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
+    pbuf->buf = buf;
+    pbuf->buflen = buflen;
+    pbuf->current = pbuf->buf;
+    pbuf->remaining = 0;
 
-    case PR_NETIO_STRM_DATA:
-      pr_event_generate("core.data-write", pbuf);
-      break;
+    pr_event_generate_id(event_id, pbuf);
 
-    case PR_NETIO_STRM_OTHR:
-      pr_event_generate("core.othr-write", pbuf);
-      break;
+    /* The event listeners may have changed the data to write out. */
+    buf = pbuf->buf;
+    buflen = pbuf->buflen - pbuf->remaining;
+    destroy_pool(tmp_pool);
   }
 
-  /* The event listeners may have changed the data to write out. */
-  buf = pbuf->buf;
-  buflen = pbuf->buflen - pbuf->remaining;
-  destroy_pool(tmp_pool);
-
   while (buflen) {
     do {
 
@@ -1317,7 +1485,7 @@ int pr_netio_write_async(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
 
 int pr_netio_read(pr_netio_stream_t *nstrm, char *buf, size_t buflen,
     int bufmin) {
-  int bread = 0, total = 0;
+  int bread = 0, total = 0, event_id;
   const char *nstrm_mode;
   pr_buffer_t *pbuf;
   pool *tmp_pool;
@@ -1466,32 +1634,23 @@ int pr_netio_read(pr_netio_stream_t *nstrm, char *buf, size_t buflen,
      * pr_buffer_t out of that.  Then simply destroy the subpool when done.
      */
 
-    tmp_pool = make_sub_pool(nstrm->strm_pool);
-    pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
-    pbuf->buf = buf;
-    pbuf->buflen = bread;
-    pbuf->current = pbuf->buf;
-    pbuf->remaining = 0;
+    event_id = netio_event_id(nstrm->strm_type, TRUE);
+    if (pr_event_listening_id(event_id) > 0) {
+      tmp_pool = make_sub_pool(nstrm->strm_pool);
+      pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
+      pbuf->buf = buf;
+      pbuf->buflen = bread;
+      pbuf->current = pbuf->buf;
+      pbuf->remaining = 0;
 
-    switch (nstrm->strm_type) {
-      case PR_NETIO_STRM_CTRL:
-        pr_event_generate("core.ctrl-read", pbuf);
-        break;
+      pr_event_generate_id(event_id, pbuf);
 
-      case PR_NETIO_STRM_DATA:
-        pr_event_generate("core.data-read", pbuf);
-        break;
-
-      case PR_NETIO_STRM_OTHR:
-        pr_event_generate("core.othr-read", pbuf);
-        break;
+      /* The event listeners may have changed the data read in out. */
+      buf = pbuf->buf;
+      bread = pbuf->buflen - pbuf->remaining;
+      destroy_pool(tmp_pool);
     }
 
-    /* The event listeners may have changed the data read in out. */
-    buf = pbuf->buf;
-    bread = pbuf->buflen - pbuf->remaining;
-    destroy_pool(tmp_pool);
-
     buf += bread;
     total += bread;
     bufmin -= bread;
@@ -1613,7 +1772,7 @@ char *pr_netio_gets(char *buf, size_t buflen, pr_netio_stream_t *nstrm) {
        * network, generate an event for any listeners which may want to
        * examine this data as well.
        */
-      pr_event_generate("core.othr-read", pbuf);
+      pr_event_generate_id(netio_event_id(PR_NETIO_STRM_OTHR, TRUE), pbuf);
     }
 
     toread = pbuf->buflen - pbuf->remaining;
@@ -1702,7 +1861,7 @@ int pr_netio_telnet_gets2(char *buf, size_t bufsz,
        * network, handing any Telnet characters and such, generate an event
        * for any listeners which may want to examine this data as well.
        */
-      pr_event_generate("core.ctrl-read", pbuf);
+      pr_event_generate_id(netio_event_id(PR_NETIO_STRM_CTRL, TRUE), pbuf);
     }
 
     toread = pbuf->buflen - pbuf->remaining;
@@ -1857,6 +2016,30 @@ int pr_netio_telnet_gets2(char *buf, size_t bufsz,
   return (bufsz - buflen - 1);
 }
 
+int pr_netio_telnet_pending(pr_netio_stream_t *nstrm) {
+  pr_buffer_t *pbuf;
+  size_t unread;
+
+  if (nstrm == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pbuf = nstrm->strm_buf;
+  if (pbuf == NULL ||
+      pbuf->current == NULL ||
+      pbuf->remaining >= pbuf->buflen) {
+    return FALSE;
+  }
+
+  unread = pbuf->buflen - pbuf->remaining;
+  if (memchr(pbuf->current, '\n', unread) == NULL) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 char *pr_netio_telnet_gets(char *buf, size_t bufsz,
     pr_netio_stream_t *in_nstrm, pr_netio_stream_t *out_nstrm) {
   int res;
@@ -29,6 +29,7 @@
 #ifdef PR_USE_REDIS
 
 #include <hiredis/hiredis.h>
+#include <poll.h>
 
 #ifndef REDIS_CONNECT_RETRIES
 # define REDIS_CONNECT_RETRIES	10
@@ -53,6 +54,31 @@ struct redis_rec {
   pr_table_t *namespace_tab;
 };
 
+/* Commands queued on a pipeline are kept here, rather than written into
+ * the hiredis output buffer as they are queued; a pipeline which is
+ * abandoned without being executed must not leave commands behind, whose
+ * replies would then be read by the next command on the connection.
+ */
+struct redis_pipeline_cmd {
+  const char *name;
+
+  /* The command name and arguments, and their lengths. */
+  array_header *args;
+  array_header *argszs;
+};
+
+struct redis_pipeline_rec {
+  pool *pool;
+  pr_redis_t *redis;
+  module *owner;
+
+  /* Queued commands, as struct redis_pipeline_cmd pointers, allocated from
+   * a subpool which is destroyed once the commands have been executed.
+   */
+  pool *cmd_pool;
+  array_header *cmds;
+};
+
 static array_header *redis_sentinels = NULL;
 static const char *redis_sentinel_master = NULL;
 
@@ -64,6 +90,9 @@ static const char *redis_db_idx = NULL;
 
 static pr_redis_t *sess_redis = NULL;
 
+/* Unix domain socket path of the broker, if any, to use for connections. */
+static const char *redis_broker_path = NULL;
+
 static unsigned long redis_connect_millis = 500;
 static unsigned long redis_io_millis = 500;
 
@@ -194,6 +223,35 @@ static int ping_server(pr_redis_t *redis) {
   return 0;
 }
 
+/* Checks that the broker is usable, i.e. that it is connected to the Redis
+ * server; the broker replies with an error if not.
+ */
+static int ping_broker(pr_redis_t *redis) {
+  const char *cmd;
+  redisReply *reply;
+
+  cmd = "PING";
+  pr_trace_msg(trace_channel, 7, "sending command to broker: %s", cmd);
+  reply = redisCommand(redis->ctx, "%s", cmd);
+  if (reply == NULL) {
+    errno = EIO;
+    return -1;
+  }
+
+  if (reply->type != REDIS_REPLY_STATUS) {
+    if (reply->type == REDIS_REPLY_ERROR) {
+      pr_trace_msg(trace_channel, 3, "broker %s error: %s", cmd, reply->str);
+    }
+
+    freeReplyObject(reply);
+    errno = ENOTCONN;
+    return -1;
+  }
+
+  freeReplyObject(reply);
+  return 0;
+}
+
 static int stat_server(pr_redis_t *redis, const char *section) {
   const char *cmd;
   redisReply *reply;
@@ -408,16 +466,10 @@ static int discover_redis_master(pool *p, const char *host, int port,
   return res;
 }
 
-pr_redis_t *pr_redis_conn_new(pool *p, module *m, unsigned long flags) {
-  int default_port, res, xerrno;
-  pr_redis_t *redis;
+static pr_redis_t *make_server_conn(pool *p) {
+  int default_port;
   const char *default_host;
 
-  if (p == NULL) {
-    errno = EINVAL;
-    return NULL;
-  }
-
   default_host = redis_server;
   default_port = redis_port;
 
@@ -462,11 +514,50 @@ pr_redis_t *pr_redis_conn_new(pool *p, module *m, unsigned long flags) {
     return NULL;
   }
 
-  redis = make_redis_conn(p, redis_server, redis_port);
-  if (redis == NULL) {
+  return make_redis_conn(p, redis_server, redis_port);
+}
+
+pr_redis_t *pr_redis_conn_new(pool *p, module *m, unsigned long flags) {
+  int brokered = FALSE, res, xerrno;
+  pr_redis_t *redis = NULL;
+
+  if (p == NULL) {
+    errno = EINVAL;
     return NULL;
   }
 
+  if (redis_broker_path != NULL) {
+    redis = make_redis_conn(p, redis_broker_path, -1);
+    if (redis != NULL) {
+      redis->refcount = 1;
+
+      /* If the broker cannot reach the Redis server, try it ourselves. */
+      if (ping_broker(redis) == 0) {
+        brokered = TRUE;
+
+      } else {
+        pr_trace_msg(trace_channel, 9,
+          "Redis broker at '%s' unusable (%s), connecting to server directly",
+          redis_broker_path, strerror(errno));
+        (void) pr_redis_conn_destroy(redis);
+        redis = NULL;
+      }
+
+    } else {
+      /* This is expected once chrooted, for example. */
+      pr_trace_msg(trace_channel, 9,
+        "unable to connect to Redis broker at '%s' (%s), connecting to "
+        "server directly", redis_broker_path, strerror(errno));
+    }
+  }
+
+  if (redis == NULL) {
+    redis = make_server_conn(p);
+    if (redis == NULL) {
+      return NULL;
+    }
+  }
+
   redis->owner = m;
   redis->refcount = 1;
   redis->flags = flags;
@@ -486,28 +577,32 @@ pr_redis_t *pr_redis_conn_new(pool *p, module *m, unsigned long flags) {
     return NULL;    
   }
 
-  res = ping_server(redis);
-  if (res < 0) {
-    xerrno = errno;
-
-    pr_redis_conn_destroy(redis);
-    errno = xerrno;
-    return NULL;
-  }
-
   /* Make sure we are connected to the configured server by querying
-   * some stats/info from it.
+   * some stats/info from it.  The broker has already done this, as well as
+   * any authentication and database selection, for its own connections.
    */
-  res = stat_server(redis, "server");
-  if (res < 0) {
-    xerrno = errno;
+  if (brokered == FALSE) {
+    res = ping_server(redis);
+    if (res < 0) {
+      xerrno = errno;
 
-    pr_redis_conn_destroy(redis);
-    errno = xerrno;
-    return NULL;    
+      pr_redis_conn_destroy(redis);
+      errno = xerrno;
+      return NULL;
+    }
+
+    res = stat_server(redis, "server");
+    if (res < 0) {
+      xerrno = errno;
+
+      pr_redis_conn_destroy(redis);
+      errno = xerrno;
+      return NULL;    
+    }
   }
 
-  if (redis_password != NULL) {
+  if (brokered == FALSE &&
+      redis_password != NULL) {
     res = pr_redis_auth(redis, redis_password);
     if (res < 0) {
       xerrno = errno;
@@ -518,7 +613,8 @@ pr_redis_t *pr_redis_conn_new(pool *p, module *m, unsigned long flags) {
     }
   }
 
-  if (redis_db_idx != NULL) {
+  if (brokered == FALSE &&
+      redis_db_idx != NULL) {
     res = pr_redis_select(redis, redis_db_idx);
     if (res < 0) {
       xerrno = errno;
@@ -869,6 +965,93 @@ int pr_redis_set(pr_redis_t *redis, module *m, const char *key, void *value,
   return 0;
 }
 
+static array_header *get_key_lens(pool *p, array_header *keys) {
+  register unsigned int i;
+  array_header *keyszs;
+  char **elts;
+
+  keyszs = make_array(p, keys->nelts, sizeof(size_t));
+  elts = keys->elts;
+
+  for (i = 0; i < keys->nelts; i++) {
+    if (elts[i] == NULL) {
+      return NULL;
+    }
+
+    *((size_t *) push_array(keyszs)) = strlen(elts[i]);
+  }
+
+  return keyszs;
+}
+
+int pr_redis_mget(pool *p, pr_redis_t *redis, module *m, array_header *keys,
+    array_header **values, array_header **valueszs) {
+  int res, xerrno;
+  pool *tmp_pool;
+  array_header *keyszs;
+
+  if (p == NULL ||
+      keys == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(p);
+  keyszs = get_key_lens(tmp_pool, keys);
+  if (keyszs == NULL) {
+    destroy_pool(tmp_pool);
+    errno = EINVAL;
+    return -1;
+  }
+
+  res = pr_redis_kmget(p, redis, m, keys, keyszs, values, valueszs);
+  xerrno = errno;
+
+  if (res < 0) {
+    pr_trace_msg(trace_channel, 2,
+      "error getting data for %u %s: %s", keys->nelts,
+      keys->nelts != 1 ? "keys" : "key", strerror(xerrno));
+  }
+
+  destroy_pool(tmp_pool);
+  errno = xerrno;
+  return res;
+}
+
+int pr_redis_mset(pr_redis_t *redis, module *m, array_header *keys,
+    array_header *values, array_header *valueszs, time_t expires) {
+  int res, xerrno;
+  pool *tmp_pool;
+  array_header *keyszs;
+
+  if (redis == NULL ||
+      keys == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(redis->pool);
+  keyszs = get_key_lens(tmp_pool, keys);
+  if (keyszs == NULL) {
+    destroy_pool(tmp_pool);
+    errno = EINVAL;
+    return -1;
+  }
+
+  res = pr_redis_kmset(redis, m, keys, keyszs, values, valueszs, expires);
+  xerrno = errno;
+
+  if (res < 0) {
+    pr_trace_msg(trace_channel, 2,
+      "error setting %u %s: %s", keys->nelts,
+      keys->nelts != 1 ? "keys" : "key", strerror(xerrno));
+  }
+
+  destroy_pool(tmp_pool);
+  errno = xerrno;
+  return res;
+}
+
 /* Hash operations */
 int pr_redis_hash_count(pr_redis_t *redis, module *m, const char *key,
     uint64_t *count) {
@@ -2103,211 +2286,463 @@ int pr_redis_select(pr_redis_t *redis, const char *db_idx) {
   return 0;
 }
 
-int pr_redis_kadd(pr_redis_t *redis, module *m, const char *key, size_t keysz,
-    void *value, size_t valuesz, time_t expires) {
-  return pr_redis_kset(redis, m, key, keysz, value, valuesz, expires);
-}
-
-int pr_redis_kdecr(pr_redis_t *redis, module *m, const char *key, size_t keysz,
-    uint32_t decr, uint64_t *value) {
-  pool *tmp_pool = NULL;
-  const char *cmd = NULL;
-  redisReply *reply;
+pr_redis_pipeline_t *pr_redis_pipeline_alloc(pool *p, pr_redis_t *redis,
+    module *m) {
+  pr_redis_pipeline_t *pipeline;
 
-  if (redis == NULL ||
-      m == NULL ||
-      key == NULL ||
-      decr == 0) {
+  if (p == NULL ||
+      redis == NULL ||
+      m == NULL) {
     errno = EINVAL;
-    return -1;
+    return NULL;
   }
 
-  tmp_pool = make_sub_pool(redis->pool);
-  pr_pool_tag(tmp_pool, "Redis DECRBY pool");
+  pipeline = pcalloc(p, sizeof(pr_redis_pipeline_t));
+  pipeline->pool = p;
+  pipeline->redis = redis;
+  pipeline->owner = m;
 
-  key = get_namespace_key(tmp_pool, redis, m, key, &keysz);
+  return pipeline;
+}
 
-  cmd = "DECRBY";
-  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
-  reply = redisCommand(redis->ctx, "%s %b %lu", cmd, key, keysz,
-    (unsigned long) decr);
-  reply = handle_reply(redis, cmd, reply);
-  if (reply == NULL) {
-    pr_trace_msg(trace_channel, 2,
-      "error decrementing key (%lu bytes) by %lu using %s: %s",
-      (unsigned long) keysz, (unsigned long) decr, cmd, strerror(errno));
-    destroy_pool(tmp_pool);
-    errno = EIO;
-    return -1;
+static struct redis_pipeline_cmd *pipeline_cmd_alloc(
+    pr_redis_pipeline_t *pipeline, const char *name) {
+  struct redis_pipeline_cmd *cmd;
+
+  if (pipeline->cmd_pool == NULL) {
+    pipeline->cmd_pool = make_sub_pool(pipeline->pool);
+    pr_pool_tag(pipeline->cmd_pool, "Redis pipeline command pool");
+
+    pipeline->cmds = make_array(pipeline->cmd_pool, 0,
+      sizeof(struct redis_pipeline_cmd *));
   }
 
-  if (reply->type != REDIS_REPLY_INTEGER) {
-    pr_trace_msg(trace_channel, 2,
-      "expected INTEGER reply for %s, got %s", cmd,
-      get_reply_type(reply->type));
+  cmd = pcalloc(pipeline->cmd_pool, sizeof(struct redis_pipeline_cmd));
+  cmd->name = pstrdup(pipeline->cmd_pool, name);
+  cmd->args = make_array(pipeline->cmd_pool, 4, sizeof(char *));
+  cmd->argszs = make_array(pipeline->cmd_pool, 4, sizeof(size_t));
 
-    if (reply->type == REDIS_REPLY_ERROR) {
-      pr_trace_msg(trace_channel, 2, "%s error: %s", cmd, reply->str);
-    }
+  *((const char **) push_array(cmd->args)) = cmd->name;
+  *((size_t *) push_array(cmd->argszs)) = strlen(cmd->name);
 
-    freeReplyObject(reply);
-    destroy_pool(tmp_pool);
+  *((struct redis_pipeline_cmd **) push_array(pipeline->cmds)) = cmd;
+  return cmd;
+}
+
+static void pipeline_cmd_add_arg(pr_redis_pipeline_t *pipeline,
+    struct redis_pipeline_cmd *cmd, const void *arg, size_t argsz) {
+  char *data;
+
+  /* Copy the argument, so that callers need not keep it around until the
+   * pipeline is executed.
+   */
+  data = palloc(pipeline->cmd_pool, argsz);
+  memcpy(data, arg, argsz);
+
+  *((char **) push_array(cmd->args)) = data;
+  *((size_t *) push_array(cmd->argszs)) = argsz;
+}
+
+static void pipeline_cmd_add_key(pr_redis_pipeline_t *pipeline,
+    struct redis_pipeline_cmd *cmd, const char *key, size_t keysz) {
+  key = get_namespace_key(pipeline->cmd_pool, pipeline->redis,
+    pipeline->owner, key, &keysz);
+  pipeline_cmd_add_arg(pipeline, cmd, key, keysz);
+}
+
+static void pipeline_cmd_add_ulong(pr_redis_pipeline_t *pipeline,
+    struct redis_pipeline_cmd *cmd, unsigned long num) {
+  char buf[64];
+  int len;
+
+  len = snprintf(buf, sizeof(buf)-1, "%lu", num);
+  pipeline_cmd_add_arg(pipeline, cmd, buf, len);
+}
+
+int pr_redis_pipeline_command(pr_redis_pipeline_t *pipeline,
+    const array_header *args) {
+  register unsigned int i;
+  struct redis_pipeline_cmd *cmd;
+  char **elts;
+
+  if (pipeline == NULL ||
+      args == NULL ||
+      args->nelts == 0) {
     errno = EINVAL;
     return -1;
   }
 
-  /* Note: DECRBY will automatically set the key value to zero if it does
-   * not already exist.  To detect a nonexistent key, then, we look to
-   * see if the return value is exactly our requested decrement.  If so,
-   * REMOVE the auto-created key, and return ENOENT.
-   */
-  if ((decr * -1) == (uint32_t) reply->integer) {
-    freeReplyObject(reply);
-    destroy_pool(tmp_pool);
-    (void) pr_redis_kremove(redis, m, key, keysz);
-    errno = ENOENT;
-    return -1;
+  elts = args->elts;
+  cmd = pipeline_cmd_alloc(pipeline, elts[0]);
+  for (i = 1; i < args->nelts; i++) {
+    pipeline_cmd_add_arg(pipeline, cmd, elts[i], strlen(elts[i]));
   }
 
-  pr_trace_msg(trace_channel, 7, "%s reply: %lld", cmd, reply->integer);
+  return 0;
+}
 
-  if (value != NULL) {
-    *value = (uint64_t) reply->integer;
+int pr_redis_pipeline_get(pr_redis_pipeline_t *pipeline, const char *key) {
+  if (key == NULL) {
+    errno = EINVAL;
+    return -1;
   }
 
-  freeReplyObject(reply);
-  destroy_pool(tmp_pool);
-  return 0;
+  return pr_redis_pipeline_kget(pipeline, key, strlen(key));
 }
 
-void *pr_redis_kget(pool *p, pr_redis_t *redis, module *m, const char *key,
-    size_t keysz, size_t *valuesz) {
-  const char *cmd;
-  pool *tmp_pool;
-  redisReply *reply;
-  char *data = NULL;
+int pr_redis_pipeline_kget(pr_redis_pipeline_t *pipeline, const char *key,
+    size_t keysz) {
+  struct redis_pipeline_cmd *cmd;
 
-  if (p == NULL ||
-      redis == NULL ||
-      m == NULL ||
+  if (pipeline == NULL ||
       key == NULL ||
-      valuesz == NULL) {
+      keysz == 0) {
     errno = EINVAL;
-    return NULL;
+    return -1;
   }
 
-  tmp_pool = make_sub_pool(redis->pool);
-  pr_pool_tag(tmp_pool, "Redis GET pool");
+  cmd = pipeline_cmd_alloc(pipeline, "GET");
+  pipeline_cmd_add_key(pipeline, cmd, key, keysz);
+  return 0;
+}
 
-  key = get_namespace_key(tmp_pool, redis, m, key, &keysz);
+int pr_redis_pipeline_incr(pr_redis_pipeline_t *pipeline, const char *key,
+    uint32_t incr) {
+  if (key == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
 
-  cmd = "GET";
-  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
-  reply = redisCommand(redis->ctx, "%s %b", cmd, key, keysz);
-  reply = handle_reply(redis, cmd, reply);
-  if (reply == NULL) {
-    pr_trace_msg(trace_channel, 2,
-      "error getting data for key (%lu bytes) using %s: %s",
-      (unsigned long) keysz, cmd, strerror(errno));
-    destroy_pool(tmp_pool);
-    errno = EIO;
-    return NULL;
+  return pr_redis_pipeline_kincr(pipeline, key, strlen(key), incr);
+}
+
+int pr_redis_pipeline_kincr(pr_redis_pipeline_t *pipeline, const char *key,
+    size_t keysz, uint32_t incr) {
+  struct redis_pipeline_cmd *cmd;
+
+  if (pipeline == NULL ||
+      key == NULL ||
+      keysz == 0 ||
+      incr == 0) {
+    errno = EINVAL;
+    return -1;
   }
 
-  if (reply->type == REDIS_REPLY_NIL) {
-    pr_trace_msg(trace_channel, 7, "%s reply: nil", cmd);
-    freeReplyObject(reply);
-    destroy_pool(tmp_pool);
-    errno = ENOENT;
-    return NULL;
+  cmd = pipeline_cmd_alloc(pipeline, "INCRBY");
+  pipeline_cmd_add_key(pipeline, cmd, key, keysz);
+  pipeline_cmd_add_ulong(pipeline, cmd, (unsigned long) incr);
+  return 0;
+}
+
+int pr_redis_pipeline_remove(pr_redis_pipeline_t *pipeline, const char *key) {
+  if (key == NULL) {
+    errno = EINVAL;
+    return -1;
   }
 
-  if (reply->type != REDIS_REPLY_STRING) {
-    pr_trace_msg(trace_channel, 2,
-      "expected STRING reply for %s, got %s", cmd, get_reply_type(reply->type));
-    freeReplyObject(reply);
-    destroy_pool(tmp_pool);
+  return pr_redis_pipeline_kremove(pipeline, key, strlen(key));
+}
+
+int pr_redis_pipeline_kremove(pr_redis_pipeline_t *pipeline, const char *key,
+    size_t keysz) {
+  struct redis_pipeline_cmd *cmd;
+
+  if (pipeline == NULL ||
+      key == NULL ||
+      keysz == 0) {
     errno = EINVAL;
-    return NULL;
+    return -1;
   }
 
-  pr_trace_msg(trace_channel, 7, "%s reply: %.*s", cmd, (int) reply->len,
-    reply->str);
+  cmd = pipeline_cmd_alloc(pipeline, "DEL");
+  pipeline_cmd_add_key(pipeline, cmd, key, keysz);
+  return 0;
+}
 
-  if (valuesz != NULL) {
-    *valuesz = (uint64_t) reply->len;
+int pr_redis_pipeline_set(pr_redis_pipeline_t *pipeline, const char *key,
+    void *value, size_t valuesz, time_t expires) {
+  if (key == NULL) {
+    errno = EINVAL;
+    return -1;
   }
 
-  data = palloc(p, reply->len);
-  memcpy(data, reply->str, reply->len);
+  return pr_redis_pipeline_kset(pipeline, key, strlen(key), value, valuesz,
+    expires);
+}
 
-  freeReplyObject(reply);
-  destroy_pool(tmp_pool);
-  return data;
+int pr_redis_pipeline_kset(pr_redis_pipeline_t *pipeline, const char *key,
+    size_t keysz, void *value, size_t valuesz, time_t expires) {
+  struct redis_pipeline_cmd *cmd;
+
+  if (pipeline == NULL ||
+      key == NULL ||
+      keysz == 0 ||
+      value == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (expires > 0) {
+    cmd = pipeline_cmd_alloc(pipeline, "SETEX");
+    pipeline_cmd_add_key(pipeline, cmd, key, keysz);
+    pipeline_cmd_add_ulong(pipeline, cmd, (unsigned long) expires);
+
+  } else {
+    cmd = pipeline_cmd_alloc(pipeline, "SET");
+    pipeline_cmd_add_key(pipeline, cmd, key, keysz);
+  }
+
+  pipeline_cmd_add_arg(pipeline, cmd, value, valuesz);
+  return 0;
 }
 
-char *pr_redis_kget_str(pool *p, pr_redis_t *redis, module *m, const char *key,
-    size_t keysz) {
-  const char *cmd;
-  pool *tmp_pool;
-  redisReply *reply;
-  char *data = NULL;
+int pr_redis_pipeline_list_getall(pr_redis_pipeline_t *pipeline,
+    const char *key) {
+  if (key == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
 
-  if (p == NULL ||
-      redis == NULL ||
-      m == NULL ||
-      key == NULL) {
+  return pr_redis_pipeline_list_kgetall(pipeline, key, strlen(key));
+}
+
+int pr_redis_pipeline_list_kgetall(pr_redis_pipeline_t *pipeline,
+    const char *key, size_t keysz) {
+  struct redis_pipeline_cmd *cmd;
+
+  if (pipeline == NULL ||
+      key == NULL ||
+      keysz == 0) {
     errno = EINVAL;
-    return NULL;
+    return -1;
   }
 
-  tmp_pool = make_sub_pool(redis->pool);
-  pr_pool_tag(tmp_pool, "Redis GET pool");
+  cmd = pipeline_cmd_alloc(pipeline, "LRANGE");
+  pipeline_cmd_add_key(pipeline, cmd, key, keysz);
+  pipeline_cmd_add_arg(pipeline, cmd, "0", 1);
+  pipeline_cmd_add_arg(pipeline, cmd, "-1", 2);
+  return 0;
+}
 
-  key = get_namespace_key(tmp_pool, redis, m, key, &keysz);
+int pr_redis_pipeline_set_getall(pr_redis_pipeline_t *pipeline,
+    const char *key) {
+  if (key == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
 
-  cmd = "GET";
-  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
-  reply = redisCommand(redis->ctx, "%s %b", cmd, key, keysz);
-  reply = handle_reply(redis, cmd, reply);
-  if (reply == NULL) {
-    pr_trace_msg(trace_channel, 2,
-      "error getting data for key (%lu bytes) using %s: %s",
-      (unsigned long) keysz, cmd, strerror(errno));
-    destroy_pool(tmp_pool);
-    errno = EIO;
-    return NULL;
+  return pr_redis_pipeline_set_kgetall(pipeline, key, strlen(key));
+}
+
+int pr_redis_pipeline_set_kgetall(pr_redis_pipeline_t *pipeline,
+    const char *key, size_t keysz) {
+  struct redis_pipeline_cmd *cmd;
+
+  if (pipeline == NULL ||
+      key == NULL ||
+      keysz == 0) {
+    errno = EINVAL;
+    return -1;
   }
 
-  if (reply->type == REDIS_REPLY_NIL) {
-    pr_trace_msg(trace_channel, 7, "%s reply: nil", cmd);
-    freeReplyObject(reply);
-    destroy_pool(tmp_pool);
-    errno = ENOENT;
-    return NULL;
+  cmd = pipeline_cmd_alloc(pipeline, "SMEMBERS");
+  pipeline_cmd_add_key(pipeline, cmd, key, keysz);
+  return 0;
+}
+
+static pr_redis_reply_t *make_reply(pool *p, redisReply *reply) {
+  pr_redis_reply_t *pr_reply;
+
+  pr_reply = pcalloc(p, sizeof(pr_redis_reply_t));
+
+  switch (reply->type) {
+    case REDIS_REPLY_STRING:
+    case REDIS_REPLY_STATUS:
+    case REDIS_REPLY_ERROR:
+      if (reply->type == REDIS_REPLY_STRING) {
+        pr_reply->type = PR_REDIS_REPLY_TYPE_STRING;
+
+      } else if (reply->type == REDIS_REPLY_STATUS) {
+        pr_reply->type = PR_REDIS_REPLY_TYPE_STATUS;
+
+      } else {
+        pr_reply->type = PR_REDIS_REPLY_TYPE_ERROR;
+      }
+
+      /* Always NUL-terminate the value, for the benefit of callers treating
+       * STATUS/ERROR replies as text; the NUL is not counted in the size.
+       */
+      pr_reply->valuesz = reply->len;
+      pr_reply->value = palloc(p, reply->len + 1);
+      memcpy(pr_reply->value, reply->str, reply->len);
+      ((char *) pr_reply->value)[reply->len] = '\0';
+      break;
+
+    case REDIS_REPLY_INTEGER:
+      pr_reply->type = PR_REDIS_REPLY_TYPE_INTEGER;
+      pr_reply->number = (int64_t) reply->integer;
+      break;
+
+    case REDIS_REPLY_NIL:
+      pr_reply->type = PR_REDIS_REPLY_TYPE_NIL;
+      break;
+
+    case REDIS_REPLY_ARRAY: {
+      register unsigned int i;
+
+      pr_reply->type = PR_REDIS_REPLY_TYPE_ARRAY;
+      pr_reply->elements = make_array(p, reply->elements,
+        sizeof(pr_redis_reply_t *));
+
+      for (i = 0; i < reply->elements; i++) {
+        *((pr_redis_reply_t **) push_array(pr_reply->elements)) =
+          make_reply(p, reply->element[i]);
+      }
+      break;
+    }
+
+    default:
+      pr_trace_msg(trace_channel, 2, "unknown reply type %d", reply->type);
+      break;
   }
 
-  if (reply->type != REDIS_REPLY_STRING) {
-    pr_trace_msg(trace_channel, 2,
-      "expected STRING reply for %s, got %s", cmd, get_reply_type(reply->type));
-    freeReplyObject(reply);
-    destroy_pool(tmp_pool);
+  return pr_reply;
+}
+
+int pr_redis_pipeline_exec(pool *p, pr_redis_pipeline_t *pipeline,
+    array_header **replies) {
+  register unsigned int i;
+  unsigned int cmd_count, appended = 0;
+  int xerrno = 0;
+  struct redis_pipeline_cmd **cmds;
+  redisContext *ctx;
+
+  if (p == NULL ||
+      pipeline == NULL ||
+      replies == NULL) {
     errno = EINVAL;
-    return NULL;
+    return -1;
   }
 
-  pr_trace_msg(trace_channel, 7, "%s reply: %.*s", cmd, (int) reply->len,
-    reply->str);
+  if (pipeline->cmds == NULL ||
+      pipeline->cmds->nelts == 0) {
+    *replies = make_array(p, 0, sizeof(pr_redis_reply_t *));
+    return 0;
+  }
 
-  data = pstrndup(p, reply->str, reply->len);
+  ctx = pipeline->redis->ctx;
+  cmds = pipeline->cmds->elts;
+  cmd_count = pipeline->cmds->nelts;
 
-  freeReplyObject(reply);
-  destroy_pool(tmp_pool);
-  return data;
+  pr_trace_msg(trace_channel, 7, "sending %u pipelined %s", cmd_count,
+    cmd_count != 1 ? "commands" : "command");
+
+  for (i = 0; i < cmd_count; i++) {
+    struct redis_pipeline_cmd *cmd;
+    int res;
+
+    cmd = cmds[i];
+    pr_trace_msg(trace_channel, 7, "sending command: %s", cmd->name);
+    res = redisAppendCommandArgv(ctx, cmd->args->nelts,
+      (const char **) cmd->args->elts, (const size_t *) cmd->argszs->elts);
+    if (res != REDIS_OK) {
+      pr_trace_msg(trace_channel, 2,
+        "error queueing %s command (%u of %u) for pipeline: %s", cmd->name,
+        i+1, cmd_count, ctx->errstr);
+      xerrno = ENOMEM;
+      break;
+    }
+
+    appended++;
+  }
+
+  *replies = make_array(p, appended, sizeof(pr_redis_reply_t *));
+
+  /* Read the replies to any commands which made it into the output buffer,
+   * even if not all of them did, so that no replies are left for the next
+   * command on this connection to stumble over.
+   */
+  for (i = 0; i < appended; i++) {
+    struct redis_pipeline_cmd *cmd;
+    redisReply *reply = NULL;
+    pr_redis_reply_t *pr_reply;
+    int res;
+
+    pr_signals_handle();
+
+    cmd = cmds[i];
+    res = redisGetReply(ctx, (void **) &reply);
+    if (res != REDIS_OK) {
+      reply = NULL;
+    }
+
+    reply = handle_reply(pipeline->redis, cmd->name, reply);
+    if (reply == NULL) {
+      pr_trace_msg(trace_channel, 2,
+        "error reading reply for pipelined %s command (%u of %u): %s",
+        cmd->name, i+1, appended, strerror(errno));
+
+      destroy_pool(pipeline->cmd_pool);
+      pipeline->cmd_pool = NULL;
+      pipeline->cmds = NULL;
+
+      *replies = NULL;
+      errno = EIO;
+      return -1;
+    }
+
+    pr_reply = make_reply(p, reply);
+    switch (pr_reply->type) {
+      case PR_REDIS_REPLY_TYPE_STRING:
+      case PR_REDIS_REPLY_TYPE_STATUS:
+      case PR_REDIS_REPLY_TYPE_ERROR:
+        pr_trace_msg(trace_channel, 7, "%s %s reply: %.*s", cmd->name,
+          get_reply_type(reply->type), (int) reply->len, reply->str);
+        break;
+
+      case PR_REDIS_REPLY_TYPE_INTEGER:
+        pr_trace_msg(trace_channel, 7, "%s INTEGER reply: %lld", cmd->name,
+          reply->integer);
+        break;
+
+      case PR_REDIS_REPLY_TYPE_NIL:
+        pr_trace_msg(trace_channel, 7, "%s NIL reply", cmd->name);
+        break;
+
+      case PR_REDIS_REPLY_TYPE_ARRAY:
+        pr_trace_msg(trace_channel, 7, "%s ARRAY reply: (%lu %s)", cmd->name,
+          (unsigned long) reply->elements,
+          reply->elements != 1 ? "elements" : "element");
+        break;
+
+      default:
+        break;
+    }
+
+    *((pr_redis_reply_t **) push_array(*replies)) = pr_reply;
+    freeReplyObject(reply);
+  }
+
+  destroy_pool(pipeline->cmd_pool);
+  pipeline->cmd_pool = NULL;
+  pipeline->cmds = NULL;
+
+  if (xerrno != 0) {
+    *replies = NULL;
+    errno = xerrno;
+    return -1;
+  }
+
+  return 0;
 }
 
-int pr_redis_kincr(pr_redis_t *redis, module *m, const char *key, size_t keysz,
-    uint32_t incr, uint64_t *value) {
+int pr_redis_kadd(pr_redis_t *redis, module *m, const char *key, size_t keysz,
+    void *value, size_t valuesz, time_t expires) {
+  return pr_redis_kset(redis, m, key, keysz, value, valuesz, expires);
+}
+
+int pr_redis_kdecr(pr_redis_t *redis, module *m, const char *key, size_t keysz,
+    uint32_t decr, uint64_t *value) {
   pool *tmp_pool = NULL;
   const char *cmd = NULL;
   redisReply *reply;
@@ -2315,25 +2750,25 @@ int pr_redis_kincr(pr_redis_t *redis, module *m, const char *key, size_t keysz,
   if (redis == NULL ||
       m == NULL ||
       key == NULL ||
-      incr == 0) {
+      decr == 0) {
     errno = EINVAL;
     return -1;
   }
 
   tmp_pool = make_sub_pool(redis->pool);
-  pr_pool_tag(tmp_pool, "Redis INCRBY pool");
+  pr_pool_tag(tmp_pool, "Redis DECRBY pool");
 
   key = get_namespace_key(tmp_pool, redis, m, key, &keysz);
 
-  cmd = "INCRBY";
+  cmd = "DECRBY";
   pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
   reply = redisCommand(redis->ctx, "%s %b %lu", cmd, key, keysz,
-    (unsigned long) incr);
+    (unsigned long) decr);
   reply = handle_reply(redis, cmd, reply);
   if (reply == NULL) {
     pr_trace_msg(trace_channel, 2,
-      "error incrementing key (%lu bytes) by %lu using %s: %s",
-      (unsigned long) keysz, (unsigned long) incr, cmd, strerror(errno));
+      "error decrementing key (%lu bytes) by %lu using %s: %s",
+      (unsigned long) keysz, (unsigned long) decr, cmd, strerror(errno));
     destroy_pool(tmp_pool);
     errno = EIO;
     return -1;
@@ -2354,12 +2789,12 @@ int pr_redis_kincr(pr_redis_t *redis, module *m, const char *key, size_t keysz,
     return -1;
   }
 
-  /* Note: INCRBY will automatically set the key value to zero if it does
+  /* Note: DECRBY will automatically set the key value to zero if it does
    * not already exist.  To detect a nonexistent key, then, we look to
-   * see if the return value is exactly our requested increment.  If so,
+   * see if the return value is exactly our requested decrement.  If so,
    * REMOVE the auto-created key, and return ENOENT.
    */
-  if (incr == (uint32_t) reply->integer) {
+  if ((decr * -1) == (uint32_t) reply->integer) {
     freeReplyObject(reply);
     destroy_pool(tmp_pool);
     (void) pr_redis_kremove(redis, m, key, keysz);
@@ -2378,11 +2813,209 @@ int pr_redis_kincr(pr_redis_t *redis, module *m, const char *key, size_t keysz,
   return 0;
 }
 
-int pr_redis_kremove(pr_redis_t *redis, module *m, const char *key,
-    size_t keysz) {
-  int xerrno = 0;
-  pool *tmp_pool = NULL;
-  const char *cmd = NULL;
+void *pr_redis_kget(pool *p, pr_redis_t *redis, module *m, const char *key,
+    size_t keysz, size_t *valuesz) {
+  const char *cmd;
+  pool *tmp_pool;
+  redisReply *reply;
+  char *data = NULL;
+
+  if (p == NULL ||
+      redis == NULL ||
+      m == NULL ||
+      key == NULL ||
+      valuesz == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  tmp_pool = make_sub_pool(redis->pool);
+  pr_pool_tag(tmp_pool, "Redis GET pool");
+
+  key = get_namespace_key(tmp_pool, redis, m, key, &keysz);
+
+  cmd = "GET";
+  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
+  reply = redisCommand(redis->ctx, "%s %b", cmd, key, keysz);
+  reply = handle_reply(redis, cmd, reply);
+  if (reply == NULL) {
+    pr_trace_msg(trace_channel, 2,
+      "error getting data for key (%lu bytes) using %s: %s",
+      (unsigned long) keysz, cmd, strerror(errno));
+    destroy_pool(tmp_pool);
+    errno = EIO;
+    return NULL;
+  }
+
+  if (reply->type == REDIS_REPLY_NIL) {
+    pr_trace_msg(trace_channel, 7, "%s reply: nil", cmd);
+    freeReplyObject(reply);
+    destroy_pool(tmp_pool);
+    errno = ENOENT;
+    return NULL;
+  }
+
+  if (reply->type != REDIS_REPLY_STRING) {
+    pr_trace_msg(trace_channel, 2,
+      "expected STRING reply for %s, got %s", cmd, get_reply_type(reply->type));
+    freeReplyObject(reply);
+    destroy_pool(tmp_pool);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  pr_trace_msg(trace_channel, 7, "%s reply: %.*s", cmd, (int) reply->len,
+    reply->str);
+
+  if (valuesz != NULL) {
+    *valuesz = (uint64_t) reply->len;
+  }
+
+  data = palloc(p, reply->len);
+  memcpy(data, reply->str, reply->len);
+
+  freeReplyObject(reply);
+  destroy_pool(tmp_pool);
+  return data;
+}
+
+char *pr_redis_kget_str(pool *p, pr_redis_t *redis, module *m, const char *key,
+    size_t keysz) {
+  const char *cmd;
+  pool *tmp_pool;
+  redisReply *reply;
+  char *data = NULL;
+
+  if (p == NULL ||
+      redis == NULL ||
+      m == NULL ||
+      key == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  tmp_pool = make_sub_pool(redis->pool);
+  pr_pool_tag(tmp_pool, "Redis GET pool");
+
+  key = get_namespace_key(tmp_pool, redis, m, key, &keysz);
+
+  cmd = "GET";
+  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
+  reply = redisCommand(redis->ctx, "%s %b", cmd, key, keysz);
+  reply = handle_reply(redis, cmd, reply);
+  if (reply == NULL) {
+    pr_trace_msg(trace_channel, 2,
+      "error getting data for key (%lu bytes) using %s: %s",
+      (unsigned long) keysz, cmd, strerror(errno));
+    destroy_pool(tmp_pool);
+    errno = EIO;
+    return NULL;
+  }
+
+  if (reply->type == REDIS_REPLY_NIL) {
+    pr_trace_msg(trace_channel, 7, "%s reply: nil", cmd);
+    freeReplyObject(reply);
+    destroy_pool(tmp_pool);
+    errno = ENOENT;
+    return NULL;
+  }
+
+  if (reply->type != REDIS_REPLY_STRING) {
+    pr_trace_msg(trace_channel, 2,
+      "expected STRING reply for %s, got %s", cmd, get_reply_type(reply->type));
+    freeReplyObject(reply);
+    destroy_pool(tmp_pool);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  pr_trace_msg(trace_channel, 7, "%s reply: %.*s", cmd, (int) reply->len,
+    reply->str);
+
+  data = pstrndup(p, reply->str, reply->len);
+
+  freeReplyObject(reply);
+  destroy_pool(tmp_pool);
+  return data;
+}
+
+int pr_redis_kincr(pr_redis_t *redis, module *m, const char *key, size_t keysz,
+    uint32_t incr, uint64_t *value) {
+  pool *tmp_pool = NULL;
+  const char *cmd = NULL;
+  redisReply *reply;
+
+  if (redis == NULL ||
+      m == NULL ||
+      key == NULL ||
+      incr == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(redis->pool);
+  pr_pool_tag(tmp_pool, "Redis INCRBY pool");
+
+  key = get_namespace_key(tmp_pool, redis, m, key, &keysz);
+
+  cmd = "INCRBY";
+  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
+  reply = redisCommand(redis->ctx, "%s %b %lu", cmd, key, keysz,
+    (unsigned long) incr);
+  reply = handle_reply(redis, cmd, reply);
+  if (reply == NULL) {
+    pr_trace_msg(trace_channel, 2,
+      "error incrementing key (%lu bytes) by %lu using %s: %s",
+      (unsigned long) keysz, (unsigned long) incr, cmd, strerror(errno));
+    destroy_pool(tmp_pool);
+    errno = EIO;
+    return -1;
+  }
+
+  if (reply->type != REDIS_REPLY_INTEGER) {
+    pr_trace_msg(trace_channel, 2,
+      "expected INTEGER reply for %s, got %s", cmd,
+      get_reply_type(reply->type));
+
+    if (reply->type == REDIS_REPLY_ERROR) {
+      pr_trace_msg(trace_channel, 2, "%s error: %s", cmd, reply->str);
+    }
+
+    freeReplyObject(reply);
+    destroy_pool(tmp_pool);
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Note: INCRBY will automatically set the key value to zero if it does
+   * not already exist.  To detect a nonexistent key, then, we look to
+   * see if the return value is exactly our requested increment.  If so,
+   * REMOVE the auto-created key, and return ENOENT.
+   */
+  if (incr == (uint32_t) reply->integer) {
+    freeReplyObject(reply);
+    destroy_pool(tmp_pool);
+    (void) pr_redis_kremove(redis, m, key, keysz);
+    errno = ENOENT;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 7, "%s reply: %lld", cmd, reply->integer);
+
+  if (value != NULL) {
+    *value = (uint64_t) reply->integer;
+  }
+
+  freeReplyObject(reply);
+  destroy_pool(tmp_pool);
+  return 0;
+}
+
+int pr_redis_kremove(pr_redis_t *redis, module *m, const char *key,
+    size_t keysz) {
+  int xerrno = 0;
+  pool *tmp_pool = NULL;
+  const char *cmd = NULL;
   redisReply *reply;
   long long count;
 
@@ -2560,45 +3193,76 @@ int pr_redis_kset(pr_redis_t *redis, module *m, const char *key, size_t keysz,
   return 0;
 }
 
-int pr_redis_hash_kcount(pr_redis_t *redis, module *m, const char *key,
-    size_t keysz, uint64_t *count) {
-  int xerrno = 0;
-  pool *tmp_pool = NULL;
-  const char *cmd = NULL;
+int pr_redis_kmget(pool *p, pr_redis_t *redis, module *m, array_header *keys,
+    array_header *keyszs, array_header **values, array_header **valueszs) {
+  register unsigned int i;
+  pool *tmp_pool;
+  const char *cmd;
+  array_header *args, *argszs;
   redisReply *reply;
 
-  if (redis == NULL ||
+  if (p == NULL ||
+      redis == NULL ||
       m == NULL ||
-      key == NULL ||
-      keysz == 0 ||
-      count == NULL) {
+      keys == NULL ||
+      keyszs == NULL ||
+      values == NULL ||
+      valueszs == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (keys->nelts == 0 ||
+      keys->nelts != keyszs->nelts) {
     errno = EINVAL;
     return -1;
   }
 
   tmp_pool = make_sub_pool(redis->pool);
-  pr_pool_tag(tmp_pool, "Redis HLEN pool");
+  pr_pool_tag(tmp_pool, "Redis MGET pool");
 
-  key = get_namespace_key(tmp_pool, redis, m, key, &keysz);
+  cmd = "MGET";
+  args = make_array(tmp_pool, keys->nelts + 1, sizeof(char *));
+  argszs = make_array(tmp_pool, keys->nelts + 1, sizeof(size_t));
 
-  cmd = "HLEN";
-  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
-  reply = redisCommand(redis->ctx, "%s %b", cmd, key, keysz);
-  xerrno = errno;
+  *((const char **) push_array(args)) = cmd;
+  *((size_t *) push_array(argszs)) = strlen(cmd);
+
+  for (i = 0; i < keys->nelts; i++) {
+    const char *key;
+    size_t keysz;
+
+    key = ((char **) keys->elts)[i];
+    keysz = ((size_t *) keyszs->elts)[i];
+
+    if (key == NULL ||
+        keysz == 0) {
+      destroy_pool(tmp_pool);
+      errno = EINVAL;
+      return -1;
+    }
 
+    key = get_namespace_key(tmp_pool, redis, m, key, &keysz);
+    *((const char **) push_array(args)) = key;
+    *((size_t *) push_array(argszs)) = keysz;
+  }
+
+  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
+  reply = redisCommandArgv(redis->ctx, args->nelts, args->elts, argszs->elts);
   reply = handle_reply(redis, cmd, reply);
   if (reply == NULL) {
     pr_trace_msg(trace_channel, 2,
-      "error getting count of hash using key (%lu bytes): %s",
-      (unsigned long) keysz, strerror(errno));
+      "error getting data for %u keys using %s: %s", keys->nelts, cmd,
+      strerror(errno));
     destroy_pool(tmp_pool);
-    errno = xerrno;
+    errno = EIO;
     return -1;
   }
 
-  if (reply->type != REDIS_REPLY_INTEGER) {
+  if (reply->type != REDIS_REPLY_ARRAY ||
+      reply->elements != keys->nelts) {
     pr_trace_msg(trace_channel, 2,
-      "expected INTEGER reply for %s, got %s", cmd,
+      "expected ARRAY reply of %u elements for %s, got %s", keys->nelts, cmd,
       get_reply_type(reply->type));
 
     if (reply->type == REDIS_REPLY_ERROR) {
@@ -2611,17 +3275,250 @@ int pr_redis_hash_kcount(pr_redis_t *redis, module *m, const char *key,
     return -1;
   }
 
-  pr_trace_msg(trace_channel, 7, "%s reply: %lld", cmd, reply->integer);
-  *count = reply->integer;
+  pr_trace_msg(trace_channel, 7, "%s reply: %lu %s", cmd,
+    (unsigned long) reply->elements,
+    reply->elements != 1 ? "elements" : "element");
+
+  /* Every key gets a value element, in the requested order; nonexistent
+   * keys have NULL values.
+   */
+  *values = make_array(p, reply->elements, sizeof(void *));
+  *valueszs = make_array(p, reply->elements, sizeof(size_t));
+
+  for (i = 0; i < reply->elements; i++) {
+    redisReply *value_elt;
+    void *value_data = NULL;
+    size_t value_datasz = 0;
+
+    value_elt = reply->element[i];
+    if (value_elt->type == REDIS_REPLY_STRING) {
+      value_datasz = value_elt->len;
+      value_data = palloc(p, value_datasz);
+      memcpy(value_data, value_elt->str, value_datasz);
+
+    } else if (value_elt->type != REDIS_REPLY_NIL) {
+      pr_trace_msg(trace_channel, 2,
+        "expected STRING element at index %u, got %s", i + 1,
+        get_reply_type(value_elt->type));
+    }
+
+    *((void **) push_array(*values)) = value_data;
+    *((size_t *) push_array(*valueszs)) = value_datasz;
+  }
 
   freeReplyObject(reply);
   destroy_pool(tmp_pool);
   return 0;
 }
 
-int pr_redis_hash_kdelete(pr_redis_t *redis, module *m, const char *key,
-    size_t keysz, const char *field, size_t fieldsz) {
-  int xerrno = 0, exists = FALSE;
+int pr_redis_kmset(pr_redis_t *redis, module *m, array_header *keys,
+    array_header *keyszs, array_header *values, array_header *valueszs,
+    time_t expires) {
+  register unsigned int i;
+  pool *tmp_pool;
+  const char *cmd;
+  array_header *args, *argszs;
+  redisReply *reply;
+
+  if (redis == NULL ||
+      m == NULL ||
+      keys == NULL ||
+      keyszs == NULL ||
+      values == NULL ||
+      valueszs == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (keys->nelts == 0 ||
+      keys->nelts != keyszs->nelts ||
+      keys->nelts != values->nelts ||
+      keys->nelts != valueszs->nelts) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(redis->pool);
+  pr_pool_tag(tmp_pool, "Redis MSET pool");
+
+  if (expires > 0) {
+    pr_redis_pipeline_t *pipeline;
+    array_header *replies = NULL;
+    int res, xerrno;
+
+    /* MSET cannot set expiration times, so use a pipeline of SETEX commands
+     * instead; it still takes just the one round trip.
+     */
+    pipeline = pr_redis_pipeline_alloc(tmp_pool, redis, m);
+
+    for (i = 0; i < keys->nelts; i++) {
+      res = pr_redis_pipeline_kset(pipeline, ((char **) keys->elts)[i],
+        ((size_t *) keyszs->elts)[i], ((void **) values->elts)[i],
+        ((size_t *) valueszs->elts)[i], expires);
+      if (res < 0) {
+        xerrno = errno;
+
+        destroy_pool(tmp_pool);
+        errno = xerrno;
+        return -1;
+      }
+    }
+
+    res = pr_redis_pipeline_exec(tmp_pool, pipeline, &replies);
+    xerrno = errno;
+
+    if (res < 0) {
+      destroy_pool(tmp_pool);
+      errno = xerrno;
+      return -1;
+    }
+
+    for (i = 0; i < replies->nelts; i++) {
+      pr_redis_reply_t *pr_reply;
+
+      pr_reply = ((pr_redis_reply_t **) replies->elts)[i];
+      if (pr_reply->type != PR_REDIS_REPLY_TYPE_STATUS) {
+        pr_trace_msg(trace_channel, 2,
+          "error setting key #%u of %u: %s", i+1, replies->nelts,
+          pr_reply->type == PR_REDIS_REPLY_TYPE_ERROR ?
+            (char *) pr_reply->value : "unexpected reply");
+        destroy_pool(tmp_pool);
+        errno = EINVAL;
+        return -1;
+      }
+    }
+
+    destroy_pool(tmp_pool);
+    return 0;
+  }
+
+  cmd = "MSET";
+  args = make_array(tmp_pool, (keys->nelts * 2) + 1, sizeof(char *));
+  argszs = make_array(tmp_pool, (keys->nelts * 2) + 1, sizeof(size_t));
+
+  *((const char **) push_array(args)) = cmd;
+  *((size_t *) push_array(argszs)) = strlen(cmd);
+
+  for (i = 0; i < keys->nelts; i++) {
+    const char *key;
+    size_t keysz;
+    void *value;
+
+    key = ((char **) keys->elts)[i];
+    keysz = ((size_t *) keyszs->elts)[i];
+    value = ((void **) values->elts)[i];
+
+    if (key == NULL ||
+        keysz == 0 ||
+        value == NULL) {
+      destroy_pool(tmp_pool);
+      errno = EINVAL;
+      return -1;
+    }
+
+    key = get_namespace_key(tmp_pool, redis, m, key, &keysz);
+    *((const char **) push_array(args)) = key;
+    *((size_t *) push_array(argszs)) = keysz;
+
+    *((void **) push_array(args)) = value;
+    *((size_t *) push_array(argszs)) = ((size_t *) valueszs->elts)[i];
+  }
+
+  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
+  reply = redisCommandArgv(redis->ctx, args->nelts, args->elts, argszs->elts);
+  reply = handle_reply(redis, cmd, reply);
+  if (reply == NULL) {
+    pr_trace_msg(trace_channel, 2,
+      "error setting %u keys using %s: %s", keys->nelts, cmd,
+      strerror(errno));
+    destroy_pool(tmp_pool);
+    errno = EIO;
+    return -1;
+  }
+
+  if (reply->type != REDIS_REPLY_STATUS) {
+    pr_trace_msg(trace_channel, 2,
+      "expected STATUS reply for %s, got %s", cmd,
+      get_reply_type(reply->type));
+
+    if (reply->type == REDIS_REPLY_ERROR) {
+      pr_trace_msg(trace_channel, 2, "%s error: %s", cmd, reply->str);
+    }
+
+    freeReplyObject(reply);
+    destroy_pool(tmp_pool);
+    errno = EINVAL;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 7, "%s reply: %s", cmd, reply->str);
+  freeReplyObject(reply);
+  destroy_pool(tmp_pool);
+  return 0;
+}
+
+int pr_redis_hash_kcount(pr_redis_t *redis, module *m, const char *key,
+    size_t keysz, uint64_t *count) {
+  int xerrno = 0;
+  pool *tmp_pool = NULL;
+  const char *cmd = NULL;
+  redisReply *reply;
+
+  if (redis == NULL ||
+      m == NULL ||
+      key == NULL ||
+      keysz == 0 ||
+      count == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(redis->pool);
+  pr_pool_tag(tmp_pool, "Redis HLEN pool");
+
+  key = get_namespace_key(tmp_pool, redis, m, key, &keysz);
+
+  cmd = "HLEN";
+  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
+  reply = redisCommand(redis->ctx, "%s %b", cmd, key, keysz);
+  xerrno = errno;
+
+  reply = handle_reply(redis, cmd, reply);
+  if (reply == NULL) {
+    pr_trace_msg(trace_channel, 2,
+      "error getting count of hash using key (%lu bytes): %s",
+      (unsigned long) keysz, strerror(errno));
+    destroy_pool(tmp_pool);
+    errno = xerrno;
+    return -1;
+  }
+
+  if (reply->type != REDIS_REPLY_INTEGER) {
+    pr_trace_msg(trace_channel, 2,
+      "expected INTEGER reply for %s, got %s", cmd,
+      get_reply_type(reply->type));
+
+    if (reply->type == REDIS_REPLY_ERROR) {
+      pr_trace_msg(trace_channel, 2, "%s error: %s", cmd, reply->str);
+    }
+
+    freeReplyObject(reply);
+    destroy_pool(tmp_pool);
+    errno = EINVAL;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 7, "%s reply: %lld", cmd, reply->integer);
+  *count = reply->integer;
+
+  freeReplyObject(reply);
+  destroy_pool(tmp_pool);
+  return 0;
+}
+
+int pr_redis_hash_kdelete(pr_redis_t *redis, module *m, const char *key,
+    size_t keysz, const char *field, size_t fieldsz) {
+  int xerrno = 0, exists = FALSE;
   pool *tmp_pool = NULL;
   const char *cmd = NULL;
   redisReply *reply;
@@ -3757,9 +4654,10 @@ static int list_scan(pool *p, pr_redis_t *redis, const char *key, size_t keysz,
       }
     }
 
-    if (reply->elements == 0) {
-      /* Set the cursor to -1, to indicate to the caller the end of the
-       * iteration.
+    if (reply->elements < (size_t) count) {
+      /* A short range means that we have reached the end of the list; set
+       * the cursor to -1, to indicate to the caller the end of the
+       * iteration, without needing another command to find that out.
        */
       *cursor = -1;
 
@@ -5485,151 +6383,1072 @@ int pr_redis_sentinel_get_master_addr(pool *p, pr_redis_t *redis,
     char *host = NULL;
     int port = -1;
 
-    pr_trace_msg(trace_channel, 7, "%s reply: %lu %s", cmd,
-      (unsigned long) reply->elements,
-      reply->elements != 1 ? "elements" : "element");
+    pr_trace_msg(trace_channel, 7, "%s reply: %lu %s", cmd,
+      (unsigned long) reply->elements,
+      reply->elements != 1 ? "elements" : "element");
+
+    elt = reply->element[0];
+    if (elt->type == REDIS_REPLY_STRING) {
+      host = pstrndup(tmp_pool, elt->str, elt->len);
+
+    } else {
+      pr_trace_msg(trace_channel, 2,
+        "expected STRING element at index 0, got %s",
+        get_reply_type(elt->type));
+    }
+
+    elt = reply->element[1];
+    if (elt->type == REDIS_REPLY_STRING) {
+      char *port_str;
+
+      port_str = pstrndup(tmp_pool, elt->str, elt->len);
+      port = atoi(port_str);
+
+    } else {
+      pr_trace_msg(trace_channel, 2,
+        "expected STRING element at index 1, got %s",
+        get_reply_type(elt->type));
+    }
+
+    if (host != NULL &&
+        port != -1) {
+      *addr = (pr_netaddr_t *) pr_netaddr_get_addr(p, host, NULL);
+      if (*addr != NULL) {
+        pr_netaddr_set_port2(*addr, port);
+
+      } else {
+        xerrno = errno;
+        res = -1;
+      }
+
+    } else {
+      xerrno = ENOENT;
+      res = -1;
+    }
+
+  } else {
+    xerrno = ENOENT;
+    res = -1;
+  }
+
+  freeReplyObject(reply);
+  destroy_pool(tmp_pool);
+
+  errno = xerrno;
+  return res;
+}
+
+int pr_redis_sentinel_get_masters(pool *p, pr_redis_t *redis,
+    array_header **masters) {
+  int res = 0, xerrno = 0;
+  pool *tmp_pool = NULL;
+  const char *cmd = NULL;
+  redisReply *reply;
+
+  if (p == NULL ||
+      redis == NULL ||
+      masters == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(redis->pool);
+  pr_pool_tag(tmp_pool, "Redis SENTINEL pool");
+
+  cmd = "SENTINEL";
+  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
+  reply = redisCommand(redis->ctx, "%s masters", cmd);
+  xerrno = errno;
+
+  reply = handle_reply(redis, cmd, reply);
+  if (reply == NULL) {
+    pr_trace_msg(trace_channel, 2,
+      "error getting masters: %s", strerror(errno));
+    destroy_pool(tmp_pool);
+    errno = EIO;
+    return -1;
+  }
+
+  if (reply->type == REDIS_REPLY_NIL) {
+    pr_trace_msg(trace_channel, 7, "%s reply: nil", cmd);
+    freeReplyObject(reply);
+    destroy_pool(tmp_pool);
+
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (reply->type != REDIS_REPLY_ARRAY) {
+    pr_trace_msg(trace_channel, 2,
+      "expected ARRAY reply for %s, got %s", cmd, get_reply_type(reply->type));
+
+    if (reply->type == REDIS_REPLY_ERROR) {
+      pr_trace_msg(trace_channel, 2, "%s error: %s", cmd, reply->str);
+    }
+
+    freeReplyObject(reply);
+    destroy_pool(tmp_pool);
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (reply->elements > 0) {
+    register unsigned int i;
+
+    pr_trace_msg(trace_channel, 7, "%s reply: %lu %s", cmd,
+      (unsigned long) reply->elements,
+      reply->elements != 1 ? "elements" : "element");
+
+    *masters = make_array(p, reply->elements, sizeof(char *));
+
+    for (i = 0; i < reply->elements; i++) {
+      redisReply *elt;
+
+      elt = reply->element[i];
+      if (elt->type == REDIS_REPLY_ARRAY) {
+        redisReply *info;
+
+        info = elt->element[1];
+        *((char **) push_array(*masters)) = pstrndup(p, info->str, info->len);
+
+      } else {
+        pr_trace_msg(trace_channel, 2,
+          "expected ARRAY element at index %u, got %s", i,
+          get_reply_type(elt->type));
+      }
+    }
+
+  } else {
+    xerrno = ENOENT;
+    res = -1;
+  }
+
+  freeReplyObject(reply);
+  destroy_pool(tmp_pool);
+
+  errno = xerrno;
+  return res;
+}
+
+/* Broker
+ *
+ * The broker is a process which holds a small number of connections to the
+ * Redis server, on behalf of the session processes which connect to it using
+ * a Unix domain socket.  The commands read from all of the sessions are
+ * forwarded, pipelined, over those upstream connections, and the replies
+ * sent back to the sessions which sent the commands.  The commands from a
+ * given session always use the same upstream connection, so that their
+ * replies are read in order.
+ *
+ * The upstream connections are polled along with the sessions, so that
+ * waiting for the replies on one upstream connection does not hold up the
+ * sessions using the others, nor the reading of new commands.  Forwarded
+ * commands are still written to the Redis server as soon as they are read;
+ * the Redis server buffers its replies, rather than waiting for us to read
+ * them, thus these writes do not wait long.
+ */
+
+struct redis_broker_conn {
+  pool *pool;
+  int fd;
+  unsigned int upstream_idx;
+
+  /* Data read from the session, but not yet forwarded. */
+  char *ibuf;
+  size_t ibufsz, ibuflen;
+
+  /* Replies not yet written to the session. */
+  char *obuf;
+  size_t obufsz, obuflen;
+
+  /* Close the connection once the pending replies have been written? */
+  int closing;
+
+  /* Has the session gone away? */
+  int eof;
+
+  /* The number of commands whose replies have yet to be relayed; the
+   * connection is kept until then, even if the session has gone away.
+   */
+  unsigned int npending;
+};
+
+/* A command, from a session, awaiting its reply.  Commands which are not
+ * forwarded have their reply here, so that it is sent back in order with
+ * the replies of the forwarded commands.
+ */
+struct redis_broker_cmd {
+  struct redis_broker_conn *conn;
+  const char *reply;
+};
+
+struct redis_broker_upstream {
+  pr_redis_t *redis;
+
+  /* When the last attempt to connect failed. */
+  time_t connect_failed;
+
+  /* The commands whose replies have yet to be relayed, in order. */
+  pool *pending_pool;
+  array_header *pending;
+  unsigned int next_pending;
+};
+
+#define REDIS_BROKER_BUFSZ		16384
+
+/* The largest bulk string accepted from a session; the same as Redis. */
+#define REDIS_BROKER_MAX_BULKSZ		(512UL * 1024 * 1024)
+
+/* Commands which would change (or block) the state of the upstream
+ * connection, and thus affect the other sessions using that connection.
+ * The broker does any authentication and database selection itself.  Note
+ * that XREAD and XREADGROUP are also refused when they would block (see
+ * broker_is_denied_cmd()).
+ */
+static const char *redis_broker_denied_cmds[] = {
+  "ASKING",
+  "AUTH",
+  "BLMOVE",
+  "BLMPOP",
+  "BLPOP",
+  "BRPOP",
+  "BRPOPLPUSH",
+  "BZMPOP",
+  "BZPOPMAX",
+  "BZPOPMIN",
+  "CLIENT",
+  "DISCARD",
+  "EXEC",
+  "HELLO",
+  "MONITOR",
+  "MULTI",
+  "PSUBSCRIBE",
+  "PSYNC",
+  "READONLY",
+  "READWRITE",
+  "REPLCONF",
+  "RESET",
+  "SELECT",
+  "SSUBSCRIBE",
+  "SUBSCRIBE",
+  "SYNC",
+  "UNWATCH",
+  "WAIT",
+  "WAITAOF",
+  "WATCH",
+  NULL
+};
+
+static void broker_buf_append(struct redis_broker_conn *conn, char **buf,
+    size_t *bufsz, size_t *buflen, const char *data, size_t datasz) {
+
+  if (*buflen + datasz > *bufsz) {
+    size_t new_bufsz;
+    char *new_buf;
+
+    new_bufsz = (*bufsz > 0 ? *bufsz : REDIS_BROKER_BUFSZ);
+    while (new_bufsz < *buflen + datasz) {
+      new_bufsz *= 2;
+    }
+
+    new_buf = palloc(conn->pool, new_bufsz);
+    if (*buflen > 0) {
+      memcpy(new_buf, *buf, *buflen);
+    }
+
+    *buf = new_buf;
+    *bufsz = new_bufsz;
+  }
+
+  memcpy(*buf + *buflen, data, datasz);
+  *buflen += datasz;
+}
+
+static void broker_send(struct redis_broker_conn *conn, const char *data,
+    size_t datasz) {
+  if (conn->eof == TRUE) {
+    return;
+  }
+
+  broker_buf_append(conn, &(conn->obuf), &(conn->obufsz), &(conn->obuflen),
+    data, datasz);
+}
+
+static void broker_send_error(struct redis_broker_conn *conn,
+    const char *msg) {
+  broker_send(conn, "-", 1);
+  broker_send(conn, msg, strlen(msg));
+  broker_send(conn, "\r\n", 2);
+}
+
+static pool *broker_pool = NULL;
+
+static void broker_add_cmd(struct redis_broker_upstream *upstreams,
+    struct redis_broker_conn *conn, const char *reply) {
+  struct redis_broker_upstream *upstream;
+  struct redis_broker_cmd *cmd;
+
+  upstream = &(upstreams[conn->upstream_idx]);
+  if (upstream->pending == NULL) {
+    upstream->pending_pool = make_sub_pool(broker_pool);
+    pr_pool_tag(upstream->pending_pool, "Redis broker pending commands pool");
+
+    upstream->pending = make_array(upstream->pending_pool, 8,
+      sizeof(struct redis_broker_cmd));
+    upstream->next_pending = 0;
+  }
+
+  cmd = push_array(upstream->pending);
+  cmd->conn = conn;
+  cmd->reply = reply;
+
+  conn->npending++;
+}
+
+/* Re-encodes the given reply, as read from the upstream connection. */
+static void broker_send_reply(struct redis_broker_conn *conn,
+    redisReply *reply) {
+  register unsigned int i;
+  char hdr[64];
+  int hdrlen;
+
+  switch (reply->type) {
+    case REDIS_REPLY_STRING:
+      hdrlen = snprintf(hdr, sizeof(hdr), "$%lu\r\n",
+        (unsigned long) reply->len);
+      broker_send(conn, hdr, hdrlen);
+      broker_send(conn, reply->str, reply->len);
+      broker_send(conn, "\r\n", 2);
+      break;
+
+    case REDIS_REPLY_STATUS:
+      broker_send(conn, "+", 1);
+      broker_send(conn, reply->str, reply->len);
+      broker_send(conn, "\r\n", 2);
+      break;
+
+    case REDIS_REPLY_ERROR:
+      broker_send(conn, "-", 1);
+      broker_send(conn, reply->str, reply->len);
+      broker_send(conn, "\r\n", 2);
+      break;
+
+    case REDIS_REPLY_INTEGER:
+      hdrlen = snprintf(hdr, sizeof(hdr), ":%lld\r\n", reply->integer);
+      broker_send(conn, hdr, hdrlen);
+      break;
+
+    case REDIS_REPLY_NIL:
+      broker_send(conn, "$-1\r\n", 5);
+      break;
+
+    case REDIS_REPLY_ARRAY:
+      hdrlen = snprintf(hdr, sizeof(hdr), "*%lu\r\n",
+        (unsigned long) reply->elements);
+      broker_send(conn, hdr, hdrlen);
+
+      for (i = 0; i < reply->elements; i++) {
+        broker_send_reply(conn, reply->element[i]);
+      }
+      break;
+
+    default:
+      pr_trace_msg(trace_channel, 2,
+        "unable to relay unsupported reply type %s",
+        get_reply_type(reply->type));
+      broker_send_error(conn, "ERR unsupported reply type");
+      break;
+  }
+}
+
+/* Parses a RESP "*<count>\r\n" or "$<len>\r\n" line, starting at the given
+ * offset into the buffer.  Returns 1 if parsed, 0 if more data is needed,
+ * and -1 on a protocol error.
+ */
+static int broker_parse_len(const char *buf, size_t buflen, size_t *offset,
+    char type, unsigned long *len) {
+  const char *ptr, *eol;
+  char *endp = NULL;
+
+  if (*offset >= buflen) {
+    return 0;
+  }
+
+  ptr = buf + *offset;
+  if (*ptr != type) {
+    return -1;
+  }
+
+  eol = memchr(ptr, '\n', buflen - *offset);
+  if (eol == NULL) {
+    /* Reject absurdly long length lines. */
+    return (buflen - *offset) > 32 ? -1 : 0;
+  }
+
+  if (eol - ptr < 3 ||
+      *(eol - 1) != '\r') {
+    return -1;
+  }
+
+  *len = strtoul(ptr + 1, &endp, 10);
+  if (endp != eol - 1) {
+    return -1;
+  }
+
+  *offset = (eol - buf) + 1;
+  return 1;
+}
+
+/* Parses one complete command, as an array of bulk strings, from the
+ * session's buffer.  Returns 1 if parsed, 0 if more data is needed, and -1
+ * on a protocol error.
+ */
+static int broker_parse_cmd(pool *p, struct redis_broker_conn *conn,
+    size_t *offset, int *argc, const char ***argv, size_t **argvlen) {
+  register unsigned int i;
+  unsigned long count;
+  size_t pos;
+  int res;
+
+  pos = *offset;
+  res = broker_parse_len(conn->ibuf, conn->ibuflen, &pos, '*', &count);
+  if (res <= 0) {
+    return res;
+  }
+
+  if (count == 0 ||
+      count > INT_MAX) {
+    return -1;
+  }
+
+  *argc = (int) count;
+  *argv = pcalloc(p, sizeof(char *) * count);
+  *argvlen = pcalloc(p, sizeof(size_t) * count);
+
+  for (i = 0; i < count; i++) {
+    unsigned long len;
+
+    res = broker_parse_len(conn->ibuf, conn->ibuflen, &pos, '$', &len);
+    if (res <= 0) {
+      return res;
+    }
+
+    if (len > REDIS_BROKER_MAX_BULKSZ) {
+      return -1;
+    }
+
+    if (conn->ibuflen - pos < len + 2) {
+      return 0;
+    }
+
+    if (conn->ibuf[pos + len] != '\r' ||
+        conn->ibuf[pos + len + 1] != '\n') {
+      return -1;
+    }
+
+    (*argv)[i] = conn->ibuf + pos;
+    (*argvlen)[i] = len;
+    pos += (len + 2);
+  }
+
+  *offset = pos;
+  return 1;
+}
+
+static int broker_is_denied_cmd(int argc, const char **argv,
+    size_t *argvlen) {
+  register int i;
+
+  for (i = 0; redis_broker_denied_cmds[i] != NULL; i++) {
+    if (strlen(redis_broker_denied_cmds[i]) == argvlen[0] &&
+        strncasecmp(redis_broker_denied_cmds[i], argv[0], argvlen[0]) == 0) {
+      return TRUE;
+    }
+  }
+
+  /* XREAD and XREADGROUP block if given the BLOCK option, which precedes
+   * the STREAMS keys and IDs.
+   */
+  if ((argvlen[0] == 5 &&
+       strncasecmp(argv[0], "XREAD", 5) == 0) ||
+      (argvlen[0] == 10 &&
+       strncasecmp(argv[0], "XREADGROUP", 10) == 0)) {
+    for (i = 1; i < argc; i++) {
+      if (argvlen[i] == 7 &&
+          strncasecmp(argv[i], "STREAMS", 7) == 0) {
+        break;
+      }
+
+      if (argvlen[i] == 5 &&
+          strncasecmp(argv[i], "BLOCK", 5) == 0) {
+        return TRUE;
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+/* Only proftpd session processes may use the broker, as it is already
+ * authenticated to the Redis server.  The socket permissions limit it to
+ * processes running as the daemon User; to tell the sessions apart from any
+ * other processes which run as that User, the peer must also be in the
+ * daemon's session (see setsid(2)), which other processes cannot join.  The
+ * peer's PID is only known where SO_PEERCRED is available; otherwise, only
+ * the peer's UID can be checked.
+ */
+static int broker_check_peer(int fd) {
+  uid_t peer_uid;
+  pid_t peer_pid = 0;
+#if defined(SO_PEERCRED)
+# if defined(HAVE_STRUCT_SOCKPEERCRED)
+  struct sockpeercred cred;
+# else
+  struct ucred cred;
+# endif /* HAVE_STRUCT_SOCKPEERCRED */
+  socklen_t cred_len;
+
+  cred_len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 2,
+      "broker error obtaining peer credentials using SO_PEERCRED: %s",
+      strerror(xerrno));
+
+    errno = EPERM;
+    return -1;
+  }
+
+  peer_uid = cred.uid;
+  peer_pid = cred.pid;
+
+#elif defined(HAVE_GETPEEREID)
+  gid_t peer_gid;
+
+  if (getpeereid(fd, &peer_uid, &peer_gid) < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 2,
+      "broker error obtaining peer credentials using getpeereid(2): %s",
+      strerror(xerrno));
+
+    errno = EPERM;
+    return -1;
+  }
+
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* !SO_PEERCRED and !HAVE_GETPEEREID */
+
+  if (peer_uid != 0 &&
+      peer_uid != geteuid()) {
+    pr_trace_msg(trace_channel, 3,
+      "broker rejected connection from UID %lu: not the daemon User",
+      (unsigned long) peer_uid);
+    errno = EACCES;
+    return -1;
+  }
+
+  if (peer_pid > 0 &&
+      getsid(peer_pid) != getsid(0)) {
+    pr_trace_msg(trace_channel, 3,
+      "broker rejected connection from PID %lu: not a session process",
+      (unsigned long) peer_pid);
+    errno = EACCES;
+    return -1;
+  }
+
+  return 0;
+}
+
+static pr_redis_t *broker_get_upstream(struct redis_broker_upstream *upstreams,
+    unsigned int idx) {
+  struct redis_broker_upstream *upstream;
+
+  upstream = &(upstreams[idx]);
+  if (upstream->redis == NULL) {
+    time_t now;
+
+    /* Do not stall every session by trying to connect for each command,
+     * while the Redis server is unavailable.
+     */
+    time(&now);
+    if (now - upstream->connect_failed < 1) {
+      return NULL;
+    }
+
+    upstream->redis = pr_redis_conn_new(broker_pool, NULL, redis_flags);
+    if (upstream->redis == NULL) {
+      pr_trace_msg(trace_channel, 3,
+        "broker unable to connect to Redis server (#%u): %s", idx + 1,
+        strerror(errno));
+      upstream->connect_failed = now;
+
+    } else {
+      pr_trace_msg(trace_channel, 9, "broker connected to Redis server (#%u)",
+        idx + 1);
+    }
+  }
+
+  return upstream->redis;
+}
+
+/* Reads and forwards any complete commands from the session, queuing the
+ * session on the pending list of its upstream connection for each command
+ * forwarded.
+ */
+static void broker_handle_conn(pool *p, struct redis_broker_conn *conn,
+    struct redis_broker_upstream *upstreams) {
+  ssize_t len;
+  size_t offset = 0;
+
+  if (conn->ibuflen == conn->ibufsz) {
+    char *buf;
+    size_t bufsz;
+
+    bufsz = (conn->ibufsz > 0 ? conn->ibufsz * 2 : REDIS_BROKER_BUFSZ);
+    buf = palloc(conn->pool, bufsz);
+    if (conn->ibuflen > 0) {
+      memcpy(buf, conn->ibuf, conn->ibuflen);
+    }
+
+    conn->ibuf = buf;
+    conn->ibufsz = bufsz;
+  }
+
+  len = read(conn->fd, conn->ibuf + conn->ibuflen,
+    conn->ibufsz - conn->ibuflen);
+  if (len <= 0) {
+    if (len < 0 &&
+        (errno == EINTR || errno == EAGAIN)) {
+      return;
+    }
+
+    conn->eof = TRUE;
+    conn->closing = TRUE;
+    return;
+  }
+
+  conn->ibuflen += len;
+
+  while (conn->closing == FALSE) {
+    int argc = 0, res;
+    const char **argv = NULL;
+    size_t *argvlen = NULL;
+    pr_redis_t *upstream;
+
+    res = broker_parse_cmd(p, conn, &offset, &argc, &argv, &argvlen);
+    if (res == 0) {
+      break;
+    }
+
+    if (res < 0) {
+      pr_trace_msg(trace_channel, 3,
+        "broker received malformed command from fd %d, closing", conn->fd);
+      broker_add_cmd(upstreams, conn, "-ERR Protocol error\r\n");
+      conn->closing = TRUE;
+      break;
+    }
+
+    if (argvlen[0] == 4 &&
+        strncasecmp(argv[0], "QUIT", 4) == 0) {
+      broker_add_cmd(upstreams, conn, "+OK\r\n");
+      conn->closing = TRUE;
+      break;
+    }
+
+    if (broker_is_denied_cmd(argc, argv, argvlen) == TRUE) {
+      pr_trace_msg(trace_channel, 9, "broker refused %.*s command",
+        (int) argvlen[0], argv[0]);
+      broker_add_cmd(upstreams, conn,
+        "-ERR command not supported via broker\r\n");
+      continue;
+    }
+
+    upstream = broker_get_upstream(upstreams, conn->upstream_idx);
+    if (upstream == NULL) {
+      broker_add_cmd(upstreams, conn,
+        "-ERR no connection to Redis server\r\n");
+      continue;
+    }
+
+    if (redisAppendCommandArgv(upstream->ctx, argc, argv,
+        argvlen) != REDIS_OK) {
+      broker_add_cmd(upstreams, conn, "-ERR unable to forward command\r\n");
+      continue;
+    }
+
+    broker_add_cmd(upstreams, conn, NULL);
+  }
+
+  if (offset > 0) {
+    conn->ibuflen -= offset;
+    if (conn->ibuflen > 0) {
+      memmove(conn->ibuf, conn->ibuf + offset, conn->ibuflen);
+    }
+  }
+}
+
+/* Sends the forwarded commands on the upstream connection, without waiting
+ * for their replies.
+ */
+static int broker_flush_upstream(pool *p, pr_redis_t *upstream,
+    unsigned int idx) {
+  int done = 0;
+
+  while (done == 0) {
+    if (redisBufferWrite(upstream->ctx, &done) != REDIS_OK) {
+      pr_trace_msg(trace_channel, 2,
+        "broker error sending commands to Redis server (#%u): %s", idx + 1,
+        redis_strerror(p, upstream, errno));
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void broker_done_cmd(struct redis_broker_upstream *upstream,
+    struct redis_broker_cmd *cmd) {
+  cmd->conn->npending--;
+  upstream->next_pending++;
+
+  if (upstream->next_pending == upstream->pending->nelts) {
+    destroy_pool(upstream->pending_pool);
+    upstream->pending_pool = NULL;
+    upstream->pending = NULL;
+    upstream->next_pending = 0;
+  }
+}
+
+/* Relays the replies, which have been read, for the pending commands to the
+ * sessions which sent those commands.  Returns -1 if the replies could not
+ * be parsed.
+ */
+static int broker_relay_replies(pool *p,
+    struct redis_broker_upstream *upstreams, unsigned int idx) {
+  struct redis_broker_upstream *upstream;
+
+  upstream = &(upstreams[idx]);
+
+  while (upstream->pending != NULL) {
+    struct redis_broker_cmd *cmd;
+    void *data = NULL;
+
+    cmd = ((struct redis_broker_cmd *) upstream->pending->elts) +
+      upstream->next_pending;
+
+    if (cmd->reply != NULL) {
+      broker_send(cmd->conn, cmd->reply, strlen(cmd->reply));
+      broker_done_cmd(upstream, cmd);
+      continue;
+    }
+
+    if (upstream->redis == NULL) {
+      break;
+    }
+
+    if (redisGetReplyFromReader(upstream->redis->ctx, &data) != REDIS_OK) {
+      pr_trace_msg(trace_channel, 2,
+        "broker error reading reply from Redis server (#%u): %s", idx + 1,
+        redis_strerror(p, upstream->redis, errno));
+      return -1;
+    }
+
+    if (data == NULL) {
+      /* The rest of the replies have yet to arrive. */
+      break;
+    }
+
+    broker_send_reply(cmd->conn, data);
+    freeReplyObject(data);
+    broker_done_cmd(upstream, cmd);
+  }
+
+  return 0;
+}
+
+/* Fails all of the pending commands of the upstream connection, and closes
+ * it.  Whatever else was sent or received on this connection is now unknown;
+ * start afresh, with a new connection, when next needed.
+ */
+static void broker_fail_upstream(struct redis_broker_upstream *upstreams,
+    unsigned int idx) {
+  struct redis_broker_upstream *upstream;
 
-    elt = reply->element[0];
-    if (elt->type == REDIS_REPLY_STRING) {
-      host = pstrndup(tmp_pool, elt->str, elt->len);
+  upstream = &(upstreams[idx]);
 
-    } else {
-      pr_trace_msg(trace_channel, 2,
-        "expected STRING element at index 0, got %s",
-        get_reply_type(elt->type));
-    }
+  while (upstream->pending != NULL) {
+    struct redis_broker_cmd *cmd;
 
-    elt = reply->element[1];
-    if (elt->type == REDIS_REPLY_STRING) {
-      char *port_str;
+    cmd = ((struct redis_broker_cmd *) upstream->pending->elts) +
+      upstream->next_pending;
 
-      port_str = pstrndup(tmp_pool, elt->str, elt->len);
-      port = atoi(port_str);
+    if (cmd->reply != NULL) {
+      broker_send(cmd->conn, cmd->reply, strlen(cmd->reply));
 
     } else {
-      pr_trace_msg(trace_channel, 2,
-        "expected STRING element at index 1, got %s",
-        get_reply_type(elt->type));
+      broker_send_error(cmd->conn, "ERR lost connection to Redis server");
     }
 
-    if (host != NULL &&
-        port != -1) {
-      *addr = (pr_netaddr_t *) pr_netaddr_get_addr(p, host, NULL);
-      if (*addr != NULL) {
-        pr_netaddr_set_port2(*addr, port);
+    broker_done_cmd(upstream, cmd);
+  }
 
-      } else {
-        xerrno = errno;
-        res = -1;
-      }
+  if (upstream->redis != NULL) {
+    (void) pr_redis_conn_destroy(upstream->redis);
+    upstream->redis = NULL;
+  }
+}
 
-    } else {
-      xerrno = ENOENT;
-      res = -1;
-    }
+static void broker_flush_conn(struct redis_broker_conn *conn) {
+  ssize_t len;
 
-  } else {
-    xerrno = ENOENT;
-    res = -1;
+  if (conn->eof == TRUE ||
+      conn->obuflen == 0) {
+    return;
   }
 
-  freeReplyObject(reply);
-  destroy_pool(tmp_pool);
+  len = write(conn->fd, conn->obuf, conn->obuflen);
+  if (len < 0) {
+    if (errno != EINTR &&
+        errno != EAGAIN) {
+      conn->eof = TRUE;
+    }
 
-  errno = xerrno;
-  return res;
+    return;
+  }
+
+  conn->obuflen -= len;
+  if (conn->obuflen > 0) {
+    memmove(conn->obuf, conn->obuf + len, conn->obuflen);
+  }
 }
 
-int pr_redis_sentinel_get_masters(pool *p, pr_redis_t *redis,
-    array_header **masters) {
-  int res = 0, xerrno = 0;
-  pool *tmp_pool = NULL;
-  const char *cmd = NULL;
-  redisReply *reply;
+int redis_broker_run(pool *p, int listen_fd, unsigned int nupstreams) {
+  register unsigned int i;
+  struct redis_broker_upstream *upstreams;
+  array_header *conns;
+  unsigned int next_upstream = 0;
 
   if (p == NULL ||
-      redis == NULL ||
-      masters == NULL) {
+      listen_fd < 0 ||
+      nupstreams == 0) {
     errno = EINVAL;
     return -1;
   }
 
-  tmp_pool = make_sub_pool(redis->pool);
-  pr_pool_tag(tmp_pool, "Redis SENTINEL pool");
+#if !defined(SO_PEERCRED) && !defined(HAVE_GETPEEREID)
+  /* Without a way to check the peers, every connection would be rejected. */
+  errno = ENOSYS;
+  return -1;
+#endif /* !SO_PEERCRED and !HAVE_GETPEEREID */
 
-  cmd = "SENTINEL";
-  pr_trace_msg(trace_channel, 7, "sending command: %s", cmd);
-  reply = redisCommand(redis->ctx, "%s masters", cmd);
-  xerrno = errno;
+  /* The broker itself must use the Redis server, not the broker. */
+  redis_broker_path = NULL;
 
-  reply = handle_reply(redis, cmd, reply);
-  if (reply == NULL) {
-    pr_trace_msg(trace_channel, 2,
-      "error getting masters: %s", strerror(errno));
-    destroy_pool(tmp_pool);
-    errno = EIO;
-    return -1;
+  broker_pool = make_sub_pool(p);
+  pr_pool_tag(broker_pool, "Redis broker pool");
+
+  upstreams = pcalloc(broker_pool,
+    sizeof(struct redis_broker_upstream) * nupstreams);
+  for (i = 0; i < nupstreams; i++) {
+    (void) broker_get_upstream(upstreams, i);
   }
 
-  if (reply->type == REDIS_REPLY_NIL) {
-    pr_trace_msg(trace_channel, 7, "%s reply: nil", cmd);
-    freeReplyObject(reply);
-    destroy_pool(tmp_pool);
+  conns = make_array(broker_pool, 0, sizeof(struct redis_broker_conn *));
 
-    errno = ENOENT;
-    return -1;
-  }
+  while (TRUE) {
+    int res;
+    unsigned int nconns, nlive;
+    pool *tmp_pool;
+    struct pollfd *pfds, *upstream_pfds;
+    struct redis_broker_conn **elts;
 
-  if (reply->type != REDIS_REPLY_ARRAY) {
-    pr_trace_msg(trace_channel, 2,
-      "expected ARRAY reply for %s, got %s", cmd, get_reply_type(reply->type));
+    pr_signals_handle();
 
-    if (reply->type == REDIS_REPLY_ERROR) {
-      pr_trace_msg(trace_channel, 2, "%s error: %s", cmd, reply->str);
+    /* Note that poll(2) is used here, rather than select(2), as there may
+     * well be more sessions connected than FD_SETSIZE allows.
+     */
+    tmp_pool = make_sub_pool(broker_pool);
+    nconns = conns->nelts;
+    elts = conns->elts;
+
+    pfds = pcalloc(tmp_pool,
+      sizeof(struct pollfd) * (nconns + nupstreams + 1));
+    pfds[0].fd = listen_fd;
+    pfds[0].events = POLLIN;
+
+    for (i = 0; i < nconns; i++) {
+      /* Sessions which have gone away are kept only until the replies to
+       * their pending commands have been read, and are not polled.
+       */
+      if (elts[i]->eof == TRUE) {
+        pfds[i+1].fd = -1;
+        continue;
+      }
+
+      pfds[i+1].fd = elts[i]->fd;
+      pfds[i+1].events = (elts[i]->closing == FALSE ? POLLIN : 0);
+      if (elts[i]->obuflen > 0) {
+        pfds[i+1].events |= POLLOUT;
+      }
     }
 
-    freeReplyObject(reply);
-    destroy_pool(tmp_pool);
-    errno = EINVAL;
-    return -1;
-  }
+    /* Only the upstream connections awaiting replies are polled. */
+    upstream_pfds = pfds + nconns + 1;
+    for (i = 0; i < nupstreams; i++) {
+      upstream_pfds[i].fd = -1;
 
-  if (reply->elements > 0) {
-    register unsigned int i;
+      if (upstreams[i].redis != NULL &&
+          upstreams[i].pending != NULL) {
+        upstream_pfds[i].fd = upstreams[i].redis->ctx->fd;
+        upstream_pfds[i].events = POLLIN;
+      }
+    }
 
-    pr_trace_msg(trace_channel, 7, "%s reply: %lu %s", cmd,
-      (unsigned long) reply->elements,
-      reply->elements != 1 ? "elements" : "element");
+    res = poll(pfds, nconns + nupstreams + 1, 1000);
+    if (res < 0) {
+      int xerrno = errno;
 
-    *masters = make_array(p, reply->elements, sizeof(char *));
+      destroy_pool(tmp_pool);
 
-    for (i = 0; i < reply->elements; i++) {
-      redisReply *elt;
+      if (xerrno == EINTR) {
+        continue;
+      }
 
-      elt = reply->element[i];
-      if (elt->type == REDIS_REPLY_ARRAY) {
-        redisReply *info;
+      pr_trace_msg(trace_channel, 1, "broker error polling connections: %s",
+        strerror(xerrno));
+      destroy_pool(broker_pool);
+      broker_pool = NULL;
 
-        info = elt->element[1];
-        *((char **) push_array(*masters)) = pstrndup(p, info->str, info->len);
+      errno = xerrno;
+      return -1;
+    }
 
-      } else {
+    if (res == 0) {
+      destroy_pool(tmp_pool);
+      continue;
+    }
+
+    /* Read the replies which have arrived. */
+    for (i = 0; i < nupstreams; i++) {
+      if (upstream_pfds[i].fd < 0 ||
+          !(upstream_pfds[i].revents & (POLLIN|POLLHUP|POLLERR))) {
+        continue;
+      }
+
+      if (redisBufferRead(upstreams[i].redis->ctx) != REDIS_OK) {
         pr_trace_msg(trace_channel, 2,
-          "expected ARRAY element at index %u, got %s", i,
-          get_reply_type(elt->type));
+          "broker error reading replies from Redis server (#%u): %s", i + 1,
+          redis_strerror(tmp_pool, upstreams[i].redis, errno));
+        broker_fail_upstream(upstreams, i);
       }
     }
 
-  } else {
-    xerrno = ENOENT;
-    res = -1;
+    for (i = 0; i < nconns; i++) {
+      if (pfds[i+1].revents & (POLLIN|POLLHUP|POLLERR)) {
+        if (elts[i]->closing == FALSE) {
+          broker_handle_conn(tmp_pool, elts[i], upstreams);
+
+        } else {
+          elts[i]->eof = TRUE;
+        }
+      }
+    }
+
+    /* Send the newly forwarded commands, and relay the replies read (and
+     * those of any commands which were not forwarded).
+     */
+    for (i = 0; i < nupstreams; i++) {
+      if (upstreams[i].redis != NULL &&
+          broker_flush_upstream(tmp_pool, upstreams[i].redis, i) < 0) {
+        broker_fail_upstream(upstreams, i);
+        continue;
+      }
+
+      if (broker_relay_replies(tmp_pool, upstreams, i) < 0) {
+        broker_fail_upstream(upstreams, i);
+      }
+    }
+
+    /* Write what replies we can, and drop the closed connections. */
+    nlive = 0;
+    for (i = 0; i < nconns; i++) {
+      struct redis_broker_conn *conn;
+
+      conn = elts[i];
+      broker_flush_conn(conn);
+
+      if (conn->npending == 0 &&
+          (conn->eof == TRUE ||
+           (conn->closing == TRUE && conn->obuflen == 0))) {
+        pr_trace_msg(trace_channel, 19, "broker closing fd %d", conn->fd);
+        (void) close(conn->fd);
+        destroy_pool(conn->pool);
+        continue;
+      }
+
+      elts[nlive++] = conn;
+    }
+
+    conns->nelts = nlive;
+
+    if (pfds[0].revents & POLLIN) {
+      int fd;
+
+      fd = accept(listen_fd, NULL, NULL);
+      if (fd >= 0 &&
+          broker_check_peer(fd) < 0) {
+        pr_trace_msg(trace_channel, 9,
+          "broker closing fd %d: %s", fd, strerror(errno));
+        (void) close(fd);
+
+      } else if (fd >= 0) {
+        struct redis_broker_conn *conn;
+        pool *conn_pool;
+        int flags;
+
+        flags = fcntl(fd, F_GETFL);
+        (void) fcntl(fd, F_SETFL, flags|O_NONBLOCK);
+
+        conn_pool = make_sub_pool(broker_pool);
+        pr_pool_tag(conn_pool, "Redis broker connection pool");
+
+        conn = pcalloc(conn_pool, sizeof(struct redis_broker_conn));
+        conn->pool = conn_pool;
+        conn->fd = fd;
+        conn->upstream_idx = next_upstream++ % nupstreams;
+
+        pr_trace_msg(trace_channel, 19,
+          "broker accepted fd %d, using Redis server connection #%u", fd,
+          conn->upstream_idx + 1);
+        *((struct redis_broker_conn **) push_array(conns)) = conn;
+
+      } else if (errno != EINTR &&
+                 errno != EAGAIN) {
+        pr_trace_msg(trace_channel, 3, "broker error accepting connection: %s",
+          strerror(errno));
+      }
+    }
+
+    destroy_pool(tmp_pool);
   }
 
-  freeReplyObject(reply);
-  destroy_pool(tmp_pool);
+  /* Not reached. */
+  return 0;
+}
 
-  errno = xerrno;
-  return res;
+int redis_set_broker(const char *path) {
+  if (path != NULL &&
+      *path != '/') {
+    errno = EINVAL;
+    return -1;
+  }
+
+  redis_broker_path = path;
+  return 0;
 }
 
 int redis_set_server(const char *server, int port, unsigned long flags,
@@ -5733,6 +7552,94 @@ int pr_redis_command(pr_redis_t *redis, const array_header *args,
   return -1;
 }
 
+pr_redis_pipeline_t *pr_redis_pipeline_alloc(pool *p, pr_redis_t *redis,
+    module *m) {
+  errno = ENOSYS;
+  return NULL;
+}
+
+int pr_redis_pipeline_command(pr_redis_pipeline_t *pipeline,
+    const array_header *args) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_get(pr_redis_pipeline_t *pipeline, const char *key) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_kget(pr_redis_pipeline_t *pipeline, const char *key,
+    size_t keysz) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_incr(pr_redis_pipeline_t *pipeline, const char *key,
+    uint32_t incr) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_kincr(pr_redis_pipeline_t *pipeline, const char *key,
+    size_t keysz, uint32_t incr) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_remove(pr_redis_pipeline_t *pipeline, const char *key) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_kremove(pr_redis_pipeline_t *pipeline, const char *key,
+    size_t keysz) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_set(pr_redis_pipeline_t *pipeline, const char *key,
+    void *value, size_t valuesz, time_t expires) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_kset(pr_redis_pipeline_t *pipeline, const char *key,
+    size_t keysz, void *value, size_t valuesz, time_t expires) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_list_getall(pr_redis_pipeline_t *pipeline,
+    const char *key) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_list_kgetall(pr_redis_pipeline_t *pipeline,
+    const char *key, size_t keysz) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_set_getall(pr_redis_pipeline_t *pipeline,
+    const char *key) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_set_kgetall(pr_redis_pipeline_t *pipeline,
+    const char *key, size_t keysz) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_pipeline_exec(pool *p, pr_redis_pipeline_t *pipeline,
+    array_header **replies) {
+  errno = ENOSYS;
+  return -1;
+}
+
 int pr_redis_add(pr_redis_t *redis, module *m, const char *key, void *value,
     size_t valuesz, time_t expires) {
   errno = ENOSYS;
@@ -5779,6 +7686,18 @@ int pr_redis_set(pr_redis_t *redis, module *m, const char *key, void *value,
   return -1;
 }
 
+int pr_redis_mget(pool *p, pr_redis_t *redis, module *m, array_header *keys,
+    array_header **values, array_header **valueszs) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_mset(pr_redis_t *redis, module *m, array_header *keys,
+    array_header *values, array_header *valueszs, time_t expires) {
+  errno = ENOSYS;
+  return -1;
+}
+
 int pr_redis_hash_count(pr_redis_t *redis, module *m, const char *key,
     uint64_t *count) {
   errno = ENOSYS;
@@ -6052,6 +7971,19 @@ int pr_redis_kset(pr_redis_t *redis, module *m, const char *key, size_t keysz,
   return -1;
 }
 
+int pr_redis_kmget(pool *p, pr_redis_t *redis, module *m, array_header *keys,
+    array_header *keyszs, array_header **values, array_header **valueszs) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_redis_kmset(pr_redis_t *redis, module *m, array_header *keys,
+    array_header *keyszs, array_header *values, array_header *valueszs,
+    time_t expires) {
+  errno = ENOSYS;
+  return -1;
+}
+
 int pr_redis_hash_kcount(pr_redis_t *redis, module *m, const char *key,
     size_t keysz, uint64_t *count) {
   errno = ENOSYS;
@@ -6326,6 +8258,16 @@ int redis_set_timeouts(unsigned long conn_millis, unsigned long io_millis) {
   return -1;
 }
 
+int redis_set_broker(const char *path) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int redis_broker_run(pool *p, int listen_fd, unsigned int nupstreams) {
+  errno = ENOSYS;
+  return -1;
+}
+
 int redis_clear(void) {
   errno = ENOSYS;
   return -1;
@@ -124,9 +124,22 @@ static void handle_chld(void) {
   }
 
   while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+    /* Not every child is a session, e.g. acceptor processes (see
+     * AcceptorProcesses); the daemon checks for those as well.
+     */
+    have_dead_child = TRUE;
+
     if (child_remove(pid) == 0) {
-      have_dead_child = TRUE;
+      /* Remove the TraceBuffer of a session which ended cleanly. */
+      (void) pr_trace_remove_buffer(pid);
     }
+
+    /* Let the listeners for the other child processes know that this one
+     * has been reaped, and thus that its PID may now be reused.  Note that
+     * the listeners are called with SIGCHLD blocked, and should only note
+     * the PID, not fork or signal other processes.
+     */
+    pr_event_generate("core.signal.CHLD", &pid);
   }
 
   if (sigprocmask(SIG_UNBLOCK, &sig_set, NULL) < 0) {
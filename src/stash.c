@@ -64,6 +64,12 @@ static struct stash *auth_curr_sym = NULL;
 static xaset_t *hook_symbol_table[PR_TUNABLE_HASH_TABLE_SIZE];
 static struct stash *hook_curr_sym = NULL;
 
+/* Serial numbers for each type, bumped whenever a symbol of that type is
+ * added or removed.  Callers which cache lookup results (e.g. the command
+ * dispatch plans) use these to know when their caches are stale.
+ */
+static unsigned long symbol_serials[PR_SYM_HOOK+1];
+
 /* Symbol stash lookup code and management */
 
 static struct stash *sym_alloc(void) {
@@ -289,6 +295,7 @@ int pr_stash_add_symbol(pr_stash_type_t sym_type, void *data) {
   }
 
   xaset_insert_sort(symbol_table[idx], (xasetmember_t *) sym, TRUE);
+  symbol_serials[sym_type]++;
   return 0;
 }
 
@@ -592,6 +599,18 @@ void *pr_stash_get_symbol(pr_stash_type_t sym_type, const char *name,
   return pr_stash_get_symbol2(sym_type, name, prev, idx_cache, NULL);
 }
 
+unsigned long pr_stash_get_serial(pr_stash_type_t sym_type) {
+  if (sym_type != PR_SYM_CONF &&
+      sym_type != PR_SYM_CMD &&
+      sym_type != PR_SYM_AUTH &&
+      sym_type != PR_SYM_HOOK) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  return symbol_serials[sym_type];
+}
+
 int pr_stash_remove_conf(const char *directive_name, module *m) {
   int count = 0, prev_idx, symtab_idx = 0;
   size_t directive_namelen = 0;
@@ -635,6 +654,10 @@ int pr_stash_remove_conf(const char *directive_name, module *m) {
       &hash);
   }
 
+  if (count > 0) {
+    symbol_serials[PR_SYM_CONF]++;
+  }
+
   return count;
 }
 
@@ -694,6 +717,10 @@ int pr_stash_remove_cmd(const char *cmd_name, module *m,
     tab = pr_stash_get_symbol2(PR_SYM_CMD, cmd_name, tab, &prev_idx, &hash);
   }
 
+  if (count > 0) {
+    symbol_serials[PR_SYM_CMD]++;
+  }
+
   return count;
 }
 
@@ -738,6 +765,10 @@ int pr_stash_remove_auth(const char *api_name, module *m) {
     tab = pr_stash_get_symbol2(PR_SYM_AUTH, api_name, tab, &prev_idx, &hash);
   }
 
+  if (count > 0) {
+    symbol_serials[PR_SYM_AUTH]++;
+  }
+
   return count;
 }
 
@@ -782,6 +813,10 @@ int pr_stash_remove_hook(const char *hook_name, module *m) {
     tab = pr_stash_get_symbol2(PR_SYM_HOOK, hook_name, tab, &prev_idx, &hash);
   }
 
+  if (count > 0) {
+    symbol_serials[PR_SYM_HOOK]++;
+  }
+
   return count;
 }
 
@@ -904,5 +939,13 @@ int init_stash(void) {
   memset(auth_symbol_table, '\0', sizeof(auth_symbol_table));
   memset(hook_symbol_table, '\0', sizeof(hook_symbol_table));
 
+  /* Bump, rather than reset, the serial numbers, so that any cached lookups
+   * are known to be stale.
+   */
+  symbol_serials[PR_SYM_CONF]++;
+  symbol_serials[PR_SYM_CMD]++;
+  symbol_serials[PR_SYM_AUTH]++;
+  symbol_serials[PR_SYM_HOOK]++;
+
   return 0;
 }
@@ -27,6 +27,14 @@
 #include "conf.h"
 #include "privs.h"
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+#ifndef MAP_FAILED
+# define MAP_FAILED	((void *) -1)
+#endif /* MAP_FAILED */
+
 #ifdef PR_USE_TRACE
 
 static int trace_logfd = -1;
@@ -34,6 +42,20 @@ static unsigned long trace_opts = PR_TRACE_OPT_DEFAULT;
 static pool *trace_pool = NULL;
 static pr_table_t *trace_tab = NULL;
 
+/* The TraceBuffer path prefix and size; the buffer mapped by this process,
+ * if any, and the pid for which it was mapped.  A forked child inherits its
+ * parent's mapping, and so maps a buffer of its own on its first message.
+ */
+static char trace_buffer_path[PR_TUNABLE_PATH_MAX+1] = {'\0'};
+static size_t trace_buffer_size = 0;
+static pr_trace_buffer_header_t *trace_buffer = NULL;
+static size_t trace_buffer_mapsz = 0;
+static pid_t trace_buffer_pid = 0;
+static int trace_buffer_exit_registered = FALSE;
+
+#define TRACE_BUFFER_MSGSZ \
+  (PR_TRACE_BUFFER_RECORD_SIZE - sizeof(pr_trace_buffer_record_t))
+
 struct trace_levels {
   int min_level;
   int max_level;
@@ -189,6 +211,285 @@ static int trace_write(const char *channel, int level, const char *msg,
   return write(trace_logfd, buf, buflen);
 }
 
+#if defined(__GNUC__) && \
+    ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+# define TRACE_BUFFER_BARRIER()		__sync_synchronize()
+#else
+# define TRACE_BUFFER_BARRIER()
+#endif
+
+static void trace_buffer_unmap(void) {
+  if (trace_buffer != NULL) {
+    (void) munmap((void *) trace_buffer, trace_buffer_mapsz);
+    trace_buffer = NULL;
+    trace_buffer_mapsz = 0;
+  }
+}
+
+static const char *trace_buffer_get_path(char *buf, size_t bufsz, pid_t pid) {
+  size_t len;
+
+  /* Note that pr_trace_set_buffer() leaves room for the ".<pid>" suffix. */
+  memset(buf, '\0', bufsz);
+  len = sstrncpy(buf, trace_buffer_path, bufsz);
+  snprintf(buf + len, bufsz - len - 1, ".%lu", (unsigned long) pid);
+  return buf;
+}
+
+/* Note that nothing may be traced here, as we are called while writing a
+ * trace message.
+ */
+static int trace_buffer_map(pid_t pid) {
+  char path[PR_TUNABLE_PATH_MAX+1];
+  int fd, flags = O_RDWR|O_CREAT|O_TRUNC, xerrno;
+  size_t mapsz;
+  void *map;
+
+  /* Any buffer already mapped was inherited from our parent process.
+   * Unmapping it here leaves the parent's mapping intact.  Remember the
+   * pid, so that we do not retry for every message should we fail.
+   */
+  trace_buffer_unmap();
+  trace_buffer_pid = pid;
+
+#ifdef O_NOFOLLOW
+  flags |= O_NOFOLLOW;
+#endif /* O_NOFOLLOW */
+
+  fd = open(trace_buffer_get_path(path, sizeof(path), pid), flags, 0600);
+  if (fd < 0) {
+    return -1;
+  }
+
+  mapsz = (trace_buffer_size / PR_TRACE_BUFFER_RECORD_SIZE) *
+    PR_TRACE_BUFFER_RECORD_SIZE;
+
+  /* The file is left sparse; only the records actually written use space. */
+  if (ftruncate(fd, (off_t) mapsz) < 0) {
+    xerrno = errno;
+    (void) close(fd);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  map = mmap(NULL, mapsz, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  xerrno = errno;
+  (void) close(fd);
+
+  if (map == MAP_FAILED) {
+    errno = xerrno;
+    return -1;
+  }
+
+  trace_buffer = map;
+  trace_buffer_mapsz = mapsz;
+
+  trace_buffer->tbh_magic = PR_TRACE_BUFFER_MAGIC;
+  trace_buffer->tbh_version = PR_TRACE_BUFFER_VERSION;
+  trace_buffer->tbh_pid = (uint32_t) pid;
+  trace_buffer->tbh_flags = 0;
+  trace_buffer->tbh_record_size = PR_TRACE_BUFFER_RECORD_SIZE;
+  trace_buffer->tbh_nrecords = (uint32_t)
+    ((mapsz / PR_TRACE_BUFFER_RECORD_SIZE) - 1);
+  trace_buffer->tbh_next = 0;
+
+  return 0;
+}
+
+/* Claims the next record in this process' trace buffer, and fills in all
+ * but the message.  The record is published by trace_buffer_commit().
+ */
+static pr_trace_buffer_record_t *trace_buffer_next(const char *channel,
+    int level, uint64_t *seqno) {
+  pr_trace_buffer_record_t *rec;
+  struct timeval now;
+  pid_t pid;
+
+  pid = session.pid ? session.pid : getpid();
+  if (pid != trace_buffer_pid) {
+    if (trace_buffer_map(pid) < 0) {
+      return NULL;
+    }
+  }
+
+  if (trace_buffer == NULL) {
+    return NULL;
+  }
+
+  *seqno = trace_buffer->tbh_next++;
+  rec = (pr_trace_buffer_record_t *) (((char *) trace_buffer) +
+    ((1 + (*seqno % trace_buffer->tbh_nrecords)) *
+     PR_TRACE_BUFFER_RECORD_SIZE));
+
+  rec->tbr_seqno = 0;
+  TRACE_BUFFER_BARRIER();
+
+  gettimeofday(&now, NULL);
+  rec->tbr_sec = (int64_t) now.tv_sec;
+  rec->tbr_usec = (uint32_t) now.tv_usec;
+  rec->tbr_level = (uint32_t) level;
+  sstrncpy(rec->tbr_channel, channel, sizeof(rec->tbr_channel));
+
+  return rec;
+}
+
+static void trace_buffer_commit(pr_trace_buffer_record_t *rec,
+    uint64_t seqno, char *msg, size_t msglen) {
+
+  /* Trim trailing newlines. */
+  while (msglen >= 1 &&
+         msg[msglen-1] == '\n') {
+    msglen--;
+  }
+
+  msg[msglen] = '\0';
+  rec->tbr_msglen = (uint32_t) msglen;
+
+  TRACE_BUFFER_BARRIER();
+  rec->tbr_seqno = seqno + 1;
+}
+
+static int trace_buffer_write(const char *channel, int level,
+    const char *msg, size_t msglen) {
+  pr_trace_buffer_record_t *rec;
+  uint64_t seqno = 0;
+  char *buf;
+
+  rec = trace_buffer_next(channel, level, &seqno);
+  if (rec == NULL) {
+    return 0;
+  }
+
+  buf = ((char *) rec) + sizeof(pr_trace_buffer_record_t);
+  if (msglen >= TRACE_BUFFER_MSGSZ) {
+    msglen = TRACE_BUFFER_MSGSZ - 1;
+    memcpy(buf, msg, msglen - 3);
+    memcpy(buf + msglen - 3, "...", 3);
+
+  } else {
+    memcpy(buf, msg, msglen);
+  }
+
+  trace_buffer_commit(rec, seqno, buf, msglen);
+  return 0;
+}
+
+/* Formats the message directly into the trace buffer record, for when the
+ * trace buffer is the only destination for the message.
+ */
+static int trace_buffer_vwrite(const char *channel, int level,
+    const char *fmt, va_list msg) {
+  pr_trace_buffer_record_t *rec;
+  uint64_t seqno = 0;
+  char *buf;
+  int len;
+  size_t buflen;
+
+  rec = trace_buffer_next(channel, level, &seqno);
+  if (rec == NULL) {
+    return 0;
+  }
+
+  buf = ((char *) rec) + sizeof(pr_trace_buffer_record_t);
+  len = vsnprintf(buf, TRACE_BUFFER_MSGSZ, fmt, msg);
+  if (len < 0) {
+    buflen = 0;
+
+  } else if ((size_t) len >= TRACE_BUFFER_MSGSZ) {
+    buflen = TRACE_BUFFER_MSGSZ - 1;
+    memcpy(buf + buflen - 3, "...", 3);
+
+  } else {
+    buflen = len;
+  }
+
+  trace_buffer_commit(rec, seqno, buf, buflen);
+  return 0;
+}
+
+static int trace_buffer_read(int fd, void *buf, size_t len, off_t offset) {
+  ssize_t res;
+
+  if (lseek(fd, offset, SEEK_SET) == (off_t) -1) {
+    return -1;
+  }
+
+  res = read(fd, buf, len);
+  if (res < 0) {
+    return -1;
+  }
+
+  if ((size_t) res != len) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int trace_buffer_read_header(int fd, pr_trace_buffer_header_t *hdr) {
+  if (trace_buffer_read(fd, hdr, sizeof(pr_trace_buffer_header_t), 0) < 0) {
+    return -1;
+  }
+
+  if (hdr->tbh_magic != PR_TRACE_BUFFER_MAGIC ||
+      hdr->tbh_version != PR_TRACE_BUFFER_VERSION ||
+      hdr->tbh_record_size != PR_TRACE_BUFFER_RECORD_SIZE ||
+      hdr->tbh_nrecords == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+static char *trace_buffer_render(pool *p, pid_t pid,
+    pr_trace_buffer_record_t *rec, const char *msg) {
+  char buf[PR_TRACE_BUFFER_RECORD_SIZE + 128], ts[64];
+  time_t secs;
+  struct tm *tm;
+
+  memset(ts, '\0', sizeof(ts));
+  secs = (time_t) rec->tbr_sec;
+  tm = pr_localtime(p, &secs);
+  if (tm != NULL) {
+    (void) strftime(ts, sizeof(ts)-1, "%Y-%m-%d %H:%M:%S", tm);
+  }
+
+  memset(buf, '\0', sizeof(buf));
+  snprintf(buf, sizeof(buf)-1, "%s,%03lu [%u] <%s:%u>: %s", ts,
+    (unsigned long) (rec->tbr_usec / 1000), (unsigned int) pid,
+    rec->tbr_channel, (unsigned int) rec->tbr_level, msg);
+
+  return pstrdup(p, buf);
+}
+
+static void trace_buffer_exit_ev(const void *event_data, void *user_data) {
+  pid_t pid;
+
+  if (trace_buffer == NULL) {
+    return;
+  }
+
+  pid = session.pid ? session.pid : getpid();
+  if (pid != trace_buffer_pid) {
+    return;
+  }
+
+  switch (session.disconnect_reason) {
+    case PR_SESS_DISCONNECT_SIGNAL:
+    case PR_SESS_DISCONNECT_NOMEM:
+    case PR_SESS_DISCONNECT_SEGFAULT:
+      /* Keep this buffer, for post-mortem examination. */
+      break;
+
+    default:
+      trace_buffer->tbh_flags |= PR_TRACE_BUFFER_FL_CLEAN;
+      break;
+  }
+}
+
 pr_table_t *pr_trace_get_table(void) {
   if (trace_tab == NULL) {
     errno = ENOENT;
@@ -207,7 +508,7 @@ static const struct trace_levels *trace_get_levels(const char *channel) {
   }
 
   if (trace_tab == NULL ||
-      trace_logfd < 0) {
+      (trace_logfd < 0 && trace_buffer_path[0] == '\0')) {
     errno = EPERM;
     return NULL;
   }
@@ -398,6 +699,183 @@ int pr_trace_set_file(const char *path) {
   return 0;
 }
 
+int pr_trace_set_buffer(const char *path, off_t size) {
+  char dir[PR_TUNABLE_PATH_MAX+1], *ptr;
+  struct stat st;
+
+  if (path == NULL) {
+    trace_buffer_unmap();
+    trace_buffer_path[0] = '\0';
+    trace_buffer_size = 0;
+    trace_buffer_pid = 0;
+
+    if (trace_buffer_exit_registered == TRUE) {
+      pr_event_unregister(NULL, "core.exit", trace_buffer_exit_ev);
+      trace_buffer_exit_registered = FALSE;
+    }
+
+    return 0;
+  }
+
+  /* Leave room for the ".<pid>" suffix. */
+  if (*path != '/' ||
+      strlen(path) + 24 > PR_TUNABLE_PATH_MAX ||
+      size < PR_TRACE_BUFFER_MIN_SIZE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  sstrncpy(dir, path, sizeof(dir));
+  ptr = strrchr(dir, '/');
+  if (ptr == dir) {
+    ptr++;
+  }
+  *ptr = '\0';
+
+  if (stat(dir, &st) < 0) {
+    return -1;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    errno = ENOTDIR;
+    return -1;
+  }
+
+  if (st.st_mode & S_IWOTH) {
+    pr_log_debug(DEBUG1,
+      "unable to use TraceBuffer '%s': parent directory is world-writable",
+      path);
+    errno = EPERM;
+    return -1;
+  }
+
+  trace_buffer_unmap();
+  sstrncpy(trace_buffer_path, path, sizeof(trace_buffer_path));
+  trace_buffer_size = (size_t) size;
+  trace_buffer_pid = 0;
+
+  if (trace_buffer_exit_registered == FALSE) {
+    pr_event_register(NULL, "core.exit", trace_buffer_exit_ev, NULL);
+    trace_buffer_exit_registered = TRUE;
+  }
+
+  return 0;
+}
+
+array_header *pr_trace_read_buffer(pool *p, pid_t pid,
+    unsigned int max_records) {
+  char path[PR_TUNABLE_PATH_MAX+1];
+  uint64_t rec_buf[PR_TRACE_BUFFER_RECORD_SIZE / sizeof(uint64_t)];
+  pr_trace_buffer_header_t hdr;
+  array_header *lines;
+  uint64_t seqno, first;
+  int fd, xerrno;
+
+  if (p == NULL ||
+      max_records == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (trace_buffer_path[0] == '\0') {
+    errno = EPERM;
+    return NULL;
+  }
+
+  if (pid == 0) {
+    pid = session.pid ? session.pid : getpid();
+  }
+
+  fd = open(trace_buffer_get_path(path, sizeof(path), pid), O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  if (trace_buffer_read_header(fd, &hdr) < 0) {
+    xerrno = errno;
+    (void) close(fd);
+
+    errno = xerrno;
+    return NULL;
+  }
+
+  first = 0;
+  if (hdr.tbh_next > hdr.tbh_nrecords) {
+    first = hdr.tbh_next - hdr.tbh_nrecords;
+  }
+
+  if (hdr.tbh_next - first > max_records) {
+    first = hdr.tbh_next - max_records;
+  }
+
+  lines = make_array(p, (unsigned int) (hdr.tbh_next - first),
+    sizeof(char *));
+
+  for (seqno = first; seqno < hdr.tbh_next; seqno++) {
+    pr_trace_buffer_record_t *rec;
+    char *msg;
+
+    pr_signals_handle();
+
+    if (trace_buffer_read(fd, rec_buf, sizeof(rec_buf),
+        (off_t) ((1 + (seqno % hdr.tbh_nrecords)) *
+          PR_TRACE_BUFFER_RECORD_SIZE)) < 0) {
+      break;
+    }
+
+    rec = (pr_trace_buffer_record_t *) rec_buf;
+
+    /* Skip any records being written, or overwritten since we read the
+     * header.
+     */
+    if (rec->tbr_seqno != seqno + 1 ||
+        rec->tbr_msglen >= TRACE_BUFFER_MSGSZ) {
+      continue;
+    }
+
+    msg = ((char *) rec_buf) + sizeof(pr_trace_buffer_record_t);
+    msg[rec->tbr_msglen] = '\0';
+    rec->tbr_channel[sizeof(rec->tbr_channel)-1] = '\0';
+
+    *((char **) push_array(lines)) = trace_buffer_render(p,
+      (pid_t) hdr.tbh_pid, rec, msg);
+  }
+
+  (void) close(fd);
+  return lines;
+}
+
+int pr_trace_remove_buffer(pid_t pid) {
+  char path[PR_TUNABLE_PATH_MAX+1];
+  pr_trace_buffer_header_t hdr;
+  int fd, res, xerrno;
+
+  if (trace_buffer_path[0] == '\0') {
+    return 0;
+  }
+
+  fd = open(trace_buffer_get_path(path, sizeof(path), pid), O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  res = trace_buffer_read_header(fd, &hdr);
+  xerrno = errno;
+  (void) close(fd);
+
+  if (res < 0) {
+    errno = xerrno;
+    return -1;
+  }
+
+  if (hdr.tbh_pid == (uint32_t) pid &&
+      (hdr.tbh_flags & PR_TRACE_BUFFER_FL_CLEAN)) {
+    return unlink(path);
+  }
+
+  return 0;
+}
+
 int pr_trace_set_levels(const char *channel, int min_level, int max_level) {
 
   if (channel == NULL) {
@@ -514,6 +992,7 @@ int pr_trace_msg(const char *channel, int level, const char *fmt, ...) {
 
   /* If no one's listening... */
   if (trace_logfd < 0 &&
+      trace_buffer_path[0] == '\0' &&
       pr_log_event_listening(PR_LOG_TYPE_TRACELOG) <= 0) {
     return 0;
   }
@@ -551,7 +1030,8 @@ int pr_trace_vmsg(const char *channel, int level, const char *fmt,
   }
 
   /* If no one's listening... */
-  if (trace_logfd < 0) {
+  if (trace_logfd < 0 &&
+      trace_buffer_path[0] == '\0') {
     return 0;
   }
 
@@ -584,6 +1064,18 @@ int pr_trace_vmsg(const char *channel, int level, const char *fmt,
     }
   }
 
+  if (trace_buffer_path[0] != '\0' &&
+      trace_logfd < 0) {
+    /* The trace buffer is the only destination for this message; format
+     * it directly into the buffer record.
+     */
+    if (discard == TRUE) {
+      return 0;
+    }
+
+    return trace_buffer_vwrite(channel, level, fmt, msg);
+  }
+
   buflen = vsnprintf(buf, sizeof(buf)-1, fmt, msg);
 
   /* Always make sure the buffer is NUL-terminated. */
@@ -607,6 +1099,11 @@ int pr_trace_vmsg(const char *channel, int level, const char *fmt,
     buflen--;
   }
 
+  if (trace_buffer_path[0] != '\0' &&
+      discard == FALSE) {
+    (void) trace_buffer_write(channel, level, buf, buflen);
+  }
+
   return trace_write(channel, level, buf, discard);
 }
 
@@ -642,6 +1139,22 @@ int pr_trace_set_file(const char *path) {
   return -1;
 }
 
+int pr_trace_set_buffer(const char *path, off_t size) {
+  errno = ENOSYS;
+  return -1;
+}
+
+array_header *pr_trace_read_buffer(pool *p, pid_t pid,
+    unsigned int max_records) {
+  errno = ENOSYS;
+  return NULL;
+}
+
+int pr_trace_remove_buffer(pid_t pid) {
+  errno = ENOSYS;
+  return -1;
+}
+
 int pr_trace_set_levels(const char *channel, int min_level, int max_level) {
   errno = ENOSYS;
   return -1;
@@ -332,6 +332,107 @@ START_TEST (ascii_ftp_to_crlf_test) {
 }
 END_TEST
 
+/* Reference (byte-at-a-time) implementation of the to-CRLF conversion,
+ * for checking the results for large/chunked buffers.
+ */
+static size_t ref_to_crlf(const char *src, size_t src_len, char *dst,
+    int *prev_cr) {
+  register unsigned int i;
+  size_t dst_len = 0;
+
+  for (i = 0; i < src_len; i++) {
+    if (src[i] == '\n' &&
+        (i > 0 ? src[i-1] != '\r' : *prev_cr == FALSE)) {
+      dst[dst_len++] = '\r';
+    }
+
+    dst[dst_len++] = src[i];
+  }
+
+  *prev_cr = (src[src_len-1] == '\r');
+  return dst_len;
+}
+
+START_TEST (ascii_ftp_to_crlf_chunks_test) {
+  register unsigned int i;
+  int res, prev_cr = FALSE;
+  char *src, *dst, *expected;
+  size_t src_len, dst_len, expected_len, chunksz, off;
+
+  src_len = 64 * 1024;
+  src = palloc(p, src_len);
+  expected = palloc(p, src_len * 2);
+
+  /* Mostly text, with runs of CRs and LFs. */
+  srandom(17);
+  for (i = 0; i < src_len; i++) {
+    long r = random() % 64;
+
+    if (r == 0) {
+      src[i] = '\r';
+
+    } else if (r < 3) {
+      src[i] = '\n';
+
+    } else {
+      src[i] = 'a' + (r % 26);
+    }
+  }
+
+  /* Use odd chunk sizes, so that CRLF pairs are split across chunks. */
+  chunksz = 1021;
+
+  pr_ascii_ftp_reset();
+  for (off = 0; off < src_len; off += chunksz) {
+    size_t len;
+
+    len = src_len - off < chunksz ? src_len - off : chunksz;
+    expected_len = ref_to_crlf(src + off, len, expected, &prev_cr);
+
+    dst = NULL;
+    dst_len = 0;
+
+    mark_point();
+    res = pr_ascii_ftp_to_crlf(p, src + off, len, &dst, &dst_len);
+    fail_unless(res >= 0, "Failed to convert chunk at offset %lu: %s",
+      (unsigned long) off, strerror(errno));
+    fail_unless((size_t) res == expected_len - len,
+      "Expected %lu added CRs, got %d", (unsigned long) (expected_len - len),
+      res);
+    fail_unless(dst_len == expected_len,
+      "Expected output buffer length %lu, got %lu",
+      (unsigned long) expected_len, (unsigned long) dst_len);
+    fail_unless(memcmp(dst, expected, dst_len) == 0,
+      "Output does not match for chunk at offset %lu", (unsigned long) off);
+  }
+}
+END_TEST
+
+START_TEST (ascii_ftp_from_crlf_inplace_test) {
+  int res;
+  char *buf, *expected;
+  size_t buf_len, outlen, expected_len;
+
+  /* The download path converts the buffer in place. */
+  pr_ascii_ftp_reset();
+  buf = pstrdup(p, "a\r\nb\r\r\nc\rd\r\n\r\n\r");
+  buf_len = strlen(buf);
+  outlen = 0;
+
+  res = pr_ascii_ftp_from_crlf(p, buf, buf_len, &buf, &outlen);
+  fail_unless(res == 1, "Expected 1 carry-over CR, got %d", res);
+
+  expected = "a\nb\r\nc\rd\n\n";
+  expected_len = strlen(expected);
+  fail_unless(outlen == expected_len,
+    "Expected output buffer length %lu, got %lu", (unsigned long) expected_len,
+    (unsigned long) outlen);
+  fail_unless(strncmp(buf, expected, outlen) == 0,
+    "Expected output buffer '%s', got '%.*s'", expected, (int) outlen, buf);
+  fail_unless(buf[outlen] == '\r', "Expected carried-over CR");
+}
+END_TEST
+
 Suite *tests_get_ascii_suite(void) {
   Suite *suite;
   TCase *testcase;
@@ -344,6 +445,8 @@ Suite *tests_get_ascii_suite(void) {
 
   tcase_add_test(testcase, ascii_ftp_from_crlf_test);
   tcase_add_test(testcase, ascii_ftp_to_crlf_test);
+  tcase_add_test(testcase, ascii_ftp_to_crlf_chunks_test);
+  tcase_add_test(testcase, ascii_ftp_from_crlf_inplace_test);
 
   suite_add_tcase(suite, testcase);
 
@@ -309,6 +309,36 @@ START_TEST (cmd_get_id_test) {
 }
 END_TEST
 
+START_TEST (cmd_get_name_test) {
+  const char *res;
+  int cmd_id;
+
+  res = pr_cmd_get_name(0);
+  fail_unless(res == NULL, "Failed to handle sentinel ID");
+  fail_unless(errno == ENOENT, "Failed to set errno to ENOENT");
+
+  res = pr_cmd_get_name(PR_CMD_MAX_ID + 1);
+  fail_unless(res == NULL, "Failed to handle unknown ID");
+  fail_unless(errno == ENOENT, "Failed to set errno to ENOENT");
+
+  res = pr_cmd_get_name(PR_CMD_USER_ID);
+  fail_unless(res != NULL, "Failed to get name for ID %d", PR_CMD_USER_ID);
+  fail_unless(strcmp(res, C_USER) == 0, "Expected '%s', got '%s'", C_USER,
+    res);
+
+  res = pr_cmd_get_name(PR_CMD_MAX_ID);
+  fail_unless(res != NULL, "Failed to get name for ID %d", PR_CMD_MAX_ID);
+  fail_unless(strcmp(res, C_RANG) == 0, "Expected '%s', got '%s'", C_RANG,
+    res);
+
+  for (cmd_id = 1; cmd_id <= PR_CMD_MAX_ID; cmd_id++) {
+    res = pr_cmd_get_name(cmd_id);
+    fail_unless(pr_cmd_get_id(res) == cmd_id,
+      "Expected ID %d for '%s', got %d", cmd_id, res, pr_cmd_get_id(res));
+  }
+}
+END_TEST
+
 START_TEST (cmd_cmp_test) {
   cmd_rec *cmd;
   int res;
@@ -635,6 +665,7 @@ Suite *tests_get_cmd_suite(void) {
 
   tcase_add_test(testcase, cmd_alloc_test);
   tcase_add_test(testcase, cmd_get_id_test);
+  tcase_add_test(testcase, cmd_get_name_test);
   tcase_add_test(testcase, cmd_cmp_test);
   tcase_add_test(testcase, cmd_strcmp_test);
   tcase_add_test(testcase, cmd_get_displayable_str_test);
@@ -0,0 +1,224 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* CRC32 API tests. */
+
+#include "tests.h"
+
+static pool *p = NULL;
+static int default_engine = 0;
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  default_engine = pr_crc32_get_engine();
+}
+
+static void tear_down(void) {
+  (void) pr_crc32_set_engine(default_engine);
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+/* A bit-at-a-time reference implementation. */
+static uint32_t crc32_ref(uint32_t crc, const unsigned char *data,
+    size_t datasz) {
+  register size_t i;
+
+  crc = ~crc;
+  for (i = 0; i < datasz; i++) {
+    register unsigned int j;
+
+    crc ^= data[i];
+    for (j = 0; j < 8; j++) {
+      crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+  }
+
+  return ~crc;
+}
+
+static unsigned char *crc32_test_data(size_t datasz) {
+  register size_t i;
+  unsigned char *data;
+  uint32_t x = 1;
+
+  data = palloc(p, datasz);
+  for (i = 0; i < datasz; i++) {
+    x = (x * 1103515245) + 12345;
+    data[i] = (unsigned char) (x >> 16);
+  }
+
+  return data;
+}
+
+/* Checks the CRC of every length up to datasz, at every alignment, against
+ * the reference implementation.
+ */
+static void crc32_check_lengths(const unsigned char *data, size_t datasz) {
+  register size_t i, j;
+
+  for (i = 0; i < 8; i++) {
+    for (j = 0; j + i <= datasz; j++) {
+      uint32_t expected, res;
+
+      expected = crc32_ref(0, data + i, j);
+      res = pr_crc32(0, data + i, j);
+      fail_unless(res == expected,
+        "Expected CRC 0x%08x for %lu bytes at offset %lu, got 0x%08x",
+        expected, (unsigned long) j, (unsigned long) i, res);
+    }
+  }
+}
+
+START_TEST (crc32_test) {
+  uint32_t res;
+  const char *text = "123456789";
+
+  res = pr_crc32(0, NULL, 0);
+  fail_unless(res == 0, "Expected 0, got 0x%08x", res);
+
+  res = pr_crc32(0x1234, NULL, 10);
+  fail_unless(res == 0x1234, "Expected 0x1234, got 0x%08x", res);
+
+  res = pr_crc32(0, text, 0);
+  fail_unless(res == 0, "Expected 0, got 0x%08x", res);
+
+  /* The standard check value. */
+  res = pr_crc32(0, text, strlen(text));
+  fail_unless(res == 0xcbf43926, "Expected 0xcbf43926, got 0x%08x", res);
+
+  res = pr_crc32(0, "a", 1);
+  fail_unless(res == 0xe8b7be43, "Expected 0xe8b7be43, got 0x%08x", res);
+}
+END_TEST
+
+START_TEST (crc32_incremental_test) {
+  register size_t i;
+  unsigned char *data;
+  size_t datasz = 4096 + 7;
+  uint32_t expected, res;
+
+  data = crc32_test_data(datasz);
+  expected = crc32_ref(0, data, datasz);
+
+  /* Feed the data in uneven chunks, as a transfer would. */
+  res = 0;
+  for (i = 0; i < datasz;) {
+    size_t len;
+
+    len = (i % 97) + 1;
+    if (i + len > datasz) {
+      len = datasz - i;
+    }
+
+    res = pr_crc32(res, data + i, len);
+    i += len;
+  }
+
+  fail_unless(res == expected, "Expected CRC 0x%08x, got 0x%08x", expected,
+    res);
+}
+END_TEST
+
+START_TEST (crc32_slice8_test) {
+  int res;
+  unsigned char *data;
+  size_t datasz = 1024;
+
+  res = pr_crc32_set_engine(PR_CRC32_ENGINE_SLICE8);
+  fail_unless(res == 0, "Failed to set slice-by-8 engine: %s",
+    strerror(errno));
+  fail_unless(pr_crc32_get_engine() == PR_CRC32_ENGINE_SLICE8,
+    "Expected slice-by-8 engine, got %d", pr_crc32_get_engine());
+
+  data = crc32_test_data(datasz);
+  crc32_check_lengths(data, datasz);
+}
+END_TEST
+
+START_TEST (crc32_pclmul_test) {
+  int res;
+  unsigned char *data;
+  size_t datasz = 1024;
+
+  res = pr_crc32_set_engine(PR_CRC32_ENGINE_PCLMUL);
+  if (res < 0) {
+    fail_unless(errno == ENOSYS, "Expected ENOSYS (%d), got %s (%d)", ENOSYS,
+      strerror(errno), errno);
+
+    /* Not supported by this build, or by this CPU. */
+    return;
+  }
+
+  fail_unless(pr_crc32_get_engine() == PR_CRC32_ENGINE_PCLMUL,
+    "Expected PCLMUL engine, got %d", pr_crc32_get_engine());
+
+  data = crc32_test_data(datasz);
+  crc32_check_lengths(data, datasz);
+}
+END_TEST
+
+START_TEST (crc32_set_engine_test) {
+  int res;
+
+  res = pr_crc32_set_engine(0);
+  fail_unless(res < 0, "Failed to handle unknown engine");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_crc32_set_engine(-1);
+  fail_unless(res < 0, "Failed to handle unknown engine");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_crc32_get_engine();
+  fail_unless(res == default_engine, "Expected engine %d, got %d",
+    default_engine, res);
+}
+END_TEST
+
+Suite *tests_get_crc32_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("crc32");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, crc32_test);
+  tcase_add_test(testcase, crc32_incremental_test);
+  tcase_add_test(testcase, crc32_slice8_test);
+  tcase_add_test(testcase, crc32_pclmul_test);
+  tcase_add_test(testcase, crc32_set_engine_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -199,6 +199,10 @@ static int data_read_cb(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
 static int data_write_eagain = FALSE;
 static int data_write_epipe = FALSE;
 
+/* The most recently written data, for checking any ASCII translation. */
+static char data_written[1024];
+static size_t data_writtenlen = 0;
+
 static int data_write_cb(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
   if (data_write_eagain) {
     data_write_eagain = FALSE;
@@ -212,6 +216,10 @@ static int data_write_cb(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
     return -1;
   }
 
+  data_writtenlen = buflen < sizeof(data_written) ? buflen :
+    sizeof(data_written);
+  memcpy(data_written, buf, data_writtenlen);
+
   return buflen;
 }
 
@@ -1005,8 +1013,12 @@ START_TEST (data_xfer_write_ascii_test) {
   fail_unless(session.xfer.buflen == ascii_buflen,
     "Expected session.xfer.buflen %lu, got %lu", (unsigned long) ascii_buflen,
     (unsigned long) session.xfer.buflen);
-  fail_unless(strncmp(session.xfer.buf, ascii_buf, ascii_buflen) == 0,
-    "Expected '%s', got '%.100s'", ascii_buf, session.xfer.buf);
+  fail_unless(data_writtenlen == ascii_buflen,
+    "Expected %lu bytes written, got %lu", (unsigned long) ascii_buflen,
+    (unsigned long) data_writtenlen);
+  fail_unless(strncmp(data_written, ascii_buf, ascii_buflen) == 0,
+    "Expected '%s', got '%.*s'", ascii_buf, (int) data_writtenlen,
+    data_written);
 
   mark_point();
   cmd = pr_cmd_alloc(p, 1, pstrdup(p, "noop"));
@@ -1024,8 +1036,12 @@ START_TEST (data_xfer_write_ascii_test) {
   fail_unless(session.xfer.buflen == ascii_buflen,
     "Expected session.xfer.buflen %lu, got %lu", (unsigned long) ascii_buflen,
     (unsigned long) session.xfer.buflen);
-  fail_unless(strncmp(session.xfer.buf, ascii_buf, ascii_buflen) == 0,
-    "Expected '%s', got '%.100s'", ascii_buf, session.xfer.buf);
+  fail_unless(data_writtenlen == ascii_buflen,
+    "Expected %lu bytes written, got %lu", (unsigned long) ascii_buflen,
+    (unsigned long) data_writtenlen);
+  fail_unless(strncmp(data_written, ascii_buf, ascii_buflen) == 0,
+    "Expected '%s', got '%.*s'", ascii_buf, (int) data_writtenlen,
+    data_written);
 
   session.xfer.p = make_sub_pool(p);
   mark_point();
@@ -1044,8 +1060,12 @@ START_TEST (data_xfer_write_ascii_test) {
   fail_unless(session.xfer.buflen == ascii_buflen,
     "Expected session.xfer.buflen %lu, got %lu", (unsigned long) ascii_buflen,
     (unsigned long) session.xfer.buflen);
-  fail_unless(strncmp(session.xfer.buf, ascii_buf, ascii_buflen) == 0,
-    "Expected '%s', got '%.100s'", ascii_buf, session.xfer.buf);
+  fail_unless(data_writtenlen == ascii_buflen,
+    "Expected %lu bytes written, got %lu", (unsigned long) ascii_buflen,
+    (unsigned long) data_writtenlen);
+  fail_unless(strncmp(data_written, ascii_buf, ascii_buflen) == 0,
+    "Expected '%s', got '%.*s'", ascii_buf, (int) data_writtenlen,
+    data_written);
 
   mark_point();
   pr_ascii_ftp_reset();
@@ -1061,8 +1081,12 @@ START_TEST (data_xfer_write_ascii_test) {
   fail_unless(session.xfer.buflen == ascii_buflen,
     "Expected session.xfer.buflen %lu, got %lu", (unsigned long) ascii_buflen,
     (unsigned long) session.xfer.buflen);
-  fail_unless(strncmp(session.xfer.buf, ascii_buf, ascii_buflen) == 0,
-    "Expected '%s', got '%.100s'", ascii_buf, session.xfer.buf);
+  fail_unless(data_writtenlen == ascii_buflen,
+    "Expected %lu bytes written, got %lu", (unsigned long) ascii_buflen,
+    (unsigned long) data_writtenlen);
+  fail_unless(strncmp(data_written, ascii_buf, ascii_buflen) == 0,
+    "Expected '%s', got '%.*s'", ascii_buf, (int) data_writtenlen,
+    data_written);
 }
 END_TEST
 
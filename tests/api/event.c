@@ -235,6 +235,137 @@ START_TEST (event_generate_test) {
 }
 END_TEST
 
+START_TEST (event_get_id_test) {
+  int event_id, event_id2, res;
+  const char *event = "foo", *event2 = "bar";
+
+  res = pr_event_get_id(NULL);
+  fail_unless(res < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  event_id = pr_event_get_id(event);
+  fail_unless(event_id >= 0, "Failed to get ID for event '%s': %s", event,
+    strerror(errno));
+
+  res = pr_event_get_id(event);
+  fail_unless(res == event_id, "Expected ID %d for event '%s', got %d",
+    event_id, event, res);
+
+  event_id2 = pr_event_get_id(event2);
+  fail_unless(event_id2 >= 0, "Failed to get ID for event '%s': %s", event2,
+    strerror(errno));
+  fail_unless(event_id2 != event_id, "Expected different IDs for '%s' and "
+    "'%s', got %d", event, event2, event_id2);
+
+  /* Registering a listener for the event must not change its ID. */
+  res = pr_event_register(NULL, event, event_cb2, NULL);
+  fail_unless(res == 0, "Failed to register event '%s: %s", event,
+    strerror(errno));
+
+  res = pr_event_get_id(event);
+  fail_unless(res == event_id, "Expected ID %d for event '%s', got %d",
+    event_id, event, res);
+
+  res = pr_event_unregister(NULL, event, NULL);
+  fail_unless(res == 0, "Failed to unregister event '%s': %s", event,
+    strerror(errno));
+
+  res = pr_event_get_id(event);
+  fail_unless(res == event_id, "Expected ID %d for event '%s', got %d",
+    event_id, event, res);
+}
+END_TEST
+
+START_TEST (event_listening_id_test) {
+  int event_id, res;
+  const char *event = "foo";
+
+  res = pr_event_listening_id(-1);
+  fail_unless(res < 0, "Failed to handle invalid event ID");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_event_listening_id(1024);
+  fail_unless(res < 0, "Failed to handle unknown event ID");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  event_id = pr_event_get_id(event);
+  fail_unless(event_id >= 0, "Failed to get ID for event '%s': %s", event,
+    strerror(errno));
+
+  res = pr_event_listening_id(event_id);
+  fail_unless(res == 0, "Expected 0 listeners, got %d", res);
+
+  res = pr_event_register(NULL, event, event_cb2, NULL);
+  fail_unless(res == 0, "Failed to register event '%s: %s", event,
+    strerror(errno));
+
+  res = pr_event_listening_id(event_id);
+  fail_unless(res == 1, "Expected 1 listener, got %d", res);
+
+  res = pr_event_register(NULL, event, event_cb3, NULL);
+  fail_unless(res == 0, "Failed to register event '%s: %s", event,
+    strerror(errno));
+
+  res = pr_event_listening_id(event_id);
+  fail_unless(res == 2, "Expected 2 listeners, got %d", res);
+
+  res = pr_event_unregister(NULL, event, event_cb2);
+  fail_unless(res == 0, "Failed to unregister event '%s': %s", event,
+    strerror(errno));
+
+  res = pr_event_listening_id(event_id);
+  fail_unless(res == 1, "Expected 1 listener, got %d", res);
+
+  res = pr_event_unregister(NULL, NULL, NULL);
+  fail_unless(res == 0, "Failed to unregister events: %s", strerror(errno));
+
+  res = pr_event_listening_id(event_id);
+  fail_unless(res == 0, "Expected 0 listeners, got %d", res);
+}
+END_TEST
+
+START_TEST (event_generate_id_test) {
+  int event_id, res;
+  const char *event = "foo";
+
+  event_triggered = 0;
+
+  pr_event_generate_id(-1, NULL);
+  fail_unless(event_triggered == 0, "Expected triggered count %u, got %u",
+    0, event_triggered);
+
+  event_id = pr_event_get_id(event);
+  fail_unless(event_id >= 0, "Failed to get ID for event '%s': %s", event,
+    strerror(errno));
+
+  pr_event_generate_id(event_id, NULL);
+  fail_unless(event_triggered == 0, "Expected triggered count %u, got %u",
+    0, event_triggered);
+
+  res = pr_event_register(NULL, event, event_cb, NULL);
+  fail_unless(res == 0, "Failed to register event: %s", strerror(errno));
+
+  pr_event_generate_id(event_id, NULL);
+  fail_unless(event_triggered == 1, "Expected triggered count %u, got %u",
+    1, event_triggered);
+
+  /* Events generated by name and by ID go to the same listeners. */
+  pr_event_generate(event, NULL);
+  fail_unless(event_triggered == 2, "Expected triggered count %u, got %u",
+    2, event_triggered);
+
+  res = pr_event_unregister(NULL, NULL, NULL);
+  fail_unless(res == 0, "Failed to unregister events: %s", strerror(errno));
+
+  pr_event_generate_id(event_id, NULL);
+  fail_unless(event_triggered == 2, "Expected triggered count %u, got %u",
+    2, event_triggered);
+}
+END_TEST
+
 START_TEST (event_dump_test) {
   int res;
   const char *event = "foo";
@@ -287,6 +418,9 @@ Suite *tests_get_event_suite(void) {
   tcase_add_test(testcase, event_unregister_test);
   tcase_add_test(testcase, event_listening_test);
   tcase_add_test(testcase, event_generate_test);
+  tcase_add_test(testcase, event_get_id_test);
+  tcase_add_test(testcase, event_listening_id_test);
+  tcase_add_test(testcase, event_generate_id_test);
   tcase_add_test(testcase, event_dump_test);
 
   suite_add_tcase(suite, testcase);
@@ -3199,6 +3199,63 @@ START_TEST (fsio_statcache_expired_test) {
 }
 END_TEST
 
+START_TEST (fsio_statcache_lru_test) {
+  int fd, res;
+  struct stat st;
+
+  pr_fs_statcache_reset();
+  pr_fs_statcache_set_policy(2, PR_TUNABLE_FS_STATCACHE_MAX_AGE, 0);
+
+  fd = open(fsio_test_path, O_CREAT|O_EXCL|O_WRONLY, 0600);
+  fail_unless(fd >= 0, "Failed to create '%s': %s", fsio_test_path,
+    strerror(errno));
+  (void) close(fd);
+
+  res = pr_fsio_stat(fsio_test_path, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", fsio_test_path,
+    strerror(errno));
+
+  res = pr_fsio_stat("/tmp", &st);
+  fail_unless(res == 0, "Failed to stat '/tmp': %s", strerror(errno));
+
+  /* Using the test path entry again makes '/tmp' the least recently used
+   * entry, and thus the one evicted to make room for '/'.
+   */
+  res = pr_fsio_stat(fsio_test_path, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", fsio_test_path,
+    strerror(errno));
+
+  res = pr_fsio_stat("/", &st);
+  fail_unless(res == 0, "Failed to stat '/': %s", strerror(errno));
+
+  (void) unlink(fsio_test_path);
+
+  res = pr_fsio_stat(fsio_test_path, &st);
+  fail_unless(res == 0, "Expected cached stat for '%s', got error: %s",
+    fsio_test_path, strerror(errno));
+
+  res = pr_fs_clear_cache2("/tmp");
+  fail_unless(res == 0, "Expected evicted '/tmp' entry, cleared %d", res);
+
+  /* Evicting the test path entry as well means that the next lookup sees
+   * that the file is gone.
+   */
+  res = pr_fsio_stat("/tmp", &st);
+  fail_unless(res == 0, "Failed to stat '/tmp': %s", strerror(errno));
+
+  res = pr_fsio_stat("/", &st);
+  fail_unless(res == 0, "Failed to stat '/': %s", strerror(errno));
+
+  res = pr_fsio_stat(fsio_test_path, &st);
+  fail_unless(res < 0, "Check of '%s' succeeded unexpectedly", fsio_test_path);
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  pr_fs_statcache_dump();
+  pr_fs_clear_cache();
+}
+END_TEST
+
 START_TEST (fsio_statcache_dump_test) {
   mark_point();
   pr_fs_statcache_dump();
@@ -3904,6 +3961,127 @@ START_TEST (fs_copy_file2_test) {
 }
 END_TEST
 
+static off_t copy_progress_nbytes = 0;
+static void copy_progress_bytes_cb(int nwritten) {
+  copy_progress_nbytes += nwritten;
+}
+
+static int copy_file_compare(const char *src_path, const char *dst_path) {
+  FILE *src_fp, *dst_fp;
+  int res = 0;
+
+  src_fp = fopen(src_path, "r");
+  dst_fp = fopen(dst_path, "r");
+  if (src_fp == NULL ||
+      dst_fp == NULL) {
+    res = -1;
+
+  } else {
+    while (TRUE) {
+      int src_c, dst_c;
+
+      src_c = fgetc(src_fp);
+      dst_c = fgetc(dst_fp);
+      if (src_c != dst_c) {
+        res = -1;
+        break;
+      }
+
+      if (src_c == EOF) {
+        break;
+      }
+    }
+  }
+
+  if (src_fp != NULL) {
+    fclose(src_fp);
+  }
+
+  if (dst_fp != NULL) {
+    fclose(dst_fp);
+  }
+
+  return res;
+}
+
+START_TEST (fs_copy_file2_offload_test) {
+  register unsigned int i;
+  int res;
+  char *src_path, *dst_path, *buf;
+  size_t bufsz;
+  off_t filesz = 0;
+  pr_fh_t *fh;
+
+  src_path = (char *) fsio_copy_src_path;
+  dst_path = (char *) fsio_copy_dst_path;
+
+  (void) unlink(src_path);
+  (void) unlink(dst_path);
+
+  fh = pr_fsio_open(src_path, O_CREAT|O_EXCL|O_WRONLY);
+  fail_unless(fh != NULL, "Failed to open '%s': %s", src_path, strerror(errno));
+
+  bufsz = 65537;
+  buf = palloc(p, bufsz);
+
+  for (i = 0; i < 32; i++) {
+    register unsigned int j;
+
+    for (j = 0; j < bufsz; j++) {
+      buf[j] = (char) (i + j);
+    }
+
+    res = pr_fsio_write(fh, buf, bufsz);
+    fail_unless(res == (int) bufsz, "Failed to write to '%s': %s", src_path,
+      strerror(errno));
+    filesz += res;
+  }
+
+  res = pr_fsio_close(fh);
+  fail_unless(res == 0, "Failed to close '%s': %s", src_path, strerror(errno));
+
+  /* Copy using whatever the kernel supports, and using read/write. */
+  for (i = 0; i < 2; i++) {
+    int flags;
+
+    flags = (i == 0 ? 0 : PR_FSIO_COPY_FILE_FL_NO_OFFLOAD);
+    copy_progress_nbytes = 0;
+
+    mark_point();
+    res = pr_fs_copy_file2(src_path, dst_path, flags, copy_progress_bytes_cb);
+    fail_unless(res == 0, "Failed to copy file (flags %d): %s", flags,
+      strerror(errno));
+
+    fail_unless(copy_progress_nbytes == filesz,
+      "Expected %" PR_LU " bytes of progress, got %" PR_LU, (pr_off_t) filesz,
+      (pr_off_t) copy_progress_nbytes);
+
+    res = copy_file_compare(src_path, dst_path);
+    fail_unless(res == 0, "Copied file '%s' differs from '%s' (flags %d)",
+      dst_path, src_path, flags);
+  }
+
+  /* Copying onto a longer, existing file truncates it. */
+  fh = pr_fsio_open(dst_path, O_WRONLY|O_APPEND);
+  fail_unless(fh != NULL, "Failed to open '%s': %s", dst_path, strerror(errno));
+  res = pr_fsio_write(fh, buf, bufsz);
+  fail_unless(res == (int) bufsz, "Failed to write to '%s': %s", dst_path,
+    strerror(errno));
+  (void) pr_fsio_close(fh);
+
+  mark_point();
+  res = pr_fs_copy_file2(src_path, dst_path, 0, NULL);
+  fail_unless(res == 0, "Failed to copy file: %s", strerror(errno));
+
+  res = copy_file_compare(src_path, dst_path);
+  fail_unless(res == 0, "Copied file '%s' differs from '%s'", dst_path,
+    src_path);
+
+  (void) pr_fsio_unlink(src_path);
+  (void) pr_fsio_unlink(dst_path);
+}
+END_TEST
+
 START_TEST (fs_interpolate_test) {
   int res;
   char buf[PR_TUNABLE_PATH_MAX], *path;
@@ -5117,6 +5295,7 @@ Suite *tests_get_fsio_suite(void) {
   tcase_add_test(testcase, fsio_statcache_cache_hit_test);
   tcase_add_test(testcase, fsio_statcache_negative_cache_test);
   tcase_add_test(testcase, fsio_statcache_expired_test);
+  tcase_add_test(testcase, fsio_statcache_lru_test);
   tcase_add_test(testcase, fsio_statcache_dump_test);
 
   /* Custom FSIO management tests */
@@ -5144,6 +5323,7 @@ Suite *tests_get_fsio_suite(void) {
   tcase_add_test(testcase, fs_glob_test);
   tcase_add_test(testcase, fs_copy_file_test);
   tcase_add_test(testcase, fs_copy_file2_test);
+  tcase_add_test(testcase, fs_copy_file2_offload_test);
   tcase_add_test(testcase, fs_interpolate_test);
   tcase_add_test(testcase, fs_resolve_partial_test);
   tcase_add_test(testcase, fs_resolve_path_test);
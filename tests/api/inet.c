@@ -132,6 +132,36 @@ START_TEST (inet_create_conn_portrange_test) {
 }
 END_TEST
 
+START_TEST (inet_set_reuse_port_test) {
+  int res;
+  conn_t *conn, *conn2;
+
+#ifdef SO_REUSEPORT
+  res = pr_inet_set_reuse_port(TRUE);
+  fail_unless(res == FALSE, "Expected previous setting FALSE, got %d", res);
+
+  conn = pr_inet_create_conn(p, -1, NULL, INPORT_ANY, FALSE);
+  fail_unless(conn != NULL, "Failed to create conn: %s", strerror(errno));
+
+  /* With SO_REUSEPORT, another conn can use the same port. */
+  conn2 = pr_inet_create_conn(p, -1, NULL, conn->local_port, FALSE);
+  fail_unless(conn2 != NULL, "Failed to create conn with same port: %s",
+    strerror(errno));
+
+  pr_inet_close(p, conn2);
+  pr_inet_close(p, conn);
+
+  res = pr_inet_set_reuse_port(FALSE);
+  fail_unless(res == TRUE, "Expected previous setting TRUE, got %d", res);
+#else
+  res = pr_inet_set_reuse_port(TRUE);
+  fail_unless(res < 0, "Failed to handle unsupported SO_REUSEPORT");
+  fail_unless(errno == ENOSYS, "Expected ENOSYS (%d), got %s (%d)", ENOSYS,
+    strerror(errno), errno);
+#endif /* SO_REUSEPORT */
+}
+END_TEST
+
 START_TEST (inet_copy_conn_test) {
   int fd = -1, sockfd = -1, port = INPORT_ANY;
   conn_t *conn, *conn2;
@@ -799,6 +829,7 @@ Suite *tests_get_inet_suite(void) {
   tcase_add_test(testcase, inet_family_test);
   tcase_add_test(testcase, inet_create_conn_test);
   tcase_add_test(testcase, inet_create_conn_portrange_test);
+  tcase_add_test(testcase, inet_set_reuse_port_test);
   tcase_add_test(testcase, inet_copy_conn_test);
   tcase_add_test(testcase, inet_set_async_test);
   tcase_add_test(testcase, inet_set_block_test);
@@ -1421,6 +1421,151 @@ START_TEST (jot_resolve_logfmts_test) {
 }
 END_TEST
 
+START_TEST (jot_compile_logfmt_test) {
+  pr_jot_logfmt_t *compiled;
+  unsigned char *logfmt;
+
+  mark_point();
+  compiled = pr_jot_compile_logfmt(NULL, NULL);
+  fail_unless(compiled == NULL, "Failed to handle null pool");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  compiled = pr_jot_compile_logfmt(p, NULL);
+  fail_unless(compiled == NULL, "Failed to handle null logfmt");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  logfmt = (unsigned char *) "";
+
+  mark_point();
+  compiled = pr_jot_compile_logfmt(p, logfmt);
+  fail_unless(compiled != NULL, "Failed to compile empty logfmt: %s",
+    strerror(errno));
+}
+END_TEST
+
+START_TEST (jot_resolve_compiled_logfmt_test) {
+  int res;
+  cmd_rec *cmd;
+  pr_jot_logfmt_t *compiled;
+  unsigned char logfmt[14];
+
+  mark_point();
+  res = pr_jot_resolve_compiled_logfmt(NULL, NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null pool");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  cmd = pr_cmd_alloc(p, 1, pstrdup(p, "FOO"));
+  cmd->cmd_class = CL_MISC;
+
+  mark_point();
+  res = pr_jot_resolve_compiled_logfmt(p, cmd, NULL, NULL, NULL, NULL, NULL,
+    NULL);
+  fail_unless(res < 0, "Failed to handle null compiled logfmt");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  logfmt[0] = 'A';
+  logfmt[1] = LOGFMT_META_START;
+  logfmt[2] = LOGFMT_META_CUSTOM;
+  logfmt[3] = LOGFMT_META_START;
+  logfmt[4] = LOGFMT_META_ARG;
+  logfmt[5] = '%';
+  logfmt[6] = '{';
+  logfmt[7] = '0';
+  logfmt[8] = '}';
+  logfmt[9] = LOGFMT_META_ARG_END;
+  logfmt[10] = '!';
+  logfmt[11] = LOGFMT_META_START;
+  logfmt[12] = LOGFMT_META_USER;
+  logfmt[13] = 0;
+
+  compiled = pr_jot_compile_logfmt(p, logfmt);
+  fail_unless(compiled != NULL, "Failed to compile logfmt: %s",
+    strerror(errno));
+
+  mark_point();
+  res = pr_jot_resolve_compiled_logfmt(p, cmd, NULL, compiled, NULL, NULL,
+    NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null on_meta");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  resolve_on_meta_count = resolve_on_default_count = resolve_on_other_count = 0;
+
+  mark_point();
+  res = pr_jot_resolve_compiled_logfmt(p, cmd, NULL, compiled, NULL,
+    resolve_on_meta, resolve_on_default, resolve_on_other);
+  fail_unless(res == 0, "Failed to handle compiled logfmt: %s",
+    strerror(errno));
+  fail_unless(resolve_on_meta_count == 1,
+    "Expected on_meta count 1, got %u", resolve_on_meta_count);
+  fail_unless(resolve_on_default_count == 1,
+    "Expected on_default count 1, got %u", resolve_on_default_count);
+  fail_unless(resolve_on_other_count == 2,
+    "Expected on_other count 2, got %u", resolve_on_other_count);
+
+  /* The compiled LogFormat can be resolved multiple times. */
+  resolve_on_meta_count = resolve_on_default_count = resolve_on_other_count = 0;
+
+  mark_point();
+  res = pr_jot_resolve_compiled_logfmt(p, cmd, NULL, compiled, NULL,
+    resolve_on_meta, resolve_on_default, resolve_on_other);
+  fail_unless(res == 0, "Failed to handle compiled logfmt: %s",
+    strerror(errno));
+  fail_unless(resolve_on_meta_count == 1,
+    "Expected on_meta count 1, got %u", resolve_on_meta_count);
+  fail_unless(resolve_on_other_count == 2,
+    "Expected on_other count 2, got %u", resolve_on_other_count);
+}
+END_TEST
+
+START_TEST (jot_resolve_logfmt_memoized_test) {
+  int res;
+  cmd_rec *cmd;
+  unsigned char logfmt[3];
+  const char *note;
+
+  cmd = pr_cmd_alloc(p, 2, pstrdup(p, "DELE"), pstrdup(p, "/tmp/foo.txt"));
+  cmd->arg = pstrdup(p, "/tmp/foo.txt");
+  cmd->cmd_class = CL_WRITE;
+  cmd->cmd_id = pr_cmd_get_id("DELE");
+
+  logfmt[0] = LOGFMT_META_START;
+  logfmt[1] = LOGFMT_META_BASENAME;
+  logfmt[2] = 0;
+
+  /* Values are not memoized outside of the LOG_CMD/LOG_CMD_ERR phases. */
+  session.curr_phase = CMD;
+
+  mark_point();
+  res = pr_jot_resolve_logfmt(p, cmd, NULL, logfmt, NULL, resolve_on_meta,
+    NULL, NULL);
+  fail_unless(res == 0, "Failed to handle logfmt: %s", strerror(errno));
+
+  note = pr_table_get(cmd->notes, "jot.basename", NULL);
+  fail_unless(note == NULL, "Expected null note, got '%s'", note);
+
+  session.curr_phase = LOG_CMD;
+
+  mark_point();
+  res = pr_jot_resolve_logfmt(p, cmd, NULL, logfmt, NULL, resolve_on_meta,
+    NULL, NULL);
+  fail_unless(res == 0, "Failed to handle logfmt: %s", strerror(errno));
+
+  note = pr_table_get(cmd->notes, "jot.basename", NULL);
+  fail_unless(note != NULL, "Expected basename note, got null");
+  fail_unless(strcmp(note, "foo.txt") == 0,
+    "Expected 'foo.txt', got '%s'", note);
+
+  session.curr_phase = 0;
+}
+END_TEST
+
 static unsigned int scan_on_meta_count = 0;
 
 static int scan_on_meta(pool *jot_pool, pr_jot_ctx_t *jot_ctx,
@@ -1648,6 +1793,10 @@ Suite *tests_get_jot_suite(void) {
   tcase_add_test(testcase, jot_resolve_logfmt_disconnect_test);
   tcase_add_test(testcase, jot_resolve_logfmt_custom_test);
   tcase_add_test(testcase, jot_resolve_logfmts_test);
+  tcase_add_test(testcase, jot_resolve_logfmt_memoized_test);
+
+  tcase_add_test(testcase, jot_compile_logfmt_test);
+  tcase_add_test(testcase, jot_resolve_compiled_logfmt_test);
 
   tcase_add_test(testcase, jot_scan_logfmt_test);
   tcase_add_test(testcase, jot_on_json_test);
@@ -0,0 +1,451 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Listing cache API tests. */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+static const char *cache_dir = "/tmp/prt-listcache.d";
+static const char *list_dir = "/tmp/prt-listcache-list.d";
+static const char *list_path = "/tmp/prt-listcache-list.d/foo.txt";
+
+/* Removes the cache directory, and the per-directory subdirectories
+ * within it.
+ */
+static void remove_cache_dir(void) {
+  DIR *dirh;
+  struct dirent *dent;
+
+  dirh = opendir(cache_dir);
+  if (dirh == NULL) {
+    return;
+  }
+
+  while ((dent = readdir(dirh)) != NULL) {
+    char *subdir;
+    DIR *subdirh;
+    struct dirent *subdent;
+
+    if (strcmp(dent->d_name, ".") == 0 ||
+        strcmp(dent->d_name, "..") == 0) {
+      continue;
+    }
+
+    subdir = pdircat(p, cache_dir, dent->d_name, NULL);
+    subdirh = opendir(subdir);
+    if (subdirh == NULL) {
+      (void) unlink(subdir);
+      continue;
+    }
+
+    while ((subdent = readdir(subdirh)) != NULL) {
+      if (strcmp(subdent->d_name, ".") == 0 ||
+          strcmp(subdent->d_name, "..") == 0) {
+        continue;
+      }
+
+      (void) unlink(pdircat(p, subdir, subdent->d_name, NULL));
+    }
+
+    closedir(subdirh);
+    (void) rmdir(subdir);
+  }
+
+  closedir(dirh);
+  (void) rmdir(cache_dir);
+}
+
+/* Fixtures */
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  init_fs();
+  remove_cache_dir();
+  (void) unlink(list_path);
+  (void) rmdir(list_dir);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("listcache", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) pr_listcache_close();
+  (void) pr_listcache_set_limits(PR_LISTCACHE_DEFAULT_MAX_AGE,
+    PR_LISTCACHE_DEFAULT_MAX_SIZE);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("listcache", 0, 0);
+  }
+
+  if (p != NULL) {
+    remove_cache_dir();
+    (void) unlink(list_path);
+    (void) rmdir(list_dir);
+
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+/* Creates the directory to be listed, and waits until its timestamps are
+ * old enough for its listings to be cached.
+ */
+static void make_list_dir(struct stat *st) {
+  int res;
+
+  res = mkdir(list_dir, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", list_dir,
+    strerror(errno));
+
+  sleep(1);
+
+  pr_fs_clear_cache2(list_dir);
+  res = pr_fsio_stat(list_dir, st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", list_dir, strerror(errno));
+}
+
+static int store_listing(const char *key, const struct stat *st,
+    const char *text) {
+  int res;
+
+  res = pr_listcache_capture_start(list_dir, key, st);
+  if (res < 0) {
+    return res;
+  }
+
+  pr_listcache_capture_add(text, strlen(text));
+  return pr_listcache_capture_finish();
+}
+
+START_TEST (listcache_open_test) {
+  int res;
+
+  mark_point();
+  res = pr_listcache_open(NULL);
+  fail_unless(res < 0, "Failed to handle null path");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_listcache_open(cache_dir);
+  fail_unless(res < 0, "Failed to handle nonexistent path");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+  fail_unless(pr_listcache_is_open() == FALSE, "Expected cache to be closed");
+
+  mark_point();
+  res = pr_listcache_close();
+  fail_unless(res < 0, "Failed to handle unopened cache");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = mkdir(cache_dir, 0700);
+  fail_unless(res == 0, "Failed to create '%s': %s", cache_dir,
+    strerror(errno));
+
+  mark_point();
+  res = pr_listcache_open(cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+  fail_unless(pr_listcache_is_open() == TRUE, "Expected cache to be open");
+
+  res = pr_listcache_close();
+  fail_unless(res == 0, "Failed to close cache: %s", strerror(errno));
+  fail_unless(pr_listcache_is_open() == FALSE, "Expected cache to be closed");
+}
+END_TEST
+
+START_TEST (listcache_set_limits_test) {
+  int res;
+
+  mark_point();
+  res = pr_listcache_set_limits(0, 1);
+  fail_unless(res < 0, "Failed to handle zero max age");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_listcache_set_limits(1, 0);
+  fail_unless(res < 0, "Failed to handle zero max size");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_listcache_set_limits(30, 1024);
+  fail_unless(res == 0, "Failed to set limits: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (listcache_get_test) {
+  int res;
+  struct stat st;
+  char *data = NULL;
+  size_t datalen = 0;
+  const char *text = "foo\r\nbar\r\n";
+
+  memset(&st, 0, sizeof(st));
+
+  mark_point();
+  res = pr_listcache_get(p, list_dir, "-l", &st, &data, &datalen);
+  fail_unless(res < 0, "Failed to handle unopened cache");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_listcache_capture_start(list_dir, "-l", &st);
+  fail_unless(res < 0, "Failed to handle unopened cache");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = mkdir(cache_dir, 0700);
+  fail_unless(res == 0, "Failed to create '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_listcache_open(cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+
+  make_list_dir(&st);
+
+  mark_point();
+  res = pr_listcache_get(p, list_dir, "-l", &st, &data, &datalen);
+  fail_unless(res < 0, "Failed to handle uncached listing");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  mark_point();
+  res = store_listing("-l", &st, text);
+  fail_unless(res == 0, "Failed to store listing: %s", strerror(errno));
+
+  mark_point();
+  res = pr_listcache_get(p, list_dir, "-l", &st, &data, &datalen);
+  fail_unless(res == 0, "Failed to get cached listing: %s", strerror(errno));
+  fail_unless(datalen == strlen(text), "Expected %lu bytes, got %lu",
+    (unsigned long) strlen(text), (unsigned long) datalen);
+  fail_unless(memcmp(data, text, datalen) == 0,
+    "Cached listing does not match stored listing");
+
+  /* A different key must not find the listing. */
+  mark_point();
+  res = pr_listcache_get(p, list_dir, "-la", &st, &data, &datalen);
+  fail_unless(res < 0, "Failed to handle uncached key");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* Nor a different directory state. */
+  st.st_mtime--;
+
+  mark_point();
+  res = pr_listcache_get(p, list_dir, "-l", &st, &data, &datalen);
+  fail_unless(res < 0, "Failed to handle stale listing");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* The stale listing is removed. */
+  st.st_mtime++;
+
+  mark_point();
+  res = pr_listcache_get(p, list_dir, "-l", &st, &data, &datalen);
+  fail_unless(res < 0, "Failed to remove stale listing");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (listcache_capture_test) {
+  int res;
+  struct stat st;
+  char *data = NULL;
+  size_t datalen = 0;
+
+  res = mkdir(cache_dir, 0700);
+  fail_unless(res == 0, "Failed to create '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_listcache_open(cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+
+  mark_point();
+  res = pr_listcache_capture_start(NULL, "-l", &st);
+  fail_unless(res < 0, "Failed to handle null directory");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_listcache_capture_finish();
+  fail_unless(res < 0, "Failed to handle missing capture");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  /* Recently modified directories are not cached. */
+  res = mkdir(list_dir, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", list_dir,
+    strerror(errno));
+
+  res = pr_fsio_stat(list_dir, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", list_dir, strerror(errno));
+  st.st_mtime = time(NULL);
+
+  mark_point();
+  res = pr_listcache_capture_start(list_dir, "-l", &st);
+  fail_unless(res < 0, "Failed to handle recently modified directory");
+  fail_unless(errno == EAGAIN, "Expected EAGAIN (%d), got %s (%d)", EAGAIN,
+    strerror(errno), errno);
+
+  (void) rmdir(list_dir);
+  make_list_dir(&st);
+
+  /* Oversized listings are not cached. */
+  res = pr_listcache_set_limits(PR_LISTCACHE_DEFAULT_MAX_AGE, 4);
+  fail_unless(res == 0, "Failed to set limits: %s", strerror(errno));
+
+  mark_point();
+  res = store_listing("-l", &st, "foobar");
+  fail_unless(res < 0, "Failed to handle oversized listing");
+  fail_unless(errno == EFBIG, "Expected EFBIG (%d), got %s (%d)", EFBIG,
+    strerror(errno), errno);
+
+  res = pr_listcache_set_limits(PR_LISTCACHE_DEFAULT_MAX_AGE,
+    PR_LISTCACHE_DEFAULT_MAX_SIZE);
+  fail_unless(res == 0, "Failed to set limits: %s", strerror(errno));
+
+  /* Nor are listings of directories which change while being listed. */
+  mark_point();
+  res = pr_listcache_capture_start(list_dir, "-l", &st);
+  fail_unless(res == 0, "Failed to start capture: %s", strerror(errno));
+
+  pr_listcache_capture_add("foo\r\n", 5);
+
+  res = rmdir(list_dir);
+  fail_unless(res == 0, "Failed to remove '%s': %s", list_dir,
+    strerror(errno));
+
+  mark_point();
+  res = pr_listcache_capture_finish();
+  fail_unless(res < 0, "Failed to handle changed directory");
+  fail_unless(errno == ESTALE, "Expected ESTALE (%d), got %s (%d)", ESTALE,
+    strerror(errno), errno);
+
+  res = pr_listcache_get(p, list_dir, "-l", &st, &data, &datalen);
+  fail_unless(res < 0, "Unexpectedly found cached listing");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (listcache_invalidate_test) {
+  int res;
+  struct stat st;
+  char *data = NULL;
+  size_t datalen = 0;
+
+  mark_point();
+  res = pr_listcache_invalidate(list_path);
+  fail_unless(res == 0, "Failed to handle unopened cache: %s",
+    strerror(errno));
+
+  res = mkdir(cache_dir, 0700);
+  fail_unless(res == 0, "Failed to create '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_listcache_open(cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+
+  mark_point();
+  res = pr_listcache_invalidate(NULL);
+  fail_unless(res < 0, "Failed to handle null path");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  make_list_dir(&st);
+
+  res = store_listing("-l", &st, "foo\r\n");
+  fail_unless(res == 0, "Failed to store listing: %s", strerror(errno));
+
+  res = store_listing("-la", &st, ".\r\n..\r\nfoo\r\n");
+  fail_unless(res == 0, "Failed to store listing: %s", strerror(errno));
+
+  /* Invalidating an entry of the directory removes all of the listings of
+   * the directory.
+   */
+  mark_point();
+  res = pr_listcache_invalidate(list_path);
+  fail_unless(res == 0, "Failed to invalidate '%s': %s", list_path,
+    strerror(errno));
+
+  res = pr_listcache_get(p, list_dir, "-l", &st, &data, &datalen);
+  fail_unless(res < 0, "Failed to invalidate listing");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = pr_listcache_get(p, list_dir, "-la", &st, &data, &datalen);
+  fail_unless(res < 0, "Failed to invalidate listing");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* As do modifications made via the FSIO API. */
+  res = store_listing("-l", &st, "foo\r\n");
+  fail_unless(res == 0, "Failed to store listing: %s", strerror(errno));
+
+  res = pr_listcache_get(p, list_dir, "-l", &st, &data, &datalen);
+  fail_unless(res == 0, "Failed to get cached listing: %s", strerror(errno));
+
+  mark_point();
+  res = pr_fsio_chmod(list_dir, 0750);
+  fail_unless(res == 0, "Failed to chmod '%s': %s", list_dir,
+    strerror(errno));
+
+  res = pr_listcache_get(p, list_dir, "-l", &st, &data, &datalen);
+  fail_unless(res < 0, "Failed to invalidate listing");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+Suite *tests_get_listcache_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("listcache");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, listcache_open_test);
+  tcase_add_test(testcase, listcache_set_limits_test);
+  tcase_add_test(testcase, listcache_get_test);
+  tcase_add_test(testcase, listcache_capture_test);
+  tcase_add_test(testcase, listcache_invalidate_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
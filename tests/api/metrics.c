@@ -0,0 +1,295 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Metrics API tests. */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("metrics", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) pr_metrics_free();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("metrics", 0, 0);
+  }
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+static unsigned int dump_count = 0;
+
+static void metrics_dump_cb(const char *fmt, ...) {
+  dump_count++;
+}
+
+START_TEST (metrics_init_test) {
+  int res;
+
+  mark_point();
+  res = pr_metrics_enabled();
+  fail_unless(res == FALSE, "Expected metrics to be disabled");
+
+  mark_point();
+  res = pr_metrics_init();
+  fail_unless(res == 0, "Failed to init metrics: %s", strerror(errno));
+
+  res = pr_metrics_enabled();
+  fail_unless(res == TRUE, "Expected metrics to be enabled");
+
+  mark_point();
+  res = pr_metrics_init();
+  fail_unless(res == 0, "Failed to init metrics again: %s", strerror(errno));
+
+  mark_point();
+  res = pr_metrics_free();
+  fail_unless(res == 0, "Failed to free metrics: %s", strerror(errno));
+
+  res = pr_metrics_enabled();
+  fail_unless(res == FALSE, "Expected metrics to be disabled");
+}
+END_TEST
+
+START_TEST (metrics_now_test) {
+  uint64_t now;
+
+  mark_point();
+  now = pr_metrics_now();
+  fail_unless(now == 0, "Expected 0 when disabled, got %lu",
+    (unsigned long) now);
+
+  (void) pr_metrics_init();
+
+  mark_point();
+  now = pr_metrics_now();
+  fail_unless(now > 0, "Expected non-zero time when enabled");
+}
+END_TEST
+
+START_TEST (metrics_cmd_observe_test) {
+  int res;
+  cmd_rec *cmd;
+
+  mark_point();
+  res = pr_metrics_cmd_observe(NULL, CMD, 1);
+  fail_unless(res == 0, "Failed to ignore observation when disabled");
+
+  (void) pr_metrics_init();
+
+  mark_point();
+  res = pr_metrics_cmd_observe(NULL, CMD, 1);
+  fail_unless(res < 0, "Failed to handle null cmd");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  cmd = pr_cmd_alloc(p, 1, pstrdup(p, "FOO"));
+
+  mark_point();
+  res = pr_metrics_cmd_observe(cmd, -1, 1);
+  fail_unless(res < 0, "Failed to handle invalid phase");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_metrics_cmd_observe(cmd, CMD, 0);
+  fail_unless(res == 0, "Failed to ignore zero start time");
+
+  mark_point();
+  res = pr_metrics_cmd_observe(cmd, CMD, pr_metrics_now());
+  fail_unless(res == 0, "Failed to observe FOO command: %s", strerror(errno));
+
+  cmd = pr_cmd_alloc(p, 1, pstrdup(p, C_RETR));
+  cmd->cmd_id = pr_cmd_get_id(C_RETR);
+
+  mark_point();
+  res = pr_metrics_cmd_observe(cmd, PRE_CMD, pr_metrics_now());
+  fail_unless(res == 0, "Failed to observe RETR command: %s", strerror(errno));
+
+  dump_count = 0;
+  pr_metrics_dump(metrics_dump_cb);
+  fail_unless(dump_count > 0, "Expected dumped metrics");
+}
+END_TEST
+
+START_TEST (metrics_observe_test) {
+  int res;
+  uint64_t start_usecs, usecs;
+
+  mark_point();
+  res = pr_metrics_observe(PR_METRICS_ID_AUTH, 1);
+  fail_unless(res == 0, "Failed to ignore observation when disabled");
+
+  (void) pr_metrics_init();
+
+  mark_point();
+  res = pr_metrics_observe(-1, 1);
+  fail_unless(res < 0, "Failed to handle invalid metric ID");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_metrics_get_percentile(PR_METRICS_ID_AUTH, 50, &usecs);
+  fail_unless(res < 0, "Failed to handle missing observations");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* Observe a latency of roughly 100ms. */
+  start_usecs = pr_metrics_now() - 100000;
+
+  mark_point();
+  res = pr_metrics_observe(PR_METRICS_ID_AUTH, start_usecs);
+  fail_unless(res == 0, "Failed to observe auth metric: %s", strerror(errno));
+
+  mark_point();
+  res = pr_metrics_get_percentile(PR_METRICS_ID_AUTH, 101, &usecs);
+  fail_unless(res < 0, "Failed to handle invalid percentage");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_metrics_get_percentile(PR_METRICS_ID_AUTH, 99, &usecs);
+  fail_unless(res == 0, "Failed to get percentile: %s", strerror(errno));
+  fail_unless(usecs >= 100000, "Expected at least 100000 usecs, got %lu",
+    (unsigned long) usecs);
+  fail_unless(usecs < 110000, "Expected less than 110000 usecs, got %lu",
+    (unsigned long) usecs);
+
+  mark_point();
+  res = pr_metrics_reset();
+  fail_unless(res == 0, "Failed to reset metrics: %s", strerror(errno));
+
+  res = pr_metrics_get_percentile(PR_METRICS_ID_AUTH, 99, &usecs);
+  fail_unless(res < 0, "Failed to handle missing observations");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (metrics_percentile_test) {
+  register unsigned int i;
+  int res;
+  uint64_t usecs = 0;
+
+  (void) pr_metrics_init();
+
+  /* Observe latencies of 1ms through 100ms. */
+  for (i = 1; i <= 100; i++) {
+    res = pr_metrics_observe(PR_METRICS_ID_DATA_XFER,
+      pr_metrics_now() - (i * 1000));
+    fail_unless(res == 0, "Failed to observe data transfer metric: %s",
+      strerror(errno));
+  }
+
+  /* The reported percentiles are bucket upper bounds, which are within
+   * 1/16th of the observed values.
+   */
+  mark_point();
+  res = pr_metrics_get_percentile(PR_METRICS_ID_DATA_XFER, 50, &usecs);
+  fail_unless(res == 0, "Failed to get percentile: %s", strerror(errno));
+  fail_unless(usecs >= 50000, "Expected at least 50000 usecs, got %lu",
+    (unsigned long) usecs);
+  fail_unless(usecs <= 53125, "Expected at most 53125 usecs, got %lu",
+    (unsigned long) usecs);
+
+  mark_point();
+  res = pr_metrics_get_percentile(PR_METRICS_ID_DATA_XFER, 90, &usecs);
+  fail_unless(res == 0, "Failed to get percentile: %s", strerror(errno));
+  fail_unless(usecs >= 90000, "Expected at least 90000 usecs, got %lu",
+    (unsigned long) usecs);
+  fail_unless(usecs <= 95625, "Expected at most 95625 usecs, got %lu",
+    (unsigned long) usecs);
+
+  mark_point();
+  res = pr_metrics_get_percentile(PR_METRICS_ID_DATA_XFER, 100, &usecs);
+  fail_unless(res == 0, "Failed to get percentile: %s", strerror(errno));
+  fail_unless(usecs >= 100000, "Expected at least 100000 usecs, got %lu",
+    (unsigned long) usecs);
+  fail_unless(usecs < 101000, "Expected less than 101000 usecs, got %lu",
+    (unsigned long) usecs);
+}
+END_TEST
+
+START_TEST (metrics_incr_test) {
+  int res;
+  uint64_t val = 0;
+
+  mark_point();
+  res = pr_metrics_get_counter(PR_METRICS_COUNTER_BYTES_IN, &val);
+  fail_unless(res < 0, "Failed to handle disabled metrics");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  (void) pr_metrics_init();
+
+  mark_point();
+  res = pr_metrics_incr(PR_METRICS_COUNTER_MAX, 1);
+  fail_unless(res < 0, "Failed to handle invalid counter ID");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_metrics_incr(PR_METRICS_COUNTER_BYTES_IN, 2);
+  fail_unless(res == 0, "Failed to increment counter: %s", strerror(errno));
+
+  res = pr_metrics_incr(PR_METRICS_COUNTER_BYTES_IN, 3);
+  fail_unless(res == 0, "Failed to increment counter: %s", strerror(errno));
+
+  res = pr_metrics_get_counter(PR_METRICS_COUNTER_BYTES_IN, &val);
+  fail_unless(res == 0, "Failed to get counter: %s", strerror(errno));
+  fail_unless(val == 5, "Expected 5, got %lu", (unsigned long) val);
+}
+END_TEST
+
+Suite *tests_get_metrics_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("metrics");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, metrics_init_test);
+  tcase_add_test(testcase, metrics_now_test);
+  tcase_add_test(testcase, metrics_cmd_observe_test);
+  tcase_add_test(testcase, metrics_observe_test);
+  tcase_add_test(testcase, metrics_percentile_test);
+  tcase_add_test(testcase, metrics_incr_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
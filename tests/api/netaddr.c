@@ -43,6 +43,8 @@ static void set_up(void) {
 }
 
 static void tear_down(void) {
+  (void) pr_netaddr_sharedcache_free();
+
   if (getenv("TEST_VERBOSE") != NULL) {
     pr_trace_set_levels("dns", 0, 0);
   }
@@ -878,6 +880,121 @@ START_TEST (netaddr_get_dnsstr_test) {
 }
 END_TEST
 
+START_TEST (netaddr_sharedcache_init_test) {
+  int res;
+  unsigned long hits = 0, misses = 0;
+
+  mark_point();
+  res = pr_netaddr_sharedcache_get_stats(NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_netaddr_sharedcache_get_stats(&hits, &misses);
+  fail_unless(res < 0, "Failed to handle disabled cache");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_netaddr_sharedcache_init(0, 60, 10);
+  fail_unless(res < 0, "Failed to handle zero entries");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_netaddr_sharedcache_init(32, -1, 10);
+  fail_unless(res < 0, "Failed to handle negative TTL");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_netaddr_sharedcache_init(32, 60, 10);
+  if (res < 0 &&
+      errno == ENOSYS) {
+    return;
+  }
+  fail_unless(res == 0, "Failed to init shared cache: %s", strerror(errno));
+
+  mark_point();
+  res = pr_netaddr_sharedcache_init(32, 60, 10);
+  fail_unless(res < 0, "Failed to handle already-initialized cache");
+  fail_unless(errno == EEXIST, "Expected EEXIST (%d), got %s (%d)", EEXIST,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_netaddr_sharedcache_get_stats(&hits, &misses);
+  fail_unless(res == 0, "Failed to get stats: %s", strerror(errno));
+  fail_unless(hits == 0, "Expected 0 hits, got %lu", hits);
+  fail_unless(misses == 0, "Expected 0 misses, got %lu", misses);
+
+  res = pr_netaddr_sharedcache_free();
+  fail_unless(res == 0, "Failed to free shared cache: %s", strerror(errno));
+
+  res = pr_netaddr_sharedcache_free();
+  fail_unless(res == 0, "Failed to free shared cache: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (netaddr_sharedcache_get_dnsstr_test) {
+  int res;
+  const pr_netaddr_t *addr;
+  const char *ip, *name, *cached_name;
+  unsigned long hits = 0, misses = 0;
+
+  ip = "127.0.0.1";
+
+  res = pr_netaddr_sharedcache_init(32, 60, 10);
+  if (res < 0 &&
+      errno == ENOSYS) {
+    return;
+  }
+  fail_unless(res == 0, "Failed to init shared cache: %s", strerror(errno));
+
+  pr_netaddr_set_reverse_dns(TRUE);
+  pr_netaddr_clear_cache();
+
+  addr = pr_netaddr_get_addr(p, ip, NULL);
+  fail_unless(addr != NULL, "Failed to get addr for '%s': %s", ip,
+    strerror(errno));
+
+  mark_point();
+  name = pr_netaddr_get_dnsstr(addr);
+  fail_unless(name != NULL, "Failed to get DNS str for addr: %s",
+    strerror(errno));
+
+  res = pr_netaddr_sharedcache_get_stats(&hits, &misses);
+  fail_unless(res == 0, "Failed to get stats: %s", strerror(errno));
+  fail_unless(hits == 0, "Expected 0 hits, got %lu", hits);
+  fail_unless(misses == 1, "Expected 1 miss, got %lu", misses);
+
+  /* Clear the per-process caches, as a new session process would not have
+   * them; the name should then come from the shared cache.
+   */
+  pr_netaddr_clear_cache();
+
+  addr = pr_netaddr_get_addr(p, ip, NULL);
+  fail_unless(addr != NULL, "Failed to get addr for '%s': %s", ip,
+    strerror(errno));
+  fail_unless(addr->na_have_dnsstr == 0, "addr already has cached DNS str");
+
+  mark_point();
+  cached_name = pr_netaddr_get_dnsstr(addr);
+  fail_unless(cached_name != NULL, "Failed to get DNS str for addr: %s",
+    strerror(errno));
+  fail_unless(strcmp(cached_name, name) == 0, "Expected '%s', got '%s'",
+    name, cached_name);
+
+  res = pr_netaddr_sharedcache_get_stats(&hits, &misses);
+  fail_unless(res == 0, "Failed to get stats: %s", strerror(errno));
+  fail_unless(hits == 1, "Expected 1 hit, got %lu", hits);
+  fail_unless(misses == 1, "Expected 1 miss, got %lu", misses);
+
+  pr_netaddr_set_reverse_dns(FALSE);
+  (void) pr_netaddr_sharedcache_free();
+}
+END_TEST
+
 START_TEST (netaddr_get_dnsstr_list_test) {
   array_header *res, *addrs = NULL;
   const pr_netaddr_t *addr;
@@ -1436,6 +1553,8 @@ Suite *tests_get_netaddr_suite(void) {
   tcase_add_test(testcase, netaddr_set_port_test);
   tcase_add_test(testcase, netaddr_set_reverse_dns_test);
   tcase_add_test(testcase, netaddr_get_dnsstr_test);
+  tcase_add_test(testcase, netaddr_sharedcache_init_test);
+  tcase_add_test(testcase, netaddr_sharedcache_get_dnsstr_test);
   tcase_add_test(testcase, netaddr_get_dnsstr_list_test);
 #ifdef PR_USE_IPV6
   tcase_add_test(testcase, netaddr_get_dnsstr_ipv6_test);
@@ -1522,6 +1522,170 @@ static int netio_write_to_stream(int strm_type, int use_async) {
   return 0;
 }
 
+START_TEST (netio_telnet_pending_test) {
+  int res;
+  char buf[256], *cmd;
+  pr_netio_stream_t *in, *out;
+  pr_buffer_t *pbuf;
+  int len;
+
+  res = pr_netio_telnet_pending(NULL);
+  fail_unless(res < 0, "Failed to handle null stream");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  in = pr_netio_open(p, PR_NETIO_STRM_CTRL, -1, PR_NETIO_IO_RD);
+  out = pr_netio_open(p, PR_NETIO_STRM_CTRL, -1, PR_NETIO_IO_WR);
+
+  res = pr_netio_telnet_pending(in);
+  fail_unless(res == FALSE, "Expected FALSE for unbuffered stream, got %d",
+    res);
+
+  /* A complete command, followed by a partial one. */
+  cmd = "NOOP\r\nPWD";
+
+  pr_netio_buffer_alloc(in);
+  pbuf = in->strm_buf;
+  len = snprintf(pbuf->buf, pbuf->buflen-1, "%s", cmd);
+  pbuf->remaining = pbuf->buflen - len;
+  pbuf->current = pbuf->buf;
+
+  res = pr_netio_telnet_pending(in);
+  fail_unless(res == TRUE, "Expected TRUE for buffered line, got %d", res);
+
+  res = pr_netio_telnet_gets2(buf, sizeof(buf)-1, in, out);
+  fail_unless(res > 0, "Failed to get string from stream: %s",
+    strerror(errno));
+
+  res = pr_netio_telnet_pending(in);
+  fail_unless(res == FALSE, "Expected FALSE for partial line, got %d", res);
+
+  pr_netio_close(in);
+  pr_netio_close(out);
+}
+END_TEST
+
+START_TEST (netio_cork_test) {
+  int fd, res;
+  pr_netio_stream_t *nstrm;
+  struct stat st;
+
+  res = pr_netio_cork(NULL);
+  fail_unless(res < 0, "Failed to handle null stream");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_netio_uncork(NULL);
+  fail_unless(res < 0, "Failed to handle null stream");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  fd = open_tmpfile();
+  nstrm = pr_netio_open(p, PR_NETIO_STRM_CTRL, fd, PR_NETIO_IO_WR);
+  fail_unless(nstrm != NULL, "Failed to open stream: %s", strerror(errno));
+
+  /* Uncorking a stream which is not corked is a no-op. */
+  res = pr_netio_uncork(nstrm);
+  fail_unless(res == 0, "Failed to uncork stream: %s", strerror(errno));
+
+  res = pr_netio_cork(nstrm);
+  fail_unless(res == 0, "Failed to cork stream: %s", strerror(errno));
+
+  res = pr_netio_printf(nstrm, "%s\r\n", "200 First");
+  fail_unless(res == 11, "Expected 11, got %d", res);
+
+  res = pr_netio_printf(nstrm, "%s\r\n", "200 Second");
+  fail_unless(res == 12, "Expected 12, got %d", res);
+
+  res = fstat(fd, &st);
+  fail_unless(res == 0, "Failed to stat fd %d: %s", fd, strerror(errno));
+  fail_unless(st.st_size == 0, "Expected no data written, got %lu bytes",
+    (unsigned long) st.st_size);
+
+  res = pr_netio_uncork(nstrm);
+  fail_unless(res == 0, "Failed to uncork stream: %s", strerror(errno));
+
+  res = fstat(fd, &st);
+  fail_unless(res == 0, "Failed to stat fd %d: %s", fd, strerror(errno));
+  fail_unless(st.st_size == 23, "Expected 23 bytes written, got %lu bytes",
+    (unsigned long) st.st_size);
+
+  /* Closing a corked stream writes out the buffered data. */
+  res = pr_netio_cork(nstrm);
+  fail_unless(res == 0, "Failed to cork stream: %s", strerror(errno));
+
+  res = pr_netio_printf(nstrm, "%s\r\n", "221 Goodbye");
+  fail_unless(res == 13, "Expected 13, got %d", res);
+
+  pr_netio_close(nstrm);
+  tmp_fd = -1;
+
+  res = stat(tmp_path, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", tmp_path, strerror(errno));
+  fail_unless(st.st_size == 36, "Expected 36 bytes written, got %lu bytes",
+    (unsigned long) st.st_size);
+}
+END_TEST
+
+START_TEST (netio_cork_write_async_test) {
+  int fds[2], flags, res;
+  pr_netio_stream_t *nstrm;
+  char buf[1024], *text;
+  size_t textlen;
+  ssize_t len;
+
+  res = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  fail_unless(res == 0, "Failed to create socket pair: %s", strerror(errno));
+
+  /* Fill the socket, so that no more can be written without blocking. */
+  flags = fcntl(fds[0], F_GETFL);
+  (void) fcntl(fds[0], F_SETFL, flags|O_NONBLOCK);
+  (void) fcntl(fds[1], F_SETFL, flags|O_NONBLOCK);
+
+  memset(buf, 'x', sizeof(buf));
+  while (write(fds[0], buf, sizeof(buf)) > 0) {
+  }
+
+  (void) fcntl(fds[0], F_SETFL, flags);
+
+  nstrm = pr_netio_open(p, PR_NETIO_STRM_CTRL, fds[0], PR_NETIO_IO_WR);
+  fail_unless(nstrm != NULL, "Failed to open stream: %s", strerror(errno));
+
+  res = pr_netio_cork(nstrm);
+  fail_unless(res == 0, "Failed to cork stream: %s", strerror(errno));
+
+  res = pr_netio_printf(nstrm, "%s\r\n", "200 First");
+  fail_unless(res == 11, "Expected 11, got %d", res);
+
+  /* The corked data cannot be written without blocking; it, and the data
+   * written asynchronously, must stay corked rather than being dropped.
+   */
+  text = "421 Timeout\r\n";
+  textlen = strlen(text);
+
+  mark_point();
+  res = pr_netio_write_async(nstrm, text, textlen);
+  fail_unless(res == (int) textlen, "Expected %lu, got %d",
+    (unsigned long) textlen, res);
+
+  /* Drain the socket, then uncork the stream. */
+  while (read(fds[1], buf, sizeof(buf)) > 0) {
+  }
+
+  res = pr_netio_uncork(nstrm);
+  fail_unless(res == 0, "Failed to uncork stream: %s", strerror(errno));
+
+  memset(buf, '\0', sizeof(buf));
+  len = read(fds[1], buf, sizeof(buf) - 1);
+  fail_unless(len == 24, "Expected 24 bytes, got %ld", (long) len);
+  fail_unless(strcmp(buf, "200 First\r\n421 Timeout\r\n") == 0,
+    "Expected corked responses in order, got '%s'", buf);
+
+  pr_netio_close(nstrm);
+  (void) close(fds[1]);
+}
+END_TEST
+
 START_TEST (netio_read_test) {
   int res;
   pr_netio_t *netio, *netio2;
@@ -2061,6 +2225,10 @@ Suite *tests_get_netio_suite(void) {
   tcase_add_test(testcase, netio_telnet_gets2_single_line_crnul_test);
   tcase_add_test(testcase, netio_telnet_gets2_single_line_lf_test);
 
+  tcase_add_test(testcase, netio_telnet_pending_test);
+  tcase_add_test(testcase, netio_cork_test);
+  tcase_add_test(testcase, netio_cork_write_async_test);
+
   tcase_add_test(testcase, netio_read_test);
   tcase_add_test(testcase, netio_gets_test);
   tcase_add_test(testcase, netio_write_test);
@@ -469,6 +469,542 @@ START_TEST (redis_command_test) {
 }
 END_TEST
 
+START_TEST (redis_pipeline_alloc_test) {
+  int res;
+  pr_redis_t *redis;
+  pr_redis_pipeline_t *pipeline;
+  module m;
+
+  mark_point();
+  pipeline = pr_redis_pipeline_alloc(NULL, NULL, NULL);
+  fail_unless(pipeline == NULL, "Failed to handle null pool");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  pipeline = pr_redis_pipeline_alloc(p, NULL, NULL);
+  fail_unless(pipeline == NULL, "Failed to handle null redis");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  redis = pr_redis_conn_new(p, NULL, 0);
+  fail_unless(redis != NULL, "Failed to open connection to Redis: %s",
+    strerror(errno));
+
+  mark_point();
+  pipeline = pr_redis_pipeline_alloc(p, redis, NULL);
+  fail_unless(pipeline == NULL, "Failed to handle null module");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  pipeline = pr_redis_pipeline_alloc(p, redis, &m);
+  fail_unless(pipeline != NULL, "Failed to allocate pipeline: %s",
+    strerror(errno));
+
+  mark_point();
+  res = pr_redis_pipeline_kget(NULL, NULL, 0);
+  fail_unless(res < 0, "Failed to handle null pipeline");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_redis_pipeline_get(pipeline, NULL);
+  fail_unless(res < 0, "Failed to handle null key");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_redis_pipeline_set(pipeline, "testkey", NULL, 0, 0);
+  fail_unless(res < 0, "Failed to handle null value");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_redis_pipeline_incr(pipeline, "testkey", 0);
+  fail_unless(res < 0, "Failed to handle zero increment");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_redis_pipeline_command(pipeline, NULL);
+  fail_unless(res < 0, "Failed to handle null args");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_redis_conn_destroy(redis);
+  fail_unless(res == TRUE, "Failed to close redis: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (redis_pipeline_exec_test) {
+  int res;
+  pr_redis_t *redis;
+  pr_redis_pipeline_t *pipeline;
+  pr_redis_reply_t *reply;
+  module m;
+  const char *key, *list_key;
+  char *val;
+  size_t valsz;
+  array_header *args, *replies = NULL;
+
+  mark_point();
+  res = pr_redis_pipeline_exec(NULL, NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null pool");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  redis = pr_redis_conn_new(p, NULL, 0);
+  fail_unless(redis != NULL, "Failed to open connection to Redis: %s",
+    strerror(errno));
+
+  mark_point();
+  res = pr_redis_conn_set_namespace(redis, &m, "test.", 5);
+  fail_unless(res == 0, "Failed to set namespace: %s", strerror(errno));
+
+  pipeline = pr_redis_pipeline_alloc(p, redis, &m);
+  fail_unless(pipeline != NULL, "Failed to allocate pipeline: %s",
+    strerror(errno));
+
+  mark_point();
+  res = pr_redis_pipeline_exec(p, pipeline, NULL);
+  fail_unless(res < 0, "Failed to handle null replies");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* An empty pipeline has no replies. */
+  mark_point();
+  res = pr_redis_pipeline_exec(p, pipeline, &replies);
+  fail_unless(res == 0, "Failed to execute empty pipeline: %s",
+    strerror(errno));
+  fail_unless(replies != NULL, "Expected replies");
+  fail_unless(replies->nelts == 0, "Expected 0 replies, got %d",
+    replies->nelts);
+
+  key = "testkey";
+  list_key = "testlist";
+  (void) pr_redis_remove(redis, &m, key);
+  (void) pr_redis_list_remove(redis, &m, list_key);
+
+  val = "testval";
+  valsz = strlen(val);
+
+  mark_point();
+  res = pr_redis_list_append(redis, &m, list_key, "foo", 3);
+  fail_unless(res == 0, "Failed to append to list '%s': %s", list_key,
+    strerror(errno));
+
+  mark_point();
+  res = pr_redis_list_append(redis, &m, list_key, "bar", 3);
+  fail_unless(res == 0, "Failed to append to list '%s': %s", list_key,
+    strerror(errno));
+
+  res = pr_redis_pipeline_set(pipeline, key, val, valsz, 0);
+  fail_unless(res == 0, "Failed to queue SET: %s", strerror(errno));
+
+  res = pr_redis_pipeline_get(pipeline, key);
+  fail_unless(res == 0, "Failed to queue GET: %s", strerror(errno));
+
+  res = pr_redis_pipeline_get(pipeline, "nosuchkey");
+  fail_unless(res == 0, "Failed to queue GET: %s", strerror(errno));
+
+  /* Incrementing a non-numeric value is an error, but should not stop the
+   * remaining commands.
+   */
+  res = pr_redis_pipeline_incr(pipeline, key, 2);
+  fail_unless(res == 0, "Failed to queue INCRBY: %s", strerror(errno));
+
+  res = pr_redis_pipeline_list_getall(pipeline, list_key);
+  fail_unless(res == 0, "Failed to queue LRANGE: %s", strerror(errno));
+
+  args = make_array(p, 0, sizeof(char *));
+  *((char **) push_array(args)) = pstrdup(p, "PING");
+  res = pr_redis_pipeline_command(pipeline, args);
+  fail_unless(res == 0, "Failed to queue PING: %s", strerror(errno));
+
+  res = pr_redis_pipeline_remove(pipeline, key);
+  fail_unless(res == 0, "Failed to queue DEL: %s", strerror(errno));
+
+  mark_point();
+  res = pr_redis_pipeline_exec(p, pipeline, &replies);
+  fail_unless(res == 0, "Failed to execute pipeline: %s", strerror(errno));
+  fail_unless(replies != NULL, "Expected replies");
+  fail_unless(replies->nelts == 7, "Expected 7 replies, got %d",
+    replies->nelts);
+
+  reply = ((pr_redis_reply_t **) replies->elts)[0];
+  fail_unless(reply->type == PR_REDIS_REPLY_TYPE_STATUS,
+    "Expected STATUS reply for SET, got %d", reply->type);
+
+  reply = ((pr_redis_reply_t **) replies->elts)[1];
+  fail_unless(reply->type == PR_REDIS_REPLY_TYPE_STRING,
+    "Expected STRING reply for GET, got %d", reply->type);
+  fail_unless(reply->valuesz == valsz, "Expected %lu, got %lu",
+    (unsigned long) valsz, (unsigned long) reply->valuesz);
+  fail_unless(memcmp(reply->value, val, valsz) == 0,
+    "Expected '%s', got '%.*s'", val, (int) reply->valuesz,
+    (char *) reply->value);
+
+  reply = ((pr_redis_reply_t **) replies->elts)[2];
+  fail_unless(reply->type == PR_REDIS_REPLY_TYPE_NIL,
+    "Expected NIL reply for GET, got %d", reply->type);
+
+  reply = ((pr_redis_reply_t **) replies->elts)[3];
+  fail_unless(reply->type == PR_REDIS_REPLY_TYPE_ERROR,
+    "Expected ERROR reply for INCRBY, got %d", reply->type);
+
+  reply = ((pr_redis_reply_t **) replies->elts)[4];
+  fail_unless(reply->type == PR_REDIS_REPLY_TYPE_ARRAY,
+    "Expected ARRAY reply for LRANGE, got %d", reply->type);
+  fail_unless(reply->elements->nelts == 2, "Expected 2 elements, got %d",
+    reply->elements->nelts);
+  reply = ((pr_redis_reply_t **) reply->elements->elts)[1];
+  fail_unless(reply->valuesz == 3 && memcmp(reply->value, "bar", 3) == 0,
+    "Expected 'bar', got '%.*s'", (int) reply->valuesz,
+    (char *) reply->value);
+
+  reply = ((pr_redis_reply_t **) replies->elts)[5];
+  fail_unless(reply->type == PR_REDIS_REPLY_TYPE_STATUS,
+    "Expected STATUS reply for PING, got %d", reply->type);
+  fail_unless(strcmp(reply->value, "PONG") == 0, "Expected 'PONG', got '%s'",
+    (char *) reply->value);
+
+  reply = ((pr_redis_reply_t **) replies->elts)[6];
+  fail_unless(reply->type == PR_REDIS_REPLY_TYPE_INTEGER,
+    "Expected INTEGER reply for DEL, got %d", reply->type);
+  fail_unless(reply->number == 1, "Expected 1, got %lld",
+    (long long) reply->number);
+
+  /* The pipeline is empty once executed; it can be reused, and pipelined
+   * increments create nonexistent keys.  The namespace prefix should have
+   * been used for these keys as well.
+   */
+  res = pr_redis_pipeline_incr(pipeline, key, 2);
+  fail_unless(res == 0, "Failed to queue INCRBY: %s", strerror(errno));
+
+  res = pr_redis_pipeline_incr(pipeline, key, 3);
+  fail_unless(res == 0, "Failed to queue INCRBY: %s", strerror(errno));
+
+  mark_point();
+  res = pr_redis_pipeline_exec(p, pipeline, &replies);
+  fail_unless(res == 0, "Failed to execute pipeline: %s", strerror(errno));
+  fail_unless(replies->nelts == 2, "Expected 2 replies, got %d",
+    replies->nelts);
+
+  reply = ((pr_redis_reply_t **) replies->elts)[1];
+  fail_unless(reply->type == PR_REDIS_REPLY_TYPE_INTEGER,
+    "Expected INTEGER reply for INCRBY, got %d", reply->type);
+  fail_unless(reply->number == 5, "Expected 5, got %lld",
+    (long long) reply->number);
+
+  mark_point();
+  val = pr_redis_get_str(p, redis, &m, key);
+  fail_unless(val != NULL, "Failed to get key '%s': %s", key, strerror(errno));
+  fail_unless(strcmp(val, "5") == 0, "Expected '5', got '%s'", val);
+
+  (void) pr_redis_remove(redis, &m, key);
+  (void) pr_redis_list_remove(redis, &m, list_key);
+
+  mark_point();
+  res = pr_redis_conn_destroy(redis);
+  fail_unless(res == TRUE, "Failed to close redis: %s", strerror(errno));
+}
+END_TEST
+
+static const char *broker_path = "/tmp/prt-redis-broker.sock";
+
+static pid_t broker_start(unsigned int nupstreams) {
+  int fd;
+  pid_t broker_pid;
+  struct sockaddr_un sock;
+
+  (void) unlink(broker_path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  fail_unless(fd >= 0, "Failed to create socket: %s", strerror(errno));
+
+  memset(&sock, 0, sizeof(sock));
+  sock.sun_family = AF_UNIX;
+  sstrncpy(sock.sun_path, broker_path, sizeof(sock.sun_path));
+
+  fail_unless(bind(fd, (struct sockaddr *) &sock, sizeof(sock)) == 0,
+    "Failed to bind to '%s': %s", broker_path, strerror(errno));
+  fail_unless(listen(fd, 5) == 0, "Failed to listen on '%s': %s",
+    broker_path, strerror(errno));
+
+  broker_pid = fork();
+  fail_unless(broker_pid >= 0, "Failed to fork: %s", strerror(errno));
+
+  if (broker_pid == 0) {
+    (void) redis_broker_run(p, fd, nupstreams);
+    _exit(1);
+  }
+
+  (void) close(fd);
+  return broker_pid;
+}
+
+static void broker_stop(pid_t broker_pid) {
+  (void) kill(broker_pid, SIGTERM);
+  (void) waitpid(broker_pid, NULL, 0);
+  (void) unlink(broker_path);
+}
+
+START_TEST (redis_set_broker_test) {
+  int res;
+
+  mark_point();
+  res = redis_set_broker("foo.sock");
+  fail_unless(res < 0, "Failed to handle relative path");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = redis_set_broker(broker_path);
+  fail_unless(res == 0, "Failed to set broker: %s", strerror(errno));
+
+  mark_point();
+  res = redis_set_broker(NULL);
+  fail_unless(res == 0, "Failed to clear broker: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (redis_broker_run_test) {
+  int res;
+
+  mark_point();
+  res = redis_broker_run(NULL, -1, 0);
+  fail_unless(res < 0, "Failed to handle null pool");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = redis_broker_run(p, -1, 0);
+  fail_unless(res < 0, "Failed to handle invalid fd");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = redis_broker_run(p, 0, 0);
+  fail_unless(res < 0, "Failed to handle zero connections");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (redis_broker_conn_test) {
+  int res;
+  pid_t broker_pid;
+  pr_redis_t *redis, *redis2;
+  pr_redis_pipeline_t *pipeline;
+  pr_redis_reply_t **replies;
+  module m;
+  const char *key;
+  char *val;
+  array_header *args, *results = NULL;
+
+  broker_pid = broker_start(2);
+
+  mark_point();
+  res = redis_set_broker(broker_path);
+  fail_unless(res == 0, "Failed to set broker: %s", strerror(errno));
+
+  /* These two connections will use different Redis server connections. */
+  mark_point();
+  redis = pr_redis_conn_new(p, NULL, 0);
+  fail_unless(redis != NULL, "Failed to open connection via broker: %s",
+    strerror(errno));
+
+  mark_point();
+  redis2 = pr_redis_conn_new(p, NULL, 0);
+  fail_unless(redis2 != NULL, "Failed to open connection via broker: %s",
+    strerror(errno));
+
+  key = "testkey";
+  (void) pr_redis_remove(redis, &m, key);
+
+  mark_point();
+  res = pr_redis_set(redis, &m, key, "bar", 3, 0);
+  fail_unless(res == 0, "Failed to set key '%s' via broker: %s", key,
+    strerror(errno));
+
+  mark_point();
+  val = pr_redis_get_str(p, redis2, &m, key);
+  fail_unless(val != NULL, "Failed to get key '%s' via broker: %s", key,
+    strerror(errno));
+  fail_unless(strcmp(val, "bar") == 0, "Expected 'bar', got '%s'", val);
+
+  /* Commands refused by the broker must not disturb the order of the other
+   * replies.
+   */
+  pipeline = pr_redis_pipeline_alloc(p, redis, &m);
+  fail_unless(pipeline != NULL, "Failed to allocate pipeline: %s",
+    strerror(errno));
+
+  (void) pr_redis_pipeline_get(pipeline, key);
+
+  args = make_array(p, 0, sizeof(char *));
+  *((char **) push_array(args)) = pstrdup(p, "SELECT");
+  *((char **) push_array(args)) = pstrdup(p, "1");
+  (void) pr_redis_pipeline_command(pipeline, args);
+
+  args = make_array(p, 0, sizeof(char *));
+  *((char **) push_array(args)) = pstrdup(p, "RESET");
+  (void) pr_redis_pipeline_command(pipeline, args);
+
+  args = make_array(p, 0, sizeof(char *));
+  *((char **) push_array(args)) = pstrdup(p, "XREAD");
+  *((char **) push_array(args)) = pstrdup(p, "block");
+  *((char **) push_array(args)) = pstrdup(p, "0");
+  *((char **) push_array(args)) = pstrdup(p, "STREAMS");
+  *((char **) push_array(args)) = pstrdup(p, key);
+  *((char **) push_array(args)) = pstrdup(p, "$");
+  (void) pr_redis_pipeline_command(pipeline, args);
+
+  (void) pr_redis_pipeline_remove(pipeline, key);
+
+  mark_point();
+  res = pr_redis_pipeline_exec(p, pipeline, &results);
+  fail_unless(res == 0, "Failed to execute pipeline via broker: %s",
+    strerror(errno));
+  fail_unless(results->nelts == 5, "Expected 5 replies, got %u",
+    results->nelts);
+
+  replies = results->elts;
+  fail_unless(replies[0]->type == PR_REDIS_REPLY_TYPE_STRING,
+    "Expected STRING reply, got %d", replies[0]->type);
+  fail_unless(strcmp(replies[0]->value, "bar") == 0,
+    "Expected 'bar', got '%s'", (char *) replies[0]->value);
+  fail_unless(replies[1]->type == PR_REDIS_REPLY_TYPE_ERROR,
+    "Expected ERROR reply, got %d", replies[1]->type);
+  fail_unless(replies[2]->type == PR_REDIS_REPLY_TYPE_ERROR,
+    "Expected ERROR reply, got %d", replies[2]->type);
+  fail_unless(replies[3]->type == PR_REDIS_REPLY_TYPE_ERROR,
+    "Expected ERROR reply, got %d", replies[3]->type);
+  fail_unless(replies[4]->type == PR_REDIS_REPLY_TYPE_INTEGER,
+    "Expected INTEGER reply, got %d", replies[4]->type);
+  fail_unless(replies[4]->number == 1, "Expected 1, got %lld",
+    (long long) replies[4]->number);
+
+  mark_point();
+  res = pr_redis_conn_destroy(redis2);
+  fail_unless(res == TRUE, "Failed to close redis: %s", strerror(errno));
+
+  mark_point();
+  res = pr_redis_conn_destroy(redis);
+  fail_unless(res == TRUE, "Failed to close redis: %s", strerror(errno));
+
+  broker_stop(broker_pid);
+
+  /* Without the broker, connections are made to the server directly. */
+  mark_point();
+  redis = pr_redis_conn_new(p, NULL, 0);
+  fail_unless(redis != NULL, "Failed to open connection without broker: %s",
+    strerror(errno));
+
+  mark_point();
+  res = pr_redis_conn_destroy(redis);
+  fail_unless(res == TRUE, "Failed to close redis: %s", strerror(errno));
+
+  (void) redis_set_broker(NULL);
+}
+END_TEST
+
+START_TEST (redis_broker_unusable_test) {
+  int res;
+  pid_t broker_pid;
+  pr_redis_t *redis;
+  module m;
+
+  /* A broker which cannot reach the Redis server. */
+  redis_set_server(redis_server, 1020, 0UL, NULL, NULL);
+  broker_pid = broker_start(1);
+  redis_set_server(redis_server, redis_port, 0UL, NULL, NULL);
+
+  mark_point();
+  res = redis_set_broker(broker_path);
+  fail_unless(res == 0, "Failed to set broker: %s", strerror(errno));
+
+  /* Connections are then made to the server directly. */
+  mark_point();
+  redis = pr_redis_conn_new(p, NULL, 0);
+  fail_unless(redis != NULL, "Failed to open connection: %s",
+    strerror(errno));
+
+  mark_point();
+  res = pr_redis_set(redis, &m, "testkey", "bar", 3, 0);
+  fail_unless(res == 0, "Failed to set key: %s", strerror(errno));
+
+  mark_point();
+  res = pr_redis_remove(redis, &m, "testkey");
+  fail_unless(res == 0, "Failed to remove key: %s", strerror(errno));
+
+  mark_point();
+  res = pr_redis_conn_destroy(redis);
+  fail_unless(res == TRUE, "Failed to close redis: %s", strerror(errno));
+
+  broker_stop(broker_pid);
+  (void) redis_set_broker(NULL);
+}
+END_TEST
+
+START_TEST (redis_broker_peer_test) {
+  pid_t broker_pid, client_pid;
+  int status = 0;
+
+  broker_pid = broker_start(1);
+
+  /* A process outside of the broker's session, even though it runs as the
+   * same user, must not be able to use the broker.
+   */
+  client_pid = fork();
+  fail_unless(client_pid >= 0, "Failed to fork: %s", strerror(errno));
+
+  if (client_pid == 0) {
+    int fd;
+    ssize_t len;
+    char buf[64];
+    struct sockaddr_un sock;
+
+    if (setsid() < 0) {
+      _exit(2);
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      _exit(2);
+    }
+
+    memset(&sock, 0, sizeof(sock));
+    sock.sun_family = AF_UNIX;
+    sstrncpy(sock.sun_path, broker_path, sizeof(sock.sun_path));
+
+    if (connect(fd, (struct sockaddr *) &sock, sizeof(sock)) < 0) {
+      _exit(2);
+    }
+
+    (void) write(fd, "*1\r\n$4\r\nPING\r\n", 14);
+
+    /* The broker closes the connection without a reply. */
+    (void) signal(SIGALRM, SIG_DFL);
+    alarm(5);
+    len = read(fd, buf, sizeof(buf));
+    _exit(len <= 0 ? 0 : 1);
+  }
+
+  mark_point();
+  (void) waitpid(client_pid, &status, 0);
+  fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+    "Expected connection from another session to be rejected (status %d)",
+    status);
+
+  broker_stop(broker_pid);
+}
+END_TEST
+
 START_TEST (redis_sentinel_get_master_addr_test) {
   int res;
   pr_redis_t *redis;
@@ -1430,6 +1966,160 @@ START_TEST (redis_set_test) {
 }
 END_TEST
 
+START_TEST (redis_mget_test) {
+  int res;
+  pr_redis_t *redis;
+  module m;
+  array_header *keys, *values = NULL, *valueszs = NULL;
+  char *val;
+  size_t valsz;
+
+  mark_point();
+  res = pr_redis_mget(NULL, NULL, NULL, NULL, NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null pool");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  redis = pr_redis_conn_new(p, NULL, 0);
+  fail_unless(redis != NULL, "Failed to open connection to Redis: %s",
+    strerror(errno));
+
+  keys = make_array(p, 0, sizeof(char *));
+
+  mark_point();
+  res = pr_redis_mget(p, redis, &m, keys, NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null values");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_redis_mget(p, redis, &m, keys, &values, &valueszs);
+  fail_unless(res < 0, "Failed to handle empty keys");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  *((char **) push_array(keys)) = pstrdup(p, "testkey1");
+  *((char **) push_array(keys)) = pstrdup(p, "testkey2");
+  *((char **) push_array(keys)) = pstrdup(p, "testkey3");
+
+  (void) pr_redis_remove(redis, &m, "testkey1");
+  (void) pr_redis_remove(redis, &m, "testkey2");
+  (void) pr_redis_remove(redis, &m, "testkey3");
+
+  val = "testval";
+  valsz = strlen(val);
+
+  mark_point();
+  res = pr_redis_set(redis, &m, "testkey1", val, valsz, 0);
+  fail_unless(res == 0, "Failed to set key: %s", strerror(errno));
+
+  mark_point();
+  res = pr_redis_set(redis, &m, "testkey3", "foo", 3, 0);
+  fail_unless(res == 0, "Failed to set key: %s", strerror(errno));
+
+  mark_point();
+  res = pr_redis_mget(p, redis, &m, keys, &values, &valueszs);
+  fail_unless(res == 0, "Failed to get keys: %s", strerror(errno));
+  fail_unless(values != NULL, "Expected values");
+  fail_unless(values->nelts == 3, "Expected 3 values, got %d", values->nelts);
+  fail_unless(valueszs->nelts == 3, "Expected 3 value sizes, got %d",
+    valueszs->nelts);
+
+  fail_unless(((size_t *) valueszs->elts)[0] == valsz,
+    "Expected %lu, got %lu", (unsigned long) valsz,
+    (unsigned long) ((size_t *) valueszs->elts)[0]);
+  fail_unless(memcmp(((void **) values->elts)[0], val, valsz) == 0,
+    "Expected '%s'", val);
+
+  /* The missing key should have a NULL value. */
+  fail_unless(((void **) values->elts)[1] == NULL, "Expected NULL value");
+  fail_unless(((size_t *) valueszs->elts)[1] == 0, "Expected zero size");
+
+  fail_unless(((size_t *) valueszs->elts)[2] == 3, "Expected 3, got %lu",
+    (unsigned long) ((size_t *) valueszs->elts)[2]);
+  fail_unless(memcmp(((void **) values->elts)[2], "foo", 3) == 0,
+    "Expected 'foo'");
+
+  (void) pr_redis_remove(redis, &m, "testkey1");
+  (void) pr_redis_remove(redis, &m, "testkey3");
+
+  mark_point();
+  res = pr_redis_conn_destroy(redis);
+  fail_unless(res == TRUE, "Failed to close redis: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (redis_mset_test) {
+  int res;
+  pr_redis_t *redis;
+  module m;
+  array_header *keys, *values, *valueszs;
+  char *val;
+  time_t expires;
+
+  mark_point();
+  res = pr_redis_mset(NULL, NULL, NULL, NULL, NULL, 0);
+  fail_unless(res < 0, "Failed to handle null redis");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  redis = pr_redis_conn_new(p, NULL, 0);
+  fail_unless(redis != NULL, "Failed to open connection to Redis: %s",
+    strerror(errno));
+
+  keys = make_array(p, 0, sizeof(char *));
+  values = make_array(p, 0, sizeof(void *));
+  valueszs = make_array(p, 0, sizeof(size_t));
+
+  *((char **) push_array(keys)) = pstrdup(p, "testkey1");
+  *((char **) push_array(keys)) = pstrdup(p, "testkey2");
+
+  *((void **) push_array(values)) = pstrdup(p, "foo");
+  *((size_t *) push_array(valueszs)) = 3;
+
+  mark_point();
+  res = pr_redis_mset(redis, &m, keys, values, valueszs, 0);
+  fail_unless(res < 0, "Failed to handle mismatched keys/values");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  *((void **) push_array(values)) = pstrdup(p, "barbaz");
+  *((size_t *) push_array(valueszs)) = 6;
+
+  expires = 0;
+
+  mark_point();
+  res = pr_redis_mset(redis, &m, keys, values, valueszs, expires);
+  fail_unless(res == 0, "Failed to set keys: %s", strerror(errno));
+
+  mark_point();
+  val = pr_redis_get_str(p, redis, &m, "testkey2");
+  fail_unless(val != NULL, "Failed to get key: %s", strerror(errno));
+  fail_unless(strcmp(val, "barbaz") == 0, "Expected 'barbaz', got '%s'", val);
+
+  expires = 3;
+
+  mark_point();
+  res = pr_redis_mset(redis, &m, keys, values, valueszs, expires);
+  fail_unless(res == 0, "Failed to set keys with expiry: %s",
+    strerror(errno));
+
+  mark_point();
+  val = pr_redis_get_str(p, redis, &m, "testkey1");
+  fail_unless(val != NULL, "Failed to get key: %s", strerror(errno));
+  fail_unless(strcmp(val, "foo") == 0, "Expected 'foo', got '%s'", val);
+
+  (void) pr_redis_remove(redis, &m, "testkey1");
+  (void) pr_redis_remove(redis, &m, "testkey2");
+
+  mark_point();
+  res = pr_redis_conn_destroy(redis);
+  fail_unless(res == TRUE, "Failed to close redis: %s", strerror(errno));
+}
+END_TEST
+
 START_TEST (redis_hash_remove_test) {
   int res;
   pr_redis_t *redis;
@@ -4745,6 +5435,13 @@ Suite *tests_get_redis_suite(void) {
   tcase_add_test(testcase, redis_conn_select_test);
   tcase_add_test(testcase, redis_conn_reconnect_test);
   tcase_add_test(testcase, redis_command_test);
+  tcase_add_test(testcase, redis_pipeline_alloc_test);
+  tcase_add_test(testcase, redis_pipeline_exec_test);
+  tcase_add_test(testcase, redis_set_broker_test);
+  tcase_add_test(testcase, redis_broker_run_test);
+  tcase_add_test(testcase, redis_broker_conn_test);
+  tcase_add_test(testcase, redis_broker_unusable_test);
+  tcase_add_test(testcase, redis_broker_peer_test);
 
   tcase_add_test(testcase, redis_sentinel_get_master_addr_test);
   tcase_add_test(testcase, redis_sentinel_get_masters_test);
@@ -4760,6 +5457,8 @@ Suite *tests_get_redis_suite(void) {
   tcase_add_test(testcase, redis_decr_test);
   tcase_add_test(testcase, redis_rename_test);
   tcase_add_test(testcase, redis_set_test);
+  tcase_add_test(testcase, redis_mget_test);
+  tcase_add_test(testcase, redis_mset_test);
 
   tcase_add_test(testcase, redis_hash_remove_test);
   tcase_add_test(testcase, redis_hash_get_test);
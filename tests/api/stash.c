@@ -533,6 +533,47 @@ START_TEST (stash_remove_cmd_test) {
 }
 END_TEST
 
+START_TEST (stash_get_serial_test) {
+  int res;
+  unsigned long serial, serial2;
+  cmdtable cmdtab;
+
+  serial = pr_stash_get_serial(0);
+  fail_unless(serial == 0, "Failed to handle unknown symbol type");
+  fail_unless(errno == EINVAL, "Failed to set errno to EINVAL, got %d (%s)",
+    errno, strerror(errno));
+
+  serial = pr_stash_get_serial(PR_SYM_CMD);
+
+  /* Removing nothing should not change the serial number. */
+  res = pr_stash_remove_cmd("foo", NULL, 0, NULL, -1);
+  fail_unless(res == 0, "Expected %d, got %d", 0, res);
+
+  serial2 = pr_stash_get_serial(PR_SYM_CMD);
+  fail_unless(serial2 == serial, "Expected serial %lu, got %lu", serial,
+    serial2);
+
+  memset(&cmdtab, 0, sizeof(cmdtab));
+  cmdtab.command = pstrdup(p, "foo");
+  res = pr_stash_add_symbol(PR_SYM_CMD, &cmdtab);
+  fail_unless(res == 0, "Failed to add CMD symbol: %s", strerror(errno));
+
+  serial2 = pr_stash_get_serial(PR_SYM_CMD);
+  fail_unless(serial2 != serial, "Expected serial to change after add");
+  serial = serial2;
+
+  /* Other symbol types have their own serial numbers. */
+  serial2 = pr_stash_get_serial(PR_SYM_AUTH);
+  res = pr_stash_remove_cmd("foo", NULL, 0, NULL, -1);
+  fail_unless(res == 1, "Expected %d, got %d", 1, res);
+  fail_unless(pr_stash_get_serial(PR_SYM_AUTH) == serial2,
+    "Expected AUTH serial to be unchanged");
+
+  serial2 = pr_stash_get_serial(PR_SYM_CMD);
+  fail_unless(serial2 != serial, "Expected serial to change after remove");
+}
+END_TEST
+
 START_TEST (stash_remove_auth_test) {
   int res;
   authtable authtab;
@@ -604,6 +645,7 @@ Suite *tests_get_stash_suite(void) {
   tcase_add_test(testcase, stash_remove_cmd_test);
   tcase_add_test(testcase, stash_remove_auth_test);
   tcase_add_test(testcase, stash_remove_hook_test);
+  tcase_add_test(testcase, stash_get_serial_test);
 
   suite_add_tcase(suite, testcase);
   return suite;
@@ -73,6 +73,9 @@ static struct testsuite_info suites[] = {
   { "jot",		tests_get_jot_suite },
   { "redis",		tests_get_redis_suite },
   { "error",		tests_get_error_suite },
+  { "metrics",		tests_get_metrics_suite },
+  { "crc32",		tests_get_crc32_suite },
+  { "listcache",	tests_get_listcache_suite },
 
   { NULL, NULL }
 };
@@ -82,6 +82,9 @@ Suite *tests_get_json_suite(void);
 Suite *tests_get_jot_suite(void);
 Suite *tests_get_redis_suite(void);
 Suite *tests_get_error_suite(void);
+Suite *tests_get_metrics_suite(void);
+Suite *tests_get_crc32_suite(void);
+Suite *tests_get_listcache_suite(void);
 
 /* Temporary hack/placement for this variable, until we get to testing
  * the Signals API.
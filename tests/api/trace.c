@@ -29,6 +29,8 @@
 static pool *p = NULL;
 
 static const char *trace_path = "/tmp/prt-trace.log";
+static const char *trace_buffer_dir = "/tmp/prt-trace.d";
+static const char *trace_buffer_path = "/tmp/prt-trace.d/trace";
 
 static void set_up(void) {
   if (p == NULL) {
@@ -36,11 +38,22 @@ static void set_up(void) {
   }
 
   init_inet();
+
+  (void) mkdir(trace_buffer_dir, 0755);
+  (void) chmod(trace_buffer_dir, 0755);
 }
 
 static void tear_down(void) {
+  char path[PR_TUNABLE_PATH_MAX];
+
   (void) unlink(trace_path);
 
+  (void) pr_trace_set_buffer(NULL, 0);
+  snprintf(path, sizeof(path)-1, "%s.%lu", trace_buffer_path,
+    (unsigned long) getpid());
+  (void) unlink(path);
+  (void) rmdir(trace_buffer_dir);
+
   pr_inet_clear();
   pr_trace_set_options(PR_TRACE_OPT_DEFAULT);
 
@@ -387,6 +400,149 @@ START_TEST (trace_set_file_test) {
 }
 END_TEST
 
+START_TEST (trace_set_buffer_test) {
+  int res;
+  const char *path;
+
+  res = pr_trace_set_buffer(NULL, 0);
+  fail_unless(res == 0, "Failed to reset trace buffer: %s", strerror(errno));
+
+  path = "prt-trace";
+  res = pr_trace_set_buffer(path, PR_TRACE_BUFFER_MIN_SIZE);
+  fail_unless(res < 0, "Failed to handle relative path '%s'", path);
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  path = trace_buffer_path;
+  res = pr_trace_set_buffer(path, 1024);
+  fail_unless(res < 0, "Failed to handle too-small size");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  path = "/tmp/prt-trace.d/nonexistent/trace";
+  res = pr_trace_set_buffer(path, PR_TRACE_BUFFER_MIN_SIZE);
+  fail_unless(res < 0, "Failed to handle nonexistent directory");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* /tmp is world-writable. */
+  path = "/tmp/prt-trace";
+  res = pr_trace_set_buffer(path, PR_TRACE_BUFFER_MIN_SIZE);
+  fail_unless(res < 0, "Failed to handle world-writable directory");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  path = trace_buffer_path;
+  res = pr_trace_set_buffer(path, PR_TRACE_BUFFER_MIN_SIZE);
+  fail_unless(res == 0, "Failed to set trace buffer '%s': %s", path,
+    strerror(errno));
+
+  res = pr_trace_set_buffer(NULL, 0);
+  fail_unless(res == 0, "Failed to reset trace buffer: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (trace_read_buffer_test) {
+  register unsigned int i;
+  int res;
+  unsigned int nrecords;
+  array_header *lines;
+  char *line, path[PR_TUNABLE_PATH_MAX], msg[1024];
+  struct stat st;
+
+  lines = pr_trace_read_buffer(NULL, 0, 0);
+  fail_unless(lines == NULL, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  lines = pr_trace_read_buffer(p, 0, 10);
+  fail_unless(lines == NULL, "Failed to handle unconfigured trace buffer");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = pr_trace_set_buffer(trace_buffer_path, PR_TRACE_BUFFER_MIN_SIZE);
+  fail_unless(res == 0, "Failed to set trace buffer: %s", strerror(errno));
+
+  /* The buffer alone suffices for enabling tracing. */
+  pr_trace_set_levels("foo", 1, 20);
+  res = pr_trace_get_level("foo");
+  fail_unless(res == 20, "Expected level 20, got %d", res);
+
+  pr_trace_msg("foo", 1, "bar?");
+  pr_trace_msg("foo", 21, "filtered");
+  pr_trace_msg("foo", 2, "%s\n", "baz!");
+
+  memset(msg, 'A', sizeof(msg)-1);
+  msg[sizeof(msg)-1] = '\0';
+  pr_trace_msg("foo", 3, "%s", msg);
+
+  lines = pr_trace_read_buffer(p, 0, 10);
+  fail_unless(lines != NULL, "Failed to read trace buffer: %s",
+    strerror(errno));
+  fail_unless(lines->nelts == 3, "Expected 3 records, got %u", lines->nelts);
+
+  line = ((char **) lines->elts)[0];
+  fail_unless(strstr(line, "<foo:1>: bar?") != NULL,
+    "Unexpected record '%s'", line);
+
+  line = ((char **) lines->elts)[1];
+  fail_unless(strstr(line, "<foo:2>: baz!") != NULL,
+    "Unexpected record '%s'", line);
+  fail_unless(line[strlen(line)-1] == '!', "Failed to trim trailing newline");
+
+  line = ((char **) lines->elts)[2];
+  fail_unless(strstr(line, "<foo:3>: AAAA") != NULL,
+    "Unexpected record '%s'", line);
+  fail_unless(strcmp(line + strlen(line) - 4, "A...") == 0,
+    "Failed to mark truncated message in '%s'", line);
+
+  lines = pr_trace_read_buffer(p, 0, 1);
+  fail_unless(lines != NULL, "Failed to read trace buffer: %s",
+    strerror(errno));
+  fail_unless(lines->nelts == 1, "Expected 1 record, got %u", lines->nelts);
+
+  /* Wrap around the ring; only the most recent records are kept. */
+  nrecords = (PR_TRACE_BUFFER_MIN_SIZE / PR_TRACE_BUFFER_RECORD_SIZE) - 1;
+  for (i = 0; i < nrecords + 10; i++) {
+    pr_trace_msg("foo", 4, "msg #%u", i);
+  }
+
+  lines = pr_trace_read_buffer(p, 0, nrecords * 2);
+  fail_unless(lines != NULL, "Failed to read trace buffer: %s",
+    strerror(errno));
+  fail_unless(lines->nelts == nrecords, "Expected %u records, got %u",
+    nrecords, lines->nelts);
+
+  line = ((char **) lines->elts)[0];
+  snprintf(msg, sizeof(msg)-1, "<foo:4>: msg #%u", 10);
+  fail_unless(strstr(line, msg) != NULL, "Unexpected record '%s'", line);
+
+  line = ((char **) lines->elts)[nrecords-1];
+  snprintf(msg, sizeof(msg)-1, "<foo:4>: msg #%u", nrecords + 9);
+  fail_unless(strstr(line, msg) != NULL, "Unexpected record '%s'", line);
+
+  /* The buffer of a session which has not ended cleanly is kept. */
+  snprintf(path, sizeof(path)-1, "%s.%lu", trace_buffer_path,
+    (unsigned long) getpid());
+
+  res = pr_trace_remove_buffer(getpid());
+  fail_unless(res == 0, "Failed to check trace buffer: %s", strerror(errno));
+  fail_unless(stat(path, &st) == 0, "Expected '%s' to be kept", path);
+
+  session.disconnect_reason = PR_SESS_DISCONNECT_CLIENT_QUIT;
+  pr_event_generate("core.exit", NULL);
+  session.disconnect_reason = 0;
+
+  res = pr_trace_remove_buffer(getpid());
+  fail_unless(res == 0, "Failed to remove trace buffer: %s", strerror(errno));
+  fail_unless(stat(path, &st) < 0, "Expected '%s' to be removed", path);
+
+  pr_trace_set_levels("foo", 0, 0);
+  res = pr_trace_set_buffer(NULL, 0);
+  fail_unless(res == 0, "Failed to reset trace buffer: %s", strerror(errno));
+}
+END_TEST
+
 START_TEST (trace_restart_test) {
   pr_trace_set_levels("testsuite", 1, 10);
   pr_event_generate("core.restart", NULL);
@@ -412,6 +568,8 @@ Suite *tests_get_trace_suite(void) {
   tcase_add_test(testcase, trace_parse_levels_test);
   tcase_add_test(testcase, trace_msg_test);
   tcase_add_test(testcase, trace_set_file_test);
+  tcase_add_test(testcase, trace_set_buffer_test);
+  tcase_add_test(testcase, trace_read_buffer_test);
   tcase_add_test(testcase, trace_restart_test);
 #endif /* PR_USE_TRACE */
 
@@ -0,0 +1,654 @@
+#!/usr/bin/env perl
+
+# Load generator for proftpd: starts an uninstalled proftpd, drives it with
+# concurrent clients, and reports latency percentiles, throughput, and the
+# CPU time used by the session processes.
+
+use strict;
+
+use Cwd qw(abs_path);
+use File::Path qw(rmtree);
+use File::Spec;
+use File::Temp qw(tempdir);
+use Getopt::Long;
+use POSIX ();
+use Time::HiRes qw(gettimeofday tv_interval);
+
+my $opts = {};
+Getopt::Long::Configure('no_ignore_case');
+GetOptions($opts, 'h|help', 'c|clients=i', 'i|iterations=i', 's|size=i',
+  'f|files=i', 'S|scenario=s@', 'K|keep-tmpfiles', 'V|verbose');
+
+if ($opts->{h}) {
+  usage();
+}
+
+my $nclients = $opts->{c} || 4;
+my $niters = $opts->{i} || 20;
+my $file_size = ($opts->{s} || 16) * 1024 * 1024;
+my $nfiles = $opts->{f} || 10000;
+
+my $all_scenarios = [qw(login list list_fb list_stream list_stream_fb retr
+  stor extlog extlog_buf ftps_retr sftp_retr kex_rsa kex_ecdsa kex_ed25519)];
+my $scenarios = $all_scenarios;
+if (defined($opts->{S})) {
+  $scenarios = [map { split(/,/, $_) } @{ $opts->{S} }];
+
+  foreach my $scenario (@$scenarios) {
+    unless (grep { $_ eq $scenario } @$all_scenarios) {
+      print STDERR "Unknown scenario '$scenario'\n";
+      usage();
+    }
+  }
+}
+
+if ($opts->{V}) {
+  $ENV{TEST_VERBOSE} = 1;
+}
+
+my $test_dir = (File::Spec->splitpath(abs_path(__FILE__)))[1];
+push(@INC, "$test_dir/t/lib");
+
+require ProFTPD::TestSuite::Utils;
+import ProFTPD::TestSuite::Utils qw(:auth :config :features :running :test);
+
+unless (defined($ENV{PROFTPD_TEST_BIN})) {
+  $ENV{PROFTPD_TEST_BIN} = File::Spec->catfile($test_dir, '..', 'proftpd');
+}
+
+$| = 1;
+
+chdir($test_dir);
+
+my $tmpdir = tempdir("proftpd-bench-$$-XXXXXXXXXX", TMPDIR => 1,
+  CLEANUP => 0);
+chmod(0755, $tmpdir);
+
+my $setup = bench_setup($tmpdir);
+
+printf("%-14s %8s %10s %10s %10s %10s %14s\n", 'scenario', 'ops',
+  'p50 ms', 'p99 ms', 'ops/sec', 'MB/sec', 'CPU secs/GB');
+
+foreach my $scenario (@$scenarios) {
+  my $res = run_scenario($setup, $scenario);
+  unless (defined($res)) {
+    next;
+  }
+
+  report($scenario, $res);
+}
+
+if ($opts->{K}) {
+  print STDERR "Keeping $tmpdir\n";
+
+} else {
+  rmtree($tmpdir);
+}
+
+exit 0;
+
+sub usage {
+  print STDOUT <<EOH;
+
+$0: [--help] [--clients N] [--iterations N] [--size MB] [--files N]
+  [--scenario name[,name...]] [--keep-tmpfiles] [--verbose]
+
+Options:
+
+  -c, --clients      Number of concurrent clients (default 4)
+  -i, --iterations   Operations per client, per scenario (default 20)
+  -s, --size         Size of the transferred file, in MB (default 16)
+  -f, --files        Number of files in the listed directory (default 10000)
+  -S, --scenario     Run only the given scenarios; may be repeated.  Known
+                     scenarios are:
+
+                       login       Connect, log in, and quit
+                       list        LIST a large directory
+                       list_fb     LIST a large directory, timing only the
+                                   first byte of the listing
+                       list_stream, list_stream_fb
+                                   As list and list_fb, with ListStreaming
+                       retr        Download the file over FTP
+                       stor        Upload the file over FTP
+                       extlog      Send 100 NOOP commands per iteration,
+                                   each written to 3 ExtendedLogs; ops are
+                                   commands
+                       extlog_buf  As extlog, with ExtendedLogBuffer
+                       ftps_retr   Download the file over FTPS (needs
+                                   mod_tls and Net::FTPSSL)
+                       sftp_retr   Download the file over SFTP (needs
+                                   mod_sftp and Net::SSH2)
+                       kex_rsa, kex_ecdsa, kex_ed25519
+                                   Perform an SSH2 key exchange, using an
+                                   RSA, ECDSA-256 or Ed25519 host key (needs
+                                   mod_sftp and OpenSSH's ssh-keyscan)
+
+  -K, --keep-tmpfiles  Keep the temporary directory, logs, and configs
+  -V, --verbose        Log the server startup/shutdown commands
+
+EOH
+  exit 0;
+}
+
+sub bench_setup {
+  my $tmpdir = shift;
+
+  my $uid = $< == 0 ? 500 : $<;
+  my $gid = $< == 0 ? 500 : (split(' ', $())[0];
+
+  my $setup = test_setup($tmpdir, 'bench', 'proftpd', 'test', 'ftpd', $uid,
+    $gid);
+
+  # Write the logs into the temporary directory, not the current directory.
+  $setup->{log_file} = File::Spec->rel2abs("$tmpdir/bench.log");
+
+  my $home_dir = $setup->{home_dir};
+
+  my $buf = '';
+  for (my $i = 0; $i < 65536; $i++) {
+    $buf .= chr(32 + ($i % 95));
+  }
+
+  my $data_file = File::Spec->rel2abs("$home_dir/bench.dat");
+  open(my $fh, "> $data_file") or die("Can't write $data_file: $!");
+  for (my $i = 0; $i < $file_size; $i += length($buf)) {
+    print $fh $buf;
+  }
+  close($fh);
+
+  my $list_dir = File::Spec->rel2abs("$home_dir/list.d");
+  mkdir($list_dir) or die("Can't create $list_dir: $!");
+  for (my $i = 0; $i < $nfiles; $i++) {
+    my $path = "$list_dir/file$i.txt";
+    open(my $fh, "> $path") or die("Can't write $path: $!");
+    close($fh);
+  }
+
+  my $upload_dir = File::Spec->rel2abs("$home_dir/upload.d");
+  mkdir($upload_dir) or die("Can't create $upload_dir: $!");
+
+  if ($< == 0) {
+    foreach my $path ($data_file, $list_dir, $upload_dir) {
+      chown($uid, $gid, $path);
+    }
+  }
+
+  foreach my $dir (File::Spec->path()) {
+    my $path = File::Spec->catfile($dir, 'ssh-keyscan');
+    if (-x $path) {
+      $setup->{keyscan} = $path;
+      last;
+    }
+  }
+
+  $setup->{buf} = $buf;
+  return $setup;
+}
+
+sub bench_config {
+  my $setup = shift;
+  my $proto = shift;
+  my $scenario = shift;
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    MaxInstances => $nclients * 4,
+    MaxClientsPerHost => 'none',
+
+    IfModules => {
+      # mod_delay deliberately slows down logins; we want to measure the
+      # server, not the delay.
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  if ($scenario =~ /^list_stream/) {
+    $config->{ListStreaming} = 'on';
+  }
+
+  if ($scenario =~ /^extlog/) {
+    # Note: we need to use arrays here, since order of directives matters.
+    my $log_config = [
+      'LogFormat bench "%h %l %u %t %r %s %b"',
+    ];
+
+    for (my $i = 1; $i <= 3; $i++) {
+      my $ext_log = File::Spec->rel2abs("$tmpdir/extlog$i.log");
+      push(@$log_config, "ExtendedLog $ext_log ALL bench");
+    }
+
+    if ($scenario eq 'extlog_buf') {
+      push(@$log_config, 'ExtendedLogBuffer 65536');
+    }
+
+    $config->{IfModules}->{'mod_log.c'} = $log_config;
+  }
+
+  if ($proto eq 'ftps') {
+    my $cert_file = File::Spec->rel2abs(
+      't/etc/modules/mod_tls/server-cert.pem');
+    my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
+
+    $config->{IfModules}->{'mod_tls.c'} = {
+      TLSEngine => 'on',
+      TLSLog => $setup->{log_file},
+      TLSRequired => 'on',
+      TLSRSACertificateFile => $cert_file,
+      TLSCACertificateFile => $ca_file,
+    };
+
+  } elsif ($proto eq 'sftp') {
+    # Configure only the host key being measured, so that it is the one
+    # used for every key exchange.
+    my $key_type = 'rsa';
+    if ($scenario eq 'kex_ecdsa') {
+      $key_type = 'ecdsa256';
+
+    } elsif ($scenario eq 'kex_ed25519') {
+      $key_type = 'ed25519';
+    }
+
+    my $host_key = File::Spec->rel2abs(
+      "t/etc/modules/mod_sftp/ssh_host_${key_type}_key");
+
+    # mod_sftp refuses to use group- or world-readable host keys.
+    unless (chmod(0400, $host_key)) {
+      die("Can't set perms on $host_key: $!");
+    }
+
+    $config->{IfModules}->{'mod_sftp.c'} = [
+      'SFTPEngine on',
+      "SFTPLog $setup->{log_file}",
+      "SFTPHostKey $host_key",
+    ];
+  }
+
+  my ($port) = config_write($setup->{config_file}, $config);
+  return $port;
+}
+
+# Returns the CPU time (in seconds) used by the reaped children of the
+# given process, i.e. by the daemon's finished session processes, or undef
+# if that is not available.
+sub children_cpu_secs {
+  my $pid = shift;
+
+  my $path = "/proc/$pid/stat";
+  open(my $fh, "< $path") or return undef;
+  my $stat = <$fh>;
+  close($fh);
+
+  # Skip past the command name, which may contain spaces.
+  $stat =~ s/^.*\)\s+//;
+  my @fields = split(' ', $stat);
+
+  # The cutime and cstime fields are the 16th and 17th fields; we removed
+  # the first two.
+  my $ticks = POSIX::sysconf(POSIX::_SC_CLK_TCK()) || 100;
+  return ($fields[13] + $fields[14]) / $ticks;
+}
+
+sub read_pid {
+  my $pid_file = shift;
+
+  open(my $fh, "< $pid_file") or die("Can't read $pid_file: $!");
+  my $pid = <$fh>;
+  chomp($pid);
+  close($fh);
+
+  return $pid;
+}
+
+sub run_scenario {
+  my $setup = shift;
+  my $scenario = shift;
+
+  my $proto;
+
+  if ($scenario eq 'ftps_retr') {
+    $proto = 'ftps';
+
+    unless (feature_have_module_compiled('mod_tls.c')) {
+      print STDERR "Skipping $scenario: mod_tls not compiled\n";
+      return undef;
+    }
+
+    eval { require Net::FTPSSL };
+    if ($@) {
+      print STDERR "Skipping $scenario: Net::FTPSSL not installed\n";
+      return undef;
+    }
+
+  } elsif ($scenario eq 'sftp_retr') {
+    $proto = 'sftp';
+
+    unless (feature_have_module_compiled('mod_sftp.c')) {
+      print STDERR "Skipping $scenario: mod_sftp not compiled\n";
+      return undef;
+    }
+
+    eval { require Net::SSH2 };
+    if ($@) {
+      print STDERR "Skipping $scenario: Net::SSH2 not installed\n";
+      return undef;
+    }
+
+  } elsif ($scenario =~ /^kex_/) {
+    $proto = 'sftp';
+
+    unless (feature_have_module_compiled('mod_sftp.c')) {
+      print STDERR "Skipping $scenario: mod_sftp not compiled\n";
+      return undef;
+    }
+
+    unless (defined($setup->{keyscan})) {
+      print STDERR "Skipping $scenario: ssh-keyscan not found\n";
+      return undef;
+    }
+
+  } else {
+    $proto = 'ftp';
+    require Net::FTP;
+  }
+
+  my $port = bench_config($setup, $proto, $scenario);
+  server_start($setup->{config_file}, $setup->{pid_file});
+
+  my $daemon_pid = read_pid($setup->{pid_file});
+  my $cpu_start = children_cpu_secs($daemon_pid);
+
+  my $start = [gettimeofday()];
+  my $children = {};
+
+  for (my $i = 0; $i < $nclients; $i++) {
+    my ($rfh, $wfh);
+    pipe($rfh, $wfh) or die("Can't open pipe: $!");
+
+    defined(my $pid = fork()) or die("Can't fork: $!");
+    if ($pid == 0) {
+      close($rfh);
+
+      my $latencies = eval {
+        client_run($setup, $scenario, $port, $i);
+      };
+      if ($@) {
+        print STDERR "$scenario client #$i failed: $@";
+        exit 1;
+      }
+
+      print $wfh join("\n", @$latencies), "\n";
+      close($wfh);
+      exit 0;
+    }
+
+    close($wfh);
+    $children->{$pid} = $rfh;
+  }
+
+  my $latencies = [];
+  my $failed = 0;
+
+  foreach my $pid (keys(%$children)) {
+    my $rfh = $children->{$pid};
+
+    while (my $line = <$rfh>) {
+      chomp($line);
+      push(@$latencies, $line) if length($line) > 0;
+    }
+    close($rfh);
+
+    waitpid($pid, 0);
+    $failed++ if $? != 0;
+  }
+
+  my $elapsed = tv_interval($start);
+
+  # Give the daemon a moment to reap the last of the session processes, so
+  # that their CPU time is accounted for.
+  select(undef, undef, undef, 1.0);
+  my $cpu_end = children_cpu_secs($daemon_pid);
+
+  server_stop($setup->{pid_file});
+
+  if ($failed) {
+    print STDERR "Skipping $scenario: $failed clients failed (see " .
+      "$setup->{log_file})\n";
+    return undef;
+  }
+
+  my $res = {
+    latencies => [sort { $a <=> $b } @$latencies],
+    elapsed => $elapsed,
+  };
+
+  if ($scenario =~ /retr|stor/) {
+    $res->{bytes} = scalar(@$latencies) * $file_size;
+  }
+
+  if (defined($cpu_start) &&
+      defined($cpu_end)) {
+    $res->{cpu_secs} = $cpu_end - $cpu_start;
+  }
+
+  return $res;
+}
+
+sub client_run {
+  my $setup = shift;
+  my $scenario = shift;
+  my $port = shift;
+  my $client_id = shift;
+
+  my $user = $setup->{user};
+  my $passwd = $setup->{passwd};
+  my $latencies = [];
+
+  if ($scenario eq 'login') {
+    for (my $i = 0; $i < $niters; $i++) {
+      my $start = [gettimeofday()];
+
+      my $client = Net::FTP->new('127.0.0.1', Port => $port) or
+        die("Can't connect: $@\n");
+      $client->login($user, $passwd) or
+        die("Can't login: " . $client->message());
+      $client->quit();
+
+      push(@$latencies, tv_interval($start));
+    }
+
+    return $latencies;
+  }
+
+  if ($scenario eq 'sftp_retr') {
+    my $ssh2 = Net::SSH2->new();
+    $ssh2->connect('127.0.0.1', $port) or die("Can't connect to SSH2 server");
+    $ssh2->auth_password($user, $passwd) or die("Can't login to SSH2 server");
+
+    my $sftp = $ssh2->sftp() or die("Can't use SFTP on SSH2 server");
+
+    for (my $i = 0; $i < $niters; $i++) {
+      my $start = [gettimeofday()];
+
+      my $fh = $sftp->open('bench.dat') or die("Can't open bench.dat");
+      my $buf;
+      while ($fh->read($buf, 32768)) {
+      }
+      $fh = undef;
+
+      push(@$latencies, tv_interval($start));
+    }
+
+    $sftp = undef;
+    $ssh2->disconnect();
+    return $latencies;
+  }
+
+  if ($scenario =~ /^kex_(.*)$/) {
+    # Each ssh-keyscan run is a connection, a key exchange, and the
+    # server's signature of the exchange hash using the host key.
+    my $key_type = $1;
+    my $host_key_algo = $key_type eq 'ecdsa' ? 'ecdsa-sha2-nistp256' :
+      $key_type eq 'ed25519' ? 'ssh-ed25519' : 'ssh-rsa';
+
+    for (my $i = 0; $i < $niters; $i++) {
+      my $start = [gettimeofday()];
+
+      my $output = `$setup->{keyscan} -t $key_type -p $port 127.0.0.1 2>/dev/null`;
+      unless ($output =~ /\Q$host_key_algo\E /) {
+        die("Can't get $host_key_algo host key using ssh-keyscan\n");
+      }
+
+      push(@$latencies, tv_interval($start));
+    }
+
+    return $latencies;
+  }
+
+  if ($scenario eq 'ftps_retr') {
+    my $client = Net::FTPSSL->new('127.0.0.1', Encryption => 'E',
+      Port => $port) or die("Can't connect to FTPS server: " .
+      IO::Socket::SSL::errstr());
+    $client->login($user, $passwd) or
+      die("Can't login: " . $client->last_message());
+    $client->binary();
+
+    for (my $i = 0; $i < $niters; $i++) {
+      my $start = [gettimeofday()];
+
+      open(my $fh, '> /dev/null') or die("Can't open /dev/null: $!");
+      $client->get('bench.dat', $fh) or
+        die("Can't download bench.dat: " . $client->last_message());
+      close($fh);
+
+      push(@$latencies, tv_interval($start));
+    }
+
+    $client->quit();
+    return $latencies;
+  }
+
+  my $client = Net::FTP->new('127.0.0.1', Port => $port) or
+    die("Can't connect: $@\n");
+  $client->login($user, $passwd) or
+    die("Can't login: " . $client->message());
+  $client->binary();
+
+  if ($scenario =~ /^extlog/) {
+    for (my $i = 0; $i < $niters * 100; $i++) {
+      my $start = [gettimeofday()];
+
+      $client->quot('NOOP') == 2 or
+        die("Can't send NOOP: " . $client->message());
+
+      push(@$latencies, tv_interval($start));
+    }
+
+    $client->quit();
+    return $latencies;
+  }
+
+  for (my $i = 0; $i < $niters; $i++) {
+    my $start = [gettimeofday()];
+
+    if ($scenario eq 'list' ||
+        $scenario eq 'list_stream') {
+      my $list = $client->dir('list.d') or
+        die("Can't list list.d: " . $client->message());
+
+    } elsif ($scenario =~ /^list.*_fb$/) {
+      # Time-to-first-byte: how long the client waits before the listing
+      # starts arriving.
+      my $conn = $client->list('list.d') or
+        die("Can't list list.d: " . $client->message());
+
+      my $buf;
+      $conn->read($buf, 1, 30) or
+        die("Can't read listing of list.d");
+      push(@$latencies, tv_interval($start));
+
+      while ($conn->read($buf, 65536, 30)) {
+      }
+      $conn->close();
+
+      next;
+
+    } elsif ($scenario eq 'retr') {
+      my $conn = $client->retr('bench.dat') or
+        die("Can't download bench.dat: " . $client->message());
+
+      my $buf;
+      while ($conn->read($buf, 65536, 30)) {
+      }
+      $conn->close();
+
+    } elsif ($scenario eq 'stor') {
+      my $path = "upload.d/bench-$client_id-$i.dat";
+      my $conn = $client->stor($path) or
+        die("Can't upload $path: " . $client->message());
+
+      my $buf = $setup->{buf};
+      for (my $j = 0; $j < $file_size; $j += length($buf)) {
+        $conn->write($buf, length($buf), 30);
+      }
+      $conn->close();
+
+      $client->delete($path);
+    }
+
+    push(@$latencies, tv_interval($start));
+  }
+
+  $client->quit();
+  return $latencies;
+}
+
+sub percentile {
+  my $sorted = shift;
+  my $pct = shift;
+
+  my $idx = int((scalar(@$sorted) * $pct) / 100);
+  $idx = scalar(@$sorted) - 1 if $idx >= scalar(@$sorted);
+
+  return $sorted->[$idx];
+}
+
+sub report {
+  my $scenario = shift;
+  my $res = shift;
+
+  my $latencies = $res->{latencies};
+  my $nops = scalar(@$latencies);
+
+  my $mb_per_sec = 'n/a';
+  my $cpu_per_gb = 'n/a';
+
+  if (defined($res->{bytes})) {
+    $mb_per_sec = sprintf('%.1f',
+      ($res->{bytes} / (1024 * 1024)) / $res->{elapsed});
+
+    if (defined($res->{cpu_secs})) {
+      $cpu_per_gb = sprintf('%.2f',
+        $res->{cpu_secs} / ($res->{bytes} / (1024 * 1024 * 1024)));
+    }
+  }
+
+  printf("%-14s %8d %10.2f %10.2f %10.1f %10s %14s\n", $scenario, $nops,
+    percentile($latencies, 50) * 1000, percentile($latencies, 99) * 1000,
+    $nops / $res->{elapsed}, $mb_per_sec, $cpu_per_gb);
+
+  if (defined($res->{cpu_secs}) &&
+      !defined($res->{bytes}) &&
+      $nops > 0) {
+    printf("%-14s %8s CPU msecs/op: %.3f\n", '', '',
+      ($res->{cpu_secs} * 1000) / $nops);
+  }
+}
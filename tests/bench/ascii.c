@@ -0,0 +1,131 @@
+/*
+ * ProFTPD - FTP server API benchmarks
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* ASCII translation benchmarks */
+
+#include "bench.h"
+
+/* The size of a typical data transfer buffer. */
+#define BENCH_ASCII_BUFSZ	(64 * 1024)
+
+struct bench_ascii_data {
+  pool *pool;
+  char *text;
+  size_t textlen;
+  char *crlf_text;
+  size_t crlf_textlen;
+};
+
+static void bench_ascii_from_crlf(unsigned long iters, void *data) {
+  struct bench_ascii_data *bad = data;
+  register unsigned long i;
+  char *buf;
+
+  /* The translation is done in place, as data.c does, so work on a copy. */
+  buf = palloc(bad->pool, bad->crlf_textlen);
+
+  for (i = 0; i < iters; i++) {
+    char *out = buf;
+    size_t outlen = 0;
+
+    memcpy(buf, bad->crlf_text, bad->crlf_textlen);
+    pr_ascii_ftp_reset();
+    (void) pr_ascii_ftp_from_crlf(bad->pool, buf, bad->crlf_textlen, &out,
+      &outlen);
+    bench_use(out);
+  }
+}
+
+static void bench_ascii_to_crlf(unsigned long iters, void *data) {
+  struct bench_ascii_data *bad = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    char *out = NULL;
+    size_t outlen = 0;
+
+    pr_ascii_ftp_reset();
+    (void) pr_ascii_ftp_to_crlf(bad->pool, bad->text, bad->textlen, &out,
+      &outlen);
+    bench_use(out);
+  }
+}
+
+static void bench_ascii_to_crlf_noop(unsigned long iters, void *data) {
+  struct bench_ascii_data *bad = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    char *out = NULL;
+    size_t outlen = 0;
+
+    pr_ascii_ftp_reset();
+    (void) pr_ascii_ftp_to_crlf(bad->pool, bad->crlf_text, bad->crlf_textlen,
+      &out, &outlen);
+    bench_use(out);
+  }
+}
+
+int bench_ascii(pool *p) {
+  struct bench_ascii_data *bad;
+  register size_t i, j;
+
+  bad = pcalloc(p, sizeof(struct bench_ascii_data));
+  bad->pool = p;
+
+  /* Lines of printable text, averaging ~60 characters, as for source code
+   * or log files.
+   */
+  bad->text = palloc(p, BENCH_ASCII_BUFSZ);
+  bad->crlf_text = palloc(p, BENCH_ASCII_BUFSZ);
+
+  for (i = 0, j = 0; i < BENCH_ASCII_BUFSZ; i++) {
+    char ch;
+
+    ch = 'a' + (i % 26);
+    if (i % 61 == 60) {
+      ch = '\n';
+    }
+
+    bad->text[i] = ch;
+
+    if (j < BENCH_ASCII_BUFSZ - 1) {
+      if (ch == '\n') {
+        bad->crlf_text[j++] = '\r';
+      }
+
+      bad->crlf_text[j++] = ch;
+    }
+  }
+
+  bad->textlen = BENCH_ASCII_BUFSZ;
+  bad->crlf_textlen = j;
+
+  bench_run("ascii_ftp_from_crlf (64KB)", 5000, bench_ascii_from_crlf, bad);
+  bench_run("ascii_ftp_to_crlf (64KB)", 5000, bench_ascii_to_crlf, bad);
+  bench_run("ascii_ftp_to_crlf (64KB, CRLF)", 5000,
+    bench_ascii_to_crlf_noop, bad);
+
+  return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * ProFTPD - FTP server API benchmarks
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+#include "bench.h"
+
+/* Each benchmark is run this many times; the fastest and the median runs
+ * are reported.  The fastest run is the least disturbed by other activity
+ * on the machine, and is thus the most useful for comparing builds.
+ */
+#define BENCH_DEFAULT_RUNS		5
+#define BENCH_MAX_RUNS			101
+
+struct benchsuite_info {
+  const char *name;
+  int (*run)(pool *);
+};
+
+static struct benchsuite_info suites[] = {
+  { "pool",		bench_pool },
+  { "table",		bench_table },
+  { "config",		bench_config },
+  { "dirtree",		bench_dirtree },
+  { "ascii",		bench_ascii },
+  { "jot",		bench_jot },
+  { "crc32",		bench_crc32 },
+  { "copy",		bench_copy },
+
+  { NULL, NULL }
+};
+
+static const char *bench_suite = NULL;
+static double bench_scale = 1.0;
+static unsigned int bench_runs = BENCH_DEFAULT_RUNS;
+
+static volatile const void *bench_sink = NULL;
+
+void bench_use(const void *ptr) {
+  bench_sink = ptr;
+}
+
+static uint64_t bench_now_nsecs(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return ((uint64_t) tv.tv_sec * 1000000000ULL) +
+    ((uint64_t) tv.tv_usec * 1000ULL);
+}
+
+static int bench_cmp_nsecs(const void *a, const void *b) {
+  uint64_t x = *((const uint64_t *) a), y = *((const uint64_t *) b);
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+void bench_run(const char *name, unsigned long iters, bench_func_t func,
+    void *data) {
+  register unsigned int i;
+  uint64_t elapsed[BENCH_MAX_RUNS];
+  double min_ns, median_ns;
+
+  iters = (unsigned long) (iters * bench_scale);
+  if (iters == 0) {
+    iters = 1;
+  }
+
+  /* Warm up caches, and any lazily allocated state. */
+  func(iters / 10 + 1, data);
+
+  for (i = 0; i < bench_runs; i++) {
+    uint64_t start;
+
+    pr_signals_handle();
+
+    start = bench_now_nsecs();
+    func(iters, data);
+    elapsed[i] = bench_now_nsecs() - start;
+  }
+
+  qsort(elapsed, bench_runs, sizeof(uint64_t), bench_cmp_nsecs);
+
+  min_ns = (double) elapsed[0] / iters;
+  median_ns = (double) elapsed[bench_runs / 2] / iters;
+
+  fprintf(stdout, "%-8s %-36s %10lu %12.1f %12.1f %14.0f\n", bench_suite,
+    name, iters, min_ns, median_ns, min_ns > 0.0 ? 1000000000.0 / min_ns : 0.0);
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+  register unsigned int i;
+  const char *requested;
+  int nfailed = 0, found = FALSE;
+
+  requested = getenv("PR_BENCH_SCALE");
+  if (requested != NULL) {
+    bench_scale = atof(requested);
+    if (bench_scale <= 0.0) {
+      fprintf(stderr, "Invalid PR_BENCH_SCALE '%s'\n", requested);
+      return EXIT_FAILURE;
+    }
+  }
+
+  requested = getenv("PR_BENCH_RUNS");
+  if (requested != NULL) {
+    bench_runs = (unsigned int) atoi(requested);
+    if (bench_runs == 0 ||
+        bench_runs > BENCH_MAX_RUNS) {
+      fprintf(stderr, "Invalid PR_BENCH_RUNS '%s' (must be 1-%u)\n",
+        requested, BENCH_MAX_RUNS);
+      return EXIT_FAILURE;
+    }
+  }
+
+  requested = getenv("PR_BENCH_SUITE");
+
+  /* The permanent pool outlives all of the suites, as the Configuration and
+   * Dirtree APIs keep state allocated from it across re-initializations.
+   */
+  permanent_pool = make_sub_pool(NULL);
+
+  fprintf(stdout, "%-8s %-36s %10s %12s %12s %14s\n", "suite", "benchmark",
+    "iters", "min ns/op", "median ns/op", "ops/sec");
+
+  for (i = 0; suites[i].name != NULL; i++) {
+    pool *p;
+
+    if (requested != NULL &&
+        strcmp(requested, suites[i].name) != 0) {
+      continue;
+    }
+
+    found = TRUE;
+    bench_suite = suites[i].name;
+
+    p = make_sub_pool(permanent_pool);
+    if ((suites[i].run)(p) < 0) {
+      fprintf(stderr, "Benchmark suite '%s' failed: %s\n", suites[i].name,
+        strerror(errno));
+      nfailed++;
+    }
+
+    destroy_pool(p);
+  }
+
+  if (found == FALSE) {
+    fprintf(stderr, "No such benchmark suite ('%s') requested via "
+      "PR_BENCH_SUITE\n", requested);
+    return EXIT_FAILURE;
+  }
+
+  return nfailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
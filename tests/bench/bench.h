@@ -0,0 +1,63 @@
+/*
+ * ProFTPD - FTP server API benchmarks
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Benchmark management */
+
+#ifndef PR_BENCH_H
+#define PR_BENCH_H
+
+#include "conf.h"
+#include "privs.h"
+
+/* A benchmark function performs `iters` iterations of the operation being
+ * measured.  Any setup which should not be measured is done by the suite,
+ * before calling bench_run(), and passed via `data`.
+ */
+typedef void (*bench_func_t)(unsigned long iters, void *data);
+
+/* Runs the given benchmark function, repeatedly, and reports the fastest
+ * and median time per iteration.  The given iteration count is scaled by
+ * the PR_BENCH_SCALE environment variable, if set.
+ */
+void bench_run(const char *name, unsigned long iters, bench_func_t func,
+  void *data);
+
+/* Keeps the compiler from optimizing away otherwise unused results. */
+void bench_use(const void *ptr);
+
+int bench_pool(pool *p);
+int bench_table(pool *p);
+int bench_config(pool *p);
+int bench_dirtree(pool *p);
+int bench_ascii(pool *p);
+int bench_jot(pool *p);
+int bench_crc32(pool *p);
+int bench_copy(pool *p);
+
+/* Defined in stubs.c, as it is normally provided by src/main.c. */
+extern unsigned int recvd_signal_flags;
+
+extern server_rec *main_server;
+
+#endif /* PR_BENCH_H */
@@ -0,0 +1,149 @@
+/*
+ * ProFTPD - FTP server API benchmarks
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Configuration API benchmarks */
+
+#include "bench.h"
+
+/* Roughly the size of a sizeable real-world configuration. */
+#define BENCH_CONFIG_NPARAMS		200
+#define BENCH_CONFIG_NDIRS		50
+#define BENCH_CONFIG_NDIR_PARAMS	5
+
+static void bench_config_find_first(unsigned long iters, void *data) {
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    bench_use(find_config(main_server->conf, CONF_PARAM, "BenchParam0",
+      FALSE));
+  }
+}
+
+static void bench_config_find_last(unsigned long iters, void *data) {
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    bench_use(find_config(main_server->conf, CONF_PARAM, "BenchParam199",
+      FALSE));
+  }
+}
+
+static void bench_config_find_missing(unsigned long iters, void *data) {
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    bench_use(find_config(main_server->conf, CONF_PARAM, "BenchMissing",
+      FALSE));
+  }
+}
+
+static void bench_config_find_recurse(unsigned long iters, void *data) {
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    bench_use(find_config(main_server->conf, CONF_PARAM, "BenchDirParam4",
+      TRUE));
+  }
+}
+
+static void bench_config_find_next(unsigned long iters, void *data) {
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    config_rec *c;
+
+    c = find_config(main_server->conf, CONF_PARAM, "BenchMulti", FALSE);
+    while (c != NULL) {
+      bench_use(c);
+      c = find_config_next(c, c->next, CONF_PARAM, "BenchMulti", FALSE);
+    }
+  }
+}
+
+static void bench_config_get_param_ptr(unsigned long iters, void *data) {
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    bench_use(get_param_ptr(main_server->conf, "BenchParam100", FALSE));
+  }
+}
+
+int bench_config(pool *p) {
+  register unsigned int i;
+
+  init_config();
+  init_dirtree();
+
+  for (i = 0; i < BENCH_CONFIG_NPARAMS; i++) {
+    char name[64];
+
+    snprintf(name, sizeof(name)-1, "BenchParam%u", i);
+    (void) add_config_param_set(&(main_server->conf), name, 1, "value");
+
+    /* Interleave a multi-valued directive, as e.g. DNSBLDomain. */
+    if (i % 20 == 0) {
+      (void) add_config_param_set(&(main_server->conf), "BenchMulti", 1,
+        "value");
+    }
+  }
+
+  for (i = 0; i < BENCH_CONFIG_NDIRS; i++) {
+    config_rec *c;
+    char name[64];
+    register unsigned int j;
+
+    snprintf(name, sizeof(name)-1, "/bench/dir%u", i);
+    c = pr_config_add_set(&(main_server->conf), name, 0);
+    c->config_type = CONF_DIR;
+
+    for (j = 0; j < BENCH_CONFIG_NDIR_PARAMS; j++) {
+      config_rec *c2;
+
+      snprintf(name, sizeof(name)-1, "BenchDirParam%u", j);
+
+      /* Only the last <Directory> has the parameter being searched for. */
+      if (j == BENCH_CONFIG_NDIR_PARAMS - 1 &&
+          i != BENCH_CONFIG_NDIRS - 1) {
+        snprintf(name, sizeof(name)-1, "BenchDirOther%u", j);
+      }
+
+      c2 = add_config_param_set(&(c->subset), name, 1, "value");
+      c2->parent = c;
+    }
+  }
+
+  bench_run("find_config (first of 200)", 2000000, bench_config_find_first,
+    NULL);
+  bench_run("find_config (last of 200)", 2000000, bench_config_find_last,
+    NULL);
+  bench_run("find_config (missing)", 2000000, bench_config_find_missing,
+    NULL);
+  bench_run("find_config (recurse, 50 dirs)", 100000,
+    bench_config_find_recurse, NULL);
+  bench_run("find_config+find_config_next (10)", 500000,
+    bench_config_find_next, NULL);
+  bench_run("get_param_ptr", 2000000, bench_config_get_param_ptr, NULL);
+
+  return 0;
+}
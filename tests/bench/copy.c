@@ -0,0 +1,112 @@
+/*
+ * ProFTPD - FTP server API benchmarks
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* File copy benchmarks */
+
+#include "bench.h"
+
+/* The size of the file copied.  Set the PR_BENCH_COPY_DIR environment
+ * variable to copy within a different filesystem, e.g. a tmpfs, ext4 or
+ * xfs mount (a loopback image will do), as the kernel-side copy methods
+ * available differ by filesystem.
+ */
+#define BENCH_COPY_FILESZ	(64 * 1024 * 1024)
+
+struct bench_copy_data {
+  const char *src_path;
+  const char *dst_path;
+  int flags;
+};
+
+static void bench_copy_file(unsigned long iters, void *data) {
+  struct bench_copy_data *bcd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    if (pr_fs_copy_file2(bcd->src_path, bcd->dst_path, bcd->flags,
+        NULL) < 0) {
+      fprintf(stderr, "Error copying '%s' to '%s': %s\n", bcd->src_path,
+        bcd->dst_path, strerror(errno));
+      return;
+    }
+  }
+}
+
+int bench_copy(pool *p) {
+  struct bench_copy_data *bcd;
+  const char *dir;
+  char *buf;
+  size_t bufsz;
+  off_t written = 0;
+  pr_fh_t *fh;
+
+  init_fs();
+
+  dir = getenv("PR_BENCH_COPY_DIR");
+  if (dir == NULL) {
+    dir = "/tmp";
+  }
+
+  bcd = pcalloc(p, sizeof(struct bench_copy_data));
+  bcd->src_path = pdircat(p, dir, "prb-copy-src.dat", NULL);
+  bcd->dst_path = pdircat(p, dir, "prb-copy-dst.dat", NULL);
+
+  fh = pr_fsio_open(bcd->src_path, O_CREAT|O_TRUNC|O_WRONLY);
+  if (fh == NULL) {
+    fprintf(stderr, "Error opening '%s': %s\n", bcd->src_path,
+      strerror(errno));
+    return -1;
+  }
+
+  bufsz = 1024 * 1024;
+  buf = palloc(p, bufsz);
+  memset(buf, 'A', bufsz);
+
+  while (written < BENCH_COPY_FILESZ) {
+    int res;
+
+    res = pr_fsio_write(fh, buf, bufsz);
+    if (res < 0) {
+      fprintf(stderr, "Error writing '%s': %s\n", bcd->src_path,
+        strerror(errno));
+      (void) pr_fsio_close(fh);
+      (void) pr_fsio_unlink(bcd->src_path);
+      return -1;
+    }
+
+    written += res;
+  }
+
+  (void) pr_fsio_close(fh);
+
+  bcd->flags = PR_FSIO_COPY_FILE_FL_NO_OFFLOAD;
+  bench_run("copy read/write (64MB)", 5, bench_copy_file, bcd);
+
+  bcd->flags = 0;
+  bench_run("copy offload (64MB)", 5, bench_copy_file, bcd);
+
+  (void) pr_fsio_unlink(bcd->src_path);
+  (void) pr_fsio_unlink(bcd->dst_path);
+  return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * ProFTPD - FTP server API benchmarks
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* CRC32 benchmarks */
+
+#include "bench.h"
+
+/* The size of a typical data transfer buffer. */
+#define BENCH_CRC32_BUFSZ	(64 * 1024)
+
+struct bench_crc32_data {
+  unsigned char *buf;
+  size_t bufsz;
+  uint32_t table[256];
+};
+
+/* The byte-at-a-time implementation previously used by mod_digest, for
+ * comparison.
+ */
+static void bench_crc32_bytewise(unsigned long iters, void *data) {
+  struct bench_crc32_data *bcd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    register size_t j;
+    uint32_t crc = 0xffffffff;
+
+    for (j = 0; j < bcd->bufsz; j++) {
+      crc = bcd->table[(crc ^ bcd->buf[j]) & 0xff] ^ (crc >> 8);
+    }
+
+    bench_use(&crc);
+  }
+}
+
+static void bench_crc32_update(unsigned long iters, void *data) {
+  struct bench_crc32_data *bcd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    uint32_t crc;
+
+    crc = pr_crc32(0, bcd->buf, bcd->bufsz);
+    bench_use(&crc);
+  }
+}
+
+int bench_crc32(pool *p) {
+  struct bench_crc32_data *bcd;
+  register unsigned int i;
+  int engine;
+
+  bcd = pcalloc(p, sizeof(struct bench_crc32_data));
+  bcd->bufsz = BENCH_CRC32_BUFSZ;
+  bcd->buf = palloc(p, bcd->bufsz);
+
+  for (i = 0; i < bcd->bufsz; i++) {
+    bcd->buf[i] = (unsigned char) (i * 31);
+  }
+
+  for (i = 0; i < 256; i++) {
+    register unsigned int j;
+    uint32_t crc;
+
+    crc = i;
+    for (j = 8; j > 0; j--) {
+      if (crc & 1) {
+        crc = (crc >> 1) ^ 0xedb88320;
+
+      } else {
+        crc >>= 1;
+      }
+    }
+
+    bcd->table[i] = crc;
+  }
+
+  engine = pr_crc32_get_engine();
+
+  bench_run("crc32 bytewise (64KB)", 500, bench_crc32_bytewise, bcd);
+
+  if (pr_crc32_set_engine(PR_CRC32_ENGINE_SLICE8) == 0) {
+    bench_run("crc32 slice-by-8 (64KB)", 2000, bench_crc32_update, bcd);
+  }
+
+  if (pr_crc32_set_engine(PR_CRC32_ENGINE_PCLMUL) == 0) {
+    bench_run("crc32 pclmul (64KB)", 20000, bench_crc32_update, bcd);
+  }
+
+  (void) pr_crc32_set_engine(engine);
+  return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * ProFTPD - FTP server API benchmarks
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Directory tree (dir_check) benchmarks */
+
+#include "bench.h"
+
+#define BENCH_DIRTREE_NDIRS	100
+
+struct bench_dirtree_data {
+  pool *pool;
+  cmd_rec *cmd;
+  const char *path;
+};
+
+/* The first check of a path, e.g. after a CWD, finds the matching
+ * <Directory> section anew.
+ */
+static void bench_dirtree_check_full(unsigned long iters, void *data) {
+  struct bench_dirtree_data *bdd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    session.dir_config = NULL;
+    bench_use((void *) (long) dir_check_full(bdd->pool, bdd->cmd, G_READ,
+      bdd->path, NULL));
+  }
+}
+
+/* Subsequent checks use the cached session.dir_config. */
+static void bench_dirtree_check(unsigned long iters, void *data) {
+  struct bench_dirtree_data *bdd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    bench_use((void *) (long) dir_check(bdd->pool, bdd->cmd, G_READ,
+      bdd->path, NULL));
+  }
+}
+
+static void bench_dirtree_match_path(unsigned long iters, void *data) {
+  struct bench_dirtree_data *bdd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    pool *tmp_pool;
+
+    tmp_pool = make_sub_pool(bdd->pool);
+    bench_use(dir_match_path(tmp_pool, (char *) bdd->path));
+    destroy_pool(tmp_pool);
+  }
+}
+
+int bench_dirtree(pool *p) {
+  struct bench_dirtree_data *bdd;
+  config_rec *c;
+  register unsigned int i;
+
+  init_config();
+  init_dirtree();
+
+  memset(&session, 0, sizeof(session));
+  session.pool = p;
+
+  /* Avoid looking for .ftpaccess files; this benchmarks the matching of
+   * the configuration, not the filesystem.
+   */
+  c = add_config_param_set(&(main_server->conf), "AllowOverride", 2, NULL,
+    NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = FALSE;
+  c->argv[1] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = 1;
+
+  for (i = 0; i < BENCH_DIRTREE_NDIRS; i++) {
+    char name[64];
+
+    snprintf(name, sizeof(name)-1, "/bench/dir%u", i);
+    c = pr_config_add_set(&(main_server->conf), name, 0);
+    c->config_type = CONF_DIR;
+    c->argc = 2;
+    c->argv = pcalloc(c->pool, 3 * sizeof(void *));
+
+    c = add_config_param_set(&(c->subset), "Umask", 1, NULL);
+    c->argv[0] = pcalloc(c->pool, sizeof(mode_t));
+    *((mode_t *) c->argv[0]) = 0022;
+  }
+
+  bdd = pcalloc(p, sizeof(struct bench_dirtree_data));
+  bdd->pool = p;
+  bdd->cmd = pr_cmd_alloc(p, 2, pstrdup(p, C_RETR), pstrdup(p, "file.txt"));
+  bdd->cmd->arg = pstrdup(p, "file.txt");
+
+  /* Matches the last of the <Directory> sections. */
+  bdd->path = pstrdup(p, "/bench/dir99/sub/file.txt");
+
+  bench_run("dir_match_path (100 dirs)", 50000, bench_dirtree_match_path,
+    bdd);
+  bench_run("dir_check_full (100 dirs)", 20000, bench_dirtree_check_full,
+    bdd);
+
+  session.dir_config = dir_match_path(p, (char *) bdd->path);
+  bench_run("dir_check (matching dir_config)", 50000, bench_dirtree_check,
+    bdd);
+
+  return 0;
+}
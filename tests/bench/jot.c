@@ -0,0 +1,167 @@
+/*
+ * ProFTPD - FTP server API benchmarks
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Jot (LogFormat) benchmarks */
+
+#include "bench.h"
+#include "jot.h"
+
+/* A typical TransferLog-like ExtendedLog format. */
+#define BENCH_JOT_LOGFMT \
+  "%h %l %u %t \"%r\" %s %b %{protocol} %m %f %T"
+
+struct bench_jot_data {
+  pool *pool;
+  cmd_rec *cmd;
+  unsigned char *logfmt;
+  pr_jot_logfmt_t *compiled;
+  pr_jot_ctx_t *jot_ctx;
+};
+
+static int bench_jot_on_meta(pool *p, pr_jot_ctx_t *jot_ctx,
+    unsigned char logfmt_id, const char *key, const void *val) {
+  bench_use(val);
+  return 0;
+}
+
+static int bench_jot_on_default(pool *p, pr_jot_ctx_t *jot_ctx,
+    unsigned char logfmt_id) {
+  return 0;
+}
+
+static int bench_jot_on_other(pool *p, pr_jot_ctx_t *jot_ctx,
+    unsigned char *text, size_t text_len) {
+  bench_use(text);
+  return 0;
+}
+
+static void bench_jot_parse(unsigned long iters, void *data) {
+  struct bench_jot_data *bjd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    pool *tmp_pool;
+    pr_jot_ctx_t *jot_ctx;
+    pr_jot_parsed_t *jot_parsed;
+    unsigned char buf[1024];
+
+    tmp_pool = make_sub_pool(bjd->pool);
+    jot_ctx = pcalloc(tmp_pool, sizeof(pr_jot_ctx_t));
+    jot_parsed = pcalloc(tmp_pool, sizeof(pr_jot_parsed_t));
+    jot_parsed->bufsz = jot_parsed->buflen = sizeof(buf);
+    jot_parsed->ptr = jot_parsed->buf = buf;
+    jot_ctx->log = jot_parsed;
+
+    (void) pr_jot_parse_logfmt(tmp_pool, BENCH_JOT_LOGFMT, jot_ctx,
+      pr_jot_parse_on_meta, pr_jot_parse_on_unknown, pr_jot_parse_on_other, 0);
+    bench_use(buf);
+    destroy_pool(tmp_pool);
+  }
+}
+
+static void bench_jot_resolve(unsigned long iters, void *data) {
+  struct bench_jot_data *bjd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    pool *tmp_pool;
+
+    tmp_pool = make_sub_pool(bjd->pool);
+    (void) pr_jot_resolve_logfmt(tmp_pool, bjd->cmd, NULL, bjd->logfmt,
+      bjd->jot_ctx, bench_jot_on_meta, bench_jot_on_default,
+      bench_jot_on_other);
+    destroy_pool(tmp_pool);
+  }
+}
+
+static void bench_jot_resolve_compiled(unsigned long iters, void *data) {
+  struct bench_jot_data *bjd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    pool *tmp_pool;
+
+    tmp_pool = make_sub_pool(bjd->pool);
+    (void) pr_jot_resolve_compiled_logfmt(tmp_pool, bjd->cmd, NULL,
+      bjd->compiled, bjd->jot_ctx, bench_jot_on_meta, bench_jot_on_default,
+      bench_jot_on_other);
+    destroy_pool(tmp_pool);
+  }
+}
+
+int bench_jot(pool *p) {
+  struct bench_jot_data *bjd;
+  pr_jot_parsed_t *jot_parsed;
+  size_t logfmt_len;
+  int res;
+
+  init_config();
+  init_dirtree();
+
+  memset(&session, 0, sizeof(session));
+  session.pool = p;
+  session.user = pstrdup(p, "bench");
+
+  bjd = pcalloc(p, sizeof(struct bench_jot_data));
+  bjd->pool = p;
+  bjd->cmd = pr_cmd_alloc(p, 2, pstrdup(p, C_RETR), pstrdup(p, "file.txt"));
+  bjd->cmd->arg = pstrdup(p, "file.txt");
+  bjd->jot_ctx = pcalloc(p, sizeof(pr_jot_ctx_t));
+
+  jot_parsed = pcalloc(p, sizeof(pr_jot_parsed_t));
+  jot_parsed->bufsz = jot_parsed->buflen = 1024;
+  jot_parsed->ptr = jot_parsed->buf = pcalloc(p, jot_parsed->bufsz);
+  bjd->jot_ctx->log = jot_parsed;
+
+  res = pr_jot_parse_logfmt(p, BENCH_JOT_LOGFMT, bjd->jot_ctx,
+    pr_jot_parse_on_meta, pr_jot_parse_on_unknown, pr_jot_parse_on_other, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  logfmt_len = jot_parsed->bufsz - jot_parsed->buflen;
+  bjd->logfmt = pcalloc(p, logfmt_len + 1);
+  memcpy(bjd->logfmt, jot_parsed->ptr, logfmt_len);
+
+  bjd->compiled = pr_jot_compile_logfmt(p, bjd->logfmt);
+  if (bjd->compiled == NULL) {
+    return -1;
+  }
+
+  bjd->jot_ctx->log = NULL;
+
+  /* Make sure that we measure the resolving, not an error path. */
+  res = pr_jot_resolve_compiled_logfmt(p, bjd->cmd, NULL, bjd->compiled,
+    bjd->jot_ctx, bench_jot_on_meta, bench_jot_on_default, bench_jot_on_other);
+  if (res < 0) {
+    return -1;
+  }
+
+  bench_run("jot_parse_logfmt", 200000, bench_jot_parse, bjd);
+  bench_run("jot_resolve_logfmt", 200000, bench_jot_resolve, bjd);
+  bench_run("jot_resolve_compiled_logfmt", 200000,
+    bench_jot_resolve_compiled, bjd);
+
+  return 0;
+}
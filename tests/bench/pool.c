@@ -0,0 +1,123 @@
+/*
+ * ProFTPD - FTP server API benchmarks
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Pool API benchmarks */
+
+#include "bench.h"
+
+static void bench_pool_subpool(unsigned long iters, void *data) {
+  pool *p = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    pool *sub_pool;
+
+    sub_pool = make_sub_pool(p);
+    bench_use(palloc(sub_pool, 64));
+    destroy_pool(sub_pool);
+  }
+}
+
+static void bench_pool_palloc_small(unsigned long iters, void *data) {
+  pool *p = data, *sub_pool;
+  register unsigned long i;
+
+  sub_pool = make_sub_pool(p);
+
+  for (i = 0; i < iters; i++) {
+    bench_use(palloc(sub_pool, 32));
+
+    /* Keep the pool from growing without bound. */
+    if ((i & 1023) == 1023) {
+      destroy_pool(sub_pool);
+      sub_pool = make_sub_pool(p);
+    }
+  }
+
+  destroy_pool(sub_pool);
+}
+
+static void bench_pool_pcalloc_block(unsigned long iters, void *data) {
+  pool *p = data, *sub_pool;
+  register unsigned long i;
+
+  sub_pool = make_sub_pool(p);
+
+  for (i = 0; i < iters; i++) {
+    bench_use(pcalloc(sub_pool, 8192));
+
+    if ((i & 63) == 63) {
+      destroy_pool(sub_pool);
+      sub_pool = make_sub_pool(p);
+    }
+  }
+
+  destroy_pool(sub_pool);
+}
+
+static void bench_pool_pstrcat(unsigned long iters, void *data) {
+  pool *p = data, *sub_pool;
+  register unsigned long i;
+
+  sub_pool = make_sub_pool(p);
+
+  for (i = 0; i < iters; i++) {
+    bench_use(pstrcat(sub_pool, "/home/ftp/", "users/", "example", "/",
+      "upload.dat", NULL));
+
+    if ((i & 1023) == 1023) {
+      destroy_pool(sub_pool);
+      sub_pool = make_sub_pool(p);
+    }
+  }
+
+  destroy_pool(sub_pool);
+}
+
+/* The cmd_rec life cycle: a pool per command, as per pr_cmd_read(). */
+static void bench_pool_cmd_lifecycle(unsigned long iters, void *data) {
+  pool *p = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    pool *cmd_pool;
+    cmd_rec *cmd;
+
+    cmd_pool = make_sub_pool(p);
+    cmd = pr_cmd_alloc(cmd_pool, 2, pstrdup(cmd_pool, "RETR"),
+      pstrdup(cmd_pool, "file.txt"));
+    cmd->arg = pstrdup(cmd->pool, "file.txt");
+    bench_use(cmd);
+    destroy_pool(cmd_pool);
+  }
+}
+
+int bench_pool(pool *p) {
+  bench_run("make_sub_pool+destroy_pool", 500000, bench_pool_subpool, p);
+  bench_run("palloc(32)", 5000000, bench_pool_palloc_small, p);
+  bench_run("pcalloc(8192)", 500000, bench_pool_pcalloc_block, p);
+  bench_run("pstrcat(5 strings)", 2000000, bench_pool_pstrcat, p);
+  bench_run("cmd_rec alloc+destroy", 300000, bench_pool_cmd_lifecycle, p);
+  return 0;
+}
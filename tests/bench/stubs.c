@@ -0,0 +1,113 @@
+/*
+ * ProFTPD - FTP server API benchmarks
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+#include "bench.h"
+
+/* Stubs
+ *
+ * Unlike the API tests, the benchmarks link the real src/dirtree.o (for
+ * dir_check()), and thus need not stub out init_dirtree(), main_server, et al.
+ * These stubs do nothing, so that they do not distort the measurements.
+ */
+
+session_t session;
+
+unsigned char is_master = FALSE;
+unsigned int recvd_signal_flags = 0;
+pid_t mpid = 1;
+module *static_modules[] = { NULL };
+module *loaded_modules = NULL;
+
+int pr_cmd_dispatch(cmd_rec *cmd) {
+  return 0;
+}
+
+int pr_cmd_read(cmd_rec **cmd) {
+  *cmd = NULL;
+  return 0;
+}
+
+int pr_ctrls_unregister(module *m, const char *action) {
+  return 0;
+}
+
+void pr_log_auth(int level, const char *fmt, ...) {
+}
+
+void pr_log_debug(int level, const char *fmt, ...) {
+}
+
+int pr_log_event_generate(unsigned int log_type, int log_fd, int log_level,
+    const char *log_msg, size_t log_msglen) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_log_event_listening(unsigned int log_type) {
+  return FALSE;
+}
+
+void pr_log_pri(int prio, const char *fmt, ...) {
+}
+
+int pr_log_openfile(const char *log_file, int *log_fd, mode_t log_mode) {
+  errno = ENOSYS;
+  return -1;
+}
+
+void pr_log_stacktrace(int fd, const char *name) {
+}
+
+int pr_proctitle_get(char *buf, size_t buflen) {
+  errno = ENOSYS;
+  return -1;
+}
+
+void pr_proctitle_set(const char *fmt, ...) {
+}
+
+void pr_proctitle_set_str(const char *str) {
+}
+
+void pr_session_disconnect(module *m, int reason_code, const char *details) {
+}
+
+const char *pr_session_get_disconnect_reason(const char **details) {
+  if (details != NULL) {
+    *details = NULL;
+  }
+
+  return "benchmarking";
+}
+
+const char *pr_session_get_protocol(int flags) {
+  return "ftp";
+}
+
+int pr_session_set_idle(void) {
+  return 0;
+}
+
+void pr_signals_handle(void) {
+}
@@ -0,0 +1,140 @@
+/*
+ * ProFTPD - FTP server API benchmarks
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Table API benchmarks */
+
+#include "bench.h"
+
+#define BENCH_TABLE_NKEYS	1000
+
+struct bench_table_data {
+  pool *pool;
+  pr_table_t *tab;
+  char **keys;
+  char **missing_keys;
+  unsigned int nkeys;
+};
+
+static void bench_table_get(unsigned long iters, void *data) {
+  struct bench_table_data *btd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    bench_use(pr_table_get(btd->tab, btd->keys[i % btd->nkeys], NULL));
+  }
+}
+
+static void bench_table_get_miss(unsigned long iters, void *data) {
+  struct bench_table_data *btd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    bench_use(pr_table_get(btd->tab, btd->missing_keys[i % btd->nkeys], NULL));
+  }
+}
+
+static void bench_table_set(unsigned long iters, void *data) {
+  struct bench_table_data *btd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    (void) pr_table_set(btd->tab, btd->keys[i % btd->nkeys], "value", 0);
+  }
+}
+
+/* A short-lived table, as used for e.g. cmd->notes. */
+static void bench_table_alloc_add(unsigned long iters, void *data) {
+  struct bench_table_data *btd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    pool *tmp_pool;
+    pr_table_t *tab;
+    register unsigned int j;
+
+    tmp_pool = make_sub_pool(btd->pool);
+    tab = pr_table_nalloc(tmp_pool, 0, 8);
+
+    for (j = 0; j < 8; j++) {
+      (void) pr_table_add(tab, btd->keys[j], "value", 0);
+    }
+
+    bench_use(pr_table_get(tab, btd->keys[3], NULL));
+    destroy_pool(tmp_pool);
+  }
+}
+
+static void bench_table_iterate(unsigned long iters, void *data) {
+  struct bench_table_data *btd = data;
+  register unsigned long i;
+
+  for (i = 0; i < iters; i++) {
+    const void *key;
+
+    (void) pr_table_rewind(btd->tab);
+
+    key = pr_table_next(btd->tab);
+    while (key != NULL) {
+      bench_use(key);
+      key = pr_table_next(btd->tab);
+    }
+  }
+}
+
+int bench_table(pool *p) {
+  struct bench_table_data *btd;
+  register unsigned int i;
+
+  btd = pcalloc(p, sizeof(struct bench_table_data));
+  btd->pool = p;
+  btd->nkeys = BENCH_TABLE_NKEYS;
+  btd->keys = pcalloc(p, btd->nkeys * sizeof(char *));
+  btd->missing_keys = pcalloc(p, btd->nkeys * sizeof(char *));
+  btd->tab = pr_table_alloc(p, 0);
+
+  for (i = 0; i < btd->nkeys; i++) {
+    char buf[64];
+
+    snprintf(buf, sizeof(buf)-1, "mod_bench.key-%u", i);
+    btd->keys[i] = pstrdup(p, buf);
+
+    snprintf(buf, sizeof(buf)-1, "mod_bench.missing-%u", i);
+    btd->missing_keys[i] = pstrdup(p, buf);
+
+    if (pr_table_add(btd->tab, btd->keys[i], "value", 0) < 0) {
+      return -1;
+    }
+  }
+
+  bench_run("pr_table_get (1000 keys, hit)", 2000000, bench_table_get, btd);
+  bench_run("pr_table_get (1000 keys, miss)", 2000000, bench_table_get_miss,
+    btd);
+  bench_run("pr_table_set (1000 keys)", 1000000, bench_table_set, btd);
+  bench_run("pr_table_nalloc+8 adds+get", 200000, bench_table_alloc_add, btd);
+  bench_run("pr_table_next (1000 keys)", 2000, bench_table_iterate, btd);
+
+  (void) pr_table_empty(btd->tab);
+  (void) pr_table_free(btd->tab);
+  return 0;
+}
@@ -0,0 +1,590 @@
+package ProFTPD::Tests::Config::ListStreaming;
+
+use lib qw(t/lib);
+use base qw(ProFTPD::TestSuite::Child);
+use strict;
+
+use File::Path qw(mkpath);
+use File::Spec;
+use IO::Handle;
+
+use ProFTPD::TestSuite::FTP;
+use ProFTPD::TestSuite::Utils qw(:auth :config :running :test :testsuite);
+
+$| = 1;
+
+my $order = 0;
+
+my $TESTS = {
+  liststreaming_sorted => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  liststreaming_opt_t => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  liststreaming_opt_U => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  liststreaming_opt_R => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  liststreaming_bad_tmpdir => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+};
+
+sub new {
+  return shift()->SUPER::new(@_);
+}
+
+sub list_tests {
+  return testsuite_get_runnable_tests($TESTS);
+}
+
+# Creates the given number of files in the given directory, with names that
+# readdir(3) is unlikely to return in order, and with distinct mtimes (the
+# lowest-numbered file being the newest).
+sub create_files {
+  my $dir = shift;
+  my $nfiles = shift;
+
+  my $now = time();
+  my $names = [];
+
+  for (my $i = 0; $i < $nfiles; $i++) {
+    my $name = sprintf("%05d-%s.txt", $i, ('x' x ($i % 17)));
+    my $path = File::Spec->rel2abs("$dir/$name");
+
+    if (open(my $fh, "> $path")) {
+      print $fh "Hello, World!\n";
+      unless (close($fh)) {
+        die("Can't write $path: $!");
+      }
+
+      my $mtime = $now - ($i * 60);
+      unless (utime($mtime, $mtime, $path)) {
+        die("Can't change mtime for $path: $!");
+      }
+
+    } else {
+      die("Can't open $path: $!");
+    }
+
+    push(@$names, $name);
+  }
+
+  return $names;
+}
+
+# Returns the names, in order, from the given LIST output.
+sub list_names {
+  my $buf = shift;
+
+  my $names = [];
+  foreach my $line (split(/\r?\n/, $buf)) {
+    if ($line =~ /^\S+\s+\d+\s+\S+\s+\S+\s+.*?\s+(\S+)$/) {
+      push(@$names, $1);
+    }
+  }
+
+  return $names;
+}
+
+# Runs the given LIST, and returns its output.
+sub list_run {
+  my $self = shift;
+  my $setup = shift;
+  my $port = shift;
+  my $path = shift;
+
+  my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+  $client->login($setup->{user}, $setup->{passwd});
+
+  my $conn = $client->list_raw($path);
+  unless ($conn) {
+    die("Failed to LIST: " . $client->response_code() . " " .
+      $client->response_msg());
+  }
+
+  my $buf = '';
+  my $tmp;
+  while ($conn->read($tmp, 8192, 25)) {
+    $buf .= $tmp;
+  }
+  eval { $conn->close() };
+
+  my $resp_code = $client->response_code();
+  my $resp_msg = $client->response_msg();
+  $self->assert_transfer_ok($resp_code, $resp_msg);
+
+  $client->quit();
+  return $buf;
+}
+
+sub liststreaming_config {
+  my $setup = shift;
+
+  # A small maxmem, so that the listings are sorted using temporary files.
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'data:15',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    ListStreaming => 'on maxmem 65536',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  return $config;
+}
+
+sub liststreaming_sorted {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'config');
+
+  my $test_dir = File::Spec->rel2abs("$tmpdir/test.d");
+  mkpath($test_dir);
+  my $test_files = create_files($test_dir, 2000);
+
+  if ($< == 0) {
+    unless (chown($setup->{uid}, $setup->{gid}, $test_dir)) {
+      die("Can't set owner of $test_dir to $setup->{uid}/$setup->{gid}: $!");
+    }
+  }
+
+  my $config = liststreaming_config($setup);
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $buf = $self->list_run($setup, $port, 'test.d');
+      my $res = list_names($buf);
+
+      my $expected = [sort { $a cmp $b } @$test_files];
+
+      my $nexpected = scalar(@$expected);
+      my $nres = scalar(@$res);
+      $self->assert($nexpected == $nres,
+        test_msg("Expected $nexpected items, got $nres"));
+
+      for (my $i = 0; $i < $nexpected; $i++) {
+        $self->assert($expected->[$i] eq $res->[$i],
+          test_msg("Expected '$expected->[$i]' at index $i, got '$res->[$i]'"));
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  eval {
+    # Make sure that the listing was sorted using temporary files.
+    if (open(my $fh, "< $setup->{log_file}")) {
+      my $spilled = 0;
+
+      while (my $line = <$fh>) {
+        if ($line =~ /spilled \d+ listing records/) {
+          $spilled = 1;
+          last;
+        }
+      }
+
+      close($fh);
+      $self->assert($spilled, test_msg("Expected spilled listing records"));
+
+    } else {
+      die("Can't read $setup->{log_file}: $!");
+    }
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub liststreaming_opt_t {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'config');
+
+  my $test_dir = File::Spec->rel2abs("$tmpdir/test.d");
+  mkpath($test_dir);
+  my $test_files = create_files($test_dir, 2000);
+
+  if ($< == 0) {
+    unless (chown($setup->{uid}, $setup->{gid}, $test_dir)) {
+      die("Can't set owner of $test_dir to $setup->{uid}/$setup->{gid}: $!");
+    }
+  }
+
+  my $config = liststreaming_config($setup);
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Newest first, i.e. in creation order; and oldest first, for -r.
+      my $buf = $self->list_run($setup, $port, '-t test.d');
+      my $res = list_names($buf);
+
+      my $expected = $test_files;
+      my $nexpected = scalar(@$expected);
+      my $nres = scalar(@$res);
+      $self->assert($nexpected == $nres,
+        test_msg("Expected $nexpected items, got $nres"));
+
+      for (my $i = 0; $i < $nexpected; $i++) {
+        $self->assert($expected->[$i] eq $res->[$i],
+          test_msg("Expected '$expected->[$i]' at index $i, got '$res->[$i]'"));
+      }
+
+      $buf = $self->list_run($setup, $port, '-tr test.d');
+      $res = list_names($buf);
+
+      $expected = [reverse(@$test_files)];
+      $nres = scalar(@$res);
+      $self->assert($nexpected == $nres,
+        test_msg("Expected $nexpected items, got $nres"));
+
+      for (my $i = 0; $i < $nexpected; $i++) {
+        $self->assert($expected->[$i] eq $res->[$i],
+          test_msg("Expected '$expected->[$i]' at index $i, got '$res->[$i]'"));
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub liststreaming_opt_U {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'config');
+
+  my $test_dir = File::Spec->rel2abs("$tmpdir/test.d");
+  mkpath($test_dir);
+  my $test_files = create_files($test_dir, 2000);
+
+  if ($< == 0) {
+    unless (chown($setup->{uid}, $setup->{gid}, $test_dir)) {
+      die("Can't set owner of $test_dir to $setup->{uid}/$setup->{gid}: $!");
+    }
+  }
+
+  my $config = liststreaming_config($setup);
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $buf = $self->list_run($setup, $port, '-U test.d');
+
+      # Unsorted listings are in directory order, so only compare the
+      # names listed.
+      my $res = [sort { $a cmp $b } @{ list_names($buf) }];
+      my $expected = [sort { $a cmp $b } @$test_files];
+
+      my $nexpected = scalar(@$expected);
+      my $nres = scalar(@$res);
+      $self->assert($nexpected == $nres,
+        test_msg("Expected $nexpected items, got $nres"));
+
+      for (my $i = 0; $i < $nexpected; $i++) {
+        $self->assert($expected->[$i] eq $res->[$i],
+          test_msg("Expected '$expected->[$i]' at index $i, got '$res->[$i]'"));
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub liststreaming_opt_R {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'config');
+
+  my $test_dir = File::Spec->rel2abs("$tmpdir/test.d");
+  foreach my $dir (qw(b.d a.d a.d/c.d)) {
+    mkpath("$test_dir/$dir");
+  }
+
+  create_files($test_dir, 200);
+  create_files("$test_dir/a.d", 10);
+  create_files("$test_dir/b.d", 10);
+  create_files("$test_dir/a.d/c.d", 10);
+
+  if ($< == 0) {
+    foreach my $dir ($test_dir, "$test_dir/a.d", "$test_dir/b.d",
+        "$test_dir/a.d/c.d") {
+      unless (chown($setup->{uid}, $setup->{gid}, $dir)) {
+        die("Can't set owner of $dir to $setup->{uid}/$setup->{gid}: $!");
+      }
+    }
+  }
+
+  my $config = liststreaming_config($setup);
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $buf = $self->list_run($setup, $port, '-R test.d');
+
+      # The subdirectories are listed, depth first, in name order.
+      my $res = [];
+      foreach my $line (split(/\r?\n/, $buf)) {
+        if ($line =~ /^(\S+):$/) {
+          push(@$res, $1);
+        }
+      }
+
+      my $expected = ['test.d/a.d', 'test.d/a.d/c.d', 'test.d/b.d'];
+
+      my $nexpected = scalar(@$expected);
+      my $nres = scalar(@$res);
+      $self->assert($nexpected == $nres,
+        test_msg("Expected $nexpected subdirectories, got $nres"));
+
+      for (my $i = 0; $i < $nexpected; $i++) {
+        $self->assert($expected->[$i] eq $res->[$i],
+          test_msg("Expected '$expected->[$i]' at index $i, got '$res->[$i]'"));
+      }
+
+      $res = list_names($buf);
+
+      # 200 files and two directories, plus 10 files in each subdirectory,
+      # and the c.d directory.
+      $expected = 200 + 2 + 30 + 1;
+      $nres = scalar(@$res);
+      $self->assert($expected == $nres,
+        test_msg("Expected $expected items, got $nres"));
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub liststreaming_bad_tmpdir {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'config');
+
+  my $test_dir = File::Spec->rel2abs("$tmpdir/test.d");
+  mkpath($test_dir);
+  my $test_files = create_files($test_dir, 2000);
+
+  if ($< == 0) {
+    unless (chown($setup->{uid}, $setup->{gid}, $test_dir)) {
+      die("Can't set owner of $test_dir to $setup->{uid}/$setup->{gid}: $!");
+    }
+  }
+
+  # Listings are sorted in memory, if the tmpdir cannot be used.
+  my $config = liststreaming_config($setup);
+  $config->{ListStreaming} .= " tmpdir $tmpdir/no-such-dir";
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $buf = $self->list_run($setup, $port, 'test.d');
+      my $res = list_names($buf);
+
+      my $expected = [sort { $a cmp $b } @$test_files];
+
+      my $nexpected = scalar(@$expected);
+      my $nres = scalar(@$res);
+      $self->assert($nexpected == $nres,
+        test_msg("Expected $nexpected items, got $nres"));
+
+      for (my $i = 0; $i < $nexpected; $i++) {
+        $self->assert($expected->[$i] eq $res->[$i],
+          test_msg("Expected '$expected->[$i]' at index $i, got '$res->[$i]'"));
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+1;
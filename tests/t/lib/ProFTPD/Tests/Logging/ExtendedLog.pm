@@ -462,6 +462,11 @@ my $TESTS = {
     test_class => [qw(bug forking)],
   },
 
+  extlog_buffer_fifo_long_line => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
   # XXX Need unit tests for all LogFormat variables
 };
 
@@ -15030,4 +15035,141 @@ sub extlog_write_invalid_cmd_bug4313 {
   test_cleanup($setup->{log_file}, $ex);
 }
 
+sub extlog_buffer_fifo_long_line {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'extlog');
+
+  my $fifo = File::Spec->rel2abs("$tmpdir/custom.fifo");
+  unless (POSIX::mkfifo($fifo, 0644)) {
+    die("Can't create FIFO $fifo: $!");
+  }
+
+  my $ext_log = File::Spec->rel2abs("$tmpdir/custom.log");
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'extlog:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      # Note: we need to use arrays here, since order of directives matters.
+      'mod_log.c' => [
+        'LogFormat custom "%r %r"',
+        "ExtendedLog $fifo ALL custom",
+
+        # The buffer for a FIFO is capped at PIPE_BUF bytes, which is shorter
+        # than the line logged for our CWD command.
+        'ExtendedLogBuffer 65536',
+      ],
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Copy everything written to the FIFO into a regular file; we are done
+  # once the session process, the only writer, closes it.
+  defined(my $reader_pid = fork()) or die("Can't fork: $!");
+  if ($reader_pid == 0) {
+    open(my $in, "< $fifo") or exit 1;
+    open(my $out, "> $ext_log") or exit 1;
+
+    my $buf;
+    while (sysread($in, $buf, 65536)) {
+      print $out $buf;
+    }
+
+    close($out);
+    close($in);
+    exit 0;
+  }
+
+  # Long enough that the logged line exceeds PIPE_BUF, but not so long that
+  # it is truncated.
+  my $path = 'd' x 2090;
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+      eval { $client->cwd($path) };
+      $client->quit();
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  waitpid($reader_pid, 0);
+
+  eval {
+    if (open(my $fh, "< $ext_log")) {
+      my $expected = "CWD $path CWD $path";
+      my $ok = 0;
+
+      while (my $line = <$fh>) {
+        chomp($line);
+
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "# line: ", length($line), " bytes\n";
+        }
+
+        if ($line eq $expected) {
+          $ok = 1;
+        }
+      }
+
+      close($fh);
+      $self->assert($ok, "Expected ExtendedLog line for CWD not found");
+
+    } else {
+      die("Can't read $ext_log: $!");
+    }
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
 1;
@@ -157,6 +157,21 @@ my $TESTS = {
     test_class => [qw(forking)],
   },
 
+  digest_xsha1_persistent_cache => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  digest_xsha1_persistent_cache_same_size_rewrite => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  digest_xsha1_persistent_cache_forged => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
   digest_xsha256 => {
     order => ++$order,
     test_class => [qw(forking)],
@@ -3809,6 +3824,426 @@ sub digest_xsha1 {
   test_cleanup($setup->{log_file}, $ex);
 }
 
+sub digest_xsha1_persistent_cache {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'digest');
+
+  require Digest::SHA1;
+
+  my $test_file = File::Spec->rel2abs("$tmpdir/test.txt");
+  if (open(my $fh, "> $test_file")) {
+    print $fh "Hello, World!\n";
+    unless (close($fh)) {
+      die("Can't write $test_file: $!");
+    }
+
+  } else {
+    die("Can't open $test_file: $!");
+  }
+
+  my $expected_digest;
+
+  if (open(my $fh, "< $test_file")) {
+    my $ctx = Digest::SHA1->new();
+    $ctx->addfile($fh);
+    $expected_digest = uc($ctx->hexdigest);
+    close($fh);
+
+  } else {
+    die("Can't read $test_file: $!");
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'digest:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_digest.c' => {
+        DigestEngine => 'on',
+        DigestOptions => 'PersistentCache',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow server to start up
+      sleep(1);
+
+      # Use separate sessions, so that the second digest can only come from
+      # the persistent cache, not the per-session cache.
+      for (my $i = 0; $i < 2; $i++) {
+        my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port, 0, 1);
+        $client->login($setup->{user}, $setup->{passwd});
+        my ($resp_code, $resp_msg) = $client->quote('XSHA1', 'test.txt');
+        $client->quit();
+
+        my $expected;
+
+        $expected = 250;
+        $self->assert($expected == $resp_code,
+          test_msg("Expected response code $expected, got $resp_code"));
+
+        $expected = $expected_digest;
+        $self->assert($expected eq $resp_msg,
+          test_msg("Expected response message '$expected', got '$resp_msg'"));
+      }
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  eval {
+    if (open(my $fh, "< $setup->{log_file}")) {
+      my $stored = 0;
+      my $unsupported = 0;
+      my $used = 0;
+
+      while (my $line = <$fh>) {
+        chomp($line);
+
+        if ($line =~ /stored SHA1 digest '\S+' for/) {
+          $stored = 1;
+
+        } elsif ($line =~ /error storing SHA1 digest .*(not supported|Operation not permitted)/) {
+          $unsupported = 1;
+
+        } elsif ($line =~ /using stored SHA1 digest/) {
+          $used = 1;
+        }
+      }
+
+      close($fh);
+
+      # The filesystem used for the test may not support user xattrs.
+      unless ($unsupported) {
+        $self->assert($stored, test_msg("Expected digest to be stored"));
+        $self->assert($used, test_msg("Expected stored digest to be used"));
+      }
+
+    } else {
+      die("Can't read $setup->{log_file}: $!");
+    }
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub digest_xsha1_persistent_cache_same_size_rewrite {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'digest');
+
+  require Digest::SHA1;
+
+  my $test_file = File::Spec->rel2abs("$tmpdir/test.txt");
+  if (open(my $fh, "> $test_file")) {
+    print $fh "Hello, World!\n";
+    unless (close($fh)) {
+      die("Can't write $test_file: $!");
+    }
+
+  } else {
+    die("Can't open $test_file: $!");
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'digest:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_digest.c' => {
+        DigestEngine => 'on',
+        DigestOptions => 'PersistentCache',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow server to start up
+      sleep(1);
+
+      foreach my $text ("Hello, World!\n", "Jello, World!\n") {
+        if ($text ne "Hello, World!\n") {
+          # Rewrite the file with the same size, and restore its timestamps
+          # (to the nanosecond), using "touch -r".
+          my $ref_file = File::Spec->rel2abs("$tmpdir/ref.txt");
+          if (system('touch', '-r', $test_file, $ref_file) != 0) {
+            die("Can't copy timestamps of $test_file");
+          }
+
+          # Wait until any change is clearly after the digest was stored.
+          sleep(1);
+
+          if (open(my $fh, "> $test_file")) {
+            print $fh $text;
+            unless (close($fh)) {
+              die("Can't write $test_file: $!");
+            }
+
+          } else {
+            die("Can't open $test_file: $!");
+          }
+
+          if (system('touch', '-r', $ref_file, $test_file) != 0) {
+            die("Can't restore timestamps of $test_file");
+          }
+        }
+
+        my $ctx = Digest::SHA1->new();
+        $ctx->add($text);
+        my $expected_digest = uc($ctx->hexdigest);
+
+        my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port, 0, 1);
+        $client->login($setup->{user}, $setup->{passwd});
+        my ($resp_code, $resp_msg) = $client->quote('XSHA1', 'test.txt');
+        $client->quit();
+
+        my $expected;
+
+        $expected = 250;
+        $self->assert($expected == $resp_code,
+          test_msg("Expected response code $expected, got $resp_code"));
+
+        $expected = $expected_digest;
+        $self->assert($expected eq $resp_msg,
+          test_msg("Expected response message '$expected', got '$resp_msg'"));
+      }
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub digest_xsha1_persistent_cache_forged {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'digest');
+
+  require Digest::SHA1;
+
+  my $test_file = File::Spec->rel2abs("$tmpdir/test.txt");
+  if (open(my $fh, "> $test_file")) {
+    print $fh "Hello, World!\n";
+    unless (close($fh)) {
+      die("Can't write $test_file: $!");
+    }
+
+  } else {
+    die("Can't open $test_file: $!");
+  }
+
+  my $expected_digest;
+
+  if (open(my $fh, "< $test_file")) {
+    my $ctx = Digest::SHA1->new();
+    $ctx->addfile($fh);
+    $expected_digest = uc($ctx->hexdigest);
+    close($fh);
+
+  } else {
+    die("Can't read $test_file: $!");
+  }
+
+  # Store a forged digest, for the file's current identity, as the file's
+  # owner could.
+  my $attr_name = 'user.proftpd.digest.sha1';
+  my $file_id = `stat -c '%d %i %s %.9Y %.9Z' $test_file`;
+  chomp($file_id);
+  my ($dev, $ino, $size, $mtime, $ctime) = split(' ', $file_id);
+  my ($mtime_secs, $mtime_nsecs) = split(/\./, $mtime);
+  my ($ctime_secs, $ctime_nsecs) = split(/\./, $ctime);
+  my $ctime_min = ($ctime_secs * 1000000000) + $ctime_nsecs - 500000000;
+  my $ctime_max = $ctime_min + 1000000000;
+  my $forged_digest = 'F' x 40;
+  my $forged = "3 $dev $ino $size $mtime_secs " . ($mtime_nsecs + 0) .
+    " $ctime_min $ctime_max $forged_digest " .
+    ('0' x 64);
+
+  if (system('setfattr', '-n', $attr_name, '-v', $forged, $test_file) != 0) {
+    # No setfattr(1), or no extended attribute support.
+    test_cleanup($setup->{log_file});
+    return;
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'digest:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_digest.c' => {
+        DigestEngine => 'on',
+        DigestOptions => 'PersistentCache',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow server to start up
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port, 0, 1);
+      $client->login($setup->{user}, $setup->{passwd});
+      my ($resp_code, $resp_msg) = $client->quote('XSHA1', 'test.txt');
+      $client->quit();
+
+      my $expected;
+
+      $expected = 250;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      $expected = $expected_digest;
+      $self->assert($expected eq $resp_msg,
+        test_msg("Expected response message '$expected', got '$resp_msg'"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
 sub digest_xsha256 {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
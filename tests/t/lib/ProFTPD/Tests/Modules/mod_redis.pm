@@ -67,6 +67,11 @@ my $TESTS = {
     test_class => [qw(forking)],
   },
 
+  redis_broker_log_on_command => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
 };
 
 sub new {
@@ -1343,4 +1348,138 @@ EOC
   test_cleanup($setup->{log_file}, $ex);
 }
 
+sub redis_broker_log_on_command {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'redis');
+
+  my $fmt_name = 'custom';
+  redis_list_delete($fmt_name);
+
+  my $broker_path = File::Spec->rel2abs("$tmpdir/redis.sock");
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'jot:20 redis:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      # Note: we need to use arrays here, since order of directives matters.
+      'mod_redis.c' => [
+        'RedisEngine on',
+        'RedisServer 127.0.0.1:6379',
+        "RedisBroker $broker_path",
+        "RedisLog $setup->{log_file}",
+        "LogFormat $fmt_name \"%a %u\"",
+        "RedisLogOnCommand PASS $fmt_name",
+      ],
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the broker a moment to start listening
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      my $resp_code = $client->response_code();
+      my $resp_msg = $client->response_msg(0);
+      $client->quit();
+
+      my $expected = 230;
+      $self->assert($expected == $resp_code,
+        "Expected response code $expected, got $resp_code");
+
+      $expected = "User $setup->{user} logged in";
+      $self->assert($expected eq $resp_msg,
+        "Expected response message '$expected', got '$resp_msg'");
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  eval {
+    my $data = redis_list_getall($fmt_name);
+
+    my $nrecords = scalar(@$data);
+    $self->assert($nrecords == 1, "Expected 1 record, got $nrecords");
+
+    require JSON;
+    my $record = decode_json($data->[0]);
+
+    my $expected = $setup->{user};
+    $self->assert($record->{user} eq $expected,
+      "Expected user '$expected', got '$record->{user}'");
+
+    if (open(my $fh, "< $setup->{log_file}")) {
+      my $brokered = 0;
+
+      while (my $line = <$fh>) {
+        chomp($line);
+
+        if ($line =~ /broker accepted fd/) {
+          $brokered = 1;
+          last;
+        }
+      }
+
+      close($fh);
+
+      $self->assert($brokered, "Expected session to use Redis broker");
+
+    } else {
+      die("Can't read $setup->{log_file}: $!");
+    }
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
 1;
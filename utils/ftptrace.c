@@ -0,0 +1,267 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project and other respective copyright
+ * holders give permission to link this program with OpenSSL, and distribute
+ * the resulting executable, without including the source code for OpenSSL in
+ * the source distribution.
+ */
+
+/* Renders the binary TraceBuffer files written by proftpd as TraceLog text. */
+
+#include "utils.h"
+
+#ifdef HAVE_INTTYPES_H
+# include <inttypes.h>
+#endif
+
+/* These definitions must match those in include/trace.h. */
+#define UTIL_TRACE_BUFFER_MAGIC			0x50525442
+#define UTIL_TRACE_BUFFER_VERSION		1
+#define UTIL_TRACE_BUFFER_RECORD_SIZE		512
+
+typedef struct {
+  uint32_t tbh_magic;
+  uint32_t tbh_version;
+  uint32_t tbh_pid;
+  uint32_t tbh_flags;
+  uint32_t tbh_record_size;
+  uint32_t tbh_nrecords;
+  uint64_t tbh_next;
+
+} util_trace_buffer_header_t;
+
+#define UTIL_TRACE_BUFFER_FL_CLEAN		0x0001
+
+typedef struct {
+  uint64_t tbr_seqno;
+  int64_t tbr_sec;
+  uint32_t tbr_usec;
+  uint32_t tbr_level;
+  uint32_t tbr_msglen;
+  uint32_t tbr_reserved;
+  char tbr_channel[32];
+
+} util_trace_buffer_record_t;
+
+#define UTIL_TRACE_BUFFER_MSGSZ \
+  (UTIL_TRACE_BUFFER_RECORD_SIZE - sizeof(util_trace_buffer_record_t))
+
+static struct option_help {
+  const char *long_opt, *short_opt, *desc;
+} opts_help[] = {
+  { "--count",	"-n",	"display only the last N records of each file" },
+  { "--help",	"-h",	NULL },
+  { "--verbose","-v",	"display the header of each file" },
+  { NULL }
+};
+
+#ifdef HAVE_GETOPT_LONG
+static struct option opts[] = {
+  { "count",   1, NULL, 'n' },
+  { "help",    0, NULL, 'h' },
+  { "verbose", 0, NULL, 'v' },
+  { NULL,      0, NULL, 0   }
+};
+#endif /* HAVE_GETOPT_LONG */
+
+static void show_usage(const char *progname, int exit_code) {
+  struct option_help *h = NULL;
+
+  printf("usage: %s [options] file ...\n", progname);
+  for (h = opts_help; h->long_opt; h++) {
+#ifdef HAVE_GETOPT_LONG
+    printf("  %s, %s\n", h->short_opt, h->long_opt);
+#else /* HAVE_GETOPT_LONG */
+    printf("  %s\n", h->short_opt);
+#endif
+    if (h->desc == NULL) {
+      printf("    display %s usage\n", progname);
+
+    } else {
+      printf("    %s\n", h->desc);
+    }
+  }
+
+  exit(exit_code);
+}
+
+static int read_at(int fd, void *buf, size_t len, off_t offset) {
+  ssize_t res;
+
+  if (lseek(fd, offset, SEEK_SET) == (off_t) -1) {
+    return -1;
+  }
+
+  res = read(fd, buf, len);
+  if (res < 0) {
+    return -1;
+  }
+
+  if ((size_t) res != len) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int render_file(const char *path, unsigned long count, int verbose) {
+  util_trace_buffer_header_t hdr;
+  uint64_t rec_buf[UTIL_TRACE_BUFFER_RECORD_SIZE / sizeof(uint64_t)];
+  uint64_t seqno, first;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  if (read_at(fd, &hdr, sizeof(hdr), 0) < 0 ||
+      hdr.tbh_magic != UTIL_TRACE_BUFFER_MAGIC) {
+    fprintf(stderr, "%s: not a TraceBuffer file\n", path);
+    (void) close(fd);
+    return -1;
+  }
+
+  if (hdr.tbh_version != UTIL_TRACE_BUFFER_VERSION ||
+      hdr.tbh_record_size != UTIL_TRACE_BUFFER_RECORD_SIZE ||
+      hdr.tbh_nrecords == 0) {
+    fprintf(stderr, "%s: unsupported TraceBuffer version (%lu)\n", path,
+      (unsigned long) hdr.tbh_version);
+    (void) close(fd);
+    return -1;
+  }
+
+  if (verbose) {
+    printf("# %s: pid %lu, %lu records written, %lu record capacity, %s\n",
+      path, (unsigned long) hdr.tbh_pid, (unsigned long) hdr.tbh_next,
+      (unsigned long) hdr.tbh_nrecords,
+      (hdr.tbh_flags & UTIL_TRACE_BUFFER_FL_CLEAN) ? "ended cleanly" :
+        "running or ended abnormally");
+  }
+
+  first = 0;
+  if (hdr.tbh_next > hdr.tbh_nrecords) {
+    first = hdr.tbh_next - hdr.tbh_nrecords;
+  }
+
+  if (count > 0 &&
+      hdr.tbh_next - first > count) {
+    first = hdr.tbh_next - count;
+  }
+
+  for (seqno = first; seqno < hdr.tbh_next; seqno++) {
+    util_trace_buffer_record_t *rec;
+    char *msg, ts[64];
+    time_t secs;
+    struct tm *tm;
+
+    if (read_at(fd, rec_buf, sizeof(rec_buf),
+        (off_t) ((1 + (seqno % hdr.tbh_nrecords)) *
+          UTIL_TRACE_BUFFER_RECORD_SIZE)) < 0) {
+      break;
+    }
+
+    rec = (util_trace_buffer_record_t *) rec_buf;
+
+    /* Skip any records being written, or overwritten since we read the
+     * header.
+     */
+    if (rec->tbr_seqno != seqno + 1 ||
+        rec->tbr_msglen >= UTIL_TRACE_BUFFER_MSGSZ) {
+      continue;
+    }
+
+    msg = ((char *) rec_buf) + sizeof(util_trace_buffer_record_t);
+    msg[rec->tbr_msglen] = '\0';
+    rec->tbr_channel[sizeof(rec->tbr_channel)-1] = '\0';
+
+    memset(ts, '\0', sizeof(ts));
+    secs = (time_t) rec->tbr_sec;
+    tm = localtime(&secs);
+    if (tm != NULL) {
+      (void) strftime(ts, sizeof(ts)-1, "%Y-%m-%d %H:%M:%S", tm);
+    }
+
+    printf("%s,%03lu [%lu] <%s:%lu>: %s\n", ts,
+      (unsigned long) (rec->tbr_usec / 1000), (unsigned long) hdr.tbh_pid,
+      rec->tbr_channel, (unsigned long) rec->tbr_level, msg);
+  }
+
+  (void) close(fd);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int c = 0, i, verbose = FALSE, nfailed = 0;
+  unsigned long count = 0;
+  char *cp, *progname = *argv;
+  const char *cmdopts = "hn:v";
+
+  cp = strrchr(progname, '/');
+  if (cp != NULL)
+    progname = cp+1;
+
+  opterr = 0;
+  while ((c =
+#ifdef HAVE_GETOPT_LONG
+	 getopt_long(argc, argv, cmdopts, opts, NULL)
+#else /* HAVE_GETOPT_LONG */
+	 getopt(argc, argv, cmdopts)
+#endif /* HAVE_GETOPT_LONG */
+	 ) != -1) {
+    switch (c) {
+      case 'h':
+        show_usage(progname, 0);
+        break;
+
+      case 'n':
+        count = strtoul(optarg, &cp, 10);
+        if (cp == NULL ||
+            *cp != '\0' ||
+            count == 0) {
+          fprintf(stderr, "%s: invalid count: '%s'\n", progname, optarg);
+          exit(1);
+        }
+        break;
+
+      case 'v':
+        verbose = TRUE;
+        break;
+
+      case '?':
+        fprintf(stderr, "unknown option: %c\n", (char) optopt);
+        show_usage(progname, 1);
+        break;
+    }
+  }
+
+  if (optind >= argc) {
+    show_usage(progname, 1);
+  }
+
+  for (i = optind; i < argc; i++) {
+    if (render_file(argv[i], count, verbose) < 0) {
+      nfailed++;
+    }
+  }
+
+  return nfailed == 0 ? 0 : 1;
+}